@@ -79,6 +79,18 @@ function root.wallpaper(pattern)
     end
 end
 
+--- Change the part of the wallpaper inside `area`.
+-- Like `root.wallpaper`, this takes both native and LGI-ified patterns.
+function root.wallpaper_region(pattern, area)
+    local err = pcall(function() return pattern._native end)
+
+    if err and not root._write_string then
+        return root._wallpaper_region(pattern._native, area)
+    else
+        return root._wallpaper_region(pattern, area)
+    end
+end
+
 
 -- root.buttons() used to be a capi function. However this proved confusing
 -- as rc.lua used `awful.button` and `root.buttons()` used capi.button. There
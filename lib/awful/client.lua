@@ -60,6 +60,7 @@ client.dockable = {}
 client.property = {}
 client.shape = require("awful.client.shape")
 client.focus = require("awful.client.focus")
+client.ffi = require("awful.client.ffi")
 
 --- The client default placement on the screen.
 --
@@ -1930,10 +1931,21 @@ end
 do
     local disabled_count = 1
 
+    -- The native history is updated by the C core when a client is focused
+    local function set_tracking(enabled)
+        if capi.client.set_focus_history_tracking then
+            capi.client.set_focus_history_tracking(enabled)
+        elseif enabled then
+            capi.client.connect_signal("focus", client.focus.history.add)
+        else
+            capi.client.disconnect_signal("focus", client.focus.history.add)
+        end
+    end
+
     function client.focus.history.disable_tracking()
         disabled_count = disabled_count + 1
         if disabled_count == 1 then
-            capi.client.disconnect_signal("focus", client.focus.history.add)
+            set_tracking(false)
         end
         return disabled_count
     end
@@ -1942,7 +1954,7 @@ do
         assert(disabled_count > 0)
         disabled_count = disabled_count - 1
         if disabled_count == 0 then
-            capi.client.connect_signal("focus", client.focus.history.add)
+            set_tracking(true)
         end
         return disabled_count == 0
     end
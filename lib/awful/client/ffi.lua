@@ -0,0 +1,155 @@
+---------------------------------------------------------------------------
+--- Read the hot fields of clients without leaving JIT-compiled code.
+--
+-- `c.x` and the other properties go through the C API, which LuaJIT cannot
+-- compile into a trace. The functions of this module read a copy of the
+-- geometry, screen, `minimized` and `hidden` of a client through the FFI
+-- instead, so that loops over many clients (layouts, placement) stay compiled.
+-- The values are read-only and always equal to the properties. Without the FFI
+-- (or for clients that were unmanaged) the properties are used.
+--
+-- @submodule client
+---------------------------------------------------------------------------
+
+local has_ffi, ffi = pcall(require, "ffi")
+
+local module = {}
+
+--- Whether the fields are read through the FFI.
+-- @tfield boolean awful.client.ffi.enabled
+module.enabled = has_ffi
+
+local views = setmetatable({}, { __mode = "k" })
+
+-- The screen objects by the address of their C structure
+local screens = setmetatable({}, { __mode = "v" })
+
+local view
+if has_ffi then
+    -- Has to match struct client_ffi_view in src/objects/client.h
+    ffi.cdef[[
+        struct awesome_client_ffi_view {
+            int32_t x, y, width, height;
+            uint64_t screen;
+            uint8_t minimized, hidden;
+            uint8_t valid;
+        };
+    ]]
+    local view_ptr = ffi.typeof("const struct awesome_client_ffi_view *")
+
+    view = function(c)
+        local v = views[c]
+        if not v then
+            v = ffi.cast(view_ptr, c:_ffi_view())
+            views[c] = v
+        end
+        if v.valid ~= 0 then
+            return v
+        end
+    end
+else
+    view = function() end
+end
+
+--- Get the geometry of a client.
+--
+-- Unlike `client.geometry`, no table is created.
+--
+-- @function awful.client.ffi.geometry
+-- @tparam client c The client.
+-- @treturn integer x
+-- @treturn integer y
+-- @treturn integer width
+-- @treturn integer height
+function module.geometry(c)
+    local v = view(c)
+    if v then
+        return v.x, v.y, v.width, v.height
+    end
+    return c.x, c.y, c.width, c.height
+end
+
+--- Get the x coordinate of a client, like `c.x`.
+-- @function awful.client.ffi.x
+-- @tparam client c The client.
+-- @treturn integer
+function module.x(c)
+    local v = view(c)
+    return v and v.x or c.x
+end
+
+--- Get the y coordinate of a client, like `c.y`.
+-- @function awful.client.ffi.y
+-- @tparam client c The client.
+-- @treturn integer
+function module.y(c)
+    local v = view(c)
+    return v and v.y or c.y
+end
+
+--- Get the width of a client, like `c.width`.
+-- @function awful.client.ffi.width
+-- @tparam client c The client.
+-- @treturn integer
+function module.width(c)
+    local v = view(c)
+    return v and v.width or c.width
+end
+
+--- Get the height of a client, like `c.height`.
+-- @function awful.client.ffi.height
+-- @tparam client c The client.
+-- @treturn integer
+function module.height(c)
+    local v = view(c)
+    return v and v.height or c.height
+end
+
+--- Get whether a client is minimized, like `c.minimized`.
+-- @function awful.client.ffi.minimized
+-- @tparam client c The client.
+-- @treturn boolean
+function module.minimized(c)
+    local v = view(c)
+    if v then
+        return v.minimized ~= 0
+    end
+    return c.minimized
+end
+
+--- Get whether a client is hidden, like `c.hidden`.
+-- @function awful.client.ffi.hidden
+-- @tparam client c The client.
+-- @treturn boolean
+function module.hidden(c)
+    local v = view(c)
+    if v then
+        return v.hidden ~= 0
+    end
+    return c.hidden
+end
+
+--- Get the screen of a client, like `c.screen`.
+--
+-- Only the first lookup of every screen goes through `c.screen`.
+--
+-- @function awful.client.ffi.screen
+-- @tparam client c The client.
+-- @treturn screen
+function module.screen(c)
+    local v = view(c)
+    if not v then
+        return c.screen
+    end
+    local key = tonumber(v.screen)
+    local s = screens[key]
+    if not s then
+        s = c.screen
+        screens[key] = s
+    end
+    return s
+end
+
+return module
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
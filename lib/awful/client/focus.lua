@@ -38,6 +38,24 @@ end
 
 local focus = {history = {list = {}}}
 
+-- The history is kept natively when the C API is there, `history.list` is
+-- then a snapshot built when it is read.
+local native = capi.client and capi.client.focus_history and true or false
+
+if native then
+    focus.history.list = nil
+    setmetatable(focus.history, {
+        __index = function(_, k)
+            if k ~= "list" then return end
+            local list = {}
+            for c in capi.client.focus_history() do
+                table.insert(list, c)
+            end
+            return list
+        end
+    })
+end
+
 local function get_screen(s)
     return s and capi.screen[s]
 end
@@ -47,6 +65,10 @@ end
 -- @tparam client c The client that must be removed.
 -- @function awful.client.focus.history.delete
 function focus.history.delete(c)
+    if native then
+        capi.client.focus_history_delete(c)
+        return
+    end
     for k, v in ipairs(focus.history.list) do
         if v == c then
             table.remove(focus.history.list, k)
@@ -94,12 +116,40 @@ end
 -- @tparam client c The client that has been focused.
 -- @function awful.client.focus.history.add
 function focus.history.add(c)
+    if native then
+        capi.client.focus_history_add(c)
+        return
+    end
     -- Remove the client if its in stack
     focus.history.delete(c)
     -- Record the client has latest focused
     table.insert(focus.history.list, 1, c)
 end
 
+-- focus.history.get() on the history kept by the C core
+local function native_history_get(s, idx, filter)
+    local counter = 0
+    if s then
+        -- Only the visible clients of the screen are returned
+        for c in capi.client.focus_history(s, nil, true) do
+            if not filter or filter(c) then
+                if counter == idx then
+                    return c
+                end
+                counter = counter + 1
+            end
+        end
+    end
+    filter = filter or focus.filter
+    if counter == 0 then
+        for _, v in ipairs(client.visible(s, true)) do
+            if filter(v) then
+                return v
+            end
+        end
+    end
+end
+
 --- Get the latest focused client for a screen in history.
 --
 -- @tparam int|screen s The screen to look for.
@@ -112,6 +162,9 @@ end
 -- @function awful.client.focus.history.get
 function focus.history.get(s, idx, filter)
     s = get_screen(s)
+    if native then
+        return native_history_get(s, idx, filter)
+    end
     -- When this counter is equal to idx, we return the client
     local counter = 0
     local vc = client.visible(s, true)
@@ -150,6 +150,10 @@ local function grabber(mod, key, event)
 end
 
 local function stop(self, stop_key, stop_mods)
+    if self.chords then
+        capi.keygrabber.chords()
+    end
+
     keygrab.stop(self.grabber)
 
     local timer = self._private.timer
@@ -416,6 +420,29 @@ end
 -- @propertytype table Only some keys are allowed.
 -- @tablerowtype A list of key names, such as `"Control"` or `"a"`.
 
+--- Chords matched natively while the keygrabber runs.
+--
+-- This is a trie of key steps, such as VI-like modal keybindings. Each key is
+-- a step written as the modifiers and the key name, like `"Mod4+Shift+X"` or
+-- `"g"`. Lock and Mod2 (Num Lock) are ignored. A value that is a table holds
+-- the steps that may follow, anything else ends the chord:
+--
+--    chords = {
+--        g = { g = "top", t = "next_tag" },
+--        ["Shift+G"] = "bottom",
+--    }
+--
+-- The keys of a chord are matched in C and reach neither the signals nor the
+-- other callbacks of the keygrabber. Only the end of a chord calls into Lua,
+-- through `chord_callback`. Keys that do not start a chord are handled as
+-- usual.
+--
+-- @property chords
+-- @tparam[opt=nil] table|nil chords
+-- @propertytype nil No chords.
+-- @propertytype table A trie of steps.
+-- @see chord_callback
+
 --- The sequence of keys recorded since the start of the keygrabber.
 --
 -- In this example, the `stop_callback` is used to retrieve the final key
@@ -480,6 +507,21 @@ function keygrabber:start()
 
     self.grabber = keygrab.run(function(...) return runner(self, ...) end)
 
+    if self.chords then
+        capi.keygrabber.chords(self.chords, function(value, steps)
+            -- A chord counts as activity for the timeout
+            if self._private.timer and self._private.timer.started then
+                self._private.timer:again()
+            end
+
+            if self.chord_callback then
+                self.chord_callback(self.current_instance, value, steps)
+            elseif type(value) == "function" then
+                value(self.current_instance, steps)
+            end
+        end)
+    end
+
     -- Ease making keygrabber that won't hang forever if no action is taken.
     if self.timeout and not self._private.timer then
         self._private.timer = gtimer {
@@ -665,6 +707,18 @@ end
 -- @tparam awful.key key The keybinding.
 -- @tparam string event Either `"press"` or `"release"`.
 
+--- The function called when a chord from `chords` ends.
+--
+-- Without it, values of `chords` that are functions are called with the
+-- current transaction object and the steps.
+--
+-- @callback chord_callback
+-- @tparam table self The current transaction object.
+-- @param value The value of the chord, nil when a key did not continue the
+--  chord that was started.
+-- @tparam table steps The steps of the chord, like `{ "g", "t" }`.
+-- @see chords
+
 --- A function called when a keygrabber starts.
 -- @callback start_callback
 -- @tparam keygrabber keygrabber The keygrabber.
@@ -259,13 +259,15 @@ function layout.arrange(screen)
 
             p.geometries = setmetatable({}, {__mode = "k"})
             layout.get(screen).arrange(p)
+            local batch = {}
             for c, g in pairs(p.geometries) do
                 g.width = math.max(1, g.width - c.border_width * 2 - useless_gap * 2)
                 g.height = math.max(1, g.height - c.border_width * 2 - useless_gap * 2)
                 g.x = g.x + useless_gap
                 g.y = g.y + useless_gap
-                c:geometry(g)
+                table.insert(batch, { c, g })
             end
+            capi.client.apply_geometries(batch)
         end)
         arrange_lock = false
         delayed_arrange[screen] = nil
@@ -9,6 +9,7 @@
 -- Grab environment we need
 local ipairs = ipairs
 local math = math
+local capi = { awesome = awesome }
 
 --- The fairh layout layoutbox icon.
 -- @beautiful beautiful.layout_fairh
@@ -22,6 +23,13 @@ local math = math
 
 local fair = {}
 
+-- fairv and fairh come from the C core when it has them, do_fair() is the
+-- fallback and the reference for its results.
+local function native_arrange(name, p)
+    local arrange = capi.awesome and capi.awesome._layout_arrange
+    return arrange and arrange(name, p)
+end
+
 local function do_fair(p, orientation)
     local wa = p.workarea
     local cls = p.clients
@@ -94,6 +102,7 @@ fair.horizontal = {}
 fair.horizontal.name = "fairh"
 
 function fair.horizontal.arrange(p)
+    if native_arrange("fairh", p) then return end
     return do_fair(p, "east")
 end
 
@@ -101,6 +110,7 @@ end
 -- @param screen The screen to arrange.
 fair.name = "fairv"
 function fair.arrange(p)
+    if native_arrange("fairv", p) then return end
     return do_fair(p, "south")
 end
 
@@ -8,6 +8,7 @@
 
 -- Grab environment we need
 local pairs = pairs
+local capi = { awesome = awesome }
 
 local max = {}
 
@@ -21,6 +22,13 @@ local max = {}
 -- @param surface
 -- @see gears.surface
 
+-- Both max suits are placed by the C core when it has awesome._layout_arrange,
+-- fmax() is only used without it, e.g. by the doc example shims.
+local function native_arrange(name, p)
+    local arrange = capi.awesome and capi.awesome._layout_arrange
+    return arrange and arrange(name, p)
+end
+
 local function fmax(p, fs)
     -- Fullscreen?
     local area
@@ -46,6 +54,7 @@ end
 -- @usebeautiful beautiful.layout_max
 max.name = "max"
 function max.arrange(p)
+    if native_arrange("max", p) then return end
     return fmax(p, false)
 end
 function max.skip_gap(nclients, t) -- luacheck: no unused args
@@ -59,6 +68,7 @@ max.fullscreen = {}
 max.fullscreen.name = "fullscreen"
 max.fullscreen.skip_gap = max.skip_gap
 function max.fullscreen.arrange(p)
+    if native_arrange("fullscreen", p) then return end
     return fmax(p, true)
 end
 
@@ -11,6 +11,7 @@
 -- Grab environment we need
 local ipairs = ipairs
 local math = math
+local capi = { awesome = awesome }
 
 --- The spiral layout layoutbox icon.
 -- @beautiful beautiful.layout_spiral
@@ -24,6 +25,13 @@ local math = math
 
 local spiral = {}
 
+-- The C core computes spiral and dwindle with the same rounding as
+-- do_spiral(), which places the clients when it is not there.
+local function native_arrange(name, p)
+    local arrange = capi.awesome and capi.awesome._layout_arrange
+    return arrange and arrange(name, p)
+end
+
 local function do_spiral(p, is_spiral)
     local wa = p.workarea
     local cls = p.clients
@@ -75,6 +83,7 @@ end
 spiral.dwindle = {}
 spiral.dwindle.name = "dwindle"
 function spiral.dwindle.arrange(p)
+    if native_arrange("dwindle", p) then return end
     return do_spiral(p, false)
 end
 
@@ -83,6 +92,7 @@ end
 -- @usebeautiful beautiful.layout_spiral
 spiral.name = "spiral"
 function spiral.arrange(p)
+    if native_arrange("spiral", p) then return end
     return do_spiral(p, true)
 end
 
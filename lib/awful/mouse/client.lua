@@ -5,12 +5,31 @@
 -- @submodule mouse
 
 local aplace = require("awful.placement")
-local capi = { mouse = mouse, client = client }
+local capi = { mouse = mouse, client = client, mousegrabber = mousegrabber }
 local mresize = require("awful.mouse.resize")
 local gdebug = require("gears.debug")
+local beautiful = require("beautiful")
+local floating = require("awful.layout.suit.floating")
 
 local module = {}
 
+--- Move and resize floating clients natively.
+--
+-- When enabled, `awful.mouse.client.move` and `awful.mouse.client.resize` of
+-- floating clients use `mousegrabber.move_resize`, which applies the geometry
+-- without running Lua for every pointer motion. The `awful.mouse.resize`
+-- callbacks, such as aerosnap and dragging to tags, are not run then.
+--
+-- @tfield[opt=false] boolean awful.mouse.client.native
+-- @tparam boolean native
+
+module.native = false
+
+local function is_floating(c)
+    local t = c.screen.selected_tag
+    return c.floating or (t and t.layout == floating)
+end
+
 --- Move a client.
 -- @staticfct awful.mouse.client.move
 -- @tparam client c The client to move, or the focused one if nil.
@@ -35,6 +54,20 @@ function module.move(c, snap, finished_cb) --luacheck: no unused args
         return
     end
 
+    if module.native and is_floating(c) then
+        local snap_module = require("awful.mouse.snap")
+        if snap == false or snap_module.client_enabled == false then
+            snap = 0
+        end
+
+        capi.mousegrabber.move_resize(c, {
+            mode   = "move",
+            snap   = tonumber(snap) or snap_module.default_distance,
+            cursor = beautiful.cursor_mouse_move or "fleur",
+        })
+        return
+    end
+
     -- Compute the offset
     local coords = capi.mouse.coords()
     local geo    = aplace.centered(capi.mouse,{parent=c, pretend=true})
@@ -139,6 +172,15 @@ function module.resize(c, corner, args)
 
     new_args.corner = corner
 
+    if module.native and is_floating(c) then
+        capi.mousegrabber.move_resize(c, {
+            mode   = "resize",
+            corner = corner,
+            cursor = beautiful.cursor_mouse_resize or "cross",
+        })
+        return corner
+    end
+
     mresize(c, "mouse.resize", new_args)
 
     return corner
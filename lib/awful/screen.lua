@@ -20,7 +20,6 @@ local gmath = require("gears.math")
 local object = require("gears.object")
 local grect =  require("gears.geometry").rectangle
 local gsurf = require("gears.surface")
-local cairo = require("lgi").cairo
 
 local function get_screen(s)
     return s and capi.screen[s]
@@ -226,15 +225,8 @@ end
 -- @readonly
 
 function screen.object.get_content(s)
-    local geo = s.geometry
-    local source = gsurf(capi.root.content())
-    local target = source:create_similar(cairo.Content.COLOR, geo.width,
-                                         geo.height)
-    local cr = cairo.Context(target)
-    cr:set_source_surface(source, -geo.x, -geo.y)
-    cr:rectangle(0, 0, geo.width, geo.height)
-    cr:fill()
-    return target
+    -- Only the part of the root window of this screen is copied.
+    return gsurf(capi.root.content(s.geometry))
 end
 
 --- Get or set the screen padding.
@@ -385,6 +385,21 @@ capi.screen.connect_signal("property::_viewports", function(a)
 
 end)
 
+-- Xft.dpi may change at runtime, for example with `xrdb -merge`.
+if awesome and awesome.connect_signal then
+    awesome.connect_signal("xrdb_changed", function(names)
+        for _, name in ipairs(names) do
+            if name == "Xft.dpi" then
+                xft_dpi = nil
+                for s in capi.screen do
+                    s._private.dpi_cache = nil
+                end
+                return
+            end
+        end
+    end)
+end
+
 -- Add the DPI related properties
 return function(screen, d)
     ascreen, data = screen, d
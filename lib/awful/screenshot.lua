@@ -26,6 +26,7 @@
 
 -- Grab environment we need
 local capi = {
+    awesome      = awesome,
     root         = root,
     screen       = screen,
     client       = client,
@@ -67,9 +68,17 @@ end
 
 -- Convert to a real image surface so it can be added to an imagebox.
 local function to_surface(raw_surface, width, height)
+    local source = gears.surface(raw_surface)
+
+    -- `root.content()` already returns a copy, there is no need for another.
+    if cairo.ImageSurface:is_type_of(source) and source:get_width() == width
+      and source:get_height() == height then
+        return source
+    end
+
     local img = cairo.ImageSurface(cairo.Format.RGB24, width, height)
     local cr = cairo.Context(img)
-    cr:set_source_surface(gears.surface(raw_surface))
+    cr:set_source_surface(source)
     cr:paint()
 
     return img
@@ -384,7 +393,9 @@ function module._screenshot_methods.geometry(self)
         height = root_h
     })
 
-    return crop_shot(module._screenshot_methods.root(self), root_intrsct), root_intrsct
+    -- Only copy the selected part of the root window.
+    return to_surface(capi.root.content(root_intrsct), root_intrsct.width, root_intrsct.height),
+        root_intrsct
 end
 
 -- Various accessors for the screenshot object returned by any public
@@ -843,6 +854,37 @@ function module:save(file_path)
     end
 end
 
+--- Save screenshot without blocking.
+--
+-- The PNG files are encoded and written by a background thread. The
+-- `file::saved` signal is emitted once each file is complete.
+--
+-- @method save_async
+-- @tparam[opt=self.file_path] string file_path Optionally override the file path.
+-- @tparam[opt] function callback Called for each file with the screenshot, the
+--  path, the method and an error message if the file could not be written.
+-- @noreturn
+-- @emits saved
+-- @see save
+function module:save_async(file_path, callback)
+    if not self._private.surfaces then self:refresh() end
+
+    for method, surface in pairs(self._private.surfaces) do
+        file_path = file_path
+            or self._private.file_path
+            or make_file_path(self, #self._private.surfaces > 1 and method or nil)
+
+        capi.awesome.save_image_async(surface.surface._native, file_path, function(path, err)
+            if path then
+                self:emit_signal("file::saved", path, method)
+            end
+            if callback then
+                callback(self, path or file_path, method, err)
+            end
+        end)
+    end
+end
+
 --- Save and exit the interactive snipping mode.
 -- @method accept
 -- @treturn boolean `true` if the screenshot were save, `false` otherwise. It
@@ -376,6 +376,26 @@ function spawn.with_shell(cmd)
     end
 end
 
+-- Read the lines of a pipe returned by `capi.awesome.spawn` and close it at the
+-- end. `limits` may contain `max_line_length` and `max_batch`.
+local function read_fd(fd, line_callback, done_callback, limits)
+    if not capi.awesome.read_lines then
+        return spawn.read_lines(Gio.UnixInputStream.new(fd, true),
+                line_callback, done_callback, true)
+    end
+    capi.awesome.read_lines(fd, function(lines, err)
+        if not lines then
+            if err then
+                print("Error in awful.spawn.with_line_callback:", err)
+            end
+            return protected_call(done_callback)
+        end
+        for _, line in ipairs(lines) do
+            protected_call(line_callback, line)
+        end
+    end, limits.max_line_length, limits.max_batch)
+end
+
 --- Spawn a program and asynchronously capture its output line by line.
 -- @tparam string|table cmd The command.
 -- @tparam table callbacks Table containing callbacks that should be invoked on
@@ -393,6 +413,10 @@ end
 --   For "exit", the second argument is the exit code.
 --   For "signal", the second argument is the signal causing process
 --   termination.
+-- @tparam[opt] integer callbacks.max_line_length Lines longer than this many
+--   bytes are split into several lines.
+-- @tparam[opt] integer callbacks.max_batch The maximum number of lines handled
+--   per main loop iteration, the rest waits for the next ones.
 -- @treturn[1] Integer the PID of the forked process.
 -- @treturn[2] string Error message.
 -- @staticfct awful.spawn.with_line_callback
@@ -418,12 +442,10 @@ function spawn.with_line_callback(cmd, callbacks)
         end
     end
     if have_stdout then
-        spawn.read_lines(Gio.UnixInputStream.new(stdout, true),
-                stdout_callback, step_done, true)
+        read_fd(stdout, stdout_callback, step_done, callbacks)
     end
     if have_stderr then
-        spawn.read_lines(Gio.UnixInputStream.new(stderr, true),
-                stderr_callback, step_done, true)
+        read_fd(stderr, stderr_callback, step_done, callbacks)
     end
     assert(stdin == nil)
     return pid
@@ -497,6 +519,201 @@ function spawn.easy_async_with_shell(cmd, callback)
     return spawn.easy_async({ util.shell, "-c", cmd or "" }, callback)
 end
 
+-- Persistent shells for `easy_async_worker`, by command.
+local workers = {}
+local worker_count = 0
+
+-- Start the next queued request of a worker if it is idle.
+local function worker_next(worker)
+    if worker.current or worker.exit_reason or #worker.queue == 0 then
+        return
+    end
+    local request = table.remove(worker.queue, 1)
+    worker.current = request
+    worker.serial = worker.serial + 1
+    request.done_marker = worker.marker .. " " .. worker.serial .. " "
+    request.stderr_marker = worker.marker .. " " .. worker.serial
+    -- The command runs in the shell itself, `</dev/null` keeps it from reading
+    -- the following requests. The markers start on a new line, so that they
+    -- also follow output without a trailing newline.
+    local ok, err = pcall(worker.stdin.write_all, worker.stdin, string.format(
+        "{ %s\n} </dev/null\nprintf '\\n%s%%d\\n' $?\nprintf '\\n%s\\n' >&2\n",
+        request.cmd, request.done_marker, request.stderr_marker))
+    if not ok then
+        print("Error in awful.spawn.easy_async_worker:", tostring(err))
+    end
+end
+
+-- Finish the current request once both markers were seen.
+local function worker_request_done(worker)
+    local request = worker.current
+    if not request.code or not request.stderr_done then
+        return
+    end
+    worker.current = nil
+
+    local function output(lines)
+        -- Drop the empty line that the marker added after a trailing newline
+        if lines[#lines] == "" then
+            lines[#lines] = nil
+        end
+        return #lines > 0 and table.concat(lines, "\n") .. "\n" or ""
+    end
+    -- Like the shell, report statuses above 128 as signals
+    local reason, code = "exit", request.code
+    if code > 128 then
+        reason, code = "signal", code - 128
+    end
+    protected_call(request.callback, output(request.stdout), output(request.stderr), reason, code)
+    worker_next(worker)
+end
+
+local worker_start
+
+-- Called once the shell exited and its pipes are closed.
+local function worker_died(worker)
+    if workers[worker.cmd_key] == worker then
+        workers[worker.cmd_key] = nil
+    end
+    pcall(worker.stdin.close, worker.stdin)
+
+    local request = worker.current
+    if request then
+        local function output(lines)
+            return #lines > 0 and table.concat(lines, "\n") .. "\n" or ""
+        end
+        protected_call(request.callback, output(request.stdout), output(request.stderr),
+            worker.exit_reason, worker.exit_code)
+    end
+    -- Restart it for the requests that are still waiting
+    if #worker.queue > 0 and not worker.stopped then
+        local new = worker_start(worker.cmd_key)
+        if type(new) == "string" then
+            for _, queued in ipairs(worker.queue) do
+                protected_call(queued.callback, "", new, "exit", 127)
+            end
+            return
+        end
+        gtable.merge(new.queue, worker.queue)
+        worker_next(new)
+    end
+end
+
+worker_start = function(cmd_key)
+    worker_count = worker_count + 1
+    local worker = {
+        cmd_key = cmd_key,
+        queue = {},
+        serial = 0,
+        marker = string.format("__awesome_worker_%d_%d_%d", worker_count, os.time(),
+            math.random(0, 0x7fffffff)),
+        pending = 3,
+    }
+    local function step()
+        worker.pending = worker.pending - 1
+        if worker.pending == 0 then
+            worker_died(worker)
+        end
+    end
+
+    local pid, _, stdin, stdout, stderr = capi.awesome.spawn({ "/bin/sh" },
+            false, true, true, true, function(reason, code)
+        worker.exit_reason, worker.exit_code = reason, code
+        step()
+    end)
+    if type(pid) == "string" then
+        return pid
+    end
+    worker.pid = pid
+    worker.stdin = Gio.UnixOutputStream.new(stdin, true)
+
+    read_fd(stdout, function(line)
+        local request = worker.current
+        if not request then
+            return
+        end
+        if line:sub(1, #request.done_marker) == request.done_marker then
+            request.code = tonumber(line:sub(#request.done_marker + 1)) or 0
+            return worker_request_done(worker)
+        end
+        table.insert(request.stdout, line)
+    end, step, {})
+    read_fd(stderr, function(line)
+        local request = worker.current
+        if not request then
+            return
+        end
+        if line == request.stderr_marker then
+            request.stderr_done = true
+            return worker_request_done(worker)
+        end
+        table.insert(request.stderr, line)
+    end, step, {})
+
+    workers[cmd_key] = worker
+    return worker
+end
+
+--- Run a shell command in a persistent worker shell and capture its output.
+--
+-- This is a drop-in replacement for `easy_async_with_shell` for short commands
+-- that are run over and over again, e.g. by a widget every second. The first
+-- call starts a `/bin/sh` that is kept for all later calls with the same
+-- command, each call feeds the command to it over a pipe. This saves spawning
+-- and starting a shell, and the startup notification, on every call. Commands
+-- that only use shell builtins, e.g. `read temp < /sys/class/thermal/...`, need
+-- no new process at all.
+--
+-- The calls for one command run one after the other. The command runs in the
+-- worker shell itself, so it should not change the state of the shell, e.g.
+-- with `cd`, `exit` or `exec`. If the shell dies anyway, the call that was
+-- running gets its exit reason and queued calls are run by a new shell.
+--
+-- @tparam string cmd The shell command.
+-- @tparam function callback Function with the following arguments
+--   @tparam string callback.stdout Output on stdout.
+--   @tparam string callback.stderr Output on stderr.
+--   @tparam string callback.exitreason Exit reason ("exit" or "signal").
+--   @tparam integer callback.exitcode Exit code (exit code or signal number,
+--   depending on `exitreason`).
+-- @treturn[1] Integer the PID of the worker shell.
+-- @treturn[2] string Error message.
+-- @see easy_async_with_shell
+-- @see stop_worker
+-- @staticfct awful.spawn.easy_async_worker
+function spawn.easy_async_worker(cmd, callback)
+    local worker = workers[cmd]
+    if not worker then
+        worker = worker_start(cmd)
+        if type(worker) == "string" then
+            return worker
+        end
+    end
+    table.insert(worker.queue, { cmd = cmd, callback = callback, stdout = {}, stderr = {} })
+    worker_next(worker)
+    return worker.pid
+end
+
+--- Stop the worker shell of a command.
+--
+-- The shell exits once the call that is running finished, calls that are still
+-- queued are dropped. The next `easy_async_worker` call starts a new shell.
+-- @tparam string cmd The shell command.
+-- @treturn boolean Whether there was a worker.
+-- @see easy_async_worker
+-- @staticfct awful.spawn.stop_worker
+function spawn.stop_worker(cmd)
+    local worker = workers[cmd]
+    if not worker then
+        return false
+    end
+    workers[cmd] = nil
+    worker.stopped = true
+    worker.queue = {}
+    pcall(worker.stdin.close, worker.stdin)
+    return true
+end
+
 --- Read lines from a Gio input stream
 -- @tparam Gio.InputStream input_stream The input stream to read from.
 -- @tparam function line_callback Function that is called with each line
@@ -378,8 +378,17 @@ function tag.object.clear(self, args)
 
         if not fallback_tag then return end
 
+        local untagged = {}
         for _, c in ipairs(clients) do
             if #c:tags() == 0 then
+                table.insert(untagged, c)
+            end
+        end
+
+        if capi.client.move_to_tag then
+            capi.client.move_to_tag(untagged, fallback_tag)
+        else
+            for _, c in ipairs(untagged) do
                 c:tags({fallback_tag})
             end
         end
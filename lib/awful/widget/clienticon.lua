@@ -46,6 +46,17 @@ function clienticon:draw(_, cr, width, height)
     local aspect_w = width / size[1]
     local aspect_h = height / size[2]
     local aspect = math.min(aspect_w, aspect_h)
+
+    -- Without scaling, paint the icon scaled once in advance by awesome
+    local m = cr.matrix
+    if m.xx == 1 and m.yy == 1 and m.xy == 0 and m.yx == 0 then
+        local w = math.max(1, math.floor(size[1] * aspect + 0.5))
+        local h = math.max(1, math.floor(size[2] * aspect + 0.5))
+        cr:set_source_surface(surface(c:get_icon(index, w, h)), 0, 0)
+        cr:paint()
+        return
+    end
+
     cr:scale(aspect, aspect)
 
     local s = surface(c:get_icon(index))
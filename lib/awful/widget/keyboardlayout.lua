@@ -118,8 +118,9 @@ keyboardlayout.xkeyboard_country_code = {
 }
 
 -- Callback for updating current layout.
-local function update_status (self)
-    self._current = awesome.xkb_get_layout_group()
+-- `group` is the new group from `xkb::group_changed`, if it is known.
+local function update_status (self, group)
+    self._current = group or awesome.xkb_get_layout_group()
     local text = ""
     if #self._layout > 0 then
         -- Please note that the group number reported by xkb_get_layout_group
@@ -239,17 +240,26 @@ function keyboardlayout.get_groups_from_group_names(group_names)
     return layout_groups
 end
 
+-- The groups parsed from the group names last time, shared by all widgets.
+-- The names only change with the keymap.
+local parsed_group_names, parsed_layouts
+
 -- Callback for updating list of layouts
 local function update_layout(self)
     self._layout = {};
-    local layouts = keyboardlayout.get_groups_from_group_names(awesome.xkb_get_group_names())
+    local group_names = awesome.xkb_get_group_names()
+    if group_names ~= parsed_group_names or not parsed_layouts then
+        parsed_group_names = group_names
+        parsed_layouts = group_names and keyboardlayout.get_groups_from_group_names(group_names)
+        if parsed_layouts and #parsed_layouts == 1 then
+            parsed_layouts[1].group_idx = 1
+        end
+    end
+    local layouts = parsed_layouts
     if layouts == nil or layouts[1] == nil then
         gdebug.print_error("Failed to get list of keyboard groups")
         return
     end
-    if #layouts == 1 then
-        layouts[1].group_idx = 1
-    end
     for _, v in ipairs(layouts) do
         self._layout[v.group_idx] = self.layout_name(v)
     end
@@ -299,7 +309,7 @@ function keyboardlayout.new()
     capi.awesome.connect_signal("xkb::map_changed",
                                 function () update_layout(self) end)
     capi.awesome.connect_signal("xkb::group_changed",
-                                function () update_status(self) end);
+                                function (group) update_status(self, group) end);
 
     -- Mouse bindings
     self.buttons = {
@@ -42,8 +42,13 @@ local gdebug = require("gears.debug")
 local gobject = require("gears.object")
 local protected_call = require("gears.protected_call")
 
+local capi = { awesome = awesome }
+
 local matcher = {}
 
+-- Shorter rule lists are matched in Lua, compiling them doesn't pay off.
+local native_threshold = 8
+
 --- A rule has been added to a set of matching rules.
 -- @signal rule::appended
 -- @tparam table gears.matcher The matcher.
@@ -215,6 +220,74 @@ function matcher:matches_rule(o, entry)
     return true
 end
 
+-- Whether the rule list was compiled with the current rules and matchers.
+local function is_compiled(self, rules, entry)
+    if not entry or entry.version ~= self._private.prop_matchers_version
+        or entry.count ~= #rules then
+        return false
+    end
+
+    for i = 1, entry.count do
+        if entry.rules[i] ~= rules[i] then return false end
+    end
+
+    return true
+end
+
+-- Match a long rule list natively.
+--
+-- The rule list is compiled again when rules are added, removed or replaced,
+-- or when a property matcher is added. Rules are compared by identity, a rule
+-- whose content is modified in place has to be replaced to be seen.
+-- Everything but plain strings, booleans and numbers is still matched by
+-- `matches_rule`.
+-- @treturn table|nil The matching rules, or nil if the list isn't matched natively.
+local function native_matching_rules(self, o, rules)
+    local compile = capi.awesome and capi.awesome._rules_compile
+
+    if not compile or #rules < native_threshold then return nil end
+
+    local entry = self._private.compiled[rules]
+
+    if not is_compiled(self, rules, entry) then
+        local matchers = {}
+
+        for name in pairs(self._private.prop_matchers) do
+            matchers[name] = true
+        end
+
+        local set, fields = compile(rules, matchers)
+
+        entry = {
+            set     = set,
+            fields  = fields,
+            version = self._private.prop_matchers_version,
+            count   = #rules,
+            rules   = gtable.clone(rules, false),
+        }
+        self._private.compiled[rules] = entry
+    end
+
+    -- Every property is read once instead of once per rule.
+    local values = {}
+
+    for i = 1, #entry.fields do
+        values[i] = o[entry.fields[i]]
+    end
+
+    local result = {}
+
+    for _, i in ipairs(capi.awesome._rules_match(entry.set, values)) do
+        if i > 0 then
+            table.insert(result, rules[i])
+        elseif self:matches_rule(o, rules[-i]) then
+            table.insert(result, rules[-i])
+        end
+    end
+
+    return result
+end
+
 --- Get list of matching rules for an object.
 --
 -- If the `rules` argument is not provided, the rules added with
@@ -246,6 +319,10 @@ function matcher:matching_rules(o, rules)
         return result
     end
 
+    local native = native_matching_rules(self, o, rules)
+
+    if native then return native end
+
     for _, entry in ipairs(rules) do
         if self:matches_rule(o, entry) then
             table.insert(result, entry)
@@ -305,6 +382,7 @@ function matcher:add_property_matcher(name, f)
     assert(not self._private.prop_matchers[name], name .. " already has a matcher")
 
     self._private.prop_matchers[name] = f
+    self._private.prop_matchers_version = self._private.prop_matchers_version + 1
 
     self:emit_signal("property_matcher::added", name, f)
 end
@@ -567,7 +645,10 @@ local function new()
     local ret = gobject()
 
     rawset(ret, "_private", {
-        rules = {}, prop_matchers = {}, prop_setters = {}
+        rules = {}, prop_matchers = {}, prop_setters = {}, prop_matchers_version = 0,
+
+        -- Rule lists compiled by `awesome._rules_compile`, by rule list.
+        compiled = setmetatable({}, {__mode = "k"}),
     })
 
     -- Contains the sources.
@@ -126,6 +126,29 @@ function surface.load(self)
     return do_load_and_handle_errors(self, surface.load_silently)
 end
 
+--- Load an image file without blocking the main loop.
+-- The file is decoded by a background thread. Once it is ready, `callback` is
+-- called with the loaded surface, or with nil and an error message. The
+-- surface is added to the cache used by `load`. The callback is never called
+-- before this function returns.
+-- @tparam string path The file name.
+-- @tparam function callback The function to call with the surface.
+-- @staticfct load_async
+-- @noreturn
+function surface.load_async(path, callback)
+    capi.awesome.load_image_async(path, function(native, err)
+        if not native then
+            return callback(nil, err)
+        end
+        local result = native
+        if not cairo.Surface:is_type_of(result) then
+            result = cairo.Surface(native, true)
+        end
+        surface_cache[path] = result
+        callback(result)
+    end)
+end
+
 function surface.mt.__call(_, ...)
     return surface.load(...)
 end
@@ -98,11 +98,17 @@ function timer:start()
         gdebug.print_error(traceback("timer already started"))
         return
     end
-    local timeout_ms = gmath.round(self.data.timeout * 1000)
-    self.data.source_id = glib.timeout_add(glib.PRIORITY_DEFAULT, timeout_ms, function()
-        protected_call(self.emit_signal, self, "timeout")
-        return true
-    end)
+    if capi.awesome.timer_start then
+        self.data.source_id = capi.awesome.timer_start(self.data.timeout, function()
+            protected_call(self.emit_signal, self, "timeout")
+        end, self.data.slack)
+    else
+        local timeout_ms = gmath.round(self.data.timeout * 1000)
+        self.data.source_id = glib.timeout_add(glib.PRIORITY_DEFAULT, timeout_ms, function()
+            protected_call(self.emit_signal, self, "timeout")
+            return true
+        end)
+    end
     self:emit_signal("start")
 end
 
@@ -117,7 +123,11 @@ function timer:stop()
     if self.data.source_id == nil then
         return
     end
-    glib.source_remove(self.data.source_id)
+    if capi.awesome.timer_stop then
+        capi.awesome.timer_stop(self.data.source_id)
+    else
+        glib.source_remove(self.data.source_id)
+    end
     self.data.source_id = nil
     self:emit_signal("stop")
 end
@@ -153,10 +163,24 @@ end
 -- @negativeallowed false
 -- @propemits true false
 
+--- How much later than its timeout the timer may run.
+--
+-- Timers with the same slack are run together, so that the main loop wakes up
+-- less often. Status bar widgets updating every few seconds can usually allow
+-- for a second or so. Changes take effect the next time the timer starts.
+--
+-- @property slack
+-- @tparam[opt=0] number slack
+-- @propertyunit second
+-- @negativeallowed false
+-- @propemits true false
+
 local timer_instance_mt = {
     __index = function(self, property)
         if property == "timeout" then
             return self.data.timeout
+        elseif property == "slack" then
+            return self.data.slack
         elseif property == "started" then
             return self.data.source_id ~= nil
         end
@@ -168,6 +192,9 @@ local timer_instance_mt = {
         if property == "timeout" then
             self.data.timeout = tonumber(value)
             self:emit_signal("property::timeout", value)
+        elseif property == "slack" then
+            self.data.slack = tonumber(value)
+            self:emit_signal("property::slack", value)
         end
     end
 }
@@ -182,6 +209,7 @@ local timer_instance_mt = {
 --
 -- @tparam table args Arguments.
 -- @tparam number args.timeout Timeout in seconds (e.g. `1.5`).
+-- @tparam[opt=0] number args.slack How much later the timer may run, in seconds.
 -- @tparam[opt=false] boolean args.autostart Automatically start the timer.
 -- @tparam[opt=false] boolean args.call_now Call the callback at timer creation.
 -- @tparam[opt] function args.callback Callback function to connect to the
@@ -193,7 +221,7 @@ function timer.new(args)
     args = args or {}
     local ret = object()
 
-    ret.data = { timeout = 0 } --TODO v5 rename to ._private
+    ret.data = { timeout = 0, slack = 0 } --TODO v5 rename to ._private
     setmetatable(ret, timer_instance_mt)
 
     for k, v in pairs(args) do
@@ -55,7 +55,15 @@ function wallpaper.prepare_context(s)
         timer.delayed_call(function()
             local paper = pending_wallpaper
             pending_wallpaper = nil
-            wallpaper.set(paper.surface)
+            if paper.areas and root.wallpaper_region then
+                -- Only some screens changed, only upload those
+                local pattern = cairo.Pattern.create_for_surface(paper.surface)
+                for _, area in ipairs(paper.areas) do
+                    root.wallpaper_region(pattern, area)
+                end
+            else
+                wallpaper.set(paper.surface)
+            end
             paper.surface:finish()
         end)
     elseif root_width > pending_wallpaper.width or root_height > pending_wallpaper.height then
@@ -68,6 +76,13 @@ function wallpaper.prepare_context(s)
         target = pending_wallpaper.surface
     end
 
+    -- Remember which screens were drawn to, nil means everything
+    local areas = nil
+    if s and (not pending_wallpaper or (not source and pending_wallpaper.areas)) then
+        areas = pending_wallpaper and pending_wallpaper.areas or {}
+        table.insert(areas, geom)
+    end
+
     cr = cairo.Context(target)
 
     if source then
@@ -82,7 +97,8 @@ function wallpaper.prepare_context(s)
     pending_wallpaper = {
         surface = target,
         width = root_width,
-        height = root_height
+        height = root_height,
+        areas = areas
     }
 
     -- Only draw to the selected area
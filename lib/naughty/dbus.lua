@@ -14,6 +14,7 @@ local string = string
 local capi = { awesome = awesome }
 local gsurface = require("gears.surface")
 local gdebug  = require("gears.debug")
+local gtimer  = require("gears.timer")
 local protected_call = require("gears.protected_call")
 local lgi = require("lgi")
 local cairo, Gio, GLib, GObject = lgi.cairo, lgi.Gio, lgi.GLib, lgi.GObject
@@ -57,6 +58,24 @@ local urgency = {
 -- @table config.mapping
 dbus.config.mapping = cst.config.mapping
 
+--- How long notifications from the same source are coalesced, in seconds.
+--
+-- The first notification with a given `replaces_id`, or of an application with
+-- a given summary, is shown right away. The ones that follow within this time
+-- are not shown, only the last of them updates the first notification when the
+-- time is over. Its `suppressed_count` tells how many were skipped. The
+-- default of 0 shows every notification on its own.
+-- @tfield[opt=0] number config.coalesce_window
+dbus.config.coalesce_window = 0
+
+--- How many notifications an application can show per second.
+--
+-- Further notifications of the application within the same second update its
+-- last notification at the end of the second, like coalesced ones do. The
+-- default of 0 means no limit.
+-- @tfield[opt=0] number config.rate_limit
+dbus.config.rate_limit = 0
+
 local function sendActionInvoked(notificationId, action)
     if bus_connection then
         bus_connection:emit_signal(nil, "/org/freedesktop/Notifications",
@@ -123,12 +142,17 @@ local function convert_icon(w, h, rowstride, channels, data)
     return res
 end
 
-local notif_methods = {}
-
-function notif_methods.Notify(sender, object_path, interface, method, parameters, invocation)
+-- Show a notification. `coalesced` is set when the notification updates the
+-- one it was coalesced into, with `replaces_id` and `suppressed_count`.
+-- Returns the notification id.
+local function notify(sender, object_path, interface, method, parameters, invocation, coalesced)
     local appname, replaces_id, app_icon, title, text, actions, hints, expire =
         unpack(parameters.value)
 
+    if coalesced then
+        replaces_id = coalesced.replaces_id
+    end
+
     local args = {}
     if text ~= "" then
         args.message = text
@@ -285,6 +309,10 @@ function notif_methods.Notify(sender, object_path, interface, method, parameters
 
         args.freedesktop_hints = hints
 
+        if coalesced then
+            args.suppressed_count = coalesced.suppressed_count
+        end
+
         -- Not very pretty, but given the current format is documented in the
         -- public API... well, whatever...
         if hints and hints.urgency then
@@ -349,10 +377,164 @@ function notif_methods.Notify(sender, object_path, interface, method, parameters
         end
 
         invocation:return_value(GLib.Variant("(u)", { notification.id }))
+        return notification.id
+    end
+
+    local id = nnotif._gen_next_id()
+    invocation:return_value(GLib.Variant("(u)", { id }))
+    return id
+end
+
+-- Notifications that are being coalesced, by source. Each has the `id` of the
+-- notification that is shown, when the window `ends` and the last `pending`
+-- call that will update the notification then, with the `seq` it came in as.
+local coalescing = {}
+local coalescing_seq = 0
+-- Per application: how many notifications were shown since `since`, and the
+-- last one of them.
+local app_rates = {}
+local coalescing_count = 0
+
+local ignored_invocation = { return_value = function() end }
+
+local function now()
+    return GLib.get_monotonic_time() / 1e6
+end
+
+local flush_coalesced
+
+local function schedule_flush(key, entry)
+    entry.timer = gtimer.start_new(math.max(entry.ends - now(), 0), function()
+        entry.timer = nil
+        flush_coalesced(key, entry)
+    end)
+end
+
+flush_coalesced = function(key, entry)
+    if entry.timer then
+        entry.timer:stop()
+        entry.timer = nil
+    end
+    if coalescing[key] ~= entry then
         return
     end
 
-    invocation:return_value(GLib.Variant("(u)", { nnotif._gen_next_id() }))
+    -- The calls held back before this one are shown first, in the order they
+    -- came in, whenever their own window ends
+    if entry.pending then
+        local earlier = {}
+        for k, e in pairs(coalescing) do
+            if e.pending and e.seq < entry.seq then
+                table.insert(earlier, { key = k, entry = e })
+            end
+        end
+        table.sort(earlier, function(a, b) return a.entry.seq < b.entry.seq end)
+        for _, e in ipairs(earlier) do
+            flush_coalesced(e.key, e.entry)
+        end
+    end
+
+    local pending = entry.pending
+    entry.pending = nil
+    if pending then
+        pending[6] = ignored_invocation
+    end
+    if not pending or not naughty.get_by_id(entry.id) then
+        -- The notification is gone, show the last call on its own
+        if pending then
+            notify(unpack(pending, 1, 6))
+        end
+        coalescing[key] = nil
+        coalescing_count = coalescing_count - 1
+        return
+    end
+
+    pending[7] = { replaces_id = entry.id, suppressed_count = entry.suppressed }
+    notify(unpack(pending, 1, 7))
+
+    -- Keep coalescing while the source goes on
+    entry.ends = now() + math.max(dbus.config.coalesce_window, 0.1)
+    schedule_flush(key, entry)
+end
+
+-- Hold a call back and answer it with the id of the notification it will
+-- update.
+local function coalesce(key, id, ends, args)
+    local entry = coalescing[key]
+    if not entry then
+        entry = { id = id, ends = ends, suppressed = 0 }
+        coalescing[key] = entry
+        coalescing_count = coalescing_count + 1
+    end
+    if entry.pending then
+        entry.suppressed = entry.suppressed + 1
+    end
+    entry.pending = args
+    coalescing_seq = coalescing_seq + 1
+    entry.seq = coalescing_seq
+    if not entry.timer then
+        schedule_flush(key, entry)
+    end
+    args[6]:return_value(GLib.Variant("(u)", { entry.id }))
+end
+
+-- Forget the sources that went quiet.
+local function sweep(time)
+    for key, entry in pairs(coalescing) do
+        if not entry.pending and entry.ends <= time then
+            coalescing[key] = nil
+            coalescing_count = coalescing_count - 1
+        end
+    end
+    for app, rate in pairs(app_rates) do
+        if rate.since + 1 <= time then
+            app_rates[app] = nil
+        end
+    end
+end
+
+local notif_methods = {}
+
+function notif_methods.Notify(sender, object_path, interface, method, parameters, invocation)
+    local window, rate_limit = dbus.config.coalesce_window, dbus.config.rate_limit
+    if window <= 0 and rate_limit <= 0 then
+        return notify(sender, object_path, interface, method, parameters, invocation)
+    end
+
+    -- Only look at the fields needed here, the hints may contain images
+    local appname = parameters:get_child_value(0).value
+    local replaces_id = parameters:get_child_value(1).value
+    local summary = parameters:get_child_value(3).value
+    local args = { sender, object_path, interface, method, parameters, invocation }
+    local time = now()
+
+    local key = replaces_id ~= 0 and ("id\0" .. replaces_id) or (appname .. "\0" .. summary)
+    local entry = coalescing[key]
+    if entry and (entry.pending or entry.ends > time) and naughty.get_by_id(entry.id) then
+        return coalesce(key, entry.id, entry.ends, args)
+    end
+
+    local rate = app_rates[appname]
+    if not rate or rate.since + 1 <= time then
+        rate = { since = time, count = 0 }
+        app_rates[appname] = rate
+    end
+    rate.count = rate.count + 1
+    if rate_limit > 0 and rate.count > rate_limit and naughty.get_by_id(rate.last_id) then
+        return coalesce("app\0" .. appname, rate.last_id, rate.since + 1, args)
+    end
+
+    local id = notify(unpack(args, 1, 6))
+    rate.last_id = id
+    if window > 0 and id then
+        if coalescing_count > 64 then
+            sweep(time)
+        end
+        if not coalescing[key] then
+            coalescing_count = coalescing_count + 1
+        end
+        coalescing[key] = { id = id, ends = time + window, suppressed = 0 }
+    end
 end
 
 function notif_methods.CloseNotification(_, _, _, _, parameters, invocation)
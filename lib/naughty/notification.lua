@@ -430,6 +430,16 @@ local notification = {}
 -- @tablerowtype A list of `naughty.action` objects.
 -- @propemits true false
 
+--- How many updates of the notification were not shown.
+--
+-- When `naughty.dbus` coalesces or rate limits the notifications of an
+-- application, only the last of several updates is shown. This counts the
+-- skipped ones.
+--
+-- @property suppressed_count
+-- @tparam[opt=nil] integer|nil suppressed_count
+-- @propemits true false
+
 --- Ignore this notification, do not display.
 --
 -- Note that this property has to be set in a `preset` or in a `request::preset`
@@ -674,7 +684,7 @@ local properties = {
     "destroy"  , "preset"  , "callback", "actions"           ,
     "run"      , "id"      , "ignore"  , "auto_reset_timeout",
     "urgency"  , "image"   , "images"  , "widget_template"   ,
-    "max_width", "app_icon",
+    "max_width", "app_icon", "suppressed_count",
 }
 
 for _, prop in ipairs(properties) do
@@ -63,6 +63,23 @@ local function get_widget_context(self)
     return context
 end
 
+-- Get a copy of the part of the wallpaper below the drawable. Render threads
+-- should not read the wallpaper pixmap itself.
+local function get_wallpaper_part(self, wallpaper, x, y, width, height)
+    local part = self._wallpaper_part
+    if part and part.x == x and part.y == y and part.width == width and part.height == height then
+        return part.surface
+    end
+
+    local img = cairo.ImageSurface(cairo.Format.RGB24, width, height)
+    local cr = cairo.Context(img)
+    cr.operator = cairo.Operator.SOURCE
+    cr:set_source_surface(wallpaper, -x, -y)
+    cr:paint()
+    self._wallpaper_part = { x = x, y = y, width = width, height = height, surface = img }
+    return img
+end
+
 local function do_redraw(self)
     if not self.drawable.valid then return end
     if self._forced_screen and not self._forced_screen.valid then return end
@@ -70,8 +87,15 @@ local function do_redraw(self)
     local surf = surface.load_silently(self.drawable.surface, false)
     -- The surface can be nil if the drawable's parent was already finalized
     if not surf then return end
-    local cr = cairo.Context(surf)
     local geom = self.drawable:geometry();
+    local recording
+    if self._render_async then
+        -- Only record the drawing here, a render thread rasterizes it
+        recording = cairo.RecordingSurface(cairo.Content.COLOR_ALPHA, cairo.Rectangle {
+            x = 0, y = 0, width = geom.width, height = geom.height
+        })
+    end
+    local cr = cairo.Context(recording or surf)
     local x, y, width, height = geom.x, geom.y, geom.width, geom.height
     local context = get_widget_context(self)
 
@@ -111,9 +135,11 @@ local function do_redraw(self)
     if self._dirty_area:is_empty() then
         return
     end
+    local areas = {}
     for i = 0, self._dirty_area:num_rectangles() - 1 do
         local rect = self._dirty_area:get_rectangle(i)
         cr:rectangle(rect.x, rect.y, rect.width, rect.height)
+        areas[i + 1] = { x = rect.x, y = rect.y, width = rect.width, height = rect.height }
     end
     self._dirty_area = cairo.Region.create()
     cr:clip()
@@ -125,7 +151,9 @@ local function do_redraw(self)
         -- This is pseudo-transparency: We draw the wallpaper in the background
         local wallpaper = surface.load_silently(capi.root.wallpaper(), false)
         cr.operator = cairo.Operator.SOURCE
-        if wallpaper then
+        if wallpaper and recording then
+            cr:set_source_surface(get_wallpaper_part(self, wallpaper, x, y, width, height), 0, 0)
+        elseif wallpaper then
             cr:set_source_surface(wallpaper, -x, -y)
         else
             cr:set_source_rgb(0, 0, 0)
@@ -161,9 +189,14 @@ local function do_redraw(self)
         self._widget_hierarchy:draw(context, cr)
     end
 
-    self.drawable:refresh()
-
     assert(cr.status == "SUCCESS", "Cairo context entered error state: " .. cr.status)
+
+    if recording then
+        recording:flush()
+        self.drawable:render_async(recording._native, areas)
+    else
+        self.drawable:refresh()
+    end
 end
 
 local function find_widgets(self, result, hierarchy, x, y)
@@ -299,6 +332,25 @@ function drawable:set_fg(c)
     self._do_complete_repaint()
 end
 
+--- Rasterize the widgets on a render thread.
+--
+-- The widgets still draw on the main thread, but only into a recording. The
+-- expensive part, turning it into pixels, is done by a render thread and the
+-- result shows up a little later. This helps with widgets that paint a lot,
+-- e.g. large images or graphs.
+-- @param value Whether to render on a render thread.
+function drawable:set_render_async(value)
+    value = value and true or false
+    if self._render_async == value then return end
+    self._render_async = value
+    self._wallpaper_part = nil
+    self._do_complete_repaint()
+end
+
+function drawable:get_render_async()
+    return self._render_async or false
+end
+
 function drawable:_force_screen(s)
     self._forced_screen = s
 end
@@ -507,6 +559,14 @@ end
 
 -- Redraw all drawables when the wallpaper changes
 capi.awesome.connect_signal("wallpaper_changed", function()
+    for d in pairs(visible_drawables) do
+        d._wallpaper_part = nil
+        d:_do_complete_repaint()
+    end
+end)
+
+-- Pseudo-transparency is only drawn without a composite manager
+capi.awesome.connect_signal("compositor::changed", function()
     for d in pairs(visible_drawables) do
         d:_do_complete_repaint()
     end
@@ -8,6 +8,7 @@
 -- @classmod wibox.hierarchy
 ---------------------------------------------------------------------------
 
+local capi = { awesome = awesome }
 local matrix = require("gears.matrix")
 local protected_call = require("gears.protected_call")
 local cairo = require("lgi").cairo
@@ -18,6 +19,10 @@ local hierarchy = {}
 
 local widgets_to_count = setmetatable({}, { __mode = "k" })
 
+-- The geometry of each node is kept natively when the C API is there, only
+-- the layout of nodes that changed is done in Lua then.
+local native = capi.awesome and capi.awesome._hierarchy_node and true or false
+
 --- Add a widget to the list of widgets for which hierarchies should count their
 -- occurrences. Note that for correct operations, the widget must not yet be
 -- visible in any hierarchy.
@@ -57,10 +62,14 @@ local function hierarchy_new(redraw_callback, layout_callback, callback_arg)
         redraw_callback(result, callback_arg)
     end
     function result._layout()
-        local h = result
-        while h do
-            h._need_update = true
-            h = h._parent
+        if result._core then
+            result._core:invalidate()
+        else
+            local h = result
+            while h do
+                h._need_update = true
+                h = h._parent
+            end
         end
         layout_callback(result, callback_arg)
     end
@@ -80,9 +89,39 @@ local function hierarchy_new(redraw_callback, layout_callback, callback_arg)
             result[k] = f
         end
     end
+
+    if native then
+        result._core = capi.awesome._hierarchy_node()
+    end
     return result
 end
 
+-- Called by the native core for each node that needs to be laid out.
+local function native_layout(self, context, widget, width, height, old_widget)
+    if old_widget ~= widget then
+        if old_widget then
+            old_widget:disconnect_signal("widget::redraw_needed", self._redraw)
+            old_widget:disconnect_signal("widget::layout_changed", self._layout)
+            old_widget:disconnect_signal("widget::emit_recursive", self._emit_recursive)
+        end
+        widget:weak_connect_signal("widget::redraw_needed", self._redraw)
+        widget:weak_connect_signal("widget::layout_changed", self._layout)
+        widget:weak_connect_signal("widget::emit_recursive", self._emit_recursive)
+    end
+    return base.layout_widget(no_parent, context, widget, width, height)
+end
+
+-- Called by the native core when a node gets a new child.
+local function native_new_child(self)
+    local r = hierarchy_new(self._redraw_callback, self._layout_callback, self._callback_arg)
+    r._parent = self
+    return r
+end
+
+if native then
+    capi.awesome._hierarchy_setup(native_layout, native_new_child, widgets_to_count)
+end
+
 local hierarchy_update
 function hierarchy_update(self, context, widget, width, height, region, matrix_to_parent, matrix_to_device)
     if (not self._need_update) and self._widget == widget and
@@ -227,7 +266,16 @@ end
 -- @method update
 function hierarchy:update(context, widget, width, height, region)
     region = region or cairo.Region.create()
-    hierarchy_update(self, context, widget, width, height, region, self._matrix, self._matrix_to_device)
+    if self._core then
+        local rects = self._core:update(self, context, widget, width, height)
+        for i = 1, #rects, 4 do
+            region:union_rectangle(cairo.RectangleInt{
+                x = rects[i], y = rects[i + 1], width = rects[i + 2], height = rects[i + 3]
+            })
+        end
+    else
+        hierarchy_update(self, context, widget, width, height, region, self._matrix, self._matrix_to_device)
+    end
     return region
 end
 
@@ -252,6 +300,10 @@ end
 -- @return A matrix describing the transformation.
 -- @method get_matrix_to_device
 function hierarchy:get_matrix_to_device()
+    if not self._matrix_to_device then
+        -- The native core dropped it when it changed
+        self._matrix_to_device = matrix.create(self._core:get_matrix_to_device())
+    end
     return self._matrix_to_device
 end
 
@@ -280,6 +332,9 @@ end
 -- @return x, y, width, height
 -- @method get_draw_extents
 function hierarchy:get_draw_extents()
+    if self._core then
+        return self._core:get_draw_extents()
+    end
     local ext = self._draw_extents
     return ext.x, ext.y, ext.width, ext.height
 end
@@ -288,6 +343,9 @@ end
 -- @return width, height
 -- @method get_size
 function hierarchy:get_size()
+    if self._core then
+        return self._core:get_size()
+    end
     local ext = self._size
     return ext.width, ext.height
 end
@@ -305,6 +363,9 @@ end
 -- @return The number of times that this widget is contained in this hierarchy.
 -- @method get_count
 function hierarchy:get_count(widget)
+    if self._core then
+        return self._core:get_count(widget)
+    end
     return self._widget_counts[widget] or 0
 end
 
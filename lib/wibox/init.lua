@@ -67,6 +67,15 @@ function wibox:set_fg(c)
     self:emit_signal("property::fg", c)
 end
 
+function wibox:set_render_async(value)
+    self._drawable:set_render_async(value)
+    self:emit_signal("property::render_async", value)
+end
+
+function wibox:get_render_async()
+    return self._drawable:get_render_async()
+end
+
 function wibox:find_widgets(x, y)
     return self._drawable:find_widgets(x, y)
 end
@@ -395,6 +404,10 @@ local function new(args)
         ret.input_passthrough = args.input_passthrough
     end
 
+    if args.render_async then
+        ret:set_render_async(args.render_async)
+    end
+
     -- Make sure all signals bubble up
     ret:_connect_everything(wibox.emit_signal)
 
@@ -10,6 +10,7 @@
 -- @supermodule wibox.widget.base
 ---------------------------------------------------------------------------
 
+local capi = { awesome = awesome }
 local base = require("wibox.widget.base")
 local gdebug = require("gears.debug")
 local beautiful = require("beautiful")
@@ -21,6 +22,10 @@ local setmetatable = setmetatable
 
 local textbox = { mt = {} }
 
+-- Layouts are shaped and cached natively when the C API is there, the Pango
+-- layout of each textbox then only keeps the state for the getters.
+local native = capi.awesome and capi.awesome.text_layout and true or false
+
 --- Set the DPI of a Pango layout
 local function setup_dpi(box, dpi)
     assert(dpi, "No DPI provided")
@@ -38,31 +43,49 @@ local function setup_layout(box, width, height, dpi)
     setup_dpi(box, dpi)
 end
 
+local function valign_offset(self, height, layout_height)
+    if self._private.valign == "center" then
+        return (height - layout_height) / 2
+    elseif self._private.valign == "bottom" then
+        return height - layout_height
+    end
+    return 0
+end
+
 -- Draw the given textbox on the given cairo context in the given geometry
 function textbox:draw(context, cr, width, height)
+    if native then
+        local layout, _, layout_height = capi.awesome.text_layout(
+            self._private.layout_args, width, height, context.dpi)
+        layout:draw(cr._native, 0, valign_offset(self, height, layout_height))
+        return
+    end
+
     setup_layout(self, width, height, context.dpi)
     cr:update_layout(self._private.layout)
     local _, logical = self._private.layout:get_pixel_extents()
-    local offset = 0
-    if self._private.valign == "center" then
-        offset = (height - logical.height) / 2
-    elseif self._private.valign == "bottom" then
-        offset = height - logical.height
-    end
-    cr:move_to(0, offset)
+    cr:move_to(0, valign_offset(self, height, logical.height))
     cr:show_layout(self._private.layout)
 end
 
-local function do_fit_return(self)
-    local _, logical = self._private.layout:get_pixel_extents()
-    if logical.width == 0 or logical.height == 0 then
+local function fit_return(width, height)
+    if width == 0 or height == 0 then
         return 0, 0
     end
-    return logical.width, logical.height
+    return width, height
+end
+
+local function do_fit_return(self)
+    local _, logical = self._private.layout:get_pixel_extents()
+    return fit_return(logical.width, logical.height)
 end
 
 -- Fit the given textbox
 function textbox:fit(context, width, height)
+    if native then
+        return fit_return(capi.awesome.text_layout_size(
+            self._private.layout_args, width, height, context.dpi))
+    end
     setup_layout(self, width, height, context.dpi)
     return do_fit_return(self)
 end
@@ -118,6 +141,9 @@ end
 -- @treturn number The preferred width.
 -- @treturn number The preferred height.
 function textbox:get_preferred_size_at_dpi(dpi)
+    if native then
+        return fit_return(capi.awesome.text_layout_size(self._private.layout_args, nil, nil, dpi))
+    end
     local max_lines = 2^20
     setup_dpi(self, dpi)
     self._private.layout.width = -1 -- no width set
@@ -135,6 +161,11 @@ end
 -- @tparam number dpi The DPI value to render at.
 -- @treturn number The needed height.
 function textbox:get_height_for_width_at_dpi(width, dpi)
+    if native then
+        local _, h = fit_return(capi.awesome.text_layout_size(
+            self._private.layout_args, width, nil, dpi))
+        return h
+    end
     local max_lines = 2^20
     setup_dpi(self, dpi)
     self._private.layout.width = Pango.units_from_double(width)
@@ -167,6 +198,8 @@ function textbox:set_markup_silently(text)
     self._private.markup = text
     self._private.layout.text = parsed
     self._private.layout.attributes = attr
+    self._private.layout_args.text = text
+    self._private.layout_args.markup = true
     self:emit_signal("widget::redraw_needed")
     self:emit_signal("widget::layout_changed")
     self:emit_signal("property::markup", text)
@@ -229,6 +262,8 @@ function textbox:set_text(text)
     self._private.markup = nil
     self._private.layout.text = text
     self._private.layout.attributes = nil
+    self._private.layout_args.text = text
+    self._private.layout_args.markup = false
     self:emit_signal("widget::redraw_needed")
     self:emit_signal("widget::layout_changed")
     self:emit_signal("property::text", text)
@@ -260,6 +295,7 @@ function textbox:set_ellipsize(mode)
             return
         end
         self._private.layout:set_ellipsize(allowed[mode])
+        self._private.layout_args.ellipsize = allowed[mode]
         self:emit_signal("widget::redraw_needed")
         self:emit_signal("widget::layout_changed")
         self:emit_signal("property::ellipsize", mode)
@@ -284,6 +320,7 @@ function textbox:set_wrap(mode)
             return
         end
         self._private.layout:set_wrap(allowed[mode])
+        self._private.layout_args.wrap = allowed[mode]
         self:emit_signal("widget::redraw_needed")
         self:emit_signal("widget::layout_changed")
         self:emit_signal("property::wrap", mode)
@@ -346,6 +383,7 @@ function textbox:set_halign(mode)
             return
         end
         self._private.layout:set_alignment(allowed[mode])
+        self._private.layout_args.align = allowed[mode]
         self:emit_signal("widget::redraw_needed")
         self:emit_signal("widget::layout_changed")
         self:emit_signal("property::align", mode)
@@ -412,7 +450,9 @@ function textbox:set_font(font)
 
     self._private.font = font
 
-    self._private.layout:set_font_description(beautiful.get_font(font))
+    local desc = beautiful.get_font(font)
+    self._private.layout:set_font_description(desc)
+    self._private.layout_args.font = desc:to_string()
     self:emit_signal("widget::redraw_needed")
     self:emit_signal("widget::layout_changed")
     self:emit_signal("property::font", font)
@@ -447,6 +487,7 @@ function textbox:set_line_spacing_factor(spacing)
 
     spacing = spacing or 0
     self._private.layout:set_line_spacing(spacing)
+    self._private.layout_args.line_spacing = spacing
     self:emit_signal("widget::redraw_needed")
     self:emit_signal("widget::layout_changed")
     self:emit_signal("property::line_spacing", spacing)
@@ -466,6 +507,7 @@ end
 
 function textbox:set_justify(justify)
     self._private.layout:set_justify(justify)
+    self._private.layout_args.justify = justify
     self:emit_signal("widget::redraw_needed")
     self:emit_signal("widget::layout_changed")
     self:emit_signal("property::justify", justify)
@@ -489,6 +531,7 @@ end
 
 function textbox:set_indent(indent)
     self._private.layout:set_indent(Pango.units_from_double(indent))
+    self._private.layout_args.indent = indent
     self:emit_signal("widget::redraw_needed")
     self:emit_signal("widget::layout_changed")
     self:emit_signal("property::indent", indent)
@@ -512,7 +555,20 @@ local function new(text, ignore_markup)
     ret._private.dpi = -1
     ret._private.ctx = PangoCairo.font_map_get_default():create_context()
     ret._private.layout = Pango.Layout.new(ret._private.ctx)
-    ret._private.layout:set_font_description(beautiful.get_font(beautiful.font))
+    local desc = beautiful.get_font(beautiful.font)
+    ret._private.layout:set_font_description(desc)
+    -- The settings of the shared native layout, they start at Pango's defaults
+    ret._private.layout_args = {
+        text         = "",
+        markup       = false,
+        font         = desc:to_string(),
+        wrap         = "WORD",
+        ellipsize    = "NONE",
+        align        = "LEFT",
+        justify      = false,
+        indent       = 0,
+        line_spacing = 0,
+    }
 
     ret:set_ellipsize("end")
     ret:set_wrap("word_char")
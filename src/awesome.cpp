@@ -20,28 +20,53 @@
  */
 
 #include "awesome.h"
+#include "capture.h"
 
 #include "common/backtrace.h"
+#include "common/log.h"
 #include "common/version.h"
 #include "common/xutil.h"
 #include "dbus.h"
 #include "event.h"
+#include "eventlog.h"
 #include "ewmh.h"
 #include "globalconf.h"
+#include "imageloader.h"
+#include "luaalloc.h"
+#include "mouse.h"
+#include "objects/client.h"
+#include "objects/drawable.h"
 #include "objects/screen.h"
 #include "options.h"
+#include "profiler.h"
+#include "property.h"
+#include "reload.h"
+#include "restartstate.h"
+#include "scratch.h"
 #include "spawn.h"
 #include "systray.h"
+#include "timerwheel.h"
+#include "trace.h"
+#include "uvloop.h"
 #include "xcbcpp/xcb.h"
 #include "xkb.h"
 #include "xwindow.h"
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <fmt/core.h>
+#include <functional>
 #include <glib-unix.h>
 #include <ranges>
+#include <string>
+#include <string_view>
 #include <sys/time.h>
-#include <uv.h>
+#include <unordered_map>
+#include <vector>
+#include <xcb/composite.h>
+#include <xcb/res.h>
+#include <xcb/shm.h>
 #include <xcb/xcb.h>
 
 static Manager* gGlobals = nullptr;
@@ -62,7 +87,7 @@ static struct timeval last_wakeup;
 static float main_loop_iteration_limit = 0.1;
 
 /** A pipe that is used to asynchronously handle SIGCHLD */
-static int sigchld_pipe[2];
+static int sigchld_pipe[2] = {-1, -1};
 
 /* Initialise various random number generators */
 static void init_rng(void) {
@@ -99,7 +124,7 @@ static void init_rng(void) {
 void awesome_atexit(bool restart) {
     lua_State* L = globalconf_get_lua_State();
     lua_pushboolean(L, restart);
-    signal_object_emit(L, &Lua::global_signals, "exit", 1);
+    signal_object_emit(L, &Lua::global_signals, "exit"_sig, 1);
 
     /* Move clients where we want them to be and keep the stacking order intact */
     for (auto* c : Manager::get().getStack()) {
@@ -116,10 +141,26 @@ void awesome_atexit(bool restart) {
     getConnection().replace_property(
       Manager::get().screen->root, AWESOME_CLIENT_ORDER, XCB_ATOM_WINDOW, wins);
 
+    if (restart) {
+        RestartState::save();
+    }
+
     a_dbus_cleanup();
 
     systray_cleanup();
 
+    ImageLoader::cleanup();
+
+    drawable_render_cleanup();
+
+    TimerWheel::cleanup();
+
+    UvLoop::cleanup();
+
+    Trace::stop();
+
+    EventLog::stop();
+
     /* Close Lua */
     lua_close(L);
 
@@ -144,37 +185,52 @@ void awesome_atexit(bool restart) {
 #endif
     getConnection().disconnect();
 
-    close(sigchld_pipe[0]);
-    close(sigchld_pipe[1]);
+    if (sigchld_pipe[0] >= 0) {
+        close(sigchld_pipe[0]);
+        close(sigchld_pipe[1]);
+    }
+
+    /* A restart replaces the process without running atexit() */
+    Log::flush();
 }
 
 /** Restore the client order after a restart */
 static void restore_client_order(xcb_get_property_cookie_t prop_cookie) {
-    int client_idx = 0;
-    xcb_window_t* windows;
-
     auto reply = getConnection().get_property_reply(prop_cookie);
     if (!reply || reply->format != 32 || reply->value_len == 0) {
         return;
     }
 
-    windows = (xcb_window_t*)xcb_get_property_value(reply.get());
+    auto windows = (xcb_window_t*)xcb_get_property_value(reply.get());
 
+    /* The saved windows come first, in their saved order, then the others */
+    auto& clients = Manager::get().clients;
+    std::unordered_map<xcb_window_t, client*> by_window;
+    for (auto* c : clients) {
+        by_window.emplace(c->window, c);
+    }
+    std::vector<client*> order;
+    order.reserve(clients.size());
     for (uint32_t i = 0; i < reply->value_len; i++) {
-        //   Find windows[i] and swap it to where it belongs
-        for (auto*& c : Manager::get().clients) {
-            if (c->window == windows[i]) {
-                std::swap(c, Manager::get().clients[client_idx]);
-                client_idx++;
-            }
+        if (auto it = by_window.find(windows[i]); it != by_window.end()) {
+            order.push_back(it->second);
+            by_window.erase(it);
+        }
+    }
+    for (auto* c : clients) {
+        if (by_window.contains(c->window)) {
+            order.push_back(c);
         }
     }
+    clients = std::move(order);
+    screen_client_index_reorder();
 
-    client_class.emit_signal(globalconf_get_lua_State(), "list", 0);
+    client_class.emit_signal(globalconf_get_lua_State(), "list"_sig, 0);
 }
 /** Scan X to find windows to manage.
  */
 static void scan(xcb_query_tree_cookie_t tree_c) {
+    Profiler::Scope scan_time(Profiler::Phase::Scan);
     auto& conn = getConnection();
     auto tree_r = conn.query_tree_reply(tree_c);
 
@@ -211,14 +267,36 @@ static void scan(xcb_query_tree_cookie_t tree_c) {
                                  };
                              });
 
-    for (const auto& [win, attr_r, geom_r, state] : clients_to_manage) {
+    /* Send the requests of every window to manage before waiting for any of
+     * them, so that managing all windows only waits for the X server once */
+    std::vector<std::tuple<xcb_window_t,
+                           XCB::reply<xcb_get_window_attributes_reply_t>,
+                           XCB::reply<xcb_get_geometry_reply_t>,
+                           client_manage_cookies_t>>
+      candidates;
+    for (auto&& [win, attr_r, geom_r, state] : clients_to_manage) {
         if (geom_r && attr_r && !attr_r->override_redirect &&
             attr_r->map_state != XCB_MAP_STATE_UNMAPPED && state != XCB_ICCCM_WM_STATE_WITHDRAWN) {
-            client_manage(win, geom_r.get(), attr_r.get());
+            candidates.emplace_back(
+              win, std::move(attr_r), std::move(geom_r), client_manage_prefetch(win));
         }
     }
 
+    /* Checking a reparent waits for the X server, so check them all at the
+     * end: only the first check has to wait */
+    std::vector<std::pair<client*, xcb_void_cookie_t>> reparented;
+    for (const auto& [win, attr_r, geom_r, cookies] : candidates) {
+        xcb_void_cookie_t reparent_cookie;
+        if (auto c = client_manage(win, geom_r.get(), attr_r.get(), cookies, &reparent_cookie)) {
+            reparented.emplace_back(c, reparent_cookie);
+        }
+    }
+    for (const auto& [c, reparent_cookie] : reparented) {
+        client_manage_check_reparent(c, reparent_cookie);
+    }
+
     restore_client_order(prop_cookie);
+    RestartState::clear();
 }
 
 static void acquire_WM_Sn(bool replace) {
@@ -331,53 +409,286 @@ static XCB::event<xcb_generic_event_t> poll_for_event(void) {
     return getConnection().poll_for_event();
 }
 
-static void a_xcb_check(void) {
-    XCB::event<xcb_generic_event_t> mouse;
-
-    while (auto event = poll_for_event()) {
-        /* We will treat mouse events later.
-         * We cannot afford to treat all mouse motion events,
-         * because that would be too much CPU intensive, so we just
-         * take the last we get after a bunch of events. */
-        if (XCB_EVENT_RESPONSE_TYPE(event) == XCB_MOTION_NOTIFY) {
-            mouse = std::move(event);
-        } else {
-            uint8_t type = XCB_EVENT_RESPONSE_TYPE(event);
-            if (mouse && (type == XCB_ENTER_NOTIFY || type == XCB_LEAVE_NOTIFY ||
-                          type == XCB_BUTTON_PRESS || type == XCB_BUTTON_RELEASE)) {
-                /* Make sure enter/motion/leave/press/release events are handled
-                 * in the correct order */
-                event_handle(mouse.get());
-                mouse.reset();
+/** Events that must not be folded across: input events, whose handlers need
+ * the state that led to them, and changes to the set of windows.
+ */
+static bool is_coalescing_barrier(uint8_t type) {
+    switch (type) {
+    case XCB_ENTER_NOTIFY:
+    case XCB_LEAVE_NOTIFY:
+    case XCB_BUTTON_PRESS:
+    case XCB_BUTTON_RELEASE:
+    case XCB_KEY_PRESS:
+    case XCB_KEY_RELEASE:
+    case XCB_MAP_NOTIFY:
+    case XCB_UNMAP_NOTIFY:
+    case XCB_DESTROY_NOTIFY:
+    case XCB_REPARENT_NOTIFY: return true;
+    default: return false;
+    }
+}
+
+/** Fold redundant events of a batch. Folded events are reset in place, the
+ * surviving one is always the most recent, so the relative order of the
+ * remaining events is preserved.
+ * Motion notifies keep only the last one, PropertyNotify (new value) the last
+ * one per window and atom, ConfigureNotify the last one per window, and Expose
+ * rectangles are unioned per window.
+ * \param events The batch of events, in arrival order.
+ */
+static void coalesce_events(std::vector<XCB::event<xcb_generic_event_t>>& events) {
+    enum { Motion, Property, Configure, Expose, Count };
+    std::array<std::unordered_map<uint64_t, size_t>, Count> last;
+
+    auto clear = [&] {
+        for (auto& map : last) {
+            map.clear();
+        }
+    };
+    auto fold = [&](int kind, uint64_t key, size_t idx) {
+        auto [it, inserted] = last[kind].try_emplace(key, idx);
+        if (!inserted) {
+            events[it->second].reset();
+            it->second = idx;
+        }
+    };
+
+    for (size_t i = 0; i < events.size(); i++) {
+        auto* event = events[i].get();
+        const uint8_t type = XCB_EVENT_RESPONSE_TYPE(event);
+
+        if (is_coalescing_barrier(type)) {
+            clear();
+            continue;
+        }
+
+        switch (type) {
+        case XCB_MOTION_NOTIFY: fold(Motion, 0, i); break;
+        case XCB_PROPERTY_NOTIFY: {
+            auto* ev = reinterpret_cast<xcb_property_notify_event_t*>(event);
+            /* Deletions drive INCR transfers, each one matters */
+            if (ev->state == XCB_PROPERTY_NEW_VALUE) {
+                fold(Property, uint64_t(ev->atom) << 32 | ev->window, i);
+            }
+        } break;
+        case XCB_CONFIGURE_NOTIFY: {
+            auto* ev = reinterpret_cast<xcb_configure_notify_event_t*>(event);
+            fold(Configure, ev->window, i);
+        } break;
+        case XCB_EXPOSE: {
+            auto* ev = reinterpret_cast<xcb_expose_event_t*>(event);
+            auto it = last[Expose].find(ev->window);
+            if (it != last[Expose].end()) {
+                auto* prev = reinterpret_cast<xcb_expose_event_t*>(events[it->second].get());
+                const int x1 = std::min(prev->x, ev->x), y1 = std::min(prev->y, ev->y);
+                const int x2 = std::max(prev->x + prev->width, ev->x + ev->width);
+                const int y2 = std::max(prev->y + prev->height, ev->y + ev->height);
+                ev->x = x1;
+                ev->y = y1;
+                ev->width = x2 - x1;
+                ev->height = y2 - y1;
+            }
+            fold(Expose, ev->window, i);
+        } break;
+        default: break;
+        }
+    }
+}
+
+/** How long the events of a type took to be handled by a replay */
+struct ReplayStats {
+    size_t count = 0;
+    std::chrono::steady_clock::duration total{}, max{};
+
+    void add(std::chrono::steady_clock::duration spent) {
+        count++;
+        total += spent;
+        max = std::max(max, spent);
+    }
+};
+
+/** Handle the events that were read in one go.
+ * \param events The events, which are consumed.
+ * \param stats Where to count the time per event type, may be NULL.
+ */
+static void handle_event_batch(std::vector<XCB::event<xcb_generic_event_t>>& events,
+                               std::array<ReplayStats, 256>* stats) {
+    /* We cannot afford to treat every event of a burst (mouse motion,
+     * title spinners, resize storms), so redundant ones are dropped. */
+    coalesce_events(events);
+
+    for (auto& event : events) {
+        if (event) {
+            const auto start = stats ? std::chrono::steady_clock::now()
+                                     : std::chrono::steady_clock::time_point{};
+            /* Queued property updates must not cross input or window
+             * changes either */
+            if (is_coalescing_barrier(XCB_EVENT_RESPONSE_TYPE(event.get()))) {
+                property_refetch_flush();
             }
             event_handle(event.get());
+            if (stats) {
+                (*stats)[XCB_EVENT_RESPONSE_TYPE(event.get())].add(
+                  std::chrono::steady_clock::now() - start);
+            }
         }
     }
+    events.clear();
+    property_refetch_flush();
+}
+
+static void a_xcb_check(void) {
+    /* Not static: a handler may run a nested main loop, which checks again */
+    std::vector<XCB::event<xcb_generic_event_t>> events;
+
+    /* Handlers may cause new events, keep going until the queue stays empty */
+    while (true) {
+        while (auto event = poll_for_event()) {
+            if (EventLog::recording) {
+                EventLog::record(event.get());
+            }
+            events.push_back(std::move(event));
+        }
+        if (events.empty()) {
+            break;
+        }
 
-    if (mouse) {
-        event_handle(mouse.get());
+        handle_event_batch(events, nullptr);
+        if (EventLog::recording) {
+            EventLog::end_batch();
+        }
     }
 }
 
-static gboolean a_xcb_io_cb(GIOChannel* source, GIOCondition cond, gpointer data) {
+/** Feed a recording through the event handlers and print how long the
+ * events took, by type.
+ * Events of the server that is running now are handled between the batches,
+ * but not counted. Window ids are the ones of the recorded session, so
+ * events for windows that do not exist here only measure their lookup.
+ */
+static void replay_events(const char* path) {
+    EventLog::Reader reader;
+    if (!reader.open(path)) {
+        log_fatal("Cannot read the event recording {}", path);
+    }
+
+    std::array<ReplayStats, 256> stats;
+    ReplayStats refresh;
+    std::vector<XCB::event<xcb_generic_event_t>> events;
+    XCB::event<xcb_generic_event_t> event;
+    std::chrono::microseconds delay;
+
+    a_xcb_check();
+    awesome_refresh();
+    while (reader.next(event, delay)) {
+        if (event) {
+            events.push_back(std::move(event));
+            continue;
+        }
+        handle_event_batch(events, &stats);
+
+        const auto start = std::chrono::steady_clock::now();
+        awesome_refresh();
+        refresh.add(std::chrono::steady_clock::now() - start);
+
+        a_xcb_check();
+    }
+    handle_event_batch(events, &stats);
+
+    using us = std::chrono::duration<double, std::micro>;
+    auto print = [](std::string_view label, const ReplayStats& s) {
+        fmt::print("{:<24} {:>8} {:>12.1f} {:>10.1f} {:>10.1f}\n",
+                   label,
+                   s.count,
+                   us(s.total).count(),
+                   us(s.total).count() / s.count,
+                   us(s.max).count());
+    };
+    std::vector<uint8_t> types;
+    for (size_t type = 0; type < stats.size(); type++) {
+        if (stats[type].count) {
+            types.push_back(type);
+        }
+    }
+    std::ranges::sort(types, std::greater{}, [&](uint8_t type) { return stats[type].total; });
+
+    fmt::print("{:<24} {:>8} {:>12} {:>10} {:>10}\n", "event", "count", "total us", "avg us", "max us");
+    for (uint8_t type : types) {
+        const char* label = xcb_event_get_label(type);
+        print(label ? label : fmt::format("event {}", type), stats[type]);
+    }
+    if (refresh.count) {
+        print("refresh", refresh);
+    }
+}
+
+static void a_xcb_check_connection(void) {
     /* a_xcb_check() already handled all events */
 
     if (auto err = getConnection().connection_has_error()) {
         log_fatal("X server connection broke (error {})", err);
     }
+}
 
+static gboolean a_xcb_io_cb(GIOChannel* source, GIOCondition cond, gpointer data) {
+    a_xcb_check_connection();
     return TRUE;
 }
 
+/** Do some garbage collection before the main loop goes to sleep, so that it
+ * is not left to allocations while events are handled.
+ * Once a cycle is complete, nothing is done until Lua allocated more memory.
+ * \param L The Lua VM state.
+ */
+static void idle_gc(lua_State* L) {
+    auto& m = Manager::get();
+    if (m.idle_gc_step <= 0 || lua_gc(L, LUA_GCCOUNT, 0) <= m.idle_gc_floor) {
+        return;
+    }
+    Profiler::measure(Profiler::Phase::Gc, [&] {
+        if (lua_gc(L, LUA_GCSTEP, m.idle_gc_step)) {
+            m.idle_gc_floor = lua_gc(L, LUA_GCCOUNT, 0);
+        }
+    });
+}
+
+/** Find out how long the deferred work waits for the next frame.
+ * Without frame pacing, and when the focus changed, it is done right away.
+ * \return How long to wait, zero if the work is due now.
+ */
+static std::chrono::milliseconds refresh_delay(void) {
+    auto& pacing = Manager::get().frame_pacing;
+    if (!pacing.enabled || Manager::get().focus.need_update) {
+        return {};
+    }
+    const auto now = std::chrono::steady_clock::now();
+    const auto next = pacing.last_refresh + pacing.interval;
+    if (now >= next) {
+        return {};
+    }
+    return std::chrono::ceil<std::chrono::milliseconds>(next - now);
+}
+
 static gint a_glib_poll(GPollFD* ufds, guint nfsd, gint timeout) {
+    /* Event handlers may run a nested main loop */
+    static int depth = 0;
+    depth++;
     guint res;
     struct timeval now, length_time;
     float length;
     int saved_errno;
     lua_State* L = globalconf_get_lua_State();
 
-    /* Do all deferred work now */
-    awesome_refresh();
+    /* Do all deferred work now, or wake up for it at the next frame */
+    if (const auto delay = refresh_delay(); delay.count() > 0) {
+        if (timeout < 0 || timeout > delay.count()) {
+            timeout = delay.count();
+        }
+    } else {
+        awesome_refresh();
+        Manager::get().frame_pacing.last_refresh = std::chrono::steady_clock::now();
+    }
+    Profiler::startup_finished();
 
     /* Check if the Lua stack is the way it should be */
     if (lua_gettop(L) != 0) {
@@ -397,6 +708,9 @@ static gint a_glib_poll(GPollFD* ufds, guint nfsd, gint timeout) {
     gettimeofday(&now, NULL);
     timersub(&now, &last_wakeup, &length_time);
     length = length_time.tv_sec + length_time.tv_usec * 1.0f / 1e6;
+    Profiler::record(Profiler::Phase::Iteration,
+                     std::chrono::seconds(length_time.tv_sec) +
+                       std::chrono::microseconds(length_time.tv_usec));
     if (length > main_loop_iteration_limit) {
         log_warn(
           "Last main loop iteration took {:.6f} seconds! Increasing limit for "
@@ -404,14 +718,38 @@ static gint a_glib_poll(GPollFD* ufds, guint nfsd, gint timeout) {
           length);
         main_loop_iteration_limit = length;
     }
+    Profiler::check_x_wait();
+
+    /* The pointer may move while we sleep */
+    mouse_pointer_forget();
+
+    /* Only when about to sleep, otherwise work is waiting. The trace is written
+     * while there is nothing else to do. */
+    if (timeout != 0) {
+        Trace::flush();
+        EventLog::flush();
+        idle_gc(L);
+    }
+
+    /* The temporaries of this iteration are gone, unless this is a nested loop
+     * or an iteration before the main loop runs, like one started while rc.lua
+     * is loaded, where the callers up the stack may still hold some */
+    GMainLoop* loop = Manager::get().loop;
+    if (depth == 1 && g_main_depth() == 0 && loop && g_main_loop_is_running(loop)) {
+        Scratch::reset();
+    }
 
     /* Actually do the polling, record time of wakeup and check for new xcb events */
-    res = g_poll(ufds, nfsd, timeout);
+    res = Profiler::measure(Profiler::Phase::Poll, [&] {
+        return UvLoop::active() ? UvLoop::poll(ufds, nfsd, timeout) : g_poll(ufds, nfsd, timeout);
+    });
     saved_errno = errno;
     gettimeofday(&last_wakeup, NULL);
-    a_xcb_check();
+    Profiler::input_wakeup();
+    Profiler::measure(Profiler::Phase::Events, a_xcb_check);
     errno = saved_errno;
 
+    depth--;
     return res;
 }
 
@@ -428,22 +766,27 @@ static void signal_child(int signum) {
     assert(res == 1);
 }
 
-/* There was a SIGCHLD signal. Read from sigchld_pipe and reap children. */
-static gboolean reap_children(GIOChannel* channel, GIOCondition condition, gpointer user_data) {
+/* Reap all children that exited. */
+static void reap_exited_children(void) {
     pid_t child;
     int status;
-    char buffer[1024];
-    ssize_t result = read(sigchld_pipe[0], &buffer[0], sizeof(buffer));
-    if (result < 0) {
-        log_fatal("Error reading from signal pipe: {}", strerror(errno));
-    }
-
     while ((child = waitpid(-1, &status, WNOHANG)) > 0) {
         spawn_child_exited(child, status);
     }
     if (child < 0 && errno != ECHILD) {
         log_warn("waitpid(-1) failed: {}", strerror(errno));
     }
+}
+
+/* There was a SIGCHLD signal. Read from sigchld_pipe and reap children. */
+static gboolean reap_children(GIOChannel* channel, GIOCondition condition, gpointer user_data) {
+    char buffer[1024];
+    ssize_t result = read(sigchld_pipe[0], &buffer[0], sizeof(buffer));
+    if (result < 0) {
+        log_fatal("Error reading from signal pipe: {}", strerror(errno));
+    }
+
+    reap_exited_children();
     return TRUE;
 }
 
@@ -468,6 +811,18 @@ static gboolean restart_on_signal(gpointer data) {
     return TRUE;
 }
 
+/** Create the cursor context and the X resource database. This runs on a
+ * thread while the rest of the startup goes on, XCB connections are thread
+ * safe and nothing else uses these two before Lua is initialized.
+ * \return The result of xcb_cursor_context_new().
+ */
+static gpointer get_x_resources(gpointer) {
+    const int status = xcb_cursor_context_new(
+      getConnection().getConnection(), Manager::get().screen, &Manager::get().x.cursor_ctx);
+    Manager::get().x.xrmdb = xcb_xrm_database_from_default(getConnection().getConnection());
+    return GINT_TO_POINTER(status);
+}
+
 /** Hello, this is main.
  * \param argc Who knows.
  * \param argv Who knows.
@@ -509,6 +864,15 @@ int main(int argc, char** argv) {
     Manager::get().startup.have_searchpaths = opts.have_searchpaths;
     Manager::get().had_overriden_depth = opts.had_overriden_depth;
 
+    if (opts.tracePath) {
+        Trace::start(opts.tracePath->c_str());
+    }
+    Profiler::startup_report = opts.startup_report;
+    LuaAlloc::enabled = opts.lua_pool_alloc;
+    if (opts.recordPath) {
+        EventLog::start(opts.recordPath->c_str());
+    }
+
     if (opts.no_auto_screen.has_value()) {
         Manager::get().startup.no_auto_screen = opts.no_auto_screen.value();
     }
@@ -551,8 +915,11 @@ int main(int argc, char** argv) {
                                      opts.searchPaths);
     }
 
-    /* Setup pipe for SIGCHLD processing */
-    {
+    /* Setup pipe for SIGCHLD processing, libuv has its own */
+    if (opts.uv_loop) {
+        UvLoop::init();
+        UvLoop::watch_children(reap_exited_children);
+    } else {
         if (!g_unix_open_pipe(sigchld_pipe, FD_CLOEXEC, NULL)) {
             log_fatal("Failed to create pipe");
         }
@@ -578,9 +945,11 @@ int main(int argc, char** argv) {
     sigaction(SIGSEGV, &sa, 0);
     signal(SIGPIPE, SIG_IGN);
 
-    sa.sa_handler = signal_child;
-    sa.sa_flags = SA_NOCLDSTOP | SA_RESTART;
-    sigaction(SIGCHLD, &sa, 0);
+    if (!UvLoop::active()) {
+        sa.sa_handler = signal_child;
+        sa.sa_flags = SA_NOCLDSTOP | SA_RESTART;
+        sigaction(SIGCHLD, &sa, 0);
+    }
 
     /* We have no clue where the input focus is right now */
     Manager::get().focus.need_update = true;
@@ -588,12 +957,24 @@ int main(int argc, char** argv) {
     /* set the default preferred icon size */
     Manager::get().preferred_icon_size = 0;
 
+    Profiler::startup_phase("init");
+
+    /* start connecting to D-Bus, a_dbus_init() finishes that */
+    a_dbus_connect_start();
+
     /* X stuff */
     Manager::get().x.connection = XCB::Connection::connect(NULL, &Manager::get().x.default_screen);
 
     if (auto err = getConnection().connection_has_error()) {
         log_fatal("cannot open display (error {})", err);
     }
+    Profiler::startup_phase("x_connect");
+
+    /* The X server answers these while we do other things */
+    atoms_init_send(getConnection().getConnection());
+
+    /* Pick up what the process that restarted into this one knew */
+    RestartState::load();
 
     Manager::get().screen = getConnection().aux_get_screen(Manager::get().x.default_screen);
     Manager::get().default_visual = draw_default_visual(Manager::get().screen);
@@ -631,34 +1012,28 @@ int main(int argc, char** argv) {
     getConnection().prefetch_extension_data(&xcb_xinerama_id);
     getConnection().prefetch_extension_data(&xcb_shape_id);
     getConnection().prefetch_extension_data(&xcb_xfixes_id);
+    getConnection().prefetch_extension_data(&xcb_composite_id);
+    getConnection().prefetch_extension_data(&xcb_damage_id);
+    getConnection().prefetch_extension_data(&xcb_res_id);
 
-    if (xcb_cursor_context_new(getConnection().getConnection(),
-                               Manager::get().screen,
-                               &Manager::get().x.cursor_ctx) < 0) {
-        log_fatal("Failed to initialize xcb-cursor");
-    }
-    Manager::get().x.xrmdb = xcb_xrm_database_from_default(getConnection().getConnection());
-    if (Manager::get().x.xrmdb == NULL) {
-        Manager::get().x.xrmdb = xcb_xrm_database_from_string("");
-    }
-    if (Manager::get().x.xrmdb == NULL) {
-        log_fatal("Failed to initialize xcb-xrm");
-    }
+    /* These mostly wait for the X server */
+    GThread* x_resources = g_thread_new("x resources", get_x_resources, NULL);
 
     /* Did we get some usable data from the above X11 setup? */
     draw_test_cairo_xcb();
+    Profiler::startup_phase("x_setup");
 
     /* Acquire the WM_Sn selection */
     acquire_WM_Sn(default_init_flags & Options::INIT_FLAG_REPLACE_WM);
-
-    /* initialize dbus */
-    a_dbus_init();
+    Profiler::startup_phase("acquire_wm_sn");
 
     /* Get the file descriptor corresponding to the X connection */
     int xfd = xcb_get_file_descriptor(getConnection().getConnection());
-    GIOChannel* channel = g_io_channel_unix_new(xfd);
-    g_io_add_watch(channel, G_IO_IN, a_xcb_io_cb, NULL);
-    g_io_channel_unref(channel);
+    if (!UvLoop::active() || !UvLoop::watch_x(xfd, a_xcb_check_connection)) {
+        GIOChannel* channel = g_io_channel_unix_new(xfd);
+        g_io_add_watch(channel, G_IO_IN, a_xcb_io_cb, NULL);
+        g_io_channel_unref(channel);
+    }
 
     /* Grab server */
     getConnection().grab_server();
@@ -700,6 +1075,10 @@ int main(int argc, char** argv) {
         p_delete(&reply);
     }
 
+    /* check for shm extension */
+    query = xcb_get_extension_data(getConnection().getConnection(), &xcb_shm_id);
+    Manager::get().x.caps.have_shm = query && query->present;
+
     /* check for xfixes extension */
     query = xcb_get_extension_data(getConnection().getConnection(), &xcb_xfixes_id);
     Manager::get().x.caps.have_xfixes = query && query->present;
@@ -708,6 +1087,8 @@ int main(int argc, char** argv) {
           xcb_xfixes_query_version(getConnection().getConnection(), 1, 0).sequence);
     }
 
+    Capture::init();
+
     event_init();
 
     /* Allocate the key symbols */
@@ -717,13 +1098,16 @@ int main(int argc, char** argv) {
     atoms_init(getConnection().getConnection());
 
     ewmh_init();
+    property_init();
     systray_init();
 
     /* init spawn (sn) */
     spawn_init();
+    Profiler::startup_phase("x_init");
 
     /* init xkb */
     xkb_init();
+    Profiler::startup_phase("xkb");
 
     /* The default GC is just a newly created associated with a window with
      * depth globalconf.default_depth.
@@ -769,6 +1153,24 @@ int main(int argc, char** argv) {
 
     /* get the current wallpaper, from now on we are informed when it changes */
     root_update_wallpaper();
+    Profiler::startup_phase("root_window");
+
+    /* Wait for everything that was started in the background */
+    if (GPOINTER_TO_INT(g_thread_join(x_resources)) < 0) {
+        log_fatal("Failed to initialize xcb-cursor");
+    }
+    if (Manager::get().x.xrmdb == NULL) {
+        Manager::get().x.xrmdb = xcb_xrm_database_from_string("");
+    }
+    if (Manager::get().x.xrmdb == NULL) {
+        log_fatal("Failed to initialize xcb-xrm");
+    }
+    xkb_init_wait();
+    Profiler::startup_phase("background_init");
+
+    /* initialize dbus */
+    a_dbus_init();
+    Profiler::startup_phase("dbus");
 
     /* init lua */
     Lua::init(&xdg, opts.searchPaths);
@@ -776,6 +1178,8 @@ int main(int argc, char** argv) {
     init_rng();
 
     ewmh_init_lua();
+    Reload::snapshot(opts.configPath);
+    Profiler::startup_phase("lua_init");
 
     /* Parse and run configuration file before adding the screens */
     if (Manager::get().startup.no_auto_screen) {
@@ -785,14 +1189,19 @@ int main(int argc, char** argv) {
         if (!opts.configPath || !Lua::parserc(&xdg, opts.configPath->c_str())) {
             log_fatal("couldn't find any rc file");
         }
+        Profiler::startup_phase("config");
     }
 
     /* init screens information */
     screen_scan();
+    Profiler::startup_phase("screen_scan");
 
     /* Parse and run configuration file after adding the screens */
-    if (((!Manager::get().startup.no_auto_screen) && !Lua::parserc(&xdg, opts.configPath))) {
-        log_fatal("couldn't find any rc file");
+    if (!Manager::get().startup.no_auto_screen) {
+        if (!Lua::parserc(&xdg, opts.configPath)) {
+            log_fatal("couldn't find any rc file");
+        }
+        Profiler::startup_phase("config");
     }
 
     xdgWipeHandle(&xdg);
@@ -800,6 +1209,7 @@ int main(int argc, char** argv) {
     /* Both screen scanning mode have this signal, it cannot be in screen_scan
        since the automatic screen generation don't have executed rc.lua yet. */
     screen_emit_scanned();
+    Profiler::startup_phase("screen_signals");
 
     /* Exit if the user doesn't read the instructions properly */
     if (Manager::get().startup.no_auto_screen && !Manager::get().screens.size()) {
@@ -815,8 +1225,16 @@ int main(int argc, char** argv) {
     scan(tree_c);
 
     client_emit_scanned();
+    Profiler::startup_phase("client_scan");
 
     Lua::emit_startup();
+    Profiler::startup_phase("startup_signal");
+
+    if (opts.replayPath) {
+        replay_events(opts.replayPath->c_str());
+        awesome_atexit(false);
+        return Manager::get().exit_code;
+    }
 
     /* Setup the main context */
     g_main_context_set_poll_func(g_main_context_default(), &a_glib_poll);
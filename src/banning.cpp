@@ -23,6 +23,10 @@
 
 #include "globalconf.h"
 #include "objects/client.h"
+#include "objects/tag.h"
+#include "scratch.h"
+
+#include <vector>
 
 /** Reban windows following current selected tags.
  */
@@ -31,24 +35,53 @@ void banning_need_update(void) {
      * excessive updates...  */
     Manager::get().need_lazy_banning = true;
 
-    /* But if a client will be banned in our next update we unfocus it now. */
-    for (auto* c : Manager::get().clients) {
-        if (!client_isvisible(c)) {
-            client_ban_unfocus(c);
-        }
+    /* But if a client will be banned in our next update we unfocus it now.
+     * Only the focused client can lose the focus. */
+    if (auto c = Manager::get().focus.client; c && !client_isvisible(c)) {
+        client_ban_unfocus(c);
     }
 }
 
-/** Check all clients if they need to rebanned
+/** Reban a client whose visibility may have changed.
+ * \param c The client.
  */
-void banning_refresh(void) {
-    if (!Manager::get().need_lazy_banning) {
-        return;
+void banning_need_update(client* c) {
+    if (!c->banning_dirty) {
+        c->banning_dirty = true;
+        Manager::get().banning_dirty.push_back(c);
     }
 
-    Manager::get().need_lazy_banning = false;
+    /* If the client will be banned in our next update we unfocus it now. */
+    if (!client_isvisible(c)) {
+        client_ban_unfocus(c);
+    }
+}
+
+/** Reban the clients of a tag whose selection changed.
+ * \param t The tag.
+ */
+void banning_need_update(tag_t* t) {
+    for (auto* c : t->clients) {
+        banning_need_update(c);
+    }
+}
 
-    for (auto* c : Manager::get().clients) {
+/** Forget about a client that is going away.
+ * \param c The client.
+ */
+void banning_client_remove(client* c) {
+    if (c->banning_dirty) {
+        std::erase(Manager::get().banning_dirty, c);
+        c->banning_dirty = false;
+    }
+}
+
+/** Reban a list of clients.
+ * \param clients The clients to check.
+ */
+template <typename Range>
+static void banning_refresh_clients(const Range& clients) {
+    for (auto* c : clients) {
         if (client_isvisible(c)) {
             client_unban(c);
         }
@@ -56,11 +89,80 @@ void banning_refresh(void) {
 
     /* Some people disliked the short flicker of background, so we first unban everything.
      * Afterwards we ban everything we don't want. This should avoid that. */
-    for (auto* c : Manager::get().clients) {
+    for (auto* c : clients) {
         if (!client_isvisible(c)) {
             client_ban(c);
         }
     }
 }
 
+/** Check if the client in a slot is visible, see client_isvisible().
+ * \param hot The client state.
+ * \param slot The slot of a managed client.
+ * \param selected The bits of the first 64 selected tags.
+ */
+static bool banning_slot_visible(const ClientHotStore& hot, size_t slot, uint64_t selected) {
+    using F = ClientHotStore::flag_t;
+    const uint8_t flags = hot.flags(slot);
+    if (flags & (F::hidden | F::minimized)) {
+        return false;
+    }
+    if (flags & F::wide_tags) {
+        return client_on_selected_tags(hot.owner(slot));
+    }
+    return (flags & F::sticky) || (hot.tags(slot) & selected);
+}
+
+/** Reban all clients, reading their state from the slots.
+ * Only the clients whose banning changes are touched. Unbanning runs Lua code,
+ * which may change the state of other clients or free slots, so the slots are
+ * read again for each client.
+ */
+static void banning_refresh_all(void) {
+    const auto& hot = Manager::get().clients_hot;
+    auto selected = [] { return Manager::get().selected_tags.word(0); };
+
+    for (size_t slot = 0; slot < hot.size(); slot++) {
+        if (hot.owner(slot) && (hot.flags(slot) & ClientHotStore::banned) &&
+            banning_slot_visible(hot, slot, selected())) {
+            client_unban(hot.owner(slot));
+        }
+    }
+
+    /* Some people disliked the short flicker of background, so we first unban everything.
+     * Afterwards we ban everything we don't want. This should avoid that. */
+    for (size_t slot = 0; slot < hot.size(); slot++) {
+        if (hot.owner(slot) && !(hot.flags(slot) & ClientHotStore::banned) &&
+            !banning_slot_visible(hot, slot, selected())) {
+            client_ban(hot.owner(slot));
+        }
+    }
+}
+
+/** Check all clients whose visibility may have changed if they need to be
+ * rebanned
+ */
+void banning_refresh(void) {
+    auto& manager = Manager::get();
+    if (!manager.need_lazy_banning && manager.banning_dirty.empty()) {
+        return;
+    }
+
+    /* Unbanning can run Lua code which may mark clients again, these are
+     * handled by the next refresh */
+    const Scratch::vector<client*> dirty(manager.banning_dirty.begin(),
+                                         manager.banning_dirty.end());
+    manager.banning_dirty.clear();
+    for (auto* c : dirty) {
+        c->banning_dirty = false;
+    }
+
+    if (manager.need_lazy_banning) {
+        manager.need_lazy_banning = false;
+        banning_refresh_all();
+    } else {
+        banning_refresh_clients(dirty);
+    }
+}
+
 // vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
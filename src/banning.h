@@ -20,5 +20,11 @@
  */
 #pragma once
 
+struct client;
+struct tag_t;
+
 void banning_need_update(void);
+void banning_need_update(client*);
+void banning_need_update(tag_t*);
+void banning_client_remove(client*);
 void banning_refresh(void);
@@ -0,0 +1,396 @@
+/*
+ * capture.cpp - client content capture
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "capture.h"
+
+#include "common/util.h"
+#include "draw.h"
+#include "globalconf.h"
+#include "objects/client.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sys/shm.h>
+#include <unordered_map>
+#include <xcb/composite.h>
+#include <xcb/shm.h>
+
+namespace Capture {
+
+namespace {
+
+struct Entry {
+    /** The storage of the window, named when it is captured */
+    xcb_pixmap_t pixmap = XCB_NONE;
+    uint16_t width = 0, height = 0;
+    /** The captures in progress plus one for a kept thumbnail, the window is
+     * redirected while this is not 0 */
+    unsigned redirects = 0;
+    /** Whether a thumbnail holds one of the redirects */
+    bool kept = false;
+    xcb_damage_damage_t damage = XCB_NONE;
+    /** Whether the window changed since it was read */
+    bool damaged = true;
+    cairo_surface_t* thumbnail = nullptr;
+    int thumbnail_max_width = 0, thumbnail_max_height = 0;
+};
+
+std::unordered_map<client*, Entry> entries;
+std::unordered_map<xcb_damage_damage_t, client*> by_damage;
+
+/** The segment GetImage is read into, it only ever grows */
+struct {
+    xcb_shm_seg_t seg = XCB_NONE;
+    void* addr = nullptr;
+    size_t size = 0;
+} scratch;
+
+bool scratch_reserve(size_t size) {
+    if (!Manager::get().x.caps.have_shm) {
+        return false;
+    }
+    if (scratch.size >= size) {
+        return true;
+    }
+
+    auto conn = getConnection().getConnection();
+    if (scratch.addr) {
+        xcb_shm_detach(conn, scratch.seg);
+        shmdt(scratch.addr);
+        scratch = {};
+    }
+    const int shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (shmid == -1) {
+        return false;
+    }
+    void* addr = shmat(shmid, NULL, 0);
+    if (addr == (void*)-1) {
+        shmctl(shmid, IPC_RMID, NULL);
+        return false;
+    }
+    const xcb_shm_seg_t seg = getConnection().generate_id();
+    /* The server writes to it, so it must not be read-only */
+    xcb_generic_error_t* error =
+      xcb_request_check(conn, xcb_shm_attach_checked(conn, seg, shmid, 0));
+    shmctl(shmid, IPC_RMID, NULL);
+    if (error) {
+        p_delete(&error);
+        shmdt(addr);
+        return false;
+    }
+    scratch = {seg, addr, size};
+    return true;
+}
+
+/** Give a window a Damage object, to tell when a thumbnail is stale.
+ * It works whether the window is redirected or not.
+ */
+void track(client* c, Entry& entry) {
+    if (Manager::get().x.caps.have_damage && entry.damage == XCB_NONE) {
+        entry.damage = getConnection().generate_id();
+        xcb_damage_create(getConnection().getConnection(),
+                          entry.damage,
+                          c->window,
+                          XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+        by_damage[entry.damage] = c;
+    }
+}
+
+/** Start reporting the changes of a window after this read of it. */
+void subtract(Entry& entry) {
+    if (entry.damage != XCB_NONE) {
+        xcb_damage_subtract(getConnection().getConnection(), entry.damage, XCB_NONE, XCB_NONE);
+    }
+    entry.damaged = false;
+}
+
+/** Give a window its own storage, or keep the one it has.
+ * Even with a compositor, only frames are redirected, the client window needs
+ * its own storage to be named.
+ */
+void redirect(client* c, Entry& entry) {
+    if (entry.redirects++ > 0) {
+        return;
+    }
+    xcb_composite_redirect_window(
+      getConnection().getConnection(), c->window, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+}
+
+/** Drop a reference taken by redirect(), the window is drawn directly again
+ * once nothing needs its storage. */
+void unredirect(client* c, Entry& entry) {
+    if (--entry.redirects > 0) {
+        return;
+    }
+    auto conn = getConnection().getConnection();
+    if (entry.pixmap != XCB_NONE) {
+        xcb_free_pixmap(conn, entry.pixmap);
+        entry.pixmap = XCB_NONE;
+    }
+    xcb_composite_unredirect_window(conn, c->window, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+}
+
+/** Make sure the pixmap of a redirected window is current.
+ * \return False if the window is not viewable.
+ */
+bool prepare(client* c, Entry& entry, uint16_t width, uint16_t height) {
+    auto conn = getConnection().getConnection();
+
+    /* The storage is replaced when the window is mapped or resized, which
+     * damages it as well */
+    if (entry.pixmap != XCB_NONE && (entry.damaged || entry.width != width ||
+                                     entry.height != height)) {
+        xcb_free_pixmap(conn, entry.pixmap);
+        entry.pixmap = XCB_NONE;
+    }
+    if (entry.pixmap != XCB_NONE) {
+        return true;
+    }
+
+    const xcb_pixmap_t pixmap = getConnection().generate_id();
+    xcb_generic_error_t* error =
+      xcb_request_check(conn, xcb_composite_name_window_pixmap_checked(conn, c->window, pixmap));
+    if (error) {
+        /* Not viewable right now */
+        p_delete(&error);
+        return false;
+    }
+    entry.pixmap = pixmap;
+    entry.width = width;
+    entry.height = height;
+    entry.damaged = true;
+    return true;
+}
+
+/** Copy rows of 32 bit pixels into a new image surface */
+cairo_surface_t* to_image(cairo_format_t format, const uint8_t* data, int width, int height) {
+    cairo_surface_t* image = cairo_image_surface_create(format, width, height);
+    if (cairo_surface_status(image) != CAIRO_STATUS_SUCCESS) {
+        return image;
+    }
+    cairo_surface_flush(image);
+    const int stride = cairo_image_surface_get_stride(image);
+    uint8_t* dst = cairo_image_surface_get_data(image);
+    for (int y = 0; y < height; y++) {
+        memcpy(dst + size_t(y) * stride, data + size_t(y) * width * 4, size_t(width) * 4);
+    }
+    cairo_surface_mark_dirty(image);
+    return image;
+}
+
+/** Copy the content of a client window.
+ * A window which is already redirected is read from its storage. Otherwise it
+ * is read from the screen, which is cheaper than redirecting it for one read
+ * but misses the parts other windows cover, unless it is to stay redirected.
+ * \param keep Whether to redirect the window and keep it redirected after a
+ *   successful read, until unredirect() is called.
+ */
+cairo_surface_t* capture(client* c, Entry& entry, int width, int height, bool keep) {
+    if (!Manager::get().x.caps.have_composite || width <= 0 || height <= 0 ||
+        width > UINT16_MAX || height > UINT16_MAX) {
+        return nullptr;
+    }
+
+    cairo_format_t format;
+    switch (draw_visual_depth(Manager::get().screen, c->visualtype->visual_id)) {
+    case 24: format = CAIRO_FORMAT_RGB24; break;
+    case 32: format = CAIRO_FORMAT_ARGB32; break;
+    default: return nullptr;
+    }
+
+    track(c, entry);
+    if (entry.redirects == 0 && !keep) {
+        /* GetImage fails on windows which are not viewable */
+        if (c->minimized || c->isbanned) {
+            return nullptr;
+        }
+        subtract(entry);
+        return read_drawable(c->window, format, 0, 0, width, height);
+    }
+
+    redirect(c, entry);
+    cairo_surface_t* surface = nullptr;
+    if (prepare(c, entry, width, height)) {
+        subtract(entry);
+        surface = read_drawable(entry.pixmap, format, 0, 0, entry.width, entry.height);
+    }
+    if (!surface || !keep) {
+        unredirect(c, entry);
+    }
+    return surface;
+}
+
+} // namespace
+
+cairo_surface_t* read_drawable(
+  xcb_drawable_t drawable, cairo_format_t format, int x, int y, int width, int height) {
+    auto conn = getConnection().getConnection();
+    const size_t size = size_t(width) * height * 4;
+
+    if (scratch_reserve(size)) {
+        auto reply = xcb_shm_get_image_reply(conn,
+                                             xcb_shm_get_image(conn,
+                                                               drawable,
+                                                               x,
+                                                               y,
+                                                               width,
+                                                               height,
+                                                               ~0u,
+                                                               XCB_IMAGE_FORMAT_Z_PIXMAP,
+                                                               scratch.seg,
+                                                               0),
+                                             NULL);
+        const bool ok = reply && reply->size >= size;
+        p_delete(&reply);
+        if (ok) {
+            return to_image(format, static_cast<const uint8_t*>(scratch.addr), width, height);
+        }
+    }
+
+    auto reply = xcb_get_image_reply(
+      conn,
+      xcb_get_image(conn, XCB_IMAGE_FORMAT_Z_PIXMAP, drawable, x, y, width, height, ~0u),
+      NULL);
+    cairo_surface_t* image = nullptr;
+    if (reply && size_t(xcb_get_image_data_length(reply)) >= size) {
+        image = to_image(format, xcb_get_image_data(reply), width, height);
+    }
+    p_delete(&reply);
+    return image;
+}
+
+cairo_surface_t* root(int x, int y, int width, int height) {
+    const auto screen = Manager::get().screen;
+    x = std::max(x, 0);
+    y = std::max(y, 0);
+    width = std::min(width, int(screen->width_in_pixels) - x);
+    height = std::min(height, int(screen->height_in_pixels) - y);
+    if (width <= 0 || height <= 0) {
+        return nullptr;
+    }
+
+    switch (screen->root_depth) {
+    case 24: return read_drawable(screen->root, CAIRO_FORMAT_RGB24, x, y, width, height);
+    case 32: return read_drawable(screen->root, CAIRO_FORMAT_ARGB32, x, y, width, height);
+    default: return nullptr;
+    }
+}
+
+void init(void) {
+    auto conn = getConnection().getConnection();
+    const xcb_query_extension_reply_t* query;
+
+    query = xcb_get_extension_data(conn, &xcb_composite_id);
+    Manager::get().x.caps.have_composite = query && query->present;
+    if (Manager::get().x.caps.have_composite) {
+        getConnection().discard_reply(xcb_composite_query_version(conn, 0, 2).sequence);
+    }
+
+    /* The version has to be negotiated before Damage can be used */
+    query = xcb_get_extension_data(conn, &xcb_damage_id);
+    Manager::get().x.caps.have_damage = query && query->present;
+    if (Manager::get().x.caps.have_damage) {
+        getConnection().discard_reply(xcb_damage_query_version(conn, 1, 1).sequence);
+        Manager::get().x.event_base_damage = query->first_event;
+    }
+}
+
+cairo_surface_t* content(client* c, int width, int height) {
+    return capture(c, entries[c], width, height, false);
+}
+
+cairo_surface_t*
+thumbnail(client* c, int width, int height, int max_width, int max_height, bool keep) {
+    auto it = entries.find(c);
+    if (it != entries.end() && it->second.thumbnail && !it->second.damaged &&
+        it->second.thumbnail_max_width == max_width &&
+        it->second.thumbnail_max_height == max_height) {
+        return cairo_surface_reference(it->second.thumbnail);
+    }
+
+    /* A persistent thumbnail keeps the window redirected, so that the next one
+     * has the covered parts as well */
+    auto& entry = entries[c];
+    const bool hold = keep && !entry.kept;
+    cairo_surface_t* full = capture(c, entry, width, height, hold);
+    entry.kept = entry.kept || (hold && full);
+    if (!full) {
+        return entry.thumbnail ? cairo_surface_reference(entry.thumbnail) : nullptr;
+    }
+
+    const double scale =
+      std::min({double(max_width) / width, double(max_height) / height, 1.0});
+    const int thumb_width = std::max(1, int(std::lround(width * scale)));
+    const int thumb_height = std::max(1, int(std::lround(height * scale)));
+    cairo_surface_t* thumb =
+      cairo_image_surface_create(cairo_image_surface_get_format(full), thumb_width, thumb_height);
+    cairo_t* cr = cairo_create(thumb);
+    cairo_scale(cr, double(thumb_width) / width, double(thumb_height) / height);
+    cairo_set_source_surface(cr, full, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_destroy(full);
+
+    if (entry.thumbnail) {
+        cairo_surface_destroy(entry.thumbnail);
+    }
+    entry.thumbnail = thumb;
+    entry.thumbnail_max_width = max_width;
+    entry.thumbnail_max_height = max_height;
+    return cairo_surface_reference(thumb);
+}
+
+void handle_damage_notify(xcb_damage_notify_event_t* ev) {
+    if (auto it = by_damage.find(ev->damage); it != by_damage.end()) {
+        entries[it->second].damaged = true;
+    }
+}
+
+void forget(client* c, bool window_gone) {
+    auto it = entries.find(c);
+    if (it == entries.end()) {
+        return;
+    }
+    auto conn = getConnection().getConnection();
+    auto& entry = it->second;
+    if (entry.pixmap != XCB_NONE) {
+        xcb_free_pixmap(conn, entry.pixmap);
+    }
+    if (entry.damage != XCB_NONE) {
+        /* Damage objects go away with their drawable */
+        if (!window_gone) {
+            xcb_damage_destroy(conn, entry.damage);
+        }
+        by_damage.erase(entry.damage);
+    }
+    if (!window_gone && entry.redirects > 0) {
+        xcb_composite_unredirect_window(conn, c->window, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+    }
+    if (entry.thumbnail) {
+        cairo_surface_destroy(entry.thumbnail);
+    }
+    entries.erase(it);
+}
+
+} // namespace Capture
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,89 @@
+/*
+ * capture.h - client content capture header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include <cairo.h>
+#include <xcb/damage.h>
+#include <xcb/xproto.h>
+
+struct client;
+
+/** Copies of client windows.
+ *
+ * A client window is read from the screen, unless it is redirected, in which
+ * case it is read from its Composite pixmap. Each captured window gets a
+ * Damage object. Thumbnails are kept until the window is damaged, so repeated
+ * previews of unchanged windows do not read the window again. A window with a
+ * persistent thumbnail is redirected and stays so, so that its storage has
+ * the content of covered parts as well.
+ *
+ * Everything is read through one MIT-SHM segment that is kept between
+ * captures, so that large reads do not go through the X socket.
+ */
+namespace Capture {
+
+/** Find out whether Composite and Damage are there. */
+void init(void);
+
+/** Copy a part of a drawable with 32 bits per pixel.
+ * \param drawable The drawable to read.
+ * \param format The format of the image, RGB24 or ARGB32.
+ * \return A new image surface, or NULL if reading failed.
+ */
+cairo_surface_t* read_drawable(
+  xcb_drawable_t drawable, cairo_format_t format, int x, int y, int width, int height);
+
+/** Copy a part of the root window, clipped to the screen.
+ * \return A new image surface, or NULL if the part is empty or the root
+ *   window does not use 32 bits per pixel.
+ */
+cairo_surface_t* root(int x, int y, int width, int height);
+
+/** Copy the content of a client window.
+ * \param c The client.
+ * \param width The width of the client window.
+ * \param height The height of the client window.
+ * \return A new image surface, or NULL if the window cannot be captured.
+ */
+cairo_surface_t* content(client* c, int width, int height);
+
+/** A scaled copy of the content of a client window.
+ * \param c The client.
+ * \param width The width of the client window.
+ * \param height The height of the client window.
+ * \param max_width The largest width of the thumbnail.
+ * \param max_height The largest height of the thumbnail.
+ * \param keep Whether to keep the window redirected from now on, so that the
+ *   thumbnails include the parts other windows cover.
+ * \return A new reference to the thumbnail, or NULL. While the window cannot
+ *   be captured, e.g. because it is minimized, this is the last thumbnail.
+ */
+cairo_surface_t*
+thumbnail(client* c, int width, int height, int max_width, int max_height, bool keep);
+
+void handle_damage_notify(xcb_damage_notify_event_t* ev);
+
+/** Drop everything of a client.
+ * \param window_gone Whether the window was destroyed already.
+ */
+void forget(client* c, bool window_gone);
+
+} // namespace Capture
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
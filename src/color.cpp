@@ -25,7 +25,10 @@
 #include "globalconf.h"
 
 #include <ctype.h>
+#include <list>
+#include <string>
 #include <string_view>
+#include <unordered_map>
 
 /* 0xFFFF / 0xFF == 0x101 (257) */
 #define RGB_8TO16(i) static_cast<uint16_t>(((i) & 0xff) * 0x101)
@@ -103,6 +106,53 @@ static uint32_t apply_mask(uint8_t component, uint32_t mask) {
     return result << shift;
 }
 
+/** Colors that were already resolved, keyed by color string and visual. Most
+ * recently used first. */
+struct ColorCache {
+    struct Entry {
+        std::string colstr;
+        xcb_visualid_t visual;
+        color_t color;
+    };
+    struct Hash {
+        size_t operator()(const std::pair<std::string_view, xcb_visualid_t>& key) const {
+            return std::hash<std::string_view>{}(key.first) ^ (size_t(key.second) * 0x9e3779b9);
+        }
+    };
+
+    static constexpr size_t limit = 64;
+    std::list<Entry> entries;
+    std::unordered_map<std::pair<std::string_view, xcb_visualid_t>,
+                       std::list<Entry>::iterator,
+                       Hash>
+      index;
+
+    const color_t* find(std::string_view colstr, xcb_visualid_t visual) {
+        auto it = index.find({colstr, visual});
+        if (it == index.end()) {
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        return &it->second->color;
+    }
+
+    void insert(std::string_view colstr, xcb_visualid_t visual, const color_t& color) {
+        if (find(colstr, visual)) {
+            return;
+        }
+        if (entries.size() >= limit) {
+            auto& last = entries.back();
+            index.erase({last.colstr, last.visual});
+            entries.pop_back();
+        }
+        entries.push_front({std::string(colstr), visual, color});
+        index.emplace(std::pair<std::string_view, xcb_visualid_t>{entries.front().colstr, visual},
+                      entries.begin());
+    }
+};
+
+static ColorCache color_cache;
+
 /** Send a request to initialize a X color.
  * \param color color_t struct to store color into.
  * \param colstr Color specification.
@@ -123,6 +173,14 @@ color_init_unchecked(color_t* color, const char* colstr, ssize_t len, xcb_visual
     }
 
     req.color = color;
+    req.visual = visual->visual_id;
+
+    if (auto cached = color_cache.find({colstr, size_t(len)}, visual->visual_id)) {
+        *color = *cached;
+        req.colstr = colstr;
+        req.len = len;
+        return req;
+    }
 
     /* The color is given in RGB value */
     if (!color_parse(colstr, len, &red, &green, &blue, &alpha)) {
@@ -132,6 +190,7 @@ color_init_unchecked(color_t* color, const char* colstr, ssize_t len, xcb_visual
     }
 
     req.colstr = colstr;
+    req.len = len;
     req.has_error = false;
 
     if (visual->_class == XCB_VISUAL_CLASS_TRUE_COLOR ||
@@ -153,6 +212,7 @@ color_init_unchecked(color_t* color, const char* colstr, ssize_t len, xcb_visual
         req.color->blue = RGB_8TO16(blue);
         req.color->alpha = RGB_8TO16(alpha);
         req.color->initialized = true;
+        color_cache.insert({colstr, size_t(len)}, req.visual, *req.color);
         return req;
     }
     req.cookie_hexa = getConnection().alloc_color_unchecked(
@@ -169,7 +229,8 @@ bool color_init_reply(color_init_request_t req) {
     if (req.has_error) {
         return false;
     }
-    if (req.color->initialized) {
+    /* No request was sent, the color is already known */
+    if (!req.cookie_hexa.sequence) {
         return true;
     }
 
@@ -180,6 +241,7 @@ bool color_init_reply(color_init_request_t req) {
         req.color->blue = hexa_color->blue;
         req.color->alpha = 0xffff;
         req.color->initialized = true;
+        color_cache.insert({req.colstr, size_t(req.len)}, req.visual, *req.color);
         return true;
     }
 
@@ -39,6 +39,8 @@ typedef struct {
     color_t* color;
     bool has_error;
     const char* colstr;
+    ssize_t len;
+    xcb_visualid_t visual;
 } color_init_request_t;
 
 color_init_request_t color_init_unchecked(color_t*, const char*, ssize_t, xcb_visualtype_t* visual);
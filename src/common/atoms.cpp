@@ -22,8 +22,13 @@
 #include "common/atoms.h"
 
 #include "common/util.h"
+#include "xcbcpp/xcb.h"
 
 #include <array>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 typedef struct {
     const char* name;
@@ -33,25 +38,154 @@ typedef struct {
 
 #include "atoms-intern.h"
 
+namespace {
+
+struct AtomNameHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+};
+
+/** Every atom whose name is known, in both directions. Atoms never change for
+ * the lifetime of a connection, so nothing is ever removed. A deque keeps the
+ * names in place when it grows, so the indexes can refer to them. */
+struct AtomCache {
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, xcb_atom_t, AtomNameHash, std::equal_to<>> by_name;
+    std::unordered_map<xcb_atom_t, std::string_view> by_atom;
+
+    void add(std::string_view name, xcb_atom_t atom) {
+        if (atom == XCB_NONE || by_atom.contains(atom)) {
+            return;
+        }
+        const auto& stored = names.emplace_back(name);
+        by_name.emplace(stored, atom);
+        by_atom.emplace(atom, stored);
+    }
+};
+
+AtomCache atom_cache;
+
+} // namespace
+
+/** The names of the predefined atoms, from XCB_ATOM_PRIMARY (1) to
+ * XCB_ATOM_WM_TRANSIENT_FOR (68) */
+static constexpr std::string_view predefined_atoms[] = {
+  "PRIMARY", "SECONDARY", "ARC", "ATOM", "BITMAP", "CARDINAL", "COLORMAP", "CURSOR", "CUT_BUFFER0",
+  "CUT_BUFFER1", "CUT_BUFFER2", "CUT_BUFFER3", "CUT_BUFFER4", "CUT_BUFFER5", "CUT_BUFFER6",
+  "CUT_BUFFER7", "DRAWABLE", "FONT", "INTEGER", "PIXMAP", "POINT", "RECTANGLE", "RESOURCE_MANAGER",
+  "RGB_COLOR_MAP", "RGB_BEST_MAP", "RGB_BLUE_MAP", "RGB_DEFAULT_MAP", "RGB_GRAY_MAP",
+  "RGB_GREEN_MAP", "RGB_RED_MAP", "STRING", "VISUALID", "WINDOW", "WM_COMMAND", "WM_HINTS",
+  "WM_CLIENT_MACHINE", "WM_ICON_NAME", "WM_ICON_SIZE", "WM_NAME", "WM_NORMAL_HINTS",
+  "WM_SIZE_HINTS", "WM_ZOOM_HINTS", "MIN_SPACE", "NORM_SPACE", "MAX_SPACE", "END_SPACE",
+  "SUPERSCRIPT_X", "SUPERSCRIPT_Y", "SUBSCRIPT_X", "SUBSCRIPT_Y", "UNDERLINE_POSITION",
+  "UNDERLINE_THICKNESS", "STRIKEOUT_ASCENT", "STRIKEOUT_DESCENT", "ITALIC_ANGLE", "X_HEIGHT",
+  "QUAD_WIDTH", "WEIGHT", "POINT_SIZE", "RESOLUTION", "COPYRIGHT", "NOTICE", "FONT_NAME",
+  "FAMILY_NAME", "FULL_NAME", "CAP_HEIGHT", "WM_CLASS", "WM_TRANSIENT_FOR"
+};
+
+/** The requests sent by atoms_init_send(), in the order of ATOM_LIST */
+static std::vector<xcb_intern_atom_cookie_t> init_cookies;
+
+void atoms_init_send(xcb_connection_t* conn) {
+    /* Create the atom and get the reply in a XCB way (e.g. send all
+     * the requests at the same time and then get the replies) */
+    init_cookies.reserve(std::size(ATOM_LIST));
+    for (const auto& item : ATOM_LIST) {
+        init_cookies.push_back(xcb_intern_atom_unchecked(conn, false, item.len, item.name));
+    }
+    xcb_flush(conn);
+}
+
 void atoms_init(xcb_connection_t* conn) {
     unsigned int i;
-    xcb_intern_atom_cookie_t cs[std::size(ATOM_LIST)];
     xcb_intern_atom_reply_t* r;
 
-    /* Create the atom and get the reply in a XCB way (e.g. send all
-     * the requests at the same time and then get the replies) */
-    for (i = 0; i < std::size(ATOM_LIST); i++) {
-        cs[i] = xcb_intern_atom_unchecked(conn, false, ATOM_LIST[i].len, ATOM_LIST[i].name);
+    for (i = 0; i < std::size(predefined_atoms); i++) {
+        atom_cache.add(predefined_atoms[i], i + 1);
+    }
+
+    if (init_cookies.empty()) {
+        atoms_init_send(conn);
     }
 
     for (i = 0; i < std::size(ATOM_LIST); i++) {
-        if (!(r = xcb_intern_atom_reply(conn, cs[i], NULL))) {
+        r = XCB::stats.wait(std::source_location::current(),
+                            [&] { return xcb_intern_atom_reply(conn, init_cookies[i], NULL); });
+        if (!r) {
             /* An error occurred, get reply for next atom */
             continue;
         }
 
         *ATOM_LIST[i].atom = r->atom;
+        atom_cache.add({ATOM_LIST[i].name, ATOM_LIST[i].len}, r->atom);
+        p_delete(&r);
+    }
+    init_cookies.clear();
+}
+
+xcb_atom_t
+atoms_get(xcb_connection_t* conn, std::string_view name, const std::source_location& loc) {
+    xcb_atom_t atom;
+    atoms_get(conn, std::span(&name, 1), std::span(&atom, 1), loc);
+    return atom;
+}
+
+void atoms_get(xcb_connection_t* conn,
+               std::span<const std::string_view> names,
+               std::span<xcb_atom_t> atoms,
+               const std::source_location& loc) {
+    std::vector<std::pair<size_t, xcb_intern_atom_cookie_t>> pending;
+
+    for (size_t i = 0; i < names.size(); i++) {
+        if (auto it = atom_cache.by_name.find(names[i]); it != atom_cache.by_name.end()) {
+            atoms[i] = it->second;
+        } else {
+            pending.emplace_back(
+              i, xcb_intern_atom_unchecked(conn, false, names[i].size(), names[i].data()));
+        }
+    }
+
+    for (const auto& [i, cookie] : pending) {
+        xcb_intern_atom_reply_t* r =
+          XCB::stats.wait(loc, [&] { return xcb_intern_atom_reply(conn, cookie, NULL); });
+        atoms[i] = r ? r->atom : XCB_NONE;
+        atom_cache.add(names[i], atoms[i]);
+        p_delete(&r);
+    }
+}
+
+std::optional<std::string_view>
+atoms_name(xcb_connection_t* conn, xcb_atom_t atom, const std::source_location& loc) {
+    std::optional<std::string_view> name;
+    atoms_names(conn, std::span(&atom, 1), std::span(&name, 1), loc);
+    return name;
+}
+
+void atoms_names(xcb_connection_t* conn,
+                 std::span<const xcb_atom_t> atoms,
+                 std::span<std::optional<std::string_view>> names,
+                 const std::source_location& loc) {
+    std::vector<std::pair<size_t, xcb_get_atom_name_cookie_t>> pending;
+
+    for (size_t i = 0; i < atoms.size(); i++) {
+        if (auto it = atom_cache.by_atom.find(atoms[i]); it != atom_cache.by_atom.end()) {
+            names[i] = it->second;
+        } else {
+            pending.emplace_back(i, xcb_get_atom_name_unchecked(conn, atoms[i]));
+        }
+    }
+
+    for (const auto& [i, cookie] : pending) {
+        xcb_get_atom_name_reply_t* r =
+          XCB::stats.wait(loc, [&] { return xcb_get_atom_name_reply(conn, cookie, NULL); });
+        if (!r) {
+            names[i] = std::nullopt;
+            continue;
+        }
+        atom_cache.add({xcb_get_atom_name_name(r), size_t(xcb_get_atom_name_name_length(r))},
+                       atoms[i]);
         p_delete(&r);
+        names[i] = atom_cache.by_atom.at(atoms[i]);
     }
 }
 
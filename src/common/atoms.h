@@ -22,4 +22,65 @@
 #pragma once
 #include "atoms-extern.h"
 
-void atoms_init(xcb_connection_t*);
+#include <optional>
+#include <source_location>
+#include <span>
+#include <string_view>
+
+/** Send the requests for the atoms of atoms.list without waiting for them, so
+ * that the X server answers while the rest of the initialization goes on.
+ * \param conn The connection.
+ */
+void atoms_init_send(xcb_connection_t* conn);
+
+/** Set the atoms of atoms.list, sending their requests first unless
+ * atoms_init_send() already did.
+ * \param conn The connection.
+ */
+void atoms_init(xcb_connection_t* conn);
+
+/** Get the atom with the given name, interning it if needed.
+ * Atoms and their names are cached, so only the first lookup of an atom waits
+ * for the X server. This includes every atom from atoms.list.
+ * \param conn The connection.
+ * \param name The atom name.
+ * \param loc Where the wait is accounted in awesome.x_stats().
+ * \return The atom, or XCB_NONE on error.
+ */
+xcb_atom_t atoms_get(xcb_connection_t* conn,
+                     std::string_view name,
+                     const std::source_location& loc = std::source_location::current());
+
+/** Get several atoms, sending the requests for all unknown ones at once.
+ * \param conn The connection.
+ * \param names The atom names.
+ * \param atoms Filled with the atoms, XCB_NONE on error.
+ * \param loc Where the wait is accounted in awesome.x_stats().
+ */
+void atoms_get(xcb_connection_t* conn,
+               std::span<const std::string_view> names,
+               std::span<xcb_atom_t> atoms,
+               const std::source_location& loc = std::source_location::current());
+
+/** Get the name of an atom.
+ * \param conn The connection.
+ * \param atom The atom.
+ * \param loc Where the wait is accounted in awesome.x_stats().
+ * \return The name, which stays valid, or nothing on error.
+ */
+std::optional<std::string_view>
+atoms_name(xcb_connection_t* conn,
+           xcb_atom_t atom,
+           const std::source_location& loc = std::source_location::current());
+
+/** Get the names of several atoms, sending the requests for all unknown ones
+ * at once.
+ * \param conn The connection.
+ * \param atoms The atoms.
+ * \param names Filled with the names, nothing on error.
+ * \param loc Where the wait is accounted in awesome.x_stats().
+ */
+void atoms_names(xcb_connection_t* conn,
+                 std::span<const xcb_atom_t> atoms,
+                 std::span<std::optional<std::string_view>> names,
+                 const std::source_location& loc = std::source_location::current());
@@ -0,0 +1,89 @@
+/*
+ * bitset.h - dynamically sized bitset
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/** A set of small non-negative integers stored as a bitmap which grows on
+ * demand.
+ */
+class Bitset {
+    static constexpr size_t word_bits = 64;
+    std::vector<uint64_t> words;
+
+  public:
+    void set(size_t i) {
+        if (i / word_bits >= words.size()) {
+            words.resize(i / word_bits + 1);
+        }
+        words[i / word_bits] |= uint64_t(1) << (i % word_bits);
+    }
+
+    void reset(size_t i) {
+        if (i / word_bits < words.size()) {
+            words[i / word_bits] &= ~(uint64_t(1) << (i % word_bits));
+        }
+    }
+
+    void assign(size_t i, bool value) { value ? set(i) : reset(i); }
+
+    bool test(size_t i) const {
+        return i / word_bits < words.size() && (words[i / word_bits] >> (i % word_bits)) & 1;
+    }
+
+    /** Check if both sets have at least one element in common. */
+    bool intersects(const Bitset& other) const {
+        const size_t n = std::min(words.size(), other.words.size());
+        for (size_t i = 0; i < n; i++) {
+            if (words[i] & other.words[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** The smallest element, if any. */
+    std::optional<size_t> first() const {
+        for (size_t i = 0; i < words.size(); i++) {
+            if (words[i]) {
+                return i * word_bits + std::countr_zero(words[i]);
+            }
+        }
+        return std::nullopt;
+    }
+
+    /** The elements from 64 * i to 64 * i + 63, as a bitmap. */
+    uint64_t word(size_t i) const { return i < words.size() ? words[i] : 0; }
+
+    /** Check if any element is over 63. */
+    bool wide() const {
+        return std::any_of(words.begin() + std::min<size_t>(1, words.size()),
+                           words.end(),
+                           [](uint64_t w) { return w != 0; });
+    }
+
+    bool none() const {
+        return std::ranges::all_of(words, [](uint64_t w) { return w == 0; });
+    }
+};
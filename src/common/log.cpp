@@ -0,0 +1,313 @@
+/*
+ * common/log.cpp - Log writer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "common/log.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <time.h>
+
+namespace Log {
+
+namespace {
+
+std::atomic<bool> warnings{true};
+std::atomic<bool> json{false};
+std::atomic<bool> async{true};
+std::atomic<uint32_t> rate_limit{20};
+
+/** A bounded multi-producer multi-consumer queue of lines.
+ *
+ * Each slot has a sequence number telling whether it is free for the push at
+ * that position or holds the line for the pop at that position.
+ */
+class Ring {
+    static constexpr size_t size = 1024;
+
+    struct Slot {
+        std::atomic<size_t> seq;
+        std::string line;
+    };
+
+    Slot slots[size];
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+
+  public:
+    Ring() {
+        for (size_t i = 0; i < size; i++) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(std::string& line) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[pos % size];
+            const size_t seq = slot->seq.load(std::memory_order_acquire);
+            const auto diff = intptr_t(seq) - intptr_t(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+        slot->line.swap(line);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(std::string& line) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[pos % size];
+            const size_t seq = slot->seq.load(std::memory_order_acquire);
+            const auto diff = intptr_t(seq) - intptr_t(pos + 1);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        line.swap(slot->line);
+        slot->line.clear();
+        slot->seq.store(pos + size, std::memory_order_release);
+        return true;
+    }
+};
+
+/** The queue, never freed so that the writer can outlive static destructors */
+Ring* ring = new Ring;
+/** Bumped on every push, the writer waits on it */
+std::atomic<uint32_t> pushed{0};
+/** Lines lost because the queue was full */
+std::atomic<uint32_t> dropped{0};
+/** Held while lines are taken from the queue and written, so that lines are
+ * written in the order they were queued even when flush() drains as well */
+std::mutex drain_lock;
+std::once_flag writer_started;
+
+/** The rate of one call site. Sites are hashed into a fixed table, the rare
+ * sites that collide share their budget.
+ */
+struct Site {
+    std::atomic<int64_t> second{0};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> suppressed{0};
+};
+
+Site sites[256];
+
+int64_t now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec;
+}
+
+Site& site_for(const std::source_location& loc) {
+    const auto hash = reinterpret_cast<uintptr_t>(loc.file_name()) * 31 + loc.line();
+    return sites[(hash ^ (hash >> 8)) % std::size(sites)];
+}
+
+/** Count a message of a site.
+ * \return False if the message is suppressed, else the number of messages of
+ * the site suppressed since the last one in *suppressed*.
+ */
+bool site_admit(Site& site, uint32_t limit, uint32_t* suppressed) {
+    const int64_t now = now_seconds();
+    int64_t second = site.second.load(std::memory_order_relaxed);
+    if (second != now && site.second.compare_exchange_strong(second, now)) {
+        site.count.store(0, std::memory_order_relaxed);
+    }
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= limit) {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    *suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+void append_json_string(std::string& out, std::string_view str) {
+    out.push_back('"');
+    for (const char ch : str) {
+        switch (ch) {
+        case '"': out.append("\\\""); break;
+        case '\\': out.append("\\\\"); break;
+        case '\n': out.append("\\n"); break;
+        case '\t': out.append("\\t"); break;
+        default:
+            if (static_cast<unsigned char>(ch) < 0x20) {
+                out.append(fmt::format("\\u{:04x}", int(static_cast<unsigned char>(ch))));
+            } else {
+                out.push_back(ch);
+            }
+        }
+    }
+    out.push_back('"');
+}
+
+std::string format_line(char tag,
+                        const std::source_location& loc,
+                        std::string_view message,
+                        uint32_t suppressed) {
+    char time_str[32];
+    time_t now = time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+
+    if (!json.load(std::memory_order_relaxed)) {
+        if (!strftime(time_str, sizeof(time_str), "%Y-%m-%d %T ", &tm)) {
+            time_str[0] = '\0';
+        }
+        std::string line = fmt::format(
+          "{}{}: awesome: {}:{}: {}", tag, time_str, loc.function_name(), loc.line(), message);
+        if (suppressed) {
+            line.append(fmt::format(" ({} similar messages suppressed)", suppressed));
+        }
+        line.push_back('\n');
+        return line;
+    }
+
+    if (!strftime(time_str, sizeof(time_str), "%Y-%m-%dT%T%z", &tm)) {
+        time_str[0] = '\0';
+    }
+    std::string line = fmt::format(R"({{"time":"{}","level":"{}","function":)",
+                                   time_str,
+                                   tag == 'E' ? "error" : "warning");
+    append_json_string(line, loc.function_name());
+    line.append(fmt::format(R"(,"line":{},"message":)", loc.line()));
+    append_json_string(line, message);
+    if (suppressed) {
+        line.append(fmt::format(R"(,"suppressed":{})", suppressed));
+    }
+    line.append("}\n");
+    return line;
+}
+
+/** Write the queued lines in one go, with the drain lock held.
+ * \return Whether there were any.
+ */
+bool drain() {
+    std::string out, line;
+    while (ring->pop(line)) {
+        out.append(line);
+    }
+    if (const uint32_t n = dropped.exchange(0, std::memory_order_relaxed)) {
+        out.append(format_line(
+          'W', std::source_location::current(), fmt::format("{} messages were dropped", n), 0));
+    }
+    if (out.empty()) {
+        return false;
+    }
+    fwrite(out.data(), 1, out.size(), stdout);
+    fflush(stdout);
+    return true;
+}
+
+void writer_main() {
+    for (;;) {
+        const uint32_t seen = pushed.load(std::memory_order_acquire);
+        {
+            std::lock_guard lock(drain_lock);
+            drain();
+        }
+        pushed.wait(seen, std::memory_order_acquire);
+    }
+}
+
+void start_writer() {
+    std::thread(writer_main).detach();
+    std::atexit(flush);
+}
+
+} // namespace
+
+void write(char tag, const std::source_location& loc, std::string_view message) {
+    const bool fatal = tag == 'E';
+    uint32_t suppressed = 0;
+    if (!fatal) {
+        if (!warnings.load(std::memory_order_relaxed)) {
+            return;
+        }
+        const uint32_t limit = rate_limit.load(std::memory_order_relaxed);
+        if (limit && !site_admit(site_for(loc), limit, &suppressed)) {
+            return;
+        }
+    }
+
+    std::string line = format_line(tag, loc, message, suppressed);
+    if (fatal || !async.load(std::memory_order_relaxed)) {
+        flush();
+        fwrite(line.data(), 1, line.size(), stdout);
+        fflush(stdout);
+        return;
+    }
+
+    std::call_once(writer_started, start_writer);
+    if (!ring->push(line)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    pushed.fetch_add(1, std::memory_order_release);
+    pushed.notify_one();
+}
+
+void flush() {
+    /* Wait for the writer to finish the lines it already took, for a while:
+     * after a fork, there is no writer anymore to release the lock */
+    std::unique_lock lock(drain_lock, std::defer_lock);
+    for (int i = 0; i < 1000 && !lock.try_lock(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (lock.owns_lock()) {
+        drain();
+    }
+}
+
+void set_warnings(bool enabled) { warnings = enabled; }
+
+void set_json(bool enabled) { json = enabled; }
+
+void set_async(bool enabled) {
+    if (!enabled) {
+        flush();
+    }
+    async = enabled;
+}
+
+void set_rate_limit(uint32_t messages) { rate_limit = messages; }
+
+} // namespace Log
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
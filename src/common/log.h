@@ -0,0 +1,55 @@
+/*
+ * common/log.h - Log writer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <source_location>
+#include <string_view>
+
+/** The writer behind log_warn() and log_fatal().
+ *
+ * Warnings are put in a lock-free ring buffer, from any thread, and written
+ * by a background thread, so a slow reader of the output does not block the
+ * caller. Each call site may log a limited number of messages per second, the
+ * number of suppressed ones is added to the next message of the site. Fatal
+ * errors write everything queued and then themselves before returning.
+ */
+namespace Log {
+
+/** Write a message.
+ * \param tag 'W' for a warning, 'E' for a fatal error.
+ */
+void write(char tag, const std::source_location& loc, std::string_view message);
+
+/** Write all queued messages before returning. */
+void flush();
+
+/** Whether warnings are written, fatal errors always are. */
+void set_warnings(bool enabled);
+/** Write one JSON object per line instead of text. */
+void set_json(bool enabled);
+/** Write from the background thread or from the caller. */
+void set_async(bool enabled);
+/** Set how many messages a call site may log per second, 0 for no limit. */
+void set_rate_limit(uint32_t messages);
+
+} // namespace Log
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -24,7 +24,10 @@
 #include "common/lualib.h"
 #include "common/luaobject.h"
 #include "common/signal.h"
+#include "scratch.h"
 
+#include <algorithm>
+#include <bit>
 #include <string_view>
 
 #define CONNECTED_SUFFIX "::connected"
@@ -148,6 +151,10 @@ static int index_invalid(lua_State* L) {
 int lua_class_t::lua_gc(lua_State* L) {
     lua_object_t* item = reinterpret_cast<lua_object_t*>(lua_touserdata(L, 1));
     item->signals.clear();
+    /* The environment goes away with the object, and its refs with it */
+    Lua::getuservalue(L, 1);
+    luaA_object_drop_refs(lua_topointer(L, -1));
+    lua_pop(L, 1);
     /* Get the object class */
     lua_class_t* cls = reinterpret_cast<lua_class_t*>(luaA_class_get(L, 1));
     cls->deref();
@@ -177,6 +184,10 @@ int lua_class_t::lua_gc(lua_State* L) {
 void lua_class_t::setup(lua_State* L,
                         const struct luaL_Reg methods[],
                         const struct luaL_Reg meta[]) {
+    if (std::ranges::find(_all, this) == _all.end()) {
+        _all.push_back(this);
+    }
+
     /* Create the object metatable */
     lua_newtable(L);
     /* Register it with class pointer as key in the registry
@@ -199,13 +210,56 @@ void lua_class_t::setup(lua_State* L,
 
     lua_setfield(L, -2, "__index"); /* metatable.__index = metatable      1 */
 
-    Lua::setfuncs(L, meta);                      /* 1 */
+    /* Remember what the metatable holds for the flattened members */
+    _meta_names = {"__gc", "__index"};
+    for (auto reg = meta; reg && reg->name; reg++) {
+        _meta_names.push_back(reg->name);
+    }
+    _generation++;
+
+    Lua::setfuncs(L, meta); /* 1 */
+
+    /* Notice the fields Lua adds to the metatable, see metatable_newindex() */
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, lua_class_t::metatable_newindex);
+    lua_setfield(L, -2, "__newindex");
+    lua_setmetatable(L, -2);
+
     Lua::registerlib(L, _name.c_str(), methods); /* 2 */
     lua_pushvalue(L, -1);                        /* dup self as metatable              3 */
     lua_setmetatable(L, -2);                     /* set self as metatable              2 */
     lua_pop(L, 2);
 }
 
+/** Add a new field to the objects metatable of a class.
+ * The flattened members have to know about it, so that it shadows properties
+ * and methods of parent classes like it does in the metatable walk. Fields
+ * which exist already change in place and need nothing, their value is read
+ * from the metatable on each access. Fields added with rawset() are not seen.
+ * \param L The Lua VM state, with the metatable, the key and the value.
+ * \return The number of elements pushed on stack.
+ */
+int lua_class_t::metatable_newindex(lua_State* L) {
+    lua_pushvalue(L, 1);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    auto cls = static_cast<lua_class_t*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+
+    if (cls && lua_type(L, 2) == LUA_TSTRING && !lua_isnil(L, 3)) {
+        size_t len;
+        const char* name = lua_tolstring(L, 2, &len);
+        if (std::ranges::find(cls->_meta_names, std::string_view(name, len)) ==
+            cls->_meta_names.end()) {
+            cls->_meta_names.push_back(cls->_lua_meta_names.emplace_back(name, len));
+            _generation++;
+        }
+    }
+
+    lua_settop(L, 3);
+    lua_rawset(L, 1);
+    return 0;
+}
+
 void lua_class_t::connect_signal(lua_State* L, const std::string_view& name, lua_CFunction fn) {
     lua_pushcfunction(L, fn);
     connect_signal(L, name, -1);
@@ -217,17 +271,13 @@ void lua_class_t::connect_signal(lua_State* L, const std::string_view& name, int
     /* Duplicate the function in the stack */
     lua_pushvalue(L, ud);
 
-    std::string buf(name);
-    buf += CONNECTED_SUFFIX;
-    /* Create a new signal to notify there is a global connection. */
-
     /* Emit a signal to notify Lua of the global connection.
      *
      * This can useful during initialization where the signal needs to be
      * artificially emitted for existing objects as soon as something connects
      * to it
      */
-    emit_signal(L, buf, 1);
+    emit_signal(L, Scratch::concat(name, CONNECTED_SUFFIX), 1);
 
     /* Register the signal to the CAPI list */
     _signals.connect(name, LuaFunction{luaA_object_ref(L, ud)});
@@ -242,8 +292,12 @@ void lua_class_t::disconnect_signal(lua_State* L, const std::string_view& name,
     lua_remove(L, ud);
 }
 
-void lua_class_t::emit_signal(lua_State* L, const std::string_view& name, int nargs) {
-    signal_object_emit(L, &_signals, name, nargs);
+void lua_class_t::emit_signal(lua_State* L, SignalId id, int nargs) {
+    signal_object_emit(L, &_signals, id, nargs, _name.c_str());
+}
+
+void lua_class_t::emit_signal(lua_State* L, std::string_view name, int nargs) {
+    signal_object_emit(L, &_signals, name, nargs, _name.c_str());
 }
 
 /** Try to use the metatable of an object.
@@ -277,14 +331,127 @@ int luaA_usemetatable(lua_State* L, int idxobj, int idxfield) {
     return 0;
 }
 
-const lua_class_property_t* lua_class_t::find_property(std::string_view name) const {
-    for (auto cls = this; cls; cls = cls->parent()) {
-        auto it = cls->_properties.find(name);
-        if (it != cls->_properties.end()) {
-            return &(*it);
+void lua_class_members_t::build(const std::vector<lua_class_member_t>& members) {
+    size_t size = std::bit_ceil(std::max<size_t>(8, members.size() * 2));
+    for (uint32_t seed = 0;; seed++) {
+        /* Grow the table if no seed works for this size */
+        if (seed > 0 && seed % 64 == 0) {
+            size *= 2;
+        }
+        _slots.assign(size, {});
+        _seed = seed;
+        _mask = size - 1;
+
+        bool collision = false;
+        for (const auto& member : members) {
+            auto& slot = _slots[hash(member.name, _seed) & _mask];
+            if (slot.name.data()) {
+                collision = true;
+                break;
+            }
+            slot = member;
+        }
+        if (!collision) {
+            return;
         }
     }
-    return nullptr;
+}
+
+/** Find what a name resolves to on objects of this class.
+ * The members of the class and all its parents are flattened into a perfect
+ * hash table, rebuilt when a property or a metatable field is added to any
+ * class.
+ * \param name The name.
+ * \return The member, or NULL if the class knows nothing by that name.
+ */
+const lua_class_member_t* lua_class_t::find_member(std::string_view name) const {
+    if (_members_generation != _generation) {
+        std::vector<lua_class_member_t> members;
+        auto member = [&members](std::string_view name) -> lua_class_member_t& {
+            auto it = std::ranges::find(members, name, &lua_class_member_t::name);
+            return it != members.end() ? *it : members.emplace_back(lua_class_member_t{name});
+        };
+
+        /* Closest class first, so only fill in what is not there already */
+        for (auto cls = this; cls; cls = cls->parent()) {
+            for (auto name : cls->_meta_names) {
+                auto& m = member(name);
+                m.method_owner = m.method_owner ? m.method_owner : cls;
+            }
+            for (const auto& prop : cls->_properties) {
+                auto& m = member(prop.name);
+                m.property = m.property ? m.property : &prop;
+            }
+        }
+        member("valid").special = lua_class_member_t::special_t::valid;
+        member("_private").special = lua_class_member_t::special_t::private_data;
+        member("data").special = lua_class_member_t::special_t::data;
+
+        _members.build(members);
+        _members_generation = _generation;
+    }
+    return _members.find(name);
+}
+
+const lua_class_property_t* lua_class_t::find_property(std::string_view name) const {
+    auto member = find_member(name);
+    return member ? member->property : nullptr;
+}
+
+/** Push a method from the metatable of a class.
+ * \param L The Lua VM state.
+ * \param cls The class owning the method.
+ * \param idxfield The index of the method name.
+ * \return True if the method was pushed, false if it is gone.
+ */
+static bool luaA_class_push_method(lua_State* L, const lua_class_t* cls, int idxfield) {
+    lua_pushlightuserdata(L, const_cast<lua_class_t*>(cls));
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    lua_pushvalue(L, idxfield);
+    lua_rawget(L, -2);
+    lua_remove(L, -2);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        return false;
+    }
+    return true;
+}
+
+/** Use the metatables of an object for a key, through the flattened members.
+ * Fields set on a metatable from Lua are flattened too, and come before the
+ * properties and methods of the parents, like in the metatable walk. Only a
+ * field set to nil since the last flattening needs the walk.
+ * \param L The Lua VM state.
+ * \param member The member named by the key at index 2, or NULL.
+ * \return The number of elements pushed on stack.
+ */
+static int luaA_class_usemetatable(lua_State* L, const lua_class_member_t* member) {
+    /* Other keys than strings are not flattened */
+    if (lua_type(L, 2) != LUA_TSTRING) {
+        return luaA_usemetatable(L, 1, 2);
+    }
+    if (!member || !member->method_owner) {
+        return 0;
+    }
+    if (luaA_class_push_method(L, member->method_owner, 2)) {
+        return 1;
+    }
+    return luaA_usemetatable(L, 1, 2);
+}
+
+/** Look up a string key in the flattened members of the class of an object.
+ * \param L The Lua VM state.
+ * \param cls The class of the object at index 1.
+ * \return The member named by the key at index 2, or NULL.
+ */
+static const lua_class_member_t* luaA_class_member_get(lua_State* L, lua_class_t* cls) {
+    /* Don't let lua_tolstring() convert numbers in place */
+    if (!cls || lua_type(L, 2) != LUA_TSTRING) {
+        return nullptr;
+    }
+    size_t len;
+    const char* key = lua_tolstring(L, 2, &len);
+    return cls->find_member({key, len});
 }
 
 /** Get a property of a object.
@@ -305,18 +472,20 @@ luaA_class_property_get(lua_State* L, lua_class_t* lua_class, int fieldidx) {
  * \return The number of elements pushed on stack.
  */
 int luaA_class_index(lua_State* L) {
+    lua_class_t* cls = reinterpret_cast<lua_class_t*>(luaA_class_get(L, 1));
+    auto member = luaA_class_member_get(L, cls);
+
     /* Try to use metatable first. */
-    if (luaA_usemetatable(L, 1, 2)) {
+    if (luaA_class_usemetatable(L, member)) {
         return 1;
     }
 
-    lua_class_t* cls = reinterpret_cast<lua_class_t*>(luaA_class_get(L, 1));
+    using special = lua_class_member_t::special_t;
+    const auto which = member ? member->special : special::none;
 
     /* Is this the special 'valid' property? This is the only property
      * accessible for invalid objects and thus needs special handling. */
-    auto attr = Lua::checkstring(L, 2);
-
-    if (attr == "valid") {
+    if (which == special::valid) {
         auto p = cls->toudata<lua_object_t>(L, 1);
         lua_pushboolean(L, p && (cls->check(p)));
         return 1;
@@ -331,15 +500,15 @@ int luaA_class_index(lua_State* L) {
 
     /* This is the table storing the object private variables.
      */
-    if (attr == "_private") {
+    if (which == special::private_data) {
         return pushdata(L, cls);
-    } else if (attr == "data") {
+    } else if (which == special::data) {
         luaA_deprecate(L, "Use `._private` instead of `.data`");
         return pushdata(L, cls);
     }
 
     /* Property does exist and has an index callback */
-    if (auto prop = cls->find_property(attr.value())) {
+    if (auto prop = member ? member->property : nullptr) {
         if (prop->index) {
             return prop->index(L, cls->checkudata<lua_object_t>(L, 1));
         }
@@ -362,15 +531,16 @@ int luaA_class_index(lua_State* L) {
  * \return The number of elements pushed on stack.
  */
 int luaA_class_newindex(lua_State* L) {
+    lua_class_t* cls = reinterpret_cast<lua_class_t*>(luaA_class_get(L, 1));
+    auto member = luaA_class_member_get(L, cls);
+
     /* Try to use metatable first. */
-    if (luaA_usemetatable(L, 1, 2)) {
+    if (luaA_class_usemetatable(L, member)) {
         return 1;
     }
 
-    lua_class_t* cls = reinterpret_cast<lua_class_t*>(luaA_class_get(L, 1));
-
     /* Property does exist and has a newindex callback */
-    if (auto prop = luaA_class_property_get(L, cls, 2)) {
+    if (auto prop = member ? member->property : nullptr) {
         if (prop->newindex) {
             return prop->newindex(L, cls->checkudata<lua_object_t>(L, 1));
         }
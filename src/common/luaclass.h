@@ -29,14 +29,18 @@
 
 #include <array>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <fmt/core.h>
 #include <functional>
 #include <map>
+#include <string>
 #include <string_view>
 #include <strings.h>
 #include <type_traits>
 #include <typeinfo>
 #include <unordered_set>
+#include <vector>
 
 template <class C>
 struct TypeIdentifier {
@@ -59,64 +63,52 @@ typedef int (*lua_class_propfunc_t)(lua_State*, lua_object_t*);
 typedef bool (*lua_class_checker_t)(lua_object_t*);
 
 struct lua_class_property_t {
-    using propfcn = std::function<int(lua_State*, lua_object_t*)>;
+    /** A property callback.
+     * This is a plain function pointer taking the object as its own type, plus
+     * a trampoline that casts the object to that type.
+     */
+    class callback {
+        using erased_t = void (*)();
+        erased_t _fn = nullptr;
+        int (*_call)(erased_t, lua_State*, lua_object_t*) = nullptr;
+
+        template <typename ObjectT>
+        static int trampoline(erased_t fn, lua_State* L, lua_object_t* obj) {
+            return reinterpret_cast<int (*)(lua_State*, ObjectT*)>(fn)(L,
+                                                                        static_cast<ObjectT*>(obj));
+        }
+
+      public:
+        callback() = default;
+        callback(std::nullptr_t) {}
+        template <typename ObjectT>
+        callback(int (*fn)(lua_State*, ObjectT*))
+            : _fn(reinterpret_cast<erased_t>(fn))
+            , _call(&trampoline<ObjectT>) {}
+
+        explicit operator bool() const { return _fn; }
+        int operator()(lua_State* L, lua_object_t* obj) const { return _call(_fn, L, obj); }
+    };
+
     /** Name of the property */
     const std::string_view name;
     /** Callback function called when the property is found in object creation. */
-    propfcn newobj;
+    callback newobj;
     /** Callback function called when the property is found in object __index. */
-    propfcn index;
+    callback index;
     /** Callback function called when the property is found in object __newindex. */
-    propfcn newindex;
+    callback newindex;
 
     template <typename ObjectT>
     lua_class_property_t(std::string_view name,
                          int (*lua_class_newobj)(lua_State*, ObjectT*),
                          int (*lua_class_index)(lua_State*, ObjectT*),
                          int (*lua_class_newindex)(lua_State*, ObjectT*))
-        : name(name) {
-        if (lua_class_newobj) {
-            newobj = [lua_class_newobj](lua_State* state, lua_object_t* obj) {
-                return lua_class_newobj(state, static_cast<ObjectT*>(obj));
-            };
-        }
-        if (lua_class_index) {
-            index = [lua_class_index](lua_State* state, lua_object_t* obj) {
-                return lua_class_index(state, static_cast<ObjectT*>(obj));
-            };
-        }
-        if (lua_class_newindex) {
-            newindex = [lua_class_newindex](lua_State* state, lua_object_t* obj) {
-                return lua_class_newindex(state, static_cast<ObjectT*>(obj));
-            };
-        }
-    }
+        : name(name)
+        , newobj(lua_class_newobj)
+        , index(lua_class_index)
+        , newindex(lua_class_newindex) {}
 
-    template <typename ObjectT>
-    lua_class_property_t(std::string_view name,
-                         std::function<int(lua_State*, ObjectT*)> lua_class_newobj,
-                         std::function<int(lua_State*, ObjectT*)> lua_class_index,
-                         std::function<int(lua_State*, ObjectT*)> lua_class_newindex)
-        : name(name) {
-        if (lua_class_newobj) {
-            newobj = [lua_class_newobj = std::move(lua_class_newobj)](lua_State* state,
-                                                                      lua_object_t* obj) {
-                return lua_class_newobj(state, static_cast<ObjectT*>(obj));
-            };
-        }
-        if (lua_class_index) {
-            index = [lua_class_index = std::move(lua_class_index)](lua_State* state,
-                                                                   lua_object_t* obj) {
-                return lua_class_index(state, static_cast<ObjectT*>(obj));
-            };
-        }
-        if (lua_class_newindex) {
-            newindex = [lua_class_newindex = std::move(lua_class_newindex)](lua_State* state,
-                                                                            lua_object_t* obj) {
-                return lua_class_newindex(state, static_cast<ObjectT*>(obj));
-            };
-        }
-    }
     template <typename ObjectT>
     static lua_class_property_t make(std::string_view name,
                                      int (*lua_class_newobj)(lua_State*, ObjectT*),
@@ -124,11 +116,50 @@ struct lua_class_property_t {
                                      int (*lua_class_newindex)(lua_State*, ObjectT*)) {
         return lua_class_property_t{name, lua_class_newobj, lua_class_index, lua_class_newindex};
     }
-    lua_class_property_t(std::string_view name,
-                         lua_class_propfunc_t newobj,
-                         lua_class_propfunc_t index,
-                         lua_class_propfunc_t newindex)
-        : name(name), newobj(newobj), index(index), newindex(newindex) {}
+};
+
+class lua_class_t;
+
+/** What a name accessed on an object resolves to, with inheritance applied. */
+struct lua_class_member_t {
+    /** Names handled by luaA_class_index() itself */
+    enum class special_t : uint8_t { none, valid, private_data, data };
+
+    std::string_view name;
+    /** The closest class whose metatable has a method by that name */
+    const lua_class_t* method_owner = nullptr;
+    special_t special = special_t::none;
+    /** The closest property by that name */
+    const lua_class_property_t* property = nullptr;
+};
+
+/** A perfect hash table of the members of a class.
+ * It is built once for a fixed set of names, picking a seed for which no two
+ * names share a slot, so a lookup costs one hash and one string compare.
+ */
+class lua_class_members_t {
+    std::vector<lua_class_member_t> _slots;
+    uint32_t _seed = 0;
+    uint32_t _mask = 0;
+
+    static uint32_t hash(std::string_view name, uint32_t seed) {
+        uint32_t h = 2166136261u ^ seed;
+        for (unsigned char c : name) {
+            h = (h ^ c) * 16777619u;
+        }
+        return h;
+    }
+
+  public:
+    void build(const std::vector<lua_class_member_t>& members);
+
+    const lua_class_member_t* find(std::string_view name) const {
+        if (_slots.empty()) {
+            return nullptr;
+        }
+        const auto& slot = _slots[hash(name, _seed) & _mask];
+        return slot.name.data() && slot.name == name ? &slot : nullptr;
+    }
 };
 
 namespace Detail {
@@ -198,16 +229,32 @@ class lua_class_t {
     lua_class_propfunc_t _index_miss_property = nullptr;
     /** Function to call when a indexing an unknown property */
     lua_class_propfunc_t _newindex_miss_property = nullptr;
+    /** Deliver property signals once per refresh instead of immediately */
+    bool _defer_property_signals = false;
     /** Function to call to check if an object is valid */
     lua_class_checker_t _checker = nullptr;
     /** Number of instances of this class in lua */
     unsigned int _instances = 0;
+    /** Size of the userdata of one instance */
+    size_t _instance_size = 0;
     /** Class tostring method */
     lua_class_propfunc_t _tostring = nullptr;
     /** Function to call on index misses */
     Lua::FunctionRegistryIdx _index_miss_handler;
     /** Function to call on newindex misses */
     Lua::FunctionRegistryIdx _newindex_miss_handler;
+    /** Names of the fields of the objects metatable */
+    std::vector<std::string_view> _meta_names;
+    /** The names of the fields added to the objects metatable from Lua */
+    std::deque<std::string> _lua_meta_names;
+    /** Flattened members of the class and its parents */
+    mutable lua_class_members_t _members;
+    /** Value of _generation when _members was built */
+    mutable unsigned _members_generation = 0;
+    /** Bumped whenever a class changes, invalidating all flattened members */
+    static inline unsigned _generation = 1;
+    /** Every class that was set up, in setup order */
+    static inline std::vector<lua_class_t*> _all;
 
   public:
     lua_class_t(std::string name, lua_class_t* parent, ClassInterface iface)
@@ -225,18 +272,33 @@ class lua_class_t {
                       lua_class_propfunc_t cb_new,
                       lua_class_propfunc_t cb_index,
                       lua_class_propfunc_t cb_newindex) {
-        _properties.insert({name, cb_new, cb_index, cb_newindex});
+        add_property({name, cb_new, cb_index, cb_newindex});
+    }
+    void add_property(lua_class_property_t prop) {
+        _properties.insert(prop);
+        _generation++;
     }
-    void add_property(lua_class_property_t prop) { _properties.insert(prop); }
     static lua_class_t* get(lua_State* state, int idx);
     void connect_signal(lua_State* state, const std::string_view& name, lua_CFunction sigfun);
     void connect_signal(lua_State* state, const std::string_view& name, int stackIdx);
     void disconnect_signal(lua_State* state, const std::string_view& name, int stackIdx);
-    void emit_signal(lua_State*, const std::string_view& name, int nargs);
+    void emit_signal(lua_State*, SignalId id, int nargs);
+    void emit_signal(lua_State*, std::string_view name, int nargs);
+    bool has_signal(SignalId id) const { return _signals.contains(id); }
+    bool defer_property_signals() const { return _defer_property_signals; }
+    void set_defer_property_signals(bool enable) { _defer_property_signals = enable; }
 
     int numRefs() const { return _instances; }
-    void ref() { ++_instances; }
+    void ref(size_t size) {
+        ++_instances;
+        _instance_size = size;
+    }
     void deref() { --_instances; }
+    /** The memory used by the userdata of all instances */
+    size_t instance_bytes() const { return _instances * _instance_size; }
+    const Signals& signals() const { return _signals; }
+    Signals& signals() { return _signals; }
+    static const std::vector<lua_class_t*>& all() { return _all; }
 
     auto& index_miss_handler() { return _index_miss_handler; }
     auto& newindex_miss_handler() { return _newindex_miss_handler; }
@@ -258,6 +320,7 @@ class lua_class_t {
     const std::string& name() const { return _name; }
 
     const lua_class_property_t* find_property(std::string_view name) const;
+    const lua_class_member_t* find_member(std::string_view name) const;
 
     auto index_miss_property() const { return _index_miss_property; }
     auto newindex_miss_property() const { return _newindex_miss_property; }
@@ -280,6 +343,7 @@ class lua_class_t {
 
   private:
     static int lua_gc(lua_State* L);
+    static int metatable_newindex(lua_State* L);
 };
 
 const char* luaA_typename(lua_State*, int);
@@ -299,7 +363,7 @@ int luaA_class_newindex(lua_State*);
 namespace internal {
 // clang-format off
 template <lua_class_t* cls>
-inline constexpr auto LuaClassMethods = std::array<luaL_Reg, 6>
+inline constexpr auto LuaClassMethods = std::array<luaL_Reg, 7>
 {{
 {
     "connect_signal",
@@ -336,6 +400,13 @@ inline constexpr auto LuaClassMethods = std::array<luaL_Reg, 6>
 {
     "set_newindex_miss_handler",
    [](lua_State* L) { return Lua::registerfct(L, 1, &cls->newindex_miss_handler()); }
+},
+{
+    "set_defer_property_signals",
+    [](lua_State* L) {
+        cls->set_defer_property_signals(Lua::checkboolean(L, 1));
+        return 0;
+    }
 }
 }};
 // clang-format on
@@ -34,8 +34,21 @@
 #include "common/lualib.h"
 #include "common/signal.h"
 #include "lua.h"
+#include "signalprofile.h"
+#include "trace.h"
 
+#include <algorithm>
 #include <format>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** Reference counts of the items anchored in each store table.
+ * The store tables (the object registry and the environment of every object)
+ * only keep the items alive, the counts live here, keyed by table then item.
+ */
+static std::unordered_map<const void*, std::unordered_map<const void*, int>> refcounts;
 
 /** Setup the object system at startup.
  * \param L The Lua VM state.
@@ -45,11 +58,6 @@ void luaA_object_setup(lua_State* L) {
     lua_pushliteral(L, LUAA_OBJECT_REGISTRY_KEY);
     /* Create an empty table */
     lua_newtable(L);
-    /* Create an empty metatable */
-    lua_newtable(L);
-    /* Set this empty table as the registry metatable.
-     * It's used to store the number of reference on stored objects. */
-    lua_setmetatable(L, -2);
     /* Register table inside registry */
     lua_rawset(L, LUA_REGISTRYINDEX);
 }
@@ -70,32 +78,15 @@ void* luaA_object_incref(lua_State* L, int tud, int oud) {
         return NULL;
     }
 
-    /* Push the pointer (key) */
-    lua_pushlightuserdata(L, pointer);
-    /* Push the data (value) */
-    lua_pushvalue(L, oud < 0 ? oud - 1 : oud);
-    /* table.lightudata = data */
-    lua_rawset(L, tud < 0 ? tud - 2 : tud);
-
-    /* refcount++ */
-
-    /* Get the metatable */
-    lua_getmetatable(L, tud);
-    /* Push the pointer (key) */
-    lua_pushlightuserdata(L, pointer);
-    /* Get the number of references */
-    lua_rawget(L, -2);
-    /* Get the number of references and increment it */
-    int count = lua_tointeger(L, -1) + 1;
-    lua_pop(L, 1);
-    /* Push the pointer (key) */
-    lua_pushlightuserdata(L, pointer);
-    /* Push count (value) */
-    lua_pushinteger(L, count);
-    /* Set metatable[pointer] = count */
-    lua_rawset(L, -3);
-    /* Pop metatable */
-    lua_pop(L, 1);
+    /* refcount++, the first reference anchors the item in the table */
+    if (++refcounts[lua_topointer(L, tud)][pointer] == 1) {
+        /* Push the pointer (key) */
+        lua_pushlightuserdata(L, pointer);
+        /* Push the data (value) */
+        lua_pushvalue(L, oud < 0 ? oud - 1 : oud);
+        /* table.lightudata = data */
+        lua_rawset(L, tud < 0 ? tud - 2 : tud);
+    }
 
     /* Remove referenced item */
     lua_remove(L, oud);
@@ -106,8 +97,7 @@ void* luaA_object_incref(lua_State* L, int tud, int oud) {
 /** Decrement a object reference in its store table.
  * \param L The Lua VM state.
  * \param tud The table index on the stack.
- * \param oud The object index on the stack.
- * \return A pointer to the object.
+ * \param pointer The object to unref.
  */
 void luaA_object_decref(lua_State* L, int tud, const void* pointer) {
     if (!pointer) {
@@ -115,40 +105,21 @@ void luaA_object_decref(lua_State* L, int tud, const void* pointer) {
     }
 
     /* First, refcount-- */
-    /* Get the metatable */
-    lua_getmetatable(L, tud);
-    /* Push the pointer (key) */
-    lua_pushlightuserdata(L, (void*)pointer);
-    /* Get the number of references */
-    lua_rawget(L, -2);
-    /* Get the number of references and decrement it */
-    int count = lua_tointeger(L, -1) - 1;
-    /* Did we find the item in our table? (tointeger(nil)-1) is -1 */
-    if (count < 0) {
+    auto table = refcounts.find(lua_topointer(L, tud));
+    std::unordered_map<const void*, int>::iterator count;
+    if (table == refcounts.end() || (count = table->second.find(pointer)) == table->second.end()) {
         auto bt = backtrace_get();
         log_warn("BUG: Reference not found: {} {}\n{}", tud, pointer, bt);
-
-        /* Pop reference count and metatable */
-        lua_pop(L, 2);
         return;
     }
-    lua_pop(L, 1);
-    /* Push the pointer (key) */
-    lua_pushlightuserdata(L, (void*)pointer);
-    /* Hasn't the ref reached 0? */
-    if (count) {
-        lua_pushinteger(L, count);
-    } else {
-        /* Yup, delete it, set nil as value */
-        lua_pushnil(L);
-    }
-    /* Set meta[pointer] = count/nil */
-    lua_rawset(L, -3);
-    /* Pop metatable */
-    lua_pop(L, 1);
 
     /* Wait, no more ref? */
-    if (!count) {
+    if (--count->second == 0) {
+        table->second.erase(count);
+        if (table->second.empty()) {
+            refcounts.erase(table);
+        }
+
         /* Yes? So remove it from table */
         lua_pushlightuserdata(L, (void*)pointer);
         /* Push nil as value */
@@ -158,6 +129,11 @@ void luaA_object_decref(lua_State* L, int tud, const void* pointer) {
     }
 }
 
+/** Forget the reference counts of a store table that is going away.
+ * \param table The store table, as returned by lua_topointer().
+ */
+void luaA_object_drop_refs(const void* table) { refcounts.erase(table); }
+
 int luaA_settype(lua_State* L, lua_class_t* lua_class) {
     lua_pushlightuserdata(L, lua_class);
     lua_rawget(L, LUA_REGISTRYINDEX);
@@ -213,58 +189,227 @@ void luaA_object_disconnect_signal_from_stack(lua_State* L, int oud, const char*
     lua_remove(L, ud);
 }
 
-void signal_object_emit(lua_State* L, Signals* arr, const std::string_view& name, int nargs) {
-    auto signalIt = arr->find(name);
-    if (signalIt != arr->end()) {
-        int nbfunc = signalIt->second.functions.size();
-        luaL_checkstack(
-          L,
-          nbfunc + nargs + 1,
-          fmt::format("Not enough stack space to call signal '{}' (trying to push {} entries)",
-                      name,
-                      nbfunc + nargs + 1)
-            .c_str());
-        /* Push all functions and then execute, because this list can change
-         * while executing funcs. */
-        for (auto func : signalIt->second.functions) {
-            luaA_object_push(L, func);
+/** Remove all the signal handlers of an object.
+ * \param L The Lua VM state.
+ * \param oud The object index on the stack.
+ */
+void luaA_object_disconnect_all_signals(lua_State* L, int oud) {
+    lua_object_t* obj = reinterpret_cast<lua_object_t*>(lua_touserdata(L, oud));
+    for (const auto& [id, signal] : obj->signals) {
+        for (const auto& function : signal.functions) {
+            luaA_object_unref_item(L, oud, (void*)function.fcn);
         }
+    }
+    obj->signals.clear();
+}
 
-        for (int i = 0; i < nbfunc; i++) {
-            /* push all args */
-            for (int j = 0; j < nargs; j++) {
-                lua_pushvalue(L, -nargs - nbfunc + i);
+/** Remove the handlers of a signal array which are referenced in the
+ * registry, like the class and global ones.
+ * \param L The Lua VM state.
+ * \param signals The signal array.
+ * \param keep Handlers to leave connected.
+ */
+void signal_object_disconnect_all(lua_State* L, Signals* signals, const Signals& keep) {
+    for (auto it = signals->begin(); it != signals->end();) {
+        const auto kept = keep.find(it->first);
+        const auto is_kept = [&](const LuaFunction& function) {
+            return kept != keep.end() &&
+                   std::ranges::find(kept->second.functions, function) != kept->second.functions.end();
+        };
+        std::erase_if(it->second.functions, [&](const LuaFunction& function) {
+            if (is_kept(function)) {
+                return false;
             }
-            /* push first function */
+            luaA_object_unref(L, function.fcn);
+            return true;
+        });
+        it = it->second.functions.empty() ? signals->erase(it) : std::next(it);
+    }
+}
+
+/** Make sure there is enough stack space to call the handlers of a signal.
+ * The error message is only built when the check fails.
+ * \param L The Lua VM state.
+ * \param id The signal.
+ * \param n The number of entries that will be pushed.
+ */
+static void signal_checkstack(lua_State* L, SignalId id, int n) {
+    if (!lua_checkstack(L, n)) {
+        luaL_error(L,
+                   "Not enough stack space to call signal '%s' (trying to push %d entries)",
+                   signal_name(id).c_str(),
+                   n);
+    }
+}
+
+void signal_object_emit(lua_State* L, Signals* arr, SignalId id, int nargs, const char* owner) {
+    Trace::Scope span(Trace::Category::Signal, nullptr, uint32_t(id));
+    auto signalIt = arr->find(id);
+    if (signalIt == arr->end()) {
+        lua_pop(L, nargs);
+        return;
+    }
+
+    int nbfunc = signalIt->second.functions.size();
+    if (nbfunc == 1) {
+        /* The arguments are not needed afterwards, hand them over as they are.
+         * + 2 for the function and the error handler */
+        signal_checkstack(L, id, 2);
+        luaA_object_push(L, signalIt->second.functions.front());
+        SignalProfile::dofunction(L, nargs, owner, id);
+        return;
+    }
+
+    signal_checkstack(L, id, nbfunc + nargs + 1);
+    /* Push all functions and then execute, because this list can change
+     * while executing funcs. */
+    for (auto func : signalIt->second.functions) {
+        luaA_object_push(L, func);
+    }
+
+    for (int i = 0; i < nbfunc; i++) {
+        /* push all args */
+        for (int j = 0; j < nargs; j++) {
             lua_pushvalue(L, -nargs - nbfunc + i);
-            /* remove this first function */
-            lua_remove(L, -nargs - nbfunc - 1 + i);
-            Lua::dofunction(L, nargs, 0);
         }
+        /* push first function */
+        lua_pushvalue(L, -nargs - nbfunc + i);
+        /* remove this first function */
+        lua_remove(L, -nargs - nbfunc - 1 + i);
+        SignalProfile::dofunction(L, nargs, owner, id);
     }
 
     /* remove args */
     lua_pop(L, nargs);
 }
 
+void signal_object_emit(
+  lua_State* L, Signals* arr, std::string_view name, int nargs, const char* owner) {
+    if (auto id = signal_find(name)) {
+        signal_object_emit(L, arr, *id, nargs, owner);
+    } else {
+        /* Never interned, so nothing is connected to it */
+        lua_pop(L, nargs);
+    }
+}
+
+/** Whether property signals of all classes are deferred. */
+static bool defer_property_signals = false;
+
+/** A property signal waiting to be delivered. */
+struct deferred_signal {
+    /** The object, referenced until delivery */
+    lua_object_t* object;
+    SignalId id;
+};
+
+/** Deferred signals in emission order, and the set used to deduplicate them. */
+static std::vector<deferred_signal> deferred_signals;
+static std::set<std::pair<const lua_object_t*, SignalId>> deferred_signals_pending;
+
+/** Enable or disable the deferral of property signals for every class.
+ * \param enable True to defer property signals.
+ */
+void luaA_object_set_defer_property_signals(bool enable) { defer_property_signals = enable; }
+
+static bool signal_is_deferred(lua_class_t* lua_class, SignalId id) {
+    bool deferred = defer_property_signals;
+    for (auto cls = lua_class; !deferred && cls; cls = cls->parent()) {
+        deferred = cls->defer_property_signals();
+    }
+    return deferred && signal_name(id).starts_with("property::");
+}
+
+/** Queue a property signal for delivery in the next refresh, unless it is
+ * already queued for that object.
+ * \param L The Lua VM state.
+ * \param oud The object index on the stack.
+ * \param obj The object.
+ * \param id The signal.
+ */
+static void signal_defer(lua_State* L, int oud, lua_object_t* obj, SignalId id) {
+    if (deferred_signals_pending.emplace(obj, id).second) {
+        luaA_object_ref(L, oud);
+        deferred_signals.push_back({obj, id});
+    }
+}
+
+static void object_emit_signal(lua_State* L, int oud, lua_object_t* obj, SignalId id, int nargs);
+
+/** Deliver the property signals that were deferred.
+ * Handlers may cause more property signals, which are delivered as well, up to
+ * a few rounds. Whatever remains then is left for the next refresh.
+ * \param L The Lua VM state.
+ */
+void luaA_object_emit_deferred_signals(lua_State* L) {
+    for (int round = 0; round < 8 && !deferred_signals.empty(); round++) {
+        auto signals = std::move(deferred_signals);
+        deferred_signals.clear();
+        deferred_signals_pending.clear();
+
+        for (const auto& deferred : signals) {
+            luaA_object_push(L, deferred.object);
+            lua_class_t* lua_class = luaA_class_get(L, -1);
+            auto obj = lua_class ? lua_class->toudata<lua_object_t>(L, -1) : nullptr;
+            /* The object may have become invalid meanwhile */
+            if (obj && lua_class->check(obj)) {
+                object_emit_signal(L, -1, obj, deferred.id, 0);
+            }
+            lua_pop(L, 1);
+            luaA_object_unref(L, deferred.object);
+        }
+    }
+}
+
 /** Emit a signal.
  * @tparam string name A signal name.
  * @param[opt] ... Various arguments.
  * @function emit_signal
  */
-void luaA_object_emit_signal(lua_State* L, int oud, const char* name, int nargs) {
+void luaA_object_emit_signal(lua_State* L, int oud, SignalId id, int nargs) {
     int oud_abs = Lua::absindex(L, oud);
     lua_class_t* lua_class = luaA_class_get(L, oud);
     auto obj = lua_class->toudata<lua_object_t>(L, oud);
     if (!obj) {
-        Lua::warn(L, "Trying to emit signal '%s' on non-object", name);
+        Lua::warn(L, "Trying to emit signal '%s' on non-object", signal_name(id).c_str());
         return;
     } else if (!lua_class->check(obj)) {
-        Lua::warn(L, "Trying to emit signal '%s' on invalid object", name);
+        Lua::warn(L, "Trying to emit signal '%s' on invalid object", signal_name(id).c_str());
+        return;
+    }
+
+    /* Only argument-less signals can be merged */
+    if (nargs == 0 && signal_is_deferred(lua_class, id)) {
+        signal_defer(L, oud_abs, obj, id);
         return;
     }
-    auto signalIt = obj->signals.find(name);
-    if (signalIt != obj->signals.end()) {
+
+    object_emit_signal(L, oud_abs, obj, id, nargs);
+}
+
+/** Call the functions connected to a signal of an object, then of its class.
+ * \param L The Lua VM state.
+ * \param oud The object index on the stack.
+ * \param obj The object.
+ * \param id The signal.
+ * \param nargs The number of arguments on top of the stack, popped.
+ */
+static void object_emit_signal(lua_State* L, int oud, lua_object_t* obj, SignalId id, int nargs) {
+    const int oud_abs = Lua::absindex(L, oud);
+    /* Not only when profiling: a handler may enable it during the emission */
+    lua_class_t* lua_class = luaA_class_get(L, oud_abs);
+    const char* owner = lua_class->name().c_str();
+    auto signalIt = obj->signals.find(id);
+    if (signalIt != obj->signals.end() && signalIt->second.functions.size() == 1) {
+        /* The arguments are still needed for the class signal, copy them */
+        luaL_checkstack(L, nargs + 3, "too much signal");
+        lua_pushvalue(L, oud_abs);
+        for (int j = 0; j < nargs; j++) {
+            lua_pushvalue(L, -nargs - 1);
+        }
+        luaA_object_push_item(L, oud_abs, signalIt->second.functions.front());
+        SignalProfile::dofunction(L, nargs + 1, owner, id);
+    } else if (signalIt != obj->signals.end()) {
         int nbfunc = signalIt->second.functions.size();
         luaL_checkstack(L, nbfunc + nargs + 2, "too much signal");
         /* Push all functions and then execute, because this list can change
@@ -284,14 +429,40 @@ void luaA_object_emit_signal(lua_State* L, int oud, const char* name, int nargs)
             lua_pushvalue(L, -nargs - nbfunc - 1 + i);
             /* remove this first function */
             lua_remove(L, -nargs - nbfunc - 2 + i);
-            Lua::dofunction(L, nargs + 1, 0);
+            SignalProfile::dofunction(L, nargs + 1, owner, id);
         }
     }
 
     /* Then emit signal on the class */
-    lua_pushvalue(L, oud);
+    lua_pushvalue(L, oud_abs);
     lua_insert(L, -nargs - 1);
-    luaA_class_get(L, -nargs - 1)->emit_signal(L, name, nargs + 1);
+    lua_class->emit_signal(L, id, nargs + 1);
+}
+
+/** Check if anything is connected to a signal of an object or of its class.
+ * This allows callers to skip building the arguments of a signal nobody
+ * listens to.
+ * \param L The Lua VM state.
+ * \param oud The object index on the stack.
+ * \param id The signal.
+ * \return True if emitting the signal on the object would call a function.
+ */
+bool luaA_object_has_listeners(lua_State* L, int oud, SignalId id) {
+    lua_class_t* lua_class = luaA_class_get(L, oud);
+    if (!lua_class) {
+        return false;
+    }
+    auto obj = lua_class->toudata<lua_object_t>(L, oud);
+    return obj && (obj->signals.contains(id) || lua_class->has_signal(id));
+}
+
+void luaA_object_emit_signal(lua_State* L, int oud, const char* name, int nargs) {
+    if (auto id = signal_find(name)) {
+        luaA_object_emit_signal(L, oud, *id, nargs);
+    } else {
+        /* Never interned, so nothing is connected to it */
+        lua_pop(L, nargs);
+    }
 }
 
 int luaA_object_tostring(lua_State* state) {
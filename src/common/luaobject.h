@@ -45,6 +45,7 @@ int luaA_settype(lua_State*, lua_class_t*);
 void luaA_object_setup(lua_State*);
 void* luaA_object_incref(lua_State*, int, int);
 void luaA_object_decref(lua_State*, int, const void*);
+void luaA_object_drop_refs(const void*);
 
 /** Store an item in the environment table of an object.
  * \param L The Lua VM state.
@@ -147,12 +148,19 @@ static inline int luaA_object_push(lua_State* L, PushableObject auto pointer) {
     return 1;
 }
 
-void signal_object_emit(lua_State*, Signals*, const std::string_view&, int);
+void signal_object_emit(lua_State*, Signals*, SignalId, int, const char* owner = "awesome");
+void signal_object_emit(lua_State*, Signals*, std::string_view, int, const char* owner = "awesome");
 
 void luaA_object_connect_signal(lua_State*, int, const char*, lua_CFunction);
 void luaA_object_disconnect_signal(lua_State*, int, const char*, lua_CFunction);
 void luaA_object_connect_signal_from_stack(lua_State*, int, const char*, int);
 void luaA_object_disconnect_signal_from_stack(lua_State*, int, const char*, int);
+void luaA_object_disconnect_all_signals(lua_State*, int);
+void signal_object_disconnect_all(lua_State*, Signals*, const Signals& keep = {});
+void luaA_object_emit_signal(lua_State*, int, SignalId, int);
+bool luaA_object_has_listeners(lua_State*, int, SignalId);
+void luaA_object_set_defer_property_signals(bool);
+void luaA_object_emit_deferred_signals(lua_State*);
 void luaA_object_emit_signal(lua_State*, int, const char*, int);
 
 template <typename T>
@@ -164,16 +172,14 @@ template <typename T, auto& lua_class>
 static inline T* newobj(lua_State* L) {
     void* mem = lua_newuserdata(L, sizeof(T));
     auto p = new (mem) T{};
-    (lua_class).ref();
+    (lua_class).ref(sizeof(T));
     luaA_settype(L, &(lua_class));
     lua_newtable(L);
     lua_newtable(L);
-    lua_setmetatable(L, -2);
-    lua_newtable(L);
     lua_setfield(L, -2, "data");
     Lua::setuservalue(L, -2);
     lua_pushvalue(L, -1);
-    lua_class.emit_signal(L, "new", 1);
+    lua_class.emit_signal(L, "new"_sig, 1);
     return p;
 }
 
@@ -0,0 +1,75 @@
+/*
+ * common/signal.cpp - Signal name interning
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "common/signal.h"
+
+#include <deque>
+
+namespace {
+
+struct SignalHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+};
+
+/** The interned names. A deque keeps the strings in place when it grows, so
+ * the index below can refer to them. */
+struct SignalTable {
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, SignalId, SignalHash, std::equal_to<>> ids;
+
+    SignalTable() {
+        for (auto name : builtin_signal_names) {
+            add(name);
+        }
+    }
+
+    SignalId add(std::string_view name) {
+        const auto id = SignalId(names.size());
+        const auto& stored = names.emplace_back(name);
+        ids.emplace(stored, id);
+        return id;
+    }
+};
+
+SignalTable& signal_table() {
+    static SignalTable table;
+    return table;
+}
+
+} // namespace
+
+SignalId signal_intern(std::string_view name) {
+    auto& table = signal_table();
+    auto it = table.ids.find(name);
+    return it != table.ids.end() ? it->second : table.add(name);
+}
+
+std::optional<SignalId> signal_find(std::string_view name) {
+    auto& table = signal_table();
+    auto it = table.ids.find(name);
+    if (it == table.ids.end()) {
+        return {};
+    }
+    return it->second;
+}
+
+const std::string& signal_name(SignalId id) { return signal_table().names[size_t(id)]; }
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -21,6 +21,9 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -33,48 +36,177 @@ struct LuaFunction {
 struct signal_t {
     std::vector<LuaFunction> functions;
 };
-struct SignalHash {
-    using is_transparent = void;
-    size_t operator()(const std::string& s) const { return std::hash<std::string_view>{}(s); }
-    size_t operator()(const std::string_view& s) const { return std::hash<std::string_view>{}(s); }
-    size_t operator()(const char* s) const { return std::hash<std::string_view>{}(s); }
-};
+/** An interned signal name. */
+enum class SignalId : uint32_t {};
 
-struct SignalEq {
-    using is_transparent = void;
-    size_t operator()(const std::string& s, const std::string& r) const { return s == r; }
-    size_t operator()(const std::string_view& s, const std::string& r) const { return s == r; }
-    size_t operator()(const char* s, const std::string& r) const { return r == (s ? s : ""); }
-};
+/** Signal names emitted from C++.
+ * They are interned first, in this order, so that their ids are known at
+ * compile time through the `_sig` literal.
+ */
+inline constexpr auto builtin_signal_names = std::to_array<std::string_view>({
+  "_added",
+  "button::press",
+  "button::release",
+  "continue",
+  "data",
+  "data_end",
+  "debug::deprecation",
+  "debug::error",
+  "debug::index::miss",
+  "debug::newindex::miss",
+  "exit",
+  "focus",
+  "list",
+  "lowered",
+  "manage",
+  "mouse::enter",
+  "mouse::leave",
+  "mouse::move",
+  "new",
+  "press",
+  "primary_changed",
+  "property::_outputs",
+  "property::_viewports",
+  "property::above",
+  "property::activated",
+  "property::active",
+  "property::below",
+  "property::border_color",
+  "property::border_width",
+  "property::button",
+  "property::buttons",
+  "property::class",
+  "property::cursor",
+  "property::focusable",
+  "property::fullscreen",
+  "property::geometry",
+  "property::group_window",
+  "property::height",
+  "property::hidden",
+  "property::icon",
+  "property::icon_name",
+  "property::icon_sizes",
+  "property::instance",
+  "property::key",
+  "property::keys",
+  "property::machine",
+  "property::maximized",
+  "property::maximized_horizontal",
+  "property::maximized_vertical",
+  "property::minimized",
+  "property::modal",
+  "property::modifiers",
+  "property::motif_wm_hints",
+  "property::name",
+  "property::ontop",
+  "property::opacity",
+  "property::pid",
+  "property::position",
+  "property::role",
+  "property::screen",
+  "property::selected",
+  "property::shape_bounding",
+  "property::shape_client_bounding",
+  "property::shape_client_clip",
+  "property::shape_clip",
+  "property::shape_input",
+  "property::size",
+  "property::size_hints",
+  "property::size_hints_honor",
+  "property::skip_taskbar",
+  "property::startup_id",
+  "property::sticky",
+  "property::struts",
+  "property::surface",
+  "property::tags",
+  "property::titlebar_bottom",
+  "property::titlebar_left",
+  "property::titlebar_right",
+  "property::titlebar_top",
+  "property::transient_for",
+  "property::type",
+  "property::urgent",
+  "property::visible",
+  "property::width",
+  "property::window",
+  "property::workarea",
+  "property::x",
+  "property::y",
+  "raised",
+  "refresh",
+  "release",
+  "reload",
+  "removed",
+  "request",
+  "request::activate",
+  "request::geometry",
+  "request::manage",
+  "request::select",
+  "request::tag",
+  "request::unmanage",
+  "request::urgent",
+  "scanned",
+  "scanning",
+  "screen::change",
+  "selection_changed",
+  "spawn::timeout",
+  "startup",
+  "swapped",
+  "systray::update",
+  "tagged",
+  "unfocus",
+  "unmanage",
+  "untagged",
+  "wallpaper_changed",
+  "xkb::group_changed",
+  "xkb::map_changed",
+  "xrdb_changed",
+});
+
+/** Get the id of a builtin signal name at compile time.
+ * Using a name which is not in builtin_signal_names does not compile.
+ */
+consteval SignalId operator""_sig(const char* name, size_t len) {
+    const std::string_view sv{name, len};
+    for (size_t i = 0; i < builtin_signal_names.size(); i++) {
+        if (builtin_signal_names[i] == sv) {
+            return SignalId(i);
+        }
+    }
+    throw "signal name missing from builtin_signal_names";
+}
+
+/** Get the id of a signal name, interning it if needed. */
+SignalId signal_intern(std::string_view name);
+/** Get the id of a signal name if it was ever interned.
+ * Nothing can be connected to a name that was never interned.
+ */
+std::optional<SignalId> signal_find(std::string_view name);
+/** Get the name of an interned signal. The result is NUL terminated. */
+const std::string& signal_name(SignalId id);
+
+struct Signals: public std::unordered_map<SignalId, signal_t> {
+    using std::unordered_map<SignalId, signal_t>::find;
+
+    std::unordered_map<SignalId, signal_t>::iterator find(std::string_view name) {
+        auto id = signal_find(name);
+        return id ? find(*id) : end();
+    }
 
-struct Signals: public std::unordered_map<std::string, signal_t, SignalHash, SignalEq> {
     /** Connect a signal inside a signal array.
      * You are in charge of reference counting.
-     * \param arr The signal array.
-     * \param name The signal name.
+     * \param id The signal id.
      * \param ref The reference to add.
      */
-    void connect(const std::string_view& name, LuaFunction ref) {
-        auto it = this->find(name);
-        if (it == this->end()) {
-            std::string nm(name.begin(), name.end());
-            auto [it, done] = this->try_emplace(nm, signal_t{});
-            it->second.functions.push_back({ref});
-            return;
-        }
-        if (it->second.functions.capacity() < it->second.functions.size() + 1) {
-            it->second.functions.reserve(it->second.functions.size() + 1);
-        }
-        it->second.functions.push_back({ref});
-    }
+    void connect(SignalId id, LuaFunction ref) { (*this)[id].functions.push_back({ref}); }
+    void connect(std::string_view name, LuaFunction ref) { connect(signal_intern(name), ref); }
     /** Disconnect a signal inside a signal array.
      * You are in charge of reference counting.
-     * \param arr The signal array.
-     * \param name The signal name.
+     * \param id The signal id.
      * \param ref The reference to remove.
      */
-    bool disconnect(const std::string_view& name, LuaFunction ref) {
-        auto it = this->find(name);
+    bool disconnect(SignalId id, LuaFunction ref) {
+        auto it = this->find(id);
         if (it == this->end()) {
             return false;
         }
@@ -88,4 +220,8 @@ struct Signals: public std::unordered_map<std::string, signal_t, SignalHash, Sig
         }
         return true;
     }
+    bool disconnect(std::string_view name, LuaFunction ref) {
+        auto id = signal_find(name);
+        return id && disconnect(*id, ref);
+    }
 };
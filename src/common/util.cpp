@@ -22,6 +22,7 @@
 
 #include "common/util.h"
 
+#include "common/log.h"
 #include "common/luahdr.h"
 #include "lua.h"
 
@@ -56,12 +57,7 @@ void log_messagev(char tag,
                   const std::source_location loc,
                   std::string_view format,
                   fmt::format_args args) {
-    fmt::print("{}{}: awesome: {}:{}: {}\n",
-               tag,
-               a_current_time_str(),
-               loc.function_name(),
-               loc.line(),
-               fmt::vformat(format, args));
+    Log::write(tag, loc, fmt::vformat(format, args));
     if (tag == 'E') {
         exit(EXIT_FAILURE);
     }
@@ -26,7 +26,6 @@
 #include <X11/cursorfont.h>
 #include <string_view>
 #include <unordered_map>
-#include <vector>
 
 static const std::unordered_map<uint16_t, std::string_view> xcursor_font = {
   {           XC_X_cursor,            "X_cursor"},
@@ -139,20 +138,53 @@ const char* xcursor_font_tostr(uint16_t c) {
     return nullptr;
 }
 
+/** Cursors created so far, by cursor font, and the context they came from.
+ * A cursor depends on the theme and size of its context, so a new context
+ * starts from an empty cache.
+ */
+static struct {
+    xcb_cursor_context_t* ctx = nullptr;
+    std::unordered_map<uint16_t, xcb_cursor_t> cursors;
+} xcursor_cache;
+
 /** Equivalent to 'XCreateFontCursor()', error are handled by the
- * default current error handler.
+ * default current error handler. Every cursor is only created once and then
+ * reused until the cache is cleared.
  * \param ctx The xcb-cursor context.
  * \param cursor_font Type of cursor to use.
  * \return Allocated cursor font.
  */
 xcb_cursor_t xcursor_new(xcb_cursor_context_t* ctx, uint16_t cursor_font) {
-    static std::vector<xcb_cursor_t> xcursor(xcursor_font.size(), 0);
+    const char* name = xcursor_font_tostr(cursor_font);
+    if (!name) {
+        return XCB_NONE;
+    }
+
+    if (xcursor_cache.ctx != ctx) {
+        xcursor_cache.cursors.clear();
+        xcursor_cache.ctx = ctx;
+    }
 
-    if (!xcursor[cursor_font]) {
-        xcursor[cursor_font] = xcb_cursor_load_cursor(ctx, xcursor_font_tostr(cursor_font));
+    auto [it, inserted] = xcursor_cache.cursors.try_emplace(cursor_font, XCB_NONE);
+    if (inserted) {
+        it->second = xcb_cursor_load_cursor(ctx, name);
     }
 
-    return xcursor[cursor_font];
+    return it->second;
+}
+
+/** Free every cached cursor, e.g. because the cursor theme changed. Windows
+ * keep the cursor they were given until they get a new one.
+ * \param conn The connection the cursors were created on.
+ */
+void xcursor_cache_clear(xcb_connection_t* conn) {
+    for (const auto& [font, cursor] : xcursor_cache.cursors) {
+        if (cursor != XCB_NONE) {
+            xcb_free_cursor(conn, cursor);
+        }
+    }
+    xcursor_cache.cursors.clear();
+    xcursor_cache.ctx = nullptr;
 }
 
 // vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
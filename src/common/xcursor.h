@@ -26,3 +26,4 @@
 uint16_t xcursor_font_fromstr(const char*);
 const char* xcursor_font_tostr(uint16_t);
 xcb_cursor_t xcursor_new(xcb_cursor_context_t*, uint16_t);
+void xcursor_cache_clear(xcb_connection_t*);
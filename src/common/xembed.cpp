@@ -124,6 +124,8 @@ void xembed_property_update(XCB::Connection& connection,
             xembed_window_deactivate(connection, emwin.win, timestamp);
             xembed_focus_out(connection, emwin.win, timestamp);
         }
+        /* Mapped behind the back of the systray, it has to place it again */
+        emwin.placed = false;
         Lua::systray_invalidate();
     }
 }
@@ -23,6 +23,8 @@
 
 #include "xcbcpp/xcb.h"
 
+#include <array>
+
 namespace XEmbed {
 enum class InfoFlags : uint32_t { UNMAPPED = 0, MAPPED = (1 << 0), FLAGS_ALL = 1 };
 struct info {
@@ -33,6 +35,12 @@ struct info {
 struct window {
     xcb_window_t win;
     struct info info;
+    /** Geometry (x, y, width, height) the systray last gave the window */
+    std::array<uint32_t, 4> geometry = {};
+    /** Is `geometry` and `mapped` what the window currently has? */
+    bool placed = false;
+    /** Did the systray map the window when it last placed it? */
+    bool mapped = false;
 };
 
 /** The version of the XEMBED protocol that this library supports.  */
@@ -38,39 +38,125 @@
 #include "common/signal.h"
 #include "config.h"
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <glib.h>
+#include <string>
 #include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #ifdef WITH_DBUS
 
 #include "event.h"
+#include "globalconf.h"
 #include "globals.h"
 #include "luaa.h"
+#include "objects/client.h"
+#include "objects/screen.h"
+#include "objects/tag.h"
+#include "profiler.h"
 
+#include <cerrno>
 #include <dbus/dbus.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
 static DBusConnection* dbus_connection_session = NULL;
 static DBusConnection* dbus_connection_system = NULL;
-static GSource* session_source = NULL;
-static GSource* system_source = NULL;
+
+/** At most this many messages wait for the main loop. While the queue is full,
+ * the worker stops reading and the bus daemon buffers the rest. */
+static constexpr size_t max_queued = 1024;
+/** The main loop handles at most this many messages per iteration */
+static constexpr int max_per_iteration = 64;
+
+/** A thread that reads a bus connection. It drops the messages that nobody
+ * wants and queues the others for the main loop. Sending stays on the main
+ * thread. */
+struct BusWorker {
+    DBusConnection** connection;
+    GThread* thread = NULL;
+    /** An eventfd that interrupts the poll of the worker */
+    int wake_fd = -1;
+    std::atomic<bool> stopping = false;
+    /** Protects the fields below */
+    GMutex lock;
+    GCond drained;
+    std::deque<DBusMessage*> queue;
+    /** Whether the main loop will look at the queue */
+    bool scheduled = false;
+};
+
+static BusWorker session_worker{&dbus_connection_session};
+static BusWorker system_worker{&dbus_connection_system};
 
 static Signals dbus_signals;
 
-/** Clean up the D-Bus connection data members
- * \param dbus_connection The D-Bus connection to clean up
- * \param source The D-Bus source
+/** Which messages without a reply a handler wants, an empty list matches
+ * everything */
+struct DBusFilter {
+    std::vector<std::string> members;
+    std::vector<std::string> paths;
+};
+/** The interfaces with a handler. The workers read this too, so it is
+ * protected by `filters_lock`. */
+static std::unordered_map<std::string, DBusFilter> dbus_filters;
+static GMutex filters_lock;
+
+static BusWorker* a_dbus_worker_of(DBusConnection* dbus_connection) {
+    return dbus_connection == dbus_connection_system ? &system_worker : &session_worker;
+}
+
+static void a_dbus_worker_wake(BusWorker* worker) {
+    if (worker->wake_fd >= 0) {
+        /* This only fails if the counter is full, the worker wakes up then */
+        const uint64_t one = 1;
+        [[maybe_unused]] const ssize_t written = write(worker->wake_fd, &one, sizeof(one));
+    }
+}
+
+/** Flush a connection.
+ * Blocking on the main thread may read incoming messages into the queue of
+ * the connection as well, the worker is woken up to look at them.
+ * \param dbus_connection The D-Bus connection to flush.
+ */
+static void a_dbus_flush(DBusConnection* dbus_connection) {
+    dbus_connection_flush(dbus_connection);
+    a_dbus_worker_wake(a_dbus_worker_of(dbus_connection));
+}
+
+/** Clean up the D-Bus connection of a worker and stop the worker
+ * \param worker The worker of the D-Bus connection to clean up
  */
-static void a_dbus_cleanup_bus(DBusConnection* dbus_connection, GSource** source) {
+static void a_dbus_cleanup_bus(BusWorker* worker) {
+    DBusConnection* dbus_connection = *worker->connection;
     if (!dbus_connection) {
         return;
     }
 
-    if (*source != NULL) {
-        g_source_destroy(*source);
+    if (worker->thread) {
+        g_mutex_lock(&worker->lock);
+        worker->stopping = true;
+        g_cond_signal(&worker->drained);
+        g_mutex_unlock(&worker->lock);
+        a_dbus_worker_wake(worker);
+        g_thread_join(worker->thread);
+        worker->thread = NULL;
     }
-    *source = NULL;
+    for (auto* msg : worker->queue) {
+        dbus_message_unref(msg);
+    }
+    worker->queue.clear();
+    if (worker->wake_fd >= 0) {
+        close(worker->wake_fd);
+        worker->wake_fd = -1;
+    }
+    *worker->connection = NULL;
 
     /* This is a shared connection owned by libdbus
      * Do not close it, only unref
@@ -78,65 +164,18 @@ static void a_dbus_cleanup_bus(DBusConnection* dbus_connection, GSource** source
     dbus_connection_unref(dbus_connection);
 }
 
-/** Iterate through the D-Bus messages counting each or traverse each sub message.
+/** Push a fixed size array, without going through its elements one by one.
+ * Byte arrays become a single string.
  * \param L The Lua VM state.
- * \param iter The D-Bus message iterator pointer
- * \return The number of arguments in the iterator
+ * \param iter The D-Bus message iterator pointing at the array.
+ * \param array_type The type of the elements.
  */
-static int a_dbus_message_iter(lua_State* L, DBusMessageIter* iter) {
-    int nargs = 0;
+static void a_dbus_push_fixed_array(lua_State* L, DBusMessageIter* iter, int array_type) {
+    DBusMessageIter sub;
+    dbus_message_iter_recurse(iter, &sub);
 
-    do {
-        switch (dbus_message_iter_get_arg_type(iter)) {
-        default:
-            lua_pushnil(L);
-            nargs++;
-            break;
-        case DBUS_TYPE_INVALID: break;
-        case DBUS_TYPE_VARIANT: {
-            DBusMessageIter subiter;
-            dbus_message_iter_recurse(iter, &subiter);
-            a_dbus_message_iter(L, &subiter);
-        }
-            nargs++;
-            break;
-        case DBUS_TYPE_DICT_ENTRY: {
-            DBusMessageIter subiter;
-
-            /* initialize a sub iterator */
-            dbus_message_iter_recurse(iter, &subiter);
-            /* create a new table to store the dict */
-            a_dbus_message_iter(L, &subiter);
-        }
-            nargs++;
-            break;
-        case DBUS_TYPE_STRUCT: {
-            DBusMessageIter subiter;
-            /* initialize a sub iterator */
-            dbus_message_iter_recurse(iter, &subiter);
-
-            int n = a_dbus_message_iter(L, &subiter);
-
-            /* create a new table to store all the value */
-            lua_createtable(L, n, 0);
-            /* move the table before array elements */
-            lua_insert(L, -n - 1);
-
-            for (int i = n; i > 0; i--) {
-                lua_rawseti(L, -i - 1, i);
-            }
-        }
-            nargs++;
-            break;
-        case DBUS_TYPE_ARRAY: {
-            int array_type = dbus_message_iter_get_element_type(iter);
-
-            if (dbus_type_is_fixed(array_type)) {
-                DBusMessageIter sub;
-                dbus_message_iter_recurse(iter, &sub);
-
-                switch (array_type) {
-                    int datalen;
+    switch (array_type) {
+        int datalen;
 #define DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(type, dbustype, pusher) \
     case dbustype: {                                                     \
         const type* data;                                                \
@@ -147,112 +186,144 @@ static int a_dbus_message_iter(lua_State* L, DBusMessageIter* iter) {
             lua_rawseti(L, -2, i + 1);                                   \
         }                                                                \
     } break;
-                    DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(
-                      int16_t, DBUS_TYPE_INT16, lua_pushinteger)
-                    DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(
-                      uint16_t, DBUS_TYPE_UINT16, lua_pushinteger)
-                    DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(
-                      int32_t, DBUS_TYPE_INT32, lua_pushinteger)
-                    DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(
-                      uint32_t, DBUS_TYPE_UINT32, lua_pushinteger)
-                    DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(
-                      int64_t, DBUS_TYPE_INT64, lua_pushinteger)
-                    DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(
-                      uint64_t, DBUS_TYPE_UINT64, lua_pushinteger)
-                    DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(
-                      double, DBUS_TYPE_DOUBLE, lua_pushnumber)
+        DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(int16_t, DBUS_TYPE_INT16, lua_pushinteger)
+        DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(uint16_t, DBUS_TYPE_UINT16, lua_pushinteger)
+        DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(int32_t, DBUS_TYPE_INT32, lua_pushinteger)
+        DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(uint32_t, DBUS_TYPE_UINT32, lua_pushinteger)
+        DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(int64_t, DBUS_TYPE_INT64, lua_pushinteger)
+        DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(uint64_t, DBUS_TYPE_UINT64, lua_pushinteger)
+        DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT(double, DBUS_TYPE_DOUBLE, lua_pushnumber)
 #undef DBUS_MSG_HANDLE_ARRAY_TYPE_NUMBER_OR_INT
-                case DBUS_TYPE_BYTE: {
-                    const char* c;
-                    dbus_message_iter_get_fixed_array(&sub, &c, &datalen);
-                    lua_pushlstring(L, c, datalen);
-                } break;
-                case DBUS_TYPE_BOOLEAN: {
-                    const dbus_bool_t* b;
-                    dbus_message_iter_get_fixed_array(&sub, &b, &datalen);
-                    lua_createtable(L, datalen, 0);
-                    for (int i = 0; i < datalen; i++) {
-                        lua_pushboolean(L, b[i]);
-                        lua_rawseti(L, -2, i + 1);
-                    }
-                } break;
-                }
-            } else if (array_type == DBUS_TYPE_DICT_ENTRY) {
-                DBusMessageIter subiter;
-                /* initialize a sub iterator */
-                dbus_message_iter_recurse(iter, &subiter);
-
-                /* get the keys and the values
-                 * n is the number of entry in dict */
-                int n = a_dbus_message_iter(L, &subiter);
-
-                /* create a new table to store all the value */
-                lua_createtable(L, n, 0);
-                /* move the table before array elements */
-                lua_insert(L, -(n * 2) - 1);
-
-                for (int i = 0; i < n; i++) {
-                    lua_rawset(L, -(n * 2) - 1 + i * 2);
-                }
-            } else {
-                DBusMessageIter subiter;
-                /* prepare to dig into the array*/
-                dbus_message_iter_recurse(iter, &subiter);
-
-                /* now iterate over every element of the array */
-                int n = a_dbus_message_iter(L, &subiter);
+    case DBUS_TYPE_BYTE: {
+        const char* c;
+        dbus_message_iter_get_fixed_array(&sub, &c, &datalen);
+        lua_pushlstring(L, c, datalen);
+    } break;
+    case DBUS_TYPE_BOOLEAN: {
+        const dbus_bool_t* b;
+        dbus_message_iter_get_fixed_array(&sub, &b, &datalen);
+        lua_createtable(L, datalen, 0);
+        for (int i = 0; i < datalen; i++) {
+            lua_pushboolean(L, b[i]);
+            lua_rawseti(L, -2, i + 1);
+        }
+    } break;
+    default: lua_pushnil(L); break;
+    }
+}
 
-                /* create a new table to store all the value */
-                lua_createtable(L, n, 0);
-                /* move the table before array elements */
-                lua_insert(L, -n - 1);
+/** Push a single value of a D-Bus message.
+ * Containers are filled element by element, so that their size does not
+ * matter for the Lua stack.
+ * \param L The Lua VM state.
+ * \param iter The D-Bus message iterator pointing at the value.
+ */
+static void a_dbus_push_value(lua_State* L, DBusMessageIter* iter) {
+    luaL_checkstack(L, 3, "D-Bus message nested too deeply");
 
-                for (int i = n; i > 0; i--) {
-                    lua_rawseti(L, -i - 1, i);
-                }
-            }
+    switch (dbus_message_iter_get_arg_type(iter)) {
+    default: lua_pushnil(L); break;
+    case DBUS_TYPE_VARIANT: {
+        DBusMessageIter subiter;
+        dbus_message_iter_recurse(iter, &subiter);
+        if (dbus_message_iter_get_arg_type(&subiter) == DBUS_TYPE_INVALID) {
+            lua_pushnil(L);
+        } else {
+            a_dbus_push_value(L, &subiter);
         }
-            nargs++;
-            break;
-        case DBUS_TYPE_BOOLEAN: {
-            dbus_bool_t b;
-            dbus_message_iter_get_basic(iter, &b);
-            lua_pushboolean(L, b);
+    } break;
+    case DBUS_TYPE_STRUCT: {
+        DBusMessageIter subiter;
+        dbus_message_iter_recurse(iter, &subiter);
+        lua_newtable(L);
+        for (int i = 1; dbus_message_iter_get_arg_type(&subiter) != DBUS_TYPE_INVALID; i++) {
+            a_dbus_push_value(L, &subiter);
+            lua_rawseti(L, -2, i);
+            dbus_message_iter_next(&subiter);
         }
-            nargs++;
+    } break;
+    case DBUS_TYPE_ARRAY: {
+        const int array_type = dbus_message_iter_get_element_type(iter);
+
+        if (dbus_type_is_fixed(array_type)) {
+            a_dbus_push_fixed_array(L, iter, array_type);
             break;
-        case DBUS_TYPE_BYTE: {
-            char c;
-            dbus_message_iter_get_basic(iter, &c);
-            lua_pushlstring(L, &c, 1);
         }
-            nargs++;
-            break;
+
+        DBusMessageIter subiter;
+        dbus_message_iter_recurse(iter, &subiter);
+        lua_newtable(L);
+        if (array_type == DBUS_TYPE_DICT_ENTRY) {
+            /* The keys are basic types, strings are interned by Lua */
+            while (dbus_message_iter_get_arg_type(&subiter) == DBUS_TYPE_DICT_ENTRY) {
+                DBusMessageIter entry;
+                dbus_message_iter_recurse(&subiter, &entry);
+                a_dbus_push_value(L, &entry);
+                dbus_message_iter_next(&entry);
+                a_dbus_push_value(L, &entry);
+                if (lua_isnil(L, -2)) {
+                    lua_pop(L, 2);
+                } else {
+                    lua_rawset(L, -3);
+                }
+                dbus_message_iter_next(&subiter);
+            }
+        } else {
+            for (int i = 1; dbus_message_iter_get_arg_type(&subiter) != DBUS_TYPE_INVALID;
+                 i++) {
+                a_dbus_push_value(L, &subiter);
+                lua_rawseti(L, -2, i);
+                dbus_message_iter_next(&subiter);
+            }
+        }
+    } break;
+    case DBUS_TYPE_BOOLEAN: {
+        dbus_bool_t b;
+        dbus_message_iter_get_basic(iter, &b);
+        lua_pushboolean(L, b);
+    } break;
+    case DBUS_TYPE_BYTE: {
+        char c;
+        dbus_message_iter_get_basic(iter, &c);
+        lua_pushlstring(L, &c, 1);
+    } break;
 #define DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(type, dbustype, pusher) \
     case dbustype: {                                               \
         type ui;                                                   \
         dbus_message_iter_get_basic(iter, &ui);                    \
         pusher(L, ui);                                             \
-    }                                                              \
-        nargs++;                                                   \
-        break;
-            DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(int16_t, DBUS_TYPE_INT16, lua_pushinteger)
-            DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(uint16_t, DBUS_TYPE_UINT16, lua_pushinteger)
-            DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(int32_t, DBUS_TYPE_INT32, lua_pushinteger)
-            DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(uint32_t, DBUS_TYPE_UINT32, lua_pushinteger)
-            DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(int64_t, DBUS_TYPE_INT64, lua_pushinteger)
-            DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(uint64_t, DBUS_TYPE_UINT64, lua_pushinteger)
-            DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(double, DBUS_TYPE_DOUBLE, lua_pushnumber)
+    } break;
+        DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(int16_t, DBUS_TYPE_INT16, lua_pushinteger)
+        DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(uint16_t, DBUS_TYPE_UINT16, lua_pushinteger)
+        DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(int32_t, DBUS_TYPE_INT32, lua_pushinteger)
+        DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(uint32_t, DBUS_TYPE_UINT32, lua_pushinteger)
+        DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(int64_t, DBUS_TYPE_INT64, lua_pushinteger)
+        DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(uint64_t, DBUS_TYPE_UINT64, lua_pushinteger)
+        DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT(double, DBUS_TYPE_DOUBLE, lua_pushnumber)
 #undef DBUS_MSG_HANDLE_TYPE_NUMBER_OR_INT
-        case DBUS_TYPE_STRING: {
-            char* s;
-            dbus_message_iter_get_basic(iter, &s);
-            lua_pushstring(L, s);
-        }
-            nargs++;
-            break;
-        }
-    } while (dbus_message_iter_next(iter));
+    case DBUS_TYPE_STRING:
+    case DBUS_TYPE_OBJECT_PATH:
+    case DBUS_TYPE_SIGNATURE: {
+        const char* s;
+        dbus_message_iter_get_basic(iter, &s);
+        lua_pushstring(L, s);
+    } break;
+    }
+}
+
+/** Push all the remaining values of a D-Bus message iterator.
+ * \param L The Lua VM state.
+ * \param iter The D-Bus message iterator pointer
+ * \return The number of arguments in the iterator
+ */
+static int a_dbus_message_iter(lua_State* L, DBusMessageIter* iter) {
+    int nargs = 0;
+
+    while (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_INVALID) {
+        a_dbus_push_value(L, iter);
+        nargs++;
+        dbus_message_iter_next(iter);
+    }
 
     return nargs;
 }
@@ -326,12 +397,44 @@ static bool a_dbus_convert_value(lua_State* L, int idx, DBusMessageIter* iter) {
     return true;
 }
 
+/** Check whether a handler wants a message, from any thread.
+ * \param msg The message.
+ * \return False if the message can be dropped.
+ */
+static bool a_dbus_wanted(DBusMessage* msg) {
+    const char* interface = dbus_message_get_interface(msg);
+    if (!interface) {
+        return false;
+    }
+    const auto matches = [](const std::vector<std::string>& list, const char* value) {
+        return list.empty() ||
+               (value && std::find(list.begin(), list.end(), value) != list.end());
+    };
+
+    g_mutex_lock(&filters_lock);
+    auto it = dbus_filters.find(interface);
+    /* Only a single handler can answer a method call, it gets all of them */
+    const bool wanted = it != dbus_filters.end() &&
+                        (!dbus_message_get_no_reply(msg) ||
+                         (matches(it->second.members, dbus_message_get_member(msg)) &&
+                          matches(it->second.paths, dbus_message_get_path(msg))));
+    g_mutex_unlock(&filters_lock);
+    return wanted;
+}
+
 /** Process a single request from D-Bus
  * \param dbus_connection  The connection to the D-Bus server.
  * \param msg The D-Bus message request being sent to the D-Bus connection.
  */
 static void a_dbus_process_request(DBusConnection* dbus_connection, DBusMessage* msg) {
     const char* interface = dbus_message_get_interface(msg);
+
+    /* The worker dropped most messages of no interest already, but the
+     * handlers may have changed since */
+    if (!a_dbus_wanted(msg) || dbus_signals.find(interface) == dbus_signals.end()) {
+        return;
+    }
+
     lua_State* L = globalconf_get_lua_State();
     int old_top = lua_gettop(L);
 
@@ -383,7 +486,7 @@ static void a_dbus_process_request(DBusConnection* dbus_connection, DBusMessage*
         auto signalIt = dbus_signals.find(interface);
         /* emit signals */
         if (signalIt != dbus_signals.end()) {
-            signal_object_emit(L, &dbus_signals, NONULL(interface), nargs);
+            signal_object_emit(L, &dbus_signals, NONULL(interface), nargs, "dbus");
         }
     } else {
         auto signalIt = dbus_signals.find(interface);
@@ -431,47 +534,338 @@ static void a_dbus_process_request(DBusConnection* dbus_connection, DBusMessage*
     lua_settop(L, old_top);
 }
 
-/** Attempt to process all the requests in the D-Bus connection.
- * \param dbus_connection The D-Bus connection to process from
- * \param source The D-Bus source
+/** Answer a loop statistics request natively, without going through Lua.
+ * The reply is an array of (name, count, p50, p99, max) structures, with the
+ * durations in seconds.
+ * \param dbus_connection The connection to the D-Bus server.
+ * \param msg The method call to reply to.
  */
-static void a_dbus_process_requests_on_bus(DBusConnection* dbus_connection, GSource** source) {
-    DBusMessage* msg;
-    int nmsg = 0;
+static void a_dbus_reply_loop_stats(DBusConnection* dbus_connection, DBusMessage* msg) {
+    DBusMessage* reply = dbus_message_new_method_return(msg);
+    DBusMessageIter iter, array;
+
+    dbus_message_iter_init_append(reply, &iter);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(stddd)", &array);
+    for (size_t i = 0; i < size_t(Profiler::Phase::Count); i++) {
+        const auto phase = Profiler::Phase(i);
+        const auto& stats = Profiler::stats(phase);
+        const std::string name{Profiler::name(phase)};
+        const char* cname = name.c_str();
+        dbus_uint64_t count = stats.count;
+        double p50 = stats.percentile(0.5) / 1e9;
+        double p99 = stats.percentile(0.99) / 1e9;
+        double max = stats.max_ns / 1e9;
+
+        DBusMessageIter entry;
+        dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &cname);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &count);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_DOUBLE, &p50);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_DOUBLE, &p99);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_DOUBLE, &max);
+        dbus_message_iter_close_container(&array, &entry);
+    }
+    dbus_message_iter_close_container(&iter, &array);
 
-    while (true) {
-        dbus_connection_read_write(dbus_connection, 0);
+    dbus_connection_send(dbus_connection, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+/** The interface answered natively, without Lua */
+static constexpr const char* introspect_interface = "org.awesomewm.awesome.Introspect";
+/** The path of its change signals */
+static constexpr const char* introspect_path = "/org/awesomewm/awesome";
+
+/** Changes not signalled yet, see a_dbus_introspect_changed() */
+static int introspect_pending = 0;
+
+/** Get a string which can be appended as DBUS_TYPE_STRING. Window and screen
+ * names come from the X server and may not be valid UTF-8, which libdbus
+ * refuses, so invalid sequences are replaced in a copy kept in storage.
+ */
+static const char* a_dbus_utf8(const std::string& s, std::deque<std::string>& storage) {
+    if (g_utf8_validate(s.data(), s.size(), NULL)) {
+        return s.c_str();
+    }
+    gchar* valid = g_utf8_make_valid(s.data(), s.size());
+    storage.emplace_back(valid);
+    g_free(valid);
+    return storage.back().c_str();
+}
+
+/** Reply with the managed clients, an array of (window, name, class,
+ * instance, x, y, width, height, screen, focused, minimized, tags)
+ * structures. The screen is its index, 0 if none, and the tags are names.
+ */
+static void a_dbus_reply_clients(DBusConnection* dbus_connection, DBusMessage* msg) {
+    DBusMessage* reply = dbus_message_new_method_return(msg);
+    DBusMessageIter iter, array;
+    std::deque<std::string> storage;
+
+    dbus_message_iter_init_append(reply, &iter);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(usssiiuuibbas)", &array);
+    for (auto* c : Manager::get().clients) {
+        dbus_uint32_t window = c->window;
+        const char* name = a_dbus_utf8(c->getName(), storage);
+        const char* cls = a_dbus_utf8(c->getCls(), storage);
+        const char* instance = a_dbus_utf8(c->getInstance(), storage);
+        dbus_int32_t x = c->geometry.left(), y = c->geometry.top();
+        dbus_uint32_t width = c->geometry.width, height = c->geometry.height;
+        dbus_int32_t screen = c->screen ? screen_get_index(c->screen) : 0;
+        dbus_bool_t focused = c == Manager::get().focus.client;
+        dbus_bool_t minimized = c->minimized;
+
+        DBusMessageIter entry, tags;
+        dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &window);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &name);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &cls);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &instance);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &x);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &y);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &width);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &height);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &screen);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_BOOLEAN, &focused);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_BOOLEAN, &minimized);
+        dbus_message_iter_open_container(&entry, DBUS_TYPE_ARRAY, "s", &tags);
+        for (const auto& t : Manager::get().tags) {
+            if (c->tags.test(t->bit)) {
+                const char* tag_name = a_dbus_utf8(t->name, storage);
+                dbus_message_iter_append_basic(&tags, DBUS_TYPE_STRING, &tag_name);
+            }
+        }
+        dbus_message_iter_close_container(&entry, &tags);
+        dbus_message_iter_close_container(&array, &entry);
+    }
+    dbus_message_iter_close_container(&iter, &array);
+
+    dbus_connection_send(dbus_connection, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+/** Reply with the activated tags, an array of (name, selected, clients)
+ * structures, where clients is the number of clients on the tag.
+ */
+static void a_dbus_reply_tags(DBusConnection* dbus_connection, DBusMessage* msg) {
+    DBusMessage* reply = dbus_message_new_method_return(msg);
+    DBusMessageIter iter, array;
+    std::deque<std::string> storage;
+
+    dbus_message_iter_init_append(reply, &iter);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(sbu)", &array);
+    for (const auto& t : Manager::get().tags) {
+        const char* name = a_dbus_utf8(t->name, storage);
+        dbus_bool_t selected = t->selected;
+        dbus_uint32_t clients = t->clients.size();
+
+        DBusMessageIter entry;
+        dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &name);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_BOOLEAN, &selected);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &clients);
+        dbus_message_iter_close_container(&array, &entry);
+    }
+    dbus_message_iter_close_container(&iter, &array);
+
+    dbus_connection_send(dbus_connection, reply, NULL);
+    dbus_message_unref(reply);
+}
 
-        if (!(msg = dbus_connection_pop_message(dbus_connection))) {
+/** Reply with the screens, an array of (index, name, x, y, width, height)
+ * structures.
+ */
+static void a_dbus_reply_screens(DBusConnection* dbus_connection, DBusMessage* msg) {
+    DBusMessage* reply = dbus_message_new_method_return(msg);
+    DBusMessageIter iter, array;
+    std::deque<std::string> storage;
+
+    dbus_message_iter_init_append(reply, &iter);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(isiiuu)", &array);
+    dbus_int32_t index = 0;
+    for (auto* screen : Manager::get().screens) {
+        index++;
+        const char* name = a_dbus_utf8(screen->name, storage);
+        dbus_int32_t x = screen->geometry.left(), y = screen->geometry.top();
+        dbus_uint32_t width = screen->geometry.width, height = screen->geometry.height;
+
+        DBusMessageIter entry;
+        dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &index);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &name);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &x);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &y);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &width);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &height);
+        dbus_message_iter_close_container(&array, &entry);
+    }
+    dbus_message_iter_close_container(&iter, &array);
+
+    dbus_connection_send(dbus_connection, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+/** Check whether a message is a method call answered natively. */
+static bool a_dbus_is_native(DBusMessage* msg) {
+    return dbus_message_is_method_call(msg, "org.awesomewm.awesome.Profiler", "LoopStats") ||
+           (dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_METHOD_CALL &&
+            dbus_message_has_interface(msg, introspect_interface));
+}
+
+/** Answer a method call for which a_dbus_is_native() is true. */
+static void a_dbus_reply_native(DBusConnection* dbus_connection, DBusMessage* msg) {
+    const std::string_view member = NONULL(dbus_message_get_member(msg));
+    if (member == "LoopStats" || member == "GetLoopStats") {
+        a_dbus_reply_loop_stats(dbus_connection, msg);
+    } else if (member == "ListClients") {
+        a_dbus_reply_clients(dbus_connection, msg);
+    } else if (member == "ListTags") {
+        a_dbus_reply_tags(dbus_connection, msg);
+    } else if (member == "ListScreens") {
+        a_dbus_reply_screens(dbus_connection, msg);
+    } else if (!dbus_message_get_no_reply(msg)) {
+        DBusMessage* reply =
+          dbus_message_new_error(msg, DBUS_ERROR_UNKNOWN_METHOD, "No such method");
+        dbus_connection_send(dbus_connection, reply, NULL);
+        dbus_message_unref(reply);
+    }
+}
+
+/** Emit the pending change signals on the session bus. */
+static gboolean a_dbus_introspect_emit(gpointer) {
+    const int pending = std::exchange(introspect_pending, 0);
+    if (!dbus_connection_session) {
+        return G_SOURCE_REMOVE;
+    }
+    if (pending & DBUS_CHANGE_CLIENTS) {
+        DBusMessage* msg =
+          dbus_message_new_signal(introspect_path, introspect_interface, "ClientsChanged");
+        dbus_connection_send(dbus_connection_session, msg, NULL);
+        dbus_message_unref(msg);
+    }
+    if (pending & DBUS_CHANGE_TAGS) {
+        DBusMessage* msg =
+          dbus_message_new_signal(introspect_path, introspect_interface, "TagsChanged");
+        dbus_connection_send(dbus_connection_session, msg, NULL);
+        dbus_message_unref(msg);
+    }
+    a_dbus_flush(dbus_connection_session);
+    return G_SOURCE_REMOVE;
+}
+
+/** Note a change for the ClientsChanged and TagsChanged signals of the
+ * introspection interface. They are emitted once per main loop iteration.
+ * \param what The dbus_change_t flags of the change.
+ */
+void a_dbus_introspect_changed(int what) {
+    if (!dbus_connection_session) {
+        return;
+    }
+    if (!introspect_pending) {
+        g_idle_add(a_dbus_introspect_emit, NULL);
+    }
+    introspect_pending |= what;
+}
+
+/** Process the messages a worker queued, on the main thread.
+ * Only a limited number is handled per main loop iteration, so that a flood
+ * of messages does not delay X events.
+ * \param data The worker.
+ */
+static gboolean a_dbus_worker_dispatch(gpointer data) {
+    auto* worker = static_cast<BusWorker*>(data);
+    DBusConnection* dbus_connection = *worker->connection;
+    int nmsg = 0;
+
+    for (; nmsg < max_per_iteration; nmsg++) {
+        g_mutex_lock(&worker->lock);
+        if (worker->queue.empty()) {
+            worker->scheduled = false;
+            g_mutex_unlock(&worker->lock);
             break;
         }
+        DBusMessage* msg = worker->queue.front();
+        worker->queue.pop_front();
+        g_cond_signal(&worker->drained);
+        g_mutex_unlock(&worker->lock);
 
         if (dbus_message_is_signal(msg, DBUS_INTERFACE_LOCAL, "Disconnected")) {
-            a_dbus_cleanup_bus(dbus_connection, source);
             dbus_message_unref(msg);
-            return;
+            a_dbus_cleanup_bus(worker);
+            return G_SOURCE_REMOVE;
+        } else if (a_dbus_is_native(msg)) {
+            a_dbus_reply_native(dbus_connection, msg);
         } else {
             a_dbus_process_request(dbus_connection, msg);
         }
 
         dbus_message_unref(msg);
-
-        nmsg++;
     }
 
-    if (nmsg) {
-        dbus_connection_flush(dbus_connection);
+    if (nmsg && *worker->connection) {
+        a_dbus_flush(dbus_connection);
     }
+    return nmsg < max_per_iteration ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
 }
 
-static gboolean a_dbus_process_requests_session(gpointer data) {
-    a_dbus_process_requests_on_bus(dbus_connection_session, &session_source);
-    return TRUE;
+/** Queue a message for the main loop, waiting while the queue is full.
+ * \param worker The worker.
+ * \param msg The message, the queue takes the reference.
+ */
+static void a_dbus_worker_push(BusWorker* worker, DBusMessage* msg) {
+    g_mutex_lock(&worker->lock);
+    while (!worker->stopping && worker->queue.size() >= max_queued) {
+        g_cond_wait(&worker->drained, &worker->lock);
+    }
+    worker->queue.push_back(msg);
+    if (!worker->scheduled) {
+        worker->scheduled = true;
+        g_idle_add(a_dbus_worker_dispatch, worker);
+    }
+    g_mutex_unlock(&worker->lock);
 }
 
-static gboolean a_dbus_process_requests_system(gpointer data) {
-    a_dbus_process_requests_on_bus(dbus_connection_system, &system_source);
-    return TRUE;
+/** The thread reading a connection.
+ * libdbus reads and parses the messages here, messages nobody wants are
+ * dropped before the main thread ever sees them.
+ * \param data The worker.
+ */
+static gpointer a_dbus_worker_run(gpointer data) {
+    auto* worker = static_cast<BusWorker*>(data);
+    DBusConnection* dbus_connection = *worker->connection;
+    int fd = -1;
+    dbus_connection_get_unix_fd(dbus_connection, &fd);
+    struct pollfd fds[2] = {{fd, POLLIN, 0}, {worker->wake_fd, POLLIN, 0}};
+
+    while (!worker->stopping) {
+        /* The main thread may have queued messages while blocking, so the
+         * queue of the connection is checked before waiting */
+        dbus_connection_read_write(dbus_connection, 0);
+
+        DBusMessage* msg;
+        while (!worker->stopping && (msg = dbus_connection_pop_message(dbus_connection))) {
+            if (dbus_message_is_signal(msg, DBUS_INTERFACE_LOCAL, "Disconnected")) {
+                /* Nothing more will arrive, the main thread cleans up */
+                a_dbus_worker_push(worker, msg);
+                return NULL;
+            }
+            if (a_dbus_is_native(msg) || a_dbus_wanted(msg)) {
+                a_dbus_worker_push(worker, msg);
+            } else {
+                dbus_message_unref(msg);
+            }
+        }
+
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+            log_warn("D-Bus worker failed to poll: {}", g_strerror(errno));
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            [[maybe_unused]] const ssize_t got = read(worker->wake_fd, &count, sizeof(count));
+        }
+    }
+    return NULL;
 }
 
 /** Attempt to request a D-Bus name.
@@ -490,6 +884,7 @@ static bool a_dbus_request_name(DBusConnection* dbus_connection, const std::stri
     dbus_error_init(&err);
 
     int ret = dbus_bus_request_name(dbus_connection, name.data(), 0, &err);
+    a_dbus_worker_wake(a_dbus_worker_of(dbus_connection));
 
     if (dbus_error_is_set(&err)) {
         log_warn("failed to request D-Bus name: {}", err.message);
@@ -522,6 +917,7 @@ static bool a_dbus_release_name(DBusConnection* dbus_connection, const char* nam
     dbus_error_init(&err);
 
     int ret = dbus_bus_release_name(dbus_connection, name, &err);
+    a_dbus_worker_wake(a_dbus_worker_of(dbus_connection));
 
     if (dbus_error_is_set(&err)) {
         log_warn("failed to release D-Bus name: {}", err.message);
@@ -540,59 +936,102 @@ static bool a_dbus_release_name(DBusConnection* dbus_connection, const char* nam
     return true;
 }
 
-/** Attempt to create a new connection to D-Bus
- * \param type The bus type to use when connecting to D-Bus
- * \param type_name The bus type name eg: "session" or "system"
- * \param cb Function callback to use when processing requests
- * \param source A new GSource that will be used for watching the dbus connection.
- * \return The requested D-Bus connection on success, NULL on failure.
+/** A bus connection, made by a thread while the startup goes on */
+struct pending_bus {
+    DBusBusType type;
+    GThread* thread = NULL;
+    DBusConnection* connection = NULL;
+    std::string error;
+};
+
+static pending_bus pending_session{DBUS_BUS_SESSION};
+static pending_bus pending_system{DBUS_BUS_SYSTEM};
+
+/** Connect to a bus, only touching the pending bus
+ * \param bus The bus to connect to.
  */
-static DBusConnection*
-a_dbus_connect(DBusBusType type, const char* type_name, GSourceFunc cb, GSource** source) {
-    int fd;
-    DBusConnection* dbus_connection;
+static gpointer a_dbus_bus_get(gpointer data) {
+    auto* bus = static_cast<pending_bus*>(data);
     DBusError err;
 
     dbus_error_init(&err);
 
-    dbus_connection = dbus_bus_get(type, &err);
+    bus->connection = dbus_bus_get(bus->type, &err);
     if (dbus_error_is_set(&err)) {
-        log_warn("Could not connect to D-Bus {} bus: {}", type_name, err.message);
-        dbus_connection = NULL;
+        bus->connection = NULL;
+        bus->error = err.message;
         dbus_error_free(&err);
+    }
+    return NULL;
+}
+
+/** Start connecting to the D-Bus session and system buses.
+ * Connecting mostly waits for the bus daemons, so it happens on threads while
+ * the rest of the startup goes on. a_dbus_init() waits for them.
+ */
+void a_dbus_connect_start(void) {
+    /* Older libdbus versions are only thread safe after this */
+    dbus_threads_init_default();
+    pending_session.thread = g_thread_new("dbus session", a_dbus_bus_get, &pending_session);
+    pending_system.thread = g_thread_new("dbus system", a_dbus_bus_get, &pending_system);
+}
+
+/** Attempt to create a new connection to D-Bus and start its worker
+ * \param bus The bus to connect to, possibly already being connected to
+ * \param type_name The bus type name eg: "session" or "system"
+ * \param worker The worker that will read the connection.
+ */
+static void a_dbus_connect(pending_bus* bus, const char* type_name, BusWorker* worker) {
+    int fd;
+    DBusConnection* dbus_connection;
+
+    if (bus->thread) {
+        g_thread_join(bus->thread);
+        bus->thread = NULL;
     } else {
-        dbus_connection_set_exit_on_disconnect(dbus_connection, false);
-        if (dbus_connection_get_unix_fd(dbus_connection, &fd)) {
-            GIOChannel* channel = g_io_channel_unix_new(fd);
-            *source = g_io_create_watch(channel, G_IO_IN);
-            g_io_channel_unref(channel);
-            g_source_set_callback(*source, cb, NULL, NULL);
-            g_source_attach(*source, NULL);
-
-            fcntl(fd, F_SETFD, FD_CLOEXEC);
-        } else {
-            log_warn("cannot get D-Bus connection file descriptor");
-            a_dbus_cleanup_bus(dbus_connection, source);
-        }
+        a_dbus_bus_get(bus);
     }
 
-    return dbus_connection;
+    dbus_connection = bus->connection;
+    bus->connection = NULL;
+    if (!dbus_connection) {
+        log_warn("Could not connect to D-Bus {} bus: {}", type_name, bus->error);
+        return;
+    }
+
+    dbus_connection_set_exit_on_disconnect(dbus_connection, false);
+    *worker->connection = dbus_connection;
+    if (!dbus_connection_get_unix_fd(dbus_connection, &fd)) {
+        log_warn("cannot get D-Bus connection file descriptor");
+        a_dbus_cleanup_bus(worker);
+        return;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    worker->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (worker->wake_fd < 0) {
+        log_warn("cannot create an eventfd for the D-Bus {} bus: {}", type_name,
+                 g_strerror(errno));
+        a_dbus_cleanup_bus(worker);
+        return;
+    }
+    worker->stopping = false;
+    worker->thread = g_thread_new(type_name, a_dbus_worker_run, worker);
 }
 
-/** Initialize the D-Bus session and system
+/** Initialize the D-Bus session and system, waiting for the connections that
+ * a_dbus_connect_start() started
  */
 void a_dbus_init(void) {
-    dbus_connection_session =
-      a_dbus_connect(DBUS_BUS_SESSION, "session", a_dbus_process_requests_session, &session_source);
-    dbus_connection_system =
-      a_dbus_connect(DBUS_BUS_SYSTEM, "system", a_dbus_process_requests_system, &system_source);
+    a_dbus_connect(&pending_session, "session", &session_worker);
+    a_dbus_connect(&pending_system, "system", &system_worker);
 }
 
 /** Cleanup the D-Bus session and system
  */
 void a_dbus_cleanup(void) {
-    a_dbus_cleanup_bus(dbus_connection_session, &session_source);
-    a_dbus_cleanup_bus(dbus_connection_system, &system_source);
+    a_dbus_cleanup_bus(&session_worker);
+    a_dbus_cleanup_bus(&system_worker);
 }
 
 /** Retrieve the D-Bus bus by its name.
@@ -653,7 +1092,7 @@ static int luaA_dbus_add_match(lua_State* L) {
 
     if (dbus_connection) {
         dbus_bus_add_match(dbus_connection, name, NULL);
-        dbus_connection_flush(dbus_connection);
+        a_dbus_flush(dbus_connection);
     }
 
     return 0;
@@ -673,16 +1112,51 @@ static int luaA_dbus_remove_match(lua_State* L) {
 
     if (dbus_connection) {
         dbus_bus_remove_match(dbus_connection, name, NULL);
-        dbus_connection_flush(dbus_connection);
+        a_dbus_flush(dbus_connection);
     }
 
     return 0;
 }
 
+/** Read a string or an array of strings from a filter table.
+ * \param L The Lua VM state.
+ * \param idx The index of the filter table.
+ * \param field The field to read.
+ * \return The strings, empty if the field is not set.
+ */
+static std::vector<std::string> a_dbus_filter_field(lua_State* L, int idx, const char* field) {
+    std::vector<std::string> values;
+    lua_getfield(L, idx, field);
+    if (lua_type(L, -1) == LUA_TSTRING) {
+        values.emplace_back(lua_tostring(L, -1));
+    } else if (lua_istable(L, -1)) {
+        const size_t len = Lua::rawlen(L, -1);
+        for (size_t i = 1; i <= len; i++) {
+            lua_rawgeti(L, -1, i);
+            if (lua_type(L, -1) != LUA_TSTRING) {
+                luaL_error(L, "filter %s must only contain strings", field);
+            }
+            values.emplace_back(lua_tostring(L, -1));
+            lua_pop(L, 1);
+        }
+    } else if (!lua_isnil(L, -1)) {
+        luaL_error(L, "filter %s must be a string or a table of strings", field);
+    }
+    lua_pop(L, 1);
+    return values;
+}
+
 /** Add a signal receiver on the D-Bus.
+ *
+ * Messages without a reply, like signals, can be filtered by member and path.
+ * Those that do not match are dropped before they reach Lua, which is a lot
+ * cheaper on a busy bus than ignoring them in the handler. Method calls are
+ * always passed to the handler, since it has to reply.
  *
  * @param interface A string with the interface name.
  * @param func The function to call.
+ * @param[opt] filter A table with `member` and `path` fields, each a string or
+ * a table of strings that is matched exactly.
  * @return true on success, nil + error if the signal could not be connected
  * because another function is already connected.
  * @function connect_signal
@@ -690,6 +1164,12 @@ static int luaA_dbus_remove_match(lua_State* L) {
 static int luaA_dbus_connect_signal(lua_State* L) {
     const auto name = Lua::checkstring(L, 1);
     Lua::checkfunction(L, 2);
+    DBusFilter filter;
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        filter.members = a_dbus_filter_field(L, 3, "member");
+        filter.paths = a_dbus_filter_field(L, 3, "path");
+    }
     auto signalIt = dbus_signals.find(*name);
     if (signalIt != dbus_signals.end()) {
         Lua::warn(L, "cannot add signal %s on D-Bus, already existing", name->data());
@@ -698,11 +1178,22 @@ static int luaA_dbus_connect_signal(lua_State* L) {
         return 2;
     } else {
         dbus_signals.connect(*name, LuaFunction{luaA_object_ref(L, 2)});
+        g_mutex_lock(&filters_lock);
+        dbus_filters[std::string(*name)] = std::move(filter);
+        g_mutex_unlock(&filters_lock);
         lua_pushboolean(L, 1);
         return 1;
     }
 }
 
+/** Remove all the signal receivers on the D-Bus, see awesome.reload. */
+void a_dbus_disconnect_all(void) {
+    signal_object_disconnect_all(globalconf_get_lua_State(), &dbus_signals);
+    g_mutex_lock(&filters_lock);
+    dbus_filters.clear();
+    g_mutex_unlock(&filters_lock);
+}
+
 /** Remove a signal receiver on the D-Bus.
  *
  * @param interface A string with the interface name.
@@ -715,6 +1206,11 @@ static int luaA_dbus_disconnect_signal(lua_State* L) {
     const void* func = lua_topointer(L, 2);
     if (dbus_signals.disconnect(name, LuaFunction{func})) {
         luaA_object_unref(L, func);
+        if (dbus_signals.find(name) == dbus_signals.end()) {
+            g_mutex_lock(&filters_lock);
+            dbus_filters.erase(name);
+            g_mutex_unlock(&filters_lock);
+        }
     }
     return 0;
 }
@@ -765,7 +1261,7 @@ static int luaA_dbus_emit_signal(lua_State* L) {
     }
     dbus_connection_send(dbus_connection, msg, NULL);
     dbus_message_unref(msg);
-    dbus_connection_flush(dbus_connection);
+    a_dbus_flush(dbus_connection);
     lua_pushboolean(L, 1);
     return 1;
 }
@@ -785,11 +1281,20 @@ const struct luaL_Reg awesome_dbus_lib[] = {
 
 #else /* WITH_DBUS */
 
+/** Empty stub if dbus is not enabled */
+void a_dbus_connect_start(void) {}
+
 /** Empty stub if dbus is not enabled */
 void a_dbus_init(void) {}
 
 /** Empty stub if dbus is not enabled */
 void a_dbus_cleanup(void) {}
 
+/** Empty stub if dbus is not enabled */
+void a_dbus_introspect_changed(int) {}
+
+/** Empty stub if dbus is not enabled */
+void a_dbus_disconnect_all(void) {}
+
 #endif
 // vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
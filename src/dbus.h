@@ -20,5 +20,16 @@
  */
 #pragma once
 
+void a_dbus_connect_start(void);
 void a_dbus_init(void);
 void a_dbus_cleanup(void);
+void a_dbus_disconnect_all(void);
+
+/** What changed, for the signals of the org.awesomewm.awesome.Introspect
+ * D-Bus interface */
+enum dbus_change_t {
+    DBUS_CHANGE_CLIENTS = 1 << 0,
+    DBUS_CHANGE_TAGS = 1 << 1,
+};
+
+void a_dbus_introspect_changed(int what);
@@ -23,7 +23,10 @@
 
 #include "config.h"
 #include "globalconf.h"
+#include "memstats.h"
+#include "premultiply.h"
 
+#include <algorithm>
 #include <cairo-xcb.h>
 #include <cstdint>
 #include <ctype.h>
@@ -32,7 +35,10 @@
 #include <langinfo.h>
 #include <lauxlib.h>
 #include <math.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <vector>
+#include <xcb/shm.h>
 
 static cairo_user_data_key_t data_key;
 
@@ -46,26 +52,18 @@ static inline void free_data(void* data) { free(data); }
  */
 cairo_surface_t* draw_surface_from_data(int width, int height, uint32_t* data) {
     unsigned long int len = width * height;
-    unsigned long int i;
     auto buf = (uint32_t*)malloc(len * sizeof(uint32_t));
     cairo_surface_t* surface;
 
     /* Cairo wants premultiplied alpha, meh :( */
-    for (i = 0; i < len; i++) {
-        uint8_t a = (data[i] >> 24) & 0xff;
-        double alpha = a / 255.0;
-        uint8_t r = ((data[i] >> 16) & 0xff) * alpha;
-        uint8_t g = ((data[i] >> 8) & 0xff) * alpha;
-        uint8_t b = ((data[i] >> 0) & 0xff) * alpha;
-        buf[i] = (a << 24) | (r << 16) | (g << 8) | b;
-    }
+    Premultiply::argb(buf, data, len);
 
     surface = cairo_image_surface_create_for_data(
       reinterpret_cast<unsigned char*>(buf), CAIRO_FORMAT_ARGB32, width, height, width * 4);
     /* This makes sure that buffer will be freed */
     cairo_surface_set_user_data(surface, &data_key, buf, &free_data);
 
-    return surface;
+    return MemStats::track_image(surface, MemStats::Image::Icon);
 }
 
 /** Create a surface object from this pixbuf
@@ -95,30 +93,22 @@ cairo_surface_t* draw_surface_from_pixbuf(GdkPixbuf* buf) {
     for (int y = 0; y < height; y++) {
         guchar* row = pixels;
         uint32_t* cairo = (uint32_t*)cairo_pixels;
-        for (int x = 0; x < width; x++) {
-            if (channels == 3) {
+        if (channels == 3) {
+            for (int x = 0; x < width; x++) {
                 uint8_t r = *row++;
                 uint8_t g = *row++;
                 uint8_t b = *row++;
                 *cairo++ = (r << 16) | (g << 8) | b;
-            } else {
-                uint8_t r = *row++;
-                uint8_t g = *row++;
-                uint8_t b = *row++;
-                uint8_t a = *row++;
-                double alpha = a / 255.0;
-                r = r * alpha;
-                g = g * alpha;
-                b = b * alpha;
-                *cairo++ = (a << 24) | (r << 16) | (g << 8) | b;
             }
+        } else {
+            Premultiply::rgba(cairo, row, width);
         }
         pixels += pix_stride;
         cairo_pixels += cairo_stride;
     }
 
     cairo_surface_mark_dirty(surface);
-    return surface;
+    return MemStats::track_image(surface, MemStats::Image::File);
 }
 
 static void get_surface_size(cairo_surface_t* surface, int* width, int* height) {
@@ -152,7 +142,7 @@ cairo_surface_t* draw_dup_image_surface(cairo_surface_t* surface) {
     cairo_paint(cr);
     cairo_destroy(cr);
 
-    return res;
+    return MemStats::track_image(res, MemStats::Image::Copy);
 }
 
 /** Load the specified path into a cairo surface
@@ -237,6 +227,193 @@ uint8_t draw_visual_depth(const xcb_screen_t* s, xcb_visualid_t vis) {
     return 0;
 }
 
+/** A shared memory segment backing an image surface */
+struct shm_segment {
+    xcb_shm_seg_t seg;
+    void* addr;
+};
+
+static cairo_user_data_key_t shm_key;
+
+static void shm_segment_destroy(void* data) {
+    auto segment = static_cast<shm_segment*>(data);
+    xcb_shm_detach(getConnection().getConnection(), segment->seg);
+    shmdt(segment->addr);
+    delete segment;
+}
+
+/** Create an image surface whose memory is shared with the X server.
+ * Such surfaces can be copied to a drawable with draw_shm_put() without
+ * sending their content through the X connection. If MIT-SHM is not usable,
+ * for example with a remote X server, this is a plain image surface.
+ * \param width The width of the surface.
+ * \param height The height of the surface.
+ * \return A new ARGB32 image surface.
+ */
+static cairo_surface_t* shm_surface_create(int width, int height) {
+    if (!Manager::get().x.caps.have_shm || width <= 0 || height <= 0) {
+        return cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    }
+
+    const int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+    const int shmid = shmget(IPC_PRIVATE, size_t(stride) * height, IPC_CREAT | 0600);
+    if (shmid == -1) {
+        return cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    }
+    void* addr = shmat(shmid, NULL, 0);
+    if (addr == (void*)-1) {
+        shmctl(shmid, IPC_RMID, NULL);
+        return cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    }
+
+    auto conn = getConnection().getConnection();
+    const xcb_shm_seg_t seg = getConnection().generate_id();
+    xcb_generic_error_t* error = xcb_request_check(conn, xcb_shm_attach_checked(conn, seg, shmid, 1));
+    /* The segment goes away once both sides detached */
+    shmctl(shmid, IPC_RMID, NULL);
+    if (error) {
+        /* The server can't see our memory, don't try again */
+        log_warn("MIT-SHM attach failed, falling back to plain image surfaces");
+        Manager::get().x.caps.have_shm = false;
+        p_delete(&error);
+        shmdt(addr);
+        return cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    }
+
+    cairo_surface_t* surface = cairo_image_surface_create_for_data(
+      static_cast<unsigned char*>(addr), CAIRO_FORMAT_ARGB32, width, height, stride);
+    cairo_surface_set_user_data(surface, &shm_key, new shm_segment{seg, addr}, shm_segment_destroy);
+    return surface;
+}
+
+cairo_surface_t* draw_shm_surface_create(int width, int height) {
+    return MemStats::track_image(shm_surface_create(width, height), MemStats::Image::Shm);
+}
+
+/** Copy a surface created by draw_shm_surface_create() to a drawable.
+ * \param surface The surface.
+ * \param dst The destination drawable, with the default depth.
+ * \param dst_pos Where to put the surface.
+ * \return false if the surface is not shared with the X server.
+ */
+bool draw_shm_put(cairo_surface_t* surface, xcb_drawable_t dst, point dst_pos) {
+    return draw_shm_put(surface,
+                        dst,
+                        {{0, 0},
+                         uint16_t(cairo_image_surface_get_width(surface)),
+                         uint16_t(cairo_image_surface_get_height(surface))},
+                        dst_pos);
+}
+
+/** Copy a part of a surface created by draw_shm_surface_create() to a drawable.
+ * \param surface The surface.
+ * \param dst The destination drawable, with the default depth.
+ * \param src The part of the surface to copy.
+ * \param dst_pos Where to put that part.
+ * \return false if the surface is not shared with the X server.
+ */
+bool draw_shm_put(cairo_surface_t* surface, xcb_drawable_t dst, area_t src, point dst_pos) {
+    return draw_shm_put(surface, dst, std::span(&src, 1), dst_pos - src.top_left);
+}
+
+/** Copy parts of a surface created by draw_shm_surface_create() to a drawable,
+ * waiting for the server only once.
+ * \param surface The surface.
+ * \param dst The destination drawable, with the default depth.
+ * \param srcs The parts of the surface to copy.
+ * \param offset Where the top left corner of the surface goes, every part is
+ *   put at its own position moved by this.
+ * \return false if the surface is not shared with the X server.
+ */
+bool draw_shm_put(cairo_surface_t* surface,
+                  xcb_drawable_t dst,
+                  std::span<const area_t> srcs,
+                  point offset) {
+    auto segment = static_cast<shm_segment*>(cairo_surface_get_user_data(surface, &shm_key));
+    if (!segment) {
+        return false;
+    }
+
+    cairo_surface_flush(surface);
+    const int width = cairo_image_surface_get_width(surface);
+    const int height = cairo_image_surface_get_height(surface);
+    const int stride = cairo_image_surface_get_stride(surface);
+    auto conn = getConnection().getConnection();
+    std::vector<xcb_void_cookie_t> cookies;
+    cookies.reserve(srcs.size());
+    for (const auto& src : srcs) {
+        cookies.push_back(xcb_shm_put_image_checked(conn,
+                                                    dst,
+                                                    Manager::get().gc,
+                                                    stride / 4,
+                                                    height,
+                                                    src.left(),
+                                                    src.top(),
+                                                    std::min<int>(src.width, width - src.left()),
+                                                    std::min<int>(src.height, height - src.top()),
+                                                    src.left() + offset.x,
+                                                    src.top() + offset.y,
+                                                    Manager::get().default_depth,
+                                                    XCB_IMAGE_FORMAT_Z_PIXMAP,
+                                                    0,
+                                                    segment->seg,
+                                                    0));
+    }
+    /* Wait for the server to be done reading, Lua may draw again right after.
+     * The first check waits for all the requests, the others find their
+     * answer already there. */
+    bool ok = true;
+    for (auto cookie : cookies) {
+        if (xcb_generic_error_t* error = xcb_request_check(conn, cookie)) {
+            p_delete(&error);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static area_t area_union(area_t a, area_t b) {
+    const int left = std::min(a.left(), b.left());
+    const int top = std::min(a.top(), b.top());
+    return {
+      {left, top},
+      uint16_t(std::max(a.right(), b.right()) - left),
+      uint16_t(std::max(a.bottom(), b.bottom()) - top)
+    };
+}
+
+static size_t area_size(area_t a) { return size_t(a.width) * a.height; }
+
+/** Add a rectangle to a region.
+ * \param area The rectangle.
+ */
+void region_t::add(area_t area) {
+    if (area.width == 0 || area.height == 0) {
+        return;
+    }
+
+    /* Merge with any rectangle where that doesn't copy much more, until none is left */
+    for (size_t i = 0; i < _rects.size();) {
+        const area_t merged = area_union(_rects[i], area);
+        if (area_size(merged) <= area_size(_rects[i]) + area_size(area)) {
+            area = merged;
+            _rects.erase(_rects.begin() + i);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    _rects.push_back(area);
+
+    if (_rects.size() > max_rects) {
+        area_t bounds = _rects[0];
+        for (const auto& r : _rects) {
+            bounds = area_union(bounds, r);
+        }
+        _rects.assign(1, bounds);
+    }
+}
+
 void draw_test_cairo_xcb(void) {
     xcb_pixmap_t pixmap = getConnection().generate_id();
     getConnection().create_pixmap(
@@ -27,6 +27,8 @@
 #include <cairo.h>
 #include <glib.h> /* for GError */
 #include <memory>
+#include <span>
+#include <vector>
 
 /* Forward definition */
 typedef struct _GdkPixbuf GdkPixbuf;
@@ -66,11 +68,28 @@ struct area_t {
     point bottom_right() const { return {top_left.x + width, top_left.y + height}; }
 
     bool inside(point p) const {
-        return (left() > p.x || right() <= p.x) && (top() > p.y || bottom() <= p.y);
+        return left() <= p.x && p.x < right() && top() <= p.y && p.y < bottom();
     }
     operator XCB::Rect() const { return {(int16_t)left(), (int16_t)top(), width, height}; }
 };
 
+/** A set of rectangles covering a damaged area.
+ * Rectangles are merged when their bounding box isn't bigger than both of
+ * them, so that few of them have to be copied.
+ */
+class region_t {
+  public:
+    void add(area_t area);
+    void clear() { _rects.clear(); }
+    bool empty() const { return _rects.empty(); }
+    const std::vector<area_t>& rects() const { return _rects; }
+
+  private:
+    /** Past this, the region is collapsed into its bounding box */
+    static constexpr size_t max_rects = 8;
+    std::vector<area_t> _rects;
+};
+
 struct CairoDeleter {
     void operator()(cairo_surface_t* ptr) const { cairo_surface_destroy(ptr); }
 };
@@ -81,6 +100,13 @@ cairo_surface_t* draw_surface_from_data(int width, int height, uint32_t* data);
 cairo_surface_t* draw_dup_image_surface(cairo_surface_t* surface);
 cairo_surface_t* draw_load_image(lua_State* L, const char* path, GError** error);
 cairo_surface_t* draw_surface_from_pixbuf(GdkPixbuf* buf);
+cairo_surface_t* draw_shm_surface_create(int width, int height);
+bool draw_shm_put(cairo_surface_t* surface, xcb_drawable_t dst, point dst_pos);
+bool draw_shm_put(cairo_surface_t* surface, xcb_drawable_t dst, area_t src, point dst_pos);
+bool draw_shm_put(cairo_surface_t* surface,
+                  xcb_drawable_t dst,
+                  std::span<const area_t> srcs,
+                  point offset);
 
 xcb_visualtype_t* draw_find_visual(const xcb_screen_t* s, xcb_visualid_t visual);
 xcb_visualtype_t* draw_default_visual(const xcb_screen_t* s);
@@ -22,13 +22,16 @@
 #include "event.h"
 
 #include "awesome.h"
+#include "capture.h"
 #include "common/atoms.h"
 #include "common/xembed.h"
 #include "common/xutil.h"
 #include "ewmh.h"
 #include "globalconf.h"
 #include "keygrabber.h"
+#include "keyset.h"
 #include "luaa.h"
+#include "mouse.h"
 #include "mousegrabber.h"
 #include "objects/client.h"
 #include "objects/drawin.h"
@@ -39,11 +42,14 @@
 #include "objects/tag.h"
 #include "property.h"
 #include "systray.h"
+#include "trace.h"
 #include "xkb.h"
 #include "xwindow.h"
 
 #include <map>
 #include <set>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include <xcb/randr.h>
 #include <xcb/shape.h>
@@ -63,46 +69,57 @@
 #undef explicit
 #include <xcb/xfixes.h>
 
-#define DO_EVENT_HOOK_CALLBACK(type, xcbtype, xcbeventprefix, arraytype, match) \
-    static void event_##xcbtype##_callback(xcb_##xcbtype##_press_event_t* ev,   \
-                                           const arraytype& arr,                \
-                                           lua_State* L,                        \
-                                           int oud,                             \
-                                           int nargs,                           \
-                                           void* data) {                        \
-        int abs_oud = oud < 0 ? ((lua_gettop(L) + 1) + oud) : oud;              \
-        int item_matching = 0;                                                  \
-        for (auto* item : arr)                                                  \
-            if (match(ev, item, data)) {                                        \
-                if (oud)                                                        \
-                    luaA_object_push_item(L, abs_oud, item);                    \
-                else                                                            \
-                    luaA_object_push(L, item);                                  \
-                item_matching++;                                                \
-            }                                                                   \
-        for (; item_matching > 0; item_matching--) {                            \
-            switch (ev->response_type) {                                        \
-            case xcbeventprefix##_PRESS:                                        \
-                for (int i = 0; i < nargs; i++)                                 \
-                    lua_pushvalue(L, -nargs - item_matching);                   \
-                luaA_object_emit_signal(L, -nargs - 1, "press", nargs);         \
-                break;                                                          \
-            case xcbeventprefix##_RELEASE:                                      \
-                for (int i = 0; i < nargs; i++)                                 \
-                    lua_pushvalue(L, -nargs - item_matching);                   \
-                luaA_object_emit_signal(L, -nargs - 1, "release", nargs);       \
-                break;                                                          \
-            }                                                                   \
-            lua_pop(L, 1);                                                      \
-        }                                                                       \
-        lua_pop(L, nargs);                                                      \
+#define DO_EVENT_HOOK_CALLBACK(type, xcbtype, xcbeventprefix, arraytype, candidates, match) \
+    static void event_##xcbtype##_callback(xcb_##xcbtype##_press_event_t* ev,               \
+                                           arraytype& arr,                                  \
+                                           lua_State* L,                                    \
+                                           int oud,                                         \
+                                           int nargs,                                       \
+                                           void* data) {                                    \
+        int abs_oud = oud < 0 ? ((lua_gettop(L) + 1) + oud) : oud;                          \
+        int item_matching = 0;                                                              \
+        for (auto* item : candidates(ev, arr, data))                                        \
+            if (match(ev, item, data)) {                                                    \
+                if (oud)                                                                    \
+                    luaA_object_push_item(L, abs_oud, item);                                \
+                else                                                                        \
+                    luaA_object_push(L, item);                                              \
+                item_matching++;                                                            \
+            }                                                                               \
+        for (; item_matching > 0; item_matching--) {                                        \
+            switch (ev->response_type) {                                                    \
+            case xcbeventprefix##_PRESS:                                                    \
+                for (int i = 0; i < nargs; i++)                                             \
+                    lua_pushvalue(L, -nargs - item_matching);                               \
+                luaA_object_emit_signal(L, -nargs - 1, "press"_sig, nargs);                 \
+                break;                                                                      \
+            case xcbeventprefix##_RELEASE:                                                  \
+                for (int i = 0; i < nargs; i++)                                             \
+                    lua_pushvalue(L, -nargs - item_matching);                               \
+                luaA_object_emit_signal(L, -nargs - 1, "release"_sig, nargs);               \
+                break;                                                                      \
+            }                                                                               \
+            lua_pop(L, 1);                                                                  \
+        }                                                                                   \
+        lua_pop(L, nargs);                                                                  \
     }
 
+/** Get the key bindings which can match an event from the array index */
+static const std::vector<keyb_t*>& event_key_candidates(xcb_key_press_event_t* ev,
+                                                        key_array_t& keys,
+                                                        void* data) {
+    return keys.index.lookup(keys, ev->detail, *(xcb_keysym_t*)data, ev->state);
+}
+
+static const std::vector<button_t*>& event_button_candidates(xcb_button_press_event_t*,
+                                                             const std::vector<button_t*>& buttons,
+                                                             void*) {
+    return buttons;
+}
+
 static bool event_key_match(xcb_key_press_event_t* ev, keyb_t* k, void* data) {
     assert(data);
-    xcb_keysym_t keysym = *(xcb_keysym_t*)data;
-    return (((k->keycode && ev->detail == k->keycode) || (k->keysym && keysym == k->keysym)) &&
-            (k->modifiers == XCB_BUTTON_MASK_ANY || k->modifiers == ev->state));
+    return k->matches(ev->detail, *(xcb_keysym_t*)data, ev->state);
 }
 
 static bool event_button_match(xcb_button_press_event_t* ev, button_t* b, void* data) {
@@ -110,8 +127,13 @@ static bool event_button_match(xcb_button_press_event_t* ev, button_t* b, void*
             (b->modifiers() == XCB_BUTTON_MASK_ANY || b->modifiers() == ev->state));
 }
 
-DO_EVENT_HOOK_CALLBACK(button_t, button, XCB_BUTTON, std::vector<button_t*>, event_button_match)
-DO_EVENT_HOOK_CALLBACK(keyb_t, key, XCB_KEY, std::vector<keyb_t*>, event_key_match)
+DO_EVENT_HOOK_CALLBACK(button_t,
+                       button,
+                       XCB_BUTTON,
+                       const std::vector<button_t*>,
+                       event_button_candidates,
+                       event_button_match)
+DO_EVENT_HOOK_CALLBACK(keyb_t, key, XCB_KEY, key_array_t, event_key_candidates, event_key_match)
 
 /** Handle an event with mouse grabber if needed
  * \param x The x coordinate.
@@ -120,6 +142,9 @@ DO_EVENT_HOOK_CALLBACK(keyb_t, key, XCB_KEY, std::vector<keyb_t*>, event_key_mat
  * \return True if the event was handled.
  */
 static bool event_handle_mousegrabber(int x, int y, uint16_t mask) {
+    if (mousegrabber_move_resize_handle(x, y, mask)) {
+        return true;
+    }
     if (Manager::get().mousegrabber) {
         lua_State* L = globalconf_get_lua_State();
         mousegrabber_handleevent(L, x, y, mask);
@@ -144,13 +169,18 @@ static bool event_handle_mousegrabber(int x, int y, uint16_t mask) {
  * \param ev The event to handle.
  */
 static void event_emit_button(lua_State* L, xcb_button_press_event_t* ev) {
-    const char* name;
+    SignalId name;
     switch (XCB_EVENT_RESPONSE_TYPE(ev)) {
-    case XCB_BUTTON_PRESS: name = "button::press"; break;
-    case XCB_BUTTON_RELEASE: name = "button::release"; break;
+    case XCB_BUTTON_PRESS: name = "button::press"_sig; break;
+    case XCB_BUTTON_RELEASE: name = "button::release"_sig; break;
     default: log_fatal("Invalid event type");
     }
 
+    /* Don't build the modifiers table for nothing */
+    if (!luaA_object_has_listeners(L, -1, name)) {
+        return;
+    }
+
     /* Push the event's info */
     lua_pushinteger(L, ev->event_x);
     lua_pushinteger(L, ev->event_y);
@@ -180,6 +210,7 @@ static void event_handle_button(xcb_button_press_event_t* ev) {
         } else {
             state &= ~change;
         }
+        mouse_pointer_seen(ev->root, ev->same_screen, ev->root_x, ev->root_y, state);
         if (event_handle_mousegrabber(ev->root_x, ev->root_y, state)) {
             return;
         }
@@ -370,6 +401,7 @@ static void event_handle_configurerequest(xcb_configure_request_event_t* ev) {
         }
 
         c->got_configure_request = true;
+        client_need_refresh(c);
 
         /* Request the changes to be applied */
         luaA_object_push(L, c);
@@ -395,7 +427,7 @@ static void event_handle_configurerequest(xcb_configure_request_event_t* ev) {
         lua_pushinteger(L, geometry.height);
         lua_rawset(L, -3);
 
-        luaA_object_emit_signal(L, -3, "request::geometry", 2);
+        luaA_object_emit_signal(L, -3, "request::geometry"_sig, 2);
         lua_pop(L, 1);
     } else if (std::find_if(Manager::get().embedded.begin(),
                             Manager::get().embedded.end(),
@@ -475,7 +507,7 @@ void event_drawable_under_mouse(lua_State* L, int ud) {
     if (Manager::get().drawable_under_mouse != NULL) {
         /* Emit leave on previous drawable */
         luaA_object_push(L, Manager::get().drawable_under_mouse);
-        luaA_object_emit_signal(L, -1, "mouse::leave", 0);
+        luaA_object_emit_signal(L, -1, "mouse::leave"_sig, 0);
         lua_pop(L, 1);
 
         /* Unref the previous drawable */
@@ -487,7 +519,7 @@ void event_drawable_under_mouse(lua_State* L, int ud) {
         Manager::get().drawable_under_mouse = (drawable_t*)d;
 
         /* Emit enter */
-        luaA_object_emit_signal(L, ud, "mouse::enter", 0);
+        luaA_object_emit_signal(L, ud, "mouse::enter"_sig, 0);
     }
 }
 
@@ -500,6 +532,7 @@ static void event_handle_motionnotify(xcb_motion_notify_event_t* ev) {
     client* c;
 
     Manager::get().x.update_timestamp(ev);
+    mouse_pointer_seen(ev->root, ev->same_screen, ev->root_x, ev->root_y, ev->state);
 
     if (event_handle_mousegrabber(ev->root_x, ev->root_y, ev->state)) {
         return;
@@ -507,9 +540,11 @@ static void event_handle_motionnotify(xcb_motion_notify_event_t* ev) {
 
     if ((c = client_getbyframewin(ev->event))) {
         luaA_object_push(L, c);
-        lua_pushinteger(L, ev->event_x);
-        lua_pushinteger(L, ev->event_y);
-        luaA_object_emit_signal(L, -3, "mouse::move", 2);
+        if (luaA_object_has_listeners(L, -1, "mouse::move"_sig)) {
+            lua_pushinteger(L, ev->event_x);
+            lua_pushinteger(L, ev->event_y);
+            luaA_object_emit_signal(L, -3, "mouse::move"_sig, 2);
+        }
 
         /* now check if a titlebar was "hit" */
         point pt{ev->event_x, ev->event_y};
@@ -517,9 +552,11 @@ static void event_handle_motionnotify(xcb_motion_notify_event_t* ev) {
         if (d) {
             luaA_object_push_item(L, -1, d);
             event_drawable_under_mouse(L, -1);
-            lua_pushinteger(L, pt.x);
-            lua_pushinteger(L, pt.y);
-            luaA_object_emit_signal(L, -3, "mouse::move", 2);
+            if (luaA_object_has_listeners(L, -1, "mouse::move"_sig)) {
+                lua_pushinteger(L, pt.x);
+                lua_pushinteger(L, pt.y);
+                luaA_object_emit_signal(L, -3, "mouse::move"_sig, 2);
+            }
             lua_pop(L, 1);
         }
         lua_pop(L, 1);
@@ -529,9 +566,11 @@ static void event_handle_motionnotify(xcb_motion_notify_event_t* ev) {
         luaA_object_push(L, w);
         luaA_object_push_item(L, -1, w->drawable);
         event_drawable_under_mouse(L, -1);
-        lua_pushinteger(L, ev->event_x);
-        lua_pushinteger(L, ev->event_y);
-        luaA_object_emit_signal(L, -3, "mouse::move", 2);
+        if (luaA_object_has_listeners(L, -1, "mouse::move"_sig)) {
+            lua_pushinteger(L, ev->event_x);
+            lua_pushinteger(L, ev->event_y);
+            luaA_object_emit_signal(L, -3, "mouse::move"_sig, 2);
+        }
         lua_pop(L, 2);
     }
 }
@@ -544,6 +583,8 @@ static void event_handle_leavenotify(xcb_leave_notify_event_t* ev) {
     client* c;
 
     Manager::get().x.update_timestamp(ev);
+    /* Bit 1 of same_screen_focus is same-screen, bit 0 is focus */
+    mouse_pointer_seen(ev->root, ev->same_screen_focus & 0x02, ev->root_x, ev->root_y, ev->state);
 
     /*
      * Ignore events with non-normal modes. Those are because a grab
@@ -569,7 +610,7 @@ static void event_handle_leavenotify(xcb_leave_notify_event_t* ev) {
          */
         if (ev->detail != XCB_NOTIFY_DETAIL_INFERIOR) {
             luaA_object_push(L, c);
-            luaA_object_emit_signal(L, -1, "mouse::leave", 0);
+            luaA_object_emit_signal(L, -1, "mouse::leave"_sig, 0);
             lua_pop(L, 1);
         }
     } else if (ev->detail != XCB_NOTIFY_DETAIL_INFERIOR) {
@@ -592,6 +633,8 @@ static void event_handle_enternotify(xcb_enter_notify_event_t* ev) {
     drawin_t* drawin;
 
     Manager::get().x.update_timestamp(ev);
+    /* Bit 1 of same_screen_focus is same-screen, bit 0 is focus */
+    mouse_pointer_seen(ev->root, ev->same_screen_focus & 0x02, ev->root_x, ev->root_y, ev->state);
 
     /*
      * Ignore events with non-normal modes. Those are because a grab
@@ -625,7 +668,7 @@ static void event_handle_enternotify(xcb_enter_notify_event_t* ev) {
          * other details mean that the client itself was really left.
          */
         if (ev->detail != XCB_NOTIFY_DETAIL_INFERIOR) {
-            luaA_object_emit_signal(L, -1, "mouse::enter", 0);
+            luaA_object_emit_signal(L, -1, "mouse::enter"_sig, 0);
         }
 
         drawable_t* d = client_get_drawable(c, {ev->event_x, ev->event_y});
@@ -703,8 +746,16 @@ static void event_handle_key(xcb_key_press_event_t* ev) {
     lua_State* L = globalconf_get_lua_State();
     Manager::get().x.update_timestamp(ev);
 
+    const bool press = XCB_EVENT_RESPONSE_TYPE(ev) == XCB_KEY_PRESS;
+    xcb_keysym_t keysym = 0;
+    if (press) {
+        Profiler::input_key_begin();
+    }
+
     if (Manager::get().keygrabber) {
-        if (keygrabber_handlekpress(L, ev)) {
+        if (keygrabber_handle_chord(L, ev)) {
+            /* Taken by a chord */
+        } else if (keygrabber_handlekpress(L, ev)) {
             lua_rawgeti(L, LUA_REGISTRYINDEX, Manager::get().keygrabber.idx.idx);
 
             if (!Lua::dofunction(L, 3, 0)) {
@@ -714,15 +765,21 @@ static void event_handle_key(xcb_key_press_event_t* ev) {
         }
     } else {
         /* get keysym ignoring all modifiers */
-        xcb_keysym_t keysym = Manager::get().input.keysyms.get_keysym(ev->detail, 0);
+        keysym = Manager::get().input.keysyms.get_keysym(ev->detail, 0);
         client* c;
         if ((c = client_getbywin(ev->event)) || (c = client_getbynofocuswin(ev->event))) {
             luaA_object_push(L, c);
+            KeySet::dispatch(L, c->key_set, ev, keysym, c);
             event_key_callback(ev, c->keys, L, -1, 1, &keysym);
         } else {
+            KeySet::dispatch(L, Manager::get().key_set, ev, keysym, nullptr);
             event_key_callback(ev, Manager::get().keys, L, 0, 0, &keysym);
         }
     }
+
+    if (press) {
+        Profiler::input_key_end(ev->detail, keysym);
+    }
 }
 
 /** The map request event handler.
@@ -750,6 +807,7 @@ static void event_handle_maprequest(xcb_map_request_event_t* ev) {
          * property. Let's simulate the XEMBED_MAPPED bit.
          */
         em->info.flags |= static_cast<uint32_t>(XEmbed::InfoFlags::MAPPED);
+        em->placed = false;
         Lua::systray_invalidate();
     } else if ((c = client_getbywin(ev->window))) {
         /* Check that it may be visible, but not asked to be hidden */
@@ -763,12 +821,14 @@ static void event_handle_maprequest(xcb_map_request_event_t* ev) {
         }
     } else {
         auto geom_c = getConnection().get_geometry_unchecked(ev->window);
+        auto cookies = client_manage_prefetch(ev->window);
         auto geom_r = getConnection().get_geometry_reply(geom_c);
         if (!geom_r) {
+            client_manage_discard(cookies);
             return;
         }
 
-        client_manage(ev->window, geom_r.get(), wa_r.get());
+        client_manage(ev->window, geom_r.get(), wa_r.get(), cookies);
     }
 }
 
@@ -815,19 +875,31 @@ static void event_handle_randr_output_change_notify(xcb_randr_notify_event_t* ev
     if (ev->subCode != XCB_RANDR_NOTIFY_OUTPUT_CHANGE) {
         return;
     }
+    /* The name of an output never changes, hotplugging one does not need a
+     * round trip once we know it */
+    static std::unordered_map<xcb_randr_output_t, std::string> output_names;
+
     xcb_randr_output_t output = ev->u.oc.output;
     uint8_t connection = ev->u.oc.connection;
     const char* connection_str = NULL;
     lua_State* L = globalconf_get_lua_State();
 
-    /* The following explicitly uses XCB_CURRENT_TIME since we want to know
-     * the final state of the connection. There could be more notification
-     * events underway and using some "old" timestamp causes problems.
-     */
-    auto info = getConnection().randr().get_output_info_reply(
-      getConnection().randr().get_output_info_unchecked(output, XCB_CURRENT_TIME));
-    if (!info) {
-        return;
+    auto name = output_names.find(output);
+    if (name == output_names.end()) {
+        /* The following explicitly uses XCB_CURRENT_TIME since we want to know
+         * the final state of the connection. There could be more notification
+         * events underway and using some "old" timestamp causes problems.
+         */
+        auto info = getConnection().randr().get_output_info_reply(
+          getConnection().randr().get_output_info_unchecked(output, XCB_CURRENT_TIME));
+        if (!info) {
+            return;
+        }
+        name = output_names
+                 .emplace(output,
+                          std::string{(char*)xcb_randr_get_output_info_name(info.get()),
+                                      (size_t)xcb_randr_get_output_info_name_length(info.get())})
+                 .first;
     }
 
     switch (connection) {
@@ -836,14 +908,13 @@ static void event_handle_randr_output_change_notify(xcb_randr_notify_event_t* ev
     default: connection_str = "Unknown"; break;
     }
 
-    lua_pushlstring(L,
-                    (char*)xcb_randr_get_output_info_name(info.get()),
-                    xcb_randr_get_output_info_name_length(info.get()));
+    lua_pushlstring(L, name->second.data(), name->second.size());
     lua_pushstring(L, connection_str);
-    signal_object_emit(L, &Lua::global_signals, "screen::change", 2);
+    signal_object_emit(L, &Lua::global_signals, "screen::change"_sig, 2);
 
-    /* The docs for RRSetOutputPrimary say we get this signal */
-    screen_update_primary();
+    /* The docs for RRSetOutputPrimary say we get this signal. The refresh
+     * updates the primary screen together with everything else. */
+    screen_schedule_refresh();
 }
 
 /** The shape notify event handler.
@@ -857,10 +928,10 @@ static void event_handle_shape_notify(xcb_shape_notify_event_t* ev) {
     lua_State* L = globalconf_get_lua_State();
     luaA_object_push(L, c);
     if (ev->shape_kind == XCB_SHAPE_SK_BOUNDING) {
-        luaA_object_emit_signal(L, -1, "property::shape_client_bounding", 0);
+        luaA_object_emit_signal(L, -1, "property::shape_client_bounding"_sig, 0);
     }
     if (ev->shape_kind == XCB_SHAPE_SK_CLIP) {
-        luaA_object_emit_signal(L, -1, "property::shape_client_clip", 0);
+        luaA_object_emit_signal(L, -1, "property::shape_client_clip"_sig, 0);
     }
     lua_pop(L, 1);
 }
@@ -967,24 +1038,14 @@ static bool should_ignore(xcb_generic_event_t* event) {
 
     /* Remove completed sequences */
     uint32_t sequence = event->full_sequence;
-    while (Manager::get().ignore_enter_leave_events.size() > 0) {
-        uint32_t end = Manager::get().ignore_enter_leave_events[0].end.sequence;
-        /* Do if (end >= sequence) break;, but handle wrap-around: The above is
-         * equivalent to end-sequence > 0 (assuming unlimited precision). With
-         * int32_t, this would mean that the sign bit is cleared, which means:
-         */
-        if (end - sequence < UINT32_MAX / 2) {
-            break;
-        }
-        Manager::get().ignore_enter_leave_events.erase(
-          Manager::get().ignore_enter_leave_events.begin());
-    }
+    auto& ignored = Manager::get().ignore_enter_leave_events;
+    ignored.prune(sequence);
 
     /* Check if this event should be ignored */
     if ((response_type == XCB_ENTER_NOTIFY || response_type == XCB_LEAVE_NOTIFY) &&
-        Manager::get().ignore_enter_leave_events.size() > 0) {
-        uint32_t begin = Manager::get().ignore_enter_leave_events[0].begin.sequence;
-        uint32_t end = Manager::get().ignore_enter_leave_events[0].end.sequence;
+        !ignored.empty()) {
+        uint32_t begin = ignored.front().begin.sequence;
+        uint32_t end = ignored.front().end.sequence;
         if (sequence >= begin && sequence <= end) {
             return true;
         }
@@ -1005,6 +1066,8 @@ void event_handle(xcb_generic_event_t* event) {
         return;
     }
 
+    Trace::Scope span(Trace::Category::Event, xcb_event_get_label(response_type), response_type);
+
     if (response_type == 0) {
         /* This is an error, not a event */
         xerror((xcb_generic_error_t*)event);
@@ -1046,6 +1109,7 @@ void event_handle(xcb_generic_event_t* event) {
     EXTENSION_EVENT(shape, XCB_SHAPE_NOTIFY, event_handle_shape_notify);
     EXTENSION_EVENT(xkb, 0, event_handle_xkb_notify);
     EXTENSION_EVENT(xfixes, XCB_XFIXES_SELECTION_NOTIFY, event_handle_xfixes_selection_notify);
+    EXTENSION_EVENT(damage, XCB_DAMAGE_NOTIFY, Capture::handle_damage_notify);
 #undef EXTENSION_EVENT
 }
 
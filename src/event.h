@@ -21,7 +21,9 @@
 #pragma once
 
 #include "banning.h"
+#include "ewmh.h"
 #include "globalconf.h"
+#include "profiler.h"
 #include "stack.h"
 
 #include <xcb/xcb.h>
@@ -34,19 +36,28 @@ void emit_refresh(void);
 /* objects/drawin.c */
 void drawin_refresh(void);
 
+/* objects/drawable.c */
+void drawable_flush_damage(void);
+
 /* objects/client.c */
 void client_refresh(void);
 void client_focus_refresh(void);
 void client_destroy_later(void);
 
 static inline int awesome_refresh(void) {
-    Lua::emit_refresh();
-    drawin_refresh();
-    client_refresh();
-    banning_refresh();
-    stack_refresh();
-    client_destroy_later();
-    return Manager::get().x.connection.flush();
+    using Profiler::Phase;
+    Profiler::measure(Phase::LuaRefresh, Lua::emit_refresh);
+    Profiler::measure(Phase::Drawin, drawin_refresh);
+    Profiler::measure(Phase::Client, client_refresh);
+    Profiler::measure(Phase::Banning, banning_refresh);
+    Profiler::measure(Phase::Stack, stack_refresh);
+    Profiler::measure(Phase::Ewmh, ewmh_refresh);
+    Profiler::measure(Phase::DestroyLater, client_destroy_later);
+    Profiler::measure(Phase::Damage, drawable_flush_damage);
+    const int ret =
+      Profiler::measure(Phase::Flush, [] { return Manager::get().x.connection.flush(); });
+    Profiler::input_flushed();
+    return ret;
 }
 
 void event_init(void);
@@ -0,0 +1,236 @@
+/*
+ * eventlog.cpp - X event recorder and replayer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "eventlog.h"
+
+#include "common/util.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <glib.h>
+#include <string>
+#include <string_view>
+
+namespace EventLog {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::string_view magic = "AWEVLOG1";
+/** The size of an event on the wire, without the data of generic events */
+constexpr size_t core_size = 32;
+/** xcb stores the full sequence number after the core, generic events
+ * continue after it */
+constexpr size_t extra_offset = core_size + sizeof(uint32_t);
+
+FILE* file = nullptr;
+bool piped = false;
+Clock::time_point last;
+std::string buffer;
+
+bool is_generic(uint8_t response_type) {
+    return (response_type & 0x7f) == XCB_GE_GENERIC;
+}
+
+std::string_view extension(std::string_view path) {
+    const auto dot = path.rfind('.');
+    return dot == std::string_view::npos ? std::string_view{} : path.substr(dot);
+}
+
+/** Open a file for reading or writing, through gzip for `.gz` files */
+FILE* open_file(const char* path, bool write, bool& through_gzip) {
+    through_gzip = extension(path) == ".gz";
+    if (!through_gzip) {
+        return fopen(path, write ? "w" : "r");
+    }
+    char* quoted = g_shell_quote(path);
+    const std::string command =
+      write ? std::string("gzip -c > ") + quoted : std::string("gzip -dc ") + quoted;
+    g_free(quoted);
+    return popen(command.c_str(), write ? "w" : "r");
+}
+
+void close_file(FILE* f, bool through_gzip) {
+    if (through_gzip) {
+        pclose(f);
+    } else {
+        fclose(f);
+    }
+}
+
+void put_varint(uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        buffer += char(value ? byte | 0x80 : byte);
+    } while (value);
+}
+
+bool get_varint(FILE* f, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        const int byte = getc(f);
+        if (byte == EOF) {
+            return false;
+        }
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void put_delay() {
+    const auto now = Clock::now();
+    put_varint(std::chrono::duration_cast<std::chrono::microseconds>(now - last).count());
+    last = now;
+}
+
+} // namespace
+
+bool start(const char* path) {
+    stop();
+    file = open_file(path, true, piped);
+    if (!file) {
+        log_warn("Cannot open event recording {}", path);
+        return false;
+    }
+    fwrite(magic.data(), 1, magic.size(), file);
+    last = Clock::now();
+    recording = true;
+    return true;
+}
+
+void record(const xcb_generic_event_t* event) {
+    auto bytes = reinterpret_cast<const uint8_t*>(event);
+    size_t size = core_size;
+    while (size > 0 && bytes[size - 1] == 0) {
+        size--;
+    }
+
+    put_delay();
+    /* 0 marks the end of a batch */
+    buffer += char(size + 1);
+    buffer.append(reinterpret_cast<const char*>(bytes), size);
+    if (is_generic(event->response_type)) {
+        auto ge = reinterpret_cast<const xcb_ge_generic_event_t*>(event);
+        buffer.append(reinterpret_cast<const char*>(bytes + extra_offset), ge->length * 4);
+    }
+}
+
+void end_batch() {
+    put_delay();
+    buffer += char(0);
+}
+
+void flush() {
+    if (!file || buffer.empty()) {
+        return;
+    }
+    fwrite(buffer.data(), 1, buffer.size(), file);
+    fflush(file);
+    buffer.clear();
+}
+
+void stop() {
+    if (!file) {
+        return;
+    }
+    flush();
+    close_file(file, piped);
+    file = nullptr;
+    recording = false;
+}
+
+Reader::~Reader() {
+    if (_file) {
+        close_file(_file, _piped);
+    }
+}
+
+bool Reader::open(const char* path) {
+    _file = open_file(path, false, _piped);
+    if (!_file) {
+        return false;
+    }
+    char header[magic.size()];
+    return fread(header, 1, sizeof(header), _file) == sizeof(header) &&
+           std::string_view(header, sizeof(header)) == magic;
+}
+
+bool Reader::next(XCB::event<xcb_generic_event_t>& event, std::chrono::microseconds& delay) {
+    event.reset();
+    uint64_t us;
+    const int tag = _file ? (get_varint(_file, us) ? getc(_file) : EOF) : EOF;
+    if (tag == EOF || size_t(tag) > core_size + 1) {
+        return false;
+    }
+    delay = std::chrono::microseconds(us);
+    if (tag == 0) {
+        return true;
+    }
+
+    uint8_t core[core_size] = {};
+    if (fread(core, 1, tag - 1, _file) != size_t(tag - 1)) {
+        return false;
+    }
+    const size_t extra =
+      is_generic(core[0]) ? reinterpret_cast<xcb_ge_generic_event_t*>(core)->length * 4 : 0;
+    auto bytes = static_cast<uint8_t*>(calloc(1, extra_offset + extra));
+    memcpy(bytes, core, core_size);
+    event.reset(reinterpret_cast<xcb_generic_event_t*>(bytes));
+    event->full_sequence = event->sequence;
+    return fread(bytes + extra_offset, 1, extra, _file) == extra;
+}
+
+/** Start recording the X events to a file.
+ *
+ * The events are recorded as they are read from the X server, before the
+ * redundant ones of a burst are dropped. A recording can be replayed with
+ * the `--replay-events` command line option, which reports how long the
+ * events took to be handled. Names ending in `.gz` are compressed with gzip.
+ * A recording that is being written is finished first. The
+ * `--record-events` command line option starts a recording at startup.
+ *
+ * @tparam string path The file to write to.
+ * @treturn boolean Whether the file could be opened.
+ * @staticfct event_record_start
+ * @see event_record_stop
+ */
+int luaA_event_record_start(lua_State* L) {
+    lua_pushboolean(L, start(luaL_checkstring(L, 1)));
+    return 1;
+}
+
+/** Stop recording the X events and finish the file.
+ *
+ * @staticfct event_record_stop
+ * @noreturn
+ * @see event_record_start
+ */
+int luaA_event_record_stop(lua_State*) {
+    stop();
+    return 0;
+}
+
+} // namespace EventLog
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,86 @@
+/*
+ * eventlog.h - X event recorder and replayer header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+#include "xcbcpp/xcb.h"
+
+#include <chrono>
+#include <cstdio>
+
+/** Raw X events written to a file, so that a session can be replayed.
+ *
+ * Every record holds the time since the previous one and the event with its
+ * trailing zero bytes left out. The end of every batch that the main loop
+ * handled in one go is recorded as well. Files whose name ends in `.gz` are
+ * piped through gzip.
+ */
+namespace EventLog {
+
+/** Whether events are being recorded; record() must not be called otherwise */
+inline bool recording = false;
+
+/** Start recording, a recording that is being written is finished first.
+ * \return Whether the file could be opened.
+ */
+bool start(const char* path);
+
+/** Record an event that was read from the X connection. */
+void record(const xcb_generic_event_t* event);
+
+/** Record that the events read so far were handled as one batch. */
+void end_batch();
+
+/** Write what was recorded so far. */
+void flush();
+
+/** Finish the recording, if any. */
+void stop();
+
+/** Reads the records of a file written by the recorder. */
+class Reader {
+  public:
+    Reader() = default;
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+    ~Reader();
+
+    /** Open a recording.
+     * \return False if it cannot be opened or is no recording.
+     */
+    bool open(const char* path);
+
+    /** Read the next record.
+     * \param event Set to the event, or to NULL at the end of a batch.
+     * \param delay Set to the time since the previous record.
+     * \return False at the end of the file.
+     */
+    bool next(XCB::event<xcb_generic_event_t>& event, std::chrono::microseconds& delay);
+
+  private:
+    FILE* _file = nullptr;
+    bool _piped = false;
+};
+
+int luaA_event_record_start(lua_State* L);
+int luaA_event_record_stop(lua_State* L);
+
+} // namespace EventLog
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -25,12 +25,18 @@
 #include "draw.h"
 #include "globalconf.h"
 #include "objects/client.h"
+#include "objects/screen.h"
 #include "objects/tag.h"
+#include "scratch.h"
 #include "xwindow.h"
 
+#include <algorithm>
+#include <optional>
+#include <span>
 #include <sys/types.h>
 #include <unistd.h>
 #include <xcb/xcb.h>
+#include <vector>
 #include <xcb/xcb_atom.h>
 
 #define _NET_WM_STATE_REMOVE 0
@@ -97,18 +103,56 @@ static int ewmh_update_net_active_window(lua_State* L) {
     return 0;
 }
 
+/** Root window client lists, published once per main loop iteration */
+static struct {
+    bool need_update = false;
+    /** The last value set on the root window */
+    std::optional<std::vector<xcb_window_t>> published;
+} net_client_list, net_client_list_stacking;
+
 static int ewmh_update_net_client_list(lua_State* L) {
-    xcb_window_t* wins = p_alloca(xcb_window_t, Manager::get().clients.size());
+    net_client_list.need_update = true;
+    return 0;
+}
+
+/** Set a client list property on the root window if it changed.
+ * \param list The list state.
+ * \param atom The property.
+ * \param clients The clients, in property order.
+ */
+static void ewmh_publish_client_list(decltype(net_client_list)& list,
+                                     xcb_atom_t atom,
+                                     const std::vector<client*>& clients) {
+    list.need_update = false;
+
+    Scratch::vector<xcb_window_t> wins;
+    wins.reserve(clients.size());
+    for (auto* c : clients) {
+        wins.push_back(c->window);
+    }
 
-    int n = 0;
-    for (auto* client : Manager::get().clients) {
-        wins[n++] = (client)->window;
+    if (list.published && std::ranges::equal(*list.published, wins)) {
+        return;
     }
 
     getConnection().replace_property(
-      Manager::get().screen->root, _NET_CLIENT_LIST, XCB_ATOM_WINDOW, std::span(wins, n));
+      Manager::get().screen->root, atom, XCB_ATOM_WINDOW, std::span{wins});
+    if (!list.published) {
+        list.published.emplace();
+    }
+    list.published->assign(wins.begin(), wins.end());
+}
 
-    return 0;
+/** Publish the client lists that changed since the last call.
+ */
+void ewmh_refresh(void) {
+    if (net_client_list.need_update) {
+        ewmh_publish_client_list(net_client_list, _NET_CLIENT_LIST, Manager::get().clients);
+    }
+    if (net_client_list_stacking.need_update) {
+        ewmh_publish_client_list(
+          net_client_list_stacking, _NET_CLIENT_LIST_STACKING, Manager::get().getStack());
+    }
 }
 
 static int ewmh_client_update_frame_extents(lua_State* L) {
@@ -221,7 +265,7 @@ static void ewmh_update_maximize(bool h, bool status, bool toggle) {
     lua_pushboolean(L, status);
     lua_settable(L, -3);
 
-    luaA_object_emit_signal(L, -3, "request::geometry", 2);
+    luaA_object_emit_signal(L, -3, "request::geometry"_sig, 2);
 }
 
 void ewmh_init_lua(void) {
@@ -258,17 +302,7 @@ void ewmh_init_lua(void) {
 
 /** Set the client list in stacking order, bottom to top.
  */
-void ewmh_update_net_client_list_stacking(void) {
-    size_t n = 0;
-    std::vector<xcb_window_t> wins(Manager::get().getStack().size());
-
-    for (auto* client : Manager::get().getStack()) {
-        wins[n++] = (client)->window;
-    }
-
-    getConnection().replace_property(
-      Manager::get().screen->root, _NET_CLIENT_LIST_STACKING, XCB_ATOM_WINDOW, std::span{wins});
-}
+void ewmh_update_net_client_list_stacking(void) { net_client_list_stacking.need_update = true; }
 
 void ewmh_update_net_numbers_of_desktop(void) {
     uint32_t count = Manager::get().tags.size();
@@ -377,15 +411,15 @@ static void ewmh_process_state_atom(client* c, xcb_atom_t state, int set) {
         if (set == _NET_WM_STATE_REMOVE) {
             lua_pushboolean(L, false);
             /*TODO v5: Add a context */
-            luaA_object_emit_signal(L, -2, "request::urgent", 1);
+            luaA_object_emit_signal(L, -2, "request::urgent"_sig, 1);
         } else if (set == _NET_WM_STATE_ADD) {
             lua_pushboolean(L, true);
             /*TODO v5: Add a context */
-            luaA_object_emit_signal(L, -2, "request::urgent", 1);
+            luaA_object_emit_signal(L, -2, "request::urgent"_sig, 1);
         } else if (set == _NET_WM_STATE_TOGGLE) {
             lua_pushboolean(L, !c->urgent);
             /*TODO v5: Add a context */
-            luaA_object_emit_signal(L, -2, "request::urgent", 1);
+            luaA_object_emit_signal(L, -2, "request::urgent"_sig, 1);
         }
     }
 
@@ -399,14 +433,14 @@ static void ewmh_process_desktop(client* c, uint32_t desktop) {
         luaA_object_push(L, c);
         lua_pushboolean(L, true);
         /*TODO v5: Move the context argument to arg1 */
-        luaA_object_emit_signal(L, -2, "request::tag", 1);
+        luaA_object_emit_signal(L, -2, "request::tag"_sig, 1);
         /* Pop the client, arguments are already popped */
         lua_pop(L, 1);
     } else if (idx >= 0 && idx < (int)Manager::get().tags.size()) {
         luaA_object_push(L, c);
         luaA_object_push(L, Manager::get().tags[idx].get());
         /*TODO v5: Move the context argument to arg1 */
-        luaA_object_emit_signal(L, -2, "request::tag", 1);
+        luaA_object_emit_signal(L, -2, "request::tag"_sig, 1);
         /* Pop the client, arguments are already popped */
         lua_pop(L, 1);
     }
@@ -421,7 +455,7 @@ int ewmh_process_client_message(xcb_client_message_event_t* ev) {
             lua_State* L = globalconf_get_lua_State();
             luaA_object_push(L, Manager::get().tags[idx].get());
             lua_pushstring(L, "ewmh");
-            luaA_object_emit_signal(L, -2, "request::select", 1);
+            luaA_object_emit_signal(L, -2, "request::select"_sig, 1);
             lua_pop(L, 1);
         }
     } else if (ev->type == _NET_CLOSE_WINDOW) {
@@ -451,7 +485,7 @@ int ewmh_process_client_message(xcb_client_message_event_t* ev) {
             lua_pushboolean(L, true);
             lua_settable(L, -3);
 
-            luaA_object_emit_signal(L, -3, "request::activate", 2);
+            luaA_object_emit_signal(L, -3, "request::activate"_sig, 2);
             lua_pop(L, 1);
         }
     }
@@ -513,28 +547,33 @@ void ewmh_update_window_type(xcb_window_t window, uint32_t type) {
     getConnection().replace_property(window, _NET_WM_WINDOW_TYPE, XCB_ATOM_ATOM, type);
 }
 
-void ewmh_client_check_hints(client* c) {
+/** Send the GetProperty requests which ewmh_client_check_hints() processes.
+ * \param window The client window.
+ * \return The cookies.
+ */
+ewmh_client_hints_cookies_t ewmh_client_check_hints_unchecked(xcb_window_t window) {
+    return {
+      getConnection().get_property_unchecked(
+        false, window, _NET_WM_DESKTOP, XCB_GET_PROPERTY_TYPE_ANY, 0, 1),
+      getConnection().get_property_unchecked(
+        false, window, _NET_WM_STATE, XCB_ATOM_ATOM, 0, UINT32_MAX),
+      getConnection().get_property_unchecked(
+        false, window, _NET_WM_WINDOW_TYPE, XCB_ATOM_ATOM, 0, UINT32_MAX),
+    };
+}
+
+void ewmh_client_check_hints(client* c, ewmh_client_hints_cookies_t cookies) {
     xcb_atom_t* state;
     void* data = NULL;
     bool is_h_max = false;
     bool is_v_max = false;
 
-    /* Send the GetProperty requests which will be processed later */
-    auto c0 = getConnection().get_property_unchecked(
-      false, c->window, _NET_WM_DESKTOP, XCB_GET_PROPERTY_TYPE_ANY, 0, 1);
-
-    auto c1 = getConnection().get_property_unchecked(
-      false, c->window, _NET_WM_STATE, XCB_ATOM_ATOM, 0, UINT32_MAX);
-
-    auto c2 = getConnection().get_property_unchecked(
-      false, c->window, _NET_WM_WINDOW_TYPE, XCB_ATOM_ATOM, 0, UINT32_MAX);
-
-    auto reply = getConnection().get_property_reply(c0);
+    auto reply = getConnection().get_property_reply(cookies.desktop);
     if (reply && reply->value_len && (data = xcb_get_property_value(reply.get()))) {
         ewmh_process_desktop(c, *(uint32_t*)data);
     }
 
-    reply = getConnection().get_property_reply(c1);
+    reply = getConnection().get_property_reply(cookies.state);
     if (reply && (data = xcb_get_property_value(reply.get()))) {
         state = reinterpret_cast<xcb_atom_t*>(data);
         for (int i = 0; i < xcb_get_property_value_length(reply.get()) / (int)sizeof(xcb_atom_t);
@@ -567,7 +606,7 @@ void ewmh_client_check_hints(client* c) {
         lua_pop(L, 1);
     }
 
-    reply = getConnection().get_property_reply(c2);
+    reply = getConnection().get_property_reply(cookies.window_type);
     if (reply && (data = xcb_get_property_value(reply.get()))) {
         c->has_NET_WM_WINDOW_TYPE = true;
         state = reinterpret_cast<xcb_atom_t*>(data);
@@ -594,15 +633,30 @@ void ewmh_client_check_hints(client* c) {
     }
 }
 
+/** Send request to get _NET_WM_STRUT_PARTIAL.
+ * \param window The client window.
+ * \return The cookie associated with the request.
+ */
+xcb_get_property_cookie_t ewmh_client_strut_unchecked(xcb_window_t window) {
+    return getConnection().get_property_unchecked(
+      false, window, _NET_WM_STRUT_PARTIAL, XCB_ATOM_CARDINAL, 0, 12);
+}
+
 /** Process the WM strut of a client.
  * \param c The client.
  */
 void ewmh_process_client_strut(client* c) {
+    ewmh_process_client_strut(c, ewmh_client_strut_unchecked(c->window));
+}
+
+/** Process the WM strut of a client.
+ * \param c The client.
+ * \param cookie Cookie returned by ewmh_client_strut_unchecked().
+ */
+void ewmh_process_client_strut(client* c, xcb_get_property_cookie_t cookie) {
     void* data;
 
-    xcb_get_property_cookie_t strut_q = getConnection().get_property_unchecked(
-      false, c->window, _NET_WM_STRUT_PARTIAL, XCB_ATOM_CARDINAL, 0, 12);
-    auto strut_r = getConnection().get_property_reply(strut_q);
+    auto strut_r = getConnection().get_property_reply(cookie);
 
     if (strut_r && strut_r->value_len && (data = xcb_get_property_value(strut_r.get()))) {
         auto strut = (uint32_t*)data;
@@ -625,10 +679,11 @@ void ewmh_process_client_strut(client* c) {
             c->strut.top_end_x = strut[9];
             c->strut.bottom_start_x = strut[10];
             c->strut.bottom_end_x = strut[11];
+            screen_strut_track(c);
 
             lua_State* L = globalconf_get_lua_State();
             luaA_object_push(L, c);
-            luaA_object_emit_signal(L, -1, "property::struts", 0);
+            luaA_object_emit_signal(L, -1, "property::struts"_sig, 0);
             lua_pop(L, 1);
         }
     }
@@ -643,56 +698,28 @@ xcb_get_property_cookie_t ewmh_window_icon_get_unchecked(xcb_window_t w) {
       false, w, _NET_WM_ICON, XCB_ATOM_CARDINAL, 0, UINT32_MAX);
 }
 
-static cairo_surface_t* ewmh_window_icon_from_reply_next(uint32_t** data, uint32_t* data_end) {
-    uint32_t width, height;
-    uint64_t data_len;
-    uint32_t* icon_data;
-
-    if (data_end - *data <= 2) {
-        return NULL;
-    }
-
-    width = (*data)[0];
-    height = (*data)[1];
-
-    /* Check that we have enough data, handling overflow */
-    data_len = width * (uint64_t)height;
-    if (width < 1 || height < 1 || data_len > (uint64_t)(data_end - *data) - 2) {
-        return NULL;
-    }
-
-    icon_data = *data + 2;
-    *data += 2 + data_len;
-    return draw_surface_from_data(width, height, icon_data);
-}
-
-static std::vector<cairo_surface_handle> ewmh_window_icon_from_reply(xcb_get_property_reply_t* r) {
-    uint32_t *data, *data_end;
-    std::vector<cairo_surface_handle> result;
-    cairo_surface_t* s;
-
+/** Get the icons in a NET_WM_ICON reply.
+ * \param r The reply, may be NULL.
+ * \return An array of icons.
+ */
+std::vector<IconCache::IconPtr> ewmh_window_icon_from_reply(xcb_get_property_reply_t* r) {
     if (!r || r->type != XCB_ATOM_CARDINAL || r->format != 32) {
-        return result;
+        return {};
     }
 
-    data = (uint32_t*)xcb_get_property_value(r);
-    data_end = &data[r->length];
+    auto data = (const uint32_t*)xcb_get_property_value(r);
     if (!data) {
-        return result;
-    }
-
-    while ((s = ewmh_window_icon_from_reply_next(&data, data_end)) != NULL) {
-        result.emplace_back(s);
+        return {};
     }
 
-    return result;
+    return IconCache::from_net_wm_icon(data, data + r->length);
 }
 
 /** Get NET_WM_ICON.
  * \param cookie The cookie.
  * \return An array of icons.
  */
-std::vector<cairo_surface_handle> ewmh_window_icon_get_reply(xcb_get_property_cookie_t cookie) {
+std::vector<IconCache::IconPtr> ewmh_window_icon_get_reply(xcb_get_property_cookie_t cookie) {
     auto r = getConnection().get_property_reply(cookie);
     return ewmh_window_icon_from_reply(r.get());
 }
@@ -21,6 +21,7 @@
 #pragma once
 
 #include "draw.h"
+#include "iconcache.h"
 #include "strut.h"
 
 #include <cairo.h>
@@ -36,10 +37,23 @@ int ewmh_update_net_current_desktop(lua_State*);
 void ewmh_update_net_desktop_names(void);
 int ewmh_process_client_message(xcb_client_message_event_t*);
 void ewmh_update_net_client_list_stacking(void);
-void ewmh_client_check_hints(client*);
+void ewmh_refresh(void);
+
+/** The requests ewmh_client_check_hints() needs */
+struct ewmh_client_hints_cookies_t {
+    xcb_get_property_cookie_t desktop;
+    xcb_get_property_cookie_t state;
+    xcb_get_property_cookie_t window_type;
+};
+
+ewmh_client_hints_cookies_t ewmh_client_check_hints_unchecked(xcb_window_t);
+void ewmh_client_check_hints(client*, ewmh_client_hints_cookies_t);
 void ewmh_client_update_desktop(client*);
+xcb_get_property_cookie_t ewmh_client_strut_unchecked(xcb_window_t);
 void ewmh_process_client_strut(client*);
+void ewmh_process_client_strut(client*, xcb_get_property_cookie_t);
 void ewmh_update_strut(xcb_window_t, strut_t*);
 void ewmh_update_window_type(xcb_window_t window, uint32_t type);
 xcb_get_property_cookie_t ewmh_window_icon_get_unchecked(xcb_window_t);
-std::vector<cairo_surface_handle> ewmh_window_icon_get_reply(xcb_get_property_cookie_t);
+std::vector<IconCache::IconPtr> ewmh_window_icon_get_reply(xcb_get_property_cookie_t);
+std::vector<IconCache::IconPtr> ewmh_window_icon_from_reply(xcb_get_property_reply_t*);
@@ -20,6 +20,7 @@
  */
 #pragma once
 
+#include "common/bitset.h"
 #include "common/lualib.h"
 
 #include <cstdlib>
@@ -27,12 +28,19 @@
 #define SN_API_NOT_YET_FROZEN
 #include "config.h"
 #include "property.h"
+#include "stack.h"
 #include "xcbcpp/xcb.h"
 
 #include <X11/Xresource.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <glib.h>
 #include <libsn/sn.h>
 #include <set>
+#include <unordered_map>
+#include <vector>
 #ifdef WITH_XCB_ERRORS
 #include <xcb/xcb_errors.h>
 #endif
@@ -55,11 +63,134 @@ class button_t;
 struct client;
 struct screen_t;
 struct tag_t;
+namespace KeySet {
+struct Set;
+}
 struct sequence_pair_t {
     xcb_void_cookie_t begin;
     xcb_void_cookie_t end;
 };
 
+/** Ranges of request sequence numbers, oldest first. They are kept in a ring
+ * buffer which grows when it is full; ranges are only ever added at the back
+ * and dropped from the front.
+ */
+class SequenceRing {
+  public:
+    /** Add a range. A range that starts right after the previous one ends
+     * extends it, since there is no request in between. */
+    void push(sequence_pair_t pair) {
+        _pushed++;
+        if (_size > 0 && pair.begin.sequence - back().end.sequence <= 1) {
+            back().end = pair.end;
+            return;
+        }
+        if (_size == _buf.size()) {
+            grow();
+        }
+        _buf[(_head + _size) & (_buf.size() - 1)] = pair;
+        _size++;
+    }
+
+    /** Drop the ranges that end before a sequence number, handling
+     * wrap-around. */
+    void prune(uint32_t sequence) {
+        /* Do if (end >= sequence) break;, but handle wrap-around: The above is
+         * equivalent to end-sequence > 0 (assuming unlimited precision). With
+         * int32_t, this would mean that the sign bit is cleared, which means:
+         */
+        while (_size > 0 && front().end.sequence - sequence >= UINT32_MAX / 2) {
+            _head = (_head + 1) & (_buf.size() - 1);
+            _size--;
+        }
+    }
+
+    bool empty() const { return _size == 0; }
+    size_t size() const { return _size; }
+    const sequence_pair_t& front() const { return _buf[_head]; }
+
+    /** The number of ranges added since the last reset_pushed() */
+    uint64_t pushed() const { return _pushed; }
+    void reset_pushed() { _pushed = 0; }
+
+  private:
+    sequence_pair_t& back() { return _buf[(_head + _size - 1) & (_buf.size() - 1)]; }
+
+    void grow() {
+        std::vector<sequence_pair_t> buf(std::max<size_t>(16, _buf.size() * 2));
+        for (size_t i = 0; i < _size; i++) {
+            buf[i] = _buf[(_head + i) & (_buf.size() - 1)];
+        }
+        _buf = std::move(buf);
+        _head = 0;
+    }
+
+    /** Always empty or a power of two long */
+    std::vector<sequence_pair_t> _buf;
+    size_t _head = 0;
+    size_t _size = 0;
+    uint64_t _pushed = 0;
+};
+
+/** The state of the managed clients the banning passes read, one slot per
+ * client in contiguous arrays, so that a pass over all clients does not touch
+ * the clients themselves. The client fields stay the reference, the slots are
+ * updated by client_hot_sync() when they change.
+ */
+class ClientHotStore {
+  public:
+    static constexpr uint32_t no_slot = UINT32_MAX;
+
+    enum flag_t : uint8_t {
+        hidden = 1 << 0,
+        minimized = 1 << 1,
+        sticky = 1 << 2,
+        banned = 1 << 3,
+        /** The client has tags with bits over 63, only tested on the client */
+        wide_tags = 1 << 4,
+    };
+
+    /** Give a client a slot, reusing the ones freed first. */
+    uint32_t acquire(client* c) {
+        if (_free.empty()) {
+            _owner.push_back(c);
+            _tags.push_back(0);
+            _flags.push_back(0);
+            return uint32_t(_owner.size() - 1);
+        }
+        const uint32_t slot = _free.back();
+        _free.pop_back();
+        _owner[slot] = c;
+        return slot;
+    }
+
+    void release(uint32_t slot) {
+        _owner[slot] = nullptr;
+        _tags[slot] = 0;
+        _flags[slot] = 0;
+        _free.push_back(slot);
+    }
+
+    void set(uint32_t slot, uint64_t tags, uint8_t flags) {
+        _tags[slot] = tags;
+        _flags[slot] = flags;
+    }
+
+    /** The number of slots, free ones included */
+    size_t size() const { return _owner.size(); }
+    /** The client of a slot, NULL if it is free */
+    client* owner(size_t slot) const { return _owner[slot]; }
+    /** The bits of the first 64 tags of a slot */
+    uint64_t tags(size_t slot) const { return _tags[slot]; }
+    uint8_t flags(size_t slot) const { return _flags[slot]; }
+
+  private:
+    std::vector<client*> _owner;
+    std::vector<uint64_t> _tags;
+    std::vector<uint8_t> _flags;
+    std::vector<uint32_t> _free;
+};
+
 void tag_unref_simplified(tag_t*);
 
 struct TagDeleter {
@@ -97,12 +228,19 @@ struct XOrg {
         bool have_input_shape = false;
         /** Check for XFixes extension */
         bool have_xfixes = false;
+        /** Check for MIT-SHM extension, cleared if attaching a segment fails */
+        bool have_shm = false;
+        /** Check for Composite extension */
+        bool have_composite = false;
+        /** Check for Damage extension */
+        bool have_damage = false;
     } caps;
 
     uint8_t event_base_shape = 0;
     uint8_t event_base_xkb = 0;
     uint8_t event_base_randr = 0;
     uint8_t event_base_xfixes = 0;
+    uint8_t event_base_damage = 0;
 
   private:
     xcb_timestamp_t timestamp = 0;
@@ -142,21 +280,20 @@ class Manager {
     /** The primary screen, access through screen_get_primary() */
     screen_t* primary_screen = nullptr;
     /** Root window key bindings */
-    std::vector<keyb_t*> keys;
+    key_array_t keys;
+    /** Root window key binding set, see keyset.h */
+    KeySet::Set* key_set = nullptr;
     /** Root window mouse bindings */
     std::vector<button_t*> buttons;
     /** When --no-argb is used in the modeline or command line */
     bool had_overriden_depth = false;
     /** Clients list */
     std::vector<client*> clients;
+    /** Clients whose geometry or border have to be sent to the X server */
+    std::vector<client*> refresh_pending;
+    /** The client stack from bottom to top */
+    const std::vector<client*>& getStack() { return stack_get(); }
     /** Embedded windows */
-  private:
-    std::vector<client*> stack = {};
-
-  public:
-    const std::vector<client*>& getStack() { return stack; }
-    std::vector<client*>& refStack() { return stack; }
-
     std::vector<XEmbed::window> embedded;
     /** Stack client history */
     /** Lua VM state (opaque to avoid mis-use, see globalconf_get_lua_State()) */
@@ -179,11 +316,22 @@ class Manager {
         struct client* client = nullptr;
         /** Is there a focus change pending? */
         bool need_update = false;
+        /** The most recently focused client of the focus history ring */
+        struct client* history = nullptr;
+        /** Whether focus changes are added to the history */
+        bool history_tracking = true;
         /** When nothing has the input focus, this window actually is focused */
         xcb_window_t window_no_focus = 0;
     } focus;
     /** Drawins */
     std::vector<drawin_t*> drawins;
+    /** Window id indexes of the managed clients and visible drawins */
+    struct {
+        std::unordered_map<xcb_window_t, struct client*> clients;
+        std::unordered_map<xcb_window_t, struct client*> frames;
+        std::unordered_map<xcb_window_t, struct client*> nofocus;
+        std::unordered_map<xcb_window_t, drawin_t*> drawins;
+    } windows;
     /** The startup notification display struct */
     SnDisplay* sndisplay = nullptr;
     /** Latest timestamp we got from the X server */
@@ -199,6 +347,8 @@ class Manager {
         drawin_t* parent = nullptr;
         /** Background color */
         uint32_t background_pixel = 0;
+        /** Width and height last given to the systray window */
+        std::array<uint32_t, 2> size = {};
     } systray;
     /** The monitor of startup notifications */
     SnMonitorContext* snmonitor = nullptr;
@@ -216,8 +366,14 @@ class Manager {
     xcb_colormap_t default_cmap = 0;
     /** Do we have to reban clients? */
     bool need_lazy_banning = false;
+    /** Clients whose visibility may have changed since the last rebanning */
+    std::vector<client*> banning_dirty;
+    /** The banning state of the managed clients, by client::hot_slot */
+    ClientHotStore clients_hot;
     /** Tag list */
     std::vector<tag_ptr> tags;
+    /** Bits of the tags that are both activated and selected */
+    Bitset selected_tags;
     /** List of registered xproperties */
     std::set<xproperty> xproperties;
     /* xkb context */
@@ -234,10 +390,24 @@ class Manager {
     bool xkb_group_changed = false;
     /** The preferred size of client icons for this screen */
     uint32_t preferred_icon_size = 0;
+    /** Only fetch _NET_WM_ICON when Lua asks for a client's icon */
+    bool lazy_icons = false;
+    /** Lua GC work in KiB done before the main loop sleeps, 0 disables */
+    int idle_gc_step = 16;
+    /** GC count in KiB after the last idle GC cycle finished */
+    int idle_gc_floor = 0;
+    /** Frame pacing of the deferred work, see `awesome.set_frame_pacing` */
+    struct {
+        bool enabled = false;
+        /** The frames per second asked for, 0 follows the monitors */
+        double rate = 0;
+        std::chrono::microseconds interval{0};
+        std::chrono::steady_clock::time_point last_refresh;
+    } frame_pacing;
     /** Cached wallpaper information */
     cairo_surface_t* wallpaper = nullptr;
     /** List of enter/leave events to ignore */
-    std::vector<sequence_pair_t> ignore_enter_leave_events;
+    SequenceRing ignore_enter_leave_events;
     xcb_void_cookie_t pending_enter_leave_begin = {0};
     /** List of windows to be destroyed later */
     std::vector<xcb_window_t> destroy_later_windows;
@@ -262,3 +432,6 @@ static inline lua_State* globalconf_get_lua_State(void) {
 
 /* Defined in root.c */
 void root_update_wallpaper(void);
+bool root_wallpaper_own_change(void);
+void root_update_cursor(void);
+void root_reset_bindings(lua_State*);
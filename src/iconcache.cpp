@@ -0,0 +1,305 @@
+/*
+ * iconcache.cpp - shared client icon cache
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "iconcache.h"
+
+#include "memstats.h"
+#include "premultiply.h"
+
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+
+namespace IconCache {
+
+static size_t icon_hash(uint32_t width, uint32_t height, const uint32_t* pixels, size_t len) {
+    const std::string_view bytes{reinterpret_cast<const char*>(pixels), len * sizeof(uint32_t)};
+    size_t hash = std::hash<std::string_view>{}(bytes);
+    hash ^= (uint64_t(width) << 32 | height) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+/** The icons in use, indexed by a hash of their size and pixels, and the
+ * decoded surfaces that can be dropped again. */
+struct Cache {
+    std::unordered_multimap<size_t, std::weak_ptr<Icon>> icons;
+    /** Evictable decoded icons, most recently used first */
+    std::list<Icon*> lru;
+    size_t bytes = 0;
+    size_t limit = 8 * 1024 * 1024;
+
+    static size_t size_of(const Icon* icon) { return size_t(icon->width()) * icon->height() * 4; }
+
+    /** Find an icon with these pixels that is in use, or add a new one */
+    IconPtr get(uint32_t width, uint32_t height, const uint32_t* pixels) {
+        const size_t len = size_t(width) * height;
+        const size_t hash = icon_hash(width, height, pixels, len);
+
+        auto [begin, end] = icons.equal_range(hash);
+        for (auto it = begin; it != end; ++it) {
+            auto icon = it->second.lock();
+            if (icon && icon->width() == width && icon->height() == height &&
+                std::equal(pixels, pixels + len, icon->_pixels.begin())) {
+                return icon;
+            }
+        }
+
+        auto icon =
+          std::make_shared<Icon>(width, height, std::vector<uint32_t>(pixels, pixels + len), hash);
+        icons.emplace(hash, icon);
+        return icon;
+    }
+
+    void touch(Icon* icon) {
+        if (icon->_in_lru) {
+            lru.splice(lru.begin(), lru, icon->_lru);
+            return;
+        }
+        icon->_lru = lru.insert(lru.begin(), icon);
+        icon->_in_lru = true;
+        bytes += size_of(icon);
+    }
+
+    void forget(Icon* icon) {
+        if (!icon->_in_lru) {
+            return;
+        }
+        lru.erase(icon->_lru);
+        icon->_in_lru = false;
+        bytes -= size_of(icon);
+    }
+
+    /** Drop decoded surfaces until the budget is met, but never the most
+     * recently used one, which a caller is about to use */
+    void trim() {
+        while (bytes > limit && lru.size() > 1) {
+            auto icon = lru.back();
+            forget(icon);
+            icon->_surface.reset();
+        }
+    }
+};
+
+/** How many scaled copies an icon keeps */
+static constexpr size_t max_variants = 4;
+
+/** Halve a premultiplied image, averaging each 2x2 block. An odd last row or
+ * column is dropped.
+ * \param src The pixels.
+ * \param width The width of the image.
+ * \param height The height of the image.
+ * \param stride The distance between rows, in pixels.
+ * \return The pixels of the halved image, without padding.
+ */
+static std::vector<uint32_t> halve(const uint32_t* src,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   size_t stride) {
+    const uint32_t w = width / 2, h = height / 2;
+    std::vector<uint32_t> out(size_t(w) * h);
+    for (uint32_t y = 0; y < h; y++) {
+        const uint32_t* row0 = src + size_t(2 * y) * stride;
+        const uint32_t* row1 = row0 + stride;
+        for (uint32_t x = 0; x < w; x++) {
+            const uint32_t block[] = {row0[2 * x], row0[2 * x + 1], row1[2 * x], row1[2 * x + 1]};
+            uint32_t pixel = 0;
+            for (unsigned shift = 0; shift < 32; shift += 8) {
+                uint32_t sum = 2;
+                for (const uint32_t p : block) {
+                    sum += (p >> shift) & 0xff;
+                }
+                pixel |= (sum / 4) << shift;
+            }
+            out[size_t(y) * w + x] = pixel;
+        }
+    }
+    return out;
+}
+
+static Cache& cache() {
+    static Cache c;
+    return c;
+}
+
+Icon::Icon(uint32_t width, uint32_t height, std::vector<uint32_t> pixels, size_t hash)
+  : _width(width)
+  , _height(height)
+  , _hash(hash)
+  , _pixels(std::move(pixels)) {
+    MemStats::icon_pixels().add(_pixels.size() * sizeof(uint32_t));
+}
+
+Icon::Icon(cairo_surface_handle surface)
+  : _width(cairo_image_surface_get_width(surface.get()))
+  , _height(cairo_image_surface_get_height(surface.get()))
+  , _hash(0)
+  , _surface(std::move(surface)) {}
+
+Icon::~Icon() {
+    if (_pixels.empty()) {
+        return;
+    }
+    MemStats::icon_pixels().remove(_pixels.size() * sizeof(uint32_t));
+    auto& c = cache();
+    c.forget(this);
+    auto [begin, end] = c.icons.equal_range(_hash);
+    for (auto it = begin; it != end;) {
+        it = it->second.expired() ? c.icons.erase(it) : std::next(it);
+    }
+}
+
+cairo_surface_t* Icon::surface() {
+    if (_pixels.empty()) {
+        return _surface.get();
+    }
+    if (!_surface) {
+        _surface.reset(draw_surface_from_data(_width, _height, _pixels.data()));
+    }
+    auto& c = cache();
+    c.touch(this);
+    c.trim();
+    return _surface.get();
+}
+
+cairo_surface_t* Icon::scaled(uint32_t width, uint32_t height) {
+    if (width == _width && height == _height) {
+        return surface();
+    }
+    auto it = std::ranges::find_if(_variants, [&](const Variant& variant) {
+        return variant.width == width && variant.height == height;
+    });
+    if (it == _variants.end()) {
+        if (_variants.size() >= max_variants) {
+            _variants.pop_back();
+        }
+        _variants.push_back({width, height, cairo_surface_handle(scale(width, height))});
+        it = std::prev(_variants.end());
+    }
+    std::rotate(_variants.begin(), it, std::next(it));
+    return _variants.front().surface.get();
+}
+
+cairo_surface_t* Icon::scale(uint32_t width, uint32_t height) {
+    /* The premultiplied pixels to halve: the decoded surface if there is one,
+     * else a copy of the raw pixels, which does not count against the cache */
+    std::vector<uint32_t> level;
+    const uint32_t* pixels = nullptr;
+    size_t stride = _width;
+    cairo_format_t format = CAIRO_FORMAT_ARGB32;
+    cairo_surface_t* source = _surface.get();
+    if (!source) {
+        level.resize(_pixels.size());
+        Premultiply::argb(level.data(), _pixels.data(), level.size());
+        pixels = level.data();
+    } else {
+        format = cairo_image_surface_get_format(source);
+        if (format == CAIRO_FORMAT_ARGB32 || format == CAIRO_FORMAT_RGB24) {
+            cairo_surface_flush(source);
+            pixels = reinterpret_cast<const uint32_t*>(cairo_image_surface_get_data(source));
+            stride = cairo_image_surface_get_stride(source) / 4;
+        }
+    }
+
+    uint32_t w = _width, h = _height;
+    if (pixels) {
+        while (w / 2 >= width && h / 2 >= height) {
+            level = halve(pixels, w, h, stride);
+            w /= 2;
+            h /= 2;
+            pixels = level.data();
+            stride = w;
+        }
+    }
+    cairo_surface_handle mip;
+    if (!level.empty()) {
+        mip.reset(cairo_image_surface_create_for_data(
+          reinterpret_cast<unsigned char*>(level.data()), format, w, h, w * 4));
+        source = mip.get();
+    }
+
+    cairo_surface_t* result = cairo_image_surface_create(format, width, height);
+    cairo_t* cr = cairo_create(result);
+    cairo_scale(cr, double(width) / w, double(height) / h);
+    cairo_set_source_surface(cr, source, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+    cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_PAD);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    return MemStats::track_image(result, MemStats::Image::Icon);
+}
+
+std::vector<IconPtr> from_net_wm_icon(const uint32_t* data, const uint32_t* data_end) {
+    std::vector<IconPtr> result;
+
+    while (data_end - data > 2) {
+        const uint32_t width = data[0];
+        const uint32_t height = data[1];
+
+        /* Check that we have enough data, handling overflow */
+        const uint64_t data_len = width * (uint64_t)height;
+        if (width < 1 || height < 1 || data_len > (uint64_t)(data_end - data) - 2) {
+            break;
+        }
+
+        result.push_back(cache().get(width, height, data + 2));
+        data += 2 + data_len;
+    }
+
+    return result;
+}
+
+IconPtr from_surface(cairo_surface_handle surface) {
+    return std::make_shared<Icon>(std::move(surface));
+}
+
+Icon* closest(const std::vector<IconPtr>& icons, uint32_t preferred_size) {
+    Icon* found = nullptr;
+    uint32_t found_size = 0;
+
+    for (auto& icon : icons) {
+        const uint32_t size = std::max(icon->width(), icon->height());
+
+        /* pick the icon if it's a better match than the one we already have */
+        bool found_icon_too_small = found_size < preferred_size;
+        bool found_icon_too_large = found_size > preferred_size;
+        bool icon_empty = icon->width() == 0 || icon->height() == 0;
+        bool better_because_bigger = found_icon_too_small && size > found_size;
+        bool better_because_smaller =
+          found_icon_too_large && size >= preferred_size && size < found_size;
+        if (!icon_empty && (better_because_bigger || better_because_smaller || found_size == 0)) {
+            found = icon.get();
+            found_size = size;
+        }
+    }
+
+    return found;
+}
+
+void set_limit(size_t bytes) {
+    auto& c = cache();
+    c.limit = bytes;
+    c.trim();
+}
+
+size_t decoded_bytes() { return cache().bytes; }
+
+} // namespace IconCache
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,124 @@
+/*
+ * iconcache.h - shared client icon cache header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "draw.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <vector>
+
+namespace IconCache {
+
+/** One client icon.
+ * Icons read from _NET_WM_ICON are shared by all windows with the same pixels.
+ * They keep the raw pixels and only decode them into a cairo surface when the
+ * surface is asked for. Decoded surfaces count against the cache budget and
+ * are dropped again, least recently used first, when it is exceeded.
+ *
+ * Scaled copies for the sizes widgets draw the icon at are kept with the icon,
+ * so they are made once for all the windows sharing it.
+ */
+class Icon {
+  public:
+    Icon(uint32_t width, uint32_t height, std::vector<uint32_t> pixels, size_t hash);
+    /** An icon that was set from a surface. It is never evicted. */
+    explicit Icon(cairo_surface_handle surface);
+    ~Icon();
+    Icon(const Icon&) = delete;
+    Icon& operator=(const Icon&) = delete;
+
+    uint32_t width() const { return _width; }
+    uint32_t height() const { return _height; }
+    bool decoded() const { return bool(_surface); }
+    /** The pixels from _NET_WM_ICON, empty for icons set from a surface */
+    const std::vector<uint32_t>& pixels() const { return _pixels; }
+
+    /** Get the icon's surface, decoding it if needed.
+     * \return The surface. The icon keeps the reference, so callers that hold
+     * on to it have to take their own.
+     */
+    cairo_surface_t* surface();
+
+    /** Get a copy of the icon's surface scaled to a size.
+     * The icon is halved until it is less than twice as big as the size and
+     * that is scaled to the size, so that large icons are not sampled from a
+     * few of their pixels. The last few sizes are kept.
+     * \param width The width of the copy.
+     * \param height The height of the copy.
+     * \return The surface. The icon keeps the reference, so callers that hold
+     * on to it have to take their own.
+     */
+    cairo_surface_t* scaled(uint32_t width, uint32_t height);
+
+  private:
+    friend struct Cache;
+
+    struct Variant {
+        uint32_t width, height;
+        cairo_surface_handle surface;
+    };
+
+    cairo_surface_t* scale(uint32_t width, uint32_t height);
+
+    uint32_t _width, _height;
+    size_t _hash;
+    std::vector<uint32_t> _pixels;
+    cairo_surface_handle _surface;
+    std::list<Icon*>::iterator _lru;
+    bool _in_lru = false;
+    /** Scaled copies, most recently used first */
+    std::vector<Variant> _variants;
+};
+
+using IconPtr = std::shared_ptr<Icon>;
+
+/** Parse the value of a _NET_WM_ICON property.
+ * Icons with the same pixels as one that is already in use are shared. No
+ * icon is decoded.
+ * \param data The property value.
+ * \param data_end The end of the property value.
+ * \return The icons, in property order.
+ */
+std::vector<IconPtr> from_net_wm_icon(const uint32_t* data, const uint32_t* data_end);
+
+/** Wrap a surface in an icon.
+ * \param surface The image surface, which the icon takes over.
+ * \return The icon.
+ */
+IconPtr from_surface(cairo_surface_handle surface);
+
+/** Pick the icon closest to a size, only picking a smaller icon if no bigger
+ * one is available.
+ * \param icons The icons to choose from.
+ * \param preferred_size The wanted size.
+ * \return The best icon, or nullptr if there is none.
+ */
+Icon* closest(const std::vector<IconPtr>& icons, uint32_t preferred_size);
+
+/** Set how many bytes of decoded surfaces are kept. */
+void set_limit(size_t bytes);
+/** The number of bytes of decoded surfaces currently kept. */
+size_t decoded_bytes();
+
+} // namespace IconCache
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
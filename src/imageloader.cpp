@@ -0,0 +1,331 @@
+/*
+ * imageloader.cpp - asynchronous image loading
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "imageloader.h"
+
+#include "draw.h"
+#include "globalconf.h"
+#include "luaa.h"
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+
+namespace ImageLoader {
+
+namespace {
+
+/** Identifies one version of a file */
+struct FileStamp {
+    struct timespec mtime = {};
+    off_t size = 0;
+
+    bool valid() const { return mtime.tv_sec != 0 || mtime.tv_nsec != 0; }
+    bool operator==(const FileStamp& o) const {
+        return mtime.tv_sec == o.mtime.tv_sec && mtime.tv_nsec == o.mtime.tv_nsec &&
+               size == o.size;
+    }
+};
+
+/** A file being decoded. Only `surface` and `error` are touched by the decode
+ * thread, everything else belongs to the main thread. */
+struct Job {
+    std::string path;
+    FileStamp stamp;
+    std::vector<Lua::FunctionRegistryIdx> callbacks;
+    cairo_surface_handle surface;
+    std::string error;
+};
+
+/** A surface being written to a PNG file. The surface belongs to the encode
+ * thread until the job is delivered. */
+struct SaveJob {
+    std::string path;
+    Lua::FunctionRegistryIdx callback;
+    cairo_surface_handle surface;
+    std::string error;
+};
+
+/** Decoded images, least recently used last */
+struct SurfaceCache {
+    struct Entry {
+        std::string path;
+        FileStamp stamp;
+        cairo_surface_handle surface;
+        size_t bytes;
+    };
+
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t bytes = 0;
+    size_t limit = 16 * 1024 * 1024;
+
+    cairo_surface_t* find(const std::string& path, const FileStamp& stamp) {
+        auto it = index.find(path);
+        if (it == index.end()) {
+            return nullptr;
+        }
+        if (!(it->second->stamp == stamp)) {
+            erase(it->second);
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->surface.get();
+    }
+
+    void insert(const std::string& path, const FileStamp& stamp, cairo_surface_t* surface) {
+        if (auto it = index.find(path); it != index.end()) {
+            erase(it->second);
+        }
+        const size_t size = size_t(cairo_image_surface_get_stride(surface)) *
+                            cairo_image_surface_get_height(surface);
+        if (size > limit) {
+            return;
+        }
+        entries.push_front({path, stamp, cairo_surface_handle{cairo_surface_reference(surface)},
+                            size});
+        index.emplace(path, entries.begin());
+        bytes += size;
+        while (bytes > limit) {
+            erase(std::prev(entries.end()));
+        }
+    }
+
+    void erase(std::list<Entry>::iterator it) {
+        bytes -= it->bytes;
+        index.erase(it->path);
+        entries.erase(it);
+    }
+};
+
+GThreadPool* pool = nullptr;
+GThreadPool* save_pool = nullptr;
+bool shutting_down = false;
+/** Files currently being decoded, so that concurrent loads share the work */
+std::unordered_map<std::string, Job*> pending;
+SurfaceCache surface_cache;
+
+FileStamp file_stamp(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return {};
+    }
+    return {st.st_mtim, st.st_size};
+}
+
+/** Idle callback on the main thread, calls every callback waiting for a job */
+gboolean deliver(gpointer data) {
+    auto job = static_cast<Job*>(data);
+    if (shutting_down) {
+        return G_SOURCE_REMOVE;
+    }
+    if (auto it = pending.find(job->path); it != pending.end() && it->second == job) {
+        pending.erase(it);
+    }
+    if (job->surface && job->stamp.valid()) {
+        surface_cache.insert(job->path, job->stamp, job->surface.get());
+    }
+
+    lua_State* L = globalconf_get_lua_State();
+    for (auto& callback : job->callbacks) {
+        if (job->surface) {
+            /* every callback gets its own reference which it will have to destroy */
+            lua_pushlightuserdata(L, cairo_surface_reference(job->surface.get()));
+            lua_pushnil(L);
+        } else {
+            lua_pushnil(L);
+            lua_pushstring(L, job->error.c_str());
+        }
+        lua_rawgeti(L, LUA_REGISTRYINDEX, callback.idx.idx);
+        Lua::dofunction(L, 2, 0);
+        Lua::unregister(L, &callback);
+    }
+
+    delete job;
+    return G_SOURCE_REMOVE;
+}
+
+/** Runs on a decode thread */
+void decode(gpointer data, gpointer) {
+    auto job = static_cast<Job*>(data);
+    GError* error = nullptr;
+
+    job->surface.reset(draw_load_image(nullptr, job->path.c_str(), &error));
+    if (!job->surface) {
+        job->error = error->message;
+        g_error_free(error);
+    }
+
+    g_idle_add(deliver, job);
+}
+
+gboolean deliver_saved(gpointer data) {
+    auto job = static_cast<SaveJob*>(data);
+    if (!shutting_down) {
+        lua_State* L = globalconf_get_lua_State();
+        if (job->error.empty()) {
+            lua_pushstring(L, job->path.c_str());
+            lua_pushnil(L);
+        } else {
+            lua_pushnil(L);
+            lua_pushstring(L, job->error.c_str());
+        }
+        lua_rawgeti(L, LUA_REGISTRYINDEX, job->callback.idx.idx);
+        Lua::dofunction(L, 2, 0);
+        Lua::unregister(L, &job->callback);
+    }
+    delete job;
+    return G_SOURCE_REMOVE;
+}
+
+/** Runs on an encode thread */
+void encode(gpointer data, gpointer) {
+    auto job = static_cast<SaveJob*>(data);
+    const cairo_status_t status = cairo_surface_write_to_png(job->surface.get(), job->path.c_str());
+    if (status != CAIRO_STATUS_SUCCESS) {
+        job->error = cairo_status_to_string(status);
+    }
+    /* The surface may be the last reference, free it here and not on the
+     * main thread */
+    job->surface.reset();
+    g_idle_add(deliver_saved, job);
+}
+
+int worker_threads() { return std::clamp<int>(g_get_num_processors() - 1, 1, 4); }
+
+} // namespace
+
+/** Load an image from a given path without blocking.
+ *
+ * The file is decoded by a background thread and the callback is called from
+ * the main loop afterwards, never before this function returns. Images are
+ * cached as long as the file does not change, so loading the same file again
+ * is cheap. The surface may thus be shared and must not be modified.
+ *
+ * @tparam string name The file name.
+ * @tparam function callback Called with a cairo surface as light user datum (or
+ * nil) and an error message (or nil). The surface reference must be destroyed,
+ * e.g. by passing it to `gears.surface`.
+ * @staticfct load_image_async
+ * @noreturn
+ */
+int luaA_load_image_async(lua_State* L) {
+    const char* path = luaL_checkstring(L, 1);
+    Lua::checkfunction(L, 2);
+
+    const auto stamp = file_stamp(path);
+
+    /* Join a load of the same version of this file that is already running */
+    auto it = pending.find(path);
+    if (it != pending.end() && it->second->stamp == stamp && stamp.valid()) {
+        Lua::registerfct(L, 2, &it->second->callbacks.emplace_back());
+        return 0;
+    }
+
+    auto job = new Job{path, stamp, {}, {}, {}};
+    Lua::registerfct(L, 2, &job->callbacks.emplace_back());
+
+    if (stamp.valid()) {
+        if (auto cached = surface_cache.find(job->path, stamp)) {
+            job->surface.reset(cairo_surface_reference(cached));
+            g_idle_add(deliver, job);
+            return 0;
+        }
+        pending[job->path] = job;
+    }
+
+    if (!pool) {
+        pool = g_thread_pool_new(decode, nullptr, worker_threads(), FALSE, nullptr);
+    }
+    g_thread_pool_push(pool, job, nullptr);
+    return 0;
+}
+
+/** Save a surface to a PNG file without blocking.
+ *
+ * The image is encoded and written by a background thread and the callback is
+ * called from the main loop once the file is complete, never before this
+ * function returns. Image surfaces are used as they are and must not be
+ * modified until then, other surfaces are copied first.
+ *
+ * @param surface The cairo surface as light user datum.
+ * @tparam string path The file name.
+ * @tparam function callback Called with the path once the file is written, or
+ * with nil and an error message.
+ * @staticfct save_image_async
+ * @noreturn
+ */
+int luaA_save_image_async(lua_State* L) {
+    auto surface = static_cast<cairo_surface_t*>(lua_touserdata(L, 1));
+    if (!surface) {
+        return Lua::typerror(L, 1, "cairo surface");
+    }
+    const char* path = luaL_checkstring(L, 2);
+    Lua::checkfunction(L, 3);
+
+    cairo_surface_flush(surface);
+    cairo_surface_t* image;
+    if (cairo_surface_get_type(surface) == CAIRO_SURFACE_TYPE_IMAGE) {
+        image = cairo_surface_reference(surface);
+    } else {
+        /* Other backends cannot be used from another thread */
+        double x1, y1, x2, y2;
+        cairo_t* cr = cairo_create(surface);
+        cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+        cairo_destroy(cr);
+        image = cairo_image_surface_create(
+          CAIRO_FORMAT_ARGB32, std::max(0, int(x2 - x1)), std::max(0, int(y2 - y1)));
+        cr = cairo_create(image);
+        cairo_set_source_surface(cr, surface, -x1, -y1);
+        cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+        cairo_paint(cr);
+        cairo_destroy(cr);
+    }
+
+    auto job = new SaveJob{path, {}, cairo_surface_handle{image}, {}};
+    Lua::registerfct(L, 3, &job->callback);
+
+    if (!save_pool) {
+        save_pool = g_thread_pool_new(encode, nullptr, worker_threads(), FALSE, nullptr);
+    }
+    g_thread_pool_push(save_pool, job, nullptr);
+    return 0;
+}
+
+void cleanup() {
+    shutting_down = true;
+    if (pool) {
+        g_thread_pool_free(pool, TRUE, TRUE);
+        pool = nullptr;
+    }
+    if (save_pool) {
+        /* Files that are being saved are still finished */
+        g_thread_pool_free(save_pool, FALSE, TRUE);
+        save_pool = nullptr;
+    }
+    pending.clear();
+    surface_cache = {};
+}
+
+} // namespace ImageLoader
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
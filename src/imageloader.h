@@ -0,0 +1,34 @@
+/*
+ * imageloader.h - asynchronous image loading header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+
+namespace ImageLoader {
+
+int luaA_load_image_async(lua_State* L);
+int luaA_save_image_async(lua_State* L);
+
+/** Stop the decode threads. Images that are still being loaded are dropped,
+ * files that are being saved are finished first. */
+void cleanup();
+
+} // namespace ImageLoader
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -27,10 +27,16 @@
 
 #include "keygrabber.h"
 
+#include "common/xutil.h"
 #include "globalconf.h"
 #include "globals.h"
 
+#include <bitset>
+#include <string>
+#include <string_view>
 #include <unistd.h>
+#include <unordered_map>
+#include <vector>
 #include <xkbcommon/xkbcommon-x11.h>
 #include <xkbcommon/xkbcommon.h>
 
@@ -61,25 +67,215 @@ static bool keygrabber_grab(void) {
  */
 static bool is_control(char* buf) { return (buf[0] >= 0 && buf[0] < 0x20) || buf[0] == 0x7f; }
 
-/** Handle keypress event.
- * \param L Lua stack to push the key pressed.
+/** Get the name of a key the way the keygrabber reports it.
  * \param e Received XKeyEvent.
- * \return True if a key was successfully retrieved, false otherwise.
+ * \param buf Where to store the name.
  */
-bool keygrabber_handlekpress(lua_State* L, xcb_key_press_event_t* e) {
-    /* convert keysym to string */
-    char buf[MAX(MB_LEN_MAX, 32)];
-
+template <size_t N>
+static void keygrabber_key_name(xcb_key_press_event_t* e, char (&buf)[N]) {
     /* snprintf-like return value could be used here, but that should not be
      * necessary, as we have buffer big enough */
-    xkb_state_key_get_utf8(Manager::get().xkb_state, e->detail, buf, std::size(buf));
+    xkb_state_key_get_utf8(Manager::get().xkb_state, e->detail, buf, N);
 
     if (is_control(buf)) {
         /* Use text names for control characters, ignoring all modifiers. */
         xcb_keysym_t keysym = Manager::get().input.keysyms.get_keysym(e->detail, 0);
-        xkb_keysym_get_name(keysym, buf, std::size(buf));
+        xkb_keysym_get_name(keysym, buf, N);
+    }
+}
+
+namespace {
+
+/** A node of the chord trie. A chord ends at nodes with a value. */
+struct ChordNode {
+    /** The next node for each step, see chord_step() */
+    std::unordered_map<std::string, size_t> children;
+    /** Index of the value in the values table, 0 if no chord ends here */
+    int value = 0;
+};
+
+/** The chords set by keygrabber.chords() */
+struct {
+    std::vector<ChordNode> nodes;
+    /** Was the trie compiled completely? */
+    bool ready = false;
+    /** The node the keys pressed so far lead to, 0 is the root */
+    size_t position = 0;
+    /** The steps pressed so far */
+    std::vector<std::string> steps;
+    /** Keys whose press was taken by a chord, so is their release */
+    std::bitset<256> pressed;
+    Lua::FunctionRegistryIdx callback;
+    /** A table with the values of the chords */
+    Lua::RegistryIdx values;
+} chords;
+
+/** The modifiers of a step. Lock and Num Lock are ignored, like they are by
+ * awful.key, and so are mouse buttons. */
+constexpr uint16_t chord_modifiers = ((XCB_MOD_MASK_5 << 1) - 1) &
+                                     ~(XCB_MOD_MASK_LOCK | XCB_MOD_MASK_2);
+
+/** The key of a step in ChordNode::children */
+std::string chord_step(uint16_t modifiers, std::string_view key) {
+    modifiers &= chord_modifiers;
+    std::string step(reinterpret_cast<const char*>(&modifiers), sizeof(modifiers));
+    step += key;
+    return step;
+}
+
+/** Turn a step as Lua writes it, like "Mod4+Shift+X", into chord_step(). */
+std::string chord_step_from_lua(lua_State* L, std::string_view text) {
+    uint16_t modifiers = 0;
+    size_t plus;
+    /* The last part is the key, which may be a "+" itself */
+    while ((plus = text.find('+')) != std::string_view::npos && plus + 1 < text.size()) {
+        const uint16_t mask = xutil_key_mask_fromstr(text.substr(0, plus));
+        if (mask == XCB_NO_SYMBOL) {
+            luaL_error(L, "unknown modifier in chord step '%s'", std::string(text).c_str());
+        }
+        modifiers |= mask;
+        text.remove_prefix(plus + 1);
+    }
+    return chord_step(modifiers, text);
+}
+
+/** The step as Lua sees it, with the modifiers that were held */
+std::string chord_step_name(uint16_t modifiers, const char* key) {
+    std::string name;
+    modifiers &= chord_modifiers;
+    for (uint32_t maski = XCB_MOD_MASK_SHIFT; maski <= XCB_MOD_MASK_5; maski <<= 1) {
+        if (maski & modifiers) {
+            const char* mod;
+            size_t slen;
+            xutil_key_mask_tostr(maski, &mod, &slen);
+            name.append(mod, slen);
+            name += '+';
+        }
+    }
+    return name + key;
+}
+
+/** Compile the trie table on top of the stack into a node.
+ * \param node The index of the node.
+ * \param values The stack index of the table that gets the values.
+ * \param depth How deep the node is in the trie.
+ */
+void chords_compile(lua_State* L, size_t node, int values, int depth) {
+    if (depth > 64) {
+        luaL_error(L, "chords are nested too deeply");
+    }
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        if (lua_type(L, -2) != LUA_TSTRING) {
+            luaL_error(L, "chord steps must be strings");
+        }
+        auto step = chord_step_from_lua(L, *Lua::tostring(L, -2));
+        const size_t child = chords.nodes.size();
+        chords.nodes.emplace_back();
+        chords.nodes[node].children[step] = child;
+        if (lua_istable(L, -1)) {
+            chords_compile(L, child, values, depth + 1);
+        } else {
+            /* A value, the chord ends here */
+            const int value = Lua::rawlen(L, values) + 1;
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, values, value);
+            chords.nodes[child].value = value;
+        }
+        lua_pop(L, 1);
+    }
+}
+
+void chords_clear(lua_State* L) {
+    chords.nodes.clear();
+    chords.ready = false;
+    chords.position = 0;
+    chords.steps.clear();
+    chords.pressed.reset();
+    Lua::unregister(L, &chords.callback);
+    Lua::unregister(L, &chords.values);
+}
+
+/** Is this a key that only changes the modifiers? */
+bool is_modifier_keysym(xcb_keysym_t keysym) {
+    return (keysym >= XKB_KEY_Shift_L && keysym <= XKB_KEY_Hyper_R) ||
+           (keysym >= XKB_KEY_ISO_Lock && keysym <= XKB_KEY_ISO_Last_Group_Lock) ||
+           keysym == XKB_KEY_Mode_switch || keysym == XKB_KEY_Num_Lock;
+}
+
+/** Tell Lua that a chord completed or was aborted. */
+void chords_report(lua_State* L, int value) {
+    auto steps = std::move(chords.steps);
+    chords.steps.clear();
+    chords.position = 0;
+
+    if (value) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, chords.values.idx);
+        lua_rawgeti(L, -1, value);
+        lua_remove(L, -2);
+    } else {
+        lua_pushnil(L);
+    }
+    lua_createtable(L, steps.size(), 0);
+    for (size_t i = 0; i < steps.size(); i++) {
+        lua_pushlstring(L, steps[i].data(), steps[i].size());
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, chords.callback.idx.idx);
+    /* This may change or drop the chords */
+    Lua::dofunction(L, 2, 0);
+}
+
+} // namespace
+
+bool keygrabber_handle_chord(lua_State* L, xcb_key_press_event_t* e) {
+    if (!chords.ready) {
+        return false;
+    }
+
+    if (e->response_type != XCB_KEY_PRESS) {
+        const bool taken = chords.pressed[e->detail];
+        chords.pressed[e->detail] = false;
+        return taken;
+    }
+
+    if (is_modifier_keysym(Manager::get().input.keysyms.get_keysym(e->detail, 0))) {
+        /* Holding a modifier does not end a chord */
+        return chords.position != 0;
+    }
+
+    char buf[MAX(MB_LEN_MAX, 32)];
+    keygrabber_key_name(e, buf);
+
+    const auto& children = chords.nodes[chords.position].children;
+    auto it = children.find(chord_step(e->state, buf));
+    if (it == children.end() && chords.position == 0) {
+        /* No chord starts like this, the keygrabber callback gets the key */
+        return false;
     }
 
+    chords.pressed[e->detail] = true;
+    chords.steps.push_back(chord_step_name(e->state, buf));
+    if (it == children.end()) {
+        chords_report(L, 0);
+    } else if (chords.nodes[it->second].value) {
+        chords_report(L, chords.nodes[it->second].value);
+    } else {
+        chords.position = it->second;
+    }
+    return true;
+}
+
+/** Handle keypress event.
+ * \param L Lua stack to push the key pressed.
+ * \param e Received XKeyEvent.
+ * \return True if a key was successfully retrieved, false otherwise.
+ */
+bool keygrabber_handlekpress(lua_State* L, xcb_key_press_event_t* e) {
+    /* convert keysym to string */
+    char buf[MAX(MB_LEN_MAX, 32)];
+    keygrabber_key_name(e, buf);
+
     luaA_pushmodifiers(L, e->state);
     lua_pushstring(L, buf);
 
@@ -118,6 +314,43 @@ static int luaA_keygrabber_run(lua_State* L) {
 int luaA_keygrabber_stop(lua_State* L) {
     Manager::get().x.connection.ungrab_keyboard();
     Lua::unregister(L, &Manager::get().keygrabber.idx);
+    chords_clear(L);
+    return 0;
+}
+
+/** Match chords natively while the keyboard is grabbed.
+ *
+ * The chords are a trie: a table whose keys are steps like `"Mod4+Shift+X"`,
+ * the modifiers and the key as the keygrabber callback gets them, Lock and
+ * Mod2 ignored. A value that is a table holds the steps that may follow,
+ * anything else ends a chord.
+ *
+ * Keys that are part of a chord do not reach the keygrabber callback. When a
+ * chord ends, the callback given here gets its value and an array of the
+ * steps. When a key does not continue the chord that was started, it gets nil
+ * and the steps including that key. Keys that start no chord, and their
+ * releases, go to the keygrabber callback as usual. The chords are dropped
+ * when the keygrabber stops.
+ *
+ * @tparam[opt] table trie The chords, nil to drop them.
+ * @tparam[opt] function callback Called as `callback(value, steps)`.
+ * @staticfct keygrabber.chords
+ */
+static int luaA_keygrabber_chords(lua_State* L) {
+    chords_clear(L);
+    if (lua_isnoneornil(L, 1)) {
+        return 0;
+    }
+    Lua::checktable(L, 1);
+    Lua::registerfct(L, 2, &chords.callback);
+
+    lua_settop(L, 1);
+    lua_newtable(L);
+    Lua::lregister(L, 2, &chords.values);
+    lua_pushvalue(L, 1);
+    chords.nodes.emplace_back();
+    chords_compile(L, 0, 2, 0);
+    chords.ready = true;
     return 0;
 }
 
@@ -134,6 +367,7 @@ static int luaA_keygrabber_isrunning(lua_State* L) {
 const struct luaL_Reg awesome_keygrabber_lib[] = {
   {       "run",       luaA_keygrabber_run},
   {      "stop",      luaA_keygrabber_stop},
+  {    "chords",    luaA_keygrabber_chords},
   { "isrunning", luaA_keygrabber_isrunning},
   {   "__index",        Lua::default_index},
   {"__newindex",     Lua::default_newindex},
@@ -26,3 +26,7 @@
 
 int luaA_keygrabber_stop(lua_State*);
 bool keygrabber_handlekpress(lua_State*, xcb_key_press_event_t*);
+/** Match a key event against the chords from keygrabber.chords().
+ * \return True if the event was taken by a chord.
+ */
+bool keygrabber_handle_chord(lua_State*, xcb_key_press_event_t*);
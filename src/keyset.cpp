@@ -0,0 +1,165 @@
+/*
+ * keyset.cpp - native key binding sets
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "keyset.h"
+
+#include "globalconf.h"
+#include "luaa.h"
+#include "objects/client.h"
+#include "xwindow.h"
+
+#include <new>
+#include <xcb/xcb_event.h>
+
+namespace KeySet {
+
+namespace {
+
+constexpr const char* metatable = "awesome.key_set";
+
+Set& check(lua_State* L, int idx) { return *static_cast<Set*>(luaL_checkudata(L, idx, metatable)); }
+
+int set_gc(lua_State* L) {
+    Set& set = check(L, 1);
+    Lua::unregister(L, &set.callback);
+    set.~Set();
+    return 0;
+}
+
+int set_len(lua_State* L) {
+    lua_pushinteger(L, check(L, 1).bindings.size());
+    return 1;
+}
+
+void grab(xcb_window_t window, const std::vector<keyb_t*>& keys, const Set* set) {
+    if (!set) {
+        xwindow_grabkeys(window, keys);
+        return;
+    }
+    std::vector<keyb_t*> all;
+    all.reserve(keys.size() + set->keys.size());
+    all.insert(all.end(), keys.begin(), keys.end());
+    all.insert(all.end(), set->keys.begin(), set->keys.end());
+    xwindow_grabkeys(window, all);
+}
+
+} // namespace
+
+Set* checkopt(lua_State* L, int idx) { return lua_isnoneornil(L, idx) ? nullptr : &check(L, idx); }
+
+void grab_root() {
+    grab(Manager::get().screen->root, Manager::get().keys, Manager::get().key_set);
+}
+
+void grab_client(client* c) {
+    grab(c->window, c->keys, c->key_set);
+    if (c->nofocus_window) {
+        grab(c->nofocus_window, c->keys, c->key_set);
+    }
+}
+
+void dispatch(lua_State* L, Set* set, xcb_key_press_event_t* ev, xcb_keysym_t keysym, client* c) {
+    if (!set) {
+        return;
+    }
+
+    std::vector<lua_Integer> matches;
+    for (auto* k : set->keys.index.lookup(set->keys, ev->detail, keysym, ev->state)) {
+        if (k->matches(ev->detail, keysym, ev->state)) {
+            matches.push_back(k - set->bindings.data() + 1);
+        }
+    }
+    if (matches.empty()) {
+        return;
+    }
+
+    /* The callback may replace the set, which may then be collected */
+    lua_rawgeti(L, LUA_REGISTRYINDEX, set->callback.idx.idx);
+    const int callback = lua_gettop(L);
+    const bool press = XCB_EVENT_RESPONSE_TYPE(ev) == XCB_KEY_PRESS;
+    for (auto i : matches) {
+        lua_pushinteger(L, i);
+        lua_pushboolean(L, press);
+        if (c) {
+            luaA_object_push(L, c);
+        }
+        lua_pushvalue(L, callback);
+        Lua::dofunction(L, c ? 3 : 2, 0);
+    }
+    lua_pop(L, 1);
+}
+
+/** Create a set of key bindings.
+ *
+ * The set can be activated with `root.set_key_set` or `client:set_key_set`.
+ * Its bindings are stored natively, without a `key` object each, which makes
+ * large sets cheap to create and to switch between.
+ *
+ * @tparam table bindings A list of bindings, each a table with a list of
+ *  modifiers and a key, like `{ {"Mod4", "Shift"}, "Return" }`. The key is a
+ *  character, a keysym name or "#" followed by a keycode, like for `key`.
+ * @tparam function callback Called with the index of the binding in
+ *  *bindings*, true for a press and false for a release, and for client sets
+ *  the client.
+ * @return The set. Its length is the number of bindings.
+ * @staticfct new_set
+ */
+int luaA_key_new_set(lua_State* L) {
+    Lua::checktable(L, 1);
+    Lua::checkfunction(L, 2);
+    const size_t count = Lua::rawlen(L, 1);
+
+    auto set = new (lua_newuserdata(L, sizeof(Set))) Set;
+    if (luaL_newmetatable(L, metatable)) {
+        lua_pushcfunction(L, set_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_pushcfunction(L, set_len);
+        lua_setfield(L, -2, "__len");
+    }
+    lua_setmetatable(L, -2);
+    Lua::registerfct(L, 2, &set->callback);
+
+    set->bindings.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        keyb_t& k = set->bindings[i];
+        lua_rawgeti(L, 1, i + 1);
+        Lua::checktable(L, -1);
+        lua_rawgeti(L, -1, 1);
+        k.modifiers = luaA_tomodifiers(L, -1);
+        lua_rawgeti(L, -2, 2);
+        size_t len;
+        const char* key = luaL_checklstring(L, -1, &len);
+        if (len == 0 || !key_parse(L, key, len, &k)) {
+            /* A binding that never matches keeps the indexes in order */
+            k.keycode = 0;
+            k.keysym = 0;
+        }
+        lua_pop(L, 3);
+    }
+
+    set->keys.reserve(count);
+    for (auto& k : set->bindings) {
+        set->keys.push_back(&k);
+    }
+    return 1;
+}
+
+} // namespace KeySet
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
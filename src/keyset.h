@@ -0,0 +1,64 @@
+/*
+ * keyset.h - native key binding sets header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+#include "common/lualib.h"
+#include "objects/key.h"
+
+#include <vector>
+#include <xcb/xproto.h>
+
+struct client;
+
+/** Key bindings created in bulk, without a Lua object per binding.
+ *
+ * A set is built from a compact list of modifiers and keys and stores the
+ * bindings contiguously. It calls one Lua function with the index of the
+ * binding that was pressed. A set can be made active on the root window or on
+ * a client in one step, which only grabs and ungrabs the keys that differ.
+ */
+namespace KeySet {
+
+struct Set {
+    /** The bindings */
+    std::vector<keyb_t> bindings;
+    /** The bindings as an array, with its lookup index */
+    key_array_t keys;
+    Lua::FunctionRegistryIdx callback;
+};
+
+/** Get the set at the given index, NULL if it is nil. */
+Set* checkopt(lua_State* L, int idx);
+
+/** Grab the keys of the root window, its bindings and its active set. */
+void grab_root();
+/** Grab the keys of a client, its bindings and its active set. */
+void grab_client(client* c);
+
+/** Call the set callback for the bindings matching a key event.
+ * \param c The client the event is for, or NULL for the root window.
+ */
+void dispatch(lua_State* L, Set* set, xcb_key_press_event_t* ev, xcb_keysym_t keysym, client* c);
+
+int luaA_key_new_set(lua_State* L);
+
+} // namespace KeySet
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
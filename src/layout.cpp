@@ -0,0 +1,218 @@
+/*
+ * layout.cpp - native layout engine
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "layout.h"
+
+#include "luaa.h"
+
+#include <array>
+#include <cmath>
+#include <utility>
+
+namespace Layout {
+
+static constexpr std::array<std::pair<std::string_view, Suit>, 6> suit_names = {
+  {{"fairv", Suit::FairV},
+   {"fairh", Suit::FairH},
+   {"spiral", Suit::Spiral},
+   {"dwindle", Suit::Dwindle},
+   {"max", Suit::Max},
+   {"fullscreen", Suit::Fullscreen}}
+};
+
+/** A rectangle with signed sizes, as the intermediate results can be empty */
+struct rect {
+    int x, y, width, height;
+
+    operator area_t() const {
+        return {
+          {x, y},
+          uint16_t(std::max(width, 0)), uint16_t(std::max(height, 0))
+        };
+    }
+};
+
+static int ceil_div(int a, int b) { return int(std::ceil(double(a) / b)); }
+
+static void arrange_fair(std::vector<area_t>& out, rect wa, int n, bool east) {
+    if (east) {
+        std::swap(wa.width, wa.height);
+        std::swap(wa.x, wa.y);
+    }
+
+    int rows, cols;
+    if (n == 2) {
+        rows = 1;
+        cols = 2;
+    } else {
+        rows = int(std::ceil(std::sqrt(double(n))));
+        cols = ceil_div(n, rows);
+    }
+
+    for (int k = 0; k < n; k++) {
+        const int row = k % rows;
+        const int col = k / rows;
+
+        const int lrows = k >= rows * cols - rows ? n - (rows * cols - rows) : rows;
+        const int lcols = cols;
+
+        rect g;
+        if (row == lrows - 1) {
+            g.height = wa.height - ceil_div(wa.height, lrows) * row;
+            g.y = wa.height - g.height;
+        } else {
+            g.height = ceil_div(wa.height, lrows);
+            g.y = g.height * row;
+        }
+
+        if (col == lcols - 1) {
+            g.width = wa.width - ceil_div(wa.width, lcols) * col;
+            g.x = wa.width - g.width;
+        } else {
+            g.width = ceil_div(wa.width, lcols);
+            g.x = g.width * col;
+        }
+
+        g.x += wa.x;
+        g.y += wa.y;
+
+        if (east) {
+            std::swap(g.width, g.height);
+            std::swap(g.x, g.y);
+        }
+
+        out.push_back(g);
+    }
+}
+
+static void arrange_spiral(std::vector<area_t>& out, rect wa, int n, bool is_spiral) {
+    int old_width = wa.width, old_height = 2 * wa.height;
+
+    for (int k = 1; k <= n; k++) {
+        if (k % 2 == 0) {
+            old_width = std::exchange(wa.width, ceil_div(old_width, 2));
+            if (k != n) {
+                old_height = std::exchange(wa.height, int(std::floor(wa.height / 2.0)));
+            }
+        } else {
+            old_height = std::exchange(wa.height, ceil_div(old_height, 2));
+            if (k != n) {
+                old_width = std::exchange(wa.width, int(std::floor(wa.width / 2.0)));
+            }
+        }
+
+        if (k % 4 == 0 && is_spiral) {
+            wa.x -= wa.width;
+        } else if (k % 2 == 0) {
+            wa.x += old_width;
+        } else if (k % 4 == 3 && k < n && is_spiral) {
+            wa.x += ceil_div(old_width, 2);
+        }
+
+        if (k % 4 == 1 && k != 1 && is_spiral) {
+            wa.y -= wa.height;
+        } else if (k % 2 == 1 && k != 1) {
+            wa.y += old_height;
+        } else if (k % 4 == 0 && k < n && is_spiral) {
+            wa.y += ceil_div(old_height, 2);
+        }
+
+        out.push_back(wa);
+    }
+}
+
+std::optional<Suit> find(std::string_view name) {
+    for (const auto& [suit_name, suit] : suit_names) {
+        if (suit_name == name) {
+            return suit;
+        }
+    }
+    return {};
+}
+
+bool uses_screen_geometry(Suit suit) { return suit == Suit::Fullscreen; }
+
+std::vector<area_t> arrange(Suit suit, area_t area, size_t n) {
+    std::vector<area_t> out;
+    out.reserve(n);
+    const rect wa{area.top_left.x, area.top_left.y, area.width, area.height};
+
+    switch (suit) {
+    case Suit::FairV:
+    case Suit::FairH: arrange_fair(out, wa, int(n), suit == Suit::FairH); break;
+    case Suit::Spiral:
+    case Suit::Dwindle: arrange_spiral(out, wa, int(n), suit == Suit::Spiral); break;
+    case Suit::Max:
+    case Suit::Fullscreen: out.assign(n, area); break;
+    }
+
+    return out;
+}
+
+static area_t checkarea(lua_State* L, int idx) {
+    Lua::checktable(L, idx);
+    return {
+      {Lua::getopt_integer(L, idx, "x", 0), Lua::getopt_integer(L, idx, "y", 0)},
+      uint16_t(Lua::getopt_integer(L, idx, "width", 0)),
+      uint16_t(Lua::getopt_integer(L, idx, "height", 0))
+    };
+}
+
+/** Compute a standard layout natively.
+ *
+ * This fills `params.geometries` the same way as the `arrange` function of the
+ * Lua layouts in `awful.layout.suit`.
+ *
+ * @tparam string name The layout name (`fairv`, `fairh`, `spiral`, `dwindle`,
+ *   `max` or `fullscreen`).
+ * @tparam table params The layout parameters, as given to `arrange`.
+ * @treturn boolean Whether the layout is known. If not, nothing was done.
+ * @staticfct _layout_arrange
+ */
+int luaA_layout_arrange(lua_State* L) {
+    auto suit = find(luaL_checkstring(L, 1));
+    if (!suit) {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+    Lua::checktable(L, 2);
+
+    lua_getfield(L, 2, uses_screen_geometry(*suit) ? "geometry" : "workarea");
+    const area_t area = checkarea(L, -1);
+    lua_getfield(L, 2, "clients");
+    Lua::checktable(L, -1);
+    const int clients_idx = lua_gettop(L);
+    lua_getfield(L, 2, "geometries");
+    Lua::checktable(L, -1);
+    const int geometries_idx = lua_gettop(L);
+
+    const auto geometries = arrange(*suit, area, Lua::rawlen(L, clients_idx));
+    for (size_t i = 0; i < geometries.size(); i++) {
+        lua_rawgeti(L, clients_idx, i + 1);
+        Lua::pusharea(L, geometries[i]);
+        lua_settable(L, geometries_idx);
+    }
+
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+} // namespace Layout
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
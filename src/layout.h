@@ -0,0 +1,64 @@
+/*
+ * layout.h - native layout engine header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+#include "draw.h"
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace Layout {
+
+/** The layout suits computed natively.
+ * The tile suits are not among them: they keep per-tag window factors in Lua
+ * data and apply each client's size hints while placing its column, so they
+ * stay in awful.layout.suit.tile.
+ */
+enum class Suit : uint8_t {
+    FairV,
+    FairH,
+    Spiral,
+    Dwindle,
+    Max,
+    Fullscreen,
+};
+
+/** Find a suit by its awful.layout name (`fairv`, `spiral`, ...). */
+std::optional<Suit> find(std::string_view name);
+
+/** Whether a suit covers the whole screen instead of the workarea. */
+bool uses_screen_geometry(Suit suit);
+
+/** Compute the geometry of every client of a layout.
+ * The results are the same as the Lua implementations in awful.layout.suit.
+ * \param suit The layout.
+ * \param area The area to tile, the workarea or the screen geometry.
+ * \param n The number of clients.
+ * \return The geometry of each client, in the order of the client list.
+ */
+std::vector<area_t> arrange(Suit suit, area_t area, size_t n);
+
+int luaA_layout_arrange(lua_State* L);
+
+} // namespace Layout
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
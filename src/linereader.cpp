@@ -0,0 +1,231 @@
+/*
+ * linereader.cpp - native line reader for pipes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "linereader.h"
+
+#include "globalconf.h"
+#include "luaa.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <glib-unix.h>
+#include <glib.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+namespace LineReader {
+
+namespace {
+
+/** How much is read from a pipe per main loop iteration */
+constexpr size_t read_chunk = 64 * 1024;
+
+struct Reader {
+    int fd;
+    /** Limits from Lua, 0 means unlimited */
+    size_t max_line, max_batch;
+    Lua::FunctionRegistryIdx callback;
+    /** Data read so far, everything before `pos` was delivered */
+    std::string buffer;
+    size_t pos = 0;
+    bool eof = false;
+    std::string error;
+    /** The fd watch while more input is wanted */
+    guint watch = 0;
+    /** The idle source while lines are waiting to be delivered */
+    guint idle = 0;
+};
+
+gboolean on_readable(gint fd, GIOCondition condition, gpointer data);
+gboolean on_idle(gpointer data);
+
+/** Take the next line out of the buffer.
+ * \param r The reader.
+ * \param line Where to store the line, without its newline.
+ * \return False if there is no complete line.
+ */
+bool next_line(Reader& r, std::string_view& line) {
+    const std::string_view rest = std::string_view(r.buffer).substr(r.pos);
+    if (rest.empty()) {
+        return false;
+    }
+    size_t end = rest.find('\n');
+    if (r.max_line && (end == std::string_view::npos ? rest.size() : end) > r.max_line) {
+        /* Too long, split it */
+        line = rest.substr(0, r.max_line);
+        r.pos += r.max_line;
+        return true;
+    }
+    if (end == std::string_view::npos) {
+        if (!r.eof) {
+            return false;
+        }
+        /* The last line has no newline */
+        end = rest.size();
+    }
+    line = rest.substr(0, end);
+    r.pos += std::min(end + 1, rest.size());
+    return true;
+}
+
+bool has_line(const Reader& r) {
+    const size_t left = r.buffer.size() - r.pos;
+    return left > 0 && (r.eof || (r.max_line && left > r.max_line) ||
+                        r.buffer.find('\n', r.pos) != std::string::npos);
+}
+
+void finish(lua_State* L, Reader* r) {
+    if (r->watch) {
+        g_source_remove(r->watch);
+    }
+    if (r->idle) {
+        g_source_remove(r->idle);
+    }
+    close(r->fd);
+
+    lua_pushnil(L);
+    if (r->error.empty()) {
+        lua_pushnil(L);
+    } else {
+        lua_pushstring(L, r->error.c_str());
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, r->callback.idx.idx);
+    Lua::dofunction(L, 2, 0);
+    Lua::unregister(L, &r->callback);
+    delete r;
+}
+
+/** Hand a batch of lines to Lua and decide how to continue.
+ * While lines are left over, the pipe is not read and the rest is delivered
+ * by the next main loop iterations.
+ */
+void deliver(Reader* r) {
+    lua_State* L = globalconf_get_lua_State();
+
+    std::string_view line;
+    int count = 0;
+    lua_newtable(L);
+    while ((!r->max_batch || size_t(count) < r->max_batch) && next_line(*r, line)) {
+        lua_pushlstring(L, line.data(), line.size());
+        lua_rawseti(L, -2, ++count);
+    }
+    if (count > 0) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, r->callback.idx.idx);
+        Lua::dofunction(L, 1, 0);
+    } else {
+        lua_pop(L, 1);
+    }
+
+    /* Keep the buffer, only drop what was delivered */
+    r->buffer.erase(0, r->pos);
+    r->pos = 0;
+
+    if (has_line(*r)) {
+        if (r->watch) {
+            g_source_remove(r->watch);
+            r->watch = 0;
+        }
+        if (!r->idle) {
+            r->idle = g_idle_add(on_idle, r);
+        }
+    } else if (r->eof) {
+        finish(L, r);
+    } else if (!r->watch) {
+        r->watch = g_unix_fd_add(r->fd, GIOCondition(G_IO_IN | G_IO_HUP | G_IO_ERR), on_readable, r);
+    }
+}
+
+gboolean on_readable(gint fd, GIOCondition, gpointer data) {
+    auto r = static_cast<Reader*>(data);
+    size_t total = 0;
+    while (total < read_chunk) {
+        const size_t old_size = r->buffer.size();
+        r->buffer.resize(old_size + 4096);
+        const ssize_t n = read(fd, r->buffer.data() + old_size, 4096);
+        r->buffer.resize(old_size + std::max<ssize_t>(n, 0));
+        if (n > 0) {
+            total += n;
+            continue;
+        }
+        if (n == 0) {
+            r->eof = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN) {
+            r->error = g_strerror(errno);
+            r->eof = true;
+        }
+        break;
+    }
+
+    /* deliver() sets up the sources it needs again */
+    r->watch = 0;
+    deliver(r);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean on_idle(gpointer data) {
+    auto r = static_cast<Reader*>(data);
+    r->idle = 0;
+    deliver(r);
+    return G_SOURCE_REMOVE;
+}
+
+} // namespace
+
+/** Read lines from a file descriptor without blocking.
+ *
+ * The lines are split natively and handed to the callback in batches, one
+ * call per main loop iteration, as an array of strings without their newline.
+ * At the end of the input the callback is called with nil, and an error
+ * message if reading failed. The file descriptor is closed then.
+ *
+ * @tparam integer fd The file descriptor, e.g. a pipe from `awesome.spawn`.
+ * @tparam function callback Called with an array of lines, or with nil and an
+ *   optional error message at the end.
+ * @tparam[opt=0] integer max_line Lines longer than this many bytes are split,
+ *   0 means no limit.
+ * @tparam[opt=0] integer max_batch The maximum number of lines per call, 0
+ *   means no limit.
+ * @staticfct read_lines
+ * @noreturn
+ */
+int luaA_read_lines(lua_State* L) {
+    const int fd = Lua::checkinteger_range(L, 1, 0, INT_MAX);
+    Lua::checkfunction(L, 2);
+    const size_t max_line = Lua::optinteger(L, 3, 0) > 0 ? Lua::optinteger(L, 3, 0) : 0;
+    const size_t max_batch = Lua::optinteger(L, 4, 0) > 0 ? Lua::optinteger(L, 4, 0) : 0;
+
+    const int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return luaL_error(L, "read_lines: %s", g_strerror(errno));
+    }
+
+    auto r = new Reader{fd, max_line, max_batch, {}, {}, 0, false, {}, 0, 0};
+    Lua::registerfct(L, 2, &r->callback);
+    r->watch = g_unix_fd_add(fd, GIOCondition(G_IO_IN | G_IO_HUP | G_IO_ERR), on_readable, r);
+    return 0;
+}
+
+} // namespace LineReader
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -45,13 +45,24 @@
 #endif
 
 #include "awesome.h"
+#include "common/atoms.h"
 #include "common/backtrace.h"
+#include "common/log.h"
 #include "common/version.h"
+#include "common/xutil.h"
 #include "config.h"
 #include "event.h"
+#include "eventlog.h"
 #include "globalconf.h"
 #include "globals.h"
+#include "iconcache.h"
+#include "imageloader.h"
+#include "layout.h"
+#include "linereader.h"
 #include "luaa.h"
+#include "luaalloc.h"
+#include "luacache.h"
+#include "memstats.h"
 #include "objects/client.h"
 #include "objects/drawable.h"
 #include "objects/drawin.h"
@@ -61,10 +72,18 @@
 #include "objects/selection_transfer.h"
 #include "objects/selection_watcher.h"
 #include "objects/tag.h"
+#include "profiler.h"
 #include "property.h"
+#include "reload.h"
+#include "rulematch.h"
 #include "selection.h"
+#include "signalprofile.h"
 #include "spawn.h"
 #include "systray.h"
+#include "textlayout.h"
+#include "timerwheel.h"
+#include "trace.h"
+#include "widgethierarchy.h"
 #include "xkb.h"
 #include "xrdb.h"
 /* for strings and Unicode handling */
@@ -132,6 +151,23 @@ Signals global_signals;
  * @signal wallpaper_changed
  */
 
+/** The X resources have changed.
+ *
+ * This is emitted when the `RESOURCE_MANAGER` property of the root window
+ * changed, after the resources returned by `awesome.xrdb_get_value` were
+ * updated.
+ *
+ * @tparam table names The names of the resources looked up before whose value
+ *  changed.
+ * @signal xrdb_changed
+ */
+
+/** A composite manager started or stopped.
+ *
+ * @tparam boolean running The new value of `awesome.composite_manager_running`.
+ * @signal compositor::changed
+ */
+
 /** Keyboard map has changed.
  *
  * This signal is sent after the new keymap has been loaded. It is used in
@@ -141,8 +177,11 @@ Signals global_signals;
 
 /** Keyboard group has changed.
  *
- * It's used in `awful.widget.keyboardlayout` to redraw the layout.
- * @tparam number group Integer containing the changed group
+ * It's used in `awful.widget.keyboardlayout` to redraw the layout. The state
+ * notifications of one main loop iteration are reported at most once, and not
+ * at all when the group ends up unchanged.
+ * @tparam number group Integer containing the new group
+ * @tparam number|nil old_group The group reported before, nil if unknown
  * @signal xkb::group_changed.
  */
 
@@ -159,6 +198,13 @@ Signals global_signals;
  * @signal startup
  */
 
+/** The configuration is about to be reloaded by `awesome.reload`.
+ *
+ * The handlers of this signal are the last ones of the current configuration
+ * to run.
+ * @signal reload
+ */
+
 /** AwesomeWM is exiting / about to restart.
  *
  * This signal is emitted in the `atexit` handler as well when awesome
@@ -180,30 +226,64 @@ Signals global_signals;
 /** Path to config file */
 std::filesystem::path conffile;
 
-/** Check whether a composite manager is running.
+/** The _NET_WM_CM_Sn selection of the screen */
+static xcb_atom_t composite_manager_atom = XCB_NONE;
+/** Whether a composite manager is running, if its selection is watched */
+static std::optional<bool> composite_manager;
+
+/** Ask the X server whether a composite manager is running.
  * \return True if such a manager is running.
  */
-static bool composite_manager_running(void) {
+static bool composite_manager_query(void) {
+    if (composite_manager_atom == XCB_NONE) {
+        return false;
+    }
+
+    auto selection_r = getConnection().get_selection_owner_reply(
+      getConnection().get_selection_owner_unchecked(composite_manager_atom));
+
+    return selection_r && selection_r->owner != XCB_NONE;
+}
+
+static void composite_manager_changed(xcb_window_t owner) {
+    const bool running = owner != XCB_NONE;
+    if (composite_manager == running) {
+        return;
+    }
+    composite_manager = running;
+
+    lua_State* L = globalconf_get_lua_State();
+    lua_pushboolean(L, running);
+    signal_object_emit(L, &global_signals, "compositor::changed"_sig, 1);
+}
+
+/** Start tracking the composite manager selection. */
+static void composite_manager_watch(void) {
     char* atom_name;
-    bool result;
 
     if (!(atom_name = xcb_atom_name_by_screen("_NET_WM_CM", Manager::get().x.default_screen))) {
         log_warn("error getting composite manager atom");
-        return false;
+        return;
     }
 
-    auto atom_r = getConnection().intern_atom_reply(
-      getConnection().intern_atom_unchecked(false, strlen(atom_name), atom_name));
+    composite_manager_atom = atoms_get(getConnection().getConnection(), atom_name);
     p_delete(&atom_name);
-    if (!atom_r) {
-        return false;
+    if (composite_manager_atom == XCB_NONE) {
+        return;
     }
 
-    auto selection_r = getConnection().get_selection_owner_reply(
-      getConnection().get_selection_owner_unchecked(atom_r->atom));
+    /* Watch first, so that no change is missed between the query and the
+     * first event. Without XFixes, the owner is asked for on every read. */
+    if (selection_watch_owner(composite_manager_atom, composite_manager_changed)) {
+        composite_manager = composite_manager_query();
+    }
+}
 
-    result = selection_r && selection_r->owner != XCB_NONE;
-    return result;
+/** Check whether a composite manager is running.
+ * \return True if such a manager is running.
+ */
+static bool composite_manager_running(void) {
+    return composite_manager ? *composite_manager : composite_manager_query();
 }
 /** Quit awesome.
  * @tparam[opt=0] integer code The exit code to use when exiting.
@@ -289,6 +369,27 @@ static int pixbuf_to_surface(lua_State* L) {
     return 1;
 }
 
+/** Create an image surface shared with the X server.
+ *
+ * Drawing into this surface works like with any cairo image surface. Once
+ * copied to a drawable with `drawable:upload`, its content does not go through
+ * the X connection. When MIT-SHM is not available (e.g. with a remote
+ * display), this is a plain image surface.
+ *
+ * @tparam integer width The width of the surface.
+ * @tparam integer height The height of the surface.
+ * @treturn gears.surface A cairo surface as light user datum.
+ * @staticfct create_shm_surface
+ */
+static int create_shm_surface(lua_State* L) {
+    const int width = checkinteger_range(L, 1, 1, MAX_X11_SIZE);
+    const int height = checkinteger_range(L, 2, 1, MAX_X11_SIZE);
+
+    /* lua has to make sure to free the ref or we have a leak */
+    lua_pushlightuserdata(L, draw_shm_surface_create(width, height));
+    return 1;
+}
+
 /** Load an image from a given path.
  *
  * @tparam string name The file name.
@@ -330,6 +431,152 @@ static int set_preferred_icon_size(lua_State* L) {
     return 0;
 }
 
+/** Only fetch client icons when they are used.
+ *
+ * By default `_NET_WM_ICON` is read and decoded when a client is managed and
+ * whenever it changes. When enabled, it is only marked as changed (and
+ * `property::icon` is emitted) and read the first time `c.icon`,
+ * `c.icon_sizes` or `c:get_icon()` is used afterwards. This makes managing
+ * clients cheaper when no icons are shown.
+ *
+ * @tparam boolean enable Whether to fetch icons lazily.
+ * @staticfct set_lazy_icons
+ * @noreturn
+ */
+static int set_lazy_icons(lua_State* L) {
+    Manager::get().lazy_icons = checkboolean(L, 1);
+    return 0;
+}
+
+/** Set how much garbage collection is done while the main loop is idle.
+ *
+ * Before the main loop waits for events, the Lua garbage collector does a step
+ * of roughly the given amount of work, so that less of it is left to be
+ * triggered by allocations while events are handled. Once a collection cycle
+ * is complete, no steps are made until more memory was allocated. The time
+ * spent is reported as the `gc` phase of `awesome.loop_stats`. The default is
+ * 16 KiB.
+ *
+ * @tparam integer kib The amount of work per step in KiB, 0 disables it.
+ * @staticfct set_idle_gc_step
+ * @noreturn
+ */
+static int set_idle_gc_step(lua_State* L) {
+    Manager::get().idle_gc_step = Lua::checkinteger_range(L, 1, 0, INT_MAX);
+    return 0;
+}
+
+/** Cap how often the deferred work of the main loop is done.
+ *
+ * Input is still handled as soon as it arrives, but the geometry, stacking and
+ * drawing passes and the flush to the X server run at most once per frame.
+ * Without a rate, frames follow the highest refresh rate of the monitors as
+ * reported by RandR, or 60 Hz if it is unknown. Focus changes are always
+ * applied right away.
+ *
+ * @tparam boolean enable Whether to pace the refreshes.
+ * @tparam[opt=0] number rate The frames per second, 0 follows the monitors.
+ * @staticfct set_frame_pacing
+ * @noreturn
+ */
+static int set_frame_pacing(lua_State* L) {
+    auto& pacing = Manager::get().frame_pacing;
+    pacing.enabled = checkboolean(L, 1);
+    pacing.rate = Lua::optnumber_range(L, 2, 0, 0, 1000);
+    if (pacing.enabled) {
+        screen_update_frame_interval();
+    }
+    return 0;
+}
+
+/** Set how much memory decoded client icons may use.
+ *
+ * Client icons are shared between clients with identical icons and only
+ * decoded when they are used. Decoded icons beyond this budget are dropped,
+ * least recently used first, and decoded again when needed.
+ *
+ * @tparam integer bytes The budget in bytes.
+ * @staticfct set_icon_cache_limit
+ * @noreturn
+ */
+static int set_icon_cache_limit(lua_State* L) {
+    IconCache::set_limit(Lua::checkinteger_range(L, 1, 0, INT32_MAX));
+    return 0;
+}
+
+/** Set how much memory shared text layouts may use.
+ *
+ * Textboxes showing the same text with the same settings and size share one
+ * layout, see `awesome.text_layout`. Layouts beyond this budget are dropped,
+ * least recently used first, and shaped again when needed.
+ *
+ * @tparam integer bytes The budget in bytes.
+ * @staticfct set_text_layout_cache_limit
+ * @noreturn
+ */
+static int set_text_layout_cache_limit(lua_State* L) {
+    TextLayout::set_limit(Lua::checkinteger_range(L, 1, 0, INT32_MAX));
+    return 0;
+}
+
+/** Change how the messages of awesome are logged.
+ *
+ * Messages are written by a background thread. Each place in the code may log
+ * a limited number of messages per second, the next message from there tells
+ * how many were suppressed. Only the given options are changed.
+ *
+ * @tparam table args
+ * @tparam[opt="warning"] string args.level "warning" for all messages or
+ *  "error" for fatal errors only.
+ * @tparam[opt=false] boolean args.json Write one JSON object per line.
+ * @tparam[opt=true] boolean args.async Write from a background thread.
+ * @tparam[opt=20] integer args.rate_limit The messages per second allowed from
+ *  one place, 0 for no limit.
+ * @staticfct set_log_options
+ * @noreturn
+ */
+static int set_log_options(lua_State* L) {
+    Lua::checktable(L, 1);
+    lua_getfield(L, 1, "level");
+    if (!lua_isnil(L, -1)) {
+        const auto level = Lua::checkstring(L, -1);
+        if (level != "warning" && level != "error") {
+            luaL_error(L, "unknown log level: %s", lua_tostring(L, -1));
+        }
+        Log::set_warnings(level == "warning");
+    }
+    lua_getfield(L, 1, "json");
+    if (!lua_isnil(L, -1)) {
+        Log::set_json(lua_toboolean(L, -1));
+    }
+    lua_getfield(L, 1, "async");
+    if (!lua_isnil(L, -1)) {
+        Log::set_async(lua_toboolean(L, -1));
+    }
+    lua_getfield(L, 1, "rate_limit");
+    if (!lua_isnil(L, -1)) {
+        Log::set_rate_limit(Lua::checkinteger_range(L, -1, 0, INT32_MAX));
+    }
+    return 0;
+}
+
+/** Deliver property signals once per main loop iteration.
+ *
+ * When enabled, `property::*` signals without arguments are not emitted right
+ * away. They are queued per object and signal and delivered once after the
+ * `refresh` signal, so that moving a client several times during a layout
+ * pass only emits e.g. `property::geometry` once. This can also be enabled for
+ * a single class with `client.set_defer_property_signals(true)`.
+ *
+ * @tparam boolean enable Whether to defer property signals of all classes.
+ * @staticfct set_defer_property_signals
+ * @noreturn
+ */
+static int set_defer_property_signals(lua_State* L) {
+    luaA_object_set_defer_property_signals(checkboolean(L, 1));
+    return 0;
+}
+
 /** UTF-8 aware string length computing.
  * \param L The Lua VM state.
  * \return The number of elements pushed on stack.
@@ -636,7 +883,8 @@ static int get_active_modifiers(lua_State* L) {
  */
 
 /**
- * True if we are still in startup, false otherwise.
+ * True if we are still in startup, false otherwise. It is also true while
+ * `awesome.reload` runs the configuration again.
  * @tfield boolean startup
  */
 
@@ -648,6 +896,10 @@ static int get_active_modifiers(lua_State* L) {
 
 /**
  * True if a composite manager is running.
+ *
+ * This is tracked through XFixes and does not ask the X server, see
+ * `compositor::changed`.
+ *
  * @tfield boolean composite_manager_running
  */
 
@@ -699,7 +951,7 @@ static int awesome_index(lua_State* L) {
     }
 
     if (buf == "startup") {
-        lua_pushboolean(L, Manager::get().loop == NULL);
+        lua_pushboolean(L, Manager::get().loop == NULL || Reload::running());
         return 1;
     }
 
@@ -844,7 +1096,7 @@ static int dofunction_on_error(lua_State* L) {
     /* duplicate string error */
     lua_pushvalue(L, -1);
     /* emit error signal */
-    signal_object_emit(L, &global_signals, "debug::error", 1);
+    signal_object_emit(L, &global_signals, "debug::error"_sig, 1);
 
     if (!luaL_dostring(L, "return debug.traceback(\"error while running function!\", 3)")) {
         /* Move traceback before error */
@@ -1000,33 +1252,68 @@ static void add_to_search_path(lua_State* L, const Paths& searchpath, bool for_l
 void init(xdgHandle* xdg, const Paths& searchpath) {
     lua_State* L;
     static const struct luaL_Reg awesome_lib[] = {
-      {                   "quit",                      Lua::quit},
-      {                   "exec",                      Lua::exec},
-      {                  "spawn",                     luaA_spawn},
-      {                "restart",                   Lua::restart},
-      {         "connect_signal",    Lua::awesome_connect_signal},
-      {      "disconnect_signal", Lua::awesome_disconnect_signal},
-      {            "emit_signal",       Lua::awesome_emit_signal},
-      {                "systray",                   luaA_systray},
-      {             "load_image",                Lua::load_image},
-      {      "pixbuf_to_surface",         Lua::pixbuf_to_surface},
-      {"set_preferred_icon_size",   Lua::set_preferred_icon_size},
-      {     "register_xproperty",        luaA_register_xproperty},
-      {          "set_xproperty",             luaA_set_xproperty},
-      {          "get_xproperty",             luaA_get_xproperty},
-      {                "__index",             Lua::awesome_index},
-      {             "__newindex",          Lua::default_newindex},
-      {   "xkb_set_layout_group",      luaA_xkb_set_layout_group},
-      {   "xkb_get_layout_group",      luaA_xkb_get_layout_group},
-      {    "xkb_get_group_names",       luaA_xkb_get_group_names},
-      {         "xrdb_get_value",            luaA_xrdb_get_value},
-      {                   "kill",                      Lua::kill},
-      {                   "sync",                      Lua::sync},
-      {          "_get_key_name",              Lua::get_key_name},
-      {                     NULL,                           NULL}
+      {                       "quit",                             Lua::quit},
+      {                       "exec",                             Lua::exec},
+      {                      "spawn",                            luaA_spawn},
+      {          "set_spawn_backend",                luaA_set_spawn_backend},
+      {                 "read_lines",           LineReader::luaA_read_lines},
+      {                    "restart",                          Lua::restart},
+      {                     "reload",                    Reload::luaA_reload},
+      {             "connect_signal",           Lua::awesome_connect_signal},
+      {          "disconnect_signal",        Lua::awesome_disconnect_signal},
+      {                "emit_signal",              Lua::awesome_emit_signal},
+      {                    "systray",                          luaA_systray},
+      {                 "load_image",                       Lua::load_image},
+      {           "load_image_async",    ImageLoader::luaA_load_image_async},
+      {           "save_image_async",    ImageLoader::luaA_save_image_async},
+      {          "pixbuf_to_surface",                Lua::pixbuf_to_surface},
+      {         "create_shm_surface",               Lua::create_shm_surface},
+      {    "set_preferred_icon_size",          Lua::set_preferred_icon_size},
+      {       "set_icon_cache_limit",             Lua::set_icon_cache_limit},
+      {"set_text_layout_cache_limit",      Lua::set_text_layout_cache_limit},
+      {            "set_log_options",                  Lua::set_log_options},
+      {                "text_layout",          TextLayout::luaA_text_layout},
+      {           "text_layout_size",     TextLayout::luaA_text_layout_size},
+      {             "set_lazy_icons",                   Lua::set_lazy_icons},
+      {           "set_idle_gc_step",                 Lua::set_idle_gc_step},
+      {           "set_frame_pacing",                 Lua::set_frame_pacing},
+      { "set_defer_property_signals",       Lua::set_defer_property_signals},
+      {         "register_xproperty",               luaA_register_xproperty},
+      {              "set_xproperty",                    luaA_set_xproperty},
+      {              "get_xproperty",                    luaA_get_xproperty},
+      {                    "__index",                    Lua::awesome_index},
+      {                 "__newindex",                 Lua::default_newindex},
+      {       "xkb_set_layout_group",             luaA_xkb_set_layout_group},
+      {       "xkb_get_layout_group",             luaA_xkb_get_layout_group},
+      {        "xkb_get_group_names",              luaA_xkb_get_group_names},
+      {             "xrdb_get_value",                   luaA_xrdb_get_value},
+      {                       "kill",                             Lua::kill},
+      {                       "sync",                             Lua::sync},
+      {              "_get_key_name",                     Lua::get_key_name},
+      {                 "loop_stats",             Profiler::luaA_loop_stats},
+      {               "memory_stats",           MemStats::luaA_memory_stats},
+      {                    "x_stats",                Profiler::luaA_x_stats},
+      {                "x_resources",            Profiler::luaA_x_resources},
+      {         "set_x_wait_warning",     Profiler::luaA_set_x_wait_warning},
+      {                "input_stats",            Profiler::luaA_input_stats},
+      {  "set_input_latency_warning",      Profiler::luaA_set_input_warning},
+      {           "startup_timeline",       Profiler::luaA_startup_timeline},
+      {                "trace_start",               Trace::luaA_trace_start},
+      {                 "trace_stop",                Trace::luaA_trace_stop},
+      {         "event_record_start",     EventLog::luaA_event_record_start},
+      {          "event_record_stop",      EventLog::luaA_event_record_stop},
+      {                "timer_start",          TimerWheel::luaA_timer_start},
+      {                 "timer_stop",           TimerWheel::luaA_timer_stop},
+      {             "signal_profile",           SignalProfile::luaA_profile},
+      {            "_layout_arrange",           Layout::luaA_layout_arrange},
+      {             "_rules_compile",         RuleMatch::luaA_rules_compile},
+      {               "_rules_match",           RuleMatch::luaA_rules_match},
+      {           "_hierarchy_setup", WidgetHierarchy::luaA_hierarchy_setup},
+      {            "_hierarchy_node",  WidgetHierarchy::luaA_hierarchy_node},
+      {                         NULL,                                  NULL}
     };
 
-    L = Manager::get().L.real_L_dont_use_directly = luaL_newstate();
+    L = Manager::get().L.real_L_dont_use_directly = LuaAlloc::newstate();
 
     /* Set panic function */
     lua_atpanic(L, Lua::panic);
@@ -1099,6 +1386,7 @@ void init(xdgHandle* xdg, const Paths& searchpath) {
 
     /* Export selection watcher */
     selection_watcher_class_setup(L);
+    composite_manager_watch();
 
     /* Setup the selection interface */
     selection_setup(L);
@@ -1118,6 +1406,9 @@ void init(xdgHandle* xdg, const Paths& searchpath) {
     lua_setfield(L, 1, "cpath"); /* package.cpath = "concatenated string" */
 
     lua_pop(L, 1); /* pop "package" */
+
+    LuaCache::install(L, xdg);
+    Profiler::startup_wrap_require(L);
 }
 
 static void startup_error(const char* err) {
@@ -1128,9 +1419,9 @@ static void startup_error(const char* err) {
     Manager::get().startup_errors += std::format("Startup:{}", err);
 }
 
-static bool loadrc(const std::filesystem::path& path) {
+bool loadrc(const std::filesystem::path& path) {
     lua_State* L = globalconf_get_lua_State();
-    if (luaL_loadfile(L, path.c_str())) {
+    if (LuaCache::loadfile(L, path.c_str())) {
         const char* err = lua_tostring(L, -1);
         startup_error(err);
         fprintf(stderr, "%s\n", err);
@@ -1209,23 +1500,26 @@ std::optional<std::filesystem::path> find_config(xdgHandle* xdg,
 }
 
 int class_index_miss_property(lua_State* L, lua_object_t* obj) {
-    signal_object_emit(L, &global_signals, "debug::index::miss", 2);
+    signal_object_emit(L, &global_signals, "debug::index::miss"_sig, 2);
     return 0;
 }
 
 int class_newindex_miss_property(lua_State* L, lua_object_t* obj) {
-    signal_object_emit(L, &global_signals, "debug::newindex::miss", 3);
+    signal_object_emit(L, &global_signals, "debug::newindex::miss"_sig, 3);
     return 0;
 }
 
 void emit_startup() {
     lua_State* L = globalconf_get_lua_State();
-    signal_object_emit(L, &global_signals, "startup", 0);
+    signal_object_emit(L, &global_signals, "startup"_sig, 0);
 }
 
 void emit_refresh() {
     lua_State* L = globalconf_get_lua_State();
-    signal_object_emit(L, &global_signals, "refresh", 0);
+    signal_object_emit(L, &global_signals, "refresh"_sig, 0);
+    /* Layouts run from the refresh signal, so this is where property signals
+     * pile up */
+    luaA_object_emit_deferred_signals(L);
 }
 
 int default_index(lua_State* L) { return class_index_miss_property(L, NULL); }
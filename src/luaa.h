@@ -45,7 +45,7 @@ struct lua_object_t;
         Lua::warn(                                                                               \
           L, "%s: This function is deprecated and will be removed, see %s", __FUNCTION__, repl); \
         lua_pushlstring(L, __FUNCTION__, sizeof(__FUNCTION__));                                  \
-        signal_object_emit(L, &Lua::global_signals, "debug::deprecation", 1);                    \
+        signal_object_emit(L, &Lua::global_signals, "debug::deprecation"_sig, 1);                \
     } while (0)
 
 namespace Lua {
@@ -312,6 +312,7 @@ void init(xdgHandle*, const Paths& searchPaths);
 std::optional<std::filesystem::path>
 find_config(xdgHandle*, std::optional<std::filesystem::path>, config_callback*);
 bool parserc(xdgHandle*, std::optional<std::filesystem::path>);
+bool loadrc(const std::filesystem::path&);
 
 /** Global signals */
 int class_index_miss_property(lua_State*, lua_object_t*);
@@ -0,0 +1,264 @@
+/*
+ * luaalloc.cpp - pooled and instrumented Lua allocator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "luaalloc.h"
+
+#include "common/util.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace LuaAlloc {
+
+namespace {
+
+/** The block sizes of the pools, multiples of 16 to keep blocks aligned */
+constexpr std::array<size_t, 10> class_sizes = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512};
+constexpr size_t max_small = class_sizes.back();
+constexpr size_t chunk_size = 64 * 1024;
+
+/** The size class of each size, by size / 16 rounded up */
+constexpr auto class_index = [] {
+    std::array<uint8_t, max_small / 16 + 1> index{};
+    size_t c = 0;
+    for (size_t i = 0; i < index.size(); i++) {
+        while (class_sizes[c] < i * 16) {
+            c++;
+        }
+        index[i] = c;
+    }
+    return index;
+}();
+
+size_t class_of(size_t size) { return class_index[(size + 15) / 16]; }
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct Pool {
+    FreeBlock* free = nullptr;
+    /** The unused end of the last chunk */
+    char* bump = nullptr;
+    char* bump_end = nullptr;
+    size_t chunks = 0;
+    /** Blocks in use */
+    int64_t live = 0;
+    /** Blocks handed out since the start */
+    uint64_t allocs = 0;
+};
+
+struct Counters {
+    uint64_t allocs = 0;
+    uint64_t bytes = 0;
+};
+
+std::array<Pool, class_sizes.size()> pools;
+/** Blocks too large for the pools */
+struct {
+    int64_t live = 0;
+    int64_t bytes = 0;
+    uint64_t allocs = 0;
+} large;
+/** By phase, Phase::Count being outside of any */
+std::array<Counters, size_t(Profiler::Phase::Count) + 1> by_phase;
+/** By signal id + 1, 0 being outside of handlers */
+std::vector<Counters> by_signal;
+bool in_use = false;
+
+void* pool_alloc(size_t c) {
+    Pool& pool = pools[c];
+    pool.live++;
+    pool.allocs++;
+    if (FreeBlock* block = pool.free) {
+        pool.free = block->next;
+        return block;
+    }
+    const size_t size = class_sizes[c];
+    if (pool.bump + size > pool.bump_end) {
+        auto chunk = static_cast<char*>(malloc(chunk_size));
+        if (!chunk) {
+            pool.live--;
+            return nullptr;
+        }
+        pool.chunks++;
+        pool.bump = chunk;
+        pool.bump_end = chunk + chunk_size;
+    }
+    void* block = pool.bump;
+    pool.bump += size;
+    return block;
+}
+
+void pool_free(size_t c, void* ptr) {
+    Pool& pool = pools[c];
+    auto block = static_cast<FreeBlock*>(ptr);
+    block->next = pool.free;
+    pool.free = block;
+    pool.live--;
+}
+
+void account(size_t size) {
+    auto& phase = by_phase[size_t(Profiler::current)];
+    phase.allocs++;
+    phase.bytes += size;
+    if (current_signal >= by_signal.size()) {
+        by_signal.resize(current_signal + 1);
+    }
+    auto& signal = by_signal[current_signal];
+    signal.allocs++;
+    signal.bytes += size;
+}
+
+void push_counters(lua_State* L, const Counters& counters) {
+    lua_createtable(L, 0, 2);
+    lua_pushinteger(L, counters.allocs);
+    lua_setfield(L, -2, "allocs");
+    lua_pushinteger(L, counters.bytes);
+    lua_setfield(L, -2, "bytes");
+}
+
+} // namespace
+
+void* allocate(void*, void* ptr, size_t osize, size_t nsize) {
+    /* Lua passes an unspecified old size for new blocks */
+    if (!ptr) {
+        osize = 0;
+    }
+
+    if (nsize == 0) {
+        if (osize > max_small) {
+            large.live--;
+            large.bytes -= osize;
+            free(ptr);
+        } else if (ptr) {
+            pool_free(class_of(osize), ptr);
+        }
+        return nullptr;
+    }
+
+    if (nsize > osize) {
+        account(nsize - osize);
+    }
+
+    if (osize > max_small && nsize > max_small) {
+        void* block = realloc(ptr, nsize);
+        if (block) {
+            large.bytes += int64_t(nsize) - int64_t(osize);
+        }
+        return block;
+    }
+    if (ptr && osize <= max_small && nsize <= max_small && class_of(osize) == class_of(nsize)) {
+        return ptr;
+    }
+
+    /* Between a pool and another or malloc */
+    void* block;
+    if (nsize > max_small) {
+        block = malloc(nsize);
+        if (block) {
+            large.live++;
+            large.bytes += nsize;
+            large.allocs++;
+        }
+    } else {
+        block = pool_alloc(class_of(nsize));
+    }
+    if (!block) {
+        return nullptr;
+    }
+    if (ptr) {
+        memcpy(block, ptr, std::min(osize, nsize));
+        allocate(nullptr, ptr, osize, 0);
+    }
+    return block;
+}
+
+lua_State* newstate() {
+    if (enabled) {
+        /* 64 bit LuaJIT builds without GC64 refuse custom allocators */
+        if (lua_State* L = lua_newstate(allocate, nullptr)) {
+            in_use = true;
+            return L;
+        }
+        log_warn("This Lua does not support the pool allocator, using the default one");
+    }
+    return luaL_newstate();
+}
+
+bool active() { return in_use; }
+
+void push_stats(lua_State* L) {
+    lua_createtable(L, 0, 4);
+
+    lua_createtable(L, class_sizes.size(), 0);
+    for (size_t c = 0; c < class_sizes.size(); c++) {
+        const Pool& pool = pools[c];
+        lua_createtable(L, 0, 5);
+        lua_pushinteger(L, class_sizes[c]);
+        lua_setfield(L, -2, "size");
+        lua_pushinteger(L, pool.live);
+        lua_setfield(L, -2, "count");
+        lua_pushinteger(L, pool.live * class_sizes[c]);
+        lua_setfield(L, -2, "bytes");
+        lua_pushinteger(L, pool.allocs);
+        lua_setfield(L, -2, "allocs");
+        lua_pushinteger(L, pool.chunks * chunk_size);
+        lua_setfield(L, -2, "reserved");
+        lua_rawseti(L, -2, c + 1);
+    }
+    lua_setfield(L, -2, "pools");
+
+    lua_createtable(L, 0, 3);
+    lua_pushinteger(L, large.live);
+    lua_setfield(L, -2, "count");
+    lua_pushinteger(L, large.bytes);
+    lua_setfield(L, -2, "bytes");
+    lua_pushinteger(L, large.allocs);
+    lua_setfield(L, -2, "allocs");
+    lua_setfield(L, -2, "large");
+
+    lua_createtable(L, 0, by_phase.size());
+    for (size_t i = 0; i < by_phase.size(); i++) {
+        if (by_phase[i].allocs) {
+            push_counters(L, by_phase[i]);
+            const auto phase = Profiler::Phase(i);
+            lua_setfield(
+              L, -2, phase == Profiler::Phase::Count ? "other" : Profiler::name(phase).data());
+        }
+    }
+    lua_setfield(L, -2, "phases");
+
+    lua_newtable(L);
+    for (size_t i = 1; i < by_signal.size(); i++) {
+        if (by_signal[i].allocs) {
+            push_counters(L, by_signal[i]);
+            lua_setfield(L, -2, signal_name(SignalId(i - 1)).c_str());
+        }
+    }
+    lua_setfield(L, -2, "signals");
+}
+
+} // namespace LuaAlloc
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
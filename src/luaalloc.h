@@ -0,0 +1,74 @@
+/*
+ * luaalloc.h - pooled and instrumented Lua allocator header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+#include "common/signal.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/** An optional allocator for the Lua state, enabled with --lua-alloc pool.
+ *
+ * Small blocks come from free lists of fixed size classes, carved from large
+ * chunks, larger ones from malloc. Every size class counts its blocks, and
+ * allocations are attributed to the main loop phase (see Profiler::Scope) and
+ * the signal whose handler is running when they are made.
+ */
+namespace LuaAlloc {
+
+/** Whether the Lua state should use the pool allocator */
+inline bool enabled = false;
+
+/** The signal whose handler runs, shifted by one, 0 outside of handlers */
+inline uint32_t current_signal = 0;
+
+/** Attribute the allocations made during the lifetime of this object to a
+ * signal. */
+class SignalScope {
+  public:
+    explicit SignalScope(SignalId id)
+      : _outer(current_signal) {
+        current_signal = uint32_t(id) + 1;
+    }
+    ~SignalScope() { current_signal = _outer; }
+    SignalScope(const SignalScope&) = delete;
+    SignalScope& operator=(const SignalScope&) = delete;
+
+  private:
+    uint32_t _outer;
+};
+
+/** The pool allocator, as a lua_Alloc. Blocks of up to 512 bytes come from
+ * the pools, larger ones from malloc. */
+void* allocate(void* ud, void* ptr, size_t osize, size_t nsize);
+
+/** Create a Lua state, with the pool allocator if it is enabled and the Lua
+ * implementation supports it. */
+lua_State* newstate();
+
+/** Whether the pool allocator is in use */
+bool active();
+
+/** Push a table with the allocator statistics, see awesome.memory_stats. */
+void push_stats(lua_State* L);
+
+} // namespace LuaAlloc
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,227 @@
+/*
+ * luacache.cpp - Lua bytecode cache
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "luacache.h"
+
+#include "common/luahdr.h"
+#include "common/util.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/core.h>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+#include <luajit.h>
+}
+
+namespace LuaCache {
+
+/** Where the entries go, empty when the cache is disabled */
+static std::filesystem::path cache_dir;
+
+/** FNV-1a, stable across runs unlike std::hash */
+static uint64_t hash_path(std::string_view path) {
+    uint64_t h = 0xcbf29ce484222325;
+    for (char c : path) {
+        h = (h ^ uint8_t(c)) * 0x100000001b3;
+    }
+    return h;
+}
+
+static bool read_file(const std::filesystem::path& path, std::string& data) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    char buf[8192];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.append(buf, n);
+    }
+    const bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+static int dump_writer(lua_State*, const void* p, size_t size, void* ud) {
+    static_cast<std::string*>(ud)->append(static_cast<const char*>(p), size);
+    return 0;
+}
+
+/** Write the function on top of the stack to an entry.
+ * The entry is replaced atomically, so that concurrent instances never read
+ * half of one.
+ */
+static void store(lua_State* L, const std::filesystem::path& entry, std::string data) {
+    if (lua_dump(L, dump_writer, &data) != 0) {
+        return;
+    }
+
+    auto tmp = entry;
+    tmp += fmt::format(".{}", getpid());
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return;
+    }
+    const bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    if (fclose(f) != 0 || !ok || rename(tmp.c_str(), entry.c_str()) != 0) {
+        log_warn("Cannot write Lua bytecode cache entry {}", entry.native());
+        unlink(tmp.c_str());
+    }
+}
+
+int loadfile(lua_State* L, const char* path) {
+    struct stat st;
+    if (cache_dir.empty() || stat(path, &st) != 0) {
+        return luaL_loadfile(L, path);
+    }
+
+    std::error_code ec;
+    const auto abspath = std::filesystem::absolute(path, ec);
+    if (ec) {
+        return luaL_loadfile(L, path);
+    }
+
+    /* Everything that makes an entry stale, the bytecode follows */
+    const std::string header = fmt::format("{}\n{}\n{}.{:09} {}\n",
+                                           LUAJIT_VERSION,
+                                           abspath.native(),
+                                           st.st_mtim.tv_sec,
+                                           st.st_mtim.tv_nsec,
+                                           st.st_size);
+    const auto entry = cache_dir / fmt::format("{:016x}.luac", hash_path(abspath.native()));
+
+    std::string data;
+    if (read_file(entry, data) && data.starts_with(header)) {
+        const std::string chunkname = fmt::format("@{}", path);
+        if (luaL_loadbuffer(
+              L, data.data() + header.size(), data.size() - header.size(), chunkname.c_str()) ==
+            0) {
+            return 0;
+        }
+        /* A broken entry, compile the source again */
+        lua_pop(L, 1);
+    }
+
+    const int status = luaL_loadfile(L, path);
+    if (status == 0) {
+        store(L, entry, header);
+    }
+    return status;
+}
+
+/** Find a module's file in package.path like the standard Lua loader does.
+ * \param name The module name.
+ * \param templates The value of package.path.
+ * \param tried Where to list the files that were tried.
+ * \return The file name, or an empty string.
+ */
+static std::string find_file(std::string name, std::string_view templates, std::string& tried) {
+    for (auto& c : name) {
+        if (c == '.') {
+            c = '/';
+        }
+    }
+
+    while (!templates.empty()) {
+        auto end = templates.find(';');
+        auto tmpl = templates.substr(0, end);
+        templates.remove_prefix(end == std::string_view::npos ? templates.size() : end + 1);
+        if (tmpl.empty()) {
+            continue;
+        }
+
+        std::string filename;
+        for (char c : tmpl) {
+            if (c == '?') {
+                filename += name;
+            } else {
+                filename += c;
+            }
+        }
+        if (access(filename.c_str(), R_OK) == 0) {
+            return filename;
+        }
+        tried += fmt::format("\n\tno file '{}'", filename);
+    }
+    return {};
+}
+
+/** The replacement of the standard Lua file loader of package.loaders */
+static int loader(lua_State* L) {
+    const char* name = luaL_checkstring(L, 1);
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
+    const char* templates = lua_tostring(L, -1);
+    if (!templates) {
+        return luaL_error(L, "'package.path' must be a string");
+    }
+
+    std::string tried;
+    const std::string filename = find_file(name, templates, tried);
+    lua_pop(L, 2);
+    if (filename.empty()) {
+        lua_pushlstring(L, tried.data(), tried.size());
+        return 1;
+    }
+
+    if (loadfile(L, filename.c_str()) != 0) {
+        return luaL_error(L,
+                          "error loading module '%s' from file '%s':\n\t%s",
+                          name,
+                          filename.c_str(),
+                          lua_tostring(L, -1));
+    }
+    return 1;
+}
+
+void install(lua_State* L, xdgHandle* xdg) {
+    cache_dir.clear();
+    if (getenv("AWESOME_NO_BYTECODE_CACHE")) {
+        return;
+    }
+
+    std::error_code ec;
+    std::filesystem::path dir = xdgCacheHome(xdg);
+    dir /= "awesome/luac";
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        log_warn("Cannot create the Lua bytecode cache {}: {}", dir.native(), ec.message());
+        return;
+    }
+    cache_dir = std::move(dir);
+
+    /* The second loader is the one for Lua files */
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "loaders");
+    if (lua_istable(L, -1)) {
+        lua_pushcfunction(L, loader);
+        lua_rawseti(L, -2, 2);
+    }
+    lua_pop(L, 2);
+}
+
+} // namespace LuaCache
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,48 @@
+/*
+ * luacache.h - Lua bytecode cache header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include <basedir.h>
+
+struct lua_State;
+
+/** Compiled Lua chunks, kept below $XDG_CACHE_HOME/awesome/luac.
+ *
+ * An entry is only used for a source file with the same path, modification
+ * time and size, compiled by the same LuaJIT version; anything else replaces
+ * it. Setting AWESOME_NO_BYTECODE_CACHE disables the cache.
+ */
+namespace LuaCache {
+
+/** Use the cache for the files loaded by require().
+ * \param L The Lua VM state, with package.path set up.
+ * \param xdg An xdg handle to find the cache directory.
+ */
+void install(lua_State* L, xdgHandle* xdg);
+
+/** Load a file like luaL_loadfile() does, from the cache when possible.
+ * \param L The Lua VM state.
+ * \param path The source file.
+ * \return 0 with the chunk pushed, or a Lua error code with the message pushed.
+ */
+int loadfile(lua_State* L, const char* path);
+
+} // namespace LuaCache
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,195 @@
+/*
+ * memstats.cpp - memory accounting
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "memstats.h"
+
+#include "common/luaclass.h"
+#include "iconcache.h"
+#include "luaa.h"
+#include "luaalloc.h"
+
+#include <array>
+#include <string_view>
+
+namespace MemStats {
+
+static std::array<Counter, size_t(Image::Count)> images;
+static std::array<Counter, size_t(Pixmap::Count)> pixmaps;
+static Counter icons;
+
+static constexpr std::array<std::string_view, size_t(Image::Count)> image_names = {
+  "file",
+  "icon",
+  "copy",
+  "shm",
+};
+
+static constexpr std::array<std::string_view, size_t(Pixmap::Count)> pixmap_names = {
+  "drawable",
+  "pool",
+  "wallpaper",
+  "shape",
+};
+
+Counter& image(Image source) { return images[size_t(source)]; }
+
+Counter& pixmap(Pixmap owner) { return pixmaps[size_t(owner)]; }
+
+Counter& icon_pixels() { return icons; }
+
+/** Remembers what a tracked surface was accounted as */
+struct tracked_image {
+    Image source;
+    size_t bytes;
+};
+
+static cairo_user_data_key_t tracked_key;
+
+static void tracked_image_destroy(void* data) {
+    auto tracked = static_cast<tracked_image*>(data);
+    image(tracked->source).remove(tracked->bytes);
+    delete tracked;
+}
+
+cairo_surface_t* track_image(cairo_surface_t* surface, Image source) {
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS ||
+        cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE) {
+        return surface;
+    }
+    const size_t bytes =
+      size_t(cairo_image_surface_get_stride(surface)) * cairo_image_surface_get_height(surface);
+    auto tracked = new tracked_image{source, bytes};
+    if (cairo_surface_set_user_data(surface, &tracked_key, tracked, tracked_image_destroy) !=
+        CAIRO_STATUS_SUCCESS) {
+        delete tracked;
+        return surface;
+    }
+    image(source).add(bytes);
+    return surface;
+}
+
+size_t pixmap_bytes(uint16_t width, uint16_t height, uint8_t depth) {
+    const size_t bpp = depth == 1 ? 1 : depth <= 8 ? 8 : depth <= 16 ? 16 : 32;
+    return (width * bpp + 31) / 32 * 4 * height;
+}
+
+static void push_counter(lua_State* L, const Counter& counter) {
+    lua_createtable(L, 0, 2);
+    lua_pushinteger(L, counter.count);
+    lua_setfield(L, -2, "count");
+    lua_pushinteger(L, counter.bytes);
+    lua_setfield(L, -2, "bytes");
+}
+
+static size_t signal_handlers(const Signals& signals) {
+    size_t n = 0;
+    for (const auto& [id, sig] : signals) {
+        n += sig.functions.size();
+    }
+    return n;
+}
+
+/** Get the memory used by awesome's own objects.
+ *
+ * The returned table has these entries, each counter being a table with a
+ * `count` and a size in `bytes`:
+ *
+ * * `lua`: the size of the Lua heap in `bytes`.
+ * * `images`: counters of the image surfaces created by awesome by source,
+ *   `file` (loaded images), `icon` (decoded client icons), `copy` (surfaces
+ *   copied from Lua) and `shm` (surfaces shared with the X server).
+ * * `icons`: a counter of the raw client icons, which are shared by all
+ *   clients with the same icon.
+ * * `icon_cache`: the `bytes` of decoded client icons the icon cache counts
+ *   against `awesome.set_icon_cache_limit`.
+ * * `pixmaps`: counters of the X pixmaps by owner, `drawable`, `pool` (pixmaps
+ *   kept for reuse by drawables), `wallpaper` and `shape`.
+ * * `objects`: a counter per class of its live objects, whose `signals` is the
+ *   number of handlers connected to the class.
+ * * `signals`: the number of handlers connected to global signals.
+ * * `lua_alloc`: only with `--lua-alloc pool`, the statistics of the Lua
+ *   allocator. `pools` lists its size classes, each with the block `size`, the
+ *   `count` and `bytes` of blocks in use, the `allocs` made so far and the
+ *   `reserved` bytes. `large` counts the blocks too large for the pools.
+ *   `phases` and `signals` tell how many `allocs` and `bytes` were made during
+ *   each main loop phase (see `awesome.loop_stats`) and by the handlers of
+ *   each signal.
+ *
+ * Memory allocated by Lua libraries (e.g. lgi) is not included.
+ *
+ * @treturn table The statistics.
+ * @staticfct memory_stats
+ */
+int luaA_memory_stats(lua_State* L) {
+    lua_createtable(L, 0, 7);
+
+    lua_createtable(L, 0, 1);
+    lua_pushinteger(L, lua_Integer(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0));
+    lua_setfield(L, -2, "bytes");
+    lua_setfield(L, -2, "lua");
+
+    lua_createtable(L, 0, int(Image::Count));
+    for (size_t i = 0; i < size_t(Image::Count); i++) {
+        push_counter(L, images[i]);
+        lua_setfield(L, -2, image_names[i].data());
+    }
+    lua_setfield(L, -2, "images");
+
+    push_counter(L, icons);
+    lua_setfield(L, -2, "icons");
+
+    lua_createtable(L, 0, 1);
+    lua_pushinteger(L, lua_Integer(IconCache::decoded_bytes()));
+    lua_setfield(L, -2, "bytes");
+    lua_setfield(L, -2, "icon_cache");
+
+    lua_createtable(L, 0, int(Pixmap::Count));
+    for (size_t i = 0; i < size_t(Pixmap::Count); i++) {
+        push_counter(L, pixmaps[i]);
+        lua_setfield(L, -2, pixmap_names[i].data());
+    }
+    lua_setfield(L, -2, "pixmaps");
+
+    lua_newtable(L);
+    for (const auto* cls : lua_class_t::all()) {
+        lua_createtable(L, 0, 3);
+        lua_pushinteger(L, cls->numRefs());
+        lua_setfield(L, -2, "count");
+        lua_pushinteger(L, cls->instance_bytes());
+        lua_setfield(L, -2, "bytes");
+        lua_pushinteger(L, signal_handlers(cls->signals()));
+        lua_setfield(L, -2, "signals");
+        lua_setfield(L, -2, cls->name().c_str());
+    }
+    lua_setfield(L, -2, "objects");
+
+    lua_pushinteger(L, signal_handlers(Lua::global_signals));
+    lua_setfield(L, -2, "signals");
+
+    if (LuaAlloc::active()) {
+        LuaAlloc::push_stats(L);
+        lua_setfield(L, -2, "lua_alloc");
+    }
+
+    return 1;
+}
+
+} // namespace MemStats
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
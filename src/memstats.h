@@ -0,0 +1,95 @@
+/*
+ * memstats.h - memory accounting header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+
+#include <atomic>
+#include <cairo.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace MemStats {
+
+/** Where an image surface came from */
+enum class Image : uint8_t {
+    /** Loaded from a file or a pixbuf */
+    File,
+    /** Decoded client icons */
+    Icon,
+    /** Copies of surfaces set from Lua */
+    Copy,
+    /** Surfaces shared with the X server */
+    Shm,
+    Count
+};
+
+/** What a pixmap is used for */
+enum class Pixmap : uint8_t {
+    /** Backing pixmaps of drawables */
+    Drawable,
+    /** Pixmaps kept for reuse by drawables */
+    Pool,
+    Wallpaper,
+    /** Bitmaps of window shapes */
+    Shape,
+    Count
+};
+
+/** A live count of objects and their size. Images can be created and
+ * destroyed by the decode threads, so this is atomic. */
+struct Counter {
+    std::atomic<int64_t> count = 0;
+    std::atomic<int64_t> bytes = 0;
+
+    void add(size_t size) {
+        count++;
+        bytes += size;
+    }
+    void remove(size_t size) {
+        count--;
+        bytes -= size;
+    }
+};
+
+Counter& image(Image source);
+Counter& pixmap(Pixmap owner);
+/** The raw pixels of the client icons, shared between clients */
+Counter& icon_pixels();
+
+/** Account an image surface to a source until it is destroyed.
+ * \param surface The image surface.
+ * \param source Where it came from.
+ * \return The surface.
+ */
+cairo_surface_t* track_image(cairo_surface_t* surface, Image source);
+
+/** The size of a pixmap in the server.
+ * \param width The width of the pixmap.
+ * \param height The height of the pixmap.
+ * \param depth Its depth.
+ * \return The size in bytes, with rows padded to 32 bits.
+ */
+size_t pixmap_bytes(uint16_t width, uint16_t height, uint8_t depth);
+
+int luaA_memory_stats(lua_State* L);
+
+} // namespace MemStats
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
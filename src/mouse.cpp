@@ -73,9 +73,25 @@
 #include "objects/drawin.h"
 #include "objects/screen.h"
 
+#include <chrono>
+
 static Lua::FunctionRegistryIdx miss_index_handler;
 static Lua::FunctionRegistryIdx miss_newindex_handler;
 
+/** The last known pointer position on the root window, from pointer events and
+ * QueryPointer replies. The pointer can move without us getting any event, so
+ * this is only trusted for a short while and until the main loop goes back to
+ * sleep.
+ */
+static struct {
+    bool valid = false;
+    int16_t x = 0, y = 0;
+    uint16_t mask = 0;
+    std::chrono::steady_clock::time_point time;
+} pointer_cache;
+
+static constexpr auto pointer_cache_max_age = std::chrono::milliseconds(20);
+
 /**
  * The `screen` under the cursor
  * @property screen
@@ -120,7 +136,27 @@ bool mouse_query_pointer(
     return true;
 }
 
+/** Remember the pointer position reported by an event.
+ * \param root The root window of the event.
+ * \param same_screen Whether the pointer is on the same screen as the event window.
+ * \param x The pointer x coordinate relative to the root window.
+ * \param y The pointer y coordinate relative to the root window.
+ * \param mask The buttons and modifiers state after the event.
+ */
+void mouse_pointer_seen(xcb_window_t root, bool same_screen, int16_t x, int16_t y, uint16_t mask) {
+    if (root != Manager::get().screen->root || !same_screen) {
+        pointer_cache.valid = false;
+        return;
+    }
+    pointer_cache = {true, x, y, mask, std::chrono::steady_clock::now()};
+}
+
+/** Forget the cached pointer position, e.g. because the pointer was moved. */
+void mouse_pointer_forget(void) { pointer_cache.valid = false; }
+
 /** Get the pointer position on the screen.
+ * The position and mask are answered from the cache when it is fresh, the
+ * window under the pointer always needs a QueryPointer.
  * \param x This will be set to the Pointer-x-coordinate relative to window.
  * \param y This will be set to the Pointer-y-coordinate relative to window.
  * \param child This will be set to the window under the pointer.
@@ -129,8 +165,27 @@ bool mouse_query_pointer(
  */
 static bool mouse_query_pointer_root(int16_t* x, int16_t* y, xcb_window_t* child, uint16_t* mask) {
     xcb_window_t root = Manager::get().screen->root;
+    const auto now = std::chrono::steady_clock::now();
 
-    return mouse_query_pointer(root, x, y, child, mask);
+    if (!child && pointer_cache.valid && now - pointer_cache.time < pointer_cache_max_age) {
+        *x = pointer_cache.x;
+        *y = pointer_cache.y;
+        if (mask) {
+            *mask = pointer_cache.mask;
+        }
+        return true;
+    }
+
+    uint16_t state;
+    if (!mouse_query_pointer(root, x, y, child, &state)) {
+        pointer_cache.valid = false;
+        return false;
+    }
+    if (mask) {
+        *mask = state;
+    }
+    pointer_cache = {true, *x, *y, state, now};
+    return true;
 }
 
 /** Mouse library.
@@ -187,6 +242,7 @@ static int luaA_mouse_newindex(lua_State* L) {
     }
 
     screen = luaA_checkscreen(L, 3);
+    mouse_pointer_forget();
     getConnection().warp_pointer(Manager::get().screen->root, screen->geometry.top_left);
     return 0;
 }
@@ -243,6 +299,7 @@ static int luaA_mouse_coords(lua_State* L) {
             client_ignore_enterleave_events();
         }
 
+        mouse_pointer_forget();
         getConnection().warp_pointer(Manager::get().screen->root,
                                      {static_cast<int16_t>(x), static_cast<int16_t>(y)});
 
@@ -26,4 +26,6 @@
 #include <xcb/xcb.h>
 
 bool mouse_query_pointer(xcb_window_t, int16_t*, int16_t*, xcb_window_t*, uint16_t*);
+void mouse_pointer_seen(xcb_window_t, bool, int16_t, int16_t, uint16_t);
+void mouse_pointer_forget(void);
 int luaA_mouse_pushstatus(lua_State*, int, int, uint16_t);
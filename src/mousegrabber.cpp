@@ -27,14 +27,48 @@
 
 #include "mousegrabber.h"
 
+#include "common/luaobject.h"
 #include "common/xcursor.h"
 #include "globalconf.h"
 #include "globals.h"
+#include "luaa.h"
 #include "mouse.h"
+#include "objects/client.h"
+#include "objects/screen.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <optional>
 #include <stdbool.h>
+#include <string_view>
+#include <tuple>
 #include <unistd.h>
 
+/** A move or resize of a client that is done natively, without calling Lua for
+ * every pointer motion.
+ */
+static struct {
+    /** The client, which is referenced while it is moved */
+    client* c = nullptr;
+    /** Which edges follow the pointer: -1 for the left or top one, 1 for the
+     * right or bottom one, 0 for none. Both follow it in a move. */
+    int edge_x = 0, edge_y = 0;
+    bool resize = false;
+    point start_pointer;
+    area_t start_geometry;
+    /** From how far edges snap, 0 disables snapping */
+    int snap = 0;
+    bool snap_clients = true;
+    bool honor_hints = true;
+    bool constrain = false;
+    bool snapped = false;
+    Lua::FunctionRegistryIdx callback;
+} move_resize;
+
+static bool mousegrabber_running(void) {
+    return Manager::get().mousegrabber.hasRef() || move_resize.c;
+}
+
 /** Grab the mouse.
  * \param cursor The cursor to use while grabbing.
  * \return True if mouse was grabbed.
@@ -72,6 +106,214 @@ void mousegrabber_handleevent(lua_State* L, int x, int y, uint16_t mask) {
     luaA_mouse_pushstatus(L, x, y, mask);
 }
 
+/** Remember the move that snaps an edge closest to a target.
+ * \param edge The position of the edge.
+ * \param target Where the edge snaps to.
+ * \param best The smallest move so far.
+ */
+static void move_resize_snap_to(int edge, int target, std::optional<int>& best) {
+    const int delta = target - edge;
+    if (std::abs(delta) <= move_resize.snap && (!best || std::abs(delta) < std::abs(*best))) {
+        best = delta;
+    }
+}
+
+static std::optional<int> move_resize_closest(std::optional<int> a, std::optional<int> b) {
+    if (!a || (b && std::abs(*b) < std::abs(*a))) {
+        return b;
+    }
+    return a;
+}
+
+/** Compute the geometry of the client for a pointer position.
+ * \param p The pointer position.
+ * \param snapped Set to whether an edge snapped.
+ * \return The new geometry, without size hints.
+ */
+static area_t move_resize_geometry(point p, bool& snapped) {
+    const auto& mr = move_resize;
+    const int border = 2 * mr.c->border_width;
+    const int dx = p.x - mr.start_pointer.x, dy = p.y - mr.start_pointer.y;
+    /* The outer edges, including the border */
+    int left = mr.start_geometry.left(), top = mr.start_geometry.top();
+    int right = mr.start_geometry.right() + border, bottom = mr.start_geometry.bottom() + border;
+    const bool move_left = !mr.resize || mr.edge_x < 0, move_right = !mr.resize || mr.edge_x > 0;
+    const bool move_top = !mr.resize || mr.edge_y < 0, move_bottom = !mr.resize || mr.edge_y > 0;
+
+    if (!mr.resize) {
+        left += dx;
+        right += dx;
+        top += dy;
+        bottom += dy;
+    } else {
+        if (move_left) {
+            left = std::min(left + dx, right - border - 1);
+        } else if (move_right) {
+            right = std::max(right + dx, left + border + 1);
+        }
+        if (move_top) {
+            top = std::min(top + dy, bottom - border - 1);
+        } else if (move_bottom) {
+            bottom = std::max(bottom + dy, top + border + 1);
+        }
+    }
+
+    snapped = false;
+    screen_t* screen = screen_getbycoord(p);
+    if (screen && mr.snap > 0) {
+        const area_t& wa = screen->workarea;
+        std::optional<int> dl, dr, dt, db;
+        move_resize_snap_to(left, wa.left(), dl);
+        move_resize_snap_to(right, wa.right(), dr);
+        move_resize_snap_to(top, wa.top(), dt);
+        move_resize_snap_to(bottom, wa.bottom(), db);
+        if (mr.snap_clients) {
+            for (auto* other : screen_clients(screen)) {
+                if (other == mr.c || !client_isvisible(other)) {
+                    continue;
+                }
+                const area_t& og = other->geometry;
+                const int other_border = 2 * other->border_width;
+                /* Snap to the outside of the clients next to this one */
+                if (top < og.bottom() + other_border && og.top() < bottom) {
+                    move_resize_snap_to(left, og.right() + other_border, dl);
+                    move_resize_snap_to(right, og.left(), dr);
+                }
+                if (left < og.right() + other_border && og.left() < right) {
+                    move_resize_snap_to(top, og.bottom() + other_border, dt);
+                    move_resize_snap_to(bottom, og.top(), db);
+                }
+            }
+        }
+
+        if (!mr.resize) {
+            if (auto d = move_resize_closest(dl, dr)) {
+                left += *d;
+                right += *d;
+                snapped = true;
+            }
+            if (auto d = move_resize_closest(dt, db)) {
+                top += *d;
+                bottom += *d;
+                snapped = true;
+            }
+        } else {
+            for (auto [moves, edge, delta] : {std::tuple{move_left, &left, dl},
+                                              std::tuple{move_right, &right, dr},
+                                              std::tuple{move_top, &top, dt},
+                                              std::tuple{move_bottom, &bottom, db}}) {
+                if (moves && delta) {
+                    *edge += *delta;
+                    snapped = true;
+                }
+            }
+        }
+    }
+
+    if (screen && mr.constrain) {
+        const area_t& wa = screen->workarea;
+        if (!mr.resize) {
+            /* Push the client back inside, its top left corner wins */
+            const int shift_x = std::max(wa.left() - left, std::min(0, wa.right() - right));
+            const int shift_y = std::max(wa.top() - top, std::min(0, wa.bottom() - bottom));
+            left += shift_x;
+            right += shift_x;
+            top += shift_y;
+            bottom += shift_y;
+        } else {
+            left = move_left ? std::max(left, wa.left()) : left;
+            right = move_right ? std::min(right, wa.right()) : right;
+            top = move_top ? std::max(top, wa.top()) : top;
+            bottom = move_bottom ? std::min(bottom, wa.bottom()) : bottom;
+        }
+    }
+
+    return {
+      {left, top},
+      uint16_t(std::max(right - left - border, 1)),
+      uint16_t(std::max(bottom - top - border, 1))
+    };
+}
+
+/** Call the Lua callback of the move or resize.
+ * \param L The Lua VM state.
+ * \param event The name of the event.
+ * \param callback The callback.
+ */
+static void move_resize_notify(lua_State* L,
+                               const char* event,
+                               const Lua::FunctionRegistryIdx& callback) {
+    if (!callback) {
+        return;
+    }
+    lua_pushstring(L, event);
+    Lua::pusharea(L, move_resize.c->geometry);
+    lua_pushboolean(L, move_resize.snapped);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, callback.idx.idx);
+    Lua::dofunction(L, 3, 0);
+}
+
+static void move_resize_finish(lua_State* L) {
+    Manager::get().x.connection.ungrab_pointer();
+    auto callback = move_resize.callback;
+    move_resize.callback = {};
+    move_resize_notify(L, "end", callback);
+    Lua::unregister(L, &callback);
+    client* c = move_resize.c;
+    move_resize.c = nullptr;
+    luaA_object_unref(L, c);
+}
+
+/** Move or resize the client of a native move or resize for a pointer event.
+ * \param x The pointer x coordinate.
+ * \param y The pointer y coordinate.
+ * \param mask The buttons and modifiers state.
+ * \return True if a move or resize is running and the event was handled.
+ */
+bool mousegrabber_move_resize_handle(int x, int y, uint16_t mask) {
+    client* c = move_resize.c;
+    if (!c) {
+        return false;
+    }
+
+    lua_State* L = globalconf_get_lua_State();
+    if (c->window == XCB_NONE) {
+        /* The client was unmanaged */
+        move_resize_finish(L);
+        return true;
+    }
+
+    bool snapped;
+    std::optional<area_t> geometry = move_resize_geometry({x, y}, snapped);
+    if (move_resize.resize && move_resize.honor_hints) {
+        const area_t wanted = *geometry;
+        geometry = client_resize_geometry(c, wanted, true);
+        /* Keep the edges which don't follow the pointer in place */
+        if (geometry && move_resize.edge_x < 0) {
+            geometry->top_left.x = wanted.right() - geometry->width;
+        }
+        if (geometry && move_resize.edge_y < 0) {
+            geometry->top_left.y = wanted.bottom() - geometry->height;
+        }
+    }
+    if (geometry) {
+        client_resize(c, *geometry, false);
+    }
+
+    if (snapped != move_resize.snapped) {
+        move_resize.snapped = snapped;
+        move_resize_notify(L, "snap", move_resize.callback);
+    }
+
+    constexpr uint16_t buttons = XCB_BUTTON_MASK_1 | XCB_BUTTON_MASK_2 | XCB_BUTTON_MASK_3 |
+                                 XCB_BUTTON_MASK_4 | XCB_BUTTON_MASK_5;
+    /* The snap callback may have stopped it already */
+    if (move_resize.c == c && !(mask & buttons)) {
+        move_resize_finish(L);
+    }
+    return true;
+}
+
 /** Grab the mouse pointer and list motions, calling callback function at each
  * motion. The callback function must return a boolean value: true to
  * continue grabbing, false to stop.
@@ -90,7 +332,7 @@ void mousegrabber_handleevent(lua_State* L, int x, int y, uint16_t mask) {
  * @staticfct run
  */
 static int luaA_mousegrabber_run(lua_State* L) {
-    if (Manager::get().mousegrabber) {
+    if (mousegrabber_running()) {
         luaL_error(L, "mousegrabber already running");
     }
 
@@ -116,12 +358,122 @@ static int luaA_mousegrabber_run(lua_State* L) {
     return 0;
 }
 
+/** Move or resize a client until all mouse buttons are released.
+ *
+ * Unlike with `run`, no Lua code runs for each pointer motion: the geometry of
+ * the client is computed and applied natively. The callback is only called
+ * when the operation starts and ends, and when the client snaps to or away
+ * from an edge. It gets the name of the event (`"start"`, `"snap"` or
+ * `"end"`), the geometry of the client and whether an edge is snapped.
+ *
+ * Edges snap to the edges of the workarea of the screen under the pointer, and
+ * to the outer edges of the other visible clients of that screen.
+ *
+ * @tparam client c The client.
+ * @tparam[opt={}] table args
+ * @tparam[opt="move"] string args.mode Either `"move"` or `"resize"`.
+ * @tparam[opt="bottom_right"] string args.corner The corner or side which
+ *  follows the pointer in a resize, e.g. `"top_left"` or `"right"`.
+ * @tparam[opt=0] integer args.snap How close edges have to get to snap, 0
+ *  disables snapping.
+ * @tparam[opt=true] boolean args.snap_clients Whether edges snap to the other
+ *  clients as well.
+ * @tparam[opt=c.size_hints_honor] boolean args.honor_size_hints Whether a
+ *  resize honors the size hints of the client.
+ * @tparam[opt=false] boolean args.constrain Keep the client inside the
+ *  workarea of the screen under the pointer.
+ * @tparam[opt=nil] string args.cursor The name of an X cursor to use.
+ * @tparam[opt=nil] function args.callback The callback described above.
+ * @noreturn
+ * @staticfct move_resize
+ * @see run
+ */
+static int luaA_mousegrabber_move_resize(lua_State* L) {
+    auto c = client_class.checkudata<client>(L, 1);
+    if (lua_isnoneornil(L, 2)) {
+        lua_settop(L, 1);
+        lua_newtable(L);
+    }
+    Lua::checktable(L, 2);
+    if (mousegrabber_running()) {
+        return luaL_error(L, "mousegrabber already running");
+    }
+
+    lua_getfield(L, 2, "mode");
+    const std::string_view mode = lua_isnil(L, -1) ? "move" : luaL_checkstring(L, -1);
+    lua_getfield(L, 2, "corner");
+    const std::string_view corner = lua_isnil(L, -1) ? "bottom_right" : luaL_checkstring(L, -1);
+    lua_getfield(L, 2, "snap");
+    const lua_Integer snap = luaL_optinteger(L, -1, 0);
+    lua_getfield(L, 2, "snap_clients");
+    const bool snap_clients = lua_isnil(L, -1) || lua_toboolean(L, -1);
+    lua_getfield(L, 2, "honor_size_hints");
+    const bool honor_hints = lua_isnil(L, -1) ? c->size_hints_honor : lua_toboolean(L, -1);
+    lua_getfield(L, 2, "constrain");
+    const bool constrain = lua_toboolean(L, -1);
+    lua_getfield(L, 2, "cursor");
+    const char* cursor_name = lua_isnil(L, -1) ? nullptr : luaL_checkstring(L, -1);
+    lua_getfield(L, 2, "callback");
+    const int callback_idx = lua_gettop(L);
+    if (!lua_isnil(L, callback_idx)) {
+        Lua::checkfunction(L, callback_idx);
+    }
+
+    if (mode != "move" && mode != "resize") {
+        return luaL_error(L, "invalid mode, expected \"move\" or \"resize\"");
+    }
+
+    int16_t x, y;
+    if (!mouse_query_pointer(Manager::get().screen->root, &x, &y, nullptr, nullptr)) {
+        return luaL_error(L, "unable to query the mouse pointer");
+    }
+
+    xcb_cursor_t cursor = XCB_NONE;
+    if (cursor_name) {
+        uint16_t cfont = xcursor_font_fromstr(cursor_name);
+        if (!cfont) {
+            Lua::warn(L, "invalid cursor");
+            return 0;
+        }
+        cursor = xcursor_new(Manager::get().x.cursor_ctx, cfont);
+    }
+    if (!mousegrabber_grab(cursor)) {
+        return luaL_error(L, "unable to grab mouse pointer");
+    }
+
+    move_resize.resize = mode == "resize";
+    move_resize.edge_x = corner.contains("left") ? -1 : corner.contains("right") ? 1 : 0;
+    move_resize.edge_y = corner.contains("top") ? -1 : corner.contains("bottom") ? 1 : 0;
+    move_resize.start_pointer = {x, y};
+    move_resize.start_geometry = c->geometry;
+    move_resize.snap = std::max<lua_Integer>(snap, 0);
+    move_resize.snap_clients = snap_clients;
+    move_resize.honor_hints = honor_hints;
+    move_resize.constrain = constrain;
+    move_resize.snapped = false;
+    move_resize.c = c;
+    lua_pushvalue(L, 1);
+    luaA_object_ref(L, -1);
+    if (!lua_isnil(L, callback_idx)) {
+        Lua::registerfct(L, callback_idx, &move_resize.callback);
+    }
+
+    move_resize_notify(L, "start", move_resize.callback);
+    return 0;
+}
+
 /** Stop grabbing the mouse pointer.
+ *
+ * This also ends a `move_resize`.
  *
  * @staticfct stop
  * @noreturn
  */
 int luaA_mousegrabber_stop(lua_State* L) {
+    if (move_resize.c) {
+        move_resize_finish(L);
+        return 0;
+    }
     Manager::get().x.connection.ungrab_pointer();
     Lua::unregister(L, &Manager::get().mousegrabber);
     return 0;
@@ -133,12 +485,13 @@ int luaA_mousegrabber_stop(lua_State* L) {
  * @staticfct isrunning
  */
 static int luaA_mousegrabber_isrunning(lua_State* L) {
-    lua_pushboolean(L, Manager::get().mousegrabber.hasRef());
+    lua_pushboolean(L, mousegrabber_running());
     return 1;
 }
 
 const struct luaL_Reg awesome_mousegrabber_lib[] = {
-  {       "run",       luaA_mousegrabber_run},
+  {        "run",         luaA_mousegrabber_run},
+  {"move_resize", luaA_mousegrabber_move_resize},
   {      "stop",      luaA_mousegrabber_stop},
   { "isrunning", luaA_mousegrabber_isrunning},
   {   "__index",          Lua::default_index},
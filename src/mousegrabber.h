@@ -26,3 +26,4 @@
 
 int luaA_mousegrabber_stop(lua_State*);
 void mousegrabber_handleevent(lua_State*, int, int, uint16_t);
+bool mousegrabber_move_resize_handle(int, int, uint16_t);
@@ -133,19 +133,6 @@ int luaA_button_array_get(lua_State* L, int oidx, const std::vector<button_t*>&
     return 1;
 }
 
-void button_t::grab(xcb_window_t win) {
-    Manager::get().x.connection.grab_button(
-      false,
-      win,
-      (XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE),
-      XCB_GRAB_MODE_SYNC,
-      XCB_GRAB_MODE_ASYNC,
-      XCB_NONE,
-      XCB_NONE,
-      _button,
-      _modifiers);
-}
-
 void button_class_setup(lua_State* L) {
     static constexpr auto button_methods = DefineClassMethods<&button_class>({
       {"__call", [](auto* L) { return button_class.new_object(L); }}
@@ -156,12 +143,12 @@ void button_class_setup(lua_State* L) {
     button_class.setup(L, button_methods.data(), button_meta.data());
     auto setBtn = [](lua_State* L, button_t* b) -> int {
         b->set_button(luaL_checkinteger(L, -1));
-        luaA_object_emit_signal(L, -3, "property::button", 0);
+        luaA_object_emit_signal(L, -3, "property::button"_sig, 0);
         return 0;
     };
     auto setMod = [](lua_State* L, button_t* b) {
         b->set_modifiers(luaA_tomodifiers(L, -1));
-        luaA_object_emit_signal(L, -3, "property::modifiers", 0);
+        luaA_object_emit_signal(L, -3, "property::modifiers"_sig, 0);
         return 0;
     };
     button_class.add_property(lua_class_property_t::make<button_t>(
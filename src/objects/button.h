@@ -47,7 +47,6 @@ class button_t: public lua_object_t {
     xcb_button_t button() const { return _button; }
     void set_modifiers(uint16_t val) { _modifiers = val; }
     void set_button(xcb_button_t btn) { _button = btn; }
-    void grab(xcb_window_t win);
 };
 
 extern lua_class_t button_class;
@@ -88,20 +88,25 @@
 
 #include "objects/client.h"
 
+#include "capture.h"
 #include "common/atoms.h"
 #include "common/luaclass.h"
 #include "common/luaobject.h"
 #include "common/xutil.h"
+#include "dbus.h"
 #include "draw.h"
 #include "event.h"
 #include "ewmh.h"
 #include "globalconf.h"
+#include "keyset.h"
 #include "lua.h"
 #include "math.h"
+#include "memstats.h"
 #include "objects/drawable.h"
 #include "objects/screen.h"
 #include "objects/tag.h"
 #include "property.h"
+#include "restartstate.h"
 #include "spawn.h"
 #include "systray.h"
 #include "xwindow.h"
@@ -109,9 +114,15 @@
 #include <algorithm>
 #include <array>
 #include <cairo-xcb.h>
+#include <cmath>
 #include <cstdint>
+#include <map>
+#include <optional>
 #include <ranges>
 #include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 #include <xcb/shape.h>
 #include <xcb/xcb_atom.h>
 #include <xcb/xproto.h>
@@ -962,13 +973,18 @@ lua_class_t client_class{
  *
  *    gears.surface(c.content):write_to_png(path)
  *
- * Please note that this only creates a new cairo surface
- * referring to the client's content. This means that
+ * With the Composite extension, this is a copy of the client's content. It is
+ * read through MIT-SHM when possible. The client window only keeps its own
+ * storage while it has a `content_thumbnail`, covered parts are only there
+ * then. Without Composite, this only creates a new cairo
+ * surface referring to the client's content. This means that
  * changes to the client's content may or may not become
  * visible in the returned surface. If you want to take a
  * screenshot, a copy of the surface's content needs to
  * be taken. Note that the content of parts of a window
- * that are currently not visible are undefined.
+ * that are currently not visible are undefined then.
+ *
+ * For previews, `content_thumbnail` avoids reading unchanged windows again.
  *
  * The only way to get an animated client screenshot widget is to poll this
  * property multiple time per seconds. This is obviously a bad idea.
@@ -977,10 +993,11 @@ lua_class_t client_class{
  *
  * @property content
  * @tparam raw_curface content
- * @propertydefault This is a live surface. Always use `gears.surface` to take
- *  a snapshot.
+ * @propertydefault A copy with Composite, a live surface otherwise. Always use
+ *  `gears.surface` to take a snapshot.
  * @readonly
  * @see gears.surface
+ * @see content_thumbnail
  */
 
 /**
@@ -1548,6 +1565,9 @@ typedef enum {
 } client_maximized_t;
 
 static area_t titlebar_get_area(client* c, client_titlebar_t bar);
+static bool titlebar_atlas_update(client* c, const area_t* areas);
+static void titlebar_atlas_free(client* c);
+static point titlebar_atlas_offset(client* c, client_titlebar_t bar);
 static drawable_t*
 titlebar_get_drawable(lua_State* L, client* c, int cl_idx, client_titlebar_t bar);
 static void client_resize_do(client* c, area_t geometry);
@@ -1559,7 +1579,12 @@ client_set_maximized_common(lua_State* L, int cidx, bool s, const char* type, co
  * \return The number of element pushed on stack.
  */
 
-client::~client() { xcb_icccm_get_wm_protocols_reply_wipe(&protocols); }
+client::~client() {
+    drawable_damage_forget(this);
+    Capture::forget(this, true);
+    screen_strut_forget(this);
+    xcb_icccm_get_wm_protocols_reply_wipe(&protocols);
+}
 
 /** Change the clients urgency flag.
  * \param L The Lua VM state.
@@ -1572,7 +1597,7 @@ void client_set_urgent(lua_State* L, int cidx, bool urgent) {
     if (c->urgent != urgent) {
         c->urgent = urgent;
 
-        luaA_object_emit_signal(L, cidx, "property::urgent", 0);
+        luaA_object_emit_signal(L, cidx, "property::urgent"_sig, 0);
     }
 }
 
@@ -1581,7 +1606,7 @@ void client_set_urgent(lua_State* L, int cidx, bool urgent) {
         auto c = client_class.checkudata<client>(L, cidx);                                        \
         if (c->prop != value) {                                                                   \
             c->prop = value;                                                                      \
-            luaA_object_emit_signal(L, cidx, "property::" #prop, 0);                              \
+            luaA_object_emit_signal(L, cidx, "property::" #prop ""_sig, 0);                       \
         }                                                                                         \
     }
 DO_CLIENT_SET_PROPERTY(group_window)
@@ -1591,16 +1616,16 @@ DO_CLIENT_SET_PROPERTY(pid)
 DO_CLIENT_SET_PROPERTY(skip_taskbar)
 #undef DO_CLIENT_SET_PROPERTY
 
-#define DO_CLIENT_SET_STRING_PROPERTY2(prop, signal)               \
-    void client_set_##prop(lua_State* L, int cidx, char* value) {  \
-        auto c = client_class.checkudata<client>(L, cidx);         \
-        if (A_STREQ(c->prop, value)) {                             \
-            p_delete(&value);                                      \
-            return;                                                \
-        }                                                          \
-        p_delete(&c->prop);                                        \
-        c->prop = value;                                           \
-        luaA_object_emit_signal(L, cidx, "property::" #signal, 0); \
+#define DO_CLIENT_SET_STRING_PROPERTY2(prop, signal)                      \
+    void client_set_##prop(lua_State* L, int cidx, char* value) {         \
+        auto c = client_class.checkudata<client>(L, cidx);                \
+        if (A_STREQ(c->prop, value)) {                                    \
+            p_delete(&value);                                             \
+            return;                                                       \
+        }                                                                 \
+        p_delete(&c->prop);                                               \
+        c->prop = value;                                                  \
+        luaA_object_emit_signal(L, cidx, "property::" #signal ""_sig, 0); \
     }
 #define DO_CLIENT_SET_STRING_PROPERTY3(prop, getter, setter, signal)           \
     void client_set_##prop(lua_State* L, int cidx, const std::string& value) { \
@@ -1609,7 +1634,7 @@ DO_CLIENT_SET_PROPERTY(skip_taskbar)
             return;                                                            \
         }                                                                      \
         c->setter(value);                                                      \
-        luaA_object_emit_signal(L, cidx, "property::" #signal, 0);             \
+        luaA_object_emit_signal(L, cidx, "property::" #signal ""_sig, 0);      \
     }
 #define DO_CLIENT_SET_STRING_PROPERTY4(name, signal) \
     DO_CLIENT_SET_STRING_PROPERTY3(name, get##name, set##name, signal)
@@ -1625,12 +1650,12 @@ DO_CLIENT_SET_STRING_PROPERTY4(Machine, machine)
 
 void client_emit_scanned(void) {
     lua_State* L = globalconf_get_lua_State();
-    client_class.emit_signal(L, "scanned", 0);
+    client_class.emit_signal(L, "scanned"_sig, 0);
 }
 
 void client_emit_scanning(void) {
     lua_State* L = globalconf_get_lua_State();
-    client_class.emit_signal(L, "scanning", 0);
+    client_class.emit_signal(L, "scanning"_sig, 0);
 }
 
 void client_set_motif_wm_hints(lua_State* L, int cidx, motif_wm_hints_t hints) {
@@ -1640,7 +1665,7 @@ void client_set_motif_wm_hints(lua_State* L, int cidx, motif_wm_hints_t hints) {
     }
 
     memcpy(&c->motif_wm_hints, &hints, sizeof(c->motif_wm_hints));
-    luaA_object_emit_signal(L, cidx, "property::motif_wm_hints", 0);
+    luaA_object_emit_signal(L, cidx, "property::motif_wm_hints"_sig, 0);
 }
 
 void client_find_transient_for(client* c) {
@@ -1676,9 +1701,9 @@ void client_set_ClassInstance(lua_State* L,
                               const std::string& instance) {
     auto c = client_class.checkudata<client>(L, cidx);
     c->setCls(cls);
-    luaA_object_emit_signal(L, cidx, "property::class", 0);
+    luaA_object_emit_signal(L, cidx, "property::class"_sig, 0);
     c->setInstance(instance);
-    luaA_object_emit_signal(L, cidx, "property::instance", 0);
+    luaA_object_emit_signal(L, cidx, "property::instance"_sig, 0);
 }
 
 /** Returns true if a client is tagged with one of the active tags.
@@ -1686,33 +1711,21 @@ void client_set_ClassInstance(lua_State* L,
  * \return true if the client is visible, false otherwise.
  */
 bool client_on_selected_tags(client* c) {
-    if (c->sticky) {
-        return true;
-    }
-
-    for (auto& tag : Manager::get().tags) {
-        if (tag.get()->selected && is_client_tagged(c, tag.get())) {
-            return true;
-        }
-    }
-
-    return false;
+    return c->sticky || c->tags.intersects(Manager::get().selected_tags);
 }
-template <typename Predicate>
-static client* find_client(const std::vector<client*>& clients, Predicate&& pred) {
-    auto it = std::ranges::find_if(clients, pred);
-    return it != clients.end() ? *it : nullptr;
+template <typename T>
+static T* find_window(const std::unordered_map<xcb_window_t, T*>& index, xcb_window_t w) {
+    auto it = index.find(w);
+    return it != index.end() ? it->second : nullptr;
 }
 /** Get a client by its window.
  * \param w The client window to find.
  * \return A client pointer if found, NULL otherwise.
  */
-client* client_getbywin(xcb_window_t w) {
-    return find_client(Manager::get().clients, [w](auto c) { return c->window == w; });
-}
+client* client_getbywin(xcb_window_t w) { return find_window(Manager::get().windows.clients, w); }
 
 client* client_getbynofocuswin(xcb_window_t w) {
-    return find_client(Manager::get().clients, [w](auto c) { return c->nofocus_window == w; });
+    return find_window(Manager::get().windows.nofocus, w);
 }
 
 /** Get a client by its frame window.
@@ -1720,7 +1733,7 @@ client* client_getbynofocuswin(xcb_window_t w) {
  * \return A client pointer if found, NULL otherwise.
  */
 client* client_getbyframewin(xcb_window_t w) {
-    return find_client(Manager::get().clients, [w](auto c) { return c->frame_window == w; });
+    return find_window(Manager::get().windows.frames, w);
 }
 
 /** Unfocus a client (internal).
@@ -1733,8 +1746,8 @@ static void client_unfocus_internal(client* c) {
     luaA_object_push(L, c);
 
     lua_pushboolean(L, false);
-    luaA_object_emit_signal(L, -2, "property::active", 1);
-    luaA_object_emit_signal(L, -1, "unfocus", 0);
+    luaA_object_emit_signal(L, -2, "property::active"_sig, 1);
+    luaA_object_emit_signal(L, -1, "unfocus"_sig, 0);
     lua_pop(L, 1);
 }
 
@@ -1770,6 +1783,20 @@ void client_ban_unfocus(client* c) {
     }
 }
 
+/** Copy the state the banning passes read to the slot of a client.
+ * \param c The client.
+ */
+void client_hot_sync(client* c) {
+    if (c->hot_slot == ClientHotStore::no_slot) {
+        return;
+    }
+    using F = ClientHotStore::flag_t;
+    const uint8_t flags = (c->hidden ? F::hidden : 0) | (c->minimized ? F::minimized : 0) |
+                          (c->sticky ? F::sticky : 0) | (c->isbanned ? F::banned : 0) |
+                          (c->tags.wide() ? F::wide_tags : 0);
+    Manager::get().clients_hot.set(c->hot_slot, c->tags.word(0), flags);
+}
+
 /** Ban client and move it out of the viewport.
  * \param c The client.
  */
@@ -1780,6 +1807,7 @@ void client_ban(client* c) {
         client_restore_enterleave_events();
 
         c->isbanned = true;
+        client_hot_sync(c);
 
         client_ban_unfocus(c);
     }
@@ -1812,7 +1840,47 @@ void client_restore_enterleave_events(void) {
     pair.end = xcb_no_operation(getConnection().getConnection());
     xutil_ungrab_server();
     Manager::get().pending_enter_leave_begin.sequence = 0;
-    Manager::get().ignore_enter_leave_events.push_back(pair);
+    Manager::get().ignore_enter_leave_events.push(pair);
+}
+
+/** Take a client out of the focus history ring.
+ * \param c The client.
+ */
+static void client_history_remove(client* c) {
+    if (!c->history_next) {
+        return;
+    }
+    auto& head = Manager::get().focus.history;
+    if (c->history_next == c) {
+        head = nullptr;
+    } else {
+        c->history_prev->history_next = c->history_next;
+        c->history_next->history_prev = c->history_prev;
+        if (head == c) {
+            head = c->history_next;
+        }
+    }
+    c->history_prev = c->history_next = nullptr;
+}
+
+/** Make a client the most recent entry of the focus history ring.
+ * \param c The client.
+ */
+static void client_history_add(client* c) {
+    auto& head = Manager::get().focus.history;
+    if (head == c) {
+        return;
+    }
+    client_history_remove(c);
+    if (!head) {
+        c->history_prev = c->history_next = c;
+    } else {
+        c->history_next = head;
+        c->history_prev = head->history_prev;
+        head->history_prev->history_next = c;
+        head->history_prev = c;
+    }
+    head = c;
 }
 
 /** Record that a client got focus.
@@ -1840,9 +1908,12 @@ bool client_focus_update(client* c) {
     client_set_urgent(L, -1, false);
 
     if (focused_new) {
+        if (Manager::get().focus.history_tracking) {
+            client_history_add(c);
+        }
         lua_pushboolean(L, true);
-        luaA_object_emit_signal(L, -2, "property::active", 1);
-        luaA_object_emit_signal(L, -1, "focus", 0);
+        luaA_object_emit_signal(L, -2, "property::active"_sig, 1);
+        luaA_object_emit_signal(L, -1, "focus"_sig, 0);
     }
 
     lua_pop(L, 1);
@@ -1876,7 +1947,8 @@ static xcb_window_t client_get_nofocus_window(client* c) {
                                       Manager::get().visual->visual_id,
                                       0);
         getConnection().map_window(c->nofocus_window);
-        xwindow_grabkeys(c->nofocus_window, c->keys);
+        KeySet::grab_client(c);
+        Manager::get().windows.nofocus[c->nofocus_window] = c;
     }
     return c->nofocus_window;
 }
@@ -1915,15 +1987,25 @@ void client_focus_refresh(void) {
     Manager::get().focus.need_update = false;
 }
 
-static void client_border_refresh(void) {
-    for (auto* c : Manager::get().clients) {
+/** Queue a client for the next geometry and border refresh.
+ * \param c The client.
+ */
+void client_need_refresh(client* c) {
+    if (!c->refresh_pending) {
+        c->refresh_pending = true;
+        Manager::get().refresh_pending.push_back(c);
+    }
+}
+
+static void client_border_refresh(const std::vector<client*>& clients) {
+    for (auto* c : clients) {
         window_border_refresh((window_t*)c);
     }
 }
 
-static void client_geometry_refresh(void) {
+static void client_geometry_refresh(const std::vector<client*>& clients) {
     bool ignored_enterleave = false;
-    for (auto* c : Manager::get().clients) {
+    for (auto* c : clients) {
         /* Compute the client window's and frame window's geometry */
         area_t geometry = c->geometry;
         area_t real_geometry = c->geometry;
@@ -2005,8 +2087,14 @@ static void client_geometry_refresh(void) {
 }
 
 void client_refresh(void) {
-    client_geometry_refresh();
-    client_border_refresh();
+    std::vector<client*> clients;
+    std::swap(clients, Manager::get().refresh_pending);
+    for (auto* c : clients) {
+        c->refresh_pending = false;
+    }
+
+    client_geometry_refresh(clients);
+    client_border_refresh(clients);
     client_focus_refresh();
 }
 
@@ -2018,6 +2106,8 @@ void client_destroy_later(void) {
             ignored_enterleave = true;
         }
         getConnection().destroy_window(window);
+        xwindow_grabs_forget(window);
+        xwindow_shapes_forget(window);
     }
     if (ignored_enterleave) {
         client_restore_enterleave_events();
@@ -2043,69 +2133,194 @@ static void border_width_callback(client* c, uint16_t old_width, uint16_t new_wi
     }
 }
 
-static void client_update_properties(lua_State* L, int cidx, client* c) {
+/** Send the requests for what a restart snapshot contains.
+ * \param w The window.
+ * \param cookies Where to store the cookies.
+ */
+static void client_manage_prefetch_snapshotted(xcb_window_t w, client_manage_cookies_t& cookies) {
+    cookies.wm_client_machine = property_get_wm_client_machine(w);
+    cookies.wm_window_role = property_get_wm_window_role(w);
+    cookies.net_wm_icon = {};
+    if (!Manager::get().lazy_icons) {
+        cookies.net_wm_icon = property_get_net_wm_icon(w);
+    }
+    cookies.wm_name = property_get_wm_name(w);
+    cookies.net_wm_name = property_get_net_wm_name(w);
+    cookies.wm_icon_name = property_get_wm_icon_name(w);
+    cookies.net_wm_icon_name = property_get_net_wm_icon_name(w);
+    cookies.wm_class = property_get_wm_class(w);
+}
+
+/** Take what a restart snapshot has instead of the replies.
+ * \param L The Lua VM state.
+ * \param cidx The client index on the stack.
+ * \param c The client.
+ * \param e The snapshot of the client window.
+ */
+static void client_update_from_snapshot(lua_State* L,
+                                        int cidx,
+                                        client* c,
+                                        const RestartState::Entry& e) {
+    client_set_Machine(L, cidx, e.machine);
+    client_set_Role(L, cidx, e.role);
+    if (e.icons.empty()) {
+        c->icons_stale = true;
+    } else {
+        c->have_ewmh_icon = true;
+        client_set_icons(
+          c, IconCache::from_net_wm_icon(e.icons.data(), e.icons.data() + e.icons.size()));
+    }
+    client_set_AltName(L, cidx, e.alt_name);
+    client_set_Name(L, cidx, e.name);
+    client_set_AltIconName(L, cidx, e.alt_icon_name);
+    client_set_IconName(L, cidx, e.icon_name);
+    if (!e.cls.empty() || !e.instance.empty()) {
+        client_set_ClassInstance(L, cidx, e.cls, e.instance);
+    }
+}
+
+/** Send every request client_manage() needs for a window.
+ * \param w The window.
+ * \return The cookies to pass to client_manage().
+ */
+client_manage_cookies_t client_manage_prefetch(xcb_window_t w) {
+    client_manage_cookies_t cookies{};
+
+    /* Properties changing after the requests below are then notified and
+     * fetched again. The rest of the mask is selected after reparenting. */
+    const uint32_t property_change[] = {XCB_EVENT_MASK_PROPERTY_CHANGE};
+    getConnection().change_attributes(w, XCB_CW_EVENT_MASK, property_change);
+
+    cookies.kde_dockapp = systray_iskdedockapp_unchecked(w);
+    /* If this is a new client that just has been launched, then request its
+     * startup id. */
+    cookies.startup_id = getConnection().get_property(
+      false, w, _NET_STARTUP_ID, XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX);
+    cookies.strut = ewmh_client_strut_unchecked(w);
+    cookies.ewmh_hints = ewmh_client_check_hints_unchecked(w);
+    cookies.snapshot = RestartState::find(w);
+
     /* get all hints */
-    xcb_get_property_cookie_t wm_normal_hints = property_get_wm_normal_hints(c);
-    xcb_get_property_cookie_t wm_hints = property_get_wm_hints(c);
-    xcb_get_property_cookie_t wm_transient_for = property_get_wm_transient_for(c);
-    xcb_get_property_cookie_t wm_client_leader = property_get_wm_client_leader(c);
-    xcb_get_property_cookie_t wm_client_machine = property_get_wm_client_machine(c);
-    xcb_get_property_cookie_t wm_window_role = property_get_wm_window_role(c);
-    xcb_get_property_cookie_t net_wm_pid = property_get_net_wm_pid(c);
-    xcb_get_property_cookie_t net_wm_icon = property_get_net_wm_icon(c);
-    xcb_get_property_cookie_t wm_name = property_get_wm_name(c);
-    xcb_get_property_cookie_t net_wm_name = property_get_net_wm_name(c);
-    xcb_get_property_cookie_t wm_icon_name = property_get_wm_icon_name(c);
-    xcb_get_property_cookie_t net_wm_icon_name = property_get_net_wm_icon_name(c);
-    xcb_get_property_cookie_t wm_class = property_get_wm_class(c);
-    xcb_get_property_cookie_t wm_protocols = property_get_wm_protocols(c);
-    xcb_get_property_cookie_t motif_wm_hints = property_get_motif_wm_hints(c);
-    xcb_get_property_cookie_t opacity = xwindow_get_opacity_unchecked(c->window);
+    cookies.wm_normal_hints = property_get_wm_normal_hints(w);
+    cookies.wm_hints = property_get_wm_hints(w);
+    cookies.wm_transient_for = property_get_wm_transient_for(w);
+    cookies.net_wm_pid = property_get_net_wm_pid(w);
+    cookies.wm_client_leader = property_get_wm_client_leader(w);
+    if (!cookies.snapshot) {
+        client_manage_prefetch_snapshotted(w, cookies);
+    }
+    cookies.wm_protocols = property_get_wm_protocols(w);
+    cookies.motif_wm_hints = property_get_motif_wm_hints(w);
+    cookies.opacity = xwindow_get_opacity_unchecked(w);
+
+    return cookies;
+}
 
+/** Drop the replies of a window that is not managed after all.
+ * \param cookies The cookies from client_manage_prefetch().
+ */
+void client_manage_discard(const client_manage_cookies_t& cookies) {
+    const xcb_get_property_cookie_t all[] = {
+      cookies.kde_dockapp,
+      cookies.startup_id,
+      cookies.strut,
+      cookies.ewmh_hints.desktop,
+      cookies.ewmh_hints.state,
+      cookies.ewmh_hints.window_type,
+      cookies.wm_normal_hints,
+      cookies.wm_hints,
+      cookies.wm_transient_for,
+      cookies.wm_client_leader,
+      cookies.wm_client_machine,
+      cookies.wm_window_role,
+      cookies.net_wm_pid,
+      cookies.net_wm_icon,
+      cookies.wm_name,
+      cookies.net_wm_name,
+      cookies.wm_icon_name,
+      cookies.net_wm_icon_name,
+      cookies.wm_class,
+      cookies.wm_protocols,
+      cookies.motif_wm_hints,
+      cookies.opacity,
+    };
+    for (const auto& cookie : all) {
+        if (cookie.sequence) {
+            getConnection().discard_reply(cookie.sequence);
+        }
+    }
+}
+
+static void client_update_properties(lua_State* L,
+                                     int cidx,
+                                     client* c,
+                                     const client_manage_cookies_t& cookies) {
     /* update strut */
-    ewmh_process_client_strut(c);
+    ewmh_process_client_strut(c, cookies.strut);
 
     /* Now process all replies */
-    property_update_wm_normal_hints(c, wm_normal_hints);
-    property_update_wm_hints(c, wm_hints);
-    property_update_wm_transient_for(c, wm_transient_for);
-    property_update_wm_client_leader(c, wm_client_leader);
-    property_update_wm_client_machine(c, wm_client_machine);
-    property_update_wm_window_role(c, wm_window_role);
-    property_update_net_wm_pid(c, net_wm_pid);
-    property_update_net_wm_icon(c, net_wm_icon);
-    property_update_wm_name(c, wm_name);
-    property_update_net_wm_name(c, net_wm_name);
-    property_update_wm_icon_name(c, wm_icon_name);
-    property_update_net_wm_icon_name(c, net_wm_icon_name);
-    property_update_wm_class(c, wm_class);
-    property_update_wm_protocols(c, wm_protocols);
-    property_update_motif_wm_hints(c, motif_wm_hints);
-    window_set_opacity(L, cidx, xwindow_get_opacity_from_cookie(opacity));
+    property_update_wm_normal_hints(c, cookies.wm_normal_hints);
+    property_update_wm_hints(c, cookies.wm_hints);
+    property_update_wm_transient_for(c, cookies.wm_transient_for);
+    property_update_net_wm_pid(c, cookies.net_wm_pid);
+    property_update_wm_client_leader(c, cookies.wm_client_leader);
+    /* The window id may have been given to another window since the snapshot,
+     * its pid and leader tell whether it is still the same one */
+    const auto* snapshot = cookies.snapshot;
+    if (snapshot && c->pid && snapshot->pid == c->pid && snapshot->leader == c->leader_window) {
+        client_update_from_snapshot(L, cidx, c, *snapshot);
+    } else {
+        client_manage_cookies_t own = cookies;
+        if (snapshot) {
+            /* Another window got the same id, ask for everything after all */
+            client_manage_prefetch_snapshotted(c->window, own);
+        }
+        property_update_wm_client_machine(c, own.wm_client_machine);
+        property_update_wm_window_role(c, own.wm_window_role);
+        if (!own.net_wm_icon.sequence) {
+            c->icons_stale = true;
+        } else {
+            property_update_net_wm_icon(c, own.net_wm_icon);
+        }
+        property_update_wm_name(c, own.wm_name);
+        property_update_net_wm_name(c, own.net_wm_name);
+        property_update_wm_icon_name(c, own.wm_icon_name);
+        property_update_net_wm_icon_name(c, own.net_wm_icon_name);
+        property_update_wm_class(c, own.wm_class);
+    }
+    property_update_wm_protocols(c, cookies.wm_protocols);
+    property_update_motif_wm_hints(c, cookies.motif_wm_hints);
+    window_set_opacity(L, cidx, xwindow_get_opacity_from_cookie(cookies.opacity));
 }
 
 /** Manage a new client.
  * \param w The window.
  * \param wgeom Window geometry.
- * \param startup True if we are managing at startup time.
- */
-void client_manage(xcb_window_t w,
-                   xcb_get_geometry_reply_t* wgeom,
-                   xcb_get_window_attributes_reply_t* wattr) {
+ * \param wattr Window attributes.
+ * \param cookies The requests sent by client_manage_prefetch().
+ * \param reparent_check If given, the reparent is not checked here. Its
+ * cookie is stored instead and has to be passed to
+ * client_manage_check_reparent() later.
+ * \return The new client, or nullptr if the window is not managed as one.
+ */
+client* client_manage(xcb_window_t w,
+                      xcb_get_geometry_reply_t* wgeom,
+                      xcb_get_window_attributes_reply_t* wattr,
+                      const client_manage_cookies_t& cookies,
+                      xcb_void_cookie_t* reparent_check) {
     xcb_void_cookie_t reparent_cookie;
     lua_State* L = globalconf_get_lua_State();
     const uint32_t select_input_val[] = {CLIENT_SELECT_INPUT_EVENT_MASK};
 
-    if (systray_iskdedockapp(w)) {
+    if (systray_iskdedockapp_reply(cookies.kde_dockapp)) {
+        /* The reply was consumed above, everything else is not needed */
+        client_manage_cookies_t rest = cookies;
+        rest.kde_dockapp = {};
+        client_manage_discard(rest);
         systray_request_handle(w);
-        return;
+        return nullptr;
     }
 
-    /* If this is a new client that just has been launched, then request its
-     * startup id. */
-    xcb_get_property_cookie_t startup_id_q = getConnection().get_property(
-      false, w, _NET_STARTUP_ID, XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX);
-
     /* Make sure the window is automatically mapped if awesome exits or dies. */
     getConnection().change_save_set(XCB_SET_MODE_INSERT, w);
     if (Manager::get().x.caps.have_shape) {
@@ -2115,6 +2330,7 @@ void client_manage(xcb_window_t w,
     client* c = newobj<client, client_class>(L);
     xcb_screen_t* s = Manager::get().screen;
     c->border_width_callback = (void (*)(void*, uint16_t, uint16_t))border_width_callback;
+    c->border_need_update_callback = (void (*)(void*))client_need_refresh;
 
     /* consider the window banned */
     c->isbanned = true;
@@ -2171,6 +2387,12 @@ void client_manage(xcb_window_t w,
     /* Duplicate client and push it in client list */
     lua_pushvalue(L, -1);
     Manager::get().clients.insert(Manager::get().clients.begin(), (client*)luaA_object_ref(L, -1));
+    c->hot_slot = Manager::get().clients_hot.acquire(c);
+    client_hot_sync(c);
+    screen_client_index_add(c);
+    Manager::get().windows.clients[c->window] = c;
+    Manager::get().windows.frames[c->frame_window] = c;
+    banning_need_update(c);
 
     /* Set the right screen */
     screen_client_moveto(c, screen_getbycoord({wgeom->x, wgeom->y}), false);
@@ -2181,23 +2403,26 @@ void client_manage(xcb_window_t w,
     c->geometry.top_left = {wgeom->x, wgeom->y};
     c->geometry.width = wgeom->width;
     c->geometry.height = wgeom->height;
+    c->ffi_view.valid = true;
+    client_ffi_sync(c);
+    client_need_refresh(c);
 
-    luaA_object_emit_signal(L, -1, "property::x", 0);
-    luaA_object_emit_signal(L, -1, "property::y", 0);
-    luaA_object_emit_signal(L, -1, "property::width", 0);
-    luaA_object_emit_signal(L, -1, "property::height", 0);
-    luaA_object_emit_signal(L, -1, "property::window", 0);
-    luaA_object_emit_signal(L, -1, "property::geometry", 0);
+    luaA_object_emit_signal(L, -1, "property::x"_sig, 0);
+    luaA_object_emit_signal(L, -1, "property::y"_sig, 0);
+    luaA_object_emit_signal(L, -1, "property::width"_sig, 0);
+    luaA_object_emit_signal(L, -1, "property::height"_sig, 0);
+    luaA_object_emit_signal(L, -1, "property::window"_sig, 0);
+    luaA_object_emit_signal(L, -1, "property::geometry"_sig, 0);
 
     /* Set border width */
     window_set_border_width(L, -1, wgeom->border_width);
 
     /* we honor size hints by default */
     c->size_hints_honor = true;
-    luaA_object_emit_signal(L, -1, "property::size_hints_honor", 0);
+    luaA_object_emit_signal(L, -1, "property::size_hints_honor"_sig, 0);
 
     /* update all properties */
-    client_update_properties(L, -1, c);
+    client_update_properties(L, -1, c, cookies);
 
     /* check if this is a TRANSIENT_FOR of another client */
     for (auto* oc : Manager::get().clients) {
@@ -2210,19 +2435,19 @@ void client_manage(xcb_window_t w,
     xwindow_set_state(c->window, XCB_ICCCM_WM_STATE_NORMAL);
 
     /* Then check clients hints */
-    ewmh_client_check_hints(c);
+    ewmh_client_check_hints(c, cookies.ewmh_hints);
 
     /* Push client in stack */
     stack_client_push(c);
 
     /* Request our response */
-    auto reply = getConnection().get_property_reply(startup_id_q);
+    auto reply = getConnection().get_property_reply(cookies.startup_id);
     /* Say spawn that a client has been started, with startup id as argument */
     auto startup_id = xutil_get_text_property_from_reply(reply);
 
     if (startup_id.empty() && c->leader_window != XCB_NONE) {
         /* GTK hides this property elsewhere. No idea why. */
-        startup_id_q = getConnection().get_property(
+        auto startup_id_q = getConnection().get_property(
           false, c->leader_window, _NET_STARTUP_ID, XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX);
         reply = getConnection().get_property_reply(startup_id_q);
         startup_id = xutil_get_text_property_from_reply(reply);
@@ -2231,7 +2456,8 @@ void client_manage(xcb_window_t w,
 
     spawn_start_notify(c, startup_id.c_str());
 
-    client_class.emit_signal(L, "list", 0);
+    client_class.emit_signal(L, "list"_sig, 0);
+    a_dbus_introspect_changed(DBUS_CHANGE_CLIENTS);
 
     /* Add the context */
     if (Manager::get().loop == NULL) {
@@ -2244,11 +2470,28 @@ void client_manage(xcb_window_t w,
     lua_newtable(L);
 
     /* client is still on top of the stack; emit signal */
-    luaA_object_emit_signal(L, -3, "request::manage", 2);
+    luaA_object_emit_signal(L, -3, "request::manage"_sig, 2);
 
     /*TODO v6: remove this*/
-    luaA_object_emit_signal(L, -1, "manage", 0);
+    luaA_object_emit_signal(L, -1, "manage"_sig, 0);
+
+    if (reparent_check) {
+        *reparent_check = reparent_cookie;
+    } else {
+        client_manage_check_reparent(c, reparent_cookie);
+    }
+
+    /* pop client */
+    lua_pop(L, 1);
+
+    return c;
+}
 
+/** Unmanage a client again if reparenting it failed.
+ * \param c The client returned by client_manage().
+ * \param reparent_cookie The cookie stored by client_manage().
+ */
+void client_manage_check_reparent(client* c, xcb_void_cookie_t reparent_cookie) {
     xcb_generic_error_t* error = getConnection().request_check(reparent_cookie);
     if (error != NULL) {
         log_warn(
@@ -2261,9 +2504,6 @@ void client_manage(xcb_window_t w,
         p_delete(&error);
         client_unmanage(c, CLIENT_UNMANAGE_FAILED);
     }
-
-    /* pop client */
-    lua_pop(L, 1);
 }
 
 static void client_remove_titlebar_geometry(client* c, area_t* geometry) {
@@ -2410,43 +2650,64 @@ static area_t client_apply_size_hints(client* c, area_t geometry) {
     return geometry;
 }
 
-static void client_resize_do(client* c, area_t geometry) {
-    lua_State* L = globalconf_get_lua_State();
-
-    screen_t* new_screen = c->screen;
-    if (!screen_area_in_screen(new_screen, geometry)) {
-        new_screen = screen_getbycoord(geometry.top_left);
-    }
+/** Emit the property signals for a change of geometry.
+ * \param L The Lua VM state.
+ * \param c The client.
+ * \param old_geometry The geometry before the change.
+ */
+static void client_emit_geometry_signals(lua_State* L, client* c, area_t old_geometry) {
+    const area_t geometry = c->geometry;
 
-    /* Also store geometry including border */
-    area_t old_geometry = c->geometry;
-    c->geometry = geometry;
+    client_ffi_sync(c);
 
     luaA_object_push(L, c);
     if (old_geometry != geometry) {
-        luaA_object_emit_signal(L, -1, "property::geometry", 0);
+        luaA_object_emit_signal(L, -1, "property::geometry"_sig, 0);
     }
     if (old_geometry.top_left != geometry.top_left) {
-        luaA_object_emit_signal(L, -1, "property::position", 0);
+        luaA_object_emit_signal(L, -1, "property::position"_sig, 0);
         if (old_geometry.top_left.x != geometry.top_left.x) {
-            luaA_object_emit_signal(L, -1, "property::x", 0);
+            luaA_object_emit_signal(L, -1, "property::x"_sig, 0);
         }
         if (old_geometry.top_left.y != geometry.top_left.y) {
-            luaA_object_emit_signal(L, -1, "property::y", 0);
+            luaA_object_emit_signal(L, -1, "property::y"_sig, 0);
         }
     }
     if (old_geometry.width != geometry.width || old_geometry.height != geometry.height) {
-        luaA_object_emit_signal(L, -1, "property::size", 0);
+        luaA_object_emit_signal(L, -1, "property::size"_sig, 0);
         if (old_geometry.width != geometry.width) {
-            luaA_object_emit_signal(L, -1, "property::width", 0);
+            luaA_object_emit_signal(L, -1, "property::width"_sig, 0);
         }
         if (old_geometry.height != geometry.height) {
-            luaA_object_emit_signal(L, -1, "property::height", 0);
+            luaA_object_emit_signal(L, -1, "property::height"_sig, 0);
         }
     }
     lua_pop(L, 1);
+}
 
-    screen_client_moveto(c, new_screen, false);
+/** Update the screen and the titlebars of a client after its geometry changed.
+ * \param L The Lua VM state.
+ * \param c The client.
+ */
+static void client_resize_finish(lua_State* L, client* c) {
+    const area_t geometry = c->geometry;
+
+    if (!screen_area_in_screen(c->screen, geometry)) {
+        screen_client_moveto(c, screen_getbycoord(geometry.top_left), false);
+    }
+
+    area_t areas[CLIENT_TITLEBAR_COUNT];
+    for (int bar = CLIENT_TITLEBAR_TOP; bar < CLIENT_TITLEBAR_COUNT; bar++) {
+        areas[bar] = titlebar_get_area(c, (client_titlebar_t)bar);
+
+        /* Convert to global coordinates */
+        areas[bar].top_left += geometry.top_left;
+
+        if (c->fullscreen) {
+            areas[bar].width = areas[bar].height = 0;
+        }
+    }
+    const bool atlas = titlebar_atlas_update(c, areas);
 
     /* Update all titlebars */
     for (int bar = CLIENT_TITLEBAR_TOP; bar < CLIENT_TITLEBAR_COUNT; bar++) {
@@ -2458,64 +2719,82 @@ static void client_resize_do(client* c, area_t geometry) {
         auto drawable = (drawable_t*)titlebar_get_drawable(L, c, -1, (client_titlebar_t)bar);
         luaA_object_push_item(L, -1, drawable);
 
-        area_t area = titlebar_get_area(c, (client_titlebar_t)bar);
-
-        /* Convert to global coordinates */
-        area.top_left += geometry.top_left;
-
-        if (c->fullscreen) {
-            area.width = area.height = 0;
-        }
-        drawable_set_geometry(L, -1, area);
+        const drawable_slot_t slot = {c->titlebar_atlas.pixmap,
+                                      c->titlebar_atlas.surface,
+                                      titlebar_atlas_offset(c, (client_titlebar_t)bar)};
+        drawable_set_geometry(L, -1, areas[bar], atlas ? &slot : nullptr);
 
         /* Pop the client and the drawable */
         lua_pop(L, 2);
     }
 }
 
-/** Resize client window.
- * The sizes given as parameters are with borders!
+static void client_resize_do(client* c, area_t geometry) {
+    lua_State* L = globalconf_get_lua_State();
+
+    /* Also store geometry including border */
+    area_t old_geometry = c->geometry;
+    c->geometry = geometry;
+    /* Titlebar and fullscreen changes come through here with the same geometry */
+    client_need_refresh(c);
+
+    client_emit_geometry_signals(L, c, old_geometry);
+    client_resize_finish(L, c);
+}
+
+/** Get the geometry a client would get when resized.
  * \param c Client to resize.
  * \param geometry New window geometry.
  * \param honor_hints Use size hints.
- * \return true if an actual resize occurred.
+ * \return The geometry to apply, or nothing if the client cannot take that size.
  */
-bool client_resize(client* c, area_t geometry, bool honor_hints) {
+std::optional<area_t> client_resize_geometry(client* c, area_t geometry, bool honor_hints) {
     if (honor_hints) {
         /* We could get integer underflows in client_remove_titlebar_geometry()
          * without these checks here.
          */
         if (geometry.width <
             c->titlebar[CLIENT_TITLEBAR_LEFT].size + c->titlebar[CLIENT_TITLEBAR_RIGHT].size) {
-            return false;
+            return {};
         }
         if (geometry.height <
             c->titlebar[CLIENT_TITLEBAR_TOP].size + c->titlebar[CLIENT_TITLEBAR_BOTTOM].size) {
-            return false;
+            return {};
         }
         geometry = client_apply_size_hints(c, geometry);
     }
 
     if (geometry.width <
         c->titlebar[CLIENT_TITLEBAR_LEFT].size + c->titlebar[CLIENT_TITLEBAR_RIGHT].size) {
-        return false;
+        return {};
     }
     if (geometry.height <
         c->titlebar[CLIENT_TITLEBAR_TOP].size + c->titlebar[CLIENT_TITLEBAR_BOTTOM].size) {
-        return false;
+        return {};
     }
 
     if (geometry.width == 0 || geometry.height == 0) {
-        return false;
+        return {};
     }
 
-    if (c->geometry != geometry) {
-        client_resize_do(c, geometry);
+    return geometry;
+}
 
-        return true;
+/** Resize client window.
+ * The sizes given as parameters are with borders!
+ * \param c Client to resize.
+ * \param geometry New window geometry.
+ * \param honor_hints Use size hints.
+ * \return true if an actual resize occurred.
+ */
+bool client_resize(client* c, area_t geometry, bool honor_hints) {
+    auto g = client_resize_geometry(c, geometry, honor_hints);
+    if (!g || c->geometry == *g) {
+        return false;
     }
 
-    return false;
+    client_resize_do(c, *g);
+    return true;
 }
 
 /** Set a client minimized, or not.
@@ -2530,7 +2809,9 @@ void client_set_minimized(lua_State* L, int cidx, bool s) {
         return;
     }
     c->minimized = s;
-    banning_need_update();
+    client_ffi_sync(c);
+    client_hot_sync(c);
+    banning_need_update(c);
     if (s) {
         /* ICCCM: To transition from ICONIC to NORMAL state, the client
          * should just map the window. Thus, iconic clients need to be
@@ -2558,7 +2839,7 @@ void client_set_minimized(lua_State* L, int cidx, bool s) {
     if (strut_has_value(&c->strut)) {
         screen_update_workarea(c->screen);
     }
-    luaA_object_emit_signal(L, cidx, "property::minimized", 0);
+    luaA_object_emit_signal(L, cidx, "property::minimized"_sig, 0);
 }
 
 /** Set a client hidden, or not.
@@ -2571,11 +2852,13 @@ static void client_set_hidden(lua_State* L, int cidx, bool s) {
 
     if (c->hidden != s) {
         c->hidden = s;
-        banning_need_update();
+        client_ffi_sync(c);
+        client_hot_sync(c);
+        banning_need_update(c);
         if (strut_has_value(&c->strut)) {
             screen_update_workarea(c->screen);
         }
-        luaA_object_emit_signal(L, cidx, "property::hidden", 0);
+        luaA_object_emit_signal(L, cidx, "property::hidden"_sig, 0);
     }
 }
 
@@ -2589,12 +2872,13 @@ void client_set_sticky(lua_State* L, int cidx, bool s) {
 
     if (c->sticky != s) {
         c->sticky = s;
-        banning_need_update();
+        client_hot_sync(c);
+        banning_need_update(c);
         ewmh_client_update_desktop(c);
         if (strut_has_value(&c->strut)) {
             screen_update_workarea(c->screen);
         }
-        luaA_object_emit_signal(L, cidx, "property::sticky", 0);
+        luaA_object_emit_signal(L, cidx, "property::sticky"_sig, 0);
     }
 }
 
@@ -2608,7 +2892,7 @@ static void client_set_focusable(lua_State* L, int cidx, bool s) {
 
     if (c->focusable != s) {
         c->focusable = s;
-        luaA_object_emit_signal(L, cidx, "property::focusable", 0);
+        luaA_object_emit_signal(L, cidx, "property::focusable"_sig, 0);
     }
 }
 
@@ -2621,7 +2905,7 @@ static void client_unset_focusable(lua_State* L, int cidx) {
 
     if (c->focusable.has_value()) {
         c->focusable.reset();
-        luaA_object_emit_signal(L, cidx, "property::focusable", 0);
+        luaA_object_emit_signal(L, cidx, "property::focusable"_sig, 0);
     }
 }
 
@@ -2644,8 +2928,8 @@ void client_set_fullscreen(lua_State* L, int cidx, bool s) {
         int abs_cidx = Lua::absindex(L, cidx);
         lua_pushstring(L, "fullscreen");
         c->fullscreen = s;
-        luaA_object_emit_signal(L, abs_cidx, "request::geometry", 1);
-        luaA_object_emit_signal(L, abs_cidx, "property::fullscreen", 0);
+        luaA_object_emit_signal(L, abs_cidx, "request::geometry"_sig, 1);
+        luaA_object_emit_signal(L, abs_cidx, "property::fullscreen"_sig, 0);
         /* Force a client resize, so that titlebars get shown/hidden */
         client_resize_do(c, c->geometry);
         stack_windows();
@@ -2685,17 +2969,17 @@ void client_set_maximized_common(lua_State* L, int cidx, bool s, const char* typ
 
         /* Request the changes to be applied */
         lua_pushstring(L, type);
-        luaA_object_emit_signal(L, abs_cidx, "request::geometry", 1);
+        luaA_object_emit_signal(L, abs_cidx, "request::geometry"_sig, 1);
 
         /* Notify changes in the relevant properties */
         if (h_before != c->maximized_horizontal) {
-            luaA_object_emit_signal(L, abs_cidx, "property::maximized_horizontal", 0);
+            luaA_object_emit_signal(L, abs_cidx, "property::maximized_horizontal"_sig, 0);
         }
         if (v_before != c->maximized_vertical) {
-            luaA_object_emit_signal(L, abs_cidx, "property::maximized_vertical", 0);
+            luaA_object_emit_signal(L, abs_cidx, "property::maximized_vertical"_sig, 0);
         }
         if (max_before != c->maximized) {
-            luaA_object_emit_signal(L, abs_cidx, "property::maximized", 0);
+            luaA_object_emit_signal(L, abs_cidx, "property::maximized"_sig, 0);
         }
 
         stack_windows();
@@ -2731,7 +3015,7 @@ void client_set_above(lua_State* L, int cidx, bool s) {
         }
         c->above = s;
         stack_windows();
-        luaA_object_emit_signal(L, cidx, "property::above", 0);
+        luaA_object_emit_signal(L, cidx, "property::above"_sig, 0);
     }
 }
 
@@ -2752,7 +3036,7 @@ void client_set_below(lua_State* L, int cidx, bool s) {
         }
         c->below = s;
         stack_windows();
-        luaA_object_emit_signal(L, cidx, "property::below", 0);
+        luaA_object_emit_signal(L, cidx, "property::below"_sig, 0);
     }
 }
 
@@ -2767,7 +3051,7 @@ void client_set_modal(lua_State* L, int cidx, bool s) {
     if (c->modal != s) {
         c->modal = s;
         stack_windows();
-        luaA_object_emit_signal(L, cidx, "property::modal", 0);
+        luaA_object_emit_signal(L, cidx, "property::modal"_sig, 0);
     }
 }
 
@@ -2788,7 +3072,7 @@ void client_set_ontop(lua_State* L, int cidx, bool s) {
         }
         c->ontop = s;
         stack_windows();
-        luaA_object_emit_signal(L, cidx, "property::ontop", 0);
+        luaA_object_emit_signal(L, cidx, "property::ontop"_sig, 0);
     }
 }
 
@@ -2803,6 +3087,7 @@ void client_unban(client* c) {
         client_restore_enterleave_events();
 
         c->isbanned = false;
+        client_hot_sync(c);
 
         /* An unbanned client shouldn't be minimized or hidden */
         luaA_object_push(L, c);
@@ -2833,15 +3118,33 @@ void client_unmanage(client* c, client_unmanage_t reason) {
     if (Manager::get().focus.client == c) {
         client_unfocus(c);
     }
+    client_history_remove(c);
+
+    /* The frame window is going away, don't copy titlebars to it */
+    drawable_damage_forget(c);
+    Capture::forget(c, reason == CLIENT_UNMANAGE_DESTROYED);
 
     /* remove client from global list and everywhere else */
     if (auto it = std::ranges::find(Manager::get().clients, c);
         it != Manager::get().clients.end()) {
         Manager::get().clients.erase(it);
+        screen_client_index_remove(c);
+    }
+    if (c->hot_slot != ClientHotStore::no_slot) {
+        Manager::get().clients_hot.release(c->hot_slot);
+        c->hot_slot = ClientHotStore::no_slot;
+    }
+    Manager::get().windows.clients.erase(c->window);
+    Manager::get().windows.frames.erase(c->frame_window);
+    if (c->nofocus_window != XCB_NONE) {
+        Manager::get().windows.nofocus.erase(c->nofocus_window);
     }
     stack_client_remove(c);
-    for (size_t i = 0; i < Manager::get().tags.size(); i++) {
-        untag_client(c, Manager::get().tags[i].get());
+    untag_client_all(c);
+    banning_client_remove(c);
+    if (c->refresh_pending) {
+        std::erase(Manager::get().refresh_pending, c);
+        c->refresh_pending = false;
     }
 
     luaA_object_push(L, c);
@@ -2859,17 +3162,20 @@ void client_unmanage(client* c, client_unmanage_t reason) {
     /* Hints */
     lua_newtable(L);
 
-    luaA_object_emit_signal(L, -3, "request::unmanage", 2);
-    luaA_object_emit_signal(L, -1, "unmanage", 0);
+    luaA_object_emit_signal(L, -3, "request::unmanage"_sig, 2);
+    luaA_object_emit_signal(L, -1, "unmanage"_sig, 0);
     lua_pop(L, 1);
 
-    client_class.emit_signal(L, "list", 0);
+    client_class.emit_signal(L, "list"_sig, 0);
+    a_dbus_introspect_changed(DBUS_CHANGE_CLIENTS);
 
     if (strut_has_value(&c->strut)) {
+        screen_strut_forget(c);
         screen_update_workarea(c->screen);
     }
 
     /* Get rid of all titlebars */
+    titlebar_atlas_free(c);
     for (int bar = CLIENT_TITLEBAR_TOP; bar < CLIENT_TITLEBAR_COUNT; bar++) {
         if (c->titlebar[bar].drawable == NULL) {
             continue;
@@ -2923,8 +3229,11 @@ void client_unmanage(client* c, client_unmanage_t reason) {
         xwindow_set_state(c->window, XCB_ICCCM_WM_STATE_WITHDRAWN);
     }
 
+    xwindow_grabs_forget(c->window);
+
     /* set client as invalid */
     c->window = XCB_NONE;
+    c->ffi_view.valid = false;
 
     luaA_object_unref(L, c);
 }
@@ -2952,6 +3261,28 @@ void client_kill(client* c) {
     }
 }
 
+/** Call a function on clients, optionally filtered by screen.
+ * \param screen The screen to filter on, or NULL for all clients.
+ * \param stacked Whether to go in stacking order, from top to bottom.
+ * \param f The function to call.
+ */
+template <typename F>
+static void client_foreach(screen_t* screen, bool stacked, F&& f) {
+    /* f may run Lua code changing the lists, so iterate over a copy */
+    std::vector<client*> clients;
+    if (screen) {
+        clients = stacked ? screen_stack(screen) : screen_clients(screen);
+    } else {
+        clients = stacked ? Manager::get().getStack() : Manager::get().clients;
+    }
+    if (stacked) {
+        std::ranges::reverse(clients);
+    }
+    for (auto* c : clients) {
+        f(c);
+    }
+}
+
 /** Get all clients into a table.
  *
  * @tparam[opt] integer|screen screen A screen number to filter clients on.
@@ -2977,28 +3308,123 @@ static int luaA_client_get(lua_State* L) {
 
     lua_newtable(L);
 
-    auto pushclient = [i = int(1), L](auto* c) mutable {
+    client_foreach(screen, stacked, [i = int(1), L](auto* c) mutable {
         luaA_object_push(L, c);
         lua_rawseti(L, -2, i++);
-    };
+    });
 
-    if (stacked) {
-        for (auto* c :
-             Manager::get().getStack() | std::views::reverse |
-               std::views::filter([screen](auto* c) { return !screen || c->screen == screen; })) {
-            pushclient(c);
+    return 1;
+}
+
+/** Step a focus history iterator.
+ * Its upvalues are the screen, the tag, whether only visible clients are
+ * wanted and the client returned last.
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack.
+ */
+static int luaA_client_focus_history_next(lua_State* L) {
+    client* head = Manager::get().focus.history;
+    if (!head) {
+        return 0;
+    }
+
+    client* c = head;
+    if (!lua_isnil(L, lua_upvalueindex(4))) {
+        auto last = static_cast<client*>(lua_touserdata(L, lua_upvalueindex(4)));
+        /* Stop if the last client was removed or the ring wrapped */
+        if (!last->history_next || last->history_next == head) {
+            return 0;
         }
-    } else {
-        for (auto* c : Manager::get().clients | std::views::filter([screen](auto* c) {
-                           return !screen || c->screen == screen;
-                       })) {
-            pushclient(c);
+        c = last->history_next;
+    }
+
+    auto s = static_cast<screen_t*>(lua_touserdata(L, lua_upvalueindex(1)));
+    auto t = static_cast<tag_t*>(lua_touserdata(L, lua_upvalueindex(2)));
+    const bool visible = lua_toboolean(L, lua_upvalueindex(3));
+    for (;;) {
+        if ((!s || c->screen == s) && (!t || is_client_tagged(c, t)) &&
+            (!visible || client_isvisible(c))) {
+            luaA_object_push(L, c);
+            lua_pushvalue(L, -1);
+            lua_replace(L, lua_upvalueindex(4));
+            return 1;
+        }
+        c = c->history_next;
+        if (c == head) {
+            return 0;
         }
     }
+}
 
+/** Iterate over the focus history, most recently focused client first.
+ *
+ * The clients are filtered without building a table, so finding the previous
+ * client on a screen or tag only looks at the clients before it.
+ *
+ * @tparam[opt] screen screen Only return clients on this screen.
+ * @tparam[opt] tag tag Only return clients with this tag.
+ * @tparam[opt=false] boolean visible Only return visible clients.
+ * @treturn function An iterator returning clients.
+ * @staticfct focus_history
+ * @usage for c in client.focus_history(screen.focused(), nil, true) do
+ *     -- do something
+ * end
+ */
+static int luaA_client_focus_history(lua_State* L) {
+    if (!lua_isnoneornil(L, 1)) {
+        luaA_object_push(L, luaA_checkscreen(L, 1));
+    } else {
+        lua_pushnil(L);
+    }
+    if (!lua_isnoneornil(L, 2)) {
+        tag_class.checkudata<tag_t>(L, 2);
+        lua_pushvalue(L, 2);
+    } else {
+        lua_pushnil(L);
+    }
+    lua_pushboolean(L, lua_toboolean(L, 3));
+    lua_pushnil(L);
+    lua_pushcclosure(L, luaA_client_focus_history_next, 4);
     return 1;
 }
 
+/** Make a client the most recent entry of the focus history.
+ *
+ * @tparam client c The client.
+ * @noreturn
+ * @staticfct focus_history_add
+ */
+static int luaA_client_focus_history_add(lua_State* L) {
+    auto c = client_class.checkudata<client>(L, 1);
+    /* Unmanaged clients never come back */
+    if (std::ranges::find(Manager::get().clients, c) != Manager::get().clients.end()) {
+        client_history_add(c);
+    }
+    return 0;
+}
+
+/** Remove a client from the focus history.
+ *
+ * @tparam client c The client.
+ * @noreturn
+ * @staticfct focus_history_delete
+ */
+static int luaA_client_focus_history_delete(lua_State* L) {
+    client_history_remove(client_class.checkudata<client>(L, 1));
+    return 0;
+}
+
+/** Set whether focused clients are added to the focus history.
+ *
+ * @tparam boolean enabled Whether focus changes are tracked.
+ * @noreturn
+ * @staticfct set_focus_history_tracking
+ */
+static int luaA_client_set_focus_history_tracking(lua_State* L) {
+    Manager::get().focus.history_tracking = Lua::checkboolean(L, 1);
+    return 0;
+}
+
 /** Check if a client is visible on its screen.
  *
  * @treturn boolean A boolean value, true if the client is visible, false otherwise.
@@ -3010,40 +3436,109 @@ static int luaA_client_isvisible(lua_State* L) {
     return 1;
 }
 
-/** Set client icons.
+/** Get the address of the FFI view of a client's hot fields.
+ * Used by awful.client.ffi, the address is valid as long as the client object.
  * \param L The Lua VM state.
+ * \return The number of elements pushed on stack.
+ */
+static int luaA_client_ffi_view(lua_State* L) {
+    auto c = client_class.checkudata<client>(L, 1);
+    lua_pushlightuserdata(L, &c->ffi_view);
+    return 1;
+}
+
+/** Store client icons and decode the one that will most likely be used.
+ * \param c The client.
  * \param array Array of icons to set.
+ * \return False if the client already had these icons.
  */
-void client_set_icons(client* c, std::vector<cairo_surface_handle> array) {
-    c->icons.clear();
+static bool client_store_icons(client* c, std::vector<IconCache::IconPtr> array) {
+    /* Clients tend to set the same icons again, which the cache recognizes */
+    if (!array.empty() && array == c->icons) {
+        return false;
+    }
     c->icons = std::move(array);
 
+    /* Only the icon that will most likely be used is decoded right away */
+    if (auto icon = IconCache::closest(c->icons, Manager::get().preferred_icon_size)) {
+        icon->surface();
+    }
+    return true;
+}
+
+static void client_emit_icon_signals(client* c) {
     lua_State* L = globalconf_get_lua_State();
     luaA_object_push(L, c);
-    luaA_object_emit_signal(L, -1, "property::icon", 0);
-    luaA_object_emit_signal(L, -1, "property::icon_sizes", 0);
+    luaA_object_emit_signal(L, -1, "property::icon"_sig, 0);
+    luaA_object_emit_signal(L, -1, "property::icon_sizes"_sig, 0);
     lua_pop(L, 1);
 }
 
+/** Set client icons.
+ * \param c The client.
+ * \param array Array of icons to set.
+ */
+void client_set_icons(client* c, std::vector<IconCache::IconPtr> array) {
+    if (client_store_icons(c, std::move(array))) {
+        client_emit_icon_signals(c);
+    }
+}
+
+/** Mark _NET_WM_ICON as changed without fetching it.
+ * It is fetched when Lua asks for the icon, see awesome.set_lazy_icons().
+ * \param c The client.
+ */
+void client_icons_invalidate(client* c) {
+    if (c->icons_stale) {
+        return;
+    }
+    c->icons_stale = true;
+    client_emit_icon_signals(c);
+}
+
+static void client_load_icon_from_pixmaps(client*, xcb_pixmap_t, xcb_pixmap_t);
+
+/** Fetch _NET_WM_ICON if it changed since it was last fetched, then the
+ * WM_HINTS icon if the client has no _NET_WM_ICON.
+ * This happens while Lua reads a property, so no signals are emitted: they
+ * were already emitted when the icons were marked as changed.
+ * \param c The client.
+ */
+static void client_icons_fetch(client* c) {
+    if (c->icons_stale) {
+        c->icons_stale = false;
+        auto array = ewmh_window_icon_get_reply(property_get_net_wm_icon(c->window));
+        if (!array.empty()) {
+            c->have_ewmh_icon = true;
+            client_store_icons(c, std::move(array));
+        }
+    }
+
+    const auto hints = std::exchange(c->hints_icon, {});
+    if (hints.icon && !c->have_ewmh_icon) {
+        client_load_icon_from_pixmaps(c, hints.icon, hints.mask);
+    }
+}
+
 /** Set a client icon.
  * \param L The Lua VM state.
  * \param cidx The client index on the stack.
  * \param iidx The image index on the stack.
  */
 static void client_set_icon(client* c, cairo_surface_t* s) {
-    std::vector<cairo_surface_handle> array;
+    std::vector<IconCache::IconPtr> array;
     if (s && cairo_surface_status(s) == CAIRO_STATUS_SUCCESS) {
-        array.emplace_back(draw_dup_image_surface(s));
+        array.push_back(IconCache::from_surface(cairo_surface_handle{draw_dup_image_surface(s)}));
     }
     client_set_icons(c, std::move(array));
 }
 
-/** Set a client icon.
+/** Read a client icon from pixmaps and set it.
  * \param c The client to change.
  * \param icon A bitmap containing the icon.
  * \param mask A mask for the bitmap (optional)
  */
-void client_set_icon_from_pixmaps(client* c, xcb_pixmap_t icon, xcb_pixmap_t mask) {
+static void client_load_icon_from_pixmaps(client* c, xcb_pixmap_t icon, xcb_pixmap_t mask) {
     cairo_surface_t *s_icon, *result;
 
     auto geom_icon_c = getConnection().get_geometry_unchecked(icon);
@@ -3113,6 +3608,24 @@ void client_set_icon_from_pixmaps(client* c, xcb_pixmap_t icon, xcb_pixmap_t mas
     }
 }
 
+/** Set a client icon from the WM_HINTS pixmaps.
+ * With lazy icons, the pixmaps are only read when Lua asks for the icon.
+ * \param c The client to change.
+ * \param icon A bitmap containing the icon.
+ * \param mask A mask for the bitmap (optional)
+ */
+void client_set_icon_from_pixmaps(client* c, xcb_pixmap_t icon, xcb_pixmap_t mask) {
+    if (!Manager::get().lazy_icons) {
+        client_load_icon_from_pixmaps(c, icon, mask);
+        return;
+    }
+    const bool pending = c->icons_stale || c->hints_icon.icon;
+    c->hints_icon = {icon, mask};
+    if (!pending) {
+        client_emit_icon_signals(c);
+    }
+}
+
 /** Kill a client.
  *
  * This method can be used to close (kill) a **client** using the
@@ -3169,17 +3682,19 @@ static int luaA_client_swap(lua_State* L) {
         /* swap ! */
         *ref_c = swap;
         *ref_swap = c;
+        screen_client_index_swap(c, swap);
 
-        client_class.emit_signal(L, "list", 0);
+        client_class.emit_signal(L, "list"_sig, 0);
+        a_dbus_introspect_changed(DBUS_CHANGE_CLIENTS);
 
         luaA_object_push(L, swap);
         lua_pushboolean(L, true);
-        luaA_object_emit_signal(L, -4, "swapped", 2);
+        luaA_object_emit_signal(L, -4, "swapped"_sig, 2);
 
         luaA_object_push(L, swap);
         luaA_object_push(L, c);
         lua_pushboolean(L, false);
-        luaA_object_emit_signal(L, -3, "swapped", 2);
+        luaA_object_emit_signal(L, -3, "swapped"_sig, 2);
     }
 
     return 0;
@@ -3205,35 +3720,27 @@ static int luaA_client_tags(lua_State* L) {
 
     if (lua_gettop(L) == 2) {
         Lua::checktable(L, 2);
-        for (size_t i = 0; i < Manager::get().tags.size(); i++) {
-            /* Only untag if we aren't going to add this tag again */
-            bool found = false;
-            lua_pushnil(L);
-            while (lua_next(L, 2)) {
-                auto t = (tag_t*)lua_touserdata(L, -1);
-                /* Pop the value from lua_next */
-                lua_pop(L, 1);
-                if (t != Manager::get().tags[i].get()) {
-                    continue;
-                }
-
-                /* Pop the key from lua_next */
-                lua_pop(L, 1);
-                found = true;
-                break;
-            }
-            if (!found) {
-                untag_client(c, Manager::get().tags[i].get());
-            }
-        }
+        Scratch::vector<tag_t*> wanted;
         lua_pushnil(L);
         while (lua_next(L, 2)) {
-            tag_client(L, c);
+            wanted.push_back(tag_class.checkudata<tag_t>(L, -1));
+            lua_pop(L, 1);
         }
 
-        lua_pop(L, 1);
+        /* Only untag if we aren't going to add this tag again */
+        Scratch::vector<tag_change_t> changes;
+        for (const auto& tag : Manager::get().tags) {
+            if (is_client_tagged(c, tag.get()) &&
+                std::ranges::find(wanted, tag.get()) == wanted.end()) {
+                changes.push_back({c, tag.get(), false});
+            }
+        }
+        for (auto* t : wanted) {
+            changes.push_back({c, t, true});
+        }
+        tag_apply_changes(L, changes);
 
-        luaA_object_emit_signal(L, -1, "property::tags", 0);
+        luaA_object_emit_signal(L, 1, "property::tags"_sig, 0);
     }
 
     lua_newtable(L);
@@ -3247,6 +3754,45 @@ static int luaA_client_tags(lua_State* L) {
     return 1;
 }
 
+/** Move clients to a tag.
+ *
+ * Each client afterwards only has the given tag. All clients are moved at
+ * once, so only the tags that actually change emit `tagged` and `untagged`
+ * and the work area of each screen is updated once. Unlike `move_to_tag`,
+ * this does not move the clients to the screen of the tag.
+ *
+ * @tparam table clients The clients to move.
+ * @tparam tag t The tag to move them to.
+ * @noreturn
+ * @staticfct move_to_tag
+ * @emits property::tags For each client whose tags changed.
+ * @see move_to_tag
+ * @see tags
+ */
+static int luaA_client_move_to_tag(lua_State* L) {
+    Lua::checktable(L, 1);
+    auto t = tag_class.checkudata<tag_t>(L, 2);
+    Scratch::vector<tag_change_t> changes;
+    lua_pushnil(L);
+    while (lua_next(L, 1)) {
+        auto c = client_class.checkudata<client>(L, -1);
+        lua_pop(L, 1);
+        for (const auto& tag : Manager::get().tags) {
+            if (tag.get() != t && is_client_tagged(c, tag.get())) {
+                changes.push_back({c, tag.get(), false});
+            }
+        }
+        changes.push_back({c, t, true});
+    }
+
+    for (auto* c : tag_apply_changes(L, changes)) {
+        luaA_object_push(L, c);
+        luaA_object_emit_signal(L, -1, "property::tags"_sig, 0);
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
 /** Get the first tag of a client.
  */
 static int luaA_client_get_first_tag(lua_State* L, lua_object_t* o) {
@@ -3275,8 +3821,7 @@ static int luaA_client_raise(lua_State* L) {
     auto c = client_class.checkudata<client>(L, 1);
 
     /* Avoid sending the signal if nothing was done */
-    if (c->transient_for == NULL && Manager::get().getStack().size() &&
-        Manager::get().getStack().back() == c) {
+    if (c->transient_for == NULL && stack_top() == c) {
         return 0;
     }
 
@@ -3299,7 +3844,7 @@ static int luaA_client_lower(lua_State* L) {
     auto c = client_class.checkudata<client>(L, 1);
 
     /* Avoid sending the signal if nothing was done */
-    if (Manager::get().getStack().size() && Manager::get().getStack().front() == c) {
+    if (stack_bottom() == c) {
         return 0;
     }
 
@@ -3312,12 +3857,66 @@ static int luaA_client_lower(lua_State* L) {
 
     /* Notify the listeners */
     luaA_object_push(L, c);
-    luaA_object_emit_signal(L, -1, "lowered", 0);
+    luaA_object_emit_signal(L, -1, "lowered"_sig, 0);
     lua_pop(L, 1);
 
     return 0;
 }
 
+/** Change the stacking order of many clients at once.
+ *
+ * This is like calling `raise` on each client, or swapping their places in
+ * the stack, but `_NET_CLIENT_LIST_STACKING` is only updated once and the
+ * windows are restacked in one go.
+ *
+ * @tparam table clients The clients, from top to bottom.
+ * @tparam[opt=false] boolean raise If true, the clients are raised, like
+ *  with `raise`, and the first one ends up on top. Otherwise they only take
+ *  each other's places in the stack and the other clients do not move.
+ * @noreturn
+ * @staticfct restack
+ * @emits raised For each client when *raise* is true.
+ * @see raise
+ * @see get
+ */
+static int luaA_client_restack(lua_State* L) {
+    Lua::checktable(L, 1);
+    const bool raise = lua_toboolean(L, 2);
+    /* From top to bottom, without duplicates */
+    std::vector<client*> clients;
+    std::unordered_set<client*> seen;
+    for (size_t i = 1; i <= Lua::rawlen(L, 1); i++) {
+        lua_rawgeti(L, 1, i);
+        auto c = client_class.checkudata<client>(L, -1);
+        lua_pop(L, 1);
+        if (seen.insert(c).second) {
+            clients.push_back(c);
+        }
+    }
+
+    std::vector<client*> order;
+    for (auto* c : clients | std::views::reverse) {
+        if (raise) {
+            /* Transient parents go below, like with client_raise() */
+            const size_t at = order.size();
+            for (client* tc = c->transient_for; tc; tc = tc->transient_for) {
+                order.insert(order.begin() + at, tc);
+            }
+        }
+        order.push_back(c);
+    }
+    stack_client_restack(order, raise);
+
+    if (raise) {
+        for (auto* c : clients) {
+            luaA_object_push(L, c);
+            luaA_object_emit_signal(L, -1, "raised"_sig, 0);
+            lua_pop(L, 1);
+        }
+    }
+    return 0;
+}
+
 /** Stop managing a client.
  *
  * @method unmanage
@@ -3385,8 +3984,7 @@ drawable_t* client_get_drawable(client* c, point pt) { return client_get_drawabl
 
 static void client_refresh_titlebar_partial(
   client* c, client_titlebar_t bar, int16_t x, int16_t y, uint16_t width, uint16_t height) {
-    if (c->titlebar[bar].drawable == NULL || c->titlebar[bar].drawable->pixmap == XCB_NONE ||
-        !c->titlebar[bar].drawable->refreshed) {
+    if (c->titlebar[bar].drawable == NULL) {
         return;
     }
 
@@ -3399,21 +3997,32 @@ static void client_refresh_titlebar_partial(
         return;
     }
 
-    /* Redraw the affected parts */
-    cairo_surface_flush(c->titlebar[bar].drawable->surface);
-    getConnection().copy_area(
-      c->titlebar[bar].drawable->pixmap,
-      c->frame_window,
-      Manager::get().gc,
-      {static_cast<int16_t>(x - area.left()), static_cast<int16_t>(y - area.top()), width, height},
-      {x, y});
+    /* Schedule a copy of the affected parts, in titlebar coordinates */
+    drawable_damage(c->titlebar[bar].drawable, {{x - area.left(), y - area.top()}, width, height});
+}
+
+/** Copy a part of a titlebar to the frame window.
+ * \param c The client.
+ * \param bar The titlebar.
+ * \param area The area to copy, in titlebar coordinates.
+ */
+static void client_blit_titlebar(client* c, client_titlebar_t bar, area_t area) {
+    if (c->titlebar[bar].drawable == NULL) {
+        return;
+    }
+
+    const area_t titlebar = titlebar_get_area(c, bar);
+    const drawable_t* d = c->titlebar[bar].drawable;
+    getConnection().copy_area(d->pixmap,
+                              c->frame_window,
+                              Manager::get().gc,
+                              {area.top_left + d->pixmap_offset, area.width, area.height},
+                              titlebar.top_left + area.top_left);
 }
 
-#define HANDLE_TITLEBAR_REFRESH(name, index)                           \
-    static void client_refresh_titlebar_##name(client* c) {            \
-        area_t area = titlebar_get_area(c, index);                     \
-        client_refresh_titlebar_partial(                               \
-          c, index, area.left(), area.top(), area.width, area.height); \
+#define HANDLE_TITLEBAR_REFRESH(name, index)                             \
+    static void client_refresh_titlebar_##name(client* c, area_t area) { \
+        client_blit_titlebar(c, index, area);                            \
     }
 HANDLE_TITLEBAR_REFRESH(top, CLIENT_TITLEBAR_TOP)
 HANDLE_TITLEBAR_REFRESH(right, CLIENT_TITLEBAR_RIGHT)
@@ -3429,6 +4038,125 @@ void client_refresh_partial(client* c, int16_t x, int16_t y, uint16_t width, uin
     }
 }
 
+namespace {
+
+/** Whether new titlebar layouts share one pixmap per client */
+bool titlebar_atlas_enabled = false;
+
+/** Atlas sizes are rounded up to this */
+constexpr uint32_t titlebar_atlas_bucket = 64;
+
+} // namespace
+
+/** Where a titlebar is drawn in the atlas of its client.
+ * The top and bottom bars are stacked, with the left and right ones next to
+ * each other below them. The offsets only depend on the titlebar sizes, so that
+ * resizing the client does not move the bars in the atlas.
+ */
+static point titlebar_atlas_offset(client* c, client_titlebar_t bar) {
+    const int top = c->titlebar[CLIENT_TITLEBAR_TOP].size;
+    const int bottom = c->titlebar[CLIENT_TITLEBAR_BOTTOM].size;
+    switch (bar) {
+    case CLIENT_TITLEBAR_TOP: return {0, 0};
+    case CLIENT_TITLEBAR_BOTTOM: return {0, top};
+    case CLIENT_TITLEBAR_LEFT: return {0, top + bottom};
+    case CLIENT_TITLEBAR_RIGHT: return {c->titlebar[CLIENT_TITLEBAR_LEFT].size, top + bottom};
+    default: log_fatal("Unknown titlebar kind {}\n", (int)bar);
+    }
+    return {0, 0};
+}
+
+/** Free the atlas of a client, its titlebars lose their surfaces. */
+static void titlebar_atlas_free(client* c) {
+    auto& atlas = c->titlebar_atlas;
+    if (atlas.pixmap == XCB_NONE) {
+        return;
+    }
+    for (int bar = CLIENT_TITLEBAR_TOP; bar < CLIENT_TITLEBAR_COUNT; bar++) {
+        auto d = c->titlebar[bar].drawable;
+        if (d && d->pixmap_shared) {
+            drawable_unset_surface(d);
+        }
+    }
+    cairo_surface_finish(atlas.surface);
+    cairo_surface_destroy(atlas.surface);
+    getConnection().free_pixmap(atlas.pixmap);
+    MemStats::pixmap(MemStats::Pixmap::Drawable)
+      .remove(MemStats::pixmap_bytes(atlas.width, atlas.height, Manager::get().default_depth));
+    atlas = {};
+}
+
+/** Make sure the atlas of a client fits its titlebars.
+ * It grows with some headroom and is only replaced by a smaller one once it is
+ * four times too big, so that interactive resizes rarely allocate a pixmap.
+ * \param c The client.
+ * \param areas The titlebar geometries.
+ * \return True if the titlebars should be drawn to the atlas.
+ */
+static bool titlebar_atlas_update(client* c, const area_t* areas) {
+    uint32_t width = 0, height = 0;
+    for (int bar = CLIENT_TITLEBAR_TOP; bar < CLIENT_TITLEBAR_COUNT; bar++) {
+        if (areas[bar].width == 0 || areas[bar].height == 0) {
+            continue;
+        }
+        const point offset = titlebar_atlas_offset(c, (client_titlebar_t)bar);
+        width = std::max<uint32_t>(width, offset.x + areas[bar].width);
+        height = std::max<uint32_t>(height, offset.y + areas[bar].height);
+    }
+    if (!titlebar_atlas_enabled || width == 0 || height == 0 || width > UINT16_MAX ||
+        height > UINT16_MAX) {
+        titlebar_atlas_free(c);
+        return false;
+    }
+
+    auto& atlas = c->titlebar_atlas;
+    if (atlas.pixmap != XCB_NONE && atlas.width >= width && atlas.height >= height &&
+        uint64_t(atlas.width) * atlas.height <= 4 * uint64_t(width) * height) {
+        return true;
+    }
+
+    titlebar_atlas_free(c);
+    const auto grow = [](uint32_t v) {
+        v += v / 4;
+        v = (v + titlebar_atlas_bucket - 1) / titlebar_atlas_bucket * titlebar_atlas_bucket;
+        return uint16_t(std::min<uint32_t>(v, UINT16_MAX));
+    };
+    atlas.width = grow(width);
+    atlas.height = grow(height);
+    atlas.pixmap = getConnection().generate_id();
+    getConnection().create_pixmap(Manager::get().default_depth,
+                                  atlas.pixmap,
+                                  Manager::get().screen->root,
+                                  {atlas.width, atlas.height});
+    atlas.surface = cairo_xcb_surface_create(getConnection().getConnection(),
+                                             atlas.pixmap,
+                                             Manager::get().visual,
+                                             atlas.width,
+                                             atlas.height);
+    MemStats::pixmap(MemStats::Pixmap::Drawable)
+      .add(MemStats::pixmap_bytes(atlas.width, atlas.height, Manager::get().default_depth));
+    return true;
+}
+
+/** Draw the titlebars of each client to a single pixmap.
+ *
+ * By default each titlebar has a pixmap of its own, which is replaced when it
+ * changes size. With the atlas, the four titlebars of a client share one
+ * pixmap which only grows or shrinks once the client size changed a lot, so
+ * interactive resizes create far fewer pixmaps.
+ *
+ * @tparam boolean enabled Whether titlebars share a pixmap.
+ * @noreturn
+ * @staticfct set_titlebar_atlas
+ */
+static int luaA_client_set_titlebar_atlas(lua_State* L) {
+    titlebar_atlas_enabled = Lua::checkboolean(L, 1);
+    for (auto* c : Manager::get().clients) {
+        client_resize_finish(L, c);
+    }
+    return 0;
+}
+
 static drawable_t*
 titlebar_get_drawable(lua_State* L, client* c, int cl_idx, client_titlebar_t bar) {
     if (c->titlebar[bar].drawable == NULL) {
@@ -3455,7 +4183,7 @@ titlebar_get_drawable(lua_State* L, client* c, int cl_idx, client_titlebar_t bar
 }
 
 static void titlebar_resize(lua_State* L, int cidx, client* c, client_titlebar_t bar, int size) {
-    const char* property_name;
+    SignalId property_name;
 
     if (size < 0) {
         return;
@@ -3474,22 +4202,22 @@ static void titlebar_resize(lua_State* L, int cidx, client* c, client_titlebar_t
     case CLIENT_TITLEBAR_TOP:
         geometry.height += change;
         diff_top = change;
-        property_name = "property::titlebar_top";
+        property_name = "property::titlebar_top"_sig;
         break;
     case CLIENT_TITLEBAR_BOTTOM:
         geometry.height += change;
         diff_bottom = change;
-        property_name = "property::titlebar_bottom";
+        property_name = "property::titlebar_bottom"_sig;
         break;
     case CLIENT_TITLEBAR_RIGHT:
         geometry.width += change;
         diff_right = change;
-        property_name = "property::titlebar_right";
+        property_name = "property::titlebar_right"_sig;
         break;
     case CLIENT_TITLEBAR_LEFT:
         geometry.width += change;
         diff_left = change;
-        property_name = "property::titlebar_left";
+        property_name = "property::titlebar_left"_sig;
         break;
     default: log_fatal("Unknown titlebar kind {}\n", (int)bar);
     }
@@ -3524,6 +4252,34 @@ static int client_titlebar(lua_State* L) {
     return 2;
 }
 
+/** Read a geometry table, defaulting to the current geometry of a client.
+ * \param L The Lua VM state.
+ * \param idx The index of the table.
+ * \param c The client.
+ * \return The requested geometry.
+ */
+static area_t luaA_client_checkgeometry(lua_State* L, int idx, client* c) {
+    area_t geometry;
+
+    Lua::checktable(L, idx);
+    geometry.top_left = {
+      (int)round(Lua::getopt_number_range(
+        L, idx, "x", c->geometry.top_left.x, MIN_X11_COORDINATE, MAX_X11_COORDINATE)),
+      (int)round(Lua::getopt_number_range(
+        L, idx, "y", c->geometry.top_left.y, MIN_X11_COORDINATE, MAX_X11_COORDINATE))};
+    if (client_isfixed(c)) {
+        geometry.width = c->geometry.width;
+        geometry.height = c->geometry.height;
+    } else {
+        geometry.width = ceil(Lua::getopt_number_range(
+          L, idx, "width", c->geometry.width, MIN_X11_SIZE, MAX_X11_SIZE));
+        geometry.height = ceil(Lua::getopt_number_range(
+          L, idx, "height", c->geometry.height, MIN_X11_SIZE, MAX_X11_SIZE));
+    }
+
+    return geometry;
+}
+
 /** Return or set client geometry.
  *
  * @DOC_sequences_client_geometry1_EXAMPLE@
@@ -3545,28 +4301,61 @@ static int luaA_client_geometry(lua_State* L) {
     auto c = client_class.checkudata<client>(L, 1);
 
     if (lua_gettop(L) == 2 && !lua_isnil(L, 2)) {
-        area_t geometry;
+        client_resize(c, luaA_client_checkgeometry(L, 2, c), c->size_hints_honor);
+    }
 
-        Lua::checktable(L, 2);
-        geometry.top_left = {
-          (int)round(Lua::getopt_number_range(
-            L, 2, "x", c->geometry.top_left.x, MIN_X11_COORDINATE, MAX_X11_COORDINATE)),
-          (int)round(Lua::getopt_number_range(
-            L, 2, "y", c->geometry.top_left.y, MIN_X11_COORDINATE, MAX_X11_COORDINATE))};
-        if (client_isfixed(c)) {
-            geometry.width = c->geometry.width;
-            geometry.height = c->geometry.height;
-        } else {
-            geometry.width = ceil(Lua::getopt_number_range(
-              L, 2, "width", c->geometry.width, MIN_X11_SIZE, MAX_X11_SIZE));
-            geometry.height = ceil(Lua::getopt_number_range(
-              L, 2, "height", c->geometry.height, MIN_X11_SIZE, MAX_X11_SIZE));
+    return Lua::pusharea(L, c->geometry);
+}
+
+/** Resize many clients at once.
+ *
+ * This is the same as calling `c:geometry(geo)` for each entry, but the
+ * `property::geometry` (and related) signals are only emitted once all the
+ * clients got their new geometry. This is meant for layouts.
+ *
+ * @tparam table geometries An array of `{ client, geometry }` pairs.
+ * @treturn integer The number of clients whose geometry changed.
+ * @staticfct apply_geometries
+ * @see geometry
+ */
+static int luaA_client_apply_geometries(lua_State* L) {
+    Lua::checktable(L, 1);
+    const size_t len = Lua::rawlen(L, 1);
+
+    /* Parse everything first, so that a bad entry doesn't leave a half done batch */
+    std::vector<std::pair<client*, area_t>> batch;
+    batch.reserve(len);
+    for (size_t i = 0; i < len; i++) {
+        lua_rawgeti(L, 1, i + 1);
+        Lua::checktable(L, -1);
+        lua_rawgeti(L, -1, 1);
+        auto c = client_class.checkudata<client>(L, -1);
+        lua_rawgeti(L, -2, 2);
+        batch.emplace_back(c, luaA_client_checkgeometry(L, lua_gettop(L), c));
+        lua_pop(L, 3);
+    }
+
+    /* The argument table keeps the clients alive until the end */
+    std::vector<std::pair<client*, area_t>> changed;
+    changed.reserve(batch.size());
+    for (auto& [c, geometry] : batch) {
+        auto g = client_resize_geometry(c, geometry, c->size_hints_honor);
+        if (!g || c->geometry == *g) {
+            continue;
         }
+        changed.emplace_back(c, c->geometry);
+        c->geometry = *g;
+        client_ffi_sync(c);
+        client_need_refresh(c);
+        client_resize_finish(L, c);
+    }
 
-        client_resize(c, geometry, c->size_hints_honor);
+    for (auto& [c, old_geometry] : changed) {
+        client_emit_geometry_signals(L, c, old_geometry);
     }
 
-    return Lua::pusharea(L, c->geometry);
+    lua_pushinteger(L, changed.size());
+    return 1;
 }
 
 /** Apply size hints to a size.
@@ -3647,6 +4436,9 @@ static int luaA_client_set_icon(lua_State* L, lua_object_t* c) {
     if (!lua_isnil(L, -1)) {
         surf = (cairo_surface_t*)lua_touserdata(L, -1);
     }
+    /* The icon from Lua replaces the changes not fetched yet */
+    static_cast<client*>(c)->icons_stale = false;
+    static_cast<client*>(c)->hints_icon = {};
     client_set_icon(static_cast<client*>(c), surf);
     return 0;
 }
@@ -3667,7 +4459,7 @@ static int luaA_client_set_sticky(lua_State* L, lua_object_t* c) {
 
 static int luaA_client_set_size_hints_honor(lua_State* L, lua_object_t* c) {
     static_cast<client*>(c)->size_hints_honor = Lua::checkboolean(L, -1);
-    luaA_object_emit_signal(L, -3, "property::size_hints_honor", 0);
+    luaA_object_emit_signal(L, -3, "property::size_hints_honor"_sig, 0);
     return 0;
 }
 
@@ -3787,18 +4579,26 @@ static int luaA_client_get_motif_wm_hints(lua_State* L, lua_object_t* o) {
     return 1;
 }
 
+/** The size of the client window, without decorations */
+static std::pair<int, int> client_content_size(client* c) {
+    return {
+      c->geometry.width - c->titlebar[CLIENT_TITLEBAR_LEFT].size -
+        c->titlebar[CLIENT_TITLEBAR_RIGHT].size,
+      c->geometry.height - c->titlebar[CLIENT_TITLEBAR_TOP].size -
+        c->titlebar[CLIENT_TITLEBAR_BOTTOM].size,
+    };
+}
+
 static int luaA_client_get_content(lua_State* L, lua_object_t* o) {
     auto c = static_cast<client*>(o);
-    cairo_surface_t* surface;
-    int width = c->geometry.width;
-    int height = c->geometry.height;
-
-    /* Just the client size without decorations */
-    width -= c->titlebar[CLIENT_TITLEBAR_LEFT].size + c->titlebar[CLIENT_TITLEBAR_RIGHT].size;
-    height -= c->titlebar[CLIENT_TITLEBAR_TOP].size + c->titlebar[CLIENT_TITLEBAR_BOTTOM].size;
+    const auto [width, height] = client_content_size(c);
 
-    surface = cairo_xcb_surface_create(
-      getConnection().getConnection(), c->window, c->visualtype, width, height);
+    /* A copy from Composite, or else the live window */
+    cairo_surface_t* surface = Capture::content(c, width, height);
+    if (!surface) {
+        surface = cairo_xcb_surface_create(
+          getConnection().getConnection(), c->window, c->visualtype, width, height);
+    }
 
     /* lua has to make sure to free the ref or we have a leak */
     lua_pushlightuserdata(L, surface);
@@ -3807,37 +4607,14 @@ static int luaA_client_get_content(lua_State* L, lua_object_t* o) {
 
 static int luaA_client_get_icon(lua_State* L, lua_object_t* o) {
     auto c = static_cast<client*>(o);
-    if (c->icons.empty()) {
+    client_icons_fetch(c);
+    auto found = IconCache::closest(c->icons, Manager::get().preferred_icon_size);
+    if (!found) {
         return 0;
     }
 
-    /* Pick the closest available size, only picking a smaller icon if no bigger
-     * one is available.
-     */
-    cairo_surface_t* found = NULL;
-    int found_size = 0;
-    int preferred_size = Manager::get().preferred_icon_size;
-
-    for (auto& surf : c->icons) {
-        int width = cairo_image_surface_get_width(surf.get());
-        int height = cairo_image_surface_get_height(surf.get());
-        int size = MAX(width, height);
-
-        /* pick the icon if it's a better match than the one we already have */
-        bool found_icon_too_small = found_size < preferred_size;
-        bool found_icon_too_large = found_size > preferred_size;
-        bool icon_empty = width == 0 || height == 0;
-        bool better_because_bigger = found_icon_too_small && size > found_size;
-        bool better_because_smaller =
-          found_icon_too_large && size >= preferred_size && size < found_size;
-        if (!icon_empty && (better_because_bigger || better_because_smaller || found_size == 0)) {
-            found = surf.get();
-            found_size = size;
-        }
-    }
-
     /* lua gets its own reference which it will have to destroy */
-    lua_pushlightuserdata(L, cairo_surface_reference(found));
+    lua_pushlightuserdata(L, cairo_surface_reference(found->surface()));
     return 1;
 }
 
@@ -3997,7 +4774,7 @@ static int luaA_client_set_shape_bounding(lua_State* L, lua_object_t* o) {
                       XCB_SHAPE_SK_BOUNDING,
                       surf,
                       -c->border_width);
-    luaA_object_emit_signal(L, -3, "property::shape_bounding", 0);
+    luaA_object_emit_signal(L, -3, "property::shape_bounding"_sig, 0);
     return 0;
 }
 
@@ -4046,7 +4823,7 @@ static int luaA_client_set_shape_clip(lua_State* L, lua_object_t* o) {
     }
     xwindow_set_shape(
       c->frame_window, c->geometry.width, c->geometry.height, XCB_SHAPE_SK_CLIP, surf, 0);
-    luaA_object_emit_signal(L, -3, "property::shape_clip", 0);
+    luaA_object_emit_signal(L, -3, "property::shape_clip"_sig, 0);
     return 0;
 }
 
@@ -4083,7 +4860,7 @@ static int luaA_client_set_shape_input(lua_State* L, lua_object_t* o) {
                       XCB_SHAPE_SK_INPUT,
                       surf,
                       -c->border_width);
-    luaA_object_emit_signal(L, -3, "property::shape_input", 0);
+    luaA_object_emit_signal(L, -3, "property::shape_input"_sig, 0);
     return 0;
 }
 
@@ -4104,29 +4881,81 @@ static int luaA_client_keys(lua_State* L) {
 
     if (lua_gettop(L) == 2) {
         luaA_key_array_set(L, 1, 2, &keys);
-        luaA_object_emit_signal(L, 1, "property::keys", 0);
-        xwindow_grabkeys(c->window, keys);
-        if (c->nofocus_window) {
-            xwindow_grabkeys(c->nofocus_window, c->keys);
-        }
+        luaA_object_emit_signal(L, 1, "property::keys"_sig, 0);
+        KeySet::grab_client(c);
     }
 
     return luaA_key_array_get(L, 1, keys);
 }
 
+/** Set the key binding set active on the client.
+ *
+ * The set is used together with `keys`. Only the keys which differ from the
+ * previous set are grabbed and ungrabbed.
+ *
+ * @tparam[opt] key_set set The set, see `key.new_set`, or nil to remove it.
+ * @noreturn
+ * @method set_key_set
+ */
+static int luaA_client_set_key_set(lua_State* L) {
+    auto c = client_class.checkudata<client>(L, 1);
+    KeySet::Set* set = KeySet::checkopt(L, 2);
+    if (set == c->key_set) {
+        return 0;
+    }
+    if (c->key_set) {
+        luaA_object_unref_item(L, 1, c->key_set);
+    }
+    if (set) {
+        lua_pushvalue(L, 2);
+        luaA_object_ref_item(L, 1, -1);
+    }
+    c->key_set = set;
+    KeySet::grab_client(c);
+    return 0;
+}
+
+/** Drop the bindings and titlebars a configuration gave to a client, see
+ * awesome.reload.
+ * \param L The Lua VM state.
+ * \param cidx The client index on the stack.
+ */
+void client_reset_bindings(lua_State* L, int cidx) {
+    cidx = Lua::absindex(L, cidx);
+    auto c = client_class.checkudata<client>(L, cidx);
+
+    lua_newtable(L);
+    const int none = lua_gettop(L);
+    luaA_key_array_set(L, cidx, none, &c->keys);
+    luaA_button_array_set(L, cidx, none, &c->buttons);
+    lua_pop(L, 1);
+    xwindow_buttons_grab(c->window, c->buttons);
+
+    if (c->key_set) {
+        luaA_object_unref_item(L, cidx, c->key_set);
+        c->key_set = nullptr;
+    }
+    KeySet::grab_client(c);
+
+    for (int bar = CLIENT_TITLEBAR_TOP; bar < CLIENT_TITLEBAR_COUNT; bar++) {
+        titlebar_resize(L, cidx, c, (client_titlebar_t)bar, 0);
+    }
+}
+
 static int luaA_client_get_icon_sizes(lua_State* L, lua_object_t* o) {
     auto c = static_cast<client*>(o);
+    client_icons_fetch(c);
     int index = 1;
 
     lua_newtable(L);
-    for (auto& s : c->icons) {
+    for (auto& icon : c->icons) {
         /* Create a table { width, height } and append it to the table */
         lua_createtable(L, 2, 0);
 
-        lua_pushinteger(L, cairo_image_surface_get_width(s.get()));
+        lua_pushinteger(L, icon->width());
         lua_rawseti(L, -2, 1);
 
-        lua_pushinteger(L, cairo_image_surface_get_height(s.get()));
+        lua_pushinteger(L, icon->height());
         lua_rawseti(L, -2, 2);
 
         lua_rawseti(L, -2, index++);
@@ -4149,18 +4978,78 @@ static int luaA_client_get_icon_sizes(lua_State* L, lua_object_t* o) {
  * (by raising an error, the function will be stopped and nothing will be
  * returned to the caller).
  *
+ * With a size, the icon is returned scaled to it, which is better looking and
+ * faster to draw than scaling a large icon while drawing it. The scaled
+ * copies are kept with the icon and shared with the other clients that have
+ * the same icon.
+ *
  * @tparam integer index The index in the list of icons to get.
+ * @tparam[opt] integer width The width to scale the icon to.
+ * @tparam[opt] integer height The height to scale the icon to. Without it,
+ *   the icon keeps its aspect ratio and fits into `width` by `width`.
  * @treturn surface A lightuserdata for a cairo surface. This reference must be
  * destroyed!
  * @method get_icon
  * @see icon_sizes
  * @see awful.widget.clienticon
  */
+/** Get a scaled copy of the client's content.
+ *
+ * The thumbnail is kept until the client window changes, so that previews of
+ * many clients, like in a task switcher, only read the windows that changed.
+ * This needs the Composite extension. While the client cannot be captured,
+ * for example because it is minimized, the last thumbnail is returned.
+ *
+ * Windows are read from the screen, so the parts covered by other windows are
+ * not right. With `persistent`, the client is given its own storage for the
+ * rest of its life, so that its thumbnails are complete. This costs video
+ * memory and a copy of each of its frames.
+ *
+ * @tparam integer max_width The largest width of the thumbnail.
+ * @tparam integer max_height The largest height of the thumbnail.
+ * @tparam[opt=false] boolean persistent Keep the client redirected.
+ * @treturn surface|nil A lightuserdata for a cairo surface, keeping the aspect
+ *   ratio of the client. This reference must be destroyed!
+ * @method content_thumbnail
+ * @see content
+ */
+static int luaA_client_content_thumbnail(lua_State* L) {
+    auto c = client_class.checkudata<client>(L, 1);
+    const int max_width = Lua::checkinteger_range(L, 2, 1, UINT16_MAX);
+    const int max_height = Lua::checkinteger_range(L, 3, 1, UINT16_MAX);
+    const bool persistent = lua_toboolean(L, 4);
+    const auto [width, height] = client_content_size(c);
+
+    cairo_surface_t* surface =
+      Capture::thumbnail(c, width, height, max_width, max_height, persistent);
+    if (!surface) {
+        return 0;
+    }
+    lua_pushlightuserdata(L, surface);
+    return 1;
+}
+
 static int luaA_client_get_some_icon(lua_State* L) {
     auto c = client_class.checkudata<client>(L, 1);
     int index = luaL_checkinteger(L, 2);
+    client_icons_fetch(c);
     luaL_argcheck(L, (index >= 1 && index <= (int)c->icons.size()), 2, "invalid icon index");
-    lua_pushlightuserdata(L, cairo_surface_reference(c->icons[index - 1].get()));
+    auto& icon = c->icons[index - 1];
+    if (lua_isnoneornil(L, 3)) {
+        lua_pushlightuserdata(L, cairo_surface_reference(icon->surface()));
+        return 1;
+    }
+
+    uint32_t width = Lua::checkinteger_range(L, 3, 1, UINT16_MAX);
+    uint32_t height;
+    if (!lua_isnoneornil(L, 4)) {
+        height = Lua::checkinteger_range(L, 4, 1, UINT16_MAX);
+    } else {
+        const double scale = double(width) / std::max(icon->width(), icon->height());
+        height = std::max(1L, std::lround(icon->height() * scale));
+        width = std::max(1L, std::lround(icon->width() * scale));
+    }
+    lua_pushlightuserdata(L, cairo_surface_reference(icon->scaled(width, height)));
     return 1;
 }
 
@@ -4177,6 +5066,126 @@ static int client_tostring(lua_State* L, lua_object_t* o) {
     return 1;
 }
 
+/** How client.query() reads one of the requested names. */
+struct client_query_prop {
+    /** A C property, read through its index callback */
+    const lua_class_property_t* property = nullptr;
+    /** A method returning a value when called without arguments */
+    lua_CFunction getter = nullptr;
+};
+
+/** Fill the record of one client for client.query().
+ * It runs in its own C frame so that property callbacks see the same stack as
+ * in __index: the client at index 1 and the name at index 2.
+ * \param L The Lua VM state, with the client, a free slot for the name, the
+ * list of names, the query_prop array and the record table.
+ * \return The number of pushed elements.
+ */
+static int luaA_client_query_one(lua_State* L) {
+    auto c = client_class.checkudata<client>(L, 1);
+    const auto* props = static_cast<const client_query_prop*>(lua_touserdata(L, 4));
+    const size_t nprops = Lua::rawlen(L, 3);
+
+    for (size_t i = 0; i < nprops; i++) {
+        lua_rawgeti(L, 3, i + 1);
+        lua_replace(L, 2);
+
+        if (props[i].property) {
+            const int n = props[i].property->index(L, c);
+            if (n == 0) {
+                continue;
+            }
+            /* Only keep the first value */
+            lua_pop(L, n - 1);
+        } else if (props[i].getter) {
+            lua_pushcfunction(L, props[i].getter);
+            lua_pushvalue(L, 1);
+            lua_call(L, 1, 1);
+        } else {
+            /* Properties handled from Lua, or unknown ones */
+            lua_pushvalue(L, 2);
+            lua_gettable(L, 1);
+        }
+        lua_pushvalue(L, 2);
+        lua_insert(L, -2);
+        lua_rawset(L, 5);
+    }
+
+    lua_pushvalue(L, 1);
+    lua_setfield(L, 5, "client");
+    lua_pushvalue(L, 5);
+    return 1;
+}
+
+/** Get properties of many clients at once.
+ *
+ * This is equivalent to reading each property from each client of
+ * `client.get(screen, stacked)`, but avoids one Lua call per read.
+ *
+ * @tparam table args
+ * @tparam table args.props The names of the properties to read. `geometry`,
+ *   `tags` and `isvisible` give the result of the methods of the same name.
+ * @tparam[opt] screen args.screen Only return clients on this screen.
+ * @tparam[opt=false] boolean args.stacked Return clients in stacking order
+ *   (ordered from top to bottom).
+ * @treturn table An array with a record for each client. Each record has a
+ *   `client` field and a field for each property.
+ * @staticfct query
+ * @usage for _, r in ipairs(client.query { props = { "name", "minimized" } }) do
+ *     print(r.client, r.name, r.minimized)
+ * end
+ */
+static int luaA_client_query(lua_State* L) {
+    static const std::map<std::string_view, lua_CFunction> getters = {
+      { "geometry",  luaA_client_geometry},
+      {     "tags",      luaA_client_tags},
+      {"isvisible", luaA_client_isvisible},
+    };
+
+    Lua::checktable(L, 1);
+    lua_getfield(L, 1, "screen");
+    screen_t* screen = lua_isnil(L, -1) ? nullptr : luaA_checkscreen(L, -1);
+    lua_getfield(L, 1, "stacked");
+    const bool stacked = lua_toboolean(L, -1);
+    lua_pop(L, 2);
+    lua_getfield(L, 1, "props");
+    const int props_idx = lua_gettop(L);
+    Lua::checktable(L, props_idx);
+
+    /* Resolve the names once for all clients */
+    std::vector<client_query_prop> props(Lua::rawlen(L, props_idx));
+    for (size_t i = 0; i < props.size(); i++) {
+        lua_rawgeti(L, props_idx, i + 1);
+        size_t len;
+        const char* name = luaL_checklstring(L, -1, &len);
+        const std::string_view sv{name, len};
+        if (auto it = getters.find(sv); it != getters.end()) {
+            props[i].getter = it->second;
+        } else if (auto member = client_class.find_member(sv);
+                   member && !member->method_owner &&
+                   member->special == lua_class_member_t::special_t::none &&
+                   member->property && member->property->index) {
+            props[i].property = member->property;
+        }
+        lua_pop(L, 1);
+    }
+
+    lua_newtable(L);
+    const int result_idx = lua_gettop(L);
+    client_foreach(screen, stacked, [&, i = int(1)](client* c) mutable {
+        lua_pushcfunction(L, luaA_client_query_one);
+        luaA_object_push(L, c);
+        lua_pushnil(L);
+        lua_pushvalue(L, props_idx);
+        lua_pushlightuserdata(L, props.data());
+        lua_createtable(L, 0, props.size() + 1);
+        lua_call(L, 5, 1);
+        lua_rawseti(L, result_idx, i++);
+    });
+
+    return 1;
+}
+
 /* Client module.
  * \param L The Lua VM state.
  * \return The number of pushed elements.
@@ -4208,27 +5217,39 @@ static int luaA_client_module_newindex(lua_State* L) {
 
 void client_class_setup(lua_State* L) {
     static constexpr auto methods = DefineClassMethods<&client_class>({
-      {       "get",             luaA_client_get},
-      {   "__index",    luaA_client_module_index},
-      {"__newindex", luaA_client_module_newindex}
+      {                       "get",                        luaA_client_get},
+      {                     "query",                      luaA_client_query},
+      {          "apply_geometries",           luaA_client_apply_geometries},
+      {        "set_titlebar_atlas",         luaA_client_set_titlebar_atlas},
+      {             "focus_history",              luaA_client_focus_history},
+      {         "focus_history_add",          luaA_client_focus_history_add},
+      {      "focus_history_delete",       luaA_client_focus_history_delete},
+      {"set_focus_history_tracking", luaA_client_set_focus_history_tracking},
+      {               "move_to_tag",                luaA_client_move_to_tag},
+      {                   "restack",                    luaA_client_restack},
+      {                   "__index",               luaA_client_module_index},
+      {                "__newindex",            luaA_client_module_newindex}
     });
 
     static constexpr auto meta = DefineObjectMethods({
-      {           "_keys",                        luaA_client_keys},
-      {       "isvisible",                   luaA_client_isvisible},
-      {        "geometry",                    luaA_client_geometry},
-      {"apply_size_hints",            luaA_client_apply_size_hints},
-      {            "tags",                        luaA_client_tags},
-      {            "kill",                        luaA_client_kill},
-      {            "swap",                        luaA_client_swap},
-      {           "raise",                       luaA_client_raise},
-      {           "lower",                       luaA_client_lower},
-      {        "unmanage",                    luaA_client_unmanage},
-      {    "titlebar_top",    client_titlebar<CLIENT_TITLEBAR_TOP>},
-      {  "titlebar_right",  client_titlebar<CLIENT_TITLEBAR_RIGHT>},
-      { "titlebar_bottom", client_titlebar<CLIENT_TITLEBAR_BOTTOM>},
-      {   "titlebar_left",   client_titlebar<CLIENT_TITLEBAR_LEFT>},
-      {        "get_icon",               luaA_client_get_some_icon}
+      {            "_keys",                        luaA_client_keys},
+      {      "set_key_set",                 luaA_client_set_key_set},
+      {        "_ffi_view",                    luaA_client_ffi_view},
+      {        "isvisible",                   luaA_client_isvisible},
+      {         "geometry",                    luaA_client_geometry},
+      { "apply_size_hints",            luaA_client_apply_size_hints},
+      {             "tags",                        luaA_client_tags},
+      {             "kill",                        luaA_client_kill},
+      {             "swap",                        luaA_client_swap},
+      {            "raise",                       luaA_client_raise},
+      {            "lower",                       luaA_client_lower},
+      {         "unmanage",                    luaA_client_unmanage},
+      {     "titlebar_top",    client_titlebar<CLIENT_TITLEBAR_TOP>},
+      {   "titlebar_right",  client_titlebar<CLIENT_TITLEBAR_RIGHT>},
+      {  "titlebar_bottom", client_titlebar<CLIENT_TITLEBAR_BOTTOM>},
+      {    "titlebar_left",   client_titlebar<CLIENT_TITLEBAR_LEFT>},
+      {         "get_icon",               luaA_client_get_some_icon},
+      {"content_thumbnail",           luaA_client_content_thumbnail}
     });
 
     client_class.setup(L, methods.data(), meta.data());
@@ -20,11 +20,20 @@
  */
 #pragma once
 
+#include "common/bitset.h"
 #include "draw.h"
+#include "ewmh.h"
+#include "iconcache.h"
 #include "objects/key.h"
 #include "objects/window.h"
 #include "stack.h"
 
+#include <optional>
+
+namespace KeySet {
+struct Set;
+}
+
 enum {
     CLIENT_SELECT_INPUT_EVENT_MASK = (XCB_EVENT_MASK_STRUCTURE_NOTIFY |
                                       XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_FOCUS_CHANGE),
@@ -94,53 +103,59 @@ typedef struct {
     uint32_t status;
 } motif_wm_hints_t;
 
-/** client_t type */
-struct client: public window_t {
-    /** Window we use for input focus and no-input clients */
-    xcb_window_t nofocus_window;
-    /** Client logical screen */
-    screen_t* screen;
-    /** Client name */
-  private:
-    std::string name, alt_name, icon_name, alt_icon_name;
-
-  public:
-    const std::string& getName() const { return name; }
-    const std::string& getAltName() const { return alt_name; }
-    const std::string& getIconName() const { return icon_name; }
-    const std::string& getAltIconName() const { return alt_icon_name; }
-
-    void setName(const std::string& name) { this->name = name; }
-    void setAltName(const std::string& name) { this->alt_name = name; }
-    void setIconName(const std::string& name) { this->icon_name = name; }
-    void setAltIconName(const std::string& name) { this->alt_icon_name = name; }
-    /** WM_CLASS stuff */
-  private:
-    std::string cls;
-    std::string instance;
+/** Where a client is in the clients of one of its tags */
+struct tag_slot_t {
+    /** Index in tag_t::clients */
+    size_t index;
+    /** When the client was tagged, t:clients() is in this order */
+    uint64_t order;
+};
 
-  public:
-    ~client();
-    const std::string& getCls() const { return cls; }
-    const std::string& getInstance() const { return instance; }
+/** The client fields Lua can read through the LuaJIT FFI without a C call.
+ * The layout is part of the Lua API and has to match the cdef in
+ * lib/awful/client/ffi.lua.
+ */
+struct client_ffi_view {
+    int32_t x, y, width, height;
+    /** The address of the screen, only used to tell screens apart */
+    uint64_t screen;
+    uint8_t minimized, hidden;
+    /** Cleared when the client is unmanaged */
+    uint8_t valid;
+};
 
-    void setCls(const std::string& cls) { this->cls = cls; }
-    void setInstance(const std::string& instance) { this->instance = instance; }
+/** client_t type */
+struct client: public window_t {
+    /* The fields read by the refresh and stacking passes come first, so that
+     * they share as few cache lines as possible. The full banning passes read
+     * Manager::clients_hot instead. Everything below them is only needed when
+     * something changes. */
     /** Window geometry */
     area_t geometry;
     /** Old window geometry currently configured in X11 */
     area_t x11_client_geometry;
     area_t x11_frame_geometry;
-    /** Got a configure request and have to call client_send_configure() if its ignored? */
-    bool got_configure_request;
-    /** Startup ID */
-  private:
-    std::string startup_id;
-
-  public:
-    const std::string& getStartupId() const { return startup_id; }
-    void setStartupId(const std::string& id) { startup_id = id; }
-
+    /** Client logical screen */
+    screen_t* screen;
+    /** Window it is transient for */
+    client* transient_for;
+    /** Titelbar information */
+    struct {
+        /** The size of this bar. */
+        uint16_t size;
+        /** The drawable for this bar. */
+        drawable_t* drawable;
+    } titlebar[CLIENT_TITLEBAR_COUNT];
+    /** The pixmap shared by all titlebars, see client.set_titlebar_atlas */
+    struct {
+        xcb_pixmap_t pixmap;
+        uint16_t width, height;
+        cairo_surface_t* surface;
+    } titlebar_atlas;
+    /** Bits of the tags this client is tagged with, see tag_t::bit */
+    Bitset tags;
+    /** The slots of this client in its tags, by tag bit */
+    std::vector<tag_slot_t> tag_slots;
     /** True if the client is sticky */
     bool sticky;
     /** Has urgency hint */
@@ -171,13 +186,69 @@ struct client: public window_t {
      * Note that the geometry remains unchanged and that the window is still mapped.
      */
     bool isbanned;
+    /** True if the client is in Manager::banning_dirty */
+    bool banning_dirty;
+    /** True if the client is in Manager::refresh_pending */
+    bool refresh_pending;
     /** true if the client must be skipped from task bar client list */
     bool skip_taskbar;
     /** True if the client cannot have focus */
     bool nofocus;
+    /** The slot of the client in Manager::clients_hot while it is managed,
+     * else ClientHotStore::no_slot */
+    uint32_t hot_slot = UINT32_MAX;
+    /** Orders Manager::clients for the lists of the screens, see screen_clients() */
+    int64_t list_order;
+
+    /** Window we use for input focus and no-input clients */
+    xcb_window_t nofocus_window;
+    /** Client name */
+  private:
+    std::string name, alt_name, icon_name, alt_icon_name;
+
+  public:
+    const std::string& getName() const { return name; }
+    const std::string& getAltName() const { return alt_name; }
+    const std::string& getIconName() const { return icon_name; }
+    const std::string& getAltIconName() const { return alt_icon_name; }
+
+    void setName(const std::string& name) { this->name = name; }
+    void setAltName(const std::string& name) { this->alt_name = name; }
+    void setIconName(const std::string& name) { this->icon_name = name; }
+    void setAltIconName(const std::string& name) { this->alt_icon_name = name; }
+    /** WM_CLASS stuff */
+  private:
+    std::string cls;
+    std::string instance;
+
+  public:
+    ~client();
+    const std::string& getCls() const { return cls; }
+    const std::string& getInstance() const { return instance; }
+
+    void setCls(const std::string& cls) { this->cls = cls; }
+    void setInstance(const std::string& instance) { this->instance = instance; }
+    /** Got a configure request and have to call client_send_configure() if its ignored? */
+    bool got_configure_request;
+    /** Startup ID */
+  private:
+    std::string startup_id;
+
+  public:
+    const std::string& getStartupId() const { return startup_id; }
+    void setStartupId(const std::string& id) { startup_id = id; }
+
     /** True if the client is focusable.  Overrides nofocus, and can be set
      * from Lua. */
     std::optional<bool> focusable;
+    /** Neighbours in the focus history ring, NULL when not in it */
+    client* history_prev;
+    client* history_next;
+    /** Neighbours in the client stack, see stack.cpp */
+    client* stack_below;
+    client* stack_above;
+    /** Index in the stack, valid while the stack is unchanged */
+    size_t stack_position;
     /** True if the client window has a _NET_WM_WINDOW_TYPE proeprty */
     bool has_NET_WM_WINDOW_TYPE;
     /** Window of the group leader */
@@ -187,11 +258,20 @@ struct client: public window_t {
     /** Client's WM_PROTOCOLS property */
     xcb_icccm_get_wm_protocols_reply_t protocols;
     /** Key bindings */
-    std::vector<keyb_t*> keys;
-    /** Icons */
-    std::vector<cairo_surface_handle> icons;
+    key_array_t keys;
+    /** Key binding set, see keyset.h */
+    KeySet::Set* key_set;
+    /** Icons, decoded on demand */
+    std::vector<IconCache::IconPtr> icons;
     /** True if we ever got an icon from _NET_WM_ICON */
     bool have_ewmh_icon;
+    /** True if _NET_WM_ICON changed since it was last fetched */
+    bool icons_stale;
+    /** The WM_HINTS icon pixmaps not read yet, see awesome.set_lazy_icons() */
+    struct {
+        xcb_pixmap_t icon;
+        xcb_pixmap_t mask;
+    } hints_icon;
     /** Size hints */
     xcb_size_hints_t size_hints;
     /** The visualtype that c->window uses */
@@ -215,19 +295,47 @@ struct client: public window_t {
 
     /** Client pid */
     uint32_t pid;
-    /** Window it is transient for */
-    client* transient_for;
     /** Value of WM_TRANSIENT_FOR */
     xcb_window_t transient_for_window;
-    /** Titelbar information */
-    struct {
-        /** The size of this bar. */
-        uint16_t size;
-        /** The drawable for this bar. */
-        drawable_t* drawable;
-    } titlebar[CLIENT_TITLEBAR_COUNT];
     /** Motif WM hints, with an additional MWM_HINTS_AWESOME_SET bit */
     motif_wm_hints_t motif_wm_hints;
+    /** Copy of the fields in ffi_view, see client_ffi_sync() */
+    client_ffi_view ffi_view{};
+};
+
+namespace RestartState {
+struct Entry;
+}
+
+/** The requests client_manage() waits for. They can be sent for many windows
+ * before any of them is managed, so that managing all of them only waits for
+ * the X server once.
+ */
+struct client_manage_cookies_t {
+    xcb_get_property_cookie_t kde_dockapp;
+    xcb_get_property_cookie_t startup_id;
+    xcb_get_property_cookie_t strut;
+    ewmh_client_hints_cookies_t ewmh_hints;
+    xcb_get_property_cookie_t wm_normal_hints;
+    xcb_get_property_cookie_t wm_hints;
+    xcb_get_property_cookie_t wm_transient_for;
+    xcb_get_property_cookie_t wm_client_leader;
+    xcb_get_property_cookie_t wm_client_machine;
+    xcb_get_property_cookie_t wm_window_role;
+    xcb_get_property_cookie_t net_wm_pid;
+    /** Not sent with lazy icons */
+    xcb_get_property_cookie_t net_wm_icon;
+    xcb_get_property_cookie_t wm_name;
+    xcb_get_property_cookie_t net_wm_name;
+    xcb_get_property_cookie_t wm_icon_name;
+    xcb_get_property_cookie_t net_wm_icon_name;
+    xcb_get_property_cookie_t wm_class;
+    xcb_get_property_cookie_t wm_protocols;
+    xcb_get_property_cookie_t motif_wm_hints;
+    xcb_get_property_cookie_t opacity;
+    /** Set after a restart, the names, class, machine, role, leader and icons
+     * are then taken from it instead of being requested */
+    const RestartState::Entry* snapshot = nullptr;
 };
 
 /** Client class */
@@ -238,11 +346,20 @@ client* client_getbywin(xcb_window_t);
 client* client_getbynofocuswin(xcb_window_t);
 client* client_getbyframewin(xcb_window_t);
 
+void client_need_refresh(client*);
 void client_ban(client*);
 void client_ban_unfocus(client*);
 void client_unban(client*);
-void client_manage(xcb_window_t, xcb_get_geometry_reply_t*, xcb_get_window_attributes_reply_t*);
+client_manage_cookies_t client_manage_prefetch(xcb_window_t);
+void client_manage_discard(const client_manage_cookies_t&);
+client* client_manage(xcb_window_t,
+                      xcb_get_geometry_reply_t*,
+                      xcb_get_window_attributes_reply_t*,
+                      const client_manage_cookies_t&,
+                      xcb_void_cookie_t* = nullptr);
+void client_manage_check_reparent(client*, xcb_void_cookie_t);
 bool client_resize(client*, area_t, bool);
+std::optional<area_t> client_resize_geometry(client*, area_t, bool);
 void client_unmanage(client*, client_unmanage_t);
 void client_kill(client*);
 void client_set_sticky(lua_State*, int, bool);
@@ -268,7 +385,8 @@ void client_set_Name(lua_State* L, int, const std::string&);
 void client_set_StartupId(lua_State* L, int, const std::string&);
 void client_set_AltName(lua_State* L, int, const std::string&);
 void client_set_group_window(lua_State*, int, xcb_window_t);
-void client_set_icons(client*, std::vector<cairo_surface_handle>);
+void client_set_icons(client*, std::vector<IconCache::IconPtr>);
+void client_icons_invalidate(client*);
 void client_set_icon_from_pixmaps(client*, xcb_pixmap_t, xcb_pixmap_t);
 void client_set_skip_taskbar(lua_State*, int, bool);
 void client_set_motif_wm_hints(lua_State*, int, motif_wm_hints_t);
@@ -283,6 +401,7 @@ void client_send_configure(client*);
 void client_find_transient_for(client*);
 void client_emit_scanned(void);
 void client_emit_scanning(void);
+void client_reset_bindings(lua_State*, int);
 drawable_t* client_get_drawable(client*, point);
 drawable_t* client_get_drawable_offset(client*, point*);
 area_t client_get_undecorated_geometry(client*);
@@ -314,10 +433,26 @@ static inline void client_raise(client* c) {
     /* Notify the listeners */
     lua_State* L = globalconf_get_lua_State();
     luaA_object_push(L, c);
-    luaA_object_emit_signal(L, -1, "raised", 0);
+    luaA_object_emit_signal(L, -1, "raised"_sig, 0);
     lua_pop(L, 1);
 }
 
+/** Update the FFI view of a client after one of its fields changed.
+ * \param c The client.
+ */
+static inline void client_ffi_sync(client* c) {
+    auto& v = c->ffi_view;
+    v.x = c->geometry.top_left.x;
+    v.y = c->geometry.top_left.y;
+    v.width = c->geometry.width;
+    v.height = c->geometry.height;
+    v.screen = uintptr_t(c->screen);
+    v.minimized = c->minimized;
+    v.hidden = c->hidden;
+}
+
+void client_hot_sync(client*);
+
 /** Check if a client has fixed size.
  * \param c A client.
  * \return A boolean value, true if the client has a fixed size.
@@ -33,8 +33,15 @@
 #include "common/luaobject.h"
 #include "globalconf.h"
 #include "lua.h"
+#include "memstats.h"
 
+#include <algorithm>
 #include <cairo-xcb.h>
+#include <climits>
+#include <cstdint>
+#include <glib.h>
+#include <utility>
+#include <vector>
 
 /** Drawable object.
  *
@@ -115,6 +122,227 @@ static lua_class_t drawable_class{
     },
 };
 
+namespace {
+
+/** Pixmaps of resized or destroyed drawables, kept for reuse.
+ * Sizes are rounded up to buckets, so a drawable which grows or shrinks a bit
+ * gets back the pixmap it just released. The total size of the pool is capped
+ * and the oldest pixmaps are freed first.
+ */
+struct PixmapPool {
+    struct entry {
+        xcb_pixmap_t pixmap;
+        uint16_t width, height;
+    };
+
+    static constexpr uint32_t bucket = 32;
+
+    /** Oldest first */
+    std::vector<entry> entries;
+    size_t bytes = 0;
+    size_t limit = 16 * 1024 * 1024;
+
+    static size_t size_of(uint16_t width, uint16_t height) {
+        return MemStats::pixmap_bytes(width, height, Manager::get().default_depth);
+    }
+    static uint16_t round(uint16_t v) {
+        return std::min<uint32_t>((v + bucket - 1) / bucket * bucket, UINT16_MAX);
+    }
+
+    /** Get a pixmap of the bucket of the given size, creating one if needed. */
+    entry take(uint16_t width, uint16_t height) {
+        width = round(width);
+        height = round(height);
+        for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+            if (it->width == width && it->height == height) {
+                const entry e = *it;
+                entries.erase(std::next(it).base());
+                bytes -= size_of(width, height);
+                MemStats::pixmap(MemStats::Pixmap::Pool).remove(size_of(width, height));
+                MemStats::pixmap(MemStats::Pixmap::Drawable).add(size_of(width, height));
+                return e;
+            }
+        }
+
+        const entry e{getConnection().generate_id(), width, height};
+        getConnection().create_pixmap(
+          Manager::get().default_depth, e.pixmap, Manager::get().screen->root, {width, height});
+        MemStats::pixmap(MemStats::Pixmap::Drawable).add(size_of(width, height));
+        return e;
+    }
+
+    void give(entry e) {
+        entries.push_back(e);
+        bytes += size_of(e.width, e.height);
+        MemStats::pixmap(MemStats::Pixmap::Drawable).remove(size_of(e.width, e.height));
+        MemStats::pixmap(MemStats::Pixmap::Pool).add(size_of(e.width, e.height));
+        shrink();
+    }
+
+    /** Free the oldest pixmaps until the pool fits its limit. */
+    void shrink() {
+        size_t n = 0;
+        for (; n < entries.size() && bytes > limit; n++) {
+            const size_t size = size_of(entries[n].width, entries[n].height);
+            getConnection().free_pixmap(entries[n].pixmap);
+            bytes -= size;
+            MemStats::pixmap(MemStats::Pixmap::Pool).remove(size);
+        }
+        entries.erase(entries.begin(), entries.begin() + n);
+    }
+};
+
+PixmapPool pixmap_pool;
+
+/** The drawables with a non empty damage region */
+std::vector<drawable_t*> damaged;
+
+/** A frame recorded by Lua and rasterized by a render thread. The render
+ * thread only draws to `target`, everything else belongs to the main thread.
+ */
+struct RenderJob {
+    /** NULL once the drawable is gone */
+    drawable_t* drawable;
+    uint64_t sequence;
+    cairo_surface_handle recording;
+    /** Starts at the top left corner of `extents` */
+    cairo_surface_handle target;
+    /** The bounding box of `rects` */
+    area_t extents;
+    std::vector<area_t> rects;
+    bool done = false;
+};
+
+GThreadPool* render_pool = nullptr;
+/** Submitted frames, oldest first */
+std::vector<RenderJob*> render_jobs;
+
+/** Surfaces of presented frames, kept for reuse since shared memory segments
+ * are expensive to set up */
+std::vector<cairo_surface_handle> spare_targets;
+constexpr size_t max_spare_targets = 4;
+
+cairo_surface_t* take_target(int width, int height) {
+    auto best = spare_targets.end();
+    for (auto it = spare_targets.begin(); it != spare_targets.end(); ++it) {
+        const int w = cairo_image_surface_get_width(it->get());
+        const int h = cairo_image_surface_get_height(it->get());
+        if (w >= width && h >= height &&
+            (best == spare_targets.end() ||
+             w * h < cairo_image_surface_get_width(best->get()) *
+                       cairo_image_surface_get_height(best->get()))) {
+            best = it;
+        }
+    }
+    if (best == spare_targets.end()) {
+        return draw_shm_surface_create(width, height);
+    }
+    cairo_surface_t* target = best->release();
+    spare_targets.erase(best);
+    return target;
+}
+
+void finish_render_job(RenderJob* job) {
+    if (job->target) {
+        if (spare_targets.size() >= max_spare_targets) {
+            spare_targets.erase(spare_targets.begin());
+        }
+        spare_targets.push_back(std::move(job->target));
+    }
+    delete job;
+}
+
+/** Copy a rendered frame to the pixmap of its drawable */
+void present(drawable_t* d, RenderJob* job) {
+    /* The pixmap is written behind cairo's back */
+    cairo_surface_flush(d->surface);
+    std::vector<area_t> srcs;
+    srcs.reserve(job->rects.size());
+    for (const auto& rect : job->rects) {
+        srcs.push_back({rect.top_left - job->extents.top_left, rect.width, rect.height});
+    }
+    if (!draw_shm_put(
+          job->target.get(), d->pixmap, srcs, job->extents.top_left + d->pixmap_offset)) {
+        cairo_t* cr = cairo_create(d->surface);
+        cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source_surface(
+          cr, job->target.get(), job->extents.left(), job->extents.top());
+        for (const auto& rect : job->rects) {
+            cairo_rectangle(cr, rect.left(), rect.top(), rect.width, rect.height);
+        }
+        cairo_fill(cr);
+        cairo_destroy(cr);
+    }
+    cairo_surface_mark_dirty(d->surface);
+
+    d->refreshed = true;
+    for (const auto& rect : job->rects) {
+        drawable_damage(d, rect);
+    }
+}
+
+/** Called on the main thread once a frame is rendered. Frames are presented
+ * in the order they were submitted, a frame finishing early waits for the
+ * ones before it.
+ */
+gboolean deliver_render(gpointer data) {
+    auto job = static_cast<RenderJob*>(data);
+    job->done = true;
+    /* Sources of the recording may have to be freed on the main thread */
+    job->recording.reset();
+
+    drawable_t* d = job->drawable;
+    if (!d) {
+        std::erase(render_jobs, job);
+        finish_render_job(job);
+        return G_SOURCE_REMOVE;
+    }
+
+    for (;;) {
+        auto it = std::ranges::find_if(render_jobs, [d](RenderJob* j) {
+            return j->drawable == d && j->done && j->sequence <= d->presented_sequence + 1;
+        });
+        if (it == render_jobs.end()) {
+            break;
+        }
+        RenderJob* next = *it;
+        render_jobs.erase(it);
+        /* Anything older than the last presented frame is stale */
+        if (next->sequence == d->presented_sequence + 1) {
+            if (d->surface) {
+                present(d, next);
+            }
+            d->presented_sequence = next->sequence;
+        }
+        finish_render_job(next);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/** Runs on a render thread */
+void render(gpointer data, gpointer) {
+    auto job = static_cast<RenderJob*>(data);
+    cairo_t* cr = cairo_create(job->target.get());
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface(
+      cr, job->recording.get(), -job->extents.left(), -job->extents.top());
+    cairo_rectangle(cr, 0, 0, job->extents.width, job->extents.height);
+    cairo_fill(cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(job->target.get());
+    g_idle_add(deliver_render, job);
+}
+
+} // namespace
+
+/** Stop the render threads. Frames still being rendered are dropped. */
+void drawable_render_cleanup(void) {
+    if (render_pool) {
+        g_thread_pool_free(render_pool, TRUE, TRUE);
+        render_pool = nullptr;
+    }
+}
+
 drawable_t* drawable_allocator(lua_State* L, drawable_refresh_callback* callback, void* data) {
     drawable_t* d = newobj<drawable_t, drawable_class>(L);
     d->refresh_callback = callback;
@@ -122,65 +350,194 @@ drawable_t* drawable_allocator(lua_State* L, drawable_refresh_callback* callback
     d->refreshed = false;
     d->surface = NULL;
     d->pixmap = XCB_NONE;
+    d->pixmap_width = d->pixmap_height = 0;
+    d->pixmap_offset = {0, 0};
+    d->pixmap_shared = false;
+    d->render_sequence = d->presented_sequence = 0;
     return d;
 }
 
-static void drawable_unset_surface(drawable_t* d) {
+/** Release the surface and the pixmap of a drawable.
+ * Pixmaps of atlas slots stay with their atlas, the owner of the atlas must
+ * call this before freeing it.
+ * \param d The drawable.
+ */
+void drawable_unset_surface(drawable_t* d) {
+    /* Lua may still hold a reference to the surface, finishing it makes sure
+     * that it won't draw to the pixmap once it is reused */
     if (d->surface) {
         cairo_surface_finish(d->surface);
         cairo_surface_destroy(d->surface);
     }
-    if (d->pixmap) {
-        getConnection().free_pixmap(d->pixmap);
-        d->pixmap = 0;
+    if (d->pixmap && !d->pixmap_shared) {
+        pixmap_pool.give({d->pixmap, d->pixmap_width, d->pixmap_height});
     }
     d->refreshed = false;
+    d->damage.clear();
+    /* Frames for the old pixmap are stale */
+    d->presented_sequence = d->render_sequence;
     d->surface = NULL;
     d->pixmap = XCB_NONE;
+    d->pixmap_width = d->pixmap_height = 0;
+    d->pixmap_offset = {0, 0};
+    d->pixmap_shared = false;
+}
+
+drawable_t::~drawable_t() {
+    std::erase(damaged, this);
+    /* Frames still being rendered are freed once they are done */
+    std::erase_if(render_jobs, [this](RenderJob* job) {
+        if (job->drawable != this) {
+            return false;
+        }
+        job->drawable = nullptr;
+        if (job->done) {
+            finish_render_job(job);
+            return true;
+        }
+        return false;
+    });
+    drawable_unset_surface(this);
+}
+
+/** Mark a part of a drawable as needing to be copied to the screen.
+ * The copies are done once per main loop iteration, in drawable_flush_damage().
+ * \param d The drawable.
+ * \param area The damaged area, in drawable coordinates.
+ */
+void drawable_damage(drawable_t* d, area_t area) {
+    /* Clip to the drawable, its pixmap can be bigger */
+    const int left = std::max(area.left(), 0), top = std::max(area.top(), 0);
+    const int right = std::min<int>(area.right(), d->geometry.width);
+    const int bottom = std::min<int>(area.bottom(), d->geometry.height);
+    if (right <= left || bottom <= top) {
+        return;
+    }
+    area = {
+      {left, top},
+      uint16_t(right - left), uint16_t(bottom - top)
+    };
+
+    if (d->damage.empty()) {
+        damaged.push_back(d);
+    }
+    d->damage.add(area);
 }
 
-drawable_t::~drawable_t() { drawable_unset_surface(this); }
+/** Drop the pending damage of the drawables of an object being destroyed.
+ * \param data The data the drawables were allocated with.
+ */
+void drawable_damage_forget(void* data) {
+    std::erase_if(damaged, [data](drawable_t* d) {
+        if (d->refresh_data != data) {
+            return false;
+        }
+        d->damage.clear();
+        return true;
+    });
+}
+
+/** Copy the damaged parts of all drawables to the screen. */
+void drawable_flush_damage(void) {
+    auto pending = std::exchange(damaged, {});
+    for (auto* d : pending) {
+        if (d->damage.empty()) {
+            continue;
+        }
+        if (d->pixmap && d->refreshed) {
+            /* Make cairo do all pending drawing */
+            cairo_surface_flush(d->surface);
+            for (const auto& area : d->damage.rects()) {
+                (*d->refresh_callback)(d->refresh_data, area);
+            }
+        }
+        d->damage.clear();
+    }
+}
 
 void drawable_set_geometry(lua_State* L, int didx, area_t geom) {
+    drawable_set_geometry(L, didx, geom, nullptr);
+}
+
+/** Set the geometry of a drawable.
+ * \param L The Lua VM state.
+ * \param didx The index of the drawable.
+ * \param geom The new geometry, in root window coordinates.
+ * \param slot The part of an atlas to draw to, or NULL for a pixmap of its own.
+ */
+void drawable_set_geometry(lua_State* L, int didx, area_t geom, const drawable_slot_t* slot) {
     auto d = drawable_class.checkudata<drawable_t>(L, didx);
     area_t old = d->geometry;
     d->geometry = geom;
 
     const bool area_changed = old != geom;
-    if (area_changed) {
+    /* Moves keep the surface and its content */
+    const bool size_changed = old.width != geom.width || old.height != geom.height;
+    const bool slot_changed =
+      slot ? !d->pixmap_shared || d->pixmap != slot->pixmap || d->pixmap_offset != slot->offset
+           : d->pixmap_shared;
+    /* The owner of an atlas may have taken the surface away */
+    const bool surface_changed =
+      size_changed || slot_changed || (!d->surface && geom.width > 0 && geom.height > 0);
+    if (surface_changed) {
         drawable_unset_surface(d);
     }
-    if (area_changed && geom.width > 0 && geom.height > 0) {
-        d->pixmap = getConnection().generate_id();
-        getConnection().create_pixmap(Manager::get().default_depth,
-                                      d->pixmap,
-                                      Manager::get().screen->root,
-                                      {geom.width, geom.height});
-        d->surface = cairo_xcb_surface_create(getConnection().getConnection(),
-                                              d->pixmap,
-                                              Manager::get().visual,
-                                              geom.width,
-                                              geom.height);
-        luaA_object_emit_signal(L, didx, "property::surface", 0);
+    if (surface_changed && geom.width > 0 && geom.height > 0) {
+        if (slot) {
+            d->pixmap = slot->pixmap;
+            d->pixmap_width = geom.width;
+            d->pixmap_height = geom.height;
+            d->pixmap_offset = slot->offset;
+            d->pixmap_shared = true;
+            d->surface = cairo_surface_create_for_rectangle(
+              slot->surface, slot->offset.x, slot->offset.y, geom.width, geom.height);
+        } else {
+            const auto pixmap = pixmap_pool.take(geom.width, geom.height);
+            d->pixmap = pixmap.pixmap;
+            d->pixmap_width = pixmap.width;
+            d->pixmap_height = pixmap.height;
+            d->surface = cairo_xcb_surface_create(getConnection().getConnection(),
+                                                  d->pixmap,
+                                                  Manager::get().visual,
+                                                  geom.width,
+                                                  geom.height);
+        }
+        luaA_object_emit_signal(L, didx, "property::surface"_sig, 0);
     }
 
     if (area_changed) {
-        luaA_object_emit_signal(L, didx, "property::geometry", 0);
+        luaA_object_emit_signal(L, didx, "property::geometry"_sig, 0);
     }
     if (old.top_left.x != geom.top_left.x) {
-        luaA_object_emit_signal(L, didx, "property::x", 0);
+        luaA_object_emit_signal(L, didx, "property::x"_sig, 0);
     }
     if (old.top_left.y != geom.top_left.y) {
-        luaA_object_emit_signal(L, didx, "property::y", 0);
+        luaA_object_emit_signal(L, didx, "property::y"_sig, 0);
     }
     if (old.width != geom.width) {
-        luaA_object_emit_signal(L, didx, "property::width", 0);
+        luaA_object_emit_signal(L, didx, "property::width"_sig, 0);
     }
     if (old.height != geom.height) {
-        luaA_object_emit_signal(L, didx, "property::height", 0);
+        luaA_object_emit_signal(L, didx, "property::height"_sig, 0);
     }
 }
 
+/** Set the maximum size of the pixmaps kept for reuse by drawables.
+ *
+ * Resized drawables put their old pixmap in a pool instead of freeing it, so
+ * that drawables changing size often (popups, notifications) don't have to
+ * allocate new ones. Pixmaps above this limit are freed, oldest first.
+ *
+ * @tparam integer bytes The limit, 0 disables the pool.
+ * @noreturn
+ * @staticfct set_pixmap_pool_limit
+ */
+static int luaA_drawable_set_pixmap_pool_limit(lua_State* L) {
+    pixmap_pool.limit = Lua::checkinteger_range(L, 1, 0, INT32_MAX);
+    pixmap_pool.shrink();
+    return 0;
+}
+
 /** Get a drawable's surface
  * \param L The Lua VM state.
  * \param drawable The drawable object.
@@ -204,12 +561,154 @@ static int luaA_drawable_get_surface(lua_State* L, drawable_t* drawable) {
  */
 static int luaA_drawable_refresh(lua_State* L) {
     auto drawable = drawable_class.checkudata<drawable_t>(L, 1);
+    /* The surface was drawn to directly, frames still being rendered would
+     * overwrite it with older content */
+    drawable->presented_sequence = drawable->render_sequence;
     drawable->refreshed = true;
-    (*drawable->refresh_callback)(drawable->refresh_data);
+    drawable_damage(drawable, {{0, 0}, drawable->geometry.width, drawable->geometry.height});
 
     return 0;
 }
 
+/** Copy an image surface to the drawable.
+ *
+ * Surfaces from `awesome.create_shm_surface` are copied through shared memory,
+ * other surfaces are painted with cairo. Call `refresh` afterwards to make the
+ * result visible.
+ *
+ * @tparam gears.surface surface The surface to copy.
+ * @tparam[opt=0] integer x The x coordinate in the drawable.
+ * @tparam[opt=0] integer y The y coordinate in the drawable.
+ * @noreturn
+ * @method upload
+ */
+static int luaA_drawable_upload(lua_State* L) {
+    auto d = drawable_class.checkudata<drawable_t>(L, 1);
+    auto surface = static_cast<cairo_surface_t*>(lua_touserdata(L, 2));
+    if (!surface || cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE) {
+        Lua::typerror(L, 2, "image surface");
+    }
+    const point pos = {int(luaL_optinteger(L, 3, 0)), int(luaL_optinteger(L, 4, 0))};
+    if (!d->surface) {
+        return 0;
+    }
+
+    /* The pixmap may be an atlas shared with other drawables, only what is
+     * within the drawable may be written */
+    const int left = std::max(0, pos.x), top = std::max(0, pos.y);
+    const int right =
+      std::min<int>(pos.x + cairo_image_surface_get_width(surface), d->geometry.width);
+    const int bottom =
+      std::min<int>(pos.y + cairo_image_surface_get_height(surface), d->geometry.height);
+    if (right <= left || bottom <= top) {
+        return 0;
+    }
+    const area_t src = {
+      {left - pos.x, top - pos.y},
+      uint16_t(right - left), uint16_t(bottom - top)
+    };
+    const point dst = {left, top};
+
+    /* The pixmap is written behind cairo's back */
+    cairo_surface_flush(d->surface);
+    if (draw_shm_put(surface, d->pixmap, src, dst + d->pixmap_offset)) {
+        cairo_surface_mark_dirty(d->surface);
+        return 0;
+    }
+
+    cairo_t* cr = cairo_create(d->surface);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface(cr, surface, pos.x, pos.y);
+    cairo_rectangle(cr,
+                    pos.x,
+                    pos.y,
+                    cairo_image_surface_get_width(surface),
+                    cairo_image_surface_get_height(surface));
+    cairo_fill(cr);
+    cairo_destroy(cr);
+    return 0;
+}
+
+/** Render a recorded frame on a background thread.
+ *
+ * The recording is rasterized by a render thread and copied to the drawable
+ * from the main loop afterwards, with the given areas marked as refreshed.
+ * Frames are presented in the order they were submitted. Frames submitted
+ * before the drawable was resized or `refresh` was called are dropped.
+ *
+ * The recording must not be drawn to afterwards. Surfaces it uses as sources
+ * are snapshotted by cairo, but sources that are not image surfaces are read
+ * by the render thread, so they should be avoided.
+ *
+ * @param recording A cairo recording surface as light user datum, in drawable
+ *  coordinates.
+ * @tparam table areas The parts of the drawable to update, an array of tables
+ *  with `x`, `y`, `width` and `height`.
+ * @treturn integer The sequence number of the frame.
+ * @method render_async
+ */
+static int luaA_drawable_render_async(lua_State* L) {
+    auto d = drawable_class.checkudata<drawable_t>(L, 1);
+    auto recording = static_cast<cairo_surface_t*>(lua_touserdata(L, 2));
+    if (!recording || cairo_surface_get_type(recording) != CAIRO_SURFACE_TYPE_RECORDING) {
+        Lua::typerror(L, 2, "recording surface");
+    }
+    Lua::checktable(L, 3);
+
+    region_t region;
+    const int count = Lua::rawlen(L, 3);
+    for (int i = 1; i <= count; i++) {
+        lua_rawgeti(L, 3, i);
+        Lua::checktable(L, -1);
+        const int left = std::max(0, (int)Lua::getopt_number(L, -1, "x", 0));
+        const int top = std::max(0, (int)Lua::getopt_number(L, -1, "y", 0));
+        const int right =
+          std::min<int>(left + Lua::getopt_number(L, -1, "width", 0), d->geometry.width);
+        const int bottom =
+          std::min<int>(top + Lua::getopt_number(L, -1, "height", 0), d->geometry.height);
+        lua_pop(L, 1);
+        if (right > left && bottom > top) {
+            region.add({
+              {left, top},
+              uint16_t(right - left), uint16_t(bottom - top)
+            });
+        }
+    }
+
+    if (!d->surface || region.empty()) {
+        /* Nothing to wait for, this is the frame that is already there */
+        lua_pushinteger(L, d->render_sequence);
+        return 1;
+    }
+    const uint64_t sequence = ++d->render_sequence;
+    lua_pushinteger(L, sequence);
+
+    int left = INT_MAX, top = INT_MAX, right = 0, bottom = 0;
+    for (const auto& rect : region.rects()) {
+        left = std::min(left, rect.left());
+        top = std::min(top, rect.top());
+        right = std::max<int>(right, rect.right());
+        bottom = std::max<int>(bottom, rect.bottom());
+    }
+    const area_t extents = {
+      {left, top},
+      uint16_t(right - left), uint16_t(bottom - top)
+    };
+
+    auto job = new RenderJob{
+      d, sequence, cairo_surface_handle{cairo_surface_reference(recording)}, {}, extents,
+      region.rects(), false};
+    job->target.reset(take_target(job->extents.width, job->extents.height));
+    render_jobs.push_back(job);
+
+    if (!render_pool) {
+        const int threads = std::clamp<int>(g_get_num_processors() - 1, 1, 4);
+        render_pool = g_thread_pool_new(render, nullptr, threads, FALSE, nullptr);
+    }
+    g_thread_pool_push(render_pool, job, nullptr);
+    return 1;
+}
+
 /** Get drawable geometry. The geometry consists of x, y, width and height.
  *
  * @treturn table A table with drawable coordinates and geometry.
@@ -221,11 +720,15 @@ static int luaA_drawable_geometry(lua_State* L) {
 }
 
 void drawable_class_setup(lua_State* L) {
-    static constexpr auto methods = DefineClassMethods<&drawable_class>();
+    static constexpr auto methods = DefineClassMethods<&drawable_class>({
+      {"set_pixmap_pool_limit", luaA_drawable_set_pixmap_pool_limit},
+    });
 
     static constexpr auto meta = DefineObjectMethods({
-      { "refresh",  luaA_drawable_refresh},
-      {"geometry", luaA_drawable_geometry},
+      {     "refresh",      luaA_drawable_refresh},
+      {    "geometry",     luaA_drawable_geometry},
+      {      "upload",       luaA_drawable_upload},
+      {"render_async", luaA_drawable_render_async},
     });
 
     drawable_class.setup(L, methods.data(), meta.data());
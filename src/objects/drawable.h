@@ -24,26 +24,54 @@
 #include "common/luaclass.h"
 #include "draw.h"
 
-typedef void drawable_refresh_callback(void*);
+/** Copy an area of the drawable, in drawable coordinates, to the screen. */
+typedef void drawable_refresh_callback(void*, area_t);
 
 /** drawable type */
 struct drawable_t: public lua_object_t {
     /** The pixmap we are drawing to. */
     xcb_pixmap_t pixmap;
+    /** The size of the pixmap, which can be bigger than the geometry. */
+    uint16_t pixmap_width, pixmap_height;
+    /** Where the drawable is in its pixmap, not (0, 0) for atlas slots. */
+    point pixmap_offset;
+    /** True if the pixmap belongs to an atlas and not to the drawable. */
+    bool pixmap_shared;
     /** Surface for drawing. */
     cairo_surface_t* surface;
     /** The geometry of the drawable (in root window coordinates). */
     area_t geometry;
     /** Surface contents are undefined if this is false. */
     bool refreshed;
+    /** The parts to copy to the screen on the next refresh. */
+    region_t damage;
     /** Callback for refreshing. */
     drawable_refresh_callback* refresh_callback;
     /** Data for refresh callback. */
     void* refresh_data;
+    /** The last frame submitted with render_async. */
+    uint64_t render_sequence;
+    /** The last frame copied to the pixmap. Frames up to this one that are
+     * still being rendered are stale and get dropped. */
+    uint64_t presented_sequence;
 
     ~drawable_t();
 };
 
+/** A part of a pixmap shared by several drawables. */
+struct drawable_slot_t {
+    xcb_pixmap_t pixmap;
+    /** A surface for the whole pixmap, drawables get sub-surfaces of it. */
+    cairo_surface_t* surface;
+    point offset;
+};
+
 drawable_t* drawable_allocator(lua_State*, drawable_refresh_callback*, void*);
 void drawable_set_geometry(lua_State*, int, area_t);
+void drawable_set_geometry(lua_State*, int, area_t, const drawable_slot_t*);
+void drawable_unset_surface(drawable_t*);
+void drawable_damage(drawable_t*, area_t);
+void drawable_damage_forget(void*);
+void drawable_flush_damage(void);
+void drawable_render_cleanup(void);
 void drawable_class_setup(lua_State*);
@@ -52,10 +52,81 @@
 #include <array>
 #include <cairo-xcb.h>
 #include <cstdint>
+#include <vector>
 #include <xcb/shape.h>
 
 extern lua_class_t window_class;
 
+namespace {
+
+/** Unmapped windows of garbage collected drawins, kept for reuse.
+ * Tooltips, menus and notifications come and go all the time. Reusing their
+ * windows saves creating and destroying an X window for each of them. All
+ * drawins use the same depth and visual, so any window fits any drawin.
+ * Windows which stay unused for a while are destroyed.
+ */
+struct WindowPool {
+    struct entry {
+        xcb_window_t window;
+        gint64 released;
+    };
+
+    static constexpr guint idle_seconds = 30;
+
+    /** Oldest first */
+    std::vector<entry> entries;
+    size_t limit = 8;
+    guint trim_source = 0;
+
+    /** Get the most recently released window, or XCB_NONE. */
+    xcb_window_t take() {
+        if (entries.empty()) {
+            return XCB_NONE;
+        }
+        const xcb_window_t window = entries.back().window;
+        entries.pop_back();
+        return window;
+    }
+
+    void give(xcb_window_t window) {
+        entries.push_back({window, g_get_monotonic_time()});
+        shrink();
+        if (!trim_source && !entries.empty()) {
+            trim_source = g_timeout_add_seconds(idle_seconds, trim, this);
+        }
+    }
+
+    /** Destroy the oldest windows until the pool fits its limit. */
+    void shrink() { destroy(entries.size() - std::min(entries.size(), limit)); }
+
+    void destroy(size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            getConnection().destroy_window(entries[i].window);
+        }
+        entries.erase(entries.begin(), entries.begin() + n);
+    }
+
+    /** Destroy the windows which were not reused in time. */
+    static gboolean trim(gpointer data) {
+        auto pool = static_cast<WindowPool*>(data);
+        const gint64 deadline = g_get_monotonic_time() - idle_seconds * G_USEC_PER_SEC;
+        size_t n = 0;
+        while (n < pool->entries.size() && pool->entries[n].released <= deadline) {
+            n++;
+        }
+        pool->destroy(n);
+        if (pool->entries.empty()) {
+            pool->trim_source = 0;
+            return G_SOURCE_REMOVE;
+        }
+        return G_SOURCE_CONTINUE;
+    }
+};
+
+WindowPool window_pool;
+
+} // namespace
+
 static drawin_t* drawin_allocator(lua_State* L);
 
 lua_class_t drawin_class{
@@ -185,14 +256,40 @@ void luaA_drawin_systray_kickout(lua_State* L) {
     drawin_systray_kickout(drawin_class.checkudata<drawin_t>(L, 1));
 }
 
+/** Bring the window of a drawin back to the state of a new one, so that
+ * another drawin can use it.
+ * \param window The window.
+ */
+static void drawin_window_reset(xcb_window_t window) {
+    xwindow_buttons_grab(window, {});
+    for (auto kind : {XCB_SHAPE_SK_BOUNDING, XCB_SHAPE_SK_CLIP, XCB_SHAPE_SK_INPUT}) {
+        xwindow_set_shape(window, 0, 0, kind, nullptr, 0);
+    }
+    xwindow_set_opacity(window, -1);
+    strut_t strut{};
+    ewmh_update_strut(window, &strut);
+    getConnection().configure_window(window, XCB_CONFIG_WINDOW_BORDER_WIDTH, uint32_t(0));
+}
+
 drawin_t::~drawin_t() {
     /* The drawin must already be unmapped, else it
      * couldn't be garbage collected -> no unmap needed */
     if (window) {
         /* Make sure we don't accidentally kill the systray window */
         drawin_systray_kickout(this);
-        getConnection().destroy_window(window);
+        if (window_pool.limit > 0) {
+            drawin_window_reset(window);
+        }
+        xwindow_grabs_forget(window);
+        xwindow_shapes_forget(window);
+        if (window_pool.limit > 0) {
+            window_pool.give(window);
+        } else {
+            getConnection().destroy_window(window);
+        }
     }
+    drawable_damage_forget(this);
+    screen_strut_forget(this);
     /* No unref needed because we are being garbage collected */
     drawable = NULL;
 }
@@ -204,11 +301,18 @@ static void drawin_update_drawing(lua_State* L, int widx) {
     lua_pop(L, 1);
 }
 
-/** Refresh the window content by copying its pixmap data to its window.
+static void drawin_apply_moveresize(drawin_t* w);
+
+/** Copy a part of the pixmap of a drawin to its window.
  * \param w The drawin to refresh.
+ * \param area The area to copy.
  */
-static inline void drawin_refresh_pixmap(drawin_t* w) {
-    drawin_refresh_pixmap_partial(w, 0, 0, w->geometry.width, w->geometry.height);
+static void drawin_blit(drawin_t* w, area_t area) {
+    /* Make sure it really has the size it should have */
+    drawin_apply_moveresize(w);
+
+    getConnection().copy_area(
+      w->drawable->pixmap, w->window, Manager::get().gc, area, area.top_left);
 }
 
 static void drawin_apply_moveresize(drawin_t* w) {
@@ -274,19 +378,19 @@ static void drawin_moveresize(lua_State* L, int udx, area_t geometry) {
     drawin_update_drawing(L, udx);
 
     if (old_geometry != w->geometry) {
-        luaA_object_emit_signal(L, udx, "property::geometry", 0);
+        luaA_object_emit_signal(L, udx, "property::geometry"_sig, 0);
     }
     if (old_geometry.top_left.x != w->geometry.top_left.x) {
-        luaA_object_emit_signal(L, udx, "property::x", 0);
+        luaA_object_emit_signal(L, udx, "property::x"_sig, 0);
     }
     if (old_geometry.top_left.y != w->geometry.top_left.y) {
-        luaA_object_emit_signal(L, udx, "property::y", 0);
+        luaA_object_emit_signal(L, udx, "property::y"_sig, 0);
     }
     if (old_geometry.width != w->geometry.width) {
-        luaA_object_emit_signal(L, udx, "property::width", 0);
+        luaA_object_emit_signal(L, udx, "property::width"_sig, 0);
     }
     if (old_geometry.height != w->geometry.height) {
-        luaA_object_emit_signal(L, udx, "property::height", 0);
+        luaA_object_emit_signal(L, udx, "property::height"_sig, 0);
     }
 
     screen_t* old_screen = screen_getbycoord(old_geometry.top_left);
@@ -297,25 +401,18 @@ static void drawin_moveresize(lua_State* L, int udx, area_t geometry) {
     }
 }
 
-/** Refresh the window content by copying its pixmap data to its window.
- * \param drawin The drawin to refresh.
- * \param x The copy starting point x component.
- * \param y The copy starting point y component.
- * \param w The copy width from the x component.
- * \param h The copy height from the y component.
+/** Schedule a copy of a part of the pixmap of a drawin to its window.
+ * \param drawin The drawin.
+ * \param x The x coordinate of the area.
+ * \param y The y coordinate of the area.
+ * \param w The width of the area.
+ * \param h The height of the area.
  */
 void drawin_refresh_pixmap_partial(drawin_t* drawin, int16_t x, int16_t y, uint16_t w, uint16_t h) {
-    if (!drawin->drawable || !drawin->drawable->pixmap || !drawin->drawable->refreshed) {
+    if (!drawin->drawable) {
         return;
     }
-
-    /* Make sure it really has the size it should have */
-    drawin_apply_moveresize(drawin);
-
-    /* Make cairo do all pending drawing */
-    cairo_surface_flush(drawin->drawable->surface);
-    getConnection().copy_area(
-      drawin->drawable->pixmap, drawin->window, Manager::get().gc, {x, y, w, h}, {x, y});
+    drawable_damage(drawin->drawable, {{x, y}, w, h});
 }
 
 static void drawin_map(lua_State* L, int widx) {
@@ -332,6 +429,7 @@ static void drawin_map(lua_State* L, int widx) {
     stack_windows();
     /* Add it to the list of visible drawins */
     Manager::get().drawins.push_back(drawin);
+    Manager::get().windows.drawins[drawin->window] = drawin;
     /* Make sure it has a surface */
     if (drawin->drawable->surface == NULL) {
         drawin_update_drawing(L, widx);
@@ -344,6 +442,7 @@ static void drawin_unmap(drawin_t* drawin) {
     if (it != Manager::get().drawins.end()) {
         Manager::get().drawins.erase(it);
     }
+    Manager::get().windows.drawins.erase(drawin->window);
 }
 
 /** Get a drawin by its window.
@@ -351,9 +450,8 @@ static void drawin_unmap(drawin_t* drawin) {
  * \return A drawin if found, NULL otherwise.
  */
 drawin_t* drawin_getbywin(xcb_window_t win) {
-    auto it = std::ranges::find_if(Manager::get().drawins,
-                                   [win](auto* drawin) { return drawin->window == win; });
-    return it != Manager::get().drawins.end() ? *it : nullptr;
+    auto it = Manager::get().windows.drawins.find(win);
+    return it != Manager::get().windows.drawins.end() ? it->second : nullptr;
 }
 
 /** Set a drawin visible or not.
@@ -383,13 +481,25 @@ static void drawin_set_visible(lua_State* L, int udx, bool v) {
             luaA_object_unref(L, drawin);
         }
 
-        luaA_object_emit_signal(L, udx, "property::visible", 0);
+        luaA_object_emit_signal(L, udx, "property::visible"_sig, 0);
         if (strut_has_value(&drawin->strut)) {
             screen_update_workarea(screen_getbycoord(drawin->geometry.top_left));
         }
     }
 }
 
+/** Hide all the visible drawins, see awesome.reload.
+ * \param L The Lua VM state.
+ */
+void drawin_hide_all(lua_State* L) {
+    const auto drawins = Manager::get().drawins;
+    for (auto* drawin : drawins) {
+        luaA_object_push(L, drawin);
+        drawin_set_visible(L, -1, false);
+        lua_pop(L, 1);
+    }
+}
+
 drawin_t* drawin_allocator(lua_State* L) {
     xcb_screen_t* s = Manager::get().screen;
     auto w = newobj<drawin_t, drawin_class>(L);
@@ -403,9 +513,21 @@ drawin_t* drawin_allocator(lua_State* L) {
     w->geometry_dirty = false;
     w->type = (window_type_t)_NET_WM_WINDOW_TYPE_NORMAL;
 
-    drawable_allocator(L, (drawable_refresh_callback*)drawin_refresh_pixmap, w);
+    drawable_allocator(L, (drawable_refresh_callback*)drawin_blit, w);
     w->drawable = (drawable_t*)luaA_object_ref_item(L, -2, -1);
 
+    const xcb_cursor_t cursor =
+      xcursor_new(Manager::get().x.cursor_ctx, xcursor_font_fromstr(w->cursor.c_str()));
+    if ((w->window = window_pool.take())) {
+        getConnection().change_attributes(w->window,
+                                          XCB_CW_BORDER_PIXEL | XCB_CW_CURSOR,
+                                          std::array{w->border_color.pixel, cursor});
+        /* It still has the geometry of its previous drawin */
+        w->geometry_dirty = true;
+        ewmh_update_window_type(w->window, window_translate_type(w->type));
+        return w;
+    }
+
     w->window = getConnection().generate_id();
     const auto values = std::array<uint32_t, 6>{
       w->border_color.pixel,
@@ -417,7 +539,7 @@ drawin_t* drawin_allocator(lua_State* L) {
         XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_EXPOSURE |
         XCB_EVENT_MASK_PROPERTY_CHANGE,
       Manager::get().default_cmap,
-      xcursor_new(Manager::get().x.cursor_ctx, xcursor_font_fromstr(w->cursor.c_str()))};
+      cursor};
     getConnection().create_window(Manager::get().default_depth,
                                   w->window,
                                   s->root,
@@ -544,7 +666,7 @@ static int luaA_drawin_set_ontop(lua_State* L, drawin_t* drawin) {
     if (b != drawin->ontop) {
         drawin->ontop = b;
         stack_windows();
-        luaA_object_emit_signal(L, -3, "property::ontop", 0);
+        luaA_object_emit_signal(L, -3, "property::ontop"_sig, 0);
     }
     return 0;
 }
@@ -561,7 +683,7 @@ static int luaA_drawin_set_cursor(lua_State* L, drawin_t* drawin) {
         xcb_cursor_t cursor = xcursor_new(Manager::get().x.cursor_ctx, cursor_font);
         drawin->cursor = buf ? buf.value() : "";
         xwindow_set_cursor(drawin->window, cursor);
-        luaA_object_emit_signal(L, -3, "property::cursor", 0);
+        luaA_object_emit_signal(L, -3, "property::cursor"_sig, 0);
     }
     return 0;
 }
@@ -621,7 +743,7 @@ static int luaA_drawin_set_shape_bounding(lua_State* L, drawin_t* drawin) {
                       XCB_SHAPE_SK_BOUNDING,
                       surf,
                       -drawin->border_width);
-    luaA_object_emit_signal(L, -3, "property::shape_bounding", 0);
+    luaA_object_emit_signal(L, -3, "property::shape_bounding"_sig, 0);
     return 0;
 }
 
@@ -656,7 +778,7 @@ static int luaA_drawin_set_shape_clip(lua_State* L, drawin_t* drawin) {
 
     xwindow_set_shape(
       drawin->window, drawin->geometry.width, drawin->geometry.height, XCB_SHAPE_SK_CLIP, surf, 0);
-    luaA_object_emit_signal(L, -3, "property::shape_clip", 0);
+    luaA_object_emit_signal(L, -3, "property::shape_clip"_sig, 0);
     return 0;
 }
 
@@ -695,15 +817,32 @@ static int luaA_drawin_set_shape_input(lua_State* L, drawin_t* drawin) {
                       XCB_SHAPE_SK_INPUT,
                       surf,
                       -drawin->border_width);
-    luaA_object_emit_signal(L, -3, "property::shape_input", 0);
+    luaA_object_emit_signal(L, -3, "property::shape_input"_sig, 0);
+    return 0;
+}
+
+/** Set how many windows of garbage collected drawins are kept for reuse.
+ *
+ * New drawins take a kept window instead of creating one, which helps with
+ * popups and notifications that are created and destroyed often. Kept windows
+ * which are not reused within 30 seconds are destroyed.
+ *
+ * @tparam integer count The number of windows, 0 disables the pool.
+ * @noreturn
+ * @staticfct set_window_pool_limit
+ */
+static int luaA_drawin_set_window_pool_limit(lua_State* L) {
+    window_pool.limit = Lua::checkinteger_range(L, 1, 0, INT32_MAX);
+    window_pool.shrink();
     return 0;
 }
 
 void drawin_class_setup(lua_State* L) {
 
     static constexpr auto methods = DefineClassMethods<&drawin_class>({
-      {   "get", luaA_drawin_get},
-      {"__call", luaA_drawin_new}
+      {                  "get",                   luaA_drawin_get},
+      {               "__call",                   luaA_drawin_new},
+      {"set_window_pool_limit", luaA_drawin_set_window_pool_limit}
     });
     static constexpr auto meta = DefineObjectMethods({
       {"geometry", luaA_drawin_geometry}
@@ -40,9 +40,11 @@
 #include "common/lualib.h"
 #include "common/luaobject.h"
 #include "common/xutil.h"
+#include "keyset.h"
 #include "xkb.h"
 
 /* XStringToKeysym() */
+#include <algorithm>
 #include <fmt/core.h>
 #include <glib.h>
 #include <sys/types.h>
@@ -102,13 +104,15 @@ lua_class_t key_class{
  * @staticfct set_newindex_miss_handler
  */
 
-static void luaA_keystore(lua_State* L, int ud, const char* str, ssize_t len) {
-    if (len <= 0 || !str) {
-        return;
-    }
-
-    auto key = key_class.checkudata<keyb_t>(L, ud);
-
+/** Parse the key of a binding, which is a character, a keysym name or
+ * "#" followed by a keycode.
+ * \param L The Lua VM state, for warnings.
+ * \param str The key.
+ * \param len The length of the key.
+ * \param key The binding to store the keycode or keysym into.
+ * \return False if the key could not be converted.
+ */
+bool key_parse(lua_State* L, const char* str, size_t len, keyb_t* key) {
     if (len == 1) {
         key->keycode = 0;
         key->keysym = str[0];
@@ -123,13 +127,13 @@ static void luaA_keystore(lua_State* L, int ud, const char* str, ssize_t len) {
 
             if (!g_utf8_validate(str, -1, NULL)) {
                 Lua::warn(L, "failed to convert \"%s\" into keysym (invalid UTF-8 string)", str);
-                return;
+                return false;
             }
 
             length = g_utf8_strlen(str, -1); /* This function counts combining characters. */
             if (length <= 0) {
                 Lua::warn(L, "failed to convert \"%s\" into keysym (empty UTF-8 string)", str);
-                return;
+                return false;
             } else if (length > 1) {
                 gchar* composed = g_utf8_normalize(str, -1, G_NORMALIZE_DEFAULT_COMPOSE);
                 if (g_utf8_strlen(composed, -1) != 1) {
@@ -138,7 +142,7 @@ static void luaA_keystore(lua_State* L, int ud, const char* str, ssize_t len) {
                       L,
                       "failed to convert \"%s\" into keysym (failed to compose a single character)",
                       str);
-                    return;
+                    return false;
                 }
                 unicode = g_utf8_get_char(composed);
                 p_delete(&composed);
@@ -151,7 +155,7 @@ static void luaA_keystore(lua_State* L, int ud, const char* str, ssize_t len) {
                   L,
                   "failed to convert \"%s\" into keysym (neither keysym nor single unicode)",
                   str);
-                return;
+                return false;
             }
 
             /* Unicode-to-Keysym Conversion
@@ -167,12 +171,25 @@ static void luaA_keystore(lua_State* L, int ud, const char* str, ssize_t len) {
                           "failed to convert \"%s\" into keysym (unicode out of range): \"%u\"",
                           str,
                           unicode);
-                return;
+                return false;
             }
         }
     }
 
-    luaA_object_emit_signal(L, ud, "property::key", 0);
+    return true;
+}
+
+static void luaA_keystore(lua_State* L, int ud, const char* str, ssize_t len) {
+    if (len <= 0 || !str) {
+        return;
+    }
+
+    auto key = key_class.checkudata<keyb_t>(L, ud);
+    KeyIndex::invalidate();
+
+    if (key_parse(L, str, len, key)) {
+        luaA_object_emit_signal(L, ud, "property::key"_sig, 0);
+    }
 }
 
 /** Create a new key object.
@@ -181,6 +198,61 @@ static void luaA_keystore(lua_State* L, int ud, const char* str, ssize_t len) {
  */
 static int luaA_key_new(lua_State* L) { return key_class.new_object(L); }
 
+/** Build the key of a bucket.
+ * \param keysym True for a keysym, false for a keycode.
+ * \param value The keysym or keycode.
+ * \param modifiers The modifiers mask.
+ */
+static uint64_t key_index_bucket(bool keysym, uint32_t value, uint16_t modifiers) {
+    return uint64_t(keysym) << 48 | uint64_t(modifiers) << 32 | value;
+}
+
+void KeyIndex::rebuild(const std::vector<keyb_t*>& keys) {
+    buckets.clear();
+    for (uint32_t i = 0; i < keys.size(); i++) {
+        const keyb_t* k = keys[i];
+        if (k->keycode) {
+            buckets[key_index_bucket(false, k->keycode, k->modifiers)].push_back(i);
+        }
+        if (k->keysym) {
+            buckets[key_index_bucket(true, k->keysym, k->modifiers)].push_back(i);
+        }
+    }
+    built_generation = generation;
+    built_size = keys.size();
+}
+
+const std::vector<keyb_t*>& KeyIndex::lookup(const std::vector<keyb_t*>& keys,
+                                             xcb_keycode_t keycode,
+                                             xcb_keysym_t keysym,
+                                             uint16_t state) {
+    if (built_generation != generation || built_size != keys.size()) {
+        rebuild(keys);
+    }
+
+    found.clear();
+    auto add = [this](uint64_t bucket) {
+        if (auto it = buckets.find(bucket); it != buckets.end()) {
+            found.insert(found.end(), it->second.begin(), it->second.end());
+        }
+    };
+    add(key_index_bucket(false, keycode, state));
+    add(key_index_bucket(false, keycode, XCB_BUTTON_MASK_ANY));
+    if (keysym) {
+        add(key_index_bucket(true, keysym, state));
+        add(key_index_bucket(true, keysym, XCB_BUTTON_MASK_ANY));
+    }
+    std::ranges::sort(found);
+    const auto dups = std::ranges::unique(found);
+    found.erase(dups.begin(), dups.end());
+
+    result.clear();
+    for (auto i : found) {
+        result.push_back(keys[i]);
+    }
+    return result;
+}
+
 /** Set a key array with a Lua table.
  * \param L The Lua VM state.
  * \param oidx The index of the object to store items into.
@@ -195,6 +267,7 @@ void luaA_key_array_set(lua_State* L, int oidx, int idx, std::vector<keyb_t*>* k
     }
 
     keys->clear();
+    KeyIndex::invalidate();
 
     lua_pushnil(L);
     while (lua_next(L, idx)) {
@@ -263,7 +336,7 @@ uint16_t luaA_tomodifiers(lua_State* L, int ud) {
 
 static int luaA_key_set_modifiers(lua_State* L, keyb_t* k) {
     k->modifiers = luaA_tomodifiers(L, -1);
-    luaA_object_emit_signal(L, -3, "property::modifiers", 0);
+    luaA_object_emit_signal(L, -3, "property::modifiers"_sig, 0);
     return 0;
 }
 
@@ -318,7 +391,8 @@ static int luaA_key_set_key(lua_State* L, keyb_t* k) {
 
 void key_class_setup(lua_State* L) {
     static constexpr auto methods = DefineClassMethods<&key_class>({
-      {"__call", luaA_key_new}
+      { "__call",             luaA_key_new},
+      {"new_set", KeySet::luaA_key_new_set}
     });
 
     static constexpr auto meta = DefineObjectMethods();
@@ -336,7 +410,8 @@ void key_class_setup(lua_State* L) {
     key_class.add_property("keysym", nullptr, luaA_key_get_keysym, nullptr);
     auto setMod = [](lua_State* L, lua_object_t* o) {
         static_cast<keyb_t*>(o)->modifiers = luaA_tomodifiers(L, -1);
-        luaA_object_emit_signal(L, -3, "property::modifiers", 0);
+        KeyIndex::invalidate();
+        luaA_object_emit_signal(L, -3, "property::modifiers"_sig, 0);
         return 0;
     };
     key_class.add_property(
@@ -23,6 +23,8 @@
 #include "common/luaclass.h"
 #include "common/luaobject.h"
 
+#include <unordered_map>
+#include <vector>
 #include <xkbcommon/xkbcommon.h>
 
 struct keyb_t: public lua_object_t {
@@ -38,6 +40,41 @@ struct keyb_t: public lua_object_t {
     keyb_t& operator=(keyb_t&&) = default;
     keyb_t(const keyb_t&) = delete;
     keyb_t& operator=(const keyb_t&) = delete;
+
+    /** Whether a key event triggers this binding */
+    bool matches(xcb_keycode_t code, xcb_keysym_t sym, uint16_t state) const {
+        return ((keycode && code == keycode) || (keysym && sym == keysym)) &&
+               (modifiers == XCB_BUTTON_MASK_ANY || modifiers == state);
+    }
+};
+
+/** Hash index over a key binding array, by keycode or keysym and modifiers.
+ * It is rebuilt lazily after any key binding changed.
+ */
+class KeyIndex {
+    static inline uint64_t generation = 1;
+    uint64_t built_generation = 0;
+    size_t built_size = 0;
+    /** Binding indexes, by keycode or keysym and modifiers */
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+    std::vector<uint32_t> found;
+    std::vector<keyb_t*> result;
+
+    void rebuild(const std::vector<keyb_t*>& keys);
+
+  public:
+    /** Mark every index as outdated, must be called when any binding changes */
+    static void invalidate() { generation++; }
+    /** Find the bindings that can match a key event, in binding order */
+    const std::vector<keyb_t*>& lookup(const std::vector<keyb_t*>& keys,
+                                       xcb_keycode_t keycode,
+                                       xcb_keysym_t keysym,
+                                       uint16_t state);
+};
+
+/** A key binding array with its lookup index */
+struct key_array_t: std::vector<keyb_t*> {
+    KeyIndex index;
 };
 
 extern lua_class_t key_class;
@@ -47,6 +84,7 @@ void key_class_setup(lua_State*);
 void luaA_key_array_set(lua_State*, int, int, std::vector<keyb_t*>*);
 int luaA_key_array_get(lua_State*, int, const std::vector<keyb_t*>&);
 
+bool key_parse(lua_State*, const char*, size_t, keyb_t*);
 int luaA_pushmodifiers(lua_State*, uint16_t);
 uint16_t luaA_tomodifiers(lua_State* L, int ud);
 
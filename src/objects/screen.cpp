@@ -47,6 +47,7 @@
 #include "objects/screen.h"
 
 #include "banning.h"
+#include "common/atoms.h"
 #include "common/luaclass.h"
 #include "common/lualib.h"
 #include "common/luaobject.h"
@@ -60,8 +61,15 @@
 #include "objects/drawin.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <span>
 #include <stdio.h>
 #include <string_view>
+#include <utility>
+#include <vector>
 #include <xcb/randr.h>
 #include <xcb/xcb.h>
 #include <xcb/xinerama.h>
@@ -458,7 +466,7 @@ static void viewports_notify(lua_State* L) {
 
     luaA_viewports(L);
 
-    screen_class.emit_signal(L, "property::_viewports", 1);
+    screen_class.emit_signal(L, "property::_viewports"_sig, 1);
 }
 
 static viewport_t* viewport_add(lua_State* L, area_t area) {
@@ -555,6 +563,32 @@ static void viewport_purge(void) {
     } while (cur);
 }
 
+/** The screens sorted into vertical slabs, for finding the screen of a point.
+ * The slabs are bounded by the left and right edges of all screens, so that
+ * every screen covers a slab entirely or not at all.
+ */
+static struct {
+    unsigned generation = 1;
+    unsigned built = 0;
+    /** The edges of the slabs, slab i spans [edges[i], edges[i + 1]) */
+    std::vector<int> edges;
+    /** The screens covering each slab, in the order of the screen list */
+    std::vector<std::vector<screen_t*>> slabs;
+    /** Whether no two screens overlap, so that any hit is the only one */
+    bool disjoint = true;
+    /** The screen found by the last lookup */
+    screen_t* last_hit = nullptr;
+} screen_coord_index;
+
+/** Mark the index of screen geometries as stale.
+ * This has to be called whenever the screen list or the geometry of a screen
+ * changes.
+ */
+static void screen_coord_index_invalidate(void) {
+    screen_coord_index.generation++;
+    screen_coord_index.last_hit = nullptr;
+}
+
 static screen_t* screen_add(lua_State* L, std::vector<screen_t*>* screens) {
     screen_t* new_screen = newobj<screen_t, screen_class>(L);
     luaA_object_ref(L, -1);
@@ -564,27 +598,43 @@ static screen_t* screen_add(lua_State* L, std::vector<screen_t*>* screens) {
     return new_screen;
 }
 
+/** The monitors found by the last scan, as the part of the GetMonitors reply
+ * after its header, and the primary output at that time. A refresh that finds
+ * the same can skip updating the screens.
+ */
+static std::vector<uint8_t> last_monitors;
+static xcb_randr_output_t last_primary = XCB_NONE;
+
 /* Monitors were introduced in RandR 1.5 */
 #ifdef XCB_RANDR_GET_MONITORS
 
+static std::span<const uint8_t> screen_monitors_bytes(xcb_randr_get_monitors_reply_t* monitors_r) {
+    constexpr size_t offset = offsetof(xcb_randr_get_monitors_reply_t, nMonitors);
+    const auto data = reinterpret_cast<const uint8_t*>(monitors_r);
+    return {data + offset, sizeof(*monitors_r) + monitors_r->length * 4 - offset};
+}
+
+/** Check whether a GetMonitors reply and primary output match the last scan.
+ * \param monitors_r The GetMonitors reply.
+ * \param primary The primary output.
+ * \return True if nothing changed.
+ */
+static bool screen_monitors_unchanged(xcb_randr_get_monitors_reply_t* monitors_r,
+                                      xcb_randr_output_t primary) {
+    const auto bytes = screen_monitors_bytes(monitors_r);
+    return !last_monitors.empty() && primary == last_primary &&
+           std::ranges::equal(bytes, last_monitors);
+}
+
 static screen_output_t screen_get_randr_output(lua_State* L,
-                                               xcb_randr_monitor_info_iterator_t* it) {
+                                               xcb_randr_monitor_info_iterator_t* it,
+                                               std::optional<std::string_view> name) {
     screen_output_t output;
     xcb_randr_output_t* randr_outputs;
 
     output.mm_width = it->data->width_in_millimeters;
     output.mm_height = it->data->height_in_millimeters;
-
-    auto name_c = getConnection().get_atom_name_unchecked(it->data->name);
-    auto name_r = getConnection().get_atom_name_reply(name_c);
-
-    if (name_r) {
-        const char* name = xcb_get_atom_name_name(name_r.get());
-        size_t len = xcb_get_atom_name_name_length(name_r.get());
-        output.name.assign(name, len);
-    } else {
-        output.name = "unknown";
-    }
+    output.name = name ? *name : "unknown";
 
     randr_outputs = xcb_randr_monitor_info_outputs(it->data);
 
@@ -595,22 +645,35 @@ static screen_output_t screen_get_randr_output(lua_State* L,
     return output;
 }
 
-static void screen_scan_randr_monitors(lua_State* L, std::vector<screen_t*>* screens) {
-    auto monitors_c = getConnection().randr().get_monitors(Manager::get().screen->root, 1);
-    auto monitors_r = getConnection().randr().get_monitors_reply(monitors_c);
+static void screen_scan_randr_monitors(lua_State* L,
+                                       std::vector<screen_t*>* screens,
+                                       xcb_randr_get_monitors_reply_t* monitors_r) {
     xcb_randr_monitor_info_iterator_t monitor_iter;
 
     if (monitors_r == NULL) {
         log_warn("RANDR GetMonitors failed; this should not be possible");
+        last_monitors.clear();
         return;
     }
 
-    for (monitor_iter = xcb_randr_get_monitors_monitors_iterator(monitors_r.get());
-         monitor_iter.rem;
+    const auto bytes = screen_monitors_bytes(monitors_r);
+    last_monitors.assign(bytes.begin(), bytes.end());
+
+    /* Resolve all monitor names at once */
+    std::vector<xcb_atom_t> name_atoms;
+    for (monitor_iter = xcb_randr_get_monitors_monitors_iterator(monitors_r); monitor_iter.rem;
+         xcb_randr_monitor_info_next(&monitor_iter)) {
+        name_atoms.push_back(monitor_iter.data->name);
+    }
+    std::vector<std::optional<std::string_view>> names(name_atoms.size());
+    atoms_names(getConnection().getConnection(), name_atoms, names);
+
+    size_t idx = 0;
+    for (monitor_iter = xcb_randr_get_monitors_monitors_iterator(monitors_r); monitor_iter.rem;
          xcb_randr_monitor_info_next(&monitor_iter)) {
         screen_t* new_screen;
 
-        screen_output_t output = screen_get_randr_output(L, &monitor_iter);
+        screen_output_t output = screen_get_randr_output(L, &monitor_iter, names[idx++]);
 
         viewport_t* viewport = viewport_add(L,
                                             area_t{
@@ -635,6 +698,12 @@ static void screen_scan_randr_monitors(lua_State* L, std::vector<screen_t*>* scr
         new_screen->xid = monitor_iter.data->name;
     }
 }
+
+static void screen_scan_randr_monitors(lua_State* L, std::vector<screen_t*>* screens) {
+    auto monitors_c = getConnection().randr().get_monitors(Manager::get().screen->root, 1);
+    auto monitors_r = getConnection().randr().get_monitors_reply(monitors_c);
+    screen_scan_randr_monitors(L, screens, monitors_r.get());
+}
 #else
 static void screen_scan_randr_monitors(lua_State* L, screen_array_t* screens) {}
 #endif
@@ -789,18 +858,18 @@ static void screen_added(lua_State* L, screen_t* screen) {
     screen->workarea = screen->geometry;
     screen->valid = true;
     luaA_object_push(L, screen);
-    luaA_object_emit_signal(L, -1, "_added", 0);
+    luaA_object_emit_signal(L, -1, "_added"_sig, 0);
     lua_pop(L, 1);
 }
 
 void screen_emit_scanned(void) {
     lua_State* L = globalconf_get_lua_State();
-    screen_class.emit_signal(L, "scanned", 0);
+    screen_class.emit_signal(L, "scanned"_sig, 0);
 }
 
 void screen_emit_scanning(void) {
     lua_State* L = globalconf_get_lua_State();
-    screen_class.emit_signal(L, "scanning", 0);
+    screen_class.emit_signal(L, "scanning"_sig, 0);
 }
 
 static void screen_scan_common(bool quiet) {
@@ -821,6 +890,7 @@ static void screen_scan_common(bool quiet) {
     awsm_check(Manager::get().screens.size() > 0 || Manager::get().startup.ignore_screens);
 
     screen_deduplicate(L, &Manager::get().screens);
+    screen_coord_index_invalidate();
 
     for (auto* screen : Manager::get().screens) {
         screen_added(L, screen);
@@ -851,21 +921,22 @@ static int luaA_scan_quiet(lua_State* L) {
 static void screen_removed(lua_State* L, int sidx) {
     auto screen = screen_class.checkudata<screen_t>(L, sidx);
 
-    luaA_object_emit_signal(L, sidx, "removed", 0);
+    screen_coord_index_invalidate();
+    luaA_object_emit_signal(L, sidx, "removed"_sig, 0);
 
     if (Manager::get().primary_screen == screen) {
         Manager::get().primary_screen = NULL;
     }
 
-    for (auto* c : Manager::get().clients) {
-        if (c->screen == screen) {
-            screen_client_moveto(c, screen_getbycoord(c->geometry.top_left), false);
-        }
+    /* Moving clients changes the list, work on a copy */
+    for (auto* c : std::vector<client*>{screen_clients(screen)}) {
+        screen_client_moveto(c, screen_getbycoord(c->geometry.top_left), false);
     }
 }
 
 void screen_cleanup(void) {
     Manager::get().screens.clear();
+    screen_coord_index_invalidate();
 
     monitor_unmark();
     viewport_purge();
@@ -877,9 +948,10 @@ static void screen_modified(screen_t* existing_screen, screen_t* other_screen) {
     if (existing_screen->geometry != other_screen->geometry) {
         area_t old_geometry = existing_screen->geometry;
         existing_screen->geometry = other_screen->geometry;
+        screen_coord_index_invalidate();
         luaA_object_push(L, existing_screen);
         Lua::pusharea(L, old_geometry);
-        luaA_object_emit_signal(L, -2, "property::geometry", 1);
+        luaA_object_emit_signal(L, -2, "property::geometry"_sig, 1);
         lua_pop(L, 1);
         screen_update_workarea(existing_screen);
     }
@@ -911,14 +983,39 @@ static void screen_modified(screen_t* existing_screen, screen_t* other_screen) {
 
         if (outputs_changed) {
             luaA_object_push(L, existing_screen);
-            luaA_object_emit_signal(L, -1, "property::_outputs", 0);
+            luaA_object_emit_signal(L, -1, "property::_outputs"_sig, 0);
             lua_pop(L, 1);
         }
     }
 }
 
+/** The pending debounced refresh, and when the first request for it came */
+static guint screen_refresh_source = 0;
+static std::chrono::steady_clock::time_point screen_refresh_requested;
+
+/** How long to wait for more changes before refreshing, and at most */
+static constexpr auto screen_refresh_delay = std::chrono::milliseconds(50);
+static constexpr auto screen_refresh_max_delay = std::chrono::milliseconds(250);
+
 static gboolean screen_refresh(gpointer unused) {
     Manager::get().x.screen_refresh_pending = false;
+    screen_refresh_source = 0;
+
+    /* Ask for everything at once */
+    const xcb_window_t root = Manager::get().screen->root;
+    auto monitors_c = getConnection().randr().get_monitors(root, 1);
+    auto primary_c = xcb_randr_get_output_primary(getConnection().getConnection(), root);
+    auto monitors_r = getConnection().randr().get_monitors_reply(monitors_c);
+    xcb_randr_get_output_primary_reply_t* primary_r =
+      xcb_randr_get_output_primary_reply(getConnection().getConnection(), primary_c, NULL);
+    const xcb_randr_output_t primary = primary_r ? primary_r->output : XCB_NONE;
+    p_delete(&primary_r);
+
+    /* A burst of notifies often ends where it started, or only touches
+     * things which screens do not care about */
+    if (monitors_r && screen_monitors_unchanged(monitors_r.get(), primary)) {
+        return G_SOURCE_REMOVE;
+    }
 
     monitor_unmark();
 
@@ -927,7 +1024,7 @@ static gboolean screen_refresh(gpointer unused) {
     lua_State* L = globalconf_get_lua_State();
     bool list_changed = false;
 
-    screen_scan_randr_monitors(L, &new_screens);
+    screen_scan_randr_monitors(L, &new_screens, monitors_r.get());
 
     viewport_purge();
 
@@ -947,6 +1044,7 @@ static gboolean screen_refresh(gpointer unused) {
         });
         if (it == Manager::get().screens.end()) {
             Manager::get().screens.push_back(new_screen);
+            screen_coord_index_invalidate();
             screen_added(L, new_screen);
             /* Get an extra reference since both new_screens and
              * globalconf.screens reference this screen now */
@@ -997,22 +1095,109 @@ static gboolean screen_refresh(gpointer unused) {
     }
     new_screens.clear();
 
-    screen_update_primary();
+    screen_set_primary_output(primary);
+
+    /* The modes may have changed with the monitors */
+    if (Manager::get().frame_pacing.enabled) {
+        screen_update_frame_interval();
+    }
 
     if (list_changed) {
-        screen_class.emit_signal(L, "list", 0);
+        screen_class.emit_signal(L, "list"_sig, 0);
     }
 
     return G_SOURCE_REMOVE;
 }
 
+/** Get the highest refresh rate of the active CRTCs.
+ * \return The rate in Hz, or 0 if it is unknown.
+ */
+static double screen_max_refresh_rate(void) {
+    const xcb_query_extension_reply_t* extension_reply =
+      getConnection().get_extension_data(&xcb_randr_id);
+    if (!extension_reply || !extension_reply->present) {
+        return 0;
+    }
+
+    xcb_connection_t* conn = getConnection().getConnection();
+    xcb_randr_get_screen_resources_current_reply_t* resources_r =
+      xcb_randr_get_screen_resources_current_reply(
+        conn, xcb_randr_get_screen_resources_current(conn, Manager::get().screen->root), NULL);
+    if (!resources_r) {
+        return 0;
+    }
+
+    const std::span crtcs{xcb_randr_get_screen_resources_current_crtcs(resources_r),
+                          size_t(xcb_randr_get_screen_resources_current_crtcs_length(resources_r))};
+    const std::span modes{xcb_randr_get_screen_resources_current_modes(resources_r),
+                          size_t(xcb_randr_get_screen_resources_current_modes_length(resources_r))};
+
+    std::vector<xcb_randr_get_crtc_info_cookie_t> cookies;
+    for (auto crtc : crtcs) {
+        cookies.push_back(xcb_randr_get_crtc_info(conn, crtc, resources_r->config_timestamp));
+    }
+
+    double best = 0;
+    for (auto cookie : cookies) {
+        xcb_randr_get_crtc_info_reply_t* crtc_r = xcb_randr_get_crtc_info_reply(conn, cookie, NULL);
+        if (!crtc_r) {
+            continue;
+        }
+        auto mode = std::ranges::find(modes, crtc_r->mode, &xcb_randr_mode_info_t::id);
+        if (crtc_r->mode != XCB_NONE && mode != modes.end() && mode->htotal && mode->vtotal) {
+            double rate = mode->dot_clock / (double(mode->htotal) * mode->vtotal);
+            if (mode->mode_flags & XCB_RANDR_MODE_FLAG_DOUBLE_SCAN) {
+                rate /= 2;
+            }
+            if (mode->mode_flags & XCB_RANDR_MODE_FLAG_INTERLACE) {
+                rate *= 2;
+            }
+            best = std::max(best, rate);
+        }
+        p_delete(&crtc_r);
+    }
+    p_delete(&resources_r);
+    return best;
+}
+
+/** Compute how often refreshes run when they are frame paced.
+ * This uses the rate asked for, else the highest refresh rate of the monitors,
+ * else 60 Hz.
+ */
+void screen_update_frame_interval(void) {
+    auto& pacing = Manager::get().frame_pacing;
+    double rate = pacing.rate > 0 ? pacing.rate : screen_max_refresh_rate();
+    if (!(rate > 0)) {
+        rate = 60;
+    }
+    pacing.interval = std::chrono::microseconds(std::llround(1e6 / rate));
+}
+
+/** Refresh the screens once changes stopped coming for a short while.
+ * Every call pushes the refresh back, but never further than the maximum delay
+ * after the first one.
+ */
 void screen_schedule_refresh(void) {
+    const auto now = std::chrono::steady_clock::now();
+    const auto delay = screen_refresh_delay;
+
     if (Manager::get().x.screen_refresh_pending) {
-        return;
+        const auto deadline = screen_refresh_requested + screen_refresh_max_delay;
+        if (now + delay > deadline) {
+            return;
+        }
+        g_source_remove(screen_refresh_source);
+    } else {
+        screen_refresh_requested = now;
     }
 
     Manager::get().x.screen_refresh_pending = true;
-    g_idle_add_full(G_PRIORITY_LOW, screen_refresh, NULL, NULL);
+    screen_refresh_source = g_timeout_add_full(
+      G_PRIORITY_LOW,
+      std::chrono::duration_cast<std::chrono::milliseconds>(delay).count(),
+      screen_refresh,
+      NULL,
+      NULL);
 }
 
 /** Return the squared distance of the given screen to the coordinates.
@@ -1047,15 +1232,62 @@ static unsigned int screen_get_distance_squared(screen_t* s, int x, int y) {
     return dist_x * dist_x + dist_y * dist_y;
 }
 
+/** Rebuild the index of screen geometries if it is stale. */
+static void screen_coord_index_update(void) {
+    auto& index = screen_coord_index;
+    if (index.built == index.generation) {
+        return;
+    }
+    index.built = index.generation;
+
+    const auto& screens = Manager::get().screens;
+    index.edges.clear();
+    for (auto* s : screens) {
+        index.edges.push_back(s->geometry.left());
+        index.edges.push_back(s->geometry.right());
+    }
+    std::ranges::sort(index.edges);
+    index.edges.erase(std::ranges::unique(index.edges).begin(), index.edges.end());
+
+    index.slabs.assign(index.edges.empty() ? 0 : index.edges.size() - 1, {});
+    index.disjoint = true;
+    for (auto* s : screens) {
+        auto first = std::ranges::lower_bound(index.edges, s->geometry.left());
+        auto last = std::ranges::lower_bound(index.edges, s->geometry.right());
+        for (auto it = first; it < last; it++) {
+            auto& slab = index.slabs[it - index.edges.begin()];
+            for (auto* other : slab) {
+                if (other->geometry.top() < s->geometry.bottom() &&
+                    s->geometry.top() < other->geometry.bottom()) {
+                    index.disjoint = false;
+                }
+            }
+            slab.push_back(s);
+        }
+    }
+}
+
 /** Return the first screen number where the coordinates belong to.
  * \param x X coordinate
  * \param y Y coordinate
  * \return Screen pointer or screen param if no match or no multi-head.
  */
 screen_t* screen_getbycoord(point p) {
-    for (auto* s : Manager::get().screens) {
-        if (s->geometry.inside(p)) {
-            return s;
+    auto& index = screen_coord_index;
+    screen_coord_index_update();
+
+    /* The pointer and the windows mostly stay on the same screen */
+    if (index.disjoint && index.last_hit && index.last_hit->geometry.inside(p)) {
+        return index.last_hit;
+    }
+
+    auto edge = std::ranges::upper_bound(index.edges, p.x);
+    if (edge != index.edges.begin() && edge != index.edges.end()) {
+        for (auto* s : index.slabs[edge - index.edges.begin() - 1]) {
+            if (s->geometry.inside(p)) {
+                index.last_hit = s;
+                return s;
+            }
         }
     }
 
@@ -1084,6 +1316,44 @@ bool screen_area_in_screen(screen_t* s, area_t geom) {
            (geom.top_left.y + geom.height > s->geometry.top_left.y);
 }
 
+/** The windows which have a strut, the only ones that shrink a workarea */
+static std::vector<client*> strut_clients;
+static std::vector<drawin_t*> strut_drawins;
+
+template<typename T>
+static void strut_track(std::vector<T*>& windows, T* w) {
+    auto it = std::ranges::find(windows, w);
+    if (!strut_has_value(&w->strut)) {
+        if (it != windows.end()) {
+            windows.erase(it);
+        }
+    } else if (it == windows.end()) {
+        windows.push_back(w);
+    }
+}
+
+/** Keep track of whether a window contributes to the workarea.
+ * This has to be called whenever the strut of a window changes.
+ * \param c The client.
+ */
+void screen_strut_track(client* c) { strut_track(strut_clients, c); }
+
+/** Keep track of whether a window contributes to the workarea.
+ * This has to be called whenever the strut of a window changes.
+ * \param drawin The drawin.
+ */
+void screen_strut_track(drawin_t* drawin) { strut_track(strut_drawins, drawin); }
+
+/** Stop tracking the strut of a window that goes away.
+ * \param c The client.
+ */
+void screen_strut_forget(client* c) { std::erase(strut_clients, c); }
+
+/** Stop tracking the strut of a window that goes away.
+ * \param drawin The drawin.
+ */
+void screen_strut_forget(drawin_t* drawin) { std::erase(strut_drawins, drawin); }
+
 void screen_update_workarea(screen_t* screen) {
     area_t area = screen->geometry;
     uint16_t top = 0, bottom = 0, left = 0, right = 0;
@@ -1118,13 +1388,13 @@ void screen_update_workarea(screen_t* screen) {
         }                                                                                         \
     }
 
-    for (auto* c : Manager::get().clients) {
+    for (auto* c : strut_clients) {
         if (c->screen == screen && client_isvisible(c)) {
             COMPUTE_STRUT(c)
         }
     }
 
-    for (auto* drawin : Manager::get().drawins) {
+    for (auto* drawin : strut_drawins) {
         if (drawin->visible) {
             screen_t* d_screen = screen_getbycoord(drawin->geometry.top_left);
             if (d_screen == screen) {
@@ -1148,10 +1418,167 @@ void screen_update_workarea(screen_t* screen) {
     lua_State* L = globalconf_get_lua_State();
     luaA_object_push(L, screen);
     Lua::pusharea(L, old_workarea);
-    luaA_object_emit_signal(L, -2, "property::workarea", 1);
+    luaA_object_emit_signal(L, -2, "property::workarea"_sig, 1);
     lua_pop(L, 1);
 }
 
+/** The list_order of the first client of Manager::clients */
+static int64_t client_list_front = 0;
+/** The stack lists of all screens have to be rebuilt from the client stack */
+static bool client_stack_dirty = false;
+
+static int64_t screen_list_key(client* c) { return c->list_order; }
+static size_t screen_stack_key(client* c) { return c->stack_position; }
+
+/** Insert a client in a list of a screen, keeping the list sorted.
+ * \param list The list.
+ * \param c The client, not in the list.
+ * \param key The key the list is sorted by.
+ */
+template <typename Key>
+static void screen_client_index_insert(std::vector<client*>& list, client* c, Key key) {
+    list.insert(std::ranges::upper_bound(list, key(c), {}, key), c);
+}
+
+static void screen_client_index_erase(std::vector<client*>& list, client* c) {
+    if (auto it = std::ranges::find(list, c); it != list.end()) {
+        list.erase(it);
+    }
+}
+
+/** Put a client in the lists of its screen, if it is managed. */
+static void screen_client_index_link(client* c) {
+    if (!c->screen || c->hot_slot == ClientHotStore::no_slot) {
+        return;
+    }
+    auto& index = c->screen->client_index;
+    screen_client_index_insert(index.clients, c, screen_list_key);
+    if (!client_stack_dirty && (c->stack_below || stack_bottom() == c)) {
+        /* Brings stack_position up to date */
+        stack_get();
+        screen_client_index_insert(index.stack, c, screen_stack_key);
+    }
+}
+
+/** Take a client out of the lists of its screen. */
+static void screen_client_index_unlink(client* c) {
+    if (!c->screen) {
+        return;
+    }
+    screen_client_index_erase(c->screen->client_index.clients, c);
+    screen_client_index_erase(c->screen->client_index.stack, c);
+}
+
+/** Add a client which was just put at the front of Manager::clients.
+ * \param c The client.
+ */
+void screen_client_index_add(client* c) {
+    c->list_order = --client_list_front;
+    screen_client_index_link(c);
+}
+
+/** Remove a client which is not managed anymore.
+ * \param c The client.
+ */
+void screen_client_index_remove(client* c) { screen_client_index_unlink(c); }
+
+/** Update the lists after two clients swapped their places in Manager::clients.
+ * \param a A client.
+ * \param b The other client.
+ */
+void screen_client_index_swap(client* a, client* b) {
+    std::swap(a->list_order, b->list_order);
+    for (auto* c : {a, b}) {
+        if (c->screen) {
+            screen_client_index_erase(c->screen->client_index.clients, c);
+            screen_client_index_insert(c->screen->client_index.clients, c, screen_list_key);
+        }
+    }
+}
+
+/** Rebuild the lists after Manager::clients was reordered as a whole.
+ */
+void screen_client_index_reorder(void) {
+    client_list_front = 0;
+    const auto& clients = Manager::get().clients;
+    for (auto* s : Manager::get().screens) {
+        s->client_index.clients.clear();
+    }
+    for (auto* c : clients) {
+        if (c->screen) {
+            c->screen->client_index.clients.clear();
+        }
+    }
+    for (size_t i = 0; i < clients.size(); i++) {
+        auto* c = clients[i];
+        c->list_order = int64_t(i);
+        if (c->screen) {
+            c->screen->client_index.clients.push_back(c);
+        }
+    }
+}
+
+/** Update the stack lists after a client moved to the top or the bottom of
+ * the client stack, or left it.
+ * \param c The client.
+ * \param where Where the client is now in the stack.
+ */
+void screen_stack_index_moved(client* c, screen_stack_move_t where) {
+    if (client_stack_dirty || !c->screen) {
+        return;
+    }
+    auto& stack = c->screen->client_index.stack;
+    screen_client_index_erase(stack, c);
+    if (where == SCREEN_STACK_TOP) {
+        stack.push_back(c);
+    } else if (where == SCREEN_STACK_BOTTOM) {
+        stack.insert(stack.begin(), c);
+    }
+}
+
+/** Mark the stack lists as stale after many clients moved in the stack.
+ * They are rebuilt in one pass over the stack when next read.
+ */
+void screen_stack_index_invalidate(void) { client_stack_dirty = true; }
+
+static void screen_stack_index_update(void) {
+    if (!client_stack_dirty) {
+        return;
+    }
+    client_stack_dirty = false;
+    for (auto* s : Manager::get().screens) {
+        s->client_index.stack.clear();
+    }
+    /* Including the screens which are going away */
+    for (auto* c : Manager::get().getStack()) {
+        if (c->screen) {
+            c->screen->client_index.stack.clear();
+        }
+    }
+    for (auto* c : Manager::get().getStack()) {
+        if (c->screen) {
+            c->screen->client_index.stack.push_back(c);
+        }
+    }
+}
+
+/** Get the clients of a screen, in the order of the global client list.
+ * \param screen The screen.
+ * \return The clients. The list is only valid until the next change of clients.
+ */
+const std::vector<client*>& screen_clients(screen_t* screen) {
+    return screen->client_index.clients;
+}
+
+/** Get the clients of a screen in stacking order, from bottom to top.
+ * \param screen The screen.
+ * \return The clients. The list is only valid until the next change of clients.
+ */
+const std::vector<client*>& screen_stack(screen_t* screen) {
+    screen_stack_index_update();
+    return screen->client_index.stack;
+}
+
 /** Move a client to a virtual screen.
  * \param c The client to move.
  * \param new_screen The destination screen.
@@ -1172,7 +1599,10 @@ void screen_client_moveto(client* c, screen_t* new_screen, bool doresize) {
         had_focus = true;
     }
 
+    screen_client_index_unlink(c);
     c->screen = new_screen;
+    screen_client_index_link(c);
+    client_ffi_sync(c);
 
     if (!doresize) {
         luaA_object_push(L, c);
@@ -1181,7 +1611,7 @@ void screen_client_moveto(client* c, screen_t* new_screen, bool doresize) {
         } else {
             lua_pushnil(L);
         }
-        luaA_object_emit_signal(L, -2, "property::screen", 1);
+        luaA_object_emit_signal(L, -2, "property::screen"_sig, 1);
         lua_pop(L, 1);
         if (had_focus) {
             client_focus(c);
@@ -1226,7 +1656,7 @@ void screen_client_moveto(client* c, screen_t* new_screen, bool doresize) {
     } else {
         lua_pushnil(L);
     }
-    luaA_object_emit_signal(L, -2, "property::screen", 1);
+    luaA_object_emit_signal(L, -2, "property::screen"_sig, 1);
     lua_pop(L, 1);
 
     if (had_focus) {
@@ -1241,7 +1671,6 @@ int screen_get_index(lua_object_t* s) {
 }
 
 void screen_update_primary(void) {
-    screen_t* primary_screen = NULL;
     xcb_randr_get_output_primary_reply_t* primary = xcb_randr_get_output_primary_reply(
       getConnection().getConnection(),
       xcb_randr_get_output_primary(getConnection().getConnection(), Manager::get().screen->root),
@@ -1251,18 +1680,29 @@ void screen_update_primary(void) {
         return;
     }
 
+    screen_set_primary_output(primary->output);
+    p_delete(&primary);
+}
+
+/** Make the screen of a RandR output the primary screen.
+ * \param primary The primary output.
+ */
+void screen_set_primary_output(xcb_randr_output_t primary) {
+    screen_t* primary_screen = NULL;
+
+    last_primary = primary;
+
     for (auto* screen : Manager::get().screens) {
         if (screen->viewport) {
             for (auto& output : screen->viewport->outputs) {
                 for (auto randr_output : output.outputs) {
-                    if (randr_output == primary->output) {
+                    if (randr_output == primary) {
                         primary_screen = screen;
                     }
                 }
             }
         }
     }
-    p_delete(&primary);
 
     if (!primary_screen || primary_screen == Manager::get().primary_screen) {
         return;
@@ -1274,11 +1714,11 @@ void screen_update_primary(void) {
 
     if (old) {
         luaA_object_push(L, old);
-        luaA_object_emit_signal(L, -1, "primary_changed", 0);
+        luaA_object_emit_signal(L, -1, "primary_changed"_sig, 0);
         lua_pop(L, 1);
     }
     luaA_object_push(L, primary_screen);
-    luaA_object_emit_signal(L, -1, "primary_changed", 0);
+    luaA_object_emit_signal(L, -1, "primary_changed"_sig, 0);
     lua_pop(L, 1);
 }
 
@@ -1288,7 +1728,7 @@ screen_t* screen_get_primary(void) {
 
         lua_State* L = globalconf_get_lua_State();
         luaA_object_push(L, Manager::get().primary_screen);
-        luaA_object_emit_signal(L, -1, "primary_changed", 0);
+        luaA_object_emit_signal(L, -1, "primary_changed"_sig, 0);
         lua_pop(L, 1);
     }
     return Manager::get().primary_screen;
@@ -1466,9 +1906,10 @@ static int luaA_screen_fake_add(lua_State* L) {
     s->geometry.width = width;
     s->geometry.height = height;
     s->xid = FAKE_SCREEN_XID;
+    screen_coord_index_invalidate();
 
     screen_added(L, s);
-    screen_class.emit_signal(L, "list", 0);
+    screen_class.emit_signal(L, "list"_sig, 0);
     luaA_object_push(L, s);
 
     for (auto* c : Manager::get().clients) {
@@ -1499,11 +1940,14 @@ static int luaA_screen_fake_remove(lua_State* L) {
                   "This is a very, very, very bad idea!");
     }
 
+    /* The next refresh has to bring the screen back */
+    last_monitors.clear();
+
     Manager::get().screens.erase(Manager::get().screens.begin() + idx);
     luaA_object_push(L, s);
     screen_removed(L, -1);
     lua_pop(L, 1);
-    screen_class.emit_signal(L, "list", 0);
+    screen_class.emit_signal(L, "list"_sig, 0);
     luaA_object_unref(L, s);
     s->valid = false;
 
@@ -1534,14 +1978,18 @@ static int luaA_screen_fake_resize(lua_State* L) {
     int height = luaL_checkinteger(L, 5);
     area_t old_geometry = screen->geometry;
 
+    /* The next refresh has to restore the monitor geometry */
+    last_monitors.clear();
+
     screen->geometry.top_left = {x, y};
     screen->geometry.width = width;
     screen->geometry.height = height;
+    screen_coord_index_invalidate();
 
     screen_update_workarea(screen);
 
     Lua::pusharea(L, old_geometry);
-    luaA_object_emit_signal(L, 1, "property::geometry", 1);
+    luaA_object_emit_signal(L, 1, "property::geometry"_sig, 1);
 
     /* Note: calling `screen_client_moveto` from here will create more issues
      * than it would fix. Keep in mind that it means `c.screen` will be wrong
@@ -1582,17 +2030,18 @@ static int luaA_screen_swap(lua_State* L) {
         /* swap ! */
         *ref_s = swap;
         *ref_swap = s;
+        screen_coord_index_invalidate();
 
-        screen_class.emit_signal(L, "list", 0);
+        screen_class.emit_signal(L, "list"_sig, 0);
 
         luaA_object_push(L, swap);
         lua_pushboolean(L, true);
-        luaA_object_emit_signal(L, -4, "swapped", 2);
+        luaA_object_emit_signal(L, -4, "swapped"_sig, 2);
 
         luaA_object_push(L, swap);
         luaA_object_push(L, s);
         lua_pushboolean(L, false);
-        luaA_object_emit_signal(L, -3, "swapped", 2);
+        luaA_object_emit_signal(L, -3, "swapped"_sig, 2);
     }
 
     return 0;
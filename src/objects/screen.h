@@ -24,6 +24,8 @@
 #include "draw.h"
 #include "globalconf.h"
 
+#include <vector>
+
 /** Different ways to manage screens */
 typedef enum {
     SCREEN_LIFECYCLE_USER = 0,       /*!< Unmanaged (ei. from fake_add) */
@@ -31,6 +33,14 @@ typedef enum {
     SCREEN_LIFECYCLE_C = 0x1 << 1,   /*!< Is managed internally by C    */
 } screen_lifecycle_t;
 
+/** Where a client went in the client stack, see screen_stack_index_moved() */
+typedef enum {
+    SCREEN_STACK_TOP,
+    SCREEN_STACK_BOTTOM,
+    /** It left the stack */
+    SCREEN_STACK_NONE,
+} screen_stack_move_t;
+
 struct screen_t: public lua_object_t {
     bool valid;
     /** Who manages the screen lifecycle */
@@ -45,6 +55,14 @@ struct screen_t: public lua_object_t {
     struct viewport_t* viewport;
     /** Some XID identifying this screen */
     uint32_t xid;
+    /** The clients on this screen, kept up to date as they change, see
+     * screen_clients() */
+    struct {
+        /** In the order of Manager::clients */
+        std::vector<client*> clients;
+        /** In stacking order, from bottom to top */
+        std::vector<client*> stack;
+    } client_index;
 };
 
 void screen_class_setup(lua_State* L);
@@ -55,9 +73,23 @@ bool screen_area_in_screen(screen_t*, area_t);
 int screen_get_index(lua_object_t*);
 void screen_client_moveto(client*, screen_t*, bool);
 void screen_update_primary(void);
+void screen_set_primary_output(xcb_randr_output_t);
 void screen_update_workarea(screen_t*);
+void screen_strut_track(client*);
+void screen_strut_track(drawin_t*);
+void screen_strut_forget(client*);
+void screen_strut_forget(drawin_t*);
+void screen_client_index_add(client*);
+void screen_client_index_remove(client*);
+void screen_client_index_swap(client*, client*);
+void screen_client_index_reorder(void);
+void screen_stack_index_moved(client*, screen_stack_move_t);
+void screen_stack_index_invalidate(void);
+const std::vector<client*>& screen_clients(screen_t*);
+const std::vector<client*>& screen_stack(screen_t*);
 screen_t* screen_get_primary(void);
 void screen_schedule_refresh(void);
+void screen_update_frame_interval(void);
 void screen_emit_scanned(void);
 void screen_emit_scanning(void);
 void screen_cleanup(void);
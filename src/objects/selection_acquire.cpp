@@ -21,6 +21,7 @@
 
 #include "objects/selection_acquire.h"
 
+#include "common/atoms.h"
 #include "common/luaclass.h"
 #include "common/luaobject.h"
 #include "globalconf.h"
@@ -86,7 +87,7 @@ static int selection_acquire_find_by_window(lua_State* L, xcb_window_t window) {
 static void selection_release(lua_State* L, int ud) {
     auto selection = selection_acquire_class.checkudata<selection_acquire_t>(L, ud);
 
-    luaA_object_emit_signal(L, ud, "release", 0);
+    luaA_object_emit_signal(L, ud, "release"_sig, 0);
 
     /* Destroy the window, this also releases the selection in X11 */
     getConnection().destroy_window(selection->window);
@@ -143,9 +144,7 @@ static int luaA_selection_acquire_new(lua_State* L) {
     const char* name = luaL_checklstring(L, -1, &name_length);
 
     /* Get the atom identifying the selection */
-    auto reply = getConnection().intern_atom_reply(
-      getConnection().intern_atom_unchecked(false, name_length, name));
-    xcb_atom_t name_atom = reply ? reply->atom : XCB_NONE;
+    xcb_atom_t name_atom = atoms_get(getConnection().getConnection(), {name, name_length});
 
     /* Create a selection object */
     auto selection = (selection_acquire_t*)selection_acquire_class.alloc_object(L);
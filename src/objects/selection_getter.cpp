@@ -28,7 +28,12 @@
 #include "lua.h"
 
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <ranges>
+#include <string>
+#include <unistd.h>
+#include <vector>
 
 #define REGISTRY_GETTER_TABLE_INDEX "awesome_selection_getters"
 
@@ -37,8 +42,25 @@ struct selection_getter_t: public lua_object_t {
     int ref;
     /** Window used for the transfer */
     xcb_window_t window;
-
-    ~selection_getter_t() { getConnection().destroy_window(window); }
+    /** Collect the pieces of an incremental transfer and emit them at once */
+    bool accumulate;
+    /** Maximum number of bytes accepted when accumulating, 0 for no limit */
+    size_t max_size;
+    /** File descriptor the data is written to instead of emitting it, or -1 */
+    int fd = -1;
+    /** Number of bytes received so far */
+    size_t received;
+    /** The data collected so far */
+    std::string buffer;
+    /** Why the transfer failed, empty if it did not */
+    std::string error;
+
+    ~selection_getter_t() {
+        getConnection().destroy_window(window);
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
 };
 
 static lua_class_t selection_getter_class{
@@ -65,8 +87,22 @@ static int luaA_selection_getter_new(lua_State* L) {
     auto name = luaL_checklstring(L, -2, &name_length);
     auto target = luaL_checklstring(L, -1, &target_length);
 
+    lua_pushliteral(L, "accumulate");
+    lua_gettable(L, 2);
+    const bool accumulate = lua_toboolean(L, -1);
+    lua_pushliteral(L, "max_size");
+    lua_gettable(L, 2);
+    const lua_Number max_size = luaL_optnumber(L, -1, 0);
+    lua_pushliteral(L, "fd");
+    lua_gettable(L, 2);
+    const int fd = lua_isnil(L, -1) ? -1 : luaL_checkinteger(L, -1);
+    lua_pop(L, 3);
+
     /* Create a selection object */
     selection = reinterpret_cast<selection_getter_t*>(selection_getter_class.alloc_object(L));
+    selection->accumulate = accumulate || fd >= 0;
+    selection->max_size = max_size > 0 ? size_t(max_size) : 0;
+    selection->fd = fd;
     selection->window = getConnection().generate_id();
     getConnection().create_window(Manager::get().screen->root_depth,
                                   selection->window,
@@ -85,14 +121,11 @@ static int luaA_selection_getter_new(lua_State* L) {
     lua_pop(L, 1);
 
     /* Get the atoms identifying the request */
-    auto c1 = getConnection().intern_atom_unchecked(false, name_length, name);
-    auto c2 = getConnection().intern_atom_unchecked(false, target_length, target);
-
-    auto reply = getConnection().intern_atom_reply(c1);
-    name_atom = reply ? reply->atom : XCB_NONE;
-
-    reply = getConnection().intern_atom_reply(c2);
-    target_atom = reply ? reply->atom : XCB_NONE;
+    const std::string_view names[] = {{name, name_length}, {target, target_length}};
+    xcb_atom_t atoms[2];
+    atoms_get(getConnection().getConnection(), names, atoms);
+    name_atom = atoms[0];
+    target_atom = atoms[1];
 
     getConnection().convert_selection(selection->window,
                                       name_atom,
@@ -104,6 +137,7 @@ static int luaA_selection_getter_new(lua_State* L) {
 }
 
 static void selection_transfer_finished(lua_State* L, int ud) {
+    ud = Lua::absindex(L, ud);
     selection_getter_t* selection = reinterpret_cast<selection_getter_t*>(lua_touserdata(L, ud));
 
     /* Unreference the selection object; it's dead */
@@ -114,30 +148,77 @@ static void selection_transfer_finished(lua_State* L, int ud) {
 
     selection->ref = LUA_NOREF;
 
-    luaA_object_emit_signal(L, ud, "data_end", 0);
+    const bool to_fd = selection->fd >= 0;
+    if (to_fd) {
+        close(selection->fd);
+        selection->fd = -1;
+    }
+    if (!selection->error.empty()) {
+        lua_pushlstring(L, selection->error.data(), selection->error.size());
+        luaA_object_emit_signal(L, ud, "data_end"_sig, 1);
+        return;
+    }
+    if (selection->accumulate && !to_fd && selection->received > 0) {
+        lua_pushlstring(L, selection->buffer.data(), selection->buffer.size());
+        selection->buffer = {};
+        luaA_object_emit_signal(L, ud, "data"_sig, 1);
+    }
+    luaA_object_emit_signal(L, ud, "data_end"_sig, 0);
+}
+
+/** Keep a piece of data of an accumulating transfer.
+ * \return False if the transfer failed.
+ */
+static bool selection_accumulate(selection_getter_t* selection, const char* data, size_t length) {
+    if (!selection->error.empty()) {
+        return false;
+    }
+    selection->received += length;
+    if (selection->max_size && selection->received > selection->max_size) {
+        selection->error = "selection is larger than max_size";
+        selection->buffer = {};
+        return false;
+    }
+    if (selection->fd < 0) {
+        selection->buffer.append(data, length);
+        return true;
+    }
+    while (length > 0) {
+        const ssize_t written = write(selection->fd, data, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            selection->error = strerror(errno);
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+/** Whether a property is handled by selection_accumulate() */
+static bool selection_accumulates(selection_getter_t* selection,
+                                  xcb_get_property_reply_t* property) {
+    return selection->accumulate && !(property->type == XCB_ATOM_ATOM && property->format == 32);
 }
 
 static void selection_push_data(lua_State* L, xcb_get_property_reply_t* property) {
     if (property->type == XCB_ATOM_ATOM && property->format == 32) {
         namespace views = std::ranges::views;
-        namespace ranges = std::ranges;
 
         size_t num_atoms = xcb_get_property_value_length(property) / 4;
         xcb_atom_t* atoms = (xcb_atom_t*)xcb_get_property_value(property);
-        auto cookies = span_alloca(xcb_get_atom_name_cookie_t, num_atoms);
-
-        ranges::transform(std::span{atoms, num_atoms}, cookies.begin(), [](const auto& atom) {
-            return getConnection().get_atom_name_unchecked(atom);
-        });
+        std::vector<std::optional<std::string_view>> names(num_atoms);
+        atoms_names(getConnection().getConnection(), std::span{atoms, num_atoms}, names);
 
         lua_newtable(L);
-        for (const auto& [cookie, idx] : views::zip(cookies, views::iota(1))) {
-            auto reply = getConnection().get_atom_name_reply(cookie);
-            if (!reply) {
+        for (const auto& [name, idx] : views::zip(names, views::iota(1))) {
+            if (!name) {
                 continue;
             }
-            lua_pushlstring(
-              L, xcb_get_atom_name_name(reply.get()), xcb_get_atom_name_name_length(reply.get()));
+            lua_pushlstring(L, name->data(), name->size());
             lua_rawseti(L, -2, idx);
         }
     } else {
@@ -153,7 +234,8 @@ static void selection_handle_selectionnotify(lua_State* L, int ud, xcb_atom_t pr
     ud = Lua::absindex(L, ud);
     selection = (selection_getter_t*)lua_touserdata(L, ud);
 
-    if (property != XCB_NONE) {
+    if (property == XCB_NONE) {
+        /* The owner refused the conversion */
         selection_transfer_finished(L, ud);
         return;
     }
@@ -173,12 +255,27 @@ static void selection_handle_selectionnotify(lua_State* L, int ud, xcb_atom_t pr
         /* This is an incremental transfer. The above GetProperty had
          * delete=true. This indicates to the other end that the
          * transfer should start now. Right now we only get an estimate
-         * of the size of the data to be transferred, which we ignore.
+         * of the size of the data to be transferred, which is used to
+         * presize the buffer when accumulating.
          */
+        if (selection->accumulate && selection->fd < 0 && property_r->format == 32 &&
+            xcb_get_property_value_length(property_r.get()) >= 4) {
+            size_t hint = *static_cast<uint32_t*>(xcb_get_property_value(property_r.get()));
+            if (selection->max_size) {
+                hint = std::min(hint, selection->max_size);
+            }
+            selection->buffer.reserve(hint);
+        }
         return;
     }
-    selection_push_data(L, property_r.get());
-    luaA_object_emit_signal(L, ud, "data", 1);
+    if (selection_accumulates(selection, property_r.get())) {
+        selection_accumulate(selection,
+                             static_cast<const char*>(xcb_get_property_value(property_r.get())),
+                             xcb_get_property_value_length(property_r.get()));
+    } else {
+        selection_push_data(L, property_r.get());
+        luaA_object_emit_signal(L, ud, "data"_sig, 1);
+    }
     selection_transfer_finished(L, ud);
 }
 
@@ -223,9 +320,14 @@ void property_handle_awesome_selection_atom(uint8_t state, xcb_window_t window)
       true, selection->window, AWESOME_SELECTION_ATOM, XCB_GET_PROPERTY_TYPE_ANY, 0, 0xffffffff));
 
     if (property_r) {
-        if (property_r->value_len > 0) {
+        if (property_r->value_len > 0 && selection_accumulates(selection, property_r.get())) {
+            /* Keep receiving after a failure, the owner only stops at the end */
+            selection_accumulate(selection,
+                                 static_cast<const char*>(xcb_get_property_value(property_r.get())),
+                                 xcb_get_property_value_length(property_r.get()));
+        } else if (property_r->value_len > 0) {
             selection_push_data(L, property_r.get());
-            luaA_object_emit_signal(L, -2, "data", 1);
+            luaA_object_emit_signal(L, -2, "data"_sig, 1);
         } else {
             /* Transfer finished */
             selection_transfer_finished(L, -1);
@@ -29,10 +29,19 @@
 #include "globalconf.h"
 #include "lua.h"
 
+#include <cerrno>
 #include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <glib-unix.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 
 #define REGISTRY_TRANSFER_TABLE_INDEX "awesome_selection_transfers"
 #define TRANSFER_DATA_INDEX "data_for_next_chunk"
+#define TRANSFER_SOURCE_INDEX "chunk_callback"
 
 enum transfer_state {
     TRANSFER_WAIT_FOR_DATA,
@@ -56,6 +65,12 @@ struct selection_transfer_t: public lua_object_t {
     size_t offset;
     /* Can there be more data coming from Lua? */
     bool more_data;
+    /* Is the data coming from a callback in TRANSFER_SOURCE_INDEX? */
+    bool chunk_source;
+    /* File descriptor the data is streamed from, or -1 */
+    int fd;
+    /* Watch waiting for `fd` to become readable */
+    guint watch;
 };
 
 static bool selection_transfer_checker(selection_transfer_t* transfer) {
@@ -109,6 +124,14 @@ void selection_transfer_reject(xcb_window_t requestor,
 
 static void transfer_done(lua_State* L, selection_transfer_t* transfer) {
     transfer->state = TRANSFER_DONE;
+    if (transfer->watch) {
+        g_source_remove(transfer->watch);
+        transfer->watch = 0;
+    }
+    if (transfer->fd >= 0) {
+        close(transfer->fd);
+        transfer->fd = -1;
+    }
 
     lua_pushliteral(L, REGISTRY_TRANSFER_TABLE_INDEX);
     lua_rawget(L, LUA_REGISTRYINDEX);
@@ -117,6 +140,75 @@ static void transfer_done(lua_State* L, selection_transfer_t* transfer) {
     lua_pop(L, 1);
 }
 
+static void transfer_finish_incremental(lua_State* L, selection_transfer_t* transfer) {
+    getConnection().replace_property(
+      transfer->requestor, transfer->property, UTF8_STRING, std::span("", 0));
+    getConnection().clear_attributes(transfer->requestor, XCB_CW_EVENT_MASK);
+    transfer_done(L, transfer);
+}
+
+static void transfer_send_from_fd(lua_State* L, selection_transfer_t* transfer);
+
+static gboolean transfer_fd_readable(gint, GIOCondition, gpointer data) {
+    auto transfer = static_cast<selection_transfer_t*>(data);
+    transfer->watch = 0;
+    transfer_send_from_fd(globalconf_get_lua_State(), transfer);
+    return G_SOURCE_REMOVE;
+}
+
+/** Send the next piece of data from the file descriptor of a transfer. If
+ * nothing can be read yet, this waits for the file descriptor.
+ */
+static void transfer_send_from_fd(lua_State* L, selection_transfer_t* transfer) {
+    static std::vector<char> chunk;
+    chunk.resize(max_property_length());
+
+    ssize_t length;
+    do {
+        length = read(transfer->fd, chunk.data(), chunk.size());
+    } while (length < 0 && errno == EINTR);
+
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        transfer->watch = g_unix_fd_add(
+          transfer->fd, GIOCondition(G_IO_IN | G_IO_HUP | G_IO_ERR), transfer_fd_readable, transfer);
+    } else if (length > 0) {
+        getConnection().replace_property(
+          transfer->requestor, transfer->property, UTF8_STRING, std::span(chunk.data(), length));
+    } else {
+        /* End of file, or an error that ends the transfer early */
+        if (length < 0) {
+            log_warn("Selection transfer stopped reading: {}", strerror(errno));
+        }
+        transfer_finish_incremental(L, transfer);
+    }
+}
+
+/** Get the next piece of data from the chunk callback of a transfer, save it
+ * as the data to send and push it. At the end, this is the empty string.
+ */
+static void transfer_next_chunk(lua_State* L, int ud, selection_transfer_t* transfer) {
+    lua_pushinteger(L, max_property_length());
+    Lua::getuservalue(L, ud);
+    lua_pushliteral(L, TRANSFER_SOURCE_INDEX);
+    lua_rawget(L, -2);
+    lua_remove(L, -2);
+    if (!Lua::dofunction(L, 1, 1)) {
+        lua_pushnil(L);
+    }
+    if (lua_type(L, -1) != LUA_TSTRING || Lua::rawlen(L, -1) == 0) {
+        lua_pop(L, 1);
+        lua_pushliteral(L, "");
+        transfer->chunk_source = false;
+    }
+
+    Lua::getuservalue(L, ud);
+    lua_pushliteral(L, TRANSFER_DATA_INDEX);
+    lua_pushvalue(L, -3);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+    transfer->offset = 0;
+}
+
 static void transfer_continue_incremental(lua_State* L, int ud) {
     const char* data;
     size_t data_length;
@@ -124,6 +216,14 @@ static void transfer_continue_incremental(lua_State* L, int ud) {
 
     ud = Lua::absindex(L, ud);
 
+    if (transfer->fd >= 0) {
+        /* Only read on once the requestor took the previous piece */
+        if (!transfer->watch) {
+            transfer_send_from_fd(L, transfer);
+        }
+        return;
+    }
+
     /* Get the data that is to be sent next */
     Lua::getuservalue(L, ud);
     lua_pushliteral(L, TRANSFER_DATA_INDEX);
@@ -131,11 +231,16 @@ static void transfer_continue_incremental(lua_State* L, int ud) {
     lua_remove(L, -2);
 
     data = luaL_checklstring(L, -1, &data_length);
+    if (transfer->offset == data_length && transfer->chunk_source) {
+        lua_pop(L, 1);
+        transfer_next_chunk(L, ud, transfer);
+        data = luaL_checklstring(L, -1, &data_length);
+    }
     if (transfer->offset == data_length) {
         if (transfer->more_data) {
             /* Request the next piece of data from Lua */
             transfer->state = TRANSFER_INCREMENTAL_DONE;
-            luaA_object_emit_signal(L, ud, "continue", 0);
+            luaA_object_emit_signal(L, ud, "continue"_sig, 0);
             if (transfer->state != TRANSFER_INCREMENTAL_DONE) {
                 /* Lua gave us more data to send. */
                 lua_pop(L, 1);
@@ -143,10 +248,7 @@ static void transfer_continue_incremental(lua_State* L, int ud) {
             }
         }
         /* End of transfer */
-        getConnection().replace_property(
-          transfer->requestor, transfer->property, UTF8_STRING, std::span("", 0));
-        getConnection().clear_attributes(transfer->requestor, XCB_CW_EVENT_MASK);
-        transfer_done(L, transfer);
+        transfer_finish_incremental(L, transfer);
     } else {
         /* Send next piece of data */
         assert(transfer->offset < data_length);
@@ -177,6 +279,9 @@ void selection_transfer_begin(lua_State* L,
     transfer->property = property;
     transfer->time = time;
     transfer->state = TRANSFER_WAIT_FOR_DATA;
+    transfer->chunk_source = false;
+    transfer->fd = -1;
+    transfer->watch = 0;
 
     /* Save the object in the registry */
     lua_pushliteral(L, REGISTRY_TRANSFER_TABLE_INDEX);
@@ -186,18 +291,15 @@ void selection_transfer_begin(lua_State* L,
     lua_pop(L, 1);
 
     /* Get the atom name */
-    auto reply =
-      getConnection().get_atom_name_reply(getConnection().get_atom_name_unchecked(target));
-    if (reply) {
-        lua_pushlstring(
-          L, xcb_get_atom_name_name(reply.get()), xcb_get_atom_name_name_length(reply.get()));
+    if (auto name = atoms_name(getConnection().getConnection(), target)) {
+        lua_pushlstring(L, name->data(), name->size());
     } else {
         lua_pushnil(L);
     }
 
     /* Emit the request signal with target and transfer object */
     lua_pushvalue(L, -2);
-    luaA_object_emit_signal(L, ud, "request", 2);
+    luaA_object_emit_signal(L, ud, "request"_sig, 2);
 
     /* Reject the transfer if Lua did not do anything */
     if (transfer->state == TRANSFER_WAIT_FOR_DATA) {
@@ -209,6 +311,18 @@ void selection_transfer_begin(lua_State* L,
     lua_pop(L, 1);
 }
 
+/** Announce an incremental transfer. The requestor asks for each piece of data
+ * by deleting the property.
+ */
+static void transfer_start_incremental(selection_transfer_t* transfer, uint32_t incr_size) {
+    getConnection().change_attributes(
+      transfer->requestor, XCB_CW_EVENT_MASK, std::array{XCB_EVENT_MASK_PROPERTY_CHANGE});
+    getConnection().replace_property(transfer->requestor, transfer->property, INCR, incr_size);
+
+    transfer->state = TRANSFER_INCREMENTAL_SENDING;
+    transfer->offset = 0;
+}
+
 static int luaA_selection_transfer_send(lua_State* L) {
     size_t data_length;
     bool incr = false;
@@ -268,26 +382,34 @@ static int luaA_selection_transfer_send(lua_State* L) {
         size_t len = Lua::rawlen(L, -1);
 
         /* Get an array with atoms */
-        auto* atom_lengths = p_alloca(size_t, len);
-        auto* atom_strings = p_alloca(const char*, len);
+        std::vector<std::string_view> atom_names(len);
         for (size_t i = 0; i < len; i++) {
+            size_t atom_length;
             lua_rawgeti(L, -1, i + 1);
-            atom_strings[i] = luaL_checklstring(L, -1, &atom_lengths[i]);
+            const char* atom_string = luaL_checklstring(L, -1, &atom_length);
+            atom_names[i] = {atom_string, atom_length};
             lua_pop(L, 1);
         }
 
-        auto* cookies = p_alloca(xcb_intern_atom_cookie_t, len);
         auto* atoms = p_alloca(xcb_atom_t, len);
-        for (size_t i = 0; i < len; i++) {
-            cookies[i] =
-              getConnection().intern_atom_unchecked(false, atom_lengths[i], atom_strings[i]);
-        }
-        for (size_t i = 0; i < len; i++) {
-            auto reply = getConnection().intern_atom_reply(cookies[i]);
-            atoms[i] = reply ? reply->atom : XCB_NONE;
-        }
+        atoms_get(getConnection().getConnection(), atom_names, std::span(atoms, len));
         getConnection().replace_property(
           transfer->requestor, transfer->property, XCB_ATOM_ATOM, std::span(atoms, len));
+    } else if (lua_isfunction(L, -1)) {
+        /* 'data' is a function returning one piece of data after the other */
+        Lua::getuservalue(L, 1);
+        lua_pushliteral(L, TRANSFER_SOURCE_INDEX);
+        lua_pushvalue(L, -3);
+        lua_rawset(L, -3);
+        lua_pushliteral(L, TRANSFER_DATA_INDEX);
+        lua_pushliteral(L, "");
+        lua_rawset(L, -3);
+        lua_pop(L, 1);
+
+        transfer->chunk_source = true;
+        transfer->more_data = false;
+        incr = true;
+        transfer_start_incremental(transfer, incr_size);
     } else {
         /* 'data' is a string with the data to transfer */
         const char* data = luaL_checklstring(L, -1, &data_length);
@@ -301,11 +423,6 @@ static int luaA_selection_transfer_send(lua_State* L) {
         }
 
         if (incr) {
-            getConnection().change_attributes(
-              transfer->requestor, XCB_CW_EVENT_MASK, std::array{XCB_EVENT_MASK_PROPERTY_CHANGE});
-            getConnection().replace_property(
-              transfer->requestor, transfer->property, INCR, incr_size);
-
             /* Save the data on the transfer object */
             Lua::getuservalue(L, 1);
             lua_pushliteral(L, TRANSFER_DATA_INDEX);
@@ -313,8 +430,7 @@ static int luaA_selection_transfer_send(lua_State* L) {
             lua_rawset(L, -3);
             lua_pop(L, 1);
 
-            transfer->state = TRANSFER_INCREMENTAL_SENDING;
-            transfer->offset = 0;
+            transfer_start_incremental(transfer, incr_size);
         } else {
             getConnection().replace_property(
               transfer->requestor, transfer->property, UTF8_STRING, std::span(data, data_length));
@@ -333,6 +449,72 @@ static int luaA_selection_transfer_send(lua_State* L) {
     return 0;
 }
 
+static int luaA_selection_transfer_send_fd(lua_State* L) {
+    auto transfer = selection_transfer_class.checkudata<selection_transfer_t>(L, 1);
+    if (transfer->state != TRANSFER_WAIT_FOR_DATA) {
+        luaL_error(L, "Transfer object is not ready for data to be sent");
+    }
+
+    Lua::checktable(L, 2);
+
+    lua_pushliteral(L, "fd");
+    lua_rawget(L, 2);
+    if (!lua_isnumber(L, -1)) {
+        luaL_error(L, "send_fd needs a file descriptor in 'fd'");
+    }
+    const int fd = lua_tointeger(L, -1);
+    lua_pushliteral(L, "size");
+    lua_rawget(L, 2);
+    uint32_t incr_size = lua_isnumber(L, -1) ? lua_tonumber(L, -1) : 0;
+    lua_pop(L, 2);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        /* The descriptor was handed over, even if it can't be used */
+        const int error = errno;
+        close(fd);
+        luaL_error(L, "send_fd: %s", strerror(error));
+    }
+
+    if (S_ISREG(st.st_mode) && size_t(st.st_size) < max_property_length()) {
+        /* Small enough to go in one piece */
+        std::string data(st.st_size, '\0');
+        size_t done = 0;
+        while (done < data.size()) {
+            const ssize_t n = pread(fd, data.data() + done, data.size() - done, done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        close(fd);
+        getConnection().replace_property(
+          transfer->requestor, transfer->property, UTF8_STRING, std::span(data.data(), done));
+    } else {
+        if (S_ISREG(st.st_mode)) {
+            incr_size = MIN(size_t(st.st_size), UINT32_MAX);
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        transfer->fd = fd;
+        transfer->more_data = false;
+        transfer_start_incremental(transfer, incr_size);
+    }
+
+    selection_transfer_notify(transfer->requestor,
+                              transfer->selection,
+                              transfer->target,
+                              transfer->property,
+                              transfer->time);
+    if (transfer->state == TRANSFER_WAIT_FOR_DATA) {
+        transfer_done(L, transfer);
+    }
+
+    return 0;
+}
+
 void selection_transfer_handle_propertynotify(xcb_property_notify_event_t* ev) {
     lua_State* L = globalconf_get_lua_State();
 
@@ -369,6 +551,7 @@ void selection_transfer_class_setup(lua_State* L) {
 
     static constexpr auto meta = DefineObjectMethods({
       {"send", luaA_selection_transfer_send},
+      {"send_fd", luaA_selection_transfer_send_fd},
     });
 
     /* Store a table in the registry that tracks active selection_transfer_t. */
@@ -21,11 +21,14 @@
 
 #include "objects/selection_watcher.h"
 
+#include "common/atoms.h"
 #include "common/luaclass.h"
 #include "common/luaobject.h"
 #include "globalconf.h"
 #include "lua.h"
 
+#include <utility>
+#include <vector>
 #include <xcb/xfixes.h>
 
 #define REGISTRY_WATCHER_TABLE_INDEX "awesome_selection_watchers"
@@ -50,10 +53,43 @@ static lua_class_t selection_watcher_class{
     Lua::class_newindex_miss_property},
 };
 
+/** Selections watched from C, on the root window */
+static std::vector<std::pair<xcb_atom_t, selection_owner_callback*>> owner_watches;
+
+/** Watch the owner of a selection from C.
+ * The callback is called for every change of the owner, Lua watchers are not
+ * involved.
+ * \param selection The selection to watch.
+ * \param callback The function to call with the new owner.
+ * \return False if the X server cannot report selection changes.
+ */
+bool selection_watch_owner(xcb_atom_t selection, selection_owner_callback* callback) {
+    if (!Manager::get().x.caps.have_xfixes) {
+        return false;
+    }
+    getConnection().xfixes().select_selection_input(
+      Manager::get().screen->root,
+      selection,
+      XCB_XFIXES_SELECTION_EVENT_MASK_SET_SELECTION_OWNER |
+        XCB_XFIXES_SELECTION_EVENT_MASK_SELECTION_WINDOW_DESTROY |
+        XCB_XFIXES_SELECTION_EVENT_MASK_SELECTION_CLIENT_CLOSE);
+    owner_watches.emplace_back(selection, callback);
+    return true;
+}
+
 void event_handle_xfixes_selection_notify(xcb_generic_event_t* ev) {
     auto e = (xcb_xfixes_selection_notify_event_t*)ev;
     lua_State* L = globalconf_get_lua_State();
 
+    if (e->window == Manager::get().screen->root) {
+        for (const auto& [selection, callback] : owner_watches) {
+            if (selection == e->selection) {
+                (*callback)(e->owner);
+            }
+        }
+        return;
+    }
+
     /* Iterate over all active selection watchers */
     lua_pushliteral(L, REGISTRY_WATCHER_TABLE_INDEX);
     lua_rawget(L, LUA_REGISTRYINDEX);
@@ -65,7 +101,7 @@ void event_handle_xfixes_selection_notify(xcb_generic_event_t* ev) {
 
             if (selection->selection == e->selection && selection->window == e->window) {
                 lua_pushboolean(L, e->owner != XCB_NONE);
-                luaA_object_emit_signal(L, -2, "selection_changed", 1);
+                luaA_object_emit_signal(L, -2, "selection_changed"_sig, 1);
             }
         }
         /* Remove the watcher */
@@ -90,10 +126,7 @@ static int luaA_selection_watcher_new(lua_State* L) {
     selection->window = XCB_NONE;
 
     /* Get the atom identifying the selection to watch */
-    if (auto reply = getConnection().intern_atom_reply(
-          getConnection().intern_atom_unchecked(false, name_length, name))) {
-        selection->selection = reply->atom;
-    }
+    selection->selection = atoms_get(getConnection().getConnection(), {name, name_length});
 
     return 1;
 }
@@ -158,7 +191,7 @@ static int luaA_selection_watcher_set_active(lua_State* L, selection_watcher_t*
 
             selection->active_ref = LUA_NOREF;
         }
-        luaA_object_emit_signal(L, -3, "property::active", 0);
+        luaA_object_emit_signal(L, -3, "property::active"_sig, 0);
     }
     return 0;
 }
@@ -24,5 +24,9 @@
 
 #include <xcb/xcb.h>
 
+/** Called with the new owner of a selection watched from C, or XCB_NONE. */
+typedef void selection_owner_callback(xcb_window_t);
+
 void selection_watcher_class_setup(lua_State*);
 void event_handle_xfixes_selection_notify(xcb_generic_event_t*);
+bool selection_watch_owner(xcb_atom_t, selection_owner_callback*);
@@ -202,12 +202,14 @@
 #include "client.h"
 #include "common/luaclass.h"
 #include "common/luaobject.h"
+#include "dbus.h"
 #include "ewmh.h"
 #include "globalconf.h"
 #include "luaa.h"
 #include "screen.h"
 
 #include <algorithm>
+#include <vector>
 
 lua_class_t tag_class{
   "tag",
@@ -313,6 +315,70 @@ lua_class_t tag_class{
  * @staticfct set_newindex_miss_handler
  */
 
+/** Bits released by garbage collected tags */
+static std::vector<size_t> free_tag_bits;
+static size_t next_tag_bit = 0;
+/** The live tags by bit, to find the tags of a client from its tag set */
+static std::vector<tag_t*> tags_by_bit;
+/** Counts the taggings, see tag_slot_t::order */
+static uint64_t tagging_count = 0;
+
+tag_t::tag_t() {
+    if (free_tag_bits.empty()) {
+        bit = next_tag_bit++;
+    } else {
+        bit = free_tag_bits.back();
+        free_tag_bits.pop_back();
+    }
+    if (bit >= tags_by_bit.size()) {
+        tags_by_bit.resize(bit + 1);
+    }
+    tags_by_bit[bit] = this;
+}
+
+tag_t::~tag_t() {
+    Manager::get().selected_tags.reset(bit);
+    tags_by_bit[bit] = nullptr;
+    free_tag_bits.push_back(bit);
+}
+
+/** Add a client to the clients of a tag and the tag to its tag set.
+ * \param t The tag.
+ * \param c The client, not tagged with t.
+ */
+static void tag_clients_add(tag_t* t, client* c) {
+    if (t->bit >= c->tag_slots.size()) {
+        c->tag_slots.resize(t->bit + 1);
+    }
+    c->tag_slots[t->bit] = {t->clients.size(), tagging_count++};
+    t->clients.push_back(c);
+    c->tags.set(t->bit);
+    client_hot_sync(c);
+}
+
+/** Remove a client from the clients of a tag, moving the last client into its
+ * slot, and the tag from its tag set.
+ * \param t The tag.
+ * \param c The client, tagged with t.
+ */
+static void tag_clients_remove(tag_t* t, client* c) {
+    const size_t index = c->tag_slots[t->bit].index;
+    client* last = t->clients.back();
+    t->clients[index] = last;
+    last->tag_slots[t->bit].index = index;
+    t->clients.pop_back();
+    c->tags.reset(t->bit);
+    client_hot_sync(c);
+}
+
+/** Update the manager's selected tags set after a tag was (un)selected or
+ * (de)activated.
+ * \param tag The tag.
+ */
+static void tag_update_selected_tags(tag_t* tag) {
+    Manager::get().selected_tags.assign(tag->bit, tag->selected && tag->activated);
+}
+
 void tag_unref_simplified(tag_t* tag) {
     lua_State* L = globalconf_get_lua_State();
     luaA_object_unref(L, tag);
@@ -327,28 +393,34 @@ static void tag_view(lua_State* L, int udx, bool view) {
     auto tag = tag_class.checkudata<tag_t>(L, udx);
     if (tag->selected != view) {
         tag->selected = view;
-        banning_need_update();
+        tag_update_selected_tags(tag);
+        banning_need_update(tag);
         for (auto* screen : Manager::get().screens) {
             screen_update_workarea(screen);
         }
 
-        luaA_object_emit_signal(L, udx, "property::selected", 0);
+        a_dbus_introspect_changed(DBUS_CHANGE_TAGS);
+        luaA_object_emit_signal(L, udx, "property::selected"_sig, 0);
     }
 }
 
-static void tag_client_emit_signal(tag_t* t, client* c, const char* signame) {
+static void tag_client_emit_signal(tag_t* t, client* c, SignalId signame) {
     lua_State* L = globalconf_get_lua_State();
     luaA_object_push(L, c);
-    luaA_object_push(L, t);
     /* emit signal on client, with new tag as argument */
-    luaA_object_emit_signal(L, -2, signame, 1);
-    /* re push tag */
+    if (luaA_object_has_listeners(L, -1, signame)) {
+        luaA_object_push(L, t);
+        luaA_object_emit_signal(L, -2, signame, 1);
+    }
+    /* push tag */
     luaA_object_push(L, t);
-    /* move tag before client */
-    lua_insert(L, -2);
-    luaA_object_emit_signal(L, -2, signame, 1);
-    /* Remove tag */
-    lua_pop(L, 1);
+    /* emit signal on tag, with the client as argument */
+    if (luaA_object_has_listeners(L, -1, signame)) {
+        lua_pushvalue(L, -2);
+        luaA_object_emit_signal(L, -2, signame, 1);
+    }
+    /* Remove tag and client */
+    lua_pop(L, 2);
 }
 
 /** Tag a client with the tag on top of the stack.
@@ -364,12 +436,13 @@ void tag_client(lua_State* L, client* c) {
         return;
     }
 
-    t->clients.push_back(c);
+    tag_clients_add(t, c);
     ewmh_client_update_desktop(c);
-    banning_need_update();
+    banning_need_update(c);
     screen_update_workarea(c->screen);
+    a_dbus_introspect_changed(DBUS_CHANGE_CLIENTS | DBUS_CHANGE_TAGS);
 
-    tag_client_emit_signal(t, c, "tagged");
+    tag_client_emit_signal(t, c, "tagged"_sig);
 }
 
 /** Untag a client with specified tag.
@@ -377,18 +450,84 @@ void tag_client(lua_State* L, client* c) {
  * \param t the tag to tag the client with
  */
 void untag_client(client* c, tag_t* t) {
-    for (size_t i = 0; i < t->clients.size(); i++) {
-        if (t->clients[i] == c) {
-            lua_State* L = globalconf_get_lua_State();
-            t->clients.erase(t->clients.begin() + i);
-            banning_need_update();
-            ewmh_client_update_desktop(c);
-            screen_update_workarea(c->screen);
-            tag_client_emit_signal(t, c, "untagged");
-            luaA_object_unref(L, t);
-            return;
+    if (!is_client_tagged(c, t)) {
+        return;
+    }
+    lua_State* L = globalconf_get_lua_State();
+    tag_clients_remove(t, c);
+    banning_need_update(c);
+    ewmh_client_update_desktop(c);
+    screen_update_workarea(c->screen);
+    a_dbus_introspect_changed(DBUS_CHANGE_CLIENTS | DBUS_CHANGE_TAGS);
+    tag_client_emit_signal(t, c, "untagged"_sig);
+    luaA_object_unref(L, t);
+}
+
+/** Untag a client from all its tags.
+ * \param c The client.
+ */
+void untag_client_all(client* c) {
+    /* The untagged handlers may tag it again */
+    while (const auto bit = c->tags.first()) {
+        untag_client(c, tags_by_bit[*bit]);
+    }
+}
+
+/** Change the tags of clients in one pass.
+ * All memberships are changed first. Then the desktop and banning of each
+ * affected client and the work area of each affected screen are updated once,
+ * and the signals are emitted last, in the order of the changes. Changes that
+ * would not change anything are skipped.
+ * \param L The Lua VM state.
+ * \param changes The changes to apply.
+ * \return The clients whose tags changed.
+ */
+Scratch::vector<client*> tag_apply_changes(lua_State* L, std::span<const tag_change_t> changes) {
+    Scratch::vector<tag_change_t> applied;
+    Scratch::vector<client*> clients;
+    Scratch::unordered_set<client*> seen_clients;
+    Scratch::vector<screen_t*> screens;
+
+    for (const auto& change : changes) {
+        if (change.tagged == is_client_tagged(change.c, change.t)) {
+            continue;
+        }
+        if (change.tagged) {
+            /* The client references the tag */
+            luaA_object_push(L, change.t);
+            luaA_object_ref(L, -1);
+            tag_clients_add(change.t, change.c);
+        } else {
+            tag_clients_remove(change.t, change.c);
+        }
+        applied.push_back(change);
+        if (seen_clients.insert(change.c).second) {
+            clients.push_back(change.c);
+            if (std::ranges::find(screens, change.c->screen) == screens.end()) {
+                screens.push_back(change.c->screen);
+            }
         }
     }
+
+    for (auto* c : clients) {
+        ewmh_client_update_desktop(c);
+        banning_need_update(c);
+    }
+    for (auto* screen : screens) {
+        screen_update_workarea(screen);
+    }
+    if (!applied.empty()) {
+        a_dbus_introspect_changed(DBUS_CHANGE_CLIENTS | DBUS_CHANGE_TAGS);
+    }
+
+    for (const auto& change : applied) {
+        tag_client_emit_signal(change.t, change.c, change.tagged ? "tagged"_sig : "untagged"_sig);
+        if (!change.tagged) {
+            luaA_object_unref(L, change.t);
+        }
+    }
+
+    return clients;
 }
 
 /** Check if a client is tagged with the specified tag.
@@ -396,15 +535,7 @@ void untag_client(client* c, tag_t* t) {
  * \param t the tag
  * \return true if the client is tagged with the tag, false otherwise.
  */
-bool is_client_tagged(client* c, tag_t* t) {
-    for (size_t i = 0; i < t->clients.size(); i++) {
-        if (t->clients[i] == c) {
-            return true;
-        }
-    }
-
-    return false;
-}
+bool is_client_tagged(client* c, tag_t* t) { return c->tags.test(t->bit); }
 
 /** Get the index of the tag with focused client or first selected
  * \return Its index
@@ -453,43 +584,32 @@ static int luaA_tag_clients(lua_State* L) {
 
     if (lua_gettop(L) == 2) {
         Lua::checktable(L, 2);
-        for (size_t j = 0; j < clients.size(); j++) {
-            client* c = clients[j];
-
-            /* Only untag if we aren't going to add this tag again */
-            bool found = false;
-            lua_pushnil(L);
-            while (lua_next(L, 2)) {
-                auto tc = client_class.checkudata<client>(L, -1);
-                /* Pop the value from lua_next */
-                lua_pop(L, 1);
-                if (tc != c) {
-                    continue;
-                }
-
-                /* Pop the key from lua_next */
-                lua_pop(L, 1);
-                found = true;
-                break;
-            }
-            if (!found) {
-                untag_client(c, tag);
-                j--;
-            }
-        }
+        Scratch::vector<client*> wanted;
         lua_pushnil(L);
         while (lua_next(L, 2)) {
-            auto c = client_class.checkudata<client>(L, -1);
-            /* push tag on top of the stack */
-            lua_pushvalue(L, 1);
-            tag_client(L, c);
+            wanted.push_back(client_class.checkudata<client>(L, -1));
             lua_pop(L, 1);
         }
+
+        /* Only untag if we aren't going to add this tag again */
+        const Scratch::unordered_set<client*> keep(wanted.begin(), wanted.end());
+        Scratch::vector<tag_change_t> changes;
+        for (auto* c : clients) {
+            if (!keep.contains(c)) {
+                changes.push_back({c, tag, false});
+            }
+        }
+        for (auto* c : wanted) {
+            changes.push_back({c, tag, true});
+        }
+        tag_apply_changes(L, changes);
     }
 
-    lua_createtable(L, clients.size(), 0);
-    for (i = 0; i < clients.size(); i++) {
-        luaA_object_push(L, clients[i]);
+    Scratch::vector<client*> sorted(clients.begin(), clients.end());
+    std::ranges::sort(sorted, {}, [tag](client* c) { return c->tag_slots[tag->bit].order; });
+    lua_createtable(L, sorted.size(), 0);
+    for (i = 0; i < sorted.size(); i++) {
+        luaA_object_push(L, sorted[i]);
         lua_rawseti(L, -2, i + 1);
     }
 
@@ -504,8 +624,9 @@ static int luaA_tag_clients(lua_State* L) {
 static int luaA_tag_set_name(lua_State* L, lua_object_t* tag) {
     const char* buf = luaL_checkstring(L, -1);
     static_cast<tag_t*>(tag)->name = buf ? buf : "";
-    luaA_object_emit_signal(L, -3, "property::name", 0);
+    luaA_object_emit_signal(L, -3, "property::name"_sig, 0);
     ewmh_update_net_desktop_names();
+    a_dbus_introspect_changed(DBUS_CHANGE_CLIENTS | DBUS_CHANGE_TAGS);
     return 0;
 }
 
@@ -532,6 +653,7 @@ static int luaA_tag_set_activated(lua_State* L, lua_object_t* o) {
     }
 
     tag->activated = activated;
+    tag_update_selected_tags(tag);
     if (activated) {
         lua_pushvalue(L, -3);
         Manager::get().tags.emplace_back((tag_t*)luaA_object_ref_class(L, -1, &tag_class));
@@ -546,19 +668,48 @@ static int luaA_tag_set_activated(lua_State* L, lua_object_t* o) {
 
         if (tag->selected) {
             tag->selected = false;
-            luaA_object_emit_signal(L, -3, "property::selected", 0);
-            banning_need_update();
+            tag_update_selected_tags(tag);
+            luaA_object_emit_signal(L, -3, "property::selected"_sig, 0);
+            banning_need_update(tag);
         }
         luaA_object_unref(L, tag);
     }
     ewmh_update_net_numbers_of_desktop();
     ewmh_update_net_desktop_names();
+    a_dbus_introspect_changed(DBUS_CHANGE_CLIENTS | DBUS_CHANGE_TAGS);
 
-    luaA_object_emit_signal(L, -3, "property::activated", 0);
+    luaA_object_emit_signal(L, -3, "property::activated"_sig, 0);
 
     return 0;
 }
 
+/** Remove all the clients from the tags and deactivate them, see
+ * awesome.reload.
+ * \param L The Lua VM state.
+ */
+void tag_deactivate_all(lua_State* L) {
+    std::vector<tag_change_t> changes;
+    for (const auto& tag : Manager::get().tags) {
+        for (auto* c : tag->clients) {
+            changes.push_back({c, tag.get(), false});
+        }
+    }
+    tag_apply_changes(L, changes);
+
+    std::vector<tag_t*> tags;
+    for (const auto& tag : Manager::get().tags) {
+        tags.push_back(tag.get());
+    }
+    /* In the stack layout of a property setter */
+    for (auto* tag : tags) {
+        luaA_object_push(L, tag);
+        lua_pushnil(L);
+        lua_pushboolean(L, false);
+        luaA_tag_set_activated(L, tag);
+        lua_pop(L, 3);
+    }
+}
+
 void tag_class_setup(lua_State* L) {
 
     static constexpr auto methods = DefineClassMethods<&tag_class>({
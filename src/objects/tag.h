@@ -23,25 +23,42 @@
 
 #include "client.h"
 #include "common/luaclass.h"
+#include "scratch.h"
 
 #include <algorithm>
 #include <memory>
+#include <span>
+#include <vector>
+
+/** Adding a client to a tag or removing it, see tag_apply_changes() */
+struct tag_change_t {
+    client* c;
+    tag_t* t;
+    bool tagged;
+};
 
 int tags_get_current_or_first_selected_index(void);
 void tag_client(lua_State*, client*);
 void untag_client(client*, tag_t*);
+void untag_client_all(client*);
+Scratch::vector<client*> tag_apply_changes(lua_State*, std::span<const tag_change_t>);
 bool is_client_tagged(client*, tag_t*);
 void tag_unref_simplified(tag_t*);
+void tag_deactivate_all(lua_State*);
 
 /** Tag type */
 struct tag_t: lua_object_t {
+    tag_t();
+    ~tag_t();
+    /** Index of this tag in client tag sets */
+    size_t bit;
     /** Tag name */
     std::string name;
     /** true if activated */
-    bool activated;
+    bool activated = false;
     /** true if selected */
-    bool selected;
-    /** clients in this tag */
+    bool selected = false;
+    /** clients in this tag, in no particular order, see client::tag_slots */
     std::vector<client*> clients;
 };
 
@@ -59,6 +59,8 @@
 #include "common/xutil.h"
 #include "ewmh.h"
 #include "globalconf.h"
+#include "objects/client.h"
+#include "objects/drawin.h"
 #include "objects/screen.h"
 #include "property.h"
 #include "xwindow.h"
@@ -96,7 +98,7 @@ static int luaA_window_buttons(lua_State* L) {
 
     if (lua_gettop(L) == 2) {
         luaA_button_array_set(L, 1, 2, &window->buttons);
-        luaA_object_emit_signal(L, 1, "property::buttons", 0);
+        luaA_object_emit_signal(L, 1, "property::buttons"_sig, 0);
         xwindow_buttons_grab(window->window, window->buttons);
     }
 
@@ -112,8 +114,13 @@ static int luaA_window_struts(lua_State* L) {
 
     if (lua_gettop(L) == 2) {
         luaA_tostrut(L, 2, &window->strut);
+        if (auto c = client_class.toudata<client>(L, 1)) {
+            screen_strut_track(c);
+        } else if (auto drawin = drawin_class.toudata<drawin_t>(L, 1)) {
+            screen_strut_track(drawin);
+        }
         ewmh_update_strut(window->window, &window->strut);
-        luaA_object_emit_signal(L, 1, "property::struts", 0);
+        luaA_object_emit_signal(L, 1, "property::struts"_sig, 0);
         /* We don't know the correct screen, update them all */
         for (auto* s : Manager::get().screens) {
             screen_update_workarea(s);
@@ -134,7 +141,7 @@ void window_set_opacity(lua_State* L, int idx, double opacity) {
     if (window->opacity != opacity) {
         window->opacity = opacity;
         xwindow_set_opacity(window_get(window), opacity);
-        luaA_object_emit_signal(L, idx, "property::opacity", 0);
+        luaA_object_emit_signal(L, idx, "property::opacity"_sig, 0);
     }
 }
 
@@ -171,6 +178,16 @@ static int luaA_window_get_opacity(lua_State* L, lua_object_t* o) {
     return 1;
 }
 
+/** Mark the window border as needing a refresh.
+ * \param window The window.
+ */
+static void window_border_need_update(window_t* window) {
+    window->border_need_update = true;
+    if (window->border_need_update_callback) {
+        (*window->border_need_update_callback)(window);
+    }
+}
+
 void window_border_refresh(window_t* window) {
     if (!window->border_need_update) {
         return;
@@ -195,8 +212,8 @@ static int luaA_window_set_border_color(lua_State* L, lua_object_t* o) {
 
     if (color_name && color_init_reply(color_init_unchecked(
                         &window->border_color, color_name, len, Manager::get().visual))) {
-        window->border_need_update = true;
-        luaA_object_emit_signal(L, -3, "property::border_color", 0);
+        window_border_need_update(window);
+        luaA_object_emit_signal(L, -3, "property::border_color"_sig, 0);
     }
 
     return 0;
@@ -215,14 +232,14 @@ void window_set_border_width(lua_State* L, int idx, int width) {
         return;
     }
 
-    window->border_need_update = true;
     window->border_width = width;
+    window_border_need_update(window);
 
     if (window->border_width_callback) {
         (*window->border_width_callback)(window, old_width, width);
     }
 
-    luaA_object_emit_signal(L, idx, "property::border_width", 0);
+    luaA_object_emit_signal(L, idx, "property::border_width"_sig, 0);
 }
 
 /** Push window type to stack.
@@ -300,7 +317,7 @@ int luaA_window_set_type(lua_State* L, window_t* w) {
         if (w->window != XCB_WINDOW_NONE) {
             ewmh_update_window_type(w->window, window_translate_type(w->type));
         }
-        luaA_object_emit_signal(L, -3, "property::type", 0);
+        luaA_object_emit_signal(L, -3, "property::type"_sig, 0);
     }
 
     return 0;
@@ -70,6 +70,8 @@ struct window_t: lua_object_t {
     window_type_t type;
     /** The border width callback */
     void (*border_width_callback)(void*, uint16_t old, uint16_t new_width);
+    /** Called when the border needs to be refreshed */
+    void (*border_need_update_callback)(void*);
 };
 
 void window_class_setup(lua_State*);
@@ -340,7 +340,13 @@ static void __attribute__((noreturn)) exit_help(int exit_code) {
   -a, --no-argb          disable client transparency support\n\
   -l  --api-level LEVEL  select a different API support level than the current version \n\
   -m, --screen on|off    enable or disable automatic screen creation (default: on)\n\
-  -r, --replace          replace an existing window manager\n");
+  -r, --replace          replace an existing window manager\n\
+      --trace FILE       write a trace of the main loop to FILE\n\
+      --startup-report   print how long each startup phase took\n\
+      --loop glib|uv     select the main loop backend (default: glib)\n\
+      --lua-alloc pool|system  select the Lua allocator (default: system)\n\
+      --record-events FILE  record the X events to FILE\n\
+      --replay-events FILE  handle the X events recorded in FILE, report and exit\n");
     exit(exit_code);
 }
 
@@ -350,18 +356,24 @@ static void __attribute__((noreturn)) exit_help(int exit_code) {
 ConfigResult options_check_args(int argc, char** argv, int* init_flags) {
 
     static struct option long_options[] = {
-      {     "help", NO_ARG, NULL,  'h'},
-      {  "version", NO_ARG, NULL,  'v'},
-      {   "config",    ARG, NULL,  'c'},
-      {    "force", NO_ARG, NULL,  'f'},
-      {    "check", NO_ARG, NULL,  'k'},
-      {   "search",    ARG, NULL,  's'},
-      {  "no-argb", NO_ARG, NULL,  'a'},
-      {  "replace", NO_ARG, NULL,  'r'},
-      {   "screen",    ARG, NULL,  'm'},
-      {"api-level",    ARG, NULL,  'l'},
-      {     "reap",    ARG, NULL, '\1'},
-      {       NULL, NO_ARG, NULL,    0}
+      {          "help", NO_ARG, NULL,  'h'},
+      {       "version", NO_ARG, NULL,  'v'},
+      {        "config",    ARG, NULL,  'c'},
+      {         "force", NO_ARG, NULL,  'f'},
+      {         "check", NO_ARG, NULL,  'k'},
+      {        "search",    ARG, NULL,  's'},
+      {       "no-argb", NO_ARG, NULL,  'a'},
+      {       "replace", NO_ARG, NULL,  'r'},
+      {        "screen",    ARG, NULL,  'm'},
+      {     "api-level",    ARG, NULL,  'l'},
+      {          "reap",    ARG, NULL, '\1'},
+      {         "trace",    ARG, NULL, '\2'},
+      {"startup-report", NO_ARG, NULL, '\3'},
+      {          "loop",    ARG, NULL, '\4'},
+      { "record-events",    ARG, NULL, '\5'},
+      { "replay-events",    ARG, NULL, '\6'},
+      {     "lua-alloc",    ARG, NULL, '\7'},
+      {            NULL, NO_ARG, NULL,    0}
     };
 
     ConfigResult ret;
@@ -408,6 +420,22 @@ ConfigResult options_check_args(int argc, char** argv, int* init_flags) {
         case '\1':
             /* Silently ignore --reap and its argument */
             break;
+        case '\2': ret.tracePath = optarg; break;
+        case '\3': ret.startup_report = true; break;
+        case '\4':
+            if ("glib"sv != optarg && "uv"sv != optarg) {
+                log_fatal("The possible values of --loop are \"glib\" or \"uv\"");
+            }
+            ret.uv_loop = ("uv"sv == optarg);
+            break;
+        case '\5': ret.recordPath = optarg; break;
+        case '\6': ret.replayPath = optarg; break;
+        case '\7':
+            if ("pool"sv != optarg && "system"sv != optarg) {
+                log_fatal("The possible values of --lua-alloc are \"pool\" or \"system\"");
+            }
+            ret.lua_pool_alloc = ("pool"sv == optarg);
+            break;
         default:
             if (!((*init_flags) & INIT_FLAG_ALLOW_FALLBACK)) {
                 exit_help(EXIT_FAILURE);
@@ -47,6 +47,14 @@ struct ConfigResult {
     bool have_searchpaths;
     bool had_overriden_depth;
     std::optional<bool> no_auto_screen;
+    std::optional<std::filesystem::path> tracePath;
+    std::optional<std::filesystem::path> recordPath;
+    std::optional<std::filesystem::path> replayPath;
+    bool startup_report = false;
+    /** Run the main loop on libuv instead of only GLib */
+    bool uv_loop = false;
+    /** Give the Lua state the pool allocator, see luaalloc.h */
+    bool lua_pool_alloc = false;
 
     Paths searchPaths;
 };
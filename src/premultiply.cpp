@@ -0,0 +1,227 @@
+/*
+ * premultiply.cpp - alpha premultiplication kernels
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "premultiply.h"
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define PREMULTIPLY_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define PREMULTIPLY_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+namespace Premultiply {
+
+static inline uint32_t pixel(uint8_t a, uint8_t r, uint8_t g, uint8_t b) {
+    return (uint32_t(a) << 24) | (uint32_t(mul_un8(r, a)) << 16) | (uint32_t(mul_un8(g, a)) << 8) |
+           mul_un8(b, a);
+}
+
+void argb_scalar(uint32_t* dst, const uint32_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        const uint32_t p = src[i];
+        dst[i] = pixel(p >> 24, p >> 16, p >> 8, p);
+    }
+}
+
+void rgba_scalar(uint32_t* dst, const uint8_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++, src += 4) {
+        dst[i] = pixel(src[3], src[0], src[1], src[2]);
+    }
+}
+
+namespace {
+
+/* The vector kernels work on pixels laid out in memory as cairo's ARGB32 on a
+ * little endian machine: B, G, R, A bytes. Channels are widened to 16 bits and
+ * multiplied by the alpha of their pixel, except alpha itself which is
+ * multiplied by 255 to stay unchanged. */
+
+#ifdef PREMULTIPLY_X86
+
+/** Premultiply two pixels widened to 16 bits lanes */
+inline __m128i sse2_premultiply(__m128i px) {
+    __m128i alpha = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_or_si128(_mm_and_si128(alpha, _mm_set1_epi64x(0x0000ffffffffffff)),
+                         _mm_set1_epi64x(0x00ff000000000000));
+    const __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, alpha), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+/** Turn R, G, B, A 16 bits lanes into B, G, R, A */
+inline __m128i sse2_swap_rb(__m128i px) {
+    px = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 0, 1, 2));
+    return _mm_shufflehi_epi16(px, _MM_SHUFFLE(3, 0, 1, 2));
+}
+
+template <bool swap_rb>
+inline __m128i sse2_premultiply4(__m128i px) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(px, zero);
+    __m128i hi = _mm_unpackhi_epi8(px, zero);
+    if constexpr (swap_rb) {
+        lo = sse2_swap_rb(lo);
+        hi = sse2_swap_rb(hi);
+    }
+    return _mm_packus_epi16(sse2_premultiply(lo), sse2_premultiply(hi));
+}
+
+void argb_sse2(uint32_t* dst, const uint32_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), sse2_premultiply4<false>(px));
+    }
+    argb_scalar(dst + i, src + i, n - i);
+}
+
+void rgba_sse2(uint32_t* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), sse2_premultiply4<true>(px));
+    }
+    rgba_scalar(dst + i, src + 4 * i, n - i);
+}
+
+/* The AVX2 versions are the same on 8 pixels, every instruction used here
+ * works within 128 bits lanes */
+
+__attribute__((target("avx2"))) inline __m256i avx2_premultiply(__m256i px) {
+    __m256i alpha = _mm256_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_or_si256(_mm256_and_si256(alpha, _mm256_set1_epi64x(0x0000ffffffffffff)),
+                            _mm256_set1_epi64x(0x00ff000000000000));
+    const __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(px, alpha), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_swap_rb(__m256i px) {
+    px = _mm256_shufflelo_epi16(px, _MM_SHUFFLE(3, 0, 1, 2));
+    return _mm256_shufflehi_epi16(px, _MM_SHUFFLE(3, 0, 1, 2));
+}
+
+template <bool swap_rb>
+__attribute__((target("avx2"))) inline __m256i avx2_premultiply8(__m256i px) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_unpacklo_epi8(px, zero);
+    __m256i hi = _mm256_unpackhi_epi8(px, zero);
+    if constexpr (swap_rb) {
+        lo = avx2_swap_rb(lo);
+        hi = avx2_swap_rb(hi);
+    }
+    return _mm256_packus_epi16(avx2_premultiply(lo), avx2_premultiply(hi));
+}
+
+__attribute__((target("avx2"))) void argb_avx2(uint32_t* dst, const uint32_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), avx2_premultiply8<false>(px));
+    }
+    argb_sse2(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) void rgba_avx2(uint32_t* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 4 * i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), avx2_premultiply8<true>(px));
+    }
+    rgba_sse2(dst + i, src + 4 * i, n - i);
+}
+
+#endif
+
+#ifdef PREMULTIPLY_NEON
+
+/** Same rounding as mul_un8(), on 8 channels */
+inline uint8x8_t neon_mul_un8(uint8x8_t x, uint8x8_t a) {
+    const uint16x8_t t = vmull_u8(x, a);
+    return vraddhn_u16(t, vrshrq_n_u16(t, 8));
+}
+
+void argb_neon(uint32_t* dst, const uint32_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        /* B, G, R, A */
+        uint8x8x4_t px = vld4_u8(reinterpret_cast<const uint8_t*>(src + i));
+        px.val[0] = neon_mul_un8(px.val[0], px.val[3]);
+        px.val[1] = neon_mul_un8(px.val[1], px.val[3]);
+        px.val[2] = neon_mul_un8(px.val[2], px.val[3]);
+        vst4_u8(reinterpret_cast<uint8_t*>(dst + i), px);
+    }
+    argb_scalar(dst + i, src + i, n - i);
+}
+
+void rgba_neon(uint32_t* dst, const uint8_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        /* R, G, B, A */
+        const uint8x8x4_t px = vld4_u8(src + 4 * i);
+        uint8x8x4_t out;
+        out.val[0] = neon_mul_un8(px.val[2], px.val[3]);
+        out.val[1] = neon_mul_un8(px.val[1], px.val[3]);
+        out.val[2] = neon_mul_un8(px.val[0], px.val[3]);
+        out.val[3] = px.val[3];
+        vst4_u8(reinterpret_cast<uint8_t*>(dst + i), out);
+    }
+    rgba_scalar(dst + i, src + 4 * i, n - i);
+}
+
+#endif
+
+struct kernels {
+    std::string_view name;
+    void (*argb)(uint32_t*, const uint32_t*, size_t);
+    void (*rgba)(uint32_t*, const uint8_t*, size_t);
+};
+
+/** Pick the best kernels supported by the CPU we run on */
+const kernels& selected() {
+    static const kernels k = [] {
+#if defined(PREMULTIPLY_X86)
+        if (__builtin_cpu_supports("avx2")) {
+            return kernels{"avx2", argb_avx2, rgba_avx2};
+        }
+        return kernels{"sse2", argb_sse2, rgba_sse2};
+#elif defined(PREMULTIPLY_NEON)
+        return kernels{"neon", argb_neon, rgba_neon};
+#else
+        return kernels{"scalar", argb_scalar, rgba_scalar};
+#endif
+    }();
+    return k;
+}
+
+} // namespace
+
+void argb(uint32_t* dst, const uint32_t* src, size_t n) { selected().argb(dst, src, n); }
+
+void rgba(uint32_t* dst, const uint8_t* src, size_t n) { selected().rgba(dst, src, n); }
+
+std::string_view implementation() { return selected().name; }
+
+} // namespace Premultiply
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
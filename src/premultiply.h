@@ -0,0 +1,56 @@
+/*
+ * premultiply.h - alpha premultiplication kernels header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Premultiply {
+
+/** Multiply a channel by an alpha value, rounding exactly like x * a / 255. */
+static inline uint8_t mul_un8(uint8_t x, uint8_t a) {
+    const unsigned t = unsigned(x) * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+/** Premultiply pixels in native endian ARGB (as in _NET_WM_ICON).
+ * \param dst The premultiplied pixels, in cairo's ARGB32 format.
+ * \param src The pixels.
+ * \param n The number of pixels.
+ */
+void argb(uint32_t* dst, const uint32_t* src, size_t n);
+
+/** Premultiply pixels stored as R, G, B, A bytes (as in a GdkPixbuf).
+ * \param dst The premultiplied pixels, in cairo's ARGB32 format.
+ * \param src The pixels.
+ * \param n The number of pixels.
+ */
+void rgba(uint32_t* dst, const uint8_t* src, size_t n);
+
+/** The scalar versions, which the others have to match exactly. */
+void argb_scalar(uint32_t* dst, const uint32_t* src, size_t n);
+void rgba_scalar(uint32_t* dst, const uint8_t* src, size_t n);
+
+/** The name of the kernels picked for this CPU. */
+std::string_view implementation();
+
+} // namespace Premultiply
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
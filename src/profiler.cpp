@@ -0,0 +1,604 @@
+/*
+ * profiler.cpp - main loop profiler
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "profiler.h"
+
+#include "common/atoms.h"
+#include "common/util.h"
+#include "globalconf.h"
+#include "objects/key.h"
+#include "scratch.h"
+#include "trace.h"
+#include "xcbcpp/xcb.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+#include <xcb/res.h>
+
+namespace Profiler {
+
+static std::array<PhaseStats, size_t(Phase::Count)> phase_stats;
+
+static constexpr std::array<std::string_view, size_t(Phase::Count)> phase_names = {
+  "refresh",
+  "drawin",
+  "client",
+  "banning",
+  "stack",
+  "ewmh",
+  "destroy_later",
+  "damage",
+  "flush",
+  "events",
+  "poll",
+  "iteration",
+  "scan",
+  "gc",
+};
+
+void PhaseStats::record(uint64_t ns) {
+    const uint32_t sample = uint32_t(std::min<uint64_t>(ns, std::numeric_limits<uint32_t>::max()));
+    samples[next] = sample;
+    next = (next + 1) % window;
+    count++;
+    total_ns += ns;
+    max_ns = std::max(max_ns, sample);
+}
+
+uint32_t PhaseStats::percentile(double p) const {
+    const size_t filled = std::min<uint64_t>(count, window);
+    if (filled == 0) {
+        return 0;
+    }
+
+    std::array<uint32_t, window> sorted;
+    std::copy_n(samples.begin(), filled, sorted.begin());
+    const size_t idx = std::min(filled - 1, size_t(p * filled));
+    std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.begin() + filled);
+    return sorted[idx];
+}
+
+void record(Phase phase, Clock::duration elapsed) {
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    phase_stats[size_t(phase)].record(ns > 0 ? uint64_t(ns) : 0);
+    if (Trace::enabled) {
+        const char* name = phase_names[size_t(phase)].data();
+        Trace::record(Trace::Category::Loop, Clock::now() - elapsed, elapsed, name, 0);
+    }
+}
+
+const PhaseStats& stats(Phase phase) { return phase_stats[size_t(phase)]; }
+
+std::string_view name(Phase phase) { return phase_names[size_t(phase)]; }
+
+void reset() { phase_stats = {}; }
+
+/** Push a table with the count, total, p50, p99 and max of some statistics */
+static void push_stats(lua_State* L, const PhaseStats& s) {
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, s.count);
+    lua_setfield(L, -2, "count");
+    lua_pushnumber(L, s.total_ns / 1e9);
+    lua_setfield(L, -2, "total");
+    lua_pushnumber(L, s.percentile(0.5) / 1e9);
+    lua_setfield(L, -2, "p50");
+    lua_pushnumber(L, s.percentile(0.99) / 1e9);
+    lua_setfield(L, -2, "p99");
+    lua_pushnumber(L, s.max_ns / 1e9);
+    lua_setfield(L, -2, "max");
+}
+
+/** Get timing statistics of the main loop.
+ *
+ * The returned table is indexed by phase name (`refresh`, `drawin`, `client`,
+ * `banning`, `stack`, `ewmh`, `destroy_later`, `damage`, `flush`, `events`, `poll`
+ * and `iteration`). Each entry is a table with the `count` of samples, the `total`
+ * time spent, and the `p50`, `p99` and `max` durations. Percentiles cover the
+ * last 512 samples. All times are in seconds.
+ *
+ * The `scan` entry holds the time it took to manage the windows that already
+ * existed at startup, e.g. after a restart.
+ *
+ * The `gc` entry holds the Lua garbage collector steps that ran while the main
+ * loop was idle, see `awesome.set_idle_gc_step`.
+ *
+ * The `allocations` entry counts the C++ heap allocations of the main loop
+ * iterations: the number of `iterations`, how many of them were `allocating`,
+ * the `total`, the `max` of one iteration and the count of the `last` one. Its
+ * `scratch` is the size in bytes of the buffer for the temporaries of an
+ * iteration, and `overflows` the number of iterations which outgrew it.
+ *
+ * @tparam[opt=false] boolean reset Clear the statistics after reading them.
+ * @treturn table The statistics of every phase.
+ * @staticfct loop_stats
+ */
+int luaA_loop_stats(lua_State* L) {
+    const bool do_reset = lua_toboolean(L, 1);
+
+    lua_createtable(L, 0, int(Phase::Count) + 1);
+    for (size_t i = 0; i < size_t(Phase::Count); i++) {
+        const auto phase = Phase(i);
+        push_stats(L, stats(phase));
+        auto n = name(phase);
+        lua_setfield(L, -2, n.data());
+    }
+    Scratch::push_stats(L);
+    lua_setfield(L, -2, "allocations");
+
+    if (do_reset) {
+        reset();
+        Scratch::reset_stats();
+    }
+
+    return 1;
+}
+
+/** Blocking waits longer than this in one iteration are logged, 0 disables */
+static uint64_t x_wait_warning_ns = 0;
+
+/** The name of a call site, relative to the source tree */
+static std::string site_name(const XCB::Stats::Site& site) {
+    std::string_view file = site.file;
+    if (auto pos = file.rfind("src/"); pos != std::string_view::npos) {
+        file.remove_prefix(pos);
+    }
+    return fmt::format("{}:{}", file, site.line);
+}
+
+void check_x_wait() {
+    auto& s = XCB::stats;
+    if (x_wait_warning_ns && s.iteration_wait_ns > x_wait_warning_ns && s.iteration_worst) {
+        log_warn("Main loop iteration waited {:.3f} ms for the X server, {:.3f} ms of it in {}",
+                 s.iteration_wait_ns / 1e6,
+                 s.iteration_worst_ns / 1e6,
+                 site_name(*s.iteration_worst));
+    }
+    s.end_iteration();
+}
+
+/** Get statistics of the requests sent to the X server.
+ *
+ * The returned table contains the number of `requests` sent, the number of
+ * `flushes` of the output buffer, the number of blocking `waits` for a reply
+ * and the total `wait` time. Its `sites` table is indexed by the source
+ * location (`file:line`) of each wait and holds its `count`, its total `wait`
+ * time and its `max` time. All times are in seconds.
+ *
+ * `enter_leave_ignores` is the number of times enter and leave events were
+ * suppressed around a change, and `enter_leave_pending` the number of
+ * suppressed sequence ranges that the event loop has not passed yet.
+ *
+ * @tparam[opt=false] boolean reset Clear the statistics after reading them.
+ * @treturn table The statistics.
+ * @staticfct x_stats
+ */
+int luaA_x_stats(lua_State* L) {
+    const bool do_reset = lua_toboolean(L, 1);
+    auto& s = XCB::stats;
+
+    getConnection().requests_sent();
+
+    /* Several copies of an inline function share a name */
+    std::map<std::string, XCB::Stats::Site> sites;
+    for (const auto& [key, site] : s.sites) {
+        auto& merged = sites[site_name(site)];
+        merged.count += site.count;
+        merged.wait_ns += site.wait_ns;
+        merged.max_ns = std::max(merged.max_ns, site.max_ns);
+    }
+
+    lua_createtable(L, 0, 7);
+    lua_pushinteger(L, s.requests);
+    lua_setfield(L, -2, "requests");
+    lua_pushinteger(L, s.flushes);
+    lua_setfield(L, -2, "flushes");
+    lua_pushinteger(L, s.waits);
+    lua_setfield(L, -2, "waits");
+    lua_pushnumber(L, s.wait_ns / 1e9);
+    lua_setfield(L, -2, "wait");
+
+    const auto& ignored = Manager::get().ignore_enter_leave_events;
+    lua_pushinteger(L, ignored.pushed());
+    lua_setfield(L, -2, "enter_leave_ignores");
+    lua_pushinteger(L, ignored.size());
+    lua_setfield(L, -2, "enter_leave_pending");
+
+    lua_createtable(L, 0, int(sites.size()));
+    for (const auto& [name, site] : sites) {
+        lua_createtable(L, 0, 3);
+        lua_pushinteger(L, site.count);
+        lua_setfield(L, -2, "count");
+        lua_pushnumber(L, site.wait_ns / 1e9);
+        lua_setfield(L, -2, "wait");
+        lua_pushnumber(L, site.max_ns / 1e9);
+        lua_setfield(L, -2, "max");
+        lua_setfield(L, -2, name.c_str());
+    }
+    lua_setfield(L, -2, "sites");
+
+    if (do_reset) {
+        s.reset();
+        Manager::get().ignore_enter_leave_events.reset_pushed();
+    }
+
+    return 1;
+}
+
+/** Count the resources awesome holds in the X server.
+ *
+ * This asks the server through the X-Resource extension. The table maps the
+ * resource types in lower case, like `window`, `pixmap`, `gc`, `cursor` or
+ * `picture`, to the number of resources of this type which awesome created and
+ * did not free yet.
+ *
+ * @treturn table|nil The counts, or nil if the server lacks X-Resource.
+ * @staticfct x_resources
+ */
+int luaA_x_resources(lua_State* L) {
+    auto conn = getConnection().getConnection();
+    const xcb_query_extension_reply_t* query = xcb_get_extension_data(conn, &xcb_res_id);
+    if (!query || !query->present) {
+        return 0;
+    }
+
+    /* Any XID of the connection identifies it as the client */
+    const uint32_t xid = xcb_get_setup(conn)->resource_id_base;
+    auto reply = xcb_res_query_client_resources_reply(
+      conn, xcb_res_query_client_resources(conn, xid), NULL);
+    if (!reply) {
+        return 0;
+    }
+
+    const xcb_res_type_t* types = xcb_res_query_client_resources_types(reply);
+    const size_t count = xcb_res_query_client_resources_types_length(reply);
+    std::vector<xcb_atom_t> atoms(count);
+    std::vector<std::optional<std::string_view>> names(count);
+    for (size_t i = 0; i < count; i++) {
+        atoms[i] = types[i].resource_type;
+    }
+    atoms_names(conn, atoms, names);
+
+    lua_createtable(L, 0, int(count));
+    for (size_t i = 0; i < count; i++) {
+        if (!names[i]) {
+            continue;
+        }
+        std::string name(*names[i]);
+        std::ranges::transform(
+          name, name.begin(), [](unsigned char ch) { return std::tolower(ch); });
+        lua_pushinteger(L, types[i].count);
+        lua_setfield(L, -2, name.c_str());
+    }
+    p_delete(&reply);
+
+    return 1;
+}
+
+/** Log main loop iterations that wait too long for the X server.
+ *
+ * When the replies waited for during one main loop iteration took longer than
+ * the given time in total, a warning naming the call site of the longest wait
+ * is logged.
+ *
+ * @tparam number ms The time in milliseconds, 0 disables the warning.
+ * @staticfct set_x_wait_warning
+ * @noreturn
+ */
+int luaA_set_x_wait_warning(lua_State* L) {
+    const lua_Number ms = luaL_checknumber(L, 1);
+    x_wait_warning_ns = ms > 0 ? uint64_t(ms * 1e6) : 0;
+    return 0;
+}
+
+static std::array<PhaseStats, size_t(InputStage::Count)> input_stage_stats;
+
+static constexpr std::array<std::string_view, size_t(InputStage::Count)> input_stage_names = {
+  "dispatch",
+  "handler",
+  "flush",
+  "total",
+};
+
+/** A key press whose requests were not flushed yet */
+struct PendingKey {
+    Clock::time_point wakeup, begin, end;
+    uint8_t keycode;
+    uint32_t keysym;
+};
+
+static Clock::time_point input_wakeup_time;
+static Clock::time_point input_key_start;
+static std::vector<PendingKey> pending_keys;
+
+static uint64_t to_ns(Clock::duration d) {
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    return ns > 0 ? uint64_t(ns) : 0;
+}
+
+static void record(InputStage stage, Clock::duration elapsed) {
+    input_stage_stats[size_t(stage)].record(to_ns(elapsed));
+}
+
+/** Key presses taking longer than this in total are logged, 0 disables */
+static uint64_t input_warning_ns = [] {
+    const char* ms = getenv("AWESOME_INPUT_LATENCY_WARNING");
+    return ms ? uint64_t(std::max(0.0, atof(ms)) * 1e6) : 0;
+}();
+
+void input_wakeup() { input_wakeup_time = Clock::now(); }
+
+void input_key_begin() {
+    input_key_start = Clock::now();
+    /* Events handled outside of the main loop, e.g. during startup */
+    if (input_wakeup_time > input_key_start || input_wakeup_time == Clock::time_point{}) {
+        input_wakeup_time = input_key_start;
+    }
+    record(InputStage::Dispatch, input_key_start - input_wakeup_time);
+}
+
+void input_key_end(uint8_t keycode, uint32_t keysym) {
+    const auto end = Clock::now();
+    record(InputStage::Handler, end - input_key_start);
+    pending_keys.push_back({input_wakeup_time, input_key_start, end, keycode, keysym});
+}
+
+void input_flushed() {
+    if (pending_keys.empty()) {
+        return;
+    }
+
+    const auto now = Clock::now();
+    for (const auto& key : pending_keys) {
+        record(InputStage::Flush, now - key.end);
+        record(InputStage::Total, now - key.wakeup);
+        if (input_warning_ns && to_ns(now - key.wakeup) > input_warning_ns) {
+            const auto name = key.keysym ? key_get_keysym_name(key.keysym) : std::nullopt;
+            log_warn("Key press (keycode {}, {}) took {:.3f} ms: {:.3f} ms until it was handled, "
+                     "{:.3f} ms in handlers and {:.3f} ms until the flush",
+                     key.keycode,
+                     name ? *name : "unknown keysym",
+                     to_ns(now - key.wakeup) / 1e6,
+                     to_ns(key.begin - key.wakeup) / 1e6,
+                     to_ns(key.end - key.begin) / 1e6,
+                     to_ns(now - key.end) / 1e6);
+        }
+    }
+    pending_keys.clear();
+}
+
+/** Get the latency of key presses.
+ *
+ * The returned table is indexed by stage: `dispatch` is the time from the
+ * main loop waking up until the key press is handled, `handler` the time the
+ * key bindings (or the keygrabber) ran, `flush` the time from then until the
+ * requests they caused were sent to the X server, and `total` the sum of all
+ * three. Each entry has the same fields as the ones of `awesome.loop_stats`.
+ *
+ * @tparam[opt=false] boolean reset Clear the statistics after reading them.
+ * @treturn table The statistics of every stage.
+ * @staticfct input_stats
+ * @see loop_stats
+ */
+int luaA_input_stats(lua_State* L) {
+    const bool do_reset = lua_toboolean(L, 1);
+
+    lua_createtable(L, 0, int(InputStage::Count));
+    for (size_t i = 0; i < size_t(InputStage::Count); i++) {
+        push_stats(L, input_stage_stats[i]);
+        lua_setfield(L, -2, input_stage_names[i].data());
+    }
+
+    if (do_reset) {
+        input_stage_stats = {};
+    }
+
+    return 1;
+}
+
+/** Log key presses that take too long.
+ *
+ * When a key press takes longer than the given time from the main loop waking
+ * up until the requests of its handlers are flushed, a warning with the time of
+ * every stage is logged. The `AWESOME_INPUT_LATENCY_WARNING` environment
+ * variable sets the initial value.
+ *
+ * @tparam number ms The time in milliseconds, 0 disables the warning.
+ * @staticfct set_input_latency_warning
+ * @noreturn
+ */
+int luaA_set_input_warning(lua_State* L) {
+    const lua_Number ms = luaL_checknumber(L, 1);
+    input_warning_ns = ms > 0 ? uint64_t(ms * 1e6) : 0;
+    return 0;
+}
+
+/** A startup phase or a module loaded during startup */
+struct StartupSpan {
+    std::string name;
+    bool module;
+    /** How many module loads this one is nested in */
+    int depth;
+    Clock::time_point start;
+    Clock::time_point end;
+};
+
+/** Roughly when the process started, static initialization runs before main() */
+static const Clock::time_point startup_origin = Clock::now();
+static Clock::time_point startup_last = startup_origin;
+static std::vector<StartupSpan> startup_spans;
+static bool startup_done = false;
+static int require_depth = 0;
+
+void startup_phase(const char* name) {
+    const auto now = Clock::now();
+    startup_spans.push_back({name, false, 0, startup_last, now});
+    startup_last = now;
+}
+
+/** Message handler of timed_require(): the error is raised again from there,
+ * so keep where it came from in the message */
+static int timed_require_error(lua_State* L) {
+#if HAS_LUAJIT || LUA_VERSION_NUM >= 502
+    if (lua_type(L, 1) == LUA_TSTRING) {
+        luaL_traceback(L, L, lua_tostring(L, 1), 1);
+    }
+#endif
+    return 1;
+}
+
+/** require() that records the modules loaded during startup, the original
+ * require() is the first upvalue */
+static int timed_require(lua_State* L) {
+    std::optional<std::string> module;
+    if (!startup_done && lua_type(L, 1) == LUA_TSTRING) {
+        /* Modules that are already loaded take no time */
+        lua_getglobal(L, "package");
+        lua_getfield(L, -1, "loaded");
+        lua_getfield(L, -1, lua_tostring(L, 1));
+        if (!lua_toboolean(L, -1)) {
+            module = lua_tostring(L, 1);
+        }
+        lua_pop(L, 3);
+    }
+
+    const int nargs = lua_gettop(L);
+    lua_pushcfunction(L, timed_require_error);
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_insert(L, 1);
+    const auto start = Clock::now();
+    require_depth++;
+    const int status = lua_pcall(L, nargs, LUA_MULTRET, 1);
+    require_depth--;
+    if (module) {
+        startup_spans.push_back({std::move(*module), true, require_depth, start, Clock::now()});
+    }
+    if (status != 0) {
+        return lua_error(L);
+    }
+    return lua_gettop(L) - 1;
+}
+
+void startup_wrap_require(lua_State* L) {
+    lua_getglobal(L, "require");
+    lua_pushcclosure(L, timed_require, 1);
+    lua_setglobal(L, "require");
+}
+
+/** Put the original require() back, unless the configuration replaced it */
+static void startup_unwrap_require(lua_State* L) {
+    lua_getglobal(L, "require");
+    if (lua_tocfunction(L, -1) == timed_require) {
+        lua_getupvalue(L, -1, 1);
+        lua_setglobal(L, "require");
+    }
+    lua_pop(L, 1);
+}
+
+static double to_ms(Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+/** The spans in the order they started, modules after the phase they are in */
+static std::vector<const StartupSpan*> startup_timeline() {
+    std::vector<const StartupSpan*> spans;
+    for (const auto& span : startup_spans) {
+        spans.push_back(&span);
+    }
+    std::stable_sort(spans.begin(), spans.end(), [](const auto* a, const auto* b) {
+        if (a->start != b->start) {
+            return a->start < b->start;
+        }
+        return a->module < b->module;
+    });
+    return spans;
+}
+
+void startup_finished() {
+    if (startup_done) {
+        return;
+    }
+    startup_phase("first_paint");
+    startup_done = true;
+    startup_unwrap_require(globalconf_get_lua_State());
+
+    if (!startup_report) {
+        return;
+    }
+    fmt::print(stderr, "Startup took {:.3f} ms:\n", to_ms(startup_last - startup_origin));
+    for (const auto* span : startup_timeline()) {
+        fmt::print(stderr,
+                   "{:>10.3f} ms {:>10.3f} ms  {:{}}{}{}\n",
+                   to_ms(span->start - startup_origin),
+                   to_ms(span->end - span->start),
+                   "",
+                   span->module ? 2 * (span->depth + 1) : 0,
+                   span->module ? "require " : "",
+                   span->name);
+    }
+}
+
+/** Get how long the startup took.
+ *
+ * The timeline has one entry per startup phase (connecting to the X server,
+ * acquiring the window manager selection, D-Bus, xkb, the screens, loading
+ * the configuration, managing the existing clients and the first main loop
+ * iteration) and one per module that was loaded by `require` during startup.
+ * Each entry has the `name` of the phase or module, its `kind` (`"phase"` or
+ * `"require"`), its `start` since the process started and its `duration`, both
+ * in seconds, and for modules the `depth` of nested `require` calls. Entries are
+ * sorted by start time. The `--startup-report` command line option prints the
+ * timeline.
+ *
+ * @treturn table The timeline.
+ * @staticfct startup_timeline
+ */
+int luaA_startup_timeline(lua_State* L) {
+    const auto spans = startup_timeline();
+    lua_createtable(L, int(spans.size()), 0);
+    for (size_t i = 0; i < spans.size(); i++) {
+        const auto* span = spans[i];
+        lua_createtable(L, 0, 5);
+        lua_pushlstring(L, span->name.data(), span->name.size());
+        lua_setfield(L, -2, "name");
+        lua_pushstring(L, span->module ? "require" : "phase");
+        lua_setfield(L, -2, "kind");
+        lua_pushnumber(L, to_ms(span->start - startup_origin) / 1e3);
+        lua_setfield(L, -2, "start");
+        lua_pushnumber(L, to_ms(span->end - span->start) / 1e3);
+        lua_setfield(L, -2, "duration");
+        if (span->module) {
+            lua_pushinteger(L, span->depth);
+            lua_setfield(L, -2, "depth");
+        }
+        lua_rawseti(L, -2, int(i + 1));
+    }
+    return 1;
+}
+
+} // namespace Profiler
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,168 @@
+/*
+ * profiler.h - main loop profiler header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace Profiler {
+
+using Clock = std::chrono::steady_clock;
+
+/** The phases of a main loop iteration that are timed. */
+enum class Phase : uint8_t {
+    LuaRefresh,
+    Drawin,
+    Client,
+    Banning,
+    Stack,
+    Ewmh,
+    DestroyLater,
+    Damage,
+    Flush,
+    Events,
+    Poll,
+    Iteration,
+    /** Managing the windows that exist at startup, recorded once */
+    Scan,
+    /** Lua GC steps run before the main loop sleeps */
+    Gc,
+    Count
+};
+
+/** The stages of a key press through the window manager. */
+enum class InputStage : uint8_t {
+    /** From the main loop waking up until the key press is handled */
+    Dispatch,
+    /** Running the key bindings or the keygrabber */
+    Handler,
+    /** From the end of the handlers until the requests they sent are flushed */
+    Flush,
+    /** From the main loop waking up until the flush */
+    Total,
+    Count
+};
+
+/** Rolling timing statistics for one phase.
+ * The last `window` samples are kept for percentiles, the totals and the
+ * maximum cover the whole lifetime (or the time since the last reset).
+ */
+struct PhaseStats {
+    static constexpr size_t window = 512;
+
+    std::array<uint32_t, window> samples{};
+    size_t next = 0;
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint32_t max_ns = 0;
+
+    void record(uint64_t ns);
+    /** Get the given percentile (0..1) of the sample window, in nanoseconds. */
+    uint32_t percentile(double p) const;
+};
+
+void record(Phase phase, Clock::duration elapsed);
+const PhaseStats& stats(Phase phase);
+std::string_view name(Phase phase);
+void reset();
+
+/** The phase of the innermost Scope, Phase::Count outside of any */
+inline Phase current = Phase::Count;
+
+/** Time the lifetime of this object and account it to a phase. */
+class Scope {
+  public:
+    explicit Scope(Phase phase)
+      : _phase(phase)
+      , _outer(current)
+      , _start(Clock::now()) {
+        current = phase;
+    }
+    ~Scope() {
+        current = _outer;
+        record(_phase, Clock::now() - _start);
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    Phase _phase;
+    Phase _outer;
+    Clock::time_point _start;
+};
+
+/** Run a function and account its run time to a phase.
+ * \param phase The phase to account the time to.
+ * \param f The function to run.
+ * \return Whatever f returns.
+ */
+template <typename F>
+inline decltype(auto) measure(Phase phase, F&& f) {
+    Scope scope{phase};
+    return f();
+}
+
+/** Log the time the last iteration waited for the X server if it is above
+ * the warning threshold, and start accounting a new iteration. */
+void check_x_wait();
+
+/** Note that the main loop woke up to handle events. */
+void input_wakeup();
+/** Note that handling a key press starts. */
+void input_key_begin();
+/** Note that handling a key press finished.
+ * \param keycode The key code of the event.
+ * \param keysym The key symbol of the event, or 0 if it was not looked up.
+ */
+void input_key_end(uint8_t keycode, uint32_t keysym);
+/** Note that the requests sent so far were flushed. Key presses that took
+ * longer than the warning threshold in total are logged. */
+void input_flushed();
+
+/** Whether to print the startup timeline once startup finished */
+inline bool startup_report = false;
+
+/** Note that a startup phase ended; it started when the previous one ended.
+ * \param name The name of the phase, a string literal.
+ */
+void startup_phase(const char* name);
+/** Replace require() by one that records how long each module took to load
+ * during startup. startup_finished() puts the original one back.
+ * \param L The Lua VM state.
+ */
+void startup_wrap_require(lua_State* L);
+/** Note that the first main loop iteration sent its requests, which ends the
+ * startup. Only the first call does anything. */
+void startup_finished();
+
+int luaA_loop_stats(lua_State* L);
+int luaA_x_stats(lua_State* L);
+int luaA_x_resources(lua_State* L);
+int luaA_set_x_wait_warning(lua_State* L);
+int luaA_input_stats(lua_State* L);
+int luaA_set_input_warning(lua_State* L);
+int luaA_startup_timeline(lua_State* L);
+
+} // namespace Profiler
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
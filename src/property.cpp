@@ -29,16 +29,19 @@
 #include "objects/drawin.h"
 #include "objects/selection_getter.h"
 #include "objects/selection_transfer.h"
+#include "scratch.h"
+#include "xrdb.h"
 #include "xwindow.h"
 
 #include <algorithm>
-#include <format>
+#include <unordered_map>
+#include <vector>
 #include <xcb/xcb_atom.h>
 
 #define HANDLE_TEXT_PROPERTY(funcname, atom, setfunc)                              \
-    xcb_get_property_cookie_t property_get_##funcname(client* c) {                 \
+    xcb_get_property_cookie_t property_get_##funcname(xcb_window_t window) {       \
         return getConnection().get_property(                                       \
-          false, c->window, atom, XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX);         \
+          false, window, atom, XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX);            \
     }                                                                              \
     void property_update_##funcname(client* c, xcb_get_property_cookie_t cookie) { \
         lua_State* L = globalconf_get_lua_State();                                 \
@@ -46,11 +49,6 @@
         luaA_object_push(L, c);                                                    \
         setfunc(L, -1, xutil_get_text_property_from_reply(reply));                 \
         lua_pop(L, 1);                                                             \
-    }                                                                              \
-    static void property_handle_##funcname(uint8_t state, xcb_window_t window) {   \
-        client* c = client_getbywin(window);                                       \
-        if (c)                                                                     \
-            property_update_##funcname(c, property_get_##funcname(c));             \
     }
 
 HANDLE_TEXT_PROPERTY(wm_name, XCB_ATOM_WM_NAME, client_set_AltName)
@@ -62,27 +60,8 @@ HANDLE_TEXT_PROPERTY(wm_window_role, WM_WINDOW_ROLE, client_set_Role)
 
 #undef HANDLE_TEXT_PROPERTY
 
-#define HANDLE_PROPERTY(name)                                                \
-    static void property_handle_##name(uint8_t state, xcb_window_t window) { \
-        client* c = client_getbywin(window);                                 \
-        if (c)                                                               \
-            property_update_##name(c, property_get_##name(c));               \
-    }
-
-HANDLE_PROPERTY(wm_protocols)
-HANDLE_PROPERTY(wm_transient_for)
-HANDLE_PROPERTY(wm_client_leader)
-HANDLE_PROPERTY(wm_normal_hints)
-HANDLE_PROPERTY(wm_hints)
-HANDLE_PROPERTY(wm_class)
-HANDLE_PROPERTY(net_wm_icon)
-HANDLE_PROPERTY(net_wm_pid)
-HANDLE_PROPERTY(motif_wm_hints)
-
-#undef HANDLE_PROPERTY
-
-xcb_get_property_cookie_t property_get_wm_transient_for(client* c) {
-    return getConnection().icccm_get_wm_transient_for_unchecked(c->window);
+xcb_get_property_cookie_t property_get_wm_transient_for(xcb_window_t window) {
+    return getConnection().icccm_get_wm_transient_for_unchecked(window);
 }
 
 void property_update_wm_transient_for(client* c, xcb_get_property_cookie_t cookie) {
@@ -107,9 +86,9 @@ void property_update_wm_transient_for(client* c, xcb_get_property_cookie_t cooki
     client_find_transient_for(c);
 }
 
-xcb_get_property_cookie_t property_get_wm_client_leader(client* c) {
+xcb_get_property_cookie_t property_get_wm_client_leader(xcb_window_t window) {
     return getConnection().get_property_unchecked(
-      false, c->window, WM_CLIENT_LEADER, XCB_ATOM_WINDOW, 0, 32);
+      false, window, WM_CLIENT_LEADER, XCB_ATOM_WINDOW, 0, 32);
 }
 
 /** Update leader hint of a client.
@@ -126,8 +105,8 @@ void property_update_wm_client_leader(client* c, xcb_get_property_cookie_t cooki
     }
 }
 
-xcb_get_property_cookie_t property_get_wm_normal_hints(client* c) {
-    return getConnection().icccm_get_wm_normal_hints_unchecked(c->window);
+xcb_get_property_cookie_t property_get_wm_normal_hints(xcb_window_t window) {
+    return getConnection().icccm_get_wm_normal_hints_unchecked(window);
 }
 
 /** Update the size hints of a client.
@@ -140,12 +119,12 @@ void property_update_wm_normal_hints(client* c, xcb_get_property_cookie_t cookie
     getConnection().icccm_get_wm_normal_hints_reply(cookie, &c->size_hints);
 
     luaA_object_push(L, c);
-    luaA_object_emit_signal(L, -1, "property::size_hints", 0);
+    luaA_object_emit_signal(L, -1, "property::size_hints"_sig, 0);
     lua_pop(L, 1);
 }
 
-xcb_get_property_cookie_t property_get_wm_hints(client* c) {
-    return getConnection().icccm_get_wm_hints_unchecked(c->window);
+xcb_get_property_cookie_t property_get_wm_hints(xcb_window_t window) {
+    return getConnection().icccm_get_wm_hints_unchecked(window);
 }
 
 /** Update the WM hints of a client.
@@ -164,7 +143,7 @@ void property_update_wm_hints(client* c, xcb_get_property_cookie_t cookie) {
 
     /*TODO v5: Add a context */
     lua_pushboolean(L, xcb_icccm_wm_hints_get_urgency(&wmh));
-    luaA_object_emit_signal(L, -2, "request::urgent", 1);
+    luaA_object_emit_signal(L, -2, "request::urgent"_sig, 1);
 
     if (wmh.flags & XCB_ICCCM_WM_HINT_INPUT) {
         c->nofocus = !wmh.input;
@@ -187,8 +166,8 @@ void property_update_wm_hints(client* c, xcb_get_property_cookie_t cookie) {
     lua_pop(L, 1);
 }
 
-xcb_get_property_cookie_t property_get_wm_class(client* c) {
-    return getConnection().icccm_get_wm_class_unchecked(c->window);
+xcb_get_property_cookie_t property_get_wm_class(xcb_window_t window) {
+    return getConnection().icccm_get_wm_class_unchecked(window);
 }
 
 /** Update WM_CLASS of a client.
@@ -218,12 +197,13 @@ static void property_handle_net_wm_strut_partial(uint8_t state, xcb_window_t win
     }
 }
 
-xcb_get_property_cookie_t property_get_net_wm_icon(client* c) {
-    return ewmh_window_icon_get_unchecked(c->window);
+xcb_get_property_cookie_t property_get_net_wm_icon(xcb_window_t window) {
+    return ewmh_window_icon_get_unchecked(window);
 }
 
 void property_update_net_wm_icon(client* c, xcb_get_property_cookie_t cookie) {
     auto array = ewmh_window_icon_get_reply(cookie);
+    c->icons_stale = false;
     if (array.empty()) {
         return;
     }
@@ -231,9 +211,21 @@ void property_update_net_wm_icon(client* c, xcb_get_property_cookie_t cookie) {
     client_set_icons(c, std::move(array));
 }
 
-xcb_get_property_cookie_t property_get_net_wm_pid(client* c) {
+static void property_handle_net_wm_icon(uint8_t state, xcb_window_t window) {
+    client* c = client_getbywin(window);
+    if (!c) {
+        return;
+    }
+    if (Manager::get().lazy_icons) {
+        client_icons_invalidate(c);
+    } else {
+        property_update_net_wm_icon(c, property_get_net_wm_icon(c->window));
+    }
+}
+
+xcb_get_property_cookie_t property_get_net_wm_pid(xcb_window_t window) {
     return getConnection().get_property_unchecked(
-      false, c->window, _NET_WM_PID, XCB_ATOM_CARDINAL, 0L, 1L);
+      false, window, _NET_WM_PID, XCB_ATOM_CARDINAL, 0L, 1L);
 }
 
 void property_update_net_wm_pid(client* c, xcb_get_property_cookie_t cookie) {
@@ -252,9 +244,9 @@ void property_update_net_wm_pid(client* c, xcb_get_property_cookie_t cookie) {
     lua_pop(L, 1);
 }
 
-xcb_get_property_cookie_t property_get_motif_wm_hints(client* c) {
+xcb_get_property_cookie_t property_get_motif_wm_hints(xcb_window_t window) {
     return getConnection().get_property_unchecked(
-      false, c->window, _MOTIF_WM_HINTS, _MOTIF_WM_HINTS, 0L, 5L);
+      false, window, _MOTIF_WM_HINTS, _MOTIF_WM_HINTS, 0L, 5L);
 }
 
 void property_update_motif_wm_hints(client* c, xcb_get_property_cookie_t cookie) {
@@ -279,8 +271,8 @@ void property_update_motif_wm_hints(client* c, xcb_get_property_cookie_t cookie)
     lua_pop(L, 1);
 }
 
-xcb_get_property_cookie_t property_get_wm_protocols(client* c) {
-    return getConnection().icccm_get_wm_protocols_unchecked(c->window, WM_PROTOCOLS);
+xcb_get_property_cookie_t property_get_wm_protocols(xcb_window_t window) {
+    return getConnection().icccm_get_wm_protocols_unchecked(window, WM_PROTOCOLS);
 }
 
 /** Update the list of supported protocols for a client.
@@ -334,26 +326,141 @@ static void property_handle_net_wm_opacity(uint8_t state, xcb_window_t window) {
 }
 
 static void property_handle_xrootpmap_id(uint8_t state, xcb_window_t window) {
+    /* root_set_wallpaper() already did everything */
+    if (root_wallpaper_own_change()) {
+        return;
+    }
     lua_State* L = globalconf_get_lua_State();
     root_update_wallpaper();
-    signal_object_emit(L, &Lua::global_signals, "wallpaper_changed", 0);
+    signal_object_emit(L, &Lua::global_signals, "wallpaper_changed"_sig, 0);
+}
+
+static void property_handle_resource_manager(uint8_t state, xcb_window_t window) {
+    if (window == Manager::get().screen->root) {
+        xrdb_reload();
+    }
+}
+
+/** The functions fetching and applying a client property */
+struct property_refetcher {
+    xcb_get_property_cookie_t (*get)(xcb_window_t window) = nullptr;
+    void (*update)(client* c, xcb_get_property_cookie_t cookie) = nullptr;
+};
+
+/** A PropertyNotify handler: a built-in handler, a client property to fetch
+ * again and/or a registered xproperty */
+struct property_dispatch {
+    void (*handler)(uint8_t state, xcb_window_t window) = nullptr;
+    property_refetcher refetch;
+    const xproperty* xprop = nullptr;
+};
+
+/** PropertyNotify handlers, keyed by atom */
+static std::unordered_map<xcb_atom_t, property_dispatch> property_handlers;
+
+/** A client property that changed and has to be fetched again */
+struct property_refetch {
+    xcb_window_t window;
+    xcb_atom_t atom;
+    property_refetcher refetch;
+};
+
+/** The properties to fetch again, in the order they changed */
+static std::vector<property_refetch> property_refetches;
+
+/** Fetch the properties which changed since the last call.
+ * All requests are sent before the first reply is waited for, so that a batch
+ * of changes costs a single round trip.
+ */
+void property_refetch_flush(void) {
+    if (property_refetches.empty()) {
+        return;
+    }
+    /* Updates run Lua code, which may handle events again */
+    const Scratch::vector<property_refetch> refetches(property_refetches.begin(),
+                                                      property_refetches.end());
+    property_refetches.clear();
+
+    Scratch::vector<xcb_get_property_cookie_t> cookies;
+    cookies.reserve(refetches.size());
+    for (const auto& r : refetches) {
+        cookies.push_back(r.refetch.get(r.window));
+    }
+    for (size_t i = 0; i < refetches.size(); i++) {
+        /* An earlier update may have unmanaged it */
+        if (client* c = client_getbywin(refetches[i].window)) {
+            refetches[i].refetch.update(c, cookies[i]);
+        } else {
+            xcb_discard_reply(getConnection().getConnection(), cookies[i].sequence);
+        }
+    }
+}
+
+/** Build the PropertyNotify dispatch table. Must be called after the atoms
+ * have been interned.
+ */
+void property_init(void) {
+#define REFETCH(name) property_refetcher{property_get_##name, property_update_##name}
+    /* Client properties, fetched again in batches */
+    const std::pair<xcb_atom_t, property_refetcher> refetchers[] = {
+      /* ICCCM stuff */
+      { XCB_ATOM_WM_TRANSIENT_FOR,  REFETCH(wm_transient_for)},
+      {          WM_CLIENT_LEADER,  REFETCH(wm_client_leader)},
+      {  XCB_ATOM_WM_NORMAL_HINTS,   REFETCH(wm_normal_hints)},
+      {         XCB_ATOM_WM_HINTS,          REFETCH(wm_hints)},
+      {          XCB_ATOM_WM_NAME,           REFETCH(wm_name)},
+      {     XCB_ATOM_WM_ICON_NAME,      REFETCH(wm_icon_name)},
+      {         XCB_ATOM_WM_CLASS,          REFETCH(wm_class)},
+      {              WM_PROTOCOLS,      REFETCH(wm_protocols)},
+      {XCB_ATOM_WM_CLIENT_MACHINE, REFETCH(wm_client_machine)},
+      {            WM_WINDOW_ROLE,    REFETCH(wm_window_role)},
+
+      /* EWMH stuff */
+      {              _NET_WM_NAME,       REFETCH(net_wm_name)},
+      {         _NET_WM_ICON_NAME,  REFETCH(net_wm_icon_name)},
+      {               _NET_WM_PID,        REFETCH(net_wm_pid)},
+
+      /* MOTIF hints */
+      {           _MOTIF_WM_HINTS,    REFETCH(motif_wm_hints)},
+    };
+#undef REFETCH
+
+    const std::pair<xcb_atom_t, void (*)(uint8_t, xcb_window_t)> handlers[] = {
+      /* Xembed stuff */
+      {             _XEMBED_INFO,            property_handle_xembed_info},
+
+      /* EWMH stuff */
+      {    _NET_WM_STRUT_PARTIAL,   property_handle_net_wm_strut_partial},
+      {             _NET_WM_ICON,            property_handle_net_wm_icon},
+      {   _NET_WM_WINDOW_OPACITY,         property_handle_net_wm_opacity},
+
+      /* background change */
+      {            _XROOTPMAP_ID,           property_handle_xrootpmap_id},
+
+      /* X resources and cursor theme change */
+      {XCB_ATOM_RESOURCE_MANAGER,       property_handle_resource_manager},
+
+      /* selection transfers */
+      {   AWESOME_SELECTION_ATOM, property_handle_awesome_selection_atom},
+    };
+
+    for (const auto& [atom, refetch] : refetchers) {
+        property_handlers[atom].refetch = refetch;
+    }
+    for (const auto& [atom, handler] : handlers) {
+        property_handlers[atom].handler = handler;
+    }
 }
 
 /** The property notify event handler handling xproperties.
  * \param ev The event.
+ * \param prop The registered xproperty for the event atom.
  */
-static void property_handle_propertynotify_xproperty(xcb_property_notify_event_t* ev) {
+static void property_handle_propertynotify_xproperty(xcb_property_notify_event_t* ev,
+                                                     const xproperty& prop) {
     lua_State* L = globalconf_get_lua_State();
-    xproperty lookup = {.atom = ev->atom};
     lua_object_t* obj = nullptr;
 
-    auto it = Manager::get().xproperties.find(lookup);
-
-    if (it == Manager::get().xproperties.end()) {
-        /* Property is not registered */
-        return;
-    }
-
     if (ev->window != Manager::get().screen->root) {
         obj = client_getbywin(ev->window);
         if (!obj) {
@@ -364,15 +471,13 @@ static void property_handle_propertynotify_xproperty(xcb_property_notify_event_t
         }
     }
 
-    std::string buf = std::format("xproperty::{}", it->name);
-
     /* And emit the right signal */
     if (obj) {
         luaA_object_push(L, obj);
-        luaA_object_emit_signal(L, -1, buf.c_str(), 0);
+        luaA_object_emit_signal(L, -1, prop.signal, 0);
         lua_pop(L, 1);
     } else {
-        signal_object_emit(L, &Lua::global_signals, buf.c_str(), 0);
+        signal_object_emit(L, &Lua::global_signals, prop.signal, 0);
     }
 }
 
@@ -380,59 +485,35 @@ static void property_handle_propertynotify_xproperty(xcb_property_notify_event_t
  * \param ev The event.
  */
 void property_handle_propertynotify(xcb_property_notify_event_t* ev) {
-    void (*handler)(uint8_t state, xcb_window_t window) = NULL;
-
     Manager::get().x.update_timestamp(ev);
 
-    property_handle_propertynotify_xproperty(ev);
-    selection_transfer_handle_propertynotify(ev);
-
-    /* Find the correct event handler */
-#define HANDLE(atom_, cb)    \
-    if (ev->atom == atom_) { \
-        handler = cb;        \
-    } else
-#define END return
-
-    /* Xembed stuff */
-    HANDLE(_XEMBED_INFO, property_handle_xembed_info)
-
-    /* ICCCM stuff */
-    HANDLE(XCB_ATOM_WM_TRANSIENT_FOR, property_handle_wm_transient_for)
-    HANDLE(WM_CLIENT_LEADER, property_handle_wm_client_leader)
-    HANDLE(XCB_ATOM_WM_NORMAL_HINTS, property_handle_wm_normal_hints)
-    HANDLE(XCB_ATOM_WM_HINTS, property_handle_wm_hints)
-    HANDLE(XCB_ATOM_WM_NAME, property_handle_wm_name)
-    HANDLE(XCB_ATOM_WM_ICON_NAME, property_handle_wm_icon_name)
-    HANDLE(XCB_ATOM_WM_CLASS, property_handle_wm_class)
-    HANDLE(WM_PROTOCOLS, property_handle_wm_protocols)
-    HANDLE(XCB_ATOM_WM_CLIENT_MACHINE, property_handle_wm_client_machine)
-    HANDLE(WM_WINDOW_ROLE, property_handle_wm_window_role)
-
-    /* EWMH stuff */
-    HANDLE(_NET_WM_NAME, property_handle_net_wm_name)
-    HANDLE(_NET_WM_ICON_NAME, property_handle_net_wm_icon_name)
-    HANDLE(_NET_WM_STRUT_PARTIAL, property_handle_net_wm_strut_partial)
-    HANDLE(_NET_WM_ICON, property_handle_net_wm_icon)
-    HANDLE(_NET_WM_PID, property_handle_net_wm_pid)
-    HANDLE(_NET_WM_WINDOW_OPACITY, property_handle_net_wm_opacity)
-
-    /* MOTIF hints */
-    HANDLE(_MOTIF_WM_HINTS, property_handle_motif_wm_hints)
-
-    /* background change */
-    HANDLE(_XROOTPMAP_ID, property_handle_xrootpmap_id)
-
-    /* selection transfers */
-    HANDLE(AWESOME_SELECTION_ATOM, property_handle_awesome_selection_atom)
-
-    /* If nothing was found, return */
-    END;
-
-#undef HANDLE
-#undef END
-
-    (*handler)(ev->state, ev->window);
+    /* Incremental selection transfers wait for the requestor to delete the
+     * property, the atom is chosen by the requestor */
+    if (ev->state == XCB_PROPERTY_DELETE) {
+        selection_transfer_handle_propertynotify(ev);
+    }
+
+    auto it = property_handlers.find(ev->atom);
+    if (it == property_handlers.end()) {
+        return;
+    }
+
+    /* Copy, handlers may run Lua code which can register new xproperties */
+    const property_dispatch dispatch = it->second;
+    if (dispatch.xprop) {
+        property_handle_propertynotify_xproperty(ev, *dispatch.xprop);
+    }
+    if (dispatch.handler) {
+        (*dispatch.handler)(ev->state, ev->window);
+    }
+    if (dispatch.refetch.update && client_getbywin(ev->window)) {
+        const bool queued = std::ranges::any_of(property_refetches, [ev](const auto& r) {
+            return r.window == ev->window && r.atom == ev->atom;
+        });
+        if (!queued) {
+            property_refetches.push_back({ev->window, ev->atom, dispatch.refetch});
+        }
+    }
 }
 
 /** Register a new xproperty.
@@ -457,14 +538,11 @@ int luaA_register_xproperty(lua_State* L) {
         property.type = xproperty::PROP_BOOLEAN;
     }
 
-    auto atom_r = getConnection().intern_atom_reply(
-      getConnection().intern_atom_unchecked(false, name->size(), name->data()));
-    if (!atom_r) {
+    property.atom = atoms_get(getConnection().getConnection(), *name);
+    if (property.atom == XCB_NONE) {
         return 0;
     }
 
-    property.atom = atom_r->atom;
-
     auto found = Manager::get().xproperties.find(property);
     if (found != Manager::get().xproperties.end()) {
         /* Property already registered */
@@ -473,7 +551,9 @@ int luaA_register_xproperty(lua_State* L) {
         }
     } else {
         property.name = *name;
-        Manager::get().xproperties.insert(property);
+        property.signal = signal_intern("xproperty::" + property.name);
+        auto [it, _] = Manager::get().xproperties.insert(property);
+        property_handlers[it->atom].xprop = &*it;
     }
 
     return 0;
@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include "common/signal.h"
+
 #include <xcb/xproto.h>
 extern "C" {
 #include <lua.h>
@@ -29,8 +31,8 @@ extern "C" {
 #include <string>
 struct client;
 
-#define PROPERTY(funcname)                                        \
-    xcb_get_property_cookie_t property_get_##funcname(client* c); \
+#define PROPERTY(funcname)                                                  \
+    xcb_get_property_cookie_t property_get_##funcname(xcb_window_t window); \
     void property_update_##funcname(client* c, xcb_get_property_cookie_t cookie)
 
 PROPERTY(wm_name);
@@ -51,7 +53,9 @@ PROPERTY(motif_wm_hints);
 
 #undef PROPERTY
 
+void property_init(void);
 void property_handle_propertynotify(xcb_property_notify_event_t* ev);
+void property_refetch_flush(void);
 int luaA_register_xproperty(lua_State* L);
 int luaA_set_xproperty(lua_State* L);
 int luaA_get_xproperty(lua_State* L);
@@ -59,6 +63,8 @@ int luaA_get_xproperty(lua_State* L);
 struct xproperty {
     xcb_atom_t atom;
     std::string name;
+    /** The "xproperty::<name>" signal */
+    SignalId signal;
     enum {
         /* UTF8_STRING */
         PROP_STRING,
@@ -0,0 +1,280 @@
+/*
+ * reload.cpp - configuration reload without restart
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "reload.h"
+
+#include "common/luaclass.h"
+#include "common/luaobject.h"
+#include "common/util.h"
+#include "dbus.h"
+#include "globalconf.h"
+#include "keygrabber.h"
+#include "luaa.h"
+#include "mousegrabber.h"
+#include "objects/client.h"
+#include "objects/drawable.h"
+#include "objects/drawin.h"
+#include "objects/screen.h"
+#include "objects/tag.h"
+#include "timerwheel.h"
+
+#include <filesystem>
+#include <glib.h>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Reload {
+
+namespace {
+
+/** What existed before the configuration first ran */
+struct Baseline {
+    std::optional<std::filesystem::path> config;
+    Signals global_signals;
+    std::unordered_map<const lua_class_t*, Signals> class_signals;
+    std::set<std::string> modules;
+    std::set<std::string> globals;
+};
+
+Baseline baseline;
+guint source = 0;
+bool reloading = false;
+/** Configuration files tried by the current reload */
+int attempts = 0;
+
+/** Collect the string keys of the table on top of the stack. */
+std::set<std::string> table_keys(lua_State* L) {
+    std::set<std::string> keys;
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        lua_pop(L, 1);
+        if (lua_type(L, -1) == LUA_TSTRING) {
+            keys.emplace(lua_tostring(L, -1));
+        }
+    }
+    return keys;
+}
+
+/** Remove the string keys of the table on top of the stack which are not in
+ * *keep* */
+void drop_keys(lua_State* L, const std::set<std::string>& keep, bool keep_lgi) {
+    std::set<std::string> keys = table_keys(L);
+    for (const auto& key : keys) {
+        /* lgi registers its types with GObject, loading it twice fails */
+        if (keep.contains(key) || (keep_lgi && std::string_view(key).starts_with("lgi"))) {
+            continue;
+        }
+        lua_pushnil(L);
+        lua_setfield(L, -2, key.c_str());
+    }
+}
+
+/** Disconnect the handlers of the object on top of the stack and give it
+ * empty private data, like a new object. */
+void reset_object(lua_State* L) {
+    luaA_object_disconnect_all_signals(L, -1);
+    Lua::getuservalue(L, -1);
+    lua_newtable(L);
+    lua_setfield(L, -2, "data");
+    lua_pop(L, 1);
+}
+
+/** Drop what the configuration added on top of the baseline. */
+void teardown(lua_State* L) {
+    luaA_keygrabber_stop(L);
+    luaA_mousegrabber_stop(L);
+
+    signal_object_disconnect_all(L, &Lua::global_signals, baseline.global_signals);
+    for (auto* cls : lua_class_t::all()) {
+        signal_object_disconnect_all(L, &cls->signals(), baseline.class_signals[cls]);
+        Lua::unregister(L, &cls->index_miss_handler());
+        Lua::unregister(L, &cls->newindex_miss_handler());
+    }
+    for (auto* screen : Manager::get().screens) {
+        luaA_object_push(L, screen);
+        reset_object(L);
+        lua_pop(L, 1);
+    }
+    for (const auto& tag : Manager::get().tags) {
+        luaA_object_push(L, tag.get());
+        luaA_object_disconnect_all_signals(L, -1);
+        lua_pop(L, 1);
+    }
+    for (auto* c : Manager::get().clients) {
+        luaA_object_push(L, c);
+        reset_object(L);
+        for (const auto& titlebar : c->titlebar) {
+            if (titlebar.drawable) {
+                luaA_object_push_item(L, -1, titlebar.drawable);
+                reset_object(L);
+                lua_pop(L, 1);
+            }
+        }
+        client_reset_bindings(L, -1);
+        lua_pop(L, 1);
+    }
+    a_dbus_disconnect_all();
+    TimerWheel::cleanup();
+    root_reset_bindings(L);
+    drawin_hide_all(L);
+    tag_deactivate_all(L);
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "loaded");
+    drop_keys(L, baseline.modules, true);
+    lua_pop(L, 2);
+    lua_getglobal(L, "_G");
+    drop_keys(L, baseline.globals, false);
+    lua_pop(L, 1);
+
+    lua_gc(L, LUA_GCCOLLECT, 0);
+}
+
+/** Run a configuration file, dropping what the previous attempt left. */
+bool load(const std::filesystem::path& path) {
+    if (attempts++ > 0) {
+        teardown(globalconf_get_lua_State());
+    }
+    return Lua::loadrc(path);
+}
+
+/** Run the configuration again and hand the clients to it. */
+int reload(lua_State* L) {
+    signal_object_emit(L, &Lua::global_signals, "reload"_sig, 0);
+
+    /* The tags are matched by position in the new configuration */
+    std::unordered_map<xcb_window_t, std::vector<size_t>> memberships;
+    for (size_t i = 0; i < Manager::get().tags.size(); i++) {
+        for (auto* c : Manager::get().tags[i]->clients) {
+            memberships[c->window].push_back(i);
+        }
+    }
+
+    teardown(L);
+
+    xdgHandle xdg;
+    if (!xdgInitHandle(&xdg)) {
+        return luaL_error(L, "xdgInitHandle() failed, is $HOME unset?");
+    }
+    Manager::get().startup_errors.clear();
+    attempts = 0;
+    if (!Lua::find_config(&xdg, baseline.config, load)) {
+        log_warn("couldn't find any rc file");
+    }
+    xdgWipeHandle(&xdg);
+
+    screen_emit_scanned();
+    client_emit_scanning();
+
+    std::vector<tag_change_t> changes;
+    for (const auto& [window, indexes] : memberships) {
+        auto it = Manager::get().windows.clients.find(window);
+        if (it == Manager::get().windows.clients.end()) {
+            continue;
+        }
+        for (const size_t i : indexes) {
+            if (i < Manager::get().tags.size()) {
+                changes.push_back({it->second, Manager::get().tags[i].get(), true});
+            }
+        }
+    }
+    tag_apply_changes(L, changes);
+
+    const auto clients = Manager::get().clients;
+    for (auto* c : clients) {
+        luaA_object_push(L, c);
+        lua_pushstring(L, "startup");
+        lua_createtable(L, 0, 1);
+        lua_pushboolean(L, true);
+        lua_setfield(L, -2, "reload");
+        luaA_object_emit_signal(L, -3, "request::manage"_sig, 2);
+        /*TODO v6: remove this*/
+        luaA_object_emit_signal(L, -1, "manage"_sig, 0);
+        lua_pop(L, 1);
+    }
+
+    client_emit_scanned();
+    Lua::emit_startup();
+    return 0;
+}
+
+gboolean run(gpointer) {
+    source = 0;
+    lua_State* L = globalconf_get_lua_State();
+    reloading = true;
+    lua_pushcfunction(L, reload);
+    Lua::dofunction(L, 0, 0);
+    reloading = false;
+    return G_SOURCE_REMOVE;
+}
+
+} // namespace
+
+void snapshot(std::optional<std::filesystem::path> config) {
+    lua_State* L = globalconf_get_lua_State();
+    baseline.config = std::move(config);
+    baseline.global_signals = Lua::global_signals;
+    for (const auto* cls : lua_class_t::all()) {
+        baseline.class_signals[cls] = cls->signals();
+    }
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "loaded");
+    baseline.modules = table_keys(L);
+    lua_pop(L, 2);
+    lua_getglobal(L, "_G");
+    baseline.globals = table_keys(L);
+    lua_pop(L, 1);
+}
+
+bool running() { return reloading; }
+
+/** Run the configuration again without restarting.
+ *
+ * The signal handlers, key and button bindings, timers, wiboxes and tags of
+ * the current configuration are dropped and the modules it loaded are
+ * forgotten, then the configuration file runs again. The clients, screens
+ * and windows stay as they are. Like at startup, each client then gets a
+ * `request::manage` signal with the `"startup"` context and a `reload` hint,
+ * and `awesome.startup` is true until the `startup` signal was emitted. The
+ * clients keep the tags at the same positions as before if the new
+ * configuration has them, and their `_private` tables, like the ones of the
+ * screens, start empty.
+ *
+ * The reload happens when the main loop is idle, after the caller returned.
+ * What was created through lgi, like GLib sources and D-Bus objects, is not
+ * dropped.
+ *
+ * @staticfct reload
+ * @noreturn
+ * @emits reload
+ */
+int luaA_reload(lua_State* L) {
+    if (!source) {
+        source = g_idle_add(run, nullptr);
+    }
+    return 0;
+}
+
+} // namespace Reload
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
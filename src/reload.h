@@ -0,0 +1,49 @@
+/*
+ * reload.h - configuration reload without restart header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+
+#include <filesystem>
+#include <optional>
+
+/** Run the configuration again in the same process.
+ *
+ * snapshot() remembers what exists before the configuration first runs: the
+ * signal handlers connected from C++, the loaded modules and the globals.
+ * awesome.reload() drops everything the configuration added since, its
+ * handlers, bindings, timers, drawins and tags, but keeps the clients, the
+ * screens and the X resources. The configuration then runs again and the
+ * clients are handed to it like at startup, with a request::manage signal.
+ */
+namespace Reload {
+
+/** Remember the state before the configuration runs.
+ * \param config The configuration file given on the command line, if any.
+ */
+void snapshot(std::optional<std::filesystem::path> config);
+
+/** Whether the configuration is being reloaded, awesome.startup is true */
+bool running();
+
+int luaA_reload(lua_State* L);
+
+} // namespace Reload
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,237 @@
+/*
+ * restartstate.cpp - client state handed over on restart
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "restartstate.h"
+
+#include "common/util.h"
+#include "globalconf.h"
+#include "objects/client.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <optional>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace RestartState {
+
+/** The environment variable with the file descriptor of the snapshot */
+static constexpr const char* env_name = "AWESOME_RESTART_SNAPSHOT";
+/** "AWRS" and the format version, a different binary never uses it */
+static constexpr uint32_t magic = 0x53525741;
+static constexpr uint32_t version = 1;
+
+static std::unordered_map<xcb_window_t, Entry> entries;
+
+namespace {
+
+struct Writer {
+    std::string out;
+
+    void u32(uint32_t v) { out.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void str(const std::string& s) {
+        u32(s.size());
+        out += s;
+    }
+};
+
+struct Reader {
+    std::string_view in;
+
+    std::optional<uint32_t> u32() {
+        uint32_t v;
+        if (in.size() < sizeof(v)) {
+            return {};
+        }
+        memcpy(&v, in.data(), sizeof(v));
+        in.remove_prefix(sizeof(v));
+        return v;
+    }
+    bool str(std::string& s) {
+        auto len = u32();
+        if (!len || in.size() < *len) {
+            return false;
+        }
+        s = in.substr(0, *len);
+        in.remove_prefix(*len);
+        return true;
+    }
+};
+
+} // namespace
+
+/** The icons of a client in _NET_WM_ICON layout, if they are all known */
+static std::vector<uint32_t> icon_words(const client* c) {
+    std::vector<uint32_t> words;
+    if (!c->have_ewmh_icon || c->icons_stale) {
+        return words;
+    }
+    for (const auto& icon : c->icons) {
+        const auto& pixels = icon->pixels();
+        if (pixels.empty()) {
+            /* Set from Lua, the new process asks the client again */
+            return {};
+        }
+        words.push_back(icon->width());
+        words.push_back(icon->height());
+        words.insert(words.end(), pixels.begin(), pixels.end());
+    }
+    return words;
+}
+
+void save() {
+    Writer w;
+    w.u32(magic);
+    w.u32(version);
+    /* A window without a pid could not be told from another one that got its
+     * id while the new process starts */
+    const auto verifiable = std::ranges::count_if(Manager::get().clients,
+                                                  [](const client* c) { return c->pid != 0; });
+    if (!verifiable) {
+        return;
+    }
+    w.u32(verifiable);
+    for (const auto* c : Manager::get().clients) {
+        if (!c->pid) {
+            continue;
+        }
+        w.u32(c->window);
+        w.u32(c->pid);
+        w.u32(c->leader_window);
+        for (const auto* s : {&c->getName(),
+                              &c->getAltName(),
+                              &c->getIconName(),
+                              &c->getAltIconName(),
+                              &c->getCls(),
+                              &c->getInstance(),
+                              &c->getMachine(),
+                              &c->getRole()}) {
+            w.str(*s);
+        }
+        const auto icons = icon_words(c);
+        w.u32(icons.size());
+        w.out.append(reinterpret_cast<const char*>(icons.data()), icons.size() * sizeof(uint32_t));
+    }
+
+    /* Not close-on-exec, the new process inherits it */
+    const int fd = memfd_create("awesome-restart", 0);
+    if (fd < 0) {
+        return;
+    }
+    if (write(fd, w.out.data(), w.out.size()) != ssize_t(w.out.size())) {
+        close(fd);
+        return;
+    }
+    setenv(env_name, fmt::format("{}", fd).c_str(), 1);
+}
+
+/** Parse a snapshot.
+ * \param data The snapshot.
+ * \return False if it is not a valid snapshot of this version.
+ */
+static bool parse(std::string_view data) {
+    Reader r{data};
+    if (r.u32() != magic || r.u32() != version) {
+        return false;
+    }
+    auto count = r.u32();
+    if (!count) {
+        return false;
+    }
+    for (uint32_t i = 0; i < *count; i++) {
+        Entry e;
+        auto window = r.u32(), pid = r.u32(), leader = r.u32();
+        if (!window || !pid || !leader || !*window || !*pid) {
+            return false;
+        }
+        e.window = *window;
+        e.pid = *pid;
+        e.leader = *leader;
+        for (auto* s : {&e.name,
+                        &e.alt_name,
+                        &e.icon_name,
+                        &e.alt_icon_name,
+                        &e.cls,
+                        &e.instance,
+                        &e.machine,
+                        &e.role}) {
+            if (!r.str(*s)) {
+                return false;
+            }
+        }
+        auto words = r.u32();
+        if (!words || r.in.size() / sizeof(uint32_t) < *words) {
+            return false;
+        }
+        if (*words > 0) {
+            e.icons.resize(*words);
+            memcpy(e.icons.data(), r.in.data(), *words * sizeof(uint32_t));
+            r.in.remove_prefix(*words * sizeof(uint32_t));
+        }
+        entries.emplace(e.window, std::move(e));
+    }
+    return r.in.empty();
+}
+
+void load() {
+    const char* value = getenv(env_name);
+    if (!value) {
+        return;
+    }
+    const int fd = atoi(value);
+    /* Processes started by this one must not see it */
+    unsetenv(env_name);
+
+    struct stat st;
+    if (fd <= STDERR_FILENO || fstat(fd, &st) != 0) {
+        return;
+    }
+    std::string data(st.st_size, '\0');
+    const bool complete = pread(fd, data.data(), data.size(), 0) == ssize_t(data.size());
+    close(fd);
+    if (!complete || !parse(data)) {
+        log_warn("Ignoring an invalid restart snapshot");
+        entries.clear();
+        return;
+    }
+
+    /* Changes from now on arrive as events, which are handled once the
+     * windows are managed. Windows that are gone cause errors that are
+     * ignored anyway. */
+    const uint32_t mask[] = {XCB_EVENT_MASK_PROPERTY_CHANGE};
+    for (const auto& [window, entry] : entries) {
+        getConnection().change_attributes(window, XCB_CW_EVENT_MASK, mask);
+    }
+}
+
+const Entry* find(xcb_window_t window) {
+    auto it = entries.find(window);
+    return it == entries.end() ? nullptr : &it->second;
+}
+
+void clear() { entries.clear(); }
+
+} // namespace RestartState
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,71 @@
+/*
+ * restartstate.h - client state handed over on restart header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <xcb/xcb.h>
+
+/** The properties of the clients, handed from a process that restarts to
+ * the one it executes.
+ *
+ * awesome_restart() writes a snapshot to a memfd that survives the exec, the
+ * new process reads it right after connecting and listens for property
+ * changes of every window in it. scan() then takes the properties of the
+ * windows it finds from the snapshot instead of asking the X server for them.
+ * Changes made while the new process starts up arrive as PropertyNotify events
+ * and are handled as usual, only changes between the old process disconnecting
+ * and the new one connecting are missed.
+ */
+namespace RestartState {
+
+/** What the snapshot knows about a client */
+struct Entry {
+    xcb_window_t window;
+    /** _NET_WM_PID and WM_CLIENT_LEADER, which are still fetched to check the
+     * window is the same. Windows without a pid are not in the snapshot. */
+    uint32_t pid;
+    xcb_window_t leader;
+    std::string name, alt_name, icon_name, alt_icon_name;
+    std::string cls, instance;
+    std::string machine, role;
+    /** The icons in _NET_WM_ICON layout, empty if they have to be fetched */
+    std::vector<uint32_t> icons;
+};
+
+/** Write the snapshot for the process that is about to be executed. */
+void save();
+
+/** Read the snapshot left by the process that executed this one, if any,
+ * and select property changes on its windows. */
+void load();
+
+/** Find the snapshot of a window.
+ * \param window The client window.
+ * \return The entry, or nullptr. It is valid until clear().
+ */
+const Entry* find(xcb_window_t window);
+
+/** Drop the snapshot once scan() is done with it. */
+void clear();
+
+} // namespace RestartState
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
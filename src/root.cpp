@@ -34,20 +34,27 @@
  * @coreclassmod root
  */
 
+#include "capture.h"
 #include "common/atoms.h"
 #include "common/lualib.h"
 #include "common/xcursor.h"
 #include "common/xutil.h"
 #include "globalconf.h"
 #include "globals.h"
+#include "keyset.h"
 #include "math.h"
+#include "memstats.h"
+#include "mouse.h"
 #include "objects/button.h"
 #include "objects/drawin.h"
 #include "objects/tag.h"
 #include "xcbcpp/xcb.h"
 #include "xwindow.h"
 
+#include <algorithm>
+#include <array>
 #include <cairo-xcb.h>
+#include <vector>
 #include <xcb/xcb_aux.h>
 #include <xcb/xtest.h>
 #include <xkbcommon/xkbcommon.h>
@@ -56,108 +63,283 @@ static Lua::FunctionRegistryIdx miss_index_handler;
 static Lua::FunctionRegistryIdx miss_newindex_handler;
 static Lua::FunctionRegistryIdx miss_call_handler;
 
-static void root_set_wallpaper_pixmap(XCB::Connection& c, xcb_pixmap_t p) {
-    xcb_get_property_cookie_t prop_c;
-    xcb_get_property_reply_t* prop_r;
+/** The wallpaper pixmaps live on their own X11 connection, whose resources are
+ * retained when awesome exits, so that the wallpaper survives restarts. The
+ * connection is kept open and two pixmaps of the screen's size are painted in
+ * turns, so changing the wallpaper does not need any round trips.
+ */
+static struct {
+    xcb_connection_t* connection = nullptr;
+    std::array<xcb_pixmap_t, 2> pixmaps = {XCB_NONE, XCB_NONE};
+    /** Index of the pixmap that is the current wallpaper */
+    size_t front = 0;
+    uint16_t width = 0, height = 0;
+    /** False if the wallpaper might belong to some other program */
+    bool owns_root = false;
+    /** Number of _XROOTPMAP_ID PropertyNotify events caused by us */
+    unsigned own_changes = 0;
+} wallpaper;
+
+static bool root_wallpaper_connect() {
+    if (wallpaper.connection && !xcb_connection_has_error(wallpaper.connection)) {
+        return true;
+    }
+    if (wallpaper.connection) {
+        xcb_disconnect(wallpaper.connection);
+    }
+    /* The pixmaps are retained by the server, but no longer ours */
+    for (auto p : wallpaper.pixmaps) {
+        if (p != XCB_NONE) {
+            MemStats::pixmap(MemStats::Pixmap::Wallpaper)
+              .remove(MemStats::pixmap_bytes(
+                wallpaper.width, wallpaper.height, Manager::get().screen->root_depth));
+        }
+    }
+    wallpaper.pixmaps = {XCB_NONE, XCB_NONE};
+    wallpaper.owns_root = false;
+
+    wallpaper.connection = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(wallpaper.connection)) {
+        xcb_disconnect(wallpaper.connection);
+        wallpaper.connection = nullptr;
+        return false;
+    }
+
+    /* Make sure our pixmaps are not destroyed when we disconnect. */
+    xcb_set_close_down_mode(wallpaper.connection, XCB_CLOSE_DOWN_RETAIN_PERMANENT);
+    return true;
+}
+
+/** Find the wallpaper that some other program (or an earlier instance of
+ * awesome) left behind. The property is read on the wallpaper connection, so
+ * the main connection does not have to wait for it.
+ * \return The pixmap whose owner should be killed, or XCB_NONE.
+ */
+static xcb_pixmap_t root_wallpaper_foreign() {
+    const xcb_screen_t* screen = Manager::get().screen;
+    xcb_pixmap_t result = XCB_NONE;
+    auto prop_c = xcb_get_property_unchecked(
+      wallpaper.connection, false, screen->root, ESETROOT_PMAP_ID, XCB_ATOM_PIXMAP, 0, 1);
+    auto prop_r = xcb_get_property_reply(wallpaper.connection, prop_c, NULL);
+    if (prop_r && prop_r->value_len) {
+        xcb_pixmap_t* rootpix = (xcb_pixmap_t*)xcb_get_property_value(prop_r);
+        if (rootpix && std::ranges::find(wallpaper.pixmaps, *rootpix) == wallpaper.pixmaps.end()) {
+            result = *rootpix;
+        }
+    }
+    p_delete(&prop_r);
+    return result;
+}
+
+/** Check whether the current wallpaper is our pixmap of the right size.
+ * \return True if it can be painted to directly.
+ */
+static bool root_wallpaper_is_ours() {
+    const xcb_screen_t* screen = Manager::get().screen;
+    return wallpaper.owns_root && wallpaper.pixmaps[wallpaper.front] != XCB_NONE &&
+           wallpaper.width == screen->width_in_pixels &&
+           wallpaper.height == screen->height_in_pixels && Manager::get().wallpaper;
+}
+
+static void root_set_wallpaper_pixmap(xcb_pixmap_t p) {
     const xcb_screen_t* screen = Manager::get().screen;
 
     /* We now have the pattern painted to the pixmap p. Now turn p into the root
      * window's background pixmap.
      */
-    c.change_attributes(screen->root, XCB_CW_BACK_PIXMAP, &p);
-    xcb_clear_area(c.getConnection(), 0, screen->root, 0, 0, 0, 0);
-
-    prop_c = xcb_get_property_unchecked(
-      c.connection, false, screen->root, ESETROOT_PMAP_ID, XCB_ATOM_PIXMAP, 0, 1);
+    getConnection().change_attributes(screen->root, XCB_CW_BACK_PIXMAP, &p);
+    getConnection().clear_area(0, screen->root);
 
     /* Theoretically, this should be enough to set the wallpaper. However, to
      * make pseudo-transparency work, clients need a way to get the wallpaper.
      * You can't query a window's back pixmap, so properties are (ab)used.
      */
-    c.replace_property(screen->root, _XROOTPMAP_ID, XCB_ATOM_PIXMAP, p);
-    c.replace_property(screen->root, ESETROOT_PMAP_ID, XCB_ATOM_PIXMAP, p);
-
-    /* Now make sure that the old wallpaper is freed (but only do this for ESETROOT_PMAP_ID) */
-    prop_r = xcb_get_property_reply(c.connection, prop_c, NULL);
-    if (prop_r && prop_r->value_len) {
-        xcb_pixmap_t* rootpix = (xcb_pixmap_t*)xcb_get_property_value(prop_r);
-        if (rootpix) {
-            xcb_kill_client(c.getConnection(), *rootpix);
-        }
-    }
-    p_delete(&prop_r);
+    getConnection().replace_property(screen->root, _XROOTPMAP_ID, XCB_ATOM_PIXMAP, p);
+    getConnection().replace_property(screen->root, ESETROOT_PMAP_ID, XCB_ATOM_PIXMAP, p);
+    wallpaper.own_changes++;
 }
 
-static bool root_set_wallpaper(cairo_pattern_t* pattern) {
-    lua_State* L = globalconf_get_lua_State();
-    xcb_connection_t* c = xcb_connect(NULL, NULL);
-    xcb_pixmap_t p = xcb_generate_id(c);
+/** Paint a new wallpaper into the back buffer and make it the wallpaper.
+ * \param pattern The new wallpaper.
+ * \return True on success.
+ */
+static bool root_wallpaper_repaint(cairo_pattern_t* pattern) {
     /* globalconf.connection should be connected to the same X11 server, so we
      * can just use the info from that other connection.
      */
     const xcb_screen_t* screen = Manager::get().screen;
     uint16_t width = screen->width_in_pixels;
     uint16_t height = screen->height_in_pixels;
-    bool result = false;
-    cairo_surface_t* surface;
-    cairo_t* cr;
-
-    auto disconnect = [c]() {
-        xcb_aux_sync(c);
-        xcb_disconnect(c);
-    };
+    std::vector<xcb_pixmap_t> stale;
+    size_t stale_bytes = 0;
 
-    if (xcb_connection_has_error(c)) {
-        disconnect();
+    if (!root_wallpaper_connect()) {
         return false;
     }
 
-    /* Create a pixmap and make sure it is already created, because we are going
-     * to use it from the other X11 connection (Juggling with X11 connections
-     * is a really, really bad idea).
-     */
-    xcb_create_pixmap(c, screen->root_depth, p, screen->root, width, height);
-    xcb_aux_sync(c);
+    /* Pixmaps of the wrong size are freed once they are no longer used */
+    if (wallpaper.width != width || wallpaper.height != height) {
+        std::ranges::copy_if(wallpaper.pixmaps, std::back_inserter(stale), [](auto p) {
+            return p != XCB_NONE;
+        });
+        stale_bytes = MemStats::pixmap_bytes(wallpaper.width, wallpaper.height, screen->root_depth);
+        wallpaper.pixmaps = {XCB_NONE, XCB_NONE};
+        wallpaper.width = width;
+        wallpaper.height = height;
+    }
+
+    const size_t back = 1 - wallpaper.front;
+    xcb_pixmap_t p = wallpaper.pixmaps[back];
+    if (p == XCB_NONE) {
+        /* Create a pixmap and make sure it is already created, because we are
+         * going to use it from the other X11 connection (Juggling with X11
+         * connections is a really, really bad idea). This only happens when
+         * the screen size changes.
+         */
+        p = xcb_generate_id(wallpaper.connection);
+        xcb_create_pixmap(wallpaper.connection, screen->root_depth, p, screen->root, width, height);
+        xcb_aux_sync(wallpaper.connection);
+        wallpaper.pixmaps[back] = p;
+        MemStats::pixmap(MemStats::Pixmap::Wallpaper)
+          .add(MemStats::pixmap_bytes(width, height, screen->root_depth));
+    }
 
     /* Now paint to the picture from the main connection so that cairo sees that
      * it can tell the X server to copy between the (possible) old pixmap and
      * the new one directly and doesn't need GetImage and PutImage.
      */
-    surface = cairo_xcb_surface_create(
+    cairo_surface_t* surface = cairo_xcb_surface_create(
       getConnection().getConnection(), p, draw_default_visual(screen), width, height);
-    cr = cairo_create(surface);
+    cairo_t* cr = cairo_create(surface);
     /* Paint the pattern to the surface */
     cairo_set_source(cr, pattern);
     cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
     cairo_paint(cr);
     cairo_destroy(cr);
     cairo_surface_flush(surface);
-    getConnection().aux_sync();
 
-    /* Change the wallpaper, without sending us a PropertyNotify event */
-    getConnection().grab_server();
-    getConnection().clear_attributes(Manager::get().screen->root, XCB_CW_EVENT_MASK);
-    root_set_wallpaper_pixmap(getConnection(), p);
-    getConnection().change_attributes(
-      Manager::get().screen->root, XCB_CW_EVENT_MASK, ROOT_WINDOW_EVENT_MASK);
-    xutil_ungrab_server();
+    xcb_pixmap_t foreign = XCB_NONE;
+    if (!wallpaper.owns_root) {
+        foreign = root_wallpaper_foreign();
+        wallpaper.owns_root = true;
+    }
 
-    /* Make sure our pixmap is not destroyed when we disconnect. */
-    xcb_set_close_down_mode(c, XCB_CLOSE_DOWN_RETAIN_PERMANENT);
+    /* Change the wallpaper. All of this is ordered after the painting above
+     * because it goes through the same connection. The PropertyNotify that this
+     * causes is ignored, so that we do not have to ask for the new pixmap.
+     */
+    root_set_wallpaper_pixmap(p);
+    wallpaper.front = back;
+
+    /* Now make sure that the old wallpaper is freed (but only do this for
+     * ESETROOT_PMAP_ID). This uses the main connection so that it happens
+     * after the painting above, which might have used the old wallpaper.
+     */
+    if (foreign != XCB_NONE) {
+        getConnection().kill_client(foreign);
+    }
+
+    /* The pixmaps of the old size are freed on the main connection as well,
+     * so that the server frees them after the painting and the property
+     * update above. The other connection would not be ordered with them. */
+    for (auto old : stale) {
+        getConnection().free_pixmap(old);
+        MemStats::pixmap(MemStats::Pixmap::Wallpaper).remove(stale_bytes);
+    }
+    getConnection().flush();
 
-    /* Tell Lua that the wallpaper changed */
     cairo_surface_destroy(Manager::get().wallpaper);
     Manager::get().wallpaper = surface;
-    signal_object_emit(L, &Lua::global_signals, "wallpaper_changed", 0);
+    return true;
+}
 
-    result = true;
-    disconnect();
-    return result;
+static bool root_set_wallpaper(cairo_pattern_t* pattern) {
+    if (!root_wallpaper_repaint(pattern)) {
+        return false;
+    }
+
+    /* Tell Lua that the wallpaper changed */
+    lua_State* L = globalconf_get_lua_State();
+    signal_object_emit(L, &Lua::global_signals, "wallpaper_changed"_sig, 0);
+    return true;
+}
+
+/** Change a part of the wallpaper.
+ * Only the given area of the current wallpaper pixmap is painted, the rest of
+ * it stays as it is.
+ * \param pattern The new wallpaper, in root window coordinates.
+ * \param area The area to update.
+ * \return True on success.
+ */
+static bool root_set_wallpaper_region(cairo_pattern_t* pattern, area_t area) {
+    const xcb_screen_t* screen = Manager::get().screen;
+
+    /* Clip the area to the root window */
+    const int x1 = std::max(area.left(), 0);
+    const int y1 = std::max(area.top(), 0);
+    const int x2 = std::min(area.right(), int(screen->width_in_pixels));
+    const int y2 = std::min(area.bottom(), int(screen->height_in_pixels));
+    if (x1 >= x2 || y1 >= y2) {
+        return false;
+    }
+    area = {
+      {x1, y1},
+      uint16_t(x2 - x1), uint16_t(y2 - y1)
+    };
+
+    if (!root_wallpaper_is_ours()) {
+        /* Start from whatever the wallpaper currently is */
+        cairo_pattern_t* base = Manager::get().wallpaper
+                                ? cairo_pattern_create_for_surface(Manager::get().wallpaper)
+                                : cairo_pattern_create_rgb(0, 0, 0);
+        const bool ok = root_wallpaper_repaint(base);
+        cairo_pattern_destroy(base);
+        if (!ok) {
+            return false;
+        }
+    }
+
+    cairo_t* cr = cairo_create(Manager::get().wallpaper);
+    cairo_rectangle(cr, area.left(), area.top(), area.width, area.height);
+    cairo_clip(cr);
+    cairo_set_source(cr, pattern);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(Manager::get().wallpaper);
+
+    /* The pixmap is already the background, it just has to be shown again */
+    getConnection().clear_area(
+      0,
+      screen->root,
+      {int16_t(area.left()), int16_t(area.top()), uint16_t(area.width), uint16_t(area.height)});
+    getConnection().flush();
+
+    /* Tell Lua which part of the wallpaper changed */
+    lua_State* L = globalconf_get_lua_State();
+    Lua::pusharea(L, area);
+    signal_object_emit(L, &Lua::global_signals, "wallpaper_changed"_sig, 1);
+    return true;
+}
+
+/** Check whether a change of the _XROOTPMAP_ID property was caused by setting
+ * the wallpaper ourselves.
+ * \return True if the PropertyNotify event for it should be ignored.
+ */
+bool root_wallpaper_own_change(void) {
+    if (wallpaper.own_changes == 0) {
+        return false;
+    }
+    wallpaper.own_changes--;
+    return true;
 }
 
 void root_update_wallpaper(void) {
     xcb_pixmap_t* rootpix;
 
+    /* Somebody else may have set the wallpaper */
+    wallpaper.owns_root = false;
+
     cairo_surface_destroy(Manager::get().wallpaper);
     Manager::get().wallpaper = NULL;
     auto prop_c = getConnection().get_property_unchecked(
@@ -307,6 +489,7 @@ static int luaA_root_fake_input(lua_State* L) {
         return 0;
     }
 
+    mouse_pointer_forget();
     getConnection().test_fake_input(type,
                                     detail,
                                     0, /* This is a delay, not a timestamp! */
@@ -334,14 +517,14 @@ static int luaA_root_keys(lua_State* L) {
         }
 
         Manager::get().keys.clear();
+        KeyIndex::invalidate();
 
         lua_pushnil(L);
         while (lua_next(L, 1)) {
             Manager::get().keys.push_back((keyb_t*)luaA_object_ref_class(L, -1, &key_class));
         }
 
-        xcb_screen_t* s = Manager::get().screen;
-        xwindow_grabkeys(s->root, Manager::get().keys);
+        KeySet::grab_root();
 
         return 1;
     }
@@ -355,6 +538,30 @@ static int luaA_root_keys(lua_State* L) {
     return 1;
 }
 
+/** Keeps the key set of the root window alive */
+static Lua::RegistryIdx root_key_set_ref;
+
+/** Set the key binding set active on the root window.
+ *
+ * The set is used together with `root.keys`. Only the keys which differ from
+ * the previous set are grabbed and ungrabbed.
+ *
+ * @tparam[opt] key_set set The set, see `key.new_set`, or nil to remove it.
+ * @noreturn
+ * @staticfct set_key_set
+ */
+static int luaA_root_set_key_set(lua_State* L) {
+    KeySet::Set* set = KeySet::checkopt(L, 1);
+    if (set) {
+        Lua::lregister(L, 1, &root_key_set_ref);
+    } else {
+        Lua::unregister(L, &root_key_set_ref);
+    }
+    Manager::get().key_set = set;
+    KeySet::grab_root();
+    return 0;
+}
+
 /**
  * Store the list of mouse buttons to be applied on the wallpaper (also
  * known as root window).
@@ -400,6 +607,37 @@ static int luaA_root_buttons(lua_State* L) {
     return 1;
 }
 
+/** Drop the key and button bindings of the root window, see awesome.reload.
+ * \param L The Lua VM state.
+ */
+void root_reset_bindings(lua_State* L) {
+    for (auto* key : Manager::get().keys) {
+        luaA_object_unref(L, key);
+    }
+    Manager::get().keys.clear();
+    KeyIndex::invalidate();
+    for (auto* button : Manager::get().buttons) {
+        luaA_object_unref(L, button);
+    }
+    Manager::get().buttons.clear();
+    Lua::unregister(L, &root_key_set_ref);
+    Manager::get().key_set = nullptr;
+    KeySet::grab_root();
+}
+
+/** The cursor font last set with root.cursor(), or 0 */
+static uint16_t root_cursor_font = 0;
+
+/** Give the root window its cursor again, e.g. after the cursor theme changed.
+ */
+void root_update_cursor(void) {
+    if (!root_cursor_font) {
+        return;
+    }
+    uint32_t change_win_vals[] = {xcursor_new(Manager::get().x.cursor_ctx, root_cursor_font)};
+    getConnection().change_attributes(Manager::get().screen->root, XCB_CW_CURSOR, change_win_vals);
+}
+
 /** Set the root cursor
  *
  * The possible values are:
@@ -415,10 +653,8 @@ static int luaA_root_cursor(lua_State* L) {
     uint16_t cursor_font = xcursor_font_fromstr(cursor_name);
 
     if (cursor_font) {
-        uint32_t change_win_vals[] = {xcursor_new(Manager::get().x.cursor_ctx, cursor_font)};
-
-        getConnection().change_attributes(
-          Manager::get().screen->root, XCB_CW_CURSOR, change_win_vals);
+        root_cursor_font = cursor_font;
+        root_update_cursor();
     } else {
         Lua::warn(L, "invalid cursor %s", cursor_name);
     }
@@ -472,23 +708,83 @@ static int luaA_root_wallpaper(lua_State* L) {
     return 1;
 }
 
+/** Change a part of the wallpaper.
+ *
+ * Only the given area of the wallpaper is painted, which is much cheaper than
+ * setting the whole wallpaper when only one screen changes. The
+ * `wallpaper_changed` signal gets the changed area as argument.
+ *
+ * @param pattern A cairo pattern as light userdata, in root window coordinates.
+ * @tparam table area The area to change, with `x`, `y`, `width` and `height`.
+ * @treturn boolean True if the wallpaper was changed.
+ * @staticfct wallpaper_region
+ * @see awful.wallpaper
+ */
+static int luaA_root_wallpaper_region(lua_State* L) {
+    auto pattern = (cairo_pattern_t*)lua_touserdata(L, 1);
+    if (!pattern) {
+        return Lua::typerror(L, 1, "cairo pattern");
+    }
+    Lua::checktable(L, 2);
+
+    area_t area;
+    area.top_left = {
+      (int)Lua::getopt_number_range(L, 2, "x", 0, MIN_X11_COORDINATE, MAX_X11_COORDINATE),
+      (int)Lua::getopt_number_range(L, 2, "y", 0, MIN_X11_COORDINATE, MAX_X11_COORDINATE)};
+    area.width = ceil(Lua::getopt_number_range(L, 2, "width", 0, 0, MAX_X11_SIZE));
+    area.height = ceil(Lua::getopt_number_range(L, 2, "height", 0, 0, MAX_X11_SIZE));
+
+    lua_pushboolean(L, root_set_wallpaper_region(pattern, area));
+    return 1;
+}
+
 /** Get the content of the root window as a cairo surface.
+ *
+ * The pixels are copied through a shared memory segment that is kept between
+ * captures when the X server supports MIT-SHM. Passing an area only copies
+ * that part, which is much cheaper than copying every screen.
  *
  * @property content
  * @tparam raw_surface content A cairo surface with the root window content (aka the whole surface
  * from every screens).
- * @propertydefault This is the live content. Use `gears.surface(root.content)` to
- *  take a screenshot.
+ * @tparam[opt] table area The part to copy, with `x`, `y`, `width` and `height`. The
+ *  surface then starts at the top left corner of the area.
+ * @propertydefault A copy of the content at the time of the call. Use
+ *  `gears.surface(root.content())` to take a screenshot.
  * @see gears.surface
  */
 static int luaA_root_get_content(lua_State* L) {
-    cairo_surface_t* surface;
+    const auto screen = Manager::get().screen;
+    area_t area = {{0, 0}, screen->width_in_pixels, screen->height_in_pixels};
+    if (!lua_isnoneornil(L, 1)) {
+        Lua::checktable(L, 1);
+        area.top_left = {
+          (int)Lua::getopt_number_range(L, 1, "x", 0, MIN_X11_COORDINATE, MAX_X11_COORDINATE),
+          (int)Lua::getopt_number_range(L, 1, "y", 0, MIN_X11_COORDINATE, MAX_X11_COORDINATE)};
+        area.width = ceil(Lua::getopt_number_range(L, 1, "width", area.width, 0, MAX_X11_SIZE));
+        area.height = ceil(Lua::getopt_number_range(L, 1, "height", area.height, 0, MAX_X11_SIZE));
+    }
 
-    surface = cairo_xcb_surface_create(getConnection().getConnection(),
-                                       Manager::get().screen->root,
-                                       Manager::get().default_visual,
-                                       Manager::get().screen->width_in_pixels,
-                                       Manager::get().screen->height_in_pixels);
+    cairo_surface_t* surface =
+      Capture::root(area.top_left.x, area.top_left.y, area.width, area.height);
+    if (!surface) {
+        surface = cairo_xcb_surface_create(getConnection().getConnection(),
+                                           screen->root,
+                                           Manager::get().default_visual,
+                                           screen->width_in_pixels,
+                                           screen->height_in_pixels);
+        if (!lua_isnoneornil(L, 1)) {
+            cairo_surface_t* part =
+              cairo_image_surface_create(CAIRO_FORMAT_RGB24, area.width, area.height);
+            cairo_t* cr = cairo_create(part);
+            cairo_set_source_surface(cr, surface, -area.top_left.x, -area.top_left.y);
+            cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+            cairo_paint(cr);
+            cairo_destroy(cr);
+            cairo_surface_destroy(surface);
+            surface = part;
+        }
+    }
 
     lua_pushlightuserdata(L, surface);
     return 1;
@@ -584,7 +880,9 @@ static int luaA_root_newindex(lua_State* L) {
   {                   "cursor",                    luaA_root_cursor},
   {               "fake_input",                luaA_root_fake_input},
   {                  "drawins",                   luaA_root_drawins},
+  {              "set_key_set",               luaA_root_set_key_set},
   {               "_wallpaper",                 luaA_root_wallpaper},
+  {        "_wallpaper_region",          luaA_root_wallpaper_region},
   {                  "content",               luaA_root_get_content},
   {                     "size",                      luaA_root_size},
   {                  "size_mm",                   luaA_root_size_mm},
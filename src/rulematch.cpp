@@ -0,0 +1,525 @@
+/*
+ * rulematch.cpp - native rule matching
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "rulematch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace RuleMatch {
+
+namespace {
+
+constexpr const char* metatable = "awesome.rule_set";
+
+/** Three-valued logic: Unknown is for what only Lua can decide */
+enum class Tri : uint8_t { False, True, Unknown };
+
+Tri and3(Tri a, Tri b) {
+    if (a == Tri::False || b == Tri::False) {
+        return Tri::False;
+    }
+    return a == Tri::Unknown || b == Tri::Unknown ? Tri::Unknown : Tri::True;
+}
+
+Tri or3(Tri a, Tri b) {
+    if (a == Tri::True || b == Tri::True) {
+        return Tri::True;
+    }
+    return a == Tri::Unknown || b == Tri::Unknown ? Tri::Unknown : Tri::False;
+}
+
+Tri not3(Tri a) {
+    return a == Tri::Unknown ? Tri::Unknown : a == Tri::True ? Tri::False : Tri::True;
+}
+
+/** A property value of the object */
+struct Value {
+    /** Opaque is anything else, e.g. a screen */
+    enum Type : uint8_t { Nil, Boolean, Number, String, Opaque } type = Nil;
+    bool boolean = false;
+    lua_Number number = 0;
+    std::string_view string;
+
+    bool truthy() const { return type != Nil && (type != Boolean || boolean); }
+};
+
+/** How a string of a rule is compared, the way string.match sees it */
+enum class Op : uint8_t {
+    /** `a == b`, for booleans, numbers, `""` and `^text$` */
+    Equal,
+    /** `^text` */
+    Prefix,
+    /** `text$` */
+    Suffix,
+    /** Text without pattern characters */
+    Substring,
+    /** Anything else is matched by Lua */
+    Unknown,
+};
+
+struct Condition {
+    /** Index into the fields of the rule set */
+    uint32_t field;
+    Op op;
+    Value::Type type;
+    bool boolean = false;
+    lua_Number number = 0;
+    /** The value of the rule, and the text to look for */
+    std::string raw, text;
+};
+
+/** The choices of one field in `rule_any`, `except_any` and `rule_every` */
+struct Choices {
+    uint32_t field;
+    /** `field = true` in `rule_any` and `except_any` matches any truthy value */
+    bool all = false;
+    std::vector<Condition> values;
+};
+
+/** A part of a rule, like `rule` or `except_any` */
+struct Section {
+    bool present = false;
+    /** A part with a property matcher or a key Lua handles in its own way */
+    bool lua = false;
+    std::vector<Condition> conditions;
+    std::vector<Choices> choices;
+};
+
+struct Rule {
+    Section rule, rule_any, rule_every, except, except_any;
+    /** `rule_greater` and `rule_lesser` are left to Lua */
+    bool lua = false;
+};
+
+struct RuleSet {
+    std::vector<std::string> fields;
+    std::vector<Rule> rules;
+    /** Rules whose `rule` needs an exact string, by field and string */
+    std::vector<std::unordered_map<std::string, std::vector<uint32_t>>> index;
+    /** The rules that have to be checked for every object */
+    std::vector<uint32_t> scan;
+};
+
+bool is_special(char c) { return strchr("^$*+?.([%-", c) != nullptr; }
+
+/** Find out how a string is compared by the default matcher of gears.matcher,
+ * `a == b or a:match(b)` where an empty match does not count. */
+void classify(Condition& cond) {
+    std::string_view s = cond.raw;
+    if (s.empty()) {
+        cond.op = Op::Equal;
+        return;
+    }
+    const bool anchored = s.front() == '^';
+    const bool ends = s.size() > size_t(anchored) && s.back() == '$';
+    s.remove_prefix(anchored);
+    if (ends) {
+        s.remove_suffix(1);
+    }
+    if (s.empty() || std::ranges::any_of(s, is_special)) {
+        cond.op = Op::Unknown;
+        return;
+    }
+    cond.text = s;
+    cond.op = anchored && ends ? Op::Equal
+              : anchored       ? Op::Prefix
+              : ends           ? Op::Suffix
+                               : Op::Substring;
+}
+
+Tri test(const Condition& cond, const std::vector<Value>& values) {
+    const Value& v = values[cond.field];
+    if (cond.op == Op::Unknown && cond.type != Value::String) {
+        return Tri::Unknown;
+    }
+    /* Lua only calls __eq for two tables or two userdata, so an opaque value
+     * never equals the booleans, numbers and strings of a rule */
+    if (v.type != cond.type) {
+        return Tri::False;
+    }
+    switch (cond.type) {
+    case Value::Boolean: return v.boolean == cond.boolean ? Tri::True : Tri::False;
+    case Value::Number: return v.number == cond.number ? Tri::True : Tri::False;
+    case Value::String: break;
+    default: return Tri::False;
+    }
+
+    const std::string_view s = v.string;
+    if (s == cond.raw) {
+        return Tri::True;
+    }
+    if (cond.op == Op::Unknown) {
+        return Tri::Unknown;
+    }
+    bool found = false;
+    switch (cond.op) {
+    case Op::Equal: found = s == cond.text; break;
+    case Op::Prefix: found = s.starts_with(cond.text); break;
+    case Op::Suffix: found = s.ends_with(cond.text); break;
+    case Op::Substring: found = s.find(cond.text) != std::string_view::npos; break;
+    case Op::Unknown: break;
+    }
+    return found ? Tri::True : Tri::False;
+}
+
+/** Like `matcher:_match`, every field has to match */
+Tri match_all(const Section& section, const std::vector<Value>& values) {
+    if (!section.present) {
+        return Tri::False;
+    }
+    if (section.lua) {
+        return Tri::Unknown;
+    }
+    Tri result = Tri::True;
+    for (const auto& cond : section.conditions) {
+        result = and3(result, test(cond, values));
+        if (result == Tri::False) {
+            break;
+        }
+    }
+    return result;
+}
+
+/** Like `matcher:_match_any`, one choice of one truthy field has to match */
+Tri match_any(const Section& section, const std::vector<Value>& values) {
+    if (!section.present) {
+        return Tri::False;
+    }
+    if (section.lua) {
+        return Tri::Unknown;
+    }
+    Tri result = Tri::False;
+    for (const auto& choices : section.choices) {
+        if (!values[choices.field].truthy()) {
+            continue;
+        }
+        if (choices.all) {
+            return Tri::True;
+        }
+        for (const auto& cond : choices.values) {
+            result = or3(result, test(cond, values));
+            if (result == Tri::True) {
+                return result;
+            }
+        }
+    }
+    return result;
+}
+
+/** Like `matcher:_match_every`, every field needs a matching choice */
+Tri match_every(const Section& section, const std::vector<Value>& values) {
+    if (!section.present) {
+        return Tri::True;
+    }
+    if (section.lua) {
+        return Tri::Unknown;
+    }
+    Tri result = Tri::True;
+    for (const auto& choices : section.choices) {
+        Tri found = Tri::False;
+        for (const auto& cond : choices.values) {
+            found = or3(found, test(cond, values));
+            if (found == Tri::True) {
+                break;
+            }
+        }
+        result = and3(result, found);
+        if (result == Tri::False) {
+            break;
+        }
+    }
+    return result;
+}
+
+/** Like `matcher:matches_rule` */
+Tri matches(const Rule& rule, const std::vector<Value>& values) {
+    Tri result = Tri::True;
+    if (rule.rule.present || rule.rule_any.present) {
+        result = or3(match_all(rule.rule, values), match_any(rule.rule_any, values));
+    }
+    result = and3(result, match_every(rule.rule_every, values));
+    if (rule.except.present) {
+        result = and3(result, not3(match_all(rule.except, values)));
+    }
+    if (rule.except_any.present) {
+        result = and3(result, not3(match_any(rule.except_any, values)));
+    }
+    if (rule.lua) {
+        result = and3(result, Tri::Unknown);
+    }
+    return result;
+}
+
+uint32_t intern(RuleSet& set,
+                std::unordered_map<std::string, uint32_t>& ids,
+                std::string_view field) {
+    auto [it, inserted] = ids.try_emplace(std::string(field), uint32_t(set.fields.size()));
+    if (inserted) {
+        set.fields.emplace_back(field);
+    }
+    return it->second;
+}
+
+/** Compile the value at the top of the stack. */
+Condition compile_value(lua_State* L, uint32_t field) {
+    Condition cond{field, Op::Equal, Value::Nil};
+    switch (lua_type(L, -1)) {
+    case LUA_TBOOLEAN:
+        cond.type = Value::Boolean;
+        cond.boolean = lua_toboolean(L, -1);
+        break;
+    case LUA_TNUMBER:
+        cond.type = Value::Number;
+        cond.number = lua_tonumber(L, -1);
+        break;
+    case LUA_TSTRING: {
+        size_t len;
+        const char* s = lua_tolstring(L, -1, &len);
+        cond.type = Value::String;
+        cond.raw.assign(s, len);
+        classify(cond);
+        break;
+    }
+    default: cond.op = Op::Unknown; break;
+    }
+    return cond;
+}
+
+/** Compile the section of the rule at the top of the stack.
+ * \param choices Whether the fields have lists of choices.
+ * \param any Whether the section is matched like `rule_any`, where `true`
+ *   matches every truthy value.
+ * \param matchers The index of the set of fields with a property matcher.
+ */
+Section compile_section(lua_State* L,
+                        RuleSet& set,
+                        std::unordered_map<std::string, uint32_t>& ids,
+                        const char* name,
+                        bool choices,
+                        bool any,
+                        int matchers) {
+    Section section;
+    lua_getfield(L, -1, name);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        return section;
+    }
+    section.present = true;
+    if (!lua_istable(L, -1)) {
+        section.lua = true;
+        lua_pop(L, 1);
+        return section;
+    }
+
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        if (lua_type(L, -2) != LUA_TSTRING) {
+            section.lua = true;
+            lua_pop(L, 1);
+            continue;
+        }
+        lua_pushvalue(L, -2);
+        lua_rawget(L, matchers);
+        section.lua |= !lua_isnil(L, -1);
+        lua_pop(L, 1);
+
+        const uint32_t field = intern(set, ids, lua_tostring(L, -2));
+        if (!choices) {
+            section.conditions.push_back(compile_value(L, field));
+        } else if (lua_isboolean(L, -1) && lua_toboolean(L, -1) && any) {
+            section.choices.push_back({field, true, {}});
+        } else if (!lua_istable(L, -1)) {
+            section.lua = true;
+        } else {
+            Choices c{field, false, {}};
+            for (int i = 1;; i++) {
+                lua_rawgeti(L, -1, i);
+                if (lua_isnil(L, -1)) {
+                    lua_pop(L, 1);
+                    break;
+                }
+                c.values.push_back(compile_value(L, field));
+                lua_pop(L, 1);
+            }
+            section.choices.push_back(std::move(c));
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    return section;
+}
+
+/** An exact string `rule` needs, which makes a rule indexable */
+const Condition* index_condition(const Rule& rule) {
+    if (!rule.rule.present || rule.rule.lua || rule.rule_any.present) {
+        return nullptr;
+    }
+    for (const auto& cond : rule.rule.conditions) {
+        if (cond.op == Op::Equal && cond.type == Value::String && !cond.raw.empty()) {
+            return &cond;
+        }
+    }
+    return nullptr;
+}
+
+int rule_set_gc(lua_State* L) {
+    static_cast<RuleSet*>(luaL_checkudata(L, 1, metatable))->~RuleSet();
+    return 0;
+}
+
+} // namespace
+
+/** Compile a list of gears.matcher rules.
+ *
+ * @tparam table rules The rules, as given to `gears.matcher`.
+ * @tparam table matchers The names of the properties that have a property
+ *   matcher, as keys.
+ * @return The compiled rule set.
+ * @treturn table The names of the properties `_rules_match` needs, in order.
+ * @staticfct _rules_compile
+ */
+int luaA_rules_compile(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    auto set = new (lua_newuserdata(L, sizeof(RuleSet))) RuleSet;
+    if (luaL_newmetatable(L, metatable)) {
+        lua_pushcfunction(L, rule_set_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+
+    std::unordered_map<std::string, uint32_t> ids;
+    for (int i = 1;; i++) {
+        lua_rawgeti(L, 1, i);
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            break;
+        }
+        Rule rule;
+        if (lua_istable(L, -1)) {
+            rule.rule = compile_section(L, *set, ids, "rule", false, false, 2);
+            rule.rule_any = compile_section(L, *set, ids, "rule_any", true, true, 2);
+            rule.rule_every = compile_section(L, *set, ids, "rule_every", true, false, 2);
+            rule.except = compile_section(L, *set, ids, "except", false, false, 2);
+            rule.except_any = compile_section(L, *set, ids, "except_any", true, true, 2);
+            lua_getfield(L, -1, "rule_greater");
+            lua_getfield(L, -2, "rule_lesser");
+            rule.lua = !lua_isnil(L, -1) || !lua_isnil(L, -2);
+            lua_pop(L, 2);
+        } else {
+            rule.lua = true;
+        }
+        set->rules.push_back(std::move(rule));
+        lua_pop(L, 1);
+    }
+
+    set->index.resize(set->fields.size());
+    for (uint32_t i = 0; i < set->rules.size(); i++) {
+        if (auto cond = index_condition(set->rules[i])) {
+            set->index[cond->field][cond->text].push_back(i);
+        } else {
+            set->scan.push_back(i);
+        }
+    }
+
+    lua_createtable(L, int(set->fields.size()), 0);
+    for (size_t i = 0; i < set->fields.size(); i++) {
+        lua_pushlstring(L, set->fields[i].data(), set->fields[i].size());
+        lua_rawseti(L, -2, int(i + 1));
+    }
+    return 2;
+}
+
+/** Match the properties of an object against a compiled rule set.
+ *
+ * @param set The rule set from `_rules_compile`.
+ * @tparam table values The value of each property, in the order returned by
+ *   `_rules_compile`.
+ * @treturn table The indexes of the matching rules in order. Negative indexes
+ *   are the rules that Lua has to check itself.
+ * @staticfct _rules_match
+ */
+int luaA_rules_match(lua_State* L) {
+    auto set = static_cast<RuleSet*>(luaL_checkudata(L, 1, metatable));
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    /* The strings stay alive in the table while this runs */
+    std::vector<Value> values(set->fields.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        lua_rawgeti(L, 2, int(i + 1));
+        auto& v = values[i];
+        switch (lua_type(L, -1)) {
+        case LUA_TNIL: v.type = Value::Nil; break;
+        case LUA_TBOOLEAN:
+            v.type = Value::Boolean;
+            v.boolean = lua_toboolean(L, -1);
+            break;
+        case LUA_TNUMBER:
+            v.type = Value::Number;
+            v.number = lua_tonumber(L, -1);
+            break;
+        case LUA_TSTRING: {
+            size_t len;
+            const char* s = lua_tolstring(L, -1, &len);
+            v.type = Value::String;
+            v.string = std::string_view(s, len);
+            break;
+        }
+        default: v.type = Value::Opaque; break;
+        }
+        lua_pop(L, 1);
+    }
+
+    std::vector<uint32_t> candidates = set->scan;
+    for (size_t field = 0; field < values.size(); field++) {
+        const auto& index = set->index[field];
+        if (index.empty()) {
+            continue;
+        }
+        if (values[field].type == Value::String) {
+            if (auto it = index.find(std::string(values[field].string)); it != index.end()) {
+                candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+            }
+        }
+    }
+    std::ranges::sort(candidates);
+
+    lua_newtable(L);
+    int n = 0;
+    for (uint32_t i : candidates) {
+        const Tri result = matches(set->rules[i], values);
+        if (result != Tri::False) {
+            lua_pushinteger(L, result == Tri::True ? lua_Integer(i + 1) : -lua_Integer(i + 1));
+            lua_rawseti(L, -2, ++n);
+        }
+    }
+    return 1;
+}
+
+} // namespace RuleMatch
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,36 @@
+/*
+ * rulematch.h - native rule matching header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+
+/** Rules of gears.matcher, compiled so that they are matched natively.
+ *
+ * A compiled rule set only knows the property values it is given, never the
+ * object. Conditions it cannot decide exactly like gears.matcher does, e.g.
+ * Lua patterns, functions or property matchers, are left to Lua.
+ */
+namespace RuleMatch {
+
+int luaA_rules_compile(lua_State* L);
+int luaA_rules_match(lua_State* L);
+
+} // namespace RuleMatch
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,157 @@
+/*
+ * scratch.cpp - per main loop iteration scratch arena
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "scratch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace Scratch {
+
+namespace {
+
+constexpr size_t initial_capacity = 64 * 1024;
+constexpr size_t max_capacity = 1024 * 1024;
+
+std::unique_ptr<std::byte[]> buffer;
+size_t capacity = 0;
+/** The part of the buffer handed out in this iteration */
+size_t used = 0;
+/** Heap blocks handed out once the buffer was full, freed by reset() */
+std::vector<void*> overflow;
+size_t overflow_bytes = 0;
+
+/** The C++ heap allocations made by this thread, see operator new below */
+thread_local uint64_t heap_allocations = 0;
+
+struct {
+    uint64_t iterations = 0;
+    /** Iterations which allocated from the heap */
+    uint64_t allocating = 0;
+    uint64_t total = 0;
+    uint64_t max = 0;
+    uint64_t last = 0;
+    /** Iterations which outgrew the buffer */
+    uint64_t overflows = 0;
+} stats;
+/** heap_allocations when the current iteration started */
+uint64_t iteration_start = 0;
+/** The first iteration includes the startup, it is not accounted */
+bool started = false;
+
+} // namespace
+
+void* allocate(size_t size, size_t alignment) {
+    assert(alignment <= alignof(std::max_align_t));
+    if (!buffer) {
+        buffer.reset(new std::byte[initial_capacity]);
+        capacity = initial_capacity;
+    }
+
+    const size_t start = (used + alignment - 1) & ~(alignment - 1);
+    if (start + size <= capacity) {
+        used = start + size;
+        return buffer.get() + start;
+    }
+
+    overflow_bytes += size;
+    void* block = ::operator new(size);
+    overflow.push_back(block);
+    return block;
+}
+
+void reset() {
+    const uint64_t count = heap_allocations - iteration_start;
+    if (started) {
+        stats.iterations++;
+        stats.allocating += count > 0;
+        stats.total += count;
+        stats.max = std::max(stats.max, count);
+        stats.last = count;
+    }
+    started = true;
+
+    for (void* block : overflow) {
+        ::operator delete(block);
+    }
+    overflow.clear();
+    if (overflow_bytes) {
+        stats.overflows++;
+        const size_t wanted = std::min(max_capacity, std::bit_ceil(used + overflow_bytes));
+        if (wanted > capacity) {
+            buffer.reset(new std::byte[wanted]);
+            capacity = wanted;
+        }
+        overflow_bytes = 0;
+    }
+    used = 0;
+
+    iteration_start = heap_allocations;
+}
+
+void push_stats(lua_State* L) {
+    lua_createtable(L, 0, 7);
+    lua_pushinteger(L, stats.iterations);
+    lua_setfield(L, -2, "iterations");
+    lua_pushinteger(L, stats.allocating);
+    lua_setfield(L, -2, "allocating");
+    lua_pushinteger(L, stats.total);
+    lua_setfield(L, -2, "total");
+    lua_pushinteger(L, stats.max);
+    lua_setfield(L, -2, "max");
+    lua_pushinteger(L, stats.last);
+    lua_setfield(L, -2, "last");
+    lua_pushinteger(L, capacity);
+    lua_setfield(L, -2, "scratch");
+    lua_pushinteger(L, stats.overflows);
+    lua_setfield(L, -2, "overflows");
+}
+
+void reset_stats() { stats = {}; }
+
+} // namespace Scratch
+
+/* Count the C++ heap allocations, so that the main loop can tell which
+ * iterations allocate. Everything else is left to the default implementation,
+ * which ends up here or frees with free(). */
+void* operator new(size_t size) {
+    Scratch::heap_allocations++;
+    for (;;) {
+        if (void* block = std::malloc(size ? size : 1)) {
+            return block;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void operator delete(void* block) noexcept { std::free(block); }
+
+void operator delete(void* block, size_t) noexcept { std::free(block); }
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
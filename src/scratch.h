@@ -0,0 +1,97 @@
+/*
+ * scratch.h - per main loop iteration scratch arena header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/** Memory for the temporaries of one main loop iteration.
+ *
+ * Scratch memory comes from a buffer which is handed out in order and released
+ * all at once when the main loop is about to sleep. Freeing does nothing, so
+ * nothing allocated from it may be kept past the current iteration, by a
+ * static or by an object. Locals may be live while Lua is called, even if Lua
+ * runs a nested main loop: the memory is only released by the outermost poll
+ * of the running main loop, when no work is on the stack. When the buffer runs
+ * out, the heap takes over until the next reset and the buffer grows.
+ */
+namespace Scratch {
+
+/** Get memory from the buffer of the current iteration. */
+void* allocate(size_t size, size_t alignment);
+
+/** A stateless allocator on the scratch buffer */
+template <typename T>
+struct Allocator {
+    using value_type = T;
+
+    Allocator() = default;
+    template <typename U>
+    Allocator(const Allocator<U>&) noexcept {}
+
+    T* allocate(size_t n) { return static_cast<T*>(Scratch::allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) noexcept {}
+
+    template <typename U>
+    bool operator==(const Allocator<U>&) const noexcept {
+        return true;
+    }
+};
+
+template <typename T>
+using vector = std::vector<T, Allocator<T>>;
+using string = std::basic_string<char, std::char_traits<char>, Allocator<char>>;
+template <typename K, typename V, typename Hash = std::hash<K>>
+using unordered_map =
+  std::unordered_map<K, V, Hash, std::equal_to<K>, Allocator<std::pair<const K, V>>>;
+template <typename K, typename Hash = std::hash<K>>
+using unordered_set = std::unordered_set<K, Hash, std::equal_to<K>, Allocator<K>>;
+
+/** Concatenate strings in scratch memory.
+ * \param parts Anything convertible to a string view.
+ * \return The concatenation.
+ */
+template <typename... Parts>
+string concat(const Parts&... parts) {
+    string s;
+    s.reserve((std::string_view(parts).size() + ...));
+    (s.append(std::string_view(parts)), ...);
+    return s;
+}
+
+/** Release the scratch memory and account the heap allocations of the
+ * iteration which ends. Called by the main loop before it polls, only at its
+ * outermost level and once it runs. */
+void reset();
+
+/** Push a table with the allocation statistics, see awesome.loop_stats. */
+void push_stats(lua_State* L);
+void reset_stats();
+
+} // namespace Scratch
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -97,6 +97,7 @@ static int luaA_selection_get(lua_State* L) {
              */
             event_handle(event.get());
             event = nullptr;
+            property_refetch_flush();
             awesome_refresh();
             continue;
         }
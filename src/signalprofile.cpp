@@ -0,0 +1,183 @@
+/*
+ * signalprofile.cpp - signal handler profiler
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "signalprofile.h"
+
+#include "common/luahdr.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fmt/core.h>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace SignalProfile {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/** A handler of one signal, closures count separately until dumped */
+struct Key {
+    const char* owner;
+    SignalId id;
+    const void* function;
+
+    bool operator==(const Key&) const = default;
+};
+
+struct KeyHash {
+    size_t operator()(const Key& k) const {
+        size_t h = std::hash<const void*>()(k.function);
+        h ^= std::hash<const void*>()(k.owner) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        h ^= std::hash<uint32_t>()(uint32_t(k.id)) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+struct Entry {
+    std::string source;
+    uint64_t calls = 0;
+    uint64_t total_ns = 0;
+    uint64_t self_ns = 0;
+};
+
+/** A handler that is running, innermost last */
+struct Frame {
+    Clock::time_point start;
+    uint64_t child_ns;
+};
+
+std::unordered_map<Key, Entry, KeyHash> entries;
+std::vector<Frame> frames;
+/** Bumped when the entries are dropped, the running handlers then are not counted */
+unsigned generation = 0;
+
+/** Describe where the function on top of the stack was defined */
+std::string function_source(lua_State* L) {
+    lua_Debug ar;
+    lua_pushvalue(L, -1);
+    if (!lua_getinfo(L, ">S", &ar)) {
+        return "?";
+    }
+    if (strcmp(ar.what, "C") == 0) {
+        return "[C]";
+    }
+    return fmt::format("{}:{}", ar.short_src, ar.linedefined);
+}
+
+} // namespace
+
+bool call(lua_State* L, int nargs, const char* owner, SignalId id) {
+    /* std::unordered_map keeps references to its elements valid on insertion */
+    auto [it, inserted] = entries.try_emplace(Key{owner, id, lua_topointer(L, -1)});
+    Entry& entry = it->second;
+    if (inserted) {
+        entry.source = function_source(L);
+    }
+    const unsigned started_generation = generation;
+
+    frames.push_back({Clock::now(), 0});
+    const bool ok = Lua::dofunction(L, nargs, 0);
+    const Frame frame = frames.back();
+    frames.pop_back();
+
+    const uint64_t total =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame.start).count();
+    if (!frames.empty()) {
+        frames.back().child_ns += total;
+    }
+    if (generation == started_generation) {
+        entry.calls++;
+        entry.total_ns += total;
+        entry.self_ns += total - std::min(frame.child_ns, total);
+    }
+    return ok;
+}
+
+/** Push the profile as a flat array, merging closures defined at the same place */
+static void push_profile(lua_State* L) {
+    std::map<std::tuple<std::string_view, SignalId, std::string_view>, Entry> merged;
+    for (const auto& [key, entry] : entries) {
+        auto& m = merged[{key.owner, key.id, entry.source}];
+        m.calls += entry.calls;
+        m.total_ns += entry.total_ns;
+        m.self_ns += entry.self_ns;
+    }
+
+    std::vector<std::pair<decltype(merged)::key_type, Entry>> rows(merged.begin(), merged.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.self_ns > b.second.self_ns;
+    });
+
+    lua_createtable(L, rows.size(), 0);
+    int i = 1;
+    for (const auto& [key, entry] : rows) {
+        const auto& [owner, id, source] = key;
+        lua_createtable(L, 0, 6);
+        lua_pushlstring(L, owner.data(), owner.size());
+        lua_setfield(L, -2, "class");
+        lua_pushstring(L, signal_name(id).c_str());
+        lua_setfield(L, -2, "signal");
+        lua_pushlstring(L, source.data(), source.size());
+        lua_setfield(L, -2, "source");
+        lua_pushinteger(L, entry.calls);
+        lua_setfield(L, -2, "calls");
+        lua_pushnumber(L, entry.total_ns / 1e9);
+        lua_setfield(L, -2, "total");
+        lua_pushnumber(L, entry.self_ns / 1e9);
+        lua_setfield(L, -2, "self");
+        lua_rawseti(L, -2, i++);
+    }
+}
+
+/** Profile the Lua functions connected to signals.
+ *
+ * `"start"` drops the collected data and starts timing every call of a signal
+ * handler, `"stop"` stops timing and `"dump"` returns what was collected so
+ * far. The dump is an array sorted by self time, with one table per handler of
+ * a signal: the `class` owning the signal (`"awesome"` for global signals), the
+ * `signal` name, the `source` location where the handler was defined, the
+ * number of `calls`, the `total` time and the `self` time without the handlers
+ * of signals it emitted itself. Times are in seconds.
+ *
+ * @tparam string action One of `"start"`, `"stop"` or `"dump"`.
+ * @treturn[opt] table The profile, for `"dump"`.
+ * @staticfct signal_profile
+ */
+int luaA_profile(lua_State* L) {
+    static const char* const actions[] = {"start", "stop", "dump", nullptr};
+    switch (luaL_checkoption(L, 1, nullptr, actions)) {
+    case 0:
+        entries.clear();
+        generation++;
+        enabled = true;
+        return 0;
+    case 1: enabled = false; return 0;
+    default: push_profile(L); return 1;
+    }
+}
+
+} // namespace SignalProfile
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
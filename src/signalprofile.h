@@ -0,0 +1,63 @@
+/*
+ * signalprofile.h - signal handler profiler header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/lualib.h"
+#include "common/signal.h"
+#include "luaalloc.h"
+
+struct lua_State;
+
+/** CPU time spent in the Lua functions connected to signals.
+ *
+ * While profiling, every call of a signal handler is timed and accounted to
+ * the owner of the signal, the signal and the handler. The self time excludes
+ * the handlers of signals emitted while the handler ran.
+ */
+namespace SignalProfile {
+
+/** Whether handlers are being timed */
+inline bool enabled = false;
+
+/** Call a signal handler and account its time. Only call this while enabled.
+ * \param L The Lua VM state, with the handler on top of its arguments.
+ * \param nargs The number of arguments.
+ * \param owner The name of the class owning the signal, outlives the profile.
+ * \param id The signal.
+ * \return True on no error, false otherwise.
+ */
+bool call(lua_State* L, int nargs, const char* owner, SignalId id);
+
+/** Call a signal handler like Lua::dofunction() does, without return values.
+ * \param L The Lua VM state, with the handler on top of its arguments.
+ * \param nargs The number of arguments.
+ * \param owner The name of the class owning the signal, outlives the profile.
+ * \param id The signal.
+ * \return True on no error, false otherwise.
+ */
+static inline bool dofunction(lua_State* L, int nargs, const char* owner, SignalId id) {
+    LuaAlloc::SignalScope alloc_scope(id);
+    return enabled ? call(L, nargs, owner, id) : Lua::dofunction(L, nargs, 0);
+}
+
+int luaA_profile(lua_State* L);
+
+} // namespace SignalProfile
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -60,15 +60,23 @@
 #include "luaa.h"
 
 #include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
 #include <glib.h>
 #include <memory>
 #include <set>
+#include <spawn.h>
+#include <string>
 #include <string_view>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
+extern char** environ;
+
 /** 20 seconds timeout */
 #define AWESOME_SPAWN_TIMEOUT 20.0
 
@@ -78,8 +86,23 @@ struct SnStartupDeleter {
     void operator()(SnStartupSequence* sss) { return sn_startup_sequence_unref(sss); }
 };
 using StartupSequenceHandle = std::unique_ptr<SnStartupSequence, SnStartupDeleter>;
-/** The array of startup sequence running */
-std::vector<StartupSequenceHandle> sn_waits;
+
+struct PendingSequence {
+    StartupSequenceHandle sequence;
+    /** When the sequence times out, in microseconds of monotonic time */
+    gint64 deadline;
+};
+
+/** The startup sequences running, by startup id */
+static std::unordered_map<std::string, PendingSequence> sn_waits;
+
+/** The startup ids in the order they time out. All sequences get the same
+ * timeout, so this is sorted by deadline. Ids of sequences that ended stay
+ * here until they are reached and are then skipped. */
+static std::deque<std::pair<gint64, std::string>> sn_expiry;
+
+/** The GLib source expiring the front of sn_expiry, or 0 */
+static guint sn_expiry_source = 0;
 
 struct running_child_t {
     GPid pid;
@@ -99,41 +122,76 @@ struct ChildPidComparator {
 
 static std::set<running_child_t, ChildPidComparator> running_children;
 
-/** Remove a SnStartupSequence pointer from an array and forget about it.
+/** Remove a startup sequence and forget about it.
  * \param s The startup sequence to find, remove and unref.
  * \return True if found and removed.
  */
 static inline bool spawn_sequence_remove(SnStartupSequence* s) {
-    auto it = std::find_if(
-      sn_waits.begin(), sn_waits.end(), [s](const auto& var) { return var.get() == s; });
-    if (it == sn_waits.end()) {
+    auto it = sn_waits.find(sn_startup_sequence_get_id(s));
+    if (it == sn_waits.end() || it->second.sequence.get() != s) {
         return false;
     }
     sn_waits.erase(it);
-    return false;
+    return true;
 }
 
-static gboolean spawn_monitor_timeout(gpointer sequence) {
-    if (spawn_sequence_remove((SnStartupSequence*)sequence)) {
-        auto sigIt = Lua::global_signals.find("spawn::timeout");
-        if (sigIt != Lua::global_signals.end()) {
-            /* send a timeout signal */
-            lua_State* L = globalconf_get_lua_State();
-            lua_createtable(L, 0, 2);
-            lua_pushstring(L, sn_startup_sequence_get_id((SnStartupSequence*)sequence));
-            lua_setfield(L, -2, "id");
-            for (auto func : sigIt->second.functions) {
-                lua_pushvalue(L, -1);
-                luaA_object_push(L, func);
-                Lua::dofunction(L, 1, 0);
-            }
-            lua_pop(L, 1);
+static void spawn_emit_timeout(const std::string& id) {
+    auto sigIt = Lua::global_signals.find("spawn::timeout"_sig);
+    if (sigIt != Lua::global_signals.end()) {
+        lua_State* L = globalconf_get_lua_State();
+        lua_createtable(L, 0, 2);
+        lua_pushlstring(L, id.data(), id.size());
+        lua_setfield(L, -2, "id");
+        for (auto func : sigIt->second.functions) {
+            lua_pushvalue(L, -1);
+            luaA_object_push(L, func);
+            Lua::dofunction(L, 1, 0);
         }
+        lua_pop(L, 1);
     }
-    sn_startup_sequence_unref((SnStartupSequence*)sequence);
+}
+
+static void spawn_expiry_arm();
+
+/** Drop all sequences whose deadline passed and send a timeout signal for each.
+ */
+static gboolean spawn_monitor_timeout(gpointer) {
+    sn_expiry_source = 0;
+    const gint64 now = g_get_monotonic_time();
+    while (!sn_expiry.empty() && sn_expiry.front().first <= now) {
+        auto [deadline, id] = std::move(sn_expiry.front());
+        sn_expiry.pop_front();
+        auto it = sn_waits.find(id);
+        /* A sequence that ended, or was started again under the same id */
+        if (it == sn_waits.end() || it->second.deadline != deadline) {
+            continue;
+        }
+        sn_waits.erase(it);
+        spawn_emit_timeout(id);
+    }
+    spawn_expiry_arm();
     return FALSE;
 }
 
+/** Make sure the front of sn_expiry is expired in time */
+static void spawn_expiry_arm() {
+    /* Skip the ids of sequences that already ended */
+    while (!sn_expiry.empty()) {
+        auto it = sn_waits.find(sn_expiry.front().second);
+        if (it != sn_waits.end() && it->second.deadline == sn_expiry.front().first) {
+            break;
+        }
+        sn_expiry.pop_front();
+    }
+    if (sn_expiry_source || sn_expiry.empty()) {
+        return;
+    }
+    const gint64 delay_us = std::max<gint64>(sn_expiry.front().first - g_get_monotonic_time(), 0);
+    /* Round up, a source that fires early would just have to be armed again */
+    sn_expiry_source =
+      g_timeout_add(guint((delay_us + 999) / 1000), spawn_monitor_timeout, nullptr);
+}
+
 static void spawn_monitor_event(SnMonitorEvent* event, void* data) {
     lua_State* L = globalconf_get_lua_State();
     SnStartupSequence* sequence = sn_monitor_event_get_startup_sequence(event);
@@ -146,18 +204,19 @@ static void spawn_monitor_event(SnMonitorEvent* event, void* data) {
     const char* event_type_str = NULL;
 
     switch (event_type) {
-    case SN_MONITOR_EVENT_INITIATED:
-        /* ref the sequence for the array */
+    case SN_MONITOR_EVENT_INITIATED: {
+        /* ref the sequence for the map */
         sn_startup_sequence_ref(sequence);
-        sn_waits.push_back(StartupSequenceHandle{sequence});
+        const gint64 deadline =
+          g_get_monotonic_time() + gint64(AWESOME_SPAWN_TIMEOUT * G_USEC_PER_SEC);
+        std::string id = sn_startup_sequence_get_id(sequence);
+        sn_waits.insert_or_assign(id, PendingSequence{StartupSequenceHandle{sequence}, deadline});
         event_type_str = "spawn::initiated";
 
-        /* Add a timeout function so we do not wait for this event to complete
-         * for ever */
-        g_timeout_add_seconds(AWESOME_SPAWN_TIMEOUT, spawn_monitor_timeout, sequence);
-        /* ref the sequence for the callback event */
-        sn_startup_sequence_ref(sequence);
-        break;
+        /* Expire it so we do not wait for this event to complete for ever */
+        sn_expiry.emplace_back(deadline, std::move(id));
+        spawn_expiry_arm();
+    } break;
     case SN_MONITOR_EVENT_CHANGED: event_type_str = "spawn::change"; break;
     case SN_MONITOR_EVENT_COMPLETED: event_type_str = "spawn::completed"; break;
     case SN_MONITOR_EVENT_CANCELED: event_type_str = "spawn::canceled"; break;
@@ -218,31 +277,29 @@ static void spawn_monitor_event(SnMonitorEvent* event, void* data) {
  * \param startup_id The startup id of the started application.
  */
 void spawn_start_notify(client* c, const char* startup_id) {
-    for (auto& _seq : sn_waits) {
-        SnStartupSequence* seq = _seq.get();
-        bool found = false;
-        const char* seqid = sn_startup_sequence_get_id(seq);
+    SnStartupSequence* found = nullptr;
 
-        if (strcmp(seqid, startup_id) != 0) {
-            found = true;
-        } else {
+    if (auto it = sn_waits.find(startup_id); it != sn_waits.end()) {
+        found = it->second.sequence.get();
+    } else {
+        /* Without a matching id, a sequence for the same program will do */
+        for (auto& [id, pending] : sn_waits) {
+            SnStartupSequence* seq = pending.sequence.get();
             const char* seqclass = sn_startup_sequence_get_wmclass(seq);
             seqclass = seqclass ? seqclass : "";
-            if (c->getCls() == seqclass || c->getInstance() == seqclass) {
-                found = true;
-            } else {
-                auto seqbin = std::string_view(sn_startup_sequence_get_binary_name(seq));
-                if (std::ranges::equal(seqbin, c->getCls(), ichar_equals) ||
-                    std::ranges::equal(seqbin, c->getInstance(), ichar_equals)) {
-                    found = true;
-                }
+            const char* seqbin = sn_startup_sequence_get_binary_name(seq);
+            const auto bin = std::string_view(seqbin ? seqbin : "");
+            if (c->getCls() == seqclass || c->getInstance() == seqclass ||
+                (!bin.empty() && (std::ranges::equal(bin, c->getCls(), ichar_equals) ||
+                                  std::ranges::equal(bin, c->getInstance(), ichar_equals)))) {
+                found = seq;
+                break;
             }
         }
+    }
 
-        if (found) {
-            sn_startup_sequence_complete(seq);
-            break;
-        }
+    if (found) {
+        sn_startup_sequence_complete(found);
     }
 }
 
@@ -273,6 +330,123 @@ static void spawn_callback(gpointer user_data) {
     }
 }
 
+/** How luaA_spawn() starts processes */
+enum class SpawnBackend {
+    /** posix_spawn(), which does not copy the page tables of this process */
+    PosixSpawn,
+    /** g_spawn_async_with_pipes(), which forks */
+    GLib,
+};
+
+static SpawnBackend spawn_backend = SpawnBackend::PosixSpawn;
+
+/** Start a process with posix_spawnp(), like g_spawn_async_with_pipes() with
+ * G_SPAWN_SEARCH_PATH and spawn_callback() as child setup would.
+ * The child is not reaped by GLib, reap_children() takes care of it.
+ * \param argv The command line.
+ * \param envp The environment, or NULL for the one of this process.
+ * \param context The startup notification context, or NULL.
+ * \param pid Where to store the process id.
+ * \param stdin_ptr Where to store the write end of a pipe to stdin, or NULL.
+ * \param stdout_ptr Where to store the read end of a pipe from stdout, or NULL.
+ * \param stderr_ptr Where to store the read end of a pipe from stderr, or NULL.
+ * \param error Where to store an error.
+ * \return True on success.
+ */
+static bool spawn_posix(gchar** argv,
+                        gchar** envp,
+                        SnLauncherContext* context,
+                        GPid* pid,
+                        int* stdin_ptr,
+                        int* stdout_ptr,
+                        int* stderr_ptr,
+                        GError** error) {
+    /* What spawn_callback() does in the child */
+    const std::string startup_env =
+      context ? std::string("DESKTOP_STARTUP_ID=") + sn_launcher_context_get_startup_id(context)
+              : std::string();
+    std::vector<char*> env;
+    for (char** e = envp ? envp : environ; *e; e++) {
+        if (!g_str_has_prefix(*e, "DESKTOP_STARTUP_ID=")) {
+            env.push_back(*e);
+        }
+    }
+    if (context) {
+        env.push_back(const_cast<char*>(startup_env.c_str()));
+    }
+    env.push_back(nullptr);
+
+    int* const ptrs[3] = {stdin_ptr, stdout_ptr, stderr_ptr};
+    int pipes[3][2] = {
+      {-1, -1},
+      {-1, -1},
+      {-1, -1}
+    };
+    auto close_pipes = [&] {
+        for (auto& p : pipes) {
+            for (int fd : p) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+            }
+        }
+    };
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+
+    int err = 0;
+    for (int i = 0; i < 3 && !err; i++) {
+        if (!ptrs[i]) {
+            continue;
+        }
+        if (pipe2(pipes[i], O_CLOEXEC) != 0) {
+            err = errno;
+            break;
+        }
+        /* stdin is written by us, stdout and stderr are read */
+        const int child_end = pipes[i][i == 0 ? 0 : 1];
+        err = posix_spawn_file_actions_adddup2(&actions, child_end, i);
+    }
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+    /* GLib closes everything else as well */
+    if (!err) {
+        err = posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+    }
+#endif
+    if (!err) {
+        pid_t child;
+        err = posix_spawnp(&child, argv[0], &actions, &attr, argv, env.data());
+        *pid = child;
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (err) {
+        close_pipes();
+        g_set_error(error,
+                    G_SPAWN_ERROR,
+                    G_SPAWN_ERROR_FAILED,
+                    "Failed to execute child process “%s” (%s)",
+                    argv[0],
+                    g_strerror(err));
+        return false;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        if (ptrs[i]) {
+            const int parent_end = i == 0 ? 1 : 0;
+            *ptrs[i] = pipes[i][parent_end];
+            pipes[i][parent_end] = -1;
+        }
+    }
+    close_pipes();
+    return true;
+}
+
 /** Convert a Lua table of strings to a char** array.
  * \param L The Lua VM state.
  * \param idx The index of the table that we should parse.
@@ -348,6 +522,10 @@ void spawn_child_exited(pid_t pid, int status) {
     }
     exit_callback = it->exit_callback;
     running_children.erase(it);
+    if (!exit_callback) {
+        /* Started by spawn_posix() without a callback */
+        return;
+    }
 
     /* 'Decode' the exit status */
     if (WIFEXITED(status)) {
@@ -459,17 +637,21 @@ int luaA_spawn(lua_State* L) {
     }
 
     flags |= G_SPAWN_SEARCH_PATH | G_SPAWN_CLOEXEC_PIPES;
-    retval = g_spawn_async_with_pipes(NULL,
-                                      argv,
-                                      envp,
-                                      (GSpawnFlags)flags,
-                                      spawn_callback,
-                                      context,
-                                      &pid,
-                                      stdin_ptr,
-                                      stdout_ptr,
-                                      stderr_ptr,
-                                      &error);
+    if (spawn_backend == SpawnBackend::PosixSpawn) {
+        retval = spawn_posix(argv, envp, context, &pid, stdin_ptr, stdout_ptr, stderr_ptr, &error);
+    } else {
+        retval = g_spawn_async_with_pipes(NULL,
+                                          argv,
+                                          envp,
+                                          (GSpawnFlags)flags,
+                                          spawn_callback,
+                                          context,
+                                          &pid,
+                                          stdin_ptr,
+                                          stdout_ptr,
+                                          stderr_ptr,
+                                          &error);
+    }
     g_strfreev(argv);
     g_strfreev(envp);
     if (!retval) {
@@ -486,6 +668,9 @@ int luaA_spawn(lua_State* L) {
         running_child_t child = {.pid = pid, .exit_callback = {}};
         Lua::registerfct(L, 6, &child.exit_callback);
         running_children.insert(child);
+    } else if (spawn_backend == SpawnBackend::PosixSpawn) {
+        /* GLib would have double forked, the child is ours to reap */
+        running_children.insert({.pid = pid, .exit_callback = {}});
     }
 
     /* push pid on stack */
@@ -517,4 +702,28 @@ int luaA_spawn(lua_State* L) {
     return 5;
 }
 
+/** Choose how `awesome.spawn` starts processes.
+ *
+ * `"posix_spawn"` (the default) uses `posix_spawn()`, which does not copy the
+ * page tables of the window manager and is thus much cheaper for a large
+ * process. `"glib"` forks through `g_spawn_async_with_pipes()` as in older
+ * versions. Both set up pipes, the environment and startup notification the
+ * same way.
+ *
+ * @tparam string backend `"posix_spawn"` or `"glib"`.
+ * @staticfct set_spawn_backend
+ * @noreturn
+ */
+int luaA_set_spawn_backend(lua_State* L) {
+    const std::string_view name = luaL_checkstring(L, 1);
+    if (name == "posix_spawn") {
+        spawn_backend = SpawnBackend::PosixSpawn;
+    } else if (name == "glib") {
+        spawn_backend = SpawnBackend::GLib;
+    } else {
+        luaL_argerror(L, 1, "expected \"posix_spawn\" or \"glib\"");
+    }
+    return 0;
+}
+
 // vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -26,4 +26,5 @@
 void spawn_init(void);
 void spawn_start_notify(client*, const char*);
 int luaA_spawn(lua_State*);
+int luaA_set_spawn_backend(lua_State*);
 void spawn_child_exited(pid_t, int);
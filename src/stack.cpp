@@ -25,51 +25,172 @@
 #include "globalconf.h"
 #include "objects/client.h"
 #include "objects/drawin.h"
+#include "objects/screen.h"
+#include "scratch.h"
 
 #include <algorithm>
 #include <array>
+#include <ranges>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
-void stack_client_remove(client* c) {
-    auto it =
-      std::ranges::find_if(Manager::get().getStack(), [c](auto client) { return c == client; });
-    if (it == Manager::get().getStack().end()) {
-        return;
+/** The client stack is a list linked through client::stack_below and
+ * client::stack_above, so clients move in constant time. The vector view of it
+ * is only rebuilt when it is read after a change. */
+static client* stack_lowest = nullptr;
+static client* stack_highest = nullptr;
+static std::vector<client*> stack_vector;
+static bool stack_vector_dirty = false;
+
+/** Get the client stack.
+ * \return The clients from bottom to top.
+ */
+const std::vector<client*>& stack_get(void) {
+    if (stack_vector_dirty) {
+        stack_vector.clear();
+        for (client* c = stack_lowest; c; c = c->stack_above) {
+            c->stack_position = stack_vector.size();
+            stack_vector.push_back(c);
+        }
+        stack_vector_dirty = false;
     }
-    Manager::get().refStack().erase(it);
+    return stack_vector;
+}
+
+/** Get the client at the top of the stack, without building the vector.
+ * \return The client, or NULL if the stack is empty.
+ */
+client* stack_top(void) { return stack_highest; }
+
+/** Get the client at the bottom of the stack, without building the vector.
+ * \return The client, or NULL if the stack is empty.
+ */
+client* stack_bottom(void) { return stack_lowest; }
+
+static bool stack_contains(client* c) { return c->stack_below || stack_lowest == c; }
+
+static void stack_unlink(client* c) {
+    (c->stack_below ? c->stack_below->stack_above : stack_lowest) = c->stack_above;
+    (c->stack_above ? c->stack_above->stack_below : stack_highest) = c->stack_below;
+    c->stack_below = c->stack_above = nullptr;
+}
+
+static void stack_link_top(client* c) {
+    c->stack_below = stack_highest;
+    (stack_highest ? stack_highest->stack_above : stack_lowest) = c;
+    stack_highest = c;
+}
+
+/** Publish a change of the stack */
+static void stack_changed() {
+    stack_vector_dirty = true;
     ewmh_update_net_client_list_stacking();
     stack_windows();
 }
 
+void stack_client_remove(client* c) {
+    if (!stack_contains(c)) {
+        return;
+    }
+    stack_unlink(c);
+    screen_stack_index_moved(c, SCREEN_STACK_NONE);
+    stack_changed();
+}
+
 /** Push the client at the beginning of the client stack.
  * \param c The client to push.
  */
 void stack_client_push(client* c) {
-    stack_client_remove(c);
-    Manager::get().refStack().insert(Manager::get().getStack().begin(), c);
-    ewmh_update_net_client_list_stacking();
-    stack_windows();
+    if (stack_contains(c)) {
+        stack_unlink(c);
+    }
+    c->stack_above = stack_lowest;
+    (stack_lowest ? stack_lowest->stack_below : stack_highest) = c;
+    stack_lowest = c;
+    screen_stack_index_moved(c, SCREEN_STACK_BOTTOM);
+    stack_changed();
 }
 
 /** Push the client at the end of the client stack.
  * \param c The client to push.
  */
 void stack_client_append(client* c) {
-    stack_client_remove(c);
-    Manager::get().refStack().push_back(c);
-    ewmh_update_net_client_list_stacking();
-    stack_windows();
+    if (stack_contains(c)) {
+        stack_unlink(c);
+    }
+    stack_link_top(c);
+    screen_stack_index_moved(c, SCREEN_STACK_TOP);
+    stack_changed();
+}
+
+/** Change the stacking order of many clients at once.
+ * \param clients The clients, from bottom to top. Clients which are not
+ * managed anymore are ignored. Of duplicates, the last one counts when raising,
+ * like when raising each client in turn, and the first one otherwise.
+ * \param raise If true, the clients are put on top of the stack. Otherwise
+ * they are put in the places they held in the stack, so other clients do not
+ * move.
+ */
+void stack_client_restack(const std::vector<client*>& clients, bool raise) {
+    std::vector<client*> moved;
+    std::unordered_set<client*> seen;
+    auto keep = [&](client* c) {
+        if (stack_contains(c) && seen.insert(c).second) {
+            moved.push_back(c);
+        }
+    };
+    if (raise) {
+        std::ranges::for_each(clients | std::views::reverse, keep);
+        std::ranges::reverse(moved);
+    } else {
+        std::ranges::for_each(clients, keep);
+    }
+    if (moved.empty()) {
+        return;
+    }
+
+    if (raise) {
+        for (auto* c : moved) {
+            stack_unlink(c);
+            stack_link_top(c);
+        }
+    } else {
+        std::vector<client*> order = stack_get();
+        std::vector<size_t> positions;
+        positions.reserve(moved.size());
+        for (auto* c : moved) {
+            positions.push_back(c->stack_position);
+        }
+        std::ranges::sort(positions);
+        for (size_t i = 0; i < moved.size(); i++) {
+            order[positions[i]] = moved[i];
+        }
+        stack_lowest = stack_highest = nullptr;
+        for (auto* c : order) {
+            c->stack_above = nullptr;
+            stack_link_top(c);
+        }
+    }
+    screen_stack_index_invalidate();
+    stack_changed();
 }
 
 static bool need_stack_refresh = false;
 
 void stack_windows(void) { need_stack_refresh = true; }
 
-/** Stack a window above another window, without causing errors.
+/** The frame and drawin windows in the order they were last stacked, from
+ * bottom to top */
+static std::vector<xcb_window_t> stacked_windows;
+
+/** Stack a window relative to another window, without causing errors.
  * \param w The window.
- * \param previous The window which should be below this window.
+ * \param sibling The window which should be next to this window.
+ * \param mode XCB_STACK_MODE_ABOVE or XCB_STACK_MODE_BELOW.
  */
-static void stack_window_above(xcb_window_t w, xcb_window_t previous) {
-    if (previous == XCB_NONE) {
+static void stack_window_relative(xcb_window_t w, xcb_window_t sibling, uint32_t mode) {
+    if (sibling == XCB_NONE) {
         /* This would cause an error from the X server. Also, if we really
          * changed the stacking order of all windows, they'd all have to redraw
          * themselves. Doing it like this is better. */
@@ -77,27 +198,67 @@ static void stack_window_above(xcb_window_t w, xcb_window_t previous) {
     }
     getConnection().configure_window(w,
                                      XCB_CONFIG_WINDOW_SIBLING | XCB_CONFIG_WINDOW_STACK_MODE,
-                                     std::array<uint32_t, 2>{previous, XCB_STACK_MODE_ABOVE});
+                                     std::array<uint32_t, 2>{sibling, mode});
 }
 
-/** Stack a client above.
+using transients_map = Scratch::unordered_map<client*, Scratch::vector<client*>>;
+
+/** Append a client and, recursively, its transients to the stacking order.
  * \param c The client.
- * \param previous The previous client on the stack.
- * \return The next-previous!
+ * \param transients The transients of every client, in stack order.
+ * \param order The stacking order being built.
  */
-static xcb_window_t stack_client_above(client* c, xcb_window_t previous) {
-    stack_window_above(c->frame_window, previous);
-
-    previous = c->frame_window;
+static void stack_client_above(client* c,
+                               const transients_map& transients,
+                               Scratch::vector<xcb_window_t>& order) {
+    order.push_back(c->frame_window);
 
     /* stack transient window on top of their parents */
-    for (auto* node : Manager::get().getStack()) {
-        if (node->transient_for == c) {
-            previous = stack_client_above(node, previous);
+    if (auto it = transients.find(c); it != transients.end()) {
+        for (auto* node : it->second) {
+            stack_client_above(node, transients, order);
+        }
+    }
+}
+
+/** Find which windows keep their relative order between the last stacking and
+ * the new one: the longest subsequence of the new order which is increasing in
+ * the old order. These windows do not have to be restacked.
+ * \param order The new stacking order.
+ * \return For each window of order, true if it can stay where it is.
+ */
+static Scratch::vector<bool> stack_unmoved_windows(const Scratch::vector<xcb_window_t>& order) {
+    Scratch::unordered_map<xcb_window_t, size_t> old_position;
+    for (size_t i = 0; i < stacked_windows.size(); i++) {
+        old_position[stacked_windows[i]] = i;
+    }
+
+    /* Patience sorting: tails[k] is the index in order of the smallest old
+     * position ending an increasing subsequence of length k + 1 */
+    Scratch::vector<size_t> tails, parent(order.size(), SIZE_MAX);
+    for (size_t i = 0; i < order.size(); i++) {
+        auto it = old_position.find(order[i]);
+        if (it == old_position.end()) {
+            continue;
+        }
+        const size_t pos = it->second;
+        auto k = std::ranges::lower_bound(
+          tails, pos, {}, [&](size_t idx) { return old_position[order[idx]]; });
+        if (k != tails.begin()) {
+            parent[i] = *(k - 1);
+        }
+        if (k == tails.end()) {
+            tails.push_back(i);
+        } else {
+            *k = i;
         }
     }
 
-    return previous;
+    Scratch::vector<bool> unmoved(order.size(), false);
+    for (size_t i = tails.empty() ? SIZE_MAX : tails.back(); i != SIZE_MAX; i = parent[i]) {
+        unmoved[i] = true;
+    }
+    return unmoved;
 }
 
 /** Stacking layout layers */
@@ -146,50 +307,85 @@ static window_layer_t client_layer_translator(client* c) {
 }
 
 /** Restack clients.
- * \todo It might be worth stopping to restack everyone and only stack `c'
- * relatively to the first matching in the list.
+ * The wanted stacking order is computed in one go and compared with the last
+ * one, only the windows which changed their relative position are restacked.
  */
 void stack_refresh() {
     if (!need_stack_refresh) {
         return;
     }
 
-    xcb_window_t next = XCB_NONE;
+    /* Bucket clients per layer and transients per parent, keeping stack order */
+    std::array<Scratch::vector<client*>, WINDOW_LAYER_COUNT> layers;
+    transients_map transients;
+    for (auto* node : Manager::get().getStack()) {
+        layers[client_layer_translator(node)].push_back(node);
+        if (node->transient_for) {
+            transients[node->transient_for].push_back(node);
+        }
+    }
+
+    Scratch::vector<xcb_window_t> order;
+    order.reserve(Manager::get().getStack().size() + Manager::get().drawins.size());
 
     /* stack desktop windows */
     for (int layer = WINDOW_LAYER_DESKTOP; layer < WINDOW_LAYER_BELOW; layer++) {
-        for (auto* node : Manager::get().getStack()) {
-            if (client_layer_translator(node) == layer) {
-                next = stack_client_above(node, next);
-            }
+        for (auto* node : layers[layer]) {
+            stack_client_above(node, transients, order);
         }
     }
 
     /* first stack not ontop drawin window */
     for (auto drawin : Manager::get().drawins) {
         if (!drawin->ontop) {
-            stack_window_above(drawin->window, next);
-            next = drawin->window;
+            order.push_back(drawin->window);
         }
     }
 
     /* then stack clients */
     for (int layer = WINDOW_LAYER_BELOW; layer < WINDOW_LAYER_COUNT; layer++) {
-        for (auto* node : Manager::get().getStack()) {
-            if (client_layer_translator(node) == layer) {
-                next = stack_client_above(node, next);
-            }
+        for (auto* node : layers[layer]) {
+            stack_client_above(node, transients, order);
         }
     }
 
     /* then stack ontop drawin window */
     for (auto* drawin : Manager::get().drawins) {
         if (drawin->ontop) {
-            stack_window_above(drawin->window, next);
-            next = drawin->window;
+            order.push_back(drawin->window);
+        }
+    }
+
+    /* A transient with its own layer is stacked twice, the last one wins */
+    Scratch::unordered_set<xcb_window_t> seen;
+    Scratch::vector<xcb_window_t> deduplicated;
+    deduplicated.reserve(order.size());
+    for (auto w : order | std::views::reverse) {
+        if (seen.insert(w).second) {
+            deduplicated.push_back(w);
+        }
+    }
+    std::ranges::reverse(deduplicated);
+    order = std::move(deduplicated);
+
+    /* Windows which moved are put above their new predecessor, from bottom to
+     * top. The bottom one has no predecessor and goes below the lowest window
+     * that stays in place. */
+    const auto unmoved = stack_unmoved_windows(order);
+    const auto first_unmoved = std::ranges::find(unmoved, true);
+    for (size_t i = 0; i < order.size(); i++) {
+        if (unmoved[i]) {
+            continue;
+        }
+        if (i > 0) {
+            stack_window_relative(order[i], order[i - 1], XCB_STACK_MODE_ABOVE);
+        } else if (first_unmoved != unmoved.end()) {
+            stack_window_relative(
+              order[i], order[first_unmoved - unmoved.begin()], XCB_STACK_MODE_BELOW);
         }
     }
 
+    stacked_windows.assign(order.begin(), order.end());
     need_stack_refresh = false;
 }
 
@@ -20,10 +20,16 @@
  */
 #pragma once
 
+#include <vector>
+
 struct client;
 
+const std::vector<client*>& stack_get(void);
+client* stack_top(void);
+client* stack_bottom(void);
 void stack_client_remove(client*);
 void stack_client_push(client*);
 void stack_client_append(client*);
+void stack_client_restack(const std::vector<client*>&, bool);
 void stack_windows(void);
 void stack_refresh(void);
@@ -190,18 +190,23 @@ int systray_process_client_message(xcb_client_message_event_t* ev) {
     return systray_request_handle(ev->data.data32[2]);
 }
 
-/** Check if a window is a KDE tray.
+/** Send the request to check if a window is a KDE tray.
  * \param w The window to check.
- * \return True if it is, false otherwise.
+ * \return The cookie, for systray_iskdedockapp_reply().
  */
-bool systray_iskdedockapp(xcb_window_t w) {
+xcb_get_property_cookie_t systray_iskdedockapp_unchecked(xcb_window_t w) {
     /* Check if that is a KDE tray because it does not respect fdo standards,
      * thanks KDE. */
-
-    auto kde_check_q = getConnection().get_property_unchecked(
+    return getConnection().get_property_unchecked(
       false, w, _KDE_NET_WM_SYSTEM_TRAY_WINDOW_FOR, XCB_ATOM_WINDOW, 0, 1);
+}
 
-    auto kde_check = getConnection().get_property_reply(kde_check_q);
+/** Check if a window is a KDE tray.
+ * \param cookie The cookie returned by systray_iskdedockapp_unchecked().
+ * \return True if it is, false otherwise.
+ */
+bool systray_iskdedockapp_reply(xcb_get_property_cookie_t cookie) {
+    auto kde_check = getConnection().get_property_reply(cookie);
 
     /* it's a KDE systray ?*/
     return (kde_check && kde_check->value_len);
@@ -231,7 +236,7 @@ namespace Lua {
  */
 void systray_invalidate(void) {
     lua_State* L = globalconf_get_lua_State();
-    signal_object_emit(L, &global_signals, "systray::update", 0);
+    signal_object_emit(L, &global_signals, "systray::update"_sig, 0);
 
     /* Unmap now if the systray became empty */
     if (systray_num_visible_entries() == 0) {
@@ -239,6 +244,10 @@ void systray_invalidate(void) {
     }
 }
 }
+/** Lay out the systray and its icons.
+ * Only the windows whose geometry or visibility differs from what was applied
+ * last time are configured, mapped or unmapped.
+ */
 static void systray_update(
   int base_size, bool horizontal, bool reverse, int spacing, bool force_redraw, int rows) {
     if (base_size <= 0) {
@@ -248,21 +257,23 @@ static void systray_update(
     /* Give the systray window the correct size */
     int num_entries = systray_num_visible_entries();
     int cols = (num_entries + rows - 1) / rows;
-    std::array<uint32_t, 4> config_vals = {0, 0, 0, 0};
+    std::array<uint32_t, 2> size;
     if (horizontal) {
-        config_vals[0] = base_size * cols + spacing * (cols - 1);
-        config_vals[1] = base_size * rows + spacing * (rows - 1);
+        size[0] = base_size * cols + spacing * (cols - 1);
+        size[1] = base_size * rows + spacing * (rows - 1);
     } else {
-        config_vals[0] = base_size * rows + spacing * (rows - 1);
-        config_vals[1] = base_size * cols + spacing * (cols - 1);
+        size[0] = base_size * rows + spacing * (rows - 1);
+        size[1] = base_size * cols + spacing * (cols - 1);
+    }
+    if (size != Manager::get().systray.size) {
+        getConnection().configure_window(Manager::get().systray.window,
+                                         XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
+                                         size);
+        Manager::get().systray.size = size;
     }
-    getConnection().configure_window(Manager::get().systray.window,
-                                     XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
-                                     config_vals);
 
     /* Now resize each embedded window */
-    config_vals[0] = config_vals[1] = 0;
-    config_vals[2] = config_vals[3] = base_size;
+    std::array<uint32_t, 4> config_vals = {0, 0, uint32_t(base_size), uint32_t(base_size)};
     for (size_t i = 0; i < Manager::get().embedded.size(); i++) {
         decltype(Manager::get().embedded)::iterator em;
 
@@ -273,15 +284,25 @@ static void systray_update(
         }
 
         if (!(em->info.flags & static_cast<uint32_t>(XEmbed::InfoFlags::MAPPED))) {
-            getConnection().unmap_window(em->win);
+            if (!em->placed || em->mapped) {
+                getConnection().unmap_window(em->win);
+                em->placed = true;
+                em->mapped = false;
+            }
             continue;
         }
 
-        getConnection().configure_window(em->win,
-                                         XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
-                                           XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
-                                         config_vals);
-        getConnection().map_window(em->win);
+        if (!em->placed || em->geometry != config_vals) {
+            getConnection().configure_window(em->win,
+                                             XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+                                               XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
+                                             config_vals);
+            em->geometry = config_vals;
+        }
+        if (!em->placed || !em->mapped) {
+            getConnection().map_window(em->win);
+        }
+        em->placed = em->mapped = true;
 
         if (force_redraw) {
             getConnection().clear_area(1, em->win);
@@ -0,0 +1,464 @@
+/*
+ * textlayout.cpp - cached Pango layouts
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "textlayout.h"
+
+#include "luaa.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <new>
+#include <pango/pangocairo.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace TextLayout {
+
+namespace {
+
+constexpr const char* metatable = "awesome.text_layout";
+
+/** Lines shown per paragraph when no height is given */
+constexpr int max_lines = 1 << 20;
+
+/** The layout settings, as read from the table given by Lua */
+struct Params {
+    std::string_view text, font;
+    bool markup;
+    PangoWrapMode wrap;
+    PangoEllipsizeMode ellipsize;
+    PangoAlignment align;
+    bool justify;
+    int indent;
+    float line_spacing;
+    int width, height;
+    double dpi;
+};
+
+struct Entry {
+    std::string key;
+    /** What the layout was made from, the strings point into the key */
+    Params params;
+    /** The layout in the context it is measured with */
+    PangoLayout* layout = nullptr;
+    /** The layouts made again for cairo contexts which do not match that one,
+     * by the id of their context */
+    std::vector<std::pair<uint64_t, PangoLayout*>> drawn;
+    /** An estimate of the memory used by the layouts */
+    size_t bytes = 0;
+    std::list<std::shared_ptr<Entry>>::iterator lru;
+
+    ~Entry() {
+        if (layout) {
+            g_object_unref(layout);
+        }
+        for (auto& [ctx, l] : drawn) {
+            g_object_unref(l);
+        }
+    }
+};
+
+using EntryPtr = std::shared_ptr<Entry>;
+
+struct Cache {
+    /** Most recently used first */
+    std::list<EntryPtr> lru;
+    std::unordered_map<std::string_view, EntryPtr> entries;
+    size_t bytes = 0;
+    size_t limit = 4 * 1024 * 1024;
+
+    /** Evict entries until the cache fits, the most recent one is kept */
+    void shrink() {
+        while (bytes > limit && lru.size() > 1) {
+            const EntryPtr& e = lru.back();
+            bytes -= e->bytes;
+            entries.erase(e->key);
+            lru.pop_back();
+        }
+    }
+};
+
+Cache cache;
+
+/** The memory a layout of an entry probably uses. The glyphs, attributes and
+ * lines take a few dozen bytes per byte of text. */
+size_t layout_bytes(const Entry& e) { return 1024 + 48 * e.key.size(); }
+
+/** A Pango context and what pango_cairo_update_context() gave it */
+struct Context {
+    double dpi;
+    /** Whether the layouts of this resolution are measured in it */
+    bool measuring;
+    PangoContext* pango;
+    /** Never reused, unlike the address of an evicted context */
+    uint64_t id;
+    /** When it was last drawn with, for evicting the contexts drawn with least
+     * recently */
+    uint64_t used = 0;
+    /** The transformation without translation (xx, yx, xy, yy) and the font
+     * options of the cairo contexts it draws to, null until it drew */
+    std::array<double, 4> matrix;
+    cairo_font_options_t* options = nullptr;
+
+    bool matches(const std::array<double, 4>& m, const cairo_font_options_t* o) const {
+        return options && matrix == m && cairo_font_options_equal(options, o);
+    }
+};
+
+/** The Pango contexts of all layouts. A drawing never changes a context that
+ * layouts of other drawings share: the one layouts are measured in takes the
+ * settings of the first cairo context drawn with it, layouts drawn to others
+ * are made again in a context of their own. */
+std::vector<Context> contexts;
+uint64_t context_ids = 0;
+uint64_t context_clock = 0;
+
+/** How many contexts only drawn with are kept. Each transformation of the
+ * cairo contexts needs its own, e.g. every scale of an animation. */
+constexpr size_t max_drawing_contexts = 16;
+
+/** Drop the context drawn with least recently, with the layouts of the cached
+ * entries made in it. Entries which are not cached anymore keep theirs until
+ * they are freed, the id keeps them from being used again. */
+void evict_drawing_context() {
+    auto victim = contexts.end();
+    for (auto it = contexts.begin(); it != contexts.end(); ++it) {
+        if (!it->measuring && (victim == contexts.end() || it->used < victim->used)) {
+            victim = it;
+        }
+    }
+    if (victim == contexts.end()) {
+        return;
+    }
+    for (const auto& e : cache.lru) {
+        auto drawn =
+          std::ranges::find(e->drawn, victim->id, &std::pair<uint64_t, PangoLayout*>::first);
+        if (drawn != e->drawn.end()) {
+            g_object_unref(drawn->second);
+            e->drawn.erase(drawn);
+            e->bytes -= layout_bytes(*e);
+            cache.bytes -= layout_bytes(*e);
+        }
+    }
+    g_object_unref(victim->pango);
+    cairo_font_options_destroy(victim->options);
+    contexts.erase(victim);
+}
+
+PangoContext* context_for(double dpi) {
+    for (const auto& ctx : contexts) {
+        if (ctx.measuring && ctx.dpi == dpi) {
+            return ctx.pango;
+        }
+    }
+    PangoContext* pango = pango_font_map_create_context(pango_cairo_font_map_get_default());
+    pango_cairo_context_set_resolution(pango, dpi);
+    contexts.push_back({dpi, true, pango, ++context_ids});
+    return pango;
+}
+
+/** Get a context whose layouts can be drawn to a cairo context as they are */
+const Context& context_for(double dpi, cairo_t* cr) {
+    /* What pango_cairo_update_context() would set */
+    cairo_matrix_t m;
+    cairo_get_matrix(cr, &m);
+    const std::array<double, 4> matrix{m.xx, m.yx, m.xy, m.yy};
+    cairo_font_options_t* options = cairo_font_options_create();
+    cairo_surface_get_font_options(cairo_get_target(cr), options);
+    cairo_font_options_t* cr_options = cairo_font_options_create();
+    cairo_get_font_options(cr, cr_options);
+    cairo_font_options_merge(options, cr_options);
+    cairo_font_options_destroy(cr_options);
+
+    Context* unused = nullptr;
+    size_t drawing = 0;
+    for (auto& ctx : contexts) {
+        if (ctx.dpi == dpi && ctx.matches(matrix, options)) {
+            cairo_font_options_destroy(options);
+            ctx.used = ++context_clock;
+            return ctx;
+        }
+        if (ctx.dpi == dpi && ctx.measuring && !ctx.options) {
+            unused = &ctx;
+        }
+        drawing += !ctx.measuring;
+    }
+    if (!unused) {
+        if (drawing >= max_drawing_contexts) {
+            evict_drawing_context();
+        }
+        PangoContext* pango = pango_font_map_create_context(pango_cairo_font_map_get_default());
+        pango_cairo_context_set_resolution(pango, dpi);
+        unused = &contexts.emplace_back(Context{dpi, false, pango, ++context_ids});
+    }
+    pango_cairo_update_context(cr, unused->pango);
+    unused->matrix = matrix;
+    unused->options = options;
+    unused->used = ++context_clock;
+    return *unused;
+}
+
+std::string_view getstring(lua_State* L, int idx, const char* name) {
+    lua_getfield(L, idx, name);
+    size_t len = 0;
+    const char* str = lua_tolstring(L, -1, &len);
+    lua_pop(L, 1);
+    /* The table keeps the string alive */
+    return str ? std::string_view{str, len} : std::string_view{};
+}
+
+template <typename T, size_t N>
+T getenum(lua_State* L,
+          int idx,
+          const char* name,
+          const std::pair<std::string_view, T> (&values)[N],
+          T def) {
+    const auto str = getstring(L, idx, name);
+    for (const auto& [n, v] : values) {
+        if (n == str) {
+            return v;
+        }
+    }
+    return def;
+}
+
+Params check_params(lua_State* L) {
+    static constexpr std::pair<std::string_view, PangoWrapMode> wraps[] = {
+      {     "WORD",      PANGO_WRAP_WORD},
+      {     "CHAR",      PANGO_WRAP_CHAR},
+      {"WORD_CHAR", PANGO_WRAP_WORD_CHAR},
+    };
+    static constexpr std::pair<std::string_view, PangoEllipsizeMode> ellipsizes[] = {
+      {  "NONE",   PANGO_ELLIPSIZE_NONE},
+      { "START",  PANGO_ELLIPSIZE_START},
+      {"MIDDLE", PANGO_ELLIPSIZE_MIDDLE},
+      {   "END",    PANGO_ELLIPSIZE_END},
+    };
+    static constexpr std::pair<std::string_view, PangoAlignment> aligns[] = {
+      {  "LEFT",   PANGO_ALIGN_LEFT},
+      {"CENTER", PANGO_ALIGN_CENTER},
+      { "RIGHT",  PANGO_ALIGN_RIGHT},
+    };
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    Params p;
+    p.text = getstring(L, 1, "text");
+    p.font = getstring(L, 1, "font");
+    lua_getfield(L, 1, "markup");
+    p.markup = lua_toboolean(L, -1);
+    lua_getfield(L, 1, "justify");
+    p.justify = lua_toboolean(L, -1);
+    lua_getfield(L, 1, "indent");
+    p.indent = pango_units_from_double(lua_tonumber(L, -1));
+    lua_getfield(L, 1, "line_spacing");
+    p.line_spacing = float(lua_tonumber(L, -1));
+    lua_pop(L, 4);
+    p.wrap = getenum(L, 1, "wrap", wraps, PANGO_WRAP_WORD_CHAR);
+    p.ellipsize = getenum(L, 1, "ellipsize", ellipsizes, PANGO_ELLIPSIZE_END);
+    p.align = getenum(L, 1, "align", aligns, PANGO_ALIGN_LEFT);
+
+    p.width = lua_isnoneornil(L, 2) ? -1 : pango_units_from_double(luaL_checknumber(L, 2));
+    p.height =
+      lua_isnoneornil(L, 3) ? -max_lines : pango_units_from_double(luaL_checknumber(L, 3));
+    p.dpi = luaL_checknumber(L, 4);
+    return p;
+}
+
+template <typename T>
+void append(std::string& key, T value) {
+    key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+std::string make_key(const Params& p) {
+    std::string key;
+    key.reserve(64 + p.font.size() + p.text.size());
+    append(key, p.markup);
+    append(key, p.wrap);
+    append(key, p.ellipsize);
+    append(key, p.align);
+    append(key, p.justify);
+    append(key, p.indent);
+    append(key, p.line_spacing);
+    append(key, p.width);
+    append(key, p.height);
+    append(key, p.dpi);
+    key.append(p.font);
+    key.push_back('\0');
+    key.append(p.text);
+    return key;
+}
+
+PangoLayout* create_layout(const Params& p, PangoContext* ctx) {
+    PangoLayout* layout = pango_layout_new(ctx);
+    const std::string font(p.font);
+    PangoFontDescription* desc = pango_font_description_from_string(font.c_str());
+    pango_layout_set_font_description(layout, desc);
+    pango_font_description_free(desc);
+    if (p.markup) {
+        pango_layout_set_markup(layout, p.text.data(), int(p.text.size()));
+    } else {
+        pango_layout_set_text(layout, p.text.data(), int(p.text.size()));
+    }
+    pango_layout_set_wrap(layout, p.wrap);
+    pango_layout_set_ellipsize(layout, p.ellipsize);
+    pango_layout_set_alignment(layout, p.align);
+    pango_layout_set_justify(layout, p.justify);
+    pango_layout_set_indent(layout, p.indent);
+    pango_layout_set_line_spacing(layout, p.line_spacing);
+    pango_layout_set_width(layout, p.width);
+    pango_layout_set_height(layout, p.height);
+    return layout;
+}
+
+/** Find the layout for the arguments on the stack, creating it if needed */
+EntryPtr lookup(lua_State* L) {
+    const Params p = check_params(L);
+    std::string key = make_key(p);
+
+    if (auto it = cache.entries.find(key); it != cache.entries.end()) {
+        EntryPtr e = it->second;
+        cache.lru.splice(cache.lru.begin(), cache.lru, e->lru);
+        return e;
+    }
+
+    auto e = std::make_shared<Entry>();
+    e->key = std::move(key);
+    e->params = p;
+    const std::string_view k = e->key;
+    e->params.text = k.substr(k.size() - p.text.size());
+    e->params.font = k.substr(k.size() - p.text.size() - 1 - p.font.size(), p.font.size());
+    e->layout = create_layout(e->params, context_for(p.dpi));
+    e->bytes = sizeof(Entry) + layout_bytes(*e);
+    cache.lru.push_front(e);
+    e->lru = cache.lru.begin();
+    cache.entries.emplace(e->key, e);
+    cache.bytes += e->bytes;
+    cache.shrink();
+    return e;
+}
+
+int push_size(lua_State* L, PangoLayout* layout) {
+    PangoRectangle logical;
+    pango_layout_get_pixel_extents(layout, nullptr, &logical);
+    lua_pushinteger(L, logical.width);
+    lua_pushinteger(L, logical.height);
+    return 2;
+}
+
+EntryPtr& check_handle(lua_State* L, int idx) {
+    return *static_cast<EntryPtr*>(luaL_checkudata(L, idx, metatable));
+}
+
+/** Draw a layout handle.
+ * \param L The Lua VM state.
+ * \return The number of elements pushed on stack.
+ */
+int layout_draw(lua_State* L) {
+    const EntryPtr& e = check_handle(L, 1);
+    auto cr = static_cast<cairo_t*>(lua_touserdata(L, 2));
+    if (!cr) {
+        Lua::typerror(L, 2, "cairo context");
+    }
+    const Context& ctx = context_for(e->params.dpi, cr);
+    PangoLayout* layout = e->layout;
+    if (ctx.pango != pango_layout_get_context(layout)) {
+        auto it = std::ranges::find(e->drawn, ctx.id, &std::pair<uint64_t, PangoLayout*>::first);
+        if (it != e->drawn.end()) {
+            layout = it->second;
+        } else {
+            layout = create_layout(e->params, ctx.pango);
+            e->drawn.emplace_back(ctx.id, layout);
+            e->bytes += layout_bytes(*e);
+            /* Unless the entry was evicted while the handle lived on */
+            auto in = cache.entries.find(e->key);
+            if (in != cache.entries.end() && in->second == e) {
+                cache.bytes += layout_bytes(*e);
+                cache.shrink();
+            }
+        }
+    }
+    cairo_move_to(cr, luaL_optnumber(L, 3, 0), luaL_optnumber(L, 4, 0));
+    pango_cairo_show_layout(cr, layout);
+    return 0;
+}
+
+int layout_gc(lua_State* L) {
+    using std::shared_ptr;
+    check_handle(L, 1).~shared_ptr<Entry>();
+    return 0;
+}
+
+} // namespace
+
+void set_limit(size_t bytes) {
+    cache.limit = bytes;
+    cache.shrink();
+}
+
+/** Get a shared text layout.
+ *
+ * Layouts with the same text, settings, size and resolution are shaped once
+ * and shared, see `awesome.set_text_layout_cache_limit`.
+ *
+ * @tparam table args The text and its settings: `text`, `markup` (boolean),
+ *  `font` (a Pango font description string), `wrap`, `ellipsize` and `align`
+ *  (the Pango enum names), `justify`, `indent` and `line_spacing`.
+ * @tparam[opt] number width The width in pixels, unlimited if nil.
+ * @tparam[opt] number height The height in pixels. If nil, all lines are shown.
+ * @tparam number dpi The resolution.
+ * @return The layout, with a `draw(cr, x, y)` method taking a cairo context
+ *  as light user datum.
+ * @treturn integer The logical width of the layout.
+ * @treturn integer The logical height of the layout.
+ * @staticfct text_layout
+ */
+int luaA_text_layout(lua_State* L) {
+    const EntryPtr e = lookup(L);
+    new (lua_newuserdata(L, sizeof(EntryPtr))) EntryPtr(e);
+    if (luaL_newmetatable(L, metatable)) {
+        lua_newtable(L);
+        lua_pushcfunction(L, layout_draw);
+        lua_setfield(L, -2, "draw");
+        lua_setfield(L, -2, "__index");
+        lua_pushcfunction(L, layout_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+    return 1 + push_size(L, e->layout);
+}
+
+/** Get the logical size of a shared text layout.
+ *
+ * This takes the same arguments as `awesome.text_layout`.
+ *
+ * @treturn integer The logical width of the layout.
+ * @treturn integer The logical height of the layout.
+ * @staticfct text_layout_size
+ */
+int luaA_text_layout_size(lua_State* L) { return push_size(L, lookup(L)->layout); }
+
+} // namespace TextLayout
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
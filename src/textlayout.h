@@ -0,0 +1,42 @@
+/*
+ * textlayout.h - cached Pango layouts header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+
+#include <cstddef>
+
+/** Pango layouts shared by all textboxes.
+ *
+ * A layout is identified by its text, font, size and layout settings, so that
+ * textboxes showing the same text at the same size shape it only once. Layouts
+ * are kept least recently used first within a memory budget. Handles given to
+ * Lua keep their layout alive after it was evicted.
+ */
+namespace TextLayout {
+
+/** Set how many bytes of layouts are kept. */
+void set_limit(size_t bytes);
+
+int luaA_text_layout(lua_State* L);
+int luaA_text_layout_size(lua_State* L);
+
+} // namespace TextLayout
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,335 @@
+/*
+ * timerwheel.cpp - native Lua timers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "timerwheel.h"
+
+#include "globalconf.h"
+#include "luaa.h"
+#include "uvloop.h"
+
+#include <array>
+#include <cmath>
+#include <glib.h>
+#include <unordered_map>
+#include <vector>
+
+namespace TimerWheel {
+
+namespace {
+
+/** Times are counted in ticks of one millisecond since the wheel started */
+using Tick = uint64_t;
+
+constexpr unsigned slot_bits = 6;
+constexpr unsigned slot_count = 1 << slot_bits;
+constexpr unsigned levels = 4;
+/** Timers further away than this wait in the last level and cascade again */
+constexpr Tick range = Tick(1) << (slot_bits * levels);
+
+struct Timer {
+    /** When the timer is due, without slack */
+    Tick deadline;
+    /** When the timer runs, which is the deadline rounded up to the slack */
+    Tick expires;
+    Tick period;
+    Tick slack;
+    Lua::FunctionRegistryIdx callback;
+};
+
+/** A timer in a slot. Stopped or rescheduled timers stay in their old slot
+ * until it is processed, `expires` tells whether the entry is current. */
+struct SlotEntry {
+    uint64_t id;
+    Tick expires;
+};
+
+struct Level {
+    std::array<std::vector<SlotEntry>, slot_count> slots;
+    /** Which slots are not empty */
+    uint64_t occupied = 0;
+};
+
+std::array<Level, levels> wheel;
+std::unordered_map<uint64_t, Timer> timers;
+uint64_t next_id = 1;
+/** The time the wheel processed all timers up to */
+Tick now = 0;
+gint64 base_us = 0;
+/** Whether a timer was started since the last cleanup */
+bool started = false;
+/** The source waking up for the wheel, unless libuv does */
+GSource* source = nullptr;
+
+Tick current_tick() { return Tick(g_get_monotonic_time() - base_us) / 1000; }
+
+unsigned slot_of(Tick expires, unsigned level) {
+    return (expires >> (slot_bits * level)) & (slot_count - 1);
+}
+
+void place(uint64_t id, Tick expires) {
+    const Tick delta = std::min(expires - now, range - 1);
+    unsigned level = 0;
+    while (delta >= Tick(1) << (slot_bits * (level + 1))) {
+        level++;
+    }
+    const unsigned slot = slot_of(now + delta, level);
+    wheel[level].slots[slot].push_back({id, expires});
+    wheel[level].occupied |= uint64_t(1) << slot;
+}
+
+bool is_current(const SlotEntry& entry) {
+    auto it = timers.find(entry.id);
+    return it != timers.end() && it->second.expires == entry.expires;
+}
+
+/** The earliest expiry of all timers, or 0 if there are none */
+Tick earliest() {
+    Tick best = 0;
+    for (unsigned level = 0; level < levels; level++) {
+        auto& l = wheel[level];
+        /* The slots after the current one come first, the current one is a
+         * full turn away. The first slot with a timer that is still current
+         * holds the earliest ones of this level. */
+        const unsigned start = slot_of(now, level) + 1;
+        for (unsigned i = 0; i < slot_count && l.occupied; i++) {
+            const unsigned slot = (start + i) % slot_count;
+            auto& entries = l.slots[slot];
+            std::erase_if(entries, [](const SlotEntry& entry) { return !is_current(entry); });
+            if (entries.empty()) {
+                l.occupied &= ~(uint64_t(1) << slot);
+                continue;
+            }
+            for (const auto& entry : entries) {
+                if (!best || entry.expires < best) {
+                    best = entry.expires;
+                }
+            }
+            break;
+        }
+    }
+    return best;
+}
+
+void expired();
+
+void update_ready_time() {
+    if (!started) {
+        return;
+    }
+    const Tick next = earliest();
+    if (!source) {
+        UvLoop::set_timer(next ? int64_t(next - std::min(next, current_tick())) : -1, expired);
+        return;
+    }
+    g_source_set_ready_time(source, next ? base_us + gint64(next) * 1000 : -1);
+}
+
+/** Schedule a timer for its deadline. */
+void schedule(uint64_t id, Timer& timer) {
+    timer.expires = std::max(timer.deadline, now + 1);
+    if (timer.slack > 1) {
+        timer.expires = (timer.expires + timer.slack - 1) / timer.slack * timer.slack;
+    }
+    place(id, timer.expires);
+}
+
+/** Move the timers of the current slot of a level to the lower levels.
+ * \return True if the slot of the level above has to be cascaded as well.
+ */
+bool cascade(unsigned level) {
+    const unsigned slot = slot_of(now, level);
+    auto entries = std::move(wheel[level].slots[slot]);
+    wheel[level].slots[slot].clear();
+    wheel[level].occupied &= ~(uint64_t(1) << slot);
+    for (const auto& entry : entries) {
+        if (is_current(entry)) {
+            place(entry.id, entry.expires);
+        }
+    }
+    return slot == 0;
+}
+
+/** Run a timer and schedule its next run.
+ * \param target The time the wheel is being advanced to.
+ */
+void run(lua_State* L, const SlotEntry& entry, Tick target) {
+    auto it = timers.find(entry.id);
+    if (it == timers.end() || it->second.expires != entry.expires) {
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, it->second.callback.idx.idx);
+    Lua::dofunction(L, 0, 0);
+
+    /* The callback may have stopped the timer */
+    it = timers.find(entry.id);
+    if (it == timers.end() || it->second.expires != entry.expires) {
+        return;
+    }
+    auto& timer = it->second;
+    timer.deadline += timer.period;
+    if (timer.deadline <= target) {
+        /* Fell behind, don't run it again before the wheel caught up */
+        timer.deadline = std::max(target, current_tick()) + timer.period;
+    }
+    schedule(entry.id, timer);
+}
+
+/** Run all timers that expired up to the given time. */
+void advance(lua_State* L, Tick target) {
+    while (now < target) {
+        /* Skip the ticks where nothing is in the lower levels */
+        unsigned empty = 0;
+        while (empty < levels && !wheel[empty].occupied) {
+            empty++;
+        }
+        if (empty == levels) {
+            now = target;
+            break;
+        }
+        now = empty == 0 ? now + 1
+                         : std::min(target, ((now >> (slot_bits * empty)) + 1)
+                                              << (slot_bits * empty));
+
+        for (unsigned level = 1; level < levels && slot_of(now, level - 1) == 0; level++) {
+            if (!cascade(level)) {
+                break;
+            }
+        }
+
+        const unsigned slot = slot_of(now, 0);
+        if (!(wheel[0].occupied & (uint64_t(1) << slot))) {
+            continue;
+        }
+        auto entries = std::move(wheel[0].slots[slot]);
+        wheel[0].slots[slot].clear();
+        wheel[0].occupied &= ~(uint64_t(1) << slot);
+        for (const auto& entry : entries) {
+            run(L, entry, target);
+        }
+    }
+}
+
+/** Run the expired timers and wait for the next one */
+void expired() {
+    advance(globalconf_get_lua_State(), current_tick());
+    update_ready_time();
+}
+
+gboolean dispatch(GSource*, GSourceFunc, gpointer) {
+    expired();
+    return G_SOURCE_CONTINUE;
+}
+
+GSourceFuncs source_funcs = {nullptr, nullptr, dispatch, nullptr, nullptr, nullptr};
+
+/** Convert a Lua time in seconds to ticks */
+Tick to_ticks(lua_State* L, int idx, lua_Number seconds) {
+    if (!(seconds >= 0)) {
+        luaL_argerror(L, idx, "must be a positive number");
+    }
+    return Tick(std::llround(std::min<lua_Number>(seconds * 1000, 1e15)));
+}
+
+} // namespace
+
+/** Start a repeating timer.
+ *
+ * The callback is called every `timeout` seconds until the timer is stopped.
+ * Timers that expire in the same millisecond are run by the same main loop
+ * iteration. A timer with some slack may run up to that much later than its
+ * deadline: the deadlines of all timers with the same slack are rounded up to
+ * a multiple of it, so that they expire together.
+ *
+ * This is the backend of `gears.timer`.
+ *
+ * @tparam number timeout The interval in seconds.
+ * @tparam function callback The function to call.
+ * @tparam[opt=0] number slack How much later the timer may run, in seconds.
+ * @treturn integer The id of the timer, for `timer_stop`.
+ * @staticfct timer_start
+ */
+int luaA_timer_start(lua_State* L) {
+    const Tick period = std::max<Tick>(to_ticks(L, 1, luaL_checknumber(L, 1)), 1);
+    Lua::checkfunction(L, 2);
+    const Tick slack = to_ticks(L, 3, luaL_optnumber(L, 3, 0));
+
+    if (!started) {
+        started = true;
+        base_us = g_get_monotonic_time();
+        now = 0;
+        if (!UvLoop::active()) {
+            source = g_source_new(&source_funcs, sizeof(GSource));
+            g_source_set_name(source, "awesome timers");
+            g_source_attach(source, nullptr);
+        }
+    }
+
+    const uint64_t id = next_id++;
+    auto& timer = timers[id];
+    timer.deadline = current_tick() + period;
+    timer.period = period;
+    timer.slack = slack;
+    Lua::registerfct(L, 2, &timer.callback);
+    schedule(id, timer);
+    update_ready_time();
+
+    lua_pushinteger(L, lua_Integer(id));
+    return 1;
+}
+
+/** Stop a timer started by `timer_start`.
+ *
+ * @tparam integer id The id of the timer.
+ * @treturn boolean Whether the timer was running.
+ * @staticfct timer_stop
+ */
+int luaA_timer_stop(lua_State* L) {
+    auto it = timers.find(uint64_t(luaL_checknumber(L, 1)));
+    if (it == timers.end()) {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+    Lua::unregister(L, &it->second.callback);
+    timers.erase(it);
+    update_ready_time();
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+void cleanup() {
+    if (source) {
+        g_source_destroy(source);
+        g_source_unref(source);
+        source = nullptr;
+    } else if (started) {
+        UvLoop::set_timer(-1, expired);
+    }
+    started = false;
+    lua_State* L = globalconf_get_lua_State();
+    for (auto& [id, timer] : timers) {
+        Lua::unregister(L, &timer.callback);
+    }
+    timers.clear();
+    wheel = {};
+}
+
+} // namespace TimerWheel
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
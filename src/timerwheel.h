@@ -0,0 +1,40 @@
+/*
+ * timerwheel.h - native Lua timers header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+
+/** Repeating timers for Lua, kept in a hierarchical timer wheel.
+ *
+ * All timers share one GLib source whose ready time is the earliest deadline,
+ * or one libuv timer with the libuv backend, so timers that expire in the same
+ * millisecond are run by a single wakeup instead of one GLib timeout source
+ * each.
+ */
+namespace TimerWheel {
+
+int luaA_timer_start(lua_State* L);
+int luaA_timer_stop(lua_State* L);
+
+/** Drop all timers and their callbacks. */
+void cleanup();
+
+} // namespace TimerWheel
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
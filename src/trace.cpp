@@ -0,0 +1,192 @@
+/*
+ * trace.cpp - trace-event writer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "trace.h"
+
+#include "common/luahdr.h"
+#include "common/signal.h"
+#include "common/util.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <fmt/core.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+namespace Trace {
+
+namespace {
+
+struct Span {
+    Clock::time_point start;
+    Clock::duration duration;
+    const char* name;
+    uint32_t arg;
+    Category category;
+};
+
+constexpr std::array<std::string_view, size_t(Category::Count)> category_names = {
+  "loop",
+  "event",
+  "signal",
+  "x_wait",
+};
+
+FILE* file = nullptr;
+Clock::time_point origin;
+std::vector<Span> buffer;
+
+/** Append a string to a JSON document, quoted */
+void append_quoted(std::string& out, std::string_view s) {
+    out += '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (uint8_t(c) < 0x20) {
+            out += fmt::format("\\u{:04x}", int(uint8_t(c)));
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+std::string span_name(const Span& span) {
+    switch (span.category) {
+    case Category::Signal: return signal_name(SignalId(span.arg));
+    case Category::XWait: {
+        std::string_view file = span.name;
+        if (auto pos = file.rfind("src/"); pos != std::string_view::npos) {
+            file.remove_prefix(pos);
+        }
+        return fmt::format("{}:{}", file, span.arg);
+    }
+    case Category::Event:
+        return span.name ? std::string(span.name) : fmt::format("event {}", span.arg);
+    default: return span.name ? span.name : "";
+    }
+}
+
+double to_us(Clock::duration d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+} // namespace
+
+void record(Category category,
+            Clock::time_point start,
+            Clock::duration duration,
+            const char* name,
+            uint32_t arg) {
+    buffer.push_back({start, duration, name, arg, category});
+}
+
+void flush() {
+    if (!file || buffer.empty()) {
+        return;
+    }
+
+    const int pid = getpid();
+    std::string out;
+    for (const auto& span : buffer) {
+        /* Spans that started before the trace did are cut */
+        const auto start = std::max(span.start, origin);
+        const auto duration = span.duration - (start - span.start);
+        out += ",\n{\"name\":";
+        append_quoted(out, span_name(span));
+        out += fmt::format(R"(,"cat":"{}","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":{},"tid":{}}})",
+                           category_names[size_t(span.category)],
+                           to_us(start - origin),
+                           to_us(std::max(duration, Clock::duration::zero())),
+                           pid,
+                           pid);
+    }
+    buffer.clear();
+    fwrite(out.data(), 1, out.size(), file);
+    fflush(file);
+}
+
+bool start(const char* path) {
+    stop();
+    file = fopen(path, "w");
+    if (!file) {
+        log_warn("Cannot open trace file {}", path);
+        return false;
+    }
+
+    const int pid = getpid();
+    origin = Clock::now();
+    fmt::print(file,
+               R"({{"displayTimeUnit":"ms","traceEvents":[)"
+               "\n"
+               R"({{"name":"thread_name","ph":"M","pid":{},"tid":{},"args":{{"name":"main"}}}})",
+               pid,
+               pid);
+    enabled = true;
+    return true;
+}
+
+void stop() {
+    if (!file) {
+        return;
+    }
+    flush();
+    fputs("\n]}\n", file);
+    fclose(file);
+    file = nullptr;
+    enabled = false;
+}
+
+/** Start writing a trace of the main loop.
+ *
+ * The trace covers the main loop phases, the X events by type, the signals
+ * emitted by name and the blocking waits for X replies by source location. It
+ * is written as Chrome trace-event JSON, which can be opened in
+ * ui.perfetto.dev. A trace that is already being written is finished first.
+ * The `--trace` command line option starts a trace at startup, and since
+ * awesome-client runs Lua over D-Bus, it can start one at runtime, too.
+ *
+ * @tparam string path The file to write to.
+ * @treturn boolean Whether the file could be opened.
+ * @staticfct trace_start
+ * @see trace_stop
+ */
+int luaA_trace_start(lua_State* L) {
+    lua_pushboolean(L, start(luaL_checkstring(L, 1)));
+    return 1;
+}
+
+/** Stop writing the trace and finish the file.
+ *
+ * @staticfct trace_stop
+ * @noreturn
+ * @see trace_start
+ */
+int luaA_trace_stop(lua_State*) {
+    stop();
+    return 0;
+}
+
+} // namespace Trace
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,107 @@
+/*
+ * trace.h - trace-event writer header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+struct lua_State;
+
+/** Spans of the main loop, written as Chrome trace-event JSON that
+ * chrome://tracing and ui.perfetto.dev can show.
+ *
+ * Spans are buffered in memory and only written out by flush(), which the
+ * main loop calls right before it sleeps. All instrumented code runs on the
+ * main thread, so the buffer needs no locking.
+ */
+namespace Trace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Category : uint8_t {
+    /** Main loop phases, the name is the phase */
+    Loop,
+    /** X events, the name is the event label, the argument its type */
+    Event,
+    /** Signal emissions, the argument is the SignalId */
+    Signal,
+    /** Blocking X replies, the name is the source file, the argument the line */
+    XWait,
+    Count
+};
+
+/** Whether a trace is being written; everything else is a no-op otherwise */
+inline bool enabled = false;
+
+/** Record a span. Only call this while enabled.
+ * \param category The kind of span.
+ * \param start When the span started.
+ * \param duration How long it took.
+ * \param name A string that outlives the trace, may be NULL.
+ * \param arg A number whose meaning depends on the category.
+ */
+void record(Category category,
+            Clock::time_point start,
+            Clock::duration duration,
+            const char* name,
+            uint32_t arg);
+
+/** Record the lifetime of this object as a span while tracing. */
+class Scope {
+  public:
+    Scope(Category category, const char* name, uint32_t arg = 0)
+      : _category(category)
+      , _name(name)
+      , _arg(arg) {
+        if (enabled) {
+            _start = Clock::now();
+        }
+    }
+    ~Scope() {
+        /* Tracing may be started or stopped while this object lives */
+        if (enabled && _start != Clock::time_point{}) {
+            record(_category, _start, Clock::now() - _start, _name, _arg);
+        }
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    Category _category;
+    const char* _name;
+    uint32_t _arg;
+    Clock::time_point _start{};
+};
+
+/** Start writing a trace, stopping the current one.
+ * \param path The file to write to.
+ * \return False if the file cannot be opened.
+ */
+bool start(const char* path);
+/** Write the remaining spans and finish the trace file. */
+void stop();
+/** Write the buffered spans. */
+void flush();
+
+int luaA_trace_start(lua_State* L);
+int luaA_trace_stop(lua_State* L);
+
+} // namespace Trace
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,149 @@
+/*
+ * uvloop.cpp - libuv main loop backend
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "uvloop.h"
+
+#include "common/util.h"
+
+#include <cerrno>
+#include <csignal>
+#include <vector>
+
+namespace UvLoop {
+
+namespace {
+
+bool initialized = false;
+uv_loop_t uv;
+uv_poll_t x_watch;
+uv_signal_t child_watch;
+uv_timer_t timer_watch;
+void (*x_cb)() = nullptr;
+void (*child_cb)() = nullptr;
+void (*timer_cb)() = nullptr;
+/** The fds of GLib with the backend fd of libuv at the end */
+std::vector<GPollFD> fds;
+
+void on_x(uv_poll_t*, int, int) { x_cb(); }
+
+void on_child(uv_signal_t*, int) { child_cb(); }
+
+void on_timer(uv_timer_t*) { timer_cb(); }
+
+} // namespace
+
+void init() {
+    if (int err = uv_loop_init(&uv)) {
+        log_fatal("Failed to set up the libuv loop: {}", uv_strerror(err));
+    }
+    initialized = true;
+}
+
+bool active() { return initialized; }
+
+uv_loop_t* loop() { return &uv; }
+
+bool watch_x(int fd, void (*cb)()) {
+    if (int err = uv_poll_init(&uv, &x_watch, fd)) {
+        log_warn("Failed to watch the X connection with libuv: {}", uv_strerror(err));
+        return false;
+    }
+    if (int err = uv_poll_start(&x_watch, UV_READABLE | UV_DISCONNECT, on_x)) {
+        log_warn("Failed to watch the X connection with libuv: {}", uv_strerror(err));
+        uv_close(reinterpret_cast<uv_handle_t*>(&x_watch), nullptr);
+        return false;
+    }
+    x_cb = cb;
+    return true;
+}
+
+void watch_children(void (*cb)()) {
+    child_cb = cb;
+    uv_signal_init(&uv, &child_watch);
+    if (int err = uv_signal_start(&child_watch, on_child, SIGCHLD)) {
+        log_fatal("Failed to watch SIGCHLD: {}", uv_strerror(err));
+    }
+}
+
+void set_timer(int64_t timeout, void (*cb)()) {
+    if (!timer_cb) {
+        uv_timer_init(&uv, &timer_watch);
+    }
+    timer_cb = cb;
+    if (timeout < 0) {
+        uv_timer_stop(&timer_watch);
+        return;
+    }
+    /* The deadline is relative to the time of the loop, which is only updated
+     * once per iteration */
+    uv_update_time(&uv);
+    uv_timer_start(&timer_watch, on_timer, uint64_t(timeout), 0);
+}
+
+gint poll(GPollFD* ufds, guint nfds, gint timeout) {
+    fds.assign(ufds, ufds + nfds);
+    fds.push_back({uv_backend_fd(&uv), G_IO_IN, 0});
+
+    /* Wake up for the timers of libuv as well */
+    uv_update_time(&uv);
+    const int uv_timeout = uv_backend_timeout(&uv);
+    if (uv_timeout >= 0 && (timeout < 0 || uv_timeout < timeout)) {
+        timeout = uv_timeout;
+    }
+
+    gint res = g_poll(fds.data(), fds.size(), timeout);
+    const int saved_errno = errno;
+    if (res > 0 && fds.back().revents) {
+        res--;
+    }
+    for (guint i = 0; i < nfds; i++) {
+        ufds[i].revents = fds[i].revents;
+    }
+
+    /* Only ask epoll again when libuv has something to do */
+    if (fds.back().revents || uv_timeout >= 0) {
+        uv_run(&uv, UV_RUN_NOWAIT);
+    }
+    errno = saved_errno;
+    return res;
+}
+
+void cleanup() {
+    if (!initialized) {
+        return;
+    }
+    if (x_cb) {
+        uv_close(reinterpret_cast<uv_handle_t*>(&x_watch), nullptr);
+    }
+    if (child_cb) {
+        uv_close(reinterpret_cast<uv_handle_t*>(&child_watch), nullptr);
+    }
+    if (timer_cb) {
+        uv_close(reinterpret_cast<uv_handle_t*>(&timer_watch), nullptr);
+    }
+    /* Run the close callbacks */
+    uv_run(&uv, UV_RUN_NOWAIT);
+    uv_loop_close(&uv);
+    x_cb = child_cb = timer_cb = nullptr;
+    initialized = false;
+}
+
+} // namespace UvLoop
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
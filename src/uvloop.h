@@ -0,0 +1,73 @@
+/*
+ * uvloop.h - libuv main loop backend header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <glib.h>
+#include <uv.h>
+
+/** A libuv loop that hosts the file descriptors awesome owns.
+ *
+ * The X connection, SIGCHLD and the wakeup of the Lua timers are watched by
+ * libuv, where they stay registered with epoll for the whole session. GLib still dispatches its own
+ * sources, e.g. the ones of lgi and D-Bus: the poll function waits on the fds
+ * of GLib and on the backend fd of libuv together, then runs whatever libuv
+ * has ready without blocking.
+ */
+namespace UvLoop {
+
+/** Set up the loop. */
+void init();
+
+/** Whether `init` was called, i.e. the libuv backend is in use. */
+bool active();
+
+/** The loop, e.g. for `uv_queue_work`. */
+uv_loop_t* loop();
+
+/** Watch the X connection for input.
+ * \param fd The file descriptor of the connection, which is non-blocking.
+ * \param cb Called when the connection is readable or broke.
+ * \return False if libuv cannot watch it, the caller has to.
+ */
+bool watch_x(int fd, void (*cb)());
+
+/** Call a function after a SIGCHLD was received. */
+void watch_children(void (*cb)());
+
+/** Call a function once after some time, replacing the previous timeout.
+ * \param timeout The time in milliseconds, or -1 to cancel the call.
+ * \param cb The function.
+ */
+void set_timer(int64_t timeout, void (*cb)());
+
+/** A GLib poll function that also waits for the libuv loop.
+ * \param ufds The fds GLib wants to poll.
+ * \param nfds How many there are.
+ * \param timeout The timeout in milliseconds, -1 to wait forever.
+ * \return Like g_poll(), the fds of libuv are not counted.
+ */
+gint poll(GPollFD* ufds, guint nfds, gint timeout);
+
+/** Close all handles and the loop. */
+void cleanup();
+
+} // namespace UvLoop
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,465 @@
+/*
+ * widgethierarchy.cpp - native core of wibox.hierarchy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "widgethierarchy.h"
+
+#include "luaa.h"
+
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace WidgetHierarchy {
+
+namespace {
+
+constexpr const char* metatable = "wibox.hierarchy_node";
+
+/** Same layout and semantics as gears.matrix */
+struct Matrix {
+    double xx = 1, yx = 0, xy = 0, yy = 1, x0 = 0, y0 = 0;
+
+    bool operator==(const Matrix&) const = default;
+
+    /** First apply this, then other */
+    Matrix operator*(const Matrix& o) const {
+        return {xx * o.xx + yx * o.xy,
+                xx * o.yx + yx * o.yy,
+                xy * o.xx + yy * o.xy,
+                xy * o.yx + yy * o.yy,
+                x0 * o.xx + y0 * o.xy + o.x0,
+                x0 * o.yx + y0 * o.yy + o.y0};
+    }
+};
+
+struct Rect {
+    double x, y, width, height;
+
+    bool operator==(const Rect&) const = default;
+};
+
+/** Like gears.matrix.transform_rectangle */
+Rect transform_rectangle(const Matrix& m, const Rect& r) {
+    const double xs[4] = {r.x, r.x, r.x + r.width, r.x + r.width};
+    const double ys[4] = {r.y, r.y + r.height, r.y + r.height, r.y};
+    double x1 = INFINITY, y1 = INFINITY, x2 = -INFINITY, y2 = -INFINITY;
+    for (int i = 0; i < 4; i++) {
+        const double x = m.x0 + m.xx * xs[i] + m.xy * ys[i];
+        const double y = m.y0 + m.yx * xs[i] + m.yy * ys[i];
+        x1 = std::min(x1, x);
+        y1 = std::min(y1, y);
+        x2 = std::max(x2, x);
+        y2 = std::max(y2, y);
+    }
+    return {x1, y1, x2 - x1, y2 - y1};
+}
+
+/** The device pixels covered by a node of the given size */
+Rect device_area(const Matrix& to_device, double width, double height) {
+    const Rect r = transform_rectangle(to_device, {0, 0, width, height});
+    const double x = std::floor(r.x), y = std::floor(r.y);
+    return {x, y, std::ceil(r.x + r.width) - x, std::ceil(r.y + r.height) - y};
+}
+
+struct Node {
+    /** Mirrors the `_parent` field of the Lua table */
+    Node* parent = nullptr;
+    /** Mirrors the `_children` field of the Lua table */
+    std::vector<Node*> children;
+    bool need_update = true;
+    bool has_size = false;
+    double width = 0, height = 0;
+    Matrix to_parent, to_device;
+    Rect extents = {0, 0, 0, 0};
+    /** How often the widgets in the counted set appear, by widget */
+    std::unordered_map<const void*, int> counts;
+};
+
+/** Set by _hierarchy_setup */
+Lua::FunctionRegistryIdx layout_callback, new_child_callback;
+Lua::RegistryIdx counted_widgets;
+
+/** The node at the given index, or NULL if it is something else */
+Node* tonode(lua_State* L, int idx) {
+    void* p = lua_touserdata(L, idx);
+    if (!p || !lua_getmetatable(L, idx)) {
+        return nullptr;
+    }
+    luaL_getmetatable(L, metatable);
+    const bool is_node = lua_rawequal(L, -1, -2);
+    lua_pop(L, 2);
+    return is_node ? static_cast<Node*>(p) : nullptr;
+}
+
+Matrix tomatrix(lua_State* L, int idx) {
+    Matrix m;
+    if (!lua_istable(L, idx)) {
+        return m;
+    }
+    double* fields[] = {&m.xx, &m.yx, &m.xy, &m.yy, &m.x0, &m.y0};
+    const char* names[] = {"xx", "yx", "xy", "yy", "x0", "y0"};
+    for (int i = 0; i < 6; i++) {
+        lua_getfield(L, idx, names[i]);
+        *fields[i] = lua_tonumber(L, -1);
+        lua_pop(L, 1);
+    }
+    return m;
+}
+
+void rawset_field(lua_State* L, int table, const char* name, int value) {
+    lua_pushstring(L, name);
+    if (value) {
+        lua_pushvalue(L, value);
+    } else {
+        lua_pushnil(L);
+    }
+    lua_rawset(L, table);
+}
+
+/** Update a node and its children, like hierarchy_update in Lua did.
+ * \param h The index of the Lua hierarchy table.
+ * \param matrix The index of the gears.matrix to the parent, 0 to keep it.
+ * \param damage Where to add the changed parts, in device coordinates.
+ */
+void update(lua_State* L,
+            int h,
+            Node* n,
+            int context,
+            int widget,
+            double width,
+            double height,
+            int matrix,
+            const Matrix& to_parent,
+            const Matrix& to_device,
+            std::vector<Rect>& damage) {
+    luaL_checkstack(L, 12, "widget hierarchy too deep");
+
+    lua_pushliteral(L, "_widget");
+    lua_rawget(L, h);
+    const int old_widget = lua_gettop(L);
+    const bool same_widget = lua_rawequal(L, old_widget, widget);
+    lua_pushliteral(L, "_context");
+    lua_rawget(L, h);
+    const bool same_context = lua_rawequal(L, -1, context);
+    lua_pop(L, 1);
+
+    if (!n->need_update && same_widget && same_context && n->has_size && n->width == width &&
+        n->height == height && n->to_parent == to_parent && n->to_device == to_device) {
+        /* Nothing changed */
+        lua_pop(L, 1);
+        return;
+    }
+    n->need_update = false;
+
+    const Rect old_area =
+      n->has_size ? device_area(n->to_device, n->width, n->height) : Rect{0, 0, 0, 0};
+
+    rawset_field(L, h, "_widget", widget);
+    rawset_field(L, h, "_context", context);
+    if (matrix) {
+        rawset_field(L, h, "_matrix", matrix);
+    }
+    if (n->to_device != to_device) {
+        /* Lua creates it again when it is asked for */
+        rawset_field(L, h, "_matrix_to_device", 0);
+    }
+    n->has_size = true;
+    n->width = width;
+    n->height = height;
+    n->to_parent = to_parent;
+    n->to_device = to_device;
+
+    /* Only this node's layout is done in Lua */
+    lua_pushvalue(L, h);
+    lua_pushvalue(L, context);
+    lua_pushvalue(L, widget);
+    lua_pushnumber(L, width);
+    lua_pushnumber(L, height);
+    lua_pushvalue(L, old_widget);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, layout_callback.idx.idx);
+    if (!Lua::dofunction(L, 6, 1)) {
+        lua_pushnil(L);
+    }
+    const int placements = lua_gettop(L);
+
+    lua_pushliteral(L, "_children");
+    lua_rawget(L, h);
+    const int old_children = lua_gettop(L);
+    const bool had_children = lua_istable(L, old_children);
+
+    const int count = lua_istable(L, placements) ? Lua::rawlen(L, placements) : 0;
+    lua_createtable(L, count, 0);
+    const int new_children = lua_gettop(L);
+
+    std::vector<Node*> children;
+    children.reserve(count);
+    for (int i = 1; i <= count; i++) {
+        lua_rawgeti(L, placements, i);
+        const int placement = lua_gettop(L);
+        if (had_children) {
+            lua_rawgeti(L, old_children, i);
+        } else {
+            lua_pushnil(L);
+        }
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            lua_pushvalue(L, h);
+            lua_rawgeti(L, LUA_REGISTRYINDEX, new_child_callback.idx.idx);
+            if (!Lua::dofunction(L, 1, 1)) {
+                lua_pushnil(L);
+            }
+        }
+        const int child_table = lua_gettop(L);
+
+        Node* child = nullptr;
+        if (lua_istable(L, placement) && lua_istable(L, child_table)) {
+            lua_pushliteral(L, "_core");
+            lua_rawget(L, child_table);
+            child = tonode(L, -1);
+            lua_pop(L, 1);
+        }
+        if (!child) {
+            lua_settop(L, placement - 1);
+            continue;
+        }
+        child->parent = n;
+
+        lua_getfield(L, placement, "_widget");
+        const int child_widget = lua_gettop(L);
+        lua_getfield(L, placement, "_width");
+        const double child_width = lua_tonumber(L, -1);
+        lua_getfield(L, placement, "_height");
+        const double child_height = lua_tonumber(L, -1);
+        lua_pop(L, 2);
+        lua_getfield(L, placement, "_matrix");
+        const int child_matrix = lua_gettop(L);
+        const Matrix m = tomatrix(L, child_matrix);
+
+        update(L,
+               child_table,
+               child,
+               context,
+               child_widget,
+               child_width,
+               child_height,
+               child_matrix,
+               m,
+               m * to_device,
+               damage);
+
+        lua_pushvalue(L, child_table);
+        lua_rawseti(L, new_children, int(children.size() + 1));
+        children.push_back(child);
+        lua_settop(L, placement - 1);
+    }
+
+    /* The area of removed children needs a redraw */
+    for (int i = count + 1; had_children; i++) {
+        lua_rawgeti(L, old_children, i);
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            break;
+        }
+        const int child_table = lua_gettop(L);
+        lua_pushliteral(L, "_core");
+        lua_rawget(L, child_table);
+        if (Node* child = tonode(L, -1)) {
+            const Rect r = transform_rectangle(child->to_device, child->extents);
+            damage.push_back({std::floor(r.x), std::floor(r.y), std::ceil(r.width),
+                              std::ceil(r.height)});
+            child->parent = nullptr;
+        }
+        lua_pop(L, 1);
+        rawset_field(L, child_table, "_parent", 0);
+        lua_pop(L, 1);
+    }
+    n->children = std::move(children);
+    rawset_field(L, h, "_children", new_children);
+
+    double x1 = 0, y1 = 0, x2 = width, y2 = height;
+    for (const Node* child : n->children) {
+        const Rect r = transform_rectangle(child->to_parent, child->extents);
+        x1 = std::min(x1, r.x);
+        y1 = std::min(y1, r.y);
+        x2 = std::max(x2, r.x + r.width);
+        y2 = std::max(y2, r.y + r.height);
+    }
+    n->extents = {x1, y1, x2 - x1, y2 - y1};
+
+    n->counts.clear();
+    lua_rawgeti(L, LUA_REGISTRYINDEX, counted_widgets.idx);
+    if (lua_istable(L, -1) && width > 0 && height > 0) {
+        lua_pushvalue(L, widget);
+        lua_rawget(L, -2);
+        if (lua_toboolean(L, -1)) {
+            n->counts[lua_topointer(L, widget)] = 1;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    for (const Node* child : n->children) {
+        for (const auto& [w, c] : child->counts) {
+            n->counts[w] += c;
+        }
+    }
+
+    const Rect new_area = device_area(to_device, width, height);
+    if (!(new_area == old_area) || !same_widget) {
+        damage.push_back(old_area);
+        damage.push_back(new_area);
+    }
+
+    lua_settop(L, old_widget - 1);
+}
+
+Node* checknode(lua_State* L, int idx) {
+    return static_cast<Node*>(luaL_checkudata(L, idx, metatable));
+}
+
+/** Update the hierarchy of a root node.
+ * \return An array of the changed parts, four numbers per rectangle.
+ */
+int node_update(lua_State* L) {
+    Node* n = checknode(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    luaL_checkany(L, 3);
+    luaL_checkany(L, 4);
+    const double width = luaL_checknumber(L, 5);
+    const double height = luaL_checknumber(L, 6);
+    lua_settop(L, 6);
+
+    std::vector<Rect> damage;
+    const Matrix to_parent = n->to_parent, to_device = n->to_device;
+    update(L, 2, n, 3, 4, width, height, 0, to_parent, to_device, damage);
+
+    lua_createtable(L, int(damage.size() * 4), 0);
+    int i = 0;
+    for (const auto& r : damage) {
+        for (double v : {r.x, r.y, r.width, r.height}) {
+            lua_pushnumber(L, v);
+            lua_rawseti(L, -2, ++i);
+        }
+    }
+    return 1;
+}
+
+/** A widget of this node changed its layout, update it and its parents next time */
+int node_invalidate(lua_State* L) {
+    for (Node* n = checknode(L, 1); n; n = n->parent) {
+        n->need_update = true;
+    }
+    return 0;
+}
+
+int node_get_size(lua_State* L) {
+    Node* n = checknode(L, 1);
+    if (!n->has_size) {
+        return 0;
+    }
+    lua_pushnumber(L, n->width);
+    lua_pushnumber(L, n->height);
+    return 2;
+}
+
+int node_get_draw_extents(lua_State* L) {
+    Node* n = checknode(L, 1);
+    lua_pushnumber(L, n->extents.x);
+    lua_pushnumber(L, n->extents.y);
+    lua_pushnumber(L, n->extents.width);
+    lua_pushnumber(L, n->extents.height);
+    return 4;
+}
+
+int node_get_matrix_to_device(lua_State* L) {
+    const Matrix& m = checknode(L, 1)->to_device;
+    for (double v : {m.xx, m.yx, m.xy, m.yy, m.x0, m.y0}) {
+        lua_pushnumber(L, v);
+    }
+    return 6;
+}
+
+int node_get_count(lua_State* L) {
+    Node* n = checknode(L, 1);
+    auto it = n->counts.find(lua_topointer(L, 2));
+    lua_pushinteger(L, it == n->counts.end() ? 0 : it->second);
+    return 1;
+}
+
+int node_gc(lua_State* L) {
+    /* Other nodes may be collected in the same cycle, don't touch them */
+    checknode(L, 1)->~Node();
+    return 0;
+}
+
+} // namespace
+
+/** Set the Lua side of native hierarchies.
+ *
+ * @tparam function layout Called with a hierarchy table, the context, the
+ *   widget, the width, the height and the previous widget of a node that needs
+ *   to be laid out. Returns the placements from `base.layout_widget`.
+ * @tparam function new_child Called with a hierarchy table, returns a new
+ *   child hierarchy table with a node.
+ * @tparam table counted The widgets that hierarchies count, as keys.
+ * @staticfct _hierarchy_setup
+ * @noreturn
+ */
+int luaA_hierarchy_setup(lua_State* L) {
+    luaL_checktype(L, 3, LUA_TTABLE);
+    Lua::registerfct(L, 1, &layout_callback);
+    Lua::registerfct(L, 2, &new_child_callback);
+    Lua::lregister(L, 3, &counted_widgets);
+    return 0;
+}
+
+/** Create the node of a wibox.hierarchy.
+ *
+ * @return A new node.
+ * @staticfct _hierarchy_node
+ */
+int luaA_hierarchy_node(lua_State* L) {
+    if (!layout_callback) {
+        return luaL_error(L, "_hierarchy_setup was not called");
+    }
+    new (lua_newuserdata(L, sizeof(Node))) Node;
+    if (luaL_newmetatable(L, metatable)) {
+        static const luaL_Reg methods[] = {
+          {                "update",              node_update},
+          {            "invalidate",          node_invalidate},
+          {              "get_size",            node_get_size},
+          {      "get_draw_extents",    node_get_draw_extents},
+          {"get_matrix_to_device", node_get_matrix_to_device},
+          {             "get_count",           node_get_count},
+          {                    NULL,                      NULL}
+        };
+        lua_newtable(L);
+        Lua::setfuncs(L, methods);
+        lua_setfield(L, -2, "__index");
+        lua_pushcfunction(L, node_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+} // namespace WidgetHierarchy
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
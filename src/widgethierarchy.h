@@ -0,0 +1,37 @@
+/*
+ * widgethierarchy.h - native core of wibox.hierarchy header
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+#pragma once
+
+#include "common/luahdr.h"
+
+/** The geometry of wibox.hierarchy nodes, kept natively.
+ *
+ * Each Lua hierarchy table has a node with its size, transformation matrices,
+ * draw extents and widget counts. Updating a hierarchy walks the tree here and
+ * only calls Lua to lay out the nodes that changed, unchanged subtrees are
+ * skipped without touching Lua. The changed areas are returned as rectangles.
+ */
+namespace WidgetHierarchy {
+
+int luaA_hierarchy_setup(lua_State* L);
+int luaA_hierarchy_node(lua_State* L);
+
+} // namespace WidgetHierarchy
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
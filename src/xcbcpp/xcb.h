@@ -1,7 +1,11 @@
 
 #pragma once
 
+#include "trace.h"
+
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -9,8 +13,10 @@
 #include <iterator>
 #include <memory>
 #include <optional>
+#include <source_location>
 #include <span>
 #include <type_traits>
+#include <unordered_map>
 #include <xcb/bigreq.h>
 #include <xcb/randr.h>
 #include <xcb/shape.h>
@@ -116,14 +122,108 @@ struct Rect {
     uint16_t width = 0, height = 0;
 };
 
+/** Counters of the requests sent to the X server and of the time spent
+ * waiting for its replies, by call site.
+ */
+class Stats {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /** The blocking waits of one call site */
+    struct Site {
+        const char* file = nullptr;
+        uint_least32_t line = 0;
+        uint64_t count = 0;
+        uint64_t wait_ns = 0;
+        uint64_t max_ns = 0;
+    };
+
+    struct SiteKey {
+        const char* file;
+        uint_least32_t line;
+        bool operator==(const SiteKey&) const = default;
+    };
+    struct SiteKeyHash {
+        size_t operator()(const SiteKey& k) const {
+            return std::hash<const void*>{}(k.file) ^ (size_t(k.line) * 0x9e3779b9);
+        }
+    };
+
+    uint64_t requests = 0;
+    uint64_t flushes = 0;
+    uint64_t waits = 0;
+    uint64_t wait_ns = 0;
+    std::unordered_map<SiteKey, Site, SiteKeyHash> sites;
+
+    /** Time waited since the last end_iteration() */
+    uint64_t iteration_wait_ns = 0;
+    /** The site of the longest single wait since the last end_iteration() */
+    const Site* iteration_worst = nullptr;
+    uint64_t iteration_worst_ns = 0;
+
+    /** The sequence number of the last NoOperation sent to count requests */
+    unsigned int last_sequence = 0;
+
+    /** Run a function that waits for the X server and account the time to
+     * the call site.
+     */
+    template <typename F>
+    decltype(auto) wait(const std::source_location& loc, F&& f) {
+        const auto start = Clock::now();
+        decltype(auto) result = f();
+        record(loc, Clock::now() - start);
+        return result;
+    }
+
+    void record(const std::source_location& loc, Clock::duration elapsed) {
+        const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        if (Trace::enabled) {
+            Trace::record(
+              Trace::Category::XWait, Clock::now() - elapsed, elapsed, loc.file_name(), loc.line());
+        }
+        auto& site = sites[{loc.file_name(), loc.line()}];
+        site.file = loc.file_name();
+        site.line = loc.line();
+        site.count++;
+        site.wait_ns += ns;
+        site.max_ns = std::max(site.max_ns, ns);
+        waits++;
+        wait_ns += ns;
+        iteration_wait_ns += ns;
+        if (ns >= iteration_worst_ns) {
+            iteration_worst = &site;
+            iteration_worst_ns = ns;
+        }
+    }
+
+    void end_iteration() {
+        iteration_wait_ns = 0;
+        iteration_worst = nullptr;
+        iteration_worst_ns = 0;
+    }
+
+    void reset() {
+        requests = flushes = waits = wait_ns = 0;
+        sites.clear();
+        end_iteration();
+    }
+};
+
+inline Stats stats;
+
+using SrcLoc = std::source_location;
+
 class Connection {
   public:
     xcb_get_atom_name_cookie_t get_atom_name_unchecked(xcb_atom_t atom) {
         return xcb_get_atom_name_unchecked(connection, atom);
     }
     reply<xcb_get_atom_name_reply_t> get_atom_name_reply(xcb_get_atom_name_cookie_t cookie,
-                                                         xcb_generic_error_t** e = nullptr) {
-        return reply<xcb_get_atom_name_reply_t>{xcb_get_atom_name_reply(connection, cookie, e)};
+                                                         xcb_generic_error_t** e = nullptr,
+                                                         SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_get_atom_name_reply_t>{xcb_get_atom_name_reply(connection, cookie, e)};
+        });
     };
     xcb_intern_atom_cookie_t
     intern_atom_unchecked(uint8_t only_if_exists, uint16_t name_len, const char* name) {
@@ -131,8 +231,11 @@ class Connection {
     }
 
     reply<xcb_intern_atom_reply_t> intern_atom_reply(xcb_intern_atom_cookie_t cookie,
-                                                     xcb_generic_error_t** e = nullptr) {
-        return reply<xcb_intern_atom_reply_t>{xcb_intern_atom_reply(connection, cookie, e)};
+                                                     xcb_generic_error_t** e = nullptr,
+                                                     SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_intern_atom_reply_t>{xcb_intern_atom_reply(connection, cookie, e)};
+        });
     }
     xcb_void_cookie_t
     reparent_window(xcb_window_t window, xcb_window_t parent, int16_t x, int16_t y) {
@@ -220,8 +323,11 @@ class Connection {
     }
 
     reply<xcb_query_tree_reply_t> query_tree_reply(xcb_query_tree_cookie_t cookie,
-                                                   xcb_generic_error_t** err = nullptr) {
-        return reply<xcb_query_tree_reply_t>{xcb_query_tree_reply(connection, cookie, err)};
+                                                   xcb_generic_error_t** err = nullptr,
+                                                   SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_query_tree_reply_t>{xcb_query_tree_reply(connection, cookie, err)};
+        });
     }
 
     std::optional<std::span<xcb_window_t, std::dynamic_extent>>
@@ -268,18 +374,27 @@ class Connection {
 
     reply<xcb_get_window_attributes_reply_t>
     get_window_attributes_reply(xcb_get_window_attributes_cookie_t cookie,
-                                xcb_generic_error_t** err = nullptr) {
-        return reply<xcb_get_window_attributes_reply_t>{
-          xcb_get_window_attributes_reply(connection, cookie, err)};
+                                xcb_generic_error_t** err = nullptr,
+                                SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_get_window_attributes_reply_t>{
+              xcb_get_window_attributes_reply(connection, cookie, err)};
+        });
     }
     reply<xcb_get_geometry_reply_t> get_geometry_reply(xcb_get_geometry_cookie_t cookie,
-                                                       xcb_generic_error_t** err = nullptr) {
-        return reply<xcb_get_geometry_reply_t>{xcb_get_geometry_reply(connection, cookie, err)};
+                                                       xcb_generic_error_t** err = nullptr,
+                                                       SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_get_geometry_reply_t>{xcb_get_geometry_reply(connection, cookie, err)};
+        });
     }
 
     reply<xcb_get_property_reply_t> get_property_reply(xcb_get_property_cookie_t cookie,
-                                                       xcb_generic_error_t** err = nullptr) {
-        return reply<xcb_get_property_reply_t>{xcb_get_property_reply(connection, cookie, err)};
+                                                       xcb_generic_error_t** err = nullptr,
+                                                       SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_get_property_reply_t>{xcb_get_property_reply(connection, cookie, err)};
+        });
     }
 
     std::optional<std::span<uint8_t, std::dynamic_extent>>
@@ -449,8 +564,11 @@ class Connection {
                                           time);
     }
     reply<xcb_grab_pointer_reply_t> grab_pointer_reply(xcb_grab_pointer_cookie_t cookie,
-                                                       xcb_generic_error_t** e = nullptr) {
-        return reply<xcb_grab_pointer_reply_t>{xcb_grab_pointer_reply(connection, cookie, e)};
+                                                       xcb_generic_error_t** e = nullptr,
+                                                       SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_grab_pointer_reply_t>{xcb_grab_pointer_reply(connection, cookie, e)};
+        });
     }
 
     xcb_void_cookie_t ungrab_pointer(xcb_timestamp_t time = XCB_CURRENT_TIME) {
@@ -466,9 +584,12 @@ class Connection {
           connection, owner_events, grab_window, time, pointer_mode, keyboard_mode);
     }
     reply<xcb_grab_keyboard_reply_t> grab_keyboard_reply(xcb_grab_keyboard_cookie_t cookie,
-                                                         xcb_generic_error_t** e = nullptr) {
-        return reply<xcb_grab_keyboard_reply_t>{
-          xcb_grab_keyboard_reply(connection, cookie /**< */, e)};
+                                                         xcb_generic_error_t** e = nullptr,
+                                                         SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_grab_keyboard_reply_t>{
+              xcb_grab_keyboard_reply(connection, cookie /**< */, e)};
+        });
     }
 
     xcb_void_cookie_t ungrab_keyboard(xcb_timestamp_t time = XCB_CURRENT_TIME) {
@@ -487,8 +608,11 @@ class Connection {
     }
     uint8_t icccm_get_wm_class_reply(xcb_get_property_cookie_t cookie,
                                      xcb_icccm_get_wm_class_reply_t* prop,
-                                     xcb_generic_error_t** e = nullptr) {
-        return xcb_icccm_get_wm_class_reply(connection, cookie, prop, e);
+                                     xcb_generic_error_t** e = nullptr,
+                                     SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return xcb_icccm_get_wm_class_reply(connection, cookie, prop, e);
+        });
     }
     xcb_void_cookie_t
     icccm_set_wm_class(xcb_window_t window, uint32_t class_len, const char* class_name) {
@@ -501,8 +625,11 @@ class Connection {
 
     uint8_t icccm_get_wm_transient_for_reply(xcb_get_property_cookie_t cookie,
                                              xcb_window_t* prop,
-                                             xcb_generic_error_t** e = nullptr) {
-        return xcb_icccm_get_wm_transient_for_reply(connection, cookie, prop, e);
+                                             xcb_generic_error_t** e = nullptr,
+                                             SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return xcb_icccm_get_wm_transient_for_reply(connection, cookie, prop, e);
+        });
     }
     xcb_get_property_cookie_t icccm_get_wm_transient_for_unchecked(xcb_window_t window) {
         return xcb_icccm_get_wm_transient_for_unchecked(connection, window);
@@ -512,18 +639,24 @@ class Connection {
     }
     uint8_t icccm_get_wm_normal_hints_reply(xcb_get_property_cookie_t cookie,
                                             xcb_size_hints_t* hints,
-                                            xcb_generic_error_t** e = nullptr) {
+                                            xcb_generic_error_t** e = nullptr,
+                                            SrcLoc loc = SrcLoc::current()) {
 
-        return xcb_icccm_get_wm_normal_hints_reply(connection, cookie, hints, e);
+        return stats.wait(loc, [&] {
+            return xcb_icccm_get_wm_normal_hints_reply(connection, cookie, hints, e);
+        });
     }
     xcb_get_property_cookie_t icccm_get_wm_hints_unchecked(xcb_window_t window) {
         return xcb_icccm_get_wm_hints_unchecked(connection, window);
     }
     uint8_t icccm_get_wm_hints_reply(xcb_get_property_cookie_t cookie,
                                      xcb_icccm_wm_hints_t* hints,
-                                     xcb_generic_error_t** e = nullptr) {
+                                     xcb_generic_error_t** e = nullptr,
+                                     SrcLoc loc = SrcLoc::current()) {
 
-        return xcb_icccm_get_wm_hints_reply(connection, cookie, hints, e);
+        return stats.wait(loc, [&] {
+            return xcb_icccm_get_wm_hints_reply(connection, cookie, hints, e);
+        });
     }
     xcb_get_property_cookie_t icccm_get_wm_protocols_unchecked(xcb_window_t window,
                                                                xcb_atom_t wm_protocol_atom) {
@@ -531,11 +664,17 @@ class Connection {
     }
     uint8_t icccm_get_wm_protocols_reply(xcb_get_property_cookie_t cookie,
                                          xcb_icccm_get_wm_protocols_reply_t* protocols,
-                                         xcb_generic_error_t** e = nullptr) {
+                                         xcb_generic_error_t** e = nullptr,
+                                         SrcLoc loc = SrcLoc::current()) {
 
-        return xcb_icccm_get_wm_protocols_reply(connection, cookie, protocols, e);
+        return stats.wait(loc, [&] {
+            return xcb_icccm_get_wm_protocols_reply(connection, cookie, protocols, e);
+        });
+    }
+    int flush() {
+        stats.flushes++;
+        return xcb_flush(connection);
     }
-    int flush() { return xcb_flush(connection); }
     xcb_void_cookie_t
     create_pixmap(uint8_t depth, xcb_pixmap_t pid, xcb_drawable_t drawable, Size sz) {
         return xcb_create_pixmap(connection, depth, pid, drawable, sz.width, sz.height);
@@ -549,8 +688,11 @@ class Connection {
     }
 
     reply<xcb_query_pointer_reply_t> query_pointer_reply(xcb_query_pointer_cookie_t cookie,
-                                                         xcb_generic_error_t** e = nullptr) {
-        return reply<xcb_query_pointer_reply_t>{xcb_query_pointer_reply(connection, cookie, e)};
+                                                         xcb_generic_error_t** e = nullptr,
+                                                         SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_query_pointer_reply_t>{xcb_query_pointer_reply(connection, cookie, e)};
+        });
     }
 
     xcb_void_cookie_t warp_pointer(xcb_window_t dst_window,
@@ -569,11 +711,19 @@ class Connection {
     }
     reply<xcb_get_modifier_mapping_reply_t>
     get_modifier_mapping_reply(xcb_get_modifier_mapping_cookie_t cookie,
-                               xcb_generic_error_t** e = nullptr) {
-        return reply<xcb_get_modifier_mapping_reply_t>{
-          xcb_get_modifier_mapping_reply(connection, cookie, e)};
+                               xcb_generic_error_t** e = nullptr,
+                               SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_get_modifier_mapping_reply_t>{
+              xcb_get_modifier_mapping_reply(connection, cookie, e)};
+        });
+    }
+    void aux_sync(SrcLoc loc = SrcLoc::current()) {
+        stats.wait(loc, [&] {
+            xcb_aux_sync(connection);
+            return 0;
+        });
     }
-    void aux_sync() { xcb_aux_sync(connection); }
     xcb_screen_t* aux_get_screen(int screen) { return xcb_aux_get_screen(connection, screen); }
     void disconnect() {
         xcb_disconnect(connection);
@@ -609,16 +759,24 @@ class Connection {
             return xcb_xkb_get_state_unchecked(connection, deviceSpec);
         }
         reply<xcb_xkb_get_state_reply_t> get_state_reply(xcb_xkb_get_state_cookie_t cookie,
-                                                         xcb_generic_error_t** e = nullptr) {
-            return reply<xcb_xkb_get_state_reply_t>{xcb_xkb_get_state_reply(connection, cookie, e)};
+                                                         xcb_generic_error_t** e = nullptr,
+                                                         SrcLoc loc = SrcLoc::current()) {
+            return stats.wait(loc, [&] {
+                return reply<xcb_xkb_get_state_reply_t>{
+                  xcb_xkb_get_state_reply(connection, cookie, e)};
+            });
         }
         xcb_xkb_get_names_cookie_t get_names_unchecked(xcb_xkb_device_spec_t deviceSpec,
                                                        uint32_t which) {
             return xcb_xkb_get_names_unchecked(connection, deviceSpec, which);
         }
         reply<xcb_xkb_get_names_reply_t> get_names_reply(xcb_xkb_get_names_cookie_t cookie,
-                                                         xcb_generic_error_t** e = nullptr) {
-            return reply<xcb_xkb_get_names_reply_t>{xcb_xkb_get_names_reply(connection, cookie, e)};
+                                                         xcb_generic_error_t** e = nullptr,
+                                                         SrcLoc loc = SrcLoc::current()) {
+            return stats.wait(loc, [&] {
+                return reply<xcb_xkb_get_names_reply_t>{
+                  xcb_xkb_get_names_reply(connection, cookie, e)};
+            });
         }
         xcb_xkb_per_client_flags_cookie_t per_client_flags(xcb_xkb_device_spec_t deviceSpec,
                                                            uint32_t change,
@@ -660,9 +818,12 @@ class Connection {
     }
     reply<xcb_get_selection_owner_reply_t>
     get_selection_owner_reply(xcb_get_selection_owner_cookie_t cookie,
-                              xcb_generic_error_t** e = nullptr) {
-        return reply<xcb_get_selection_owner_reply_t>{
-          xcb_get_selection_owner_reply(connection, cookie, e)};
+                              xcb_generic_error_t** e = nullptr,
+                              SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_get_selection_owner_reply_t>{
+              xcb_get_selection_owner_reply(connection, cookie, e)};
+        });
     }
     xcb_void_cookie_t
     set_selection_owner(xcb_window_t owner, xcb_atom_t selection, xcb_timestamp_t time) {
@@ -686,8 +847,11 @@ class Connection {
         return xcb_alloc_color_unchecked(connection, cmap, color.red, color.green, color.blue);
     }
     reply<xcb_alloc_color_reply_t> alloc_color_reply(xcb_alloc_color_cookie_t cookie,
-                                                     xcb_generic_error_t** e = nullptr) {
-        return reply<xcb_alloc_color_reply_t>{xcb_alloc_color_reply(connection, cookie, e)};
+                                                     xcb_generic_error_t** e = nullptr,
+                                                     SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_alloc_color_reply_t>{xcb_alloc_color_reply(connection, cookie, e)};
+        });
     }
     xcb_void_cookie_t
     create_colormap(uint8_t alloc, xcb_colormap_t mid, xcb_window_t window, xcb_visualid_t visual) {
@@ -731,15 +895,21 @@ class Connection {
         }
         reply<xcb_shape_query_extents_reply_t>
         query_extents_reply(xcb_shape_query_extents_cookie_t cookie,
-                            xcb_generic_error_t** e = nullptr) {
-            return reply<xcb_shape_query_extents_reply_t>{
-              xcb_shape_query_extents_reply(connection, cookie, e)};
+                            xcb_generic_error_t** e = nullptr,
+                            SrcLoc loc = SrcLoc::current()) {
+            return stats.wait(loc, [&] {
+                return reply<xcb_shape_query_extents_reply_t>{
+                  xcb_shape_query_extents_reply(connection, cookie, e)};
+            });
         }
         reply<xcb_shape_get_rectangles_reply_t>
         get_rectangles_reply(xcb_shape_get_rectangles_cookie_t cookie,
-                             xcb_generic_error_t** e = nullptr) {
-            return reply<xcb_shape_get_rectangles_reply_t>{
-              xcb_shape_get_rectangles_reply(connection, cookie, e)};
+                             xcb_generic_error_t** e = nullptr,
+                             SrcLoc loc = SrcLoc::current()) {
+            return stats.wait(loc, [&] {
+                return reply<xcb_shape_get_rectangles_reply_t>{
+                  xcb_shape_get_rectangles_reply(connection, cookie, e)};
+            });
         }
         xcb_void_cookie_t mask(xcb_shape_op_t operation,
                                xcb_shape_kind_t destination_kind,
@@ -755,6 +925,23 @@ class Connection {
                                   y_offset,
                                   source_bitmap);
         }
+        xcb_void_cookie_t rectangles(xcb_shape_op_t operation,
+                                     xcb_shape_kind_t destination_kind,
+                                     uint8_t ordering,
+                                     xcb_window_t destination_window,
+                                     int16_t x_offset,
+                                     int16_t y_offset,
+                                     std::span<const xcb_rectangle_t> rects) {
+            return xcb_shape_rectangles(connection,
+                                        operation,
+                                        destination_kind,
+                                        ordering,
+                                        destination_window,
+                                        x_offset,
+                                        y_offset,
+                                        rects.size(),
+                                        rects.data());
+        }
         xcb_void_cookie_t select_input(xcb_window_t destination_window, uint8_t enable) {
             return xcb_shape_select_input(connection, destination_window, enable);
         }
@@ -770,9 +957,12 @@ class Connection {
 
     reply<xcb_translate_coordinates_reply_t>
     translate_coordinates_reply(xcb_translate_coordinates_cookie_t cookie,
-                                xcb_generic_error_t** e = nullptr) {
-        return reply<xcb_translate_coordinates_reply_t>{
-          xcb_translate_coordinates_reply(connection, cookie, e)};
+                                xcb_generic_error_t** e = nullptr,
+                                SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] {
+            return reply<xcb_translate_coordinates_reply_t>{
+              xcb_translate_coordinates_reply(connection, cookie, e)};
+        });
     }
 
     class Randr {
@@ -792,18 +982,24 @@ class Connection {
         }
         reply<xcb_randr_get_output_info_reply_t>
         get_output_info_reply(xcb_randr_get_output_info_cookie_t cookie,
-                              xcb_generic_error_t** e = nullptr) {
-            return reply<xcb_randr_get_output_info_reply_t>{
-              xcb_randr_get_output_info_reply(connection, cookie, e)};
+                              xcb_generic_error_t** e = nullptr,
+                              SrcLoc loc = SrcLoc::current()) {
+            return stats.wait(loc, [&] {
+                return reply<xcb_randr_get_output_info_reply_t>{
+                  xcb_randr_get_output_info_reply(connection, cookie, e)};
+            });
         }
         xcb_randr_get_monitors_cookie_t get_monitors(xcb_window_t window, uint8_t get_active) {
             return xcb_randr_get_monitors(connection, window, get_active);
         }
         reply<xcb_randr_get_monitors_reply_t>
         get_monitors_reply(xcb_randr_get_monitors_cookie_t cookie,
-                           xcb_generic_error_t** e = nullptr) {
-            return reply<xcb_randr_get_monitors_reply_t>{
-              xcb_randr_get_monitors_reply(connection, cookie, e)};
+                           xcb_generic_error_t** e = nullptr,
+                           SrcLoc loc = SrcLoc::current()) {
+            return stats.wait(loc, [&] {
+                return reply<xcb_randr_get_monitors_reply_t>{
+                  xcb_randr_get_monitors_reply(connection, cookie, e)};
+            });
         }
         xcb_randr_query_version_cookie_t query_version(uint32_t major_version,
                                                        uint32_t minor_version) {
@@ -811,9 +1007,12 @@ class Connection {
         }
         reply<xcb_randr_query_version_reply_t>
         query_version_reply(xcb_randr_query_version_cookie_t cookie,
-                            xcb_generic_error_t** e = nullptr) {
-            return reply<xcb_randr_query_version_reply_t>{
-              xcb_randr_query_version_reply(connection, cookie, e)};
+                            xcb_generic_error_t** e = nullptr,
+                            SrcLoc loc = SrcLoc::current()) {
+            return stats.wait(loc, [&] {
+                return reply<xcb_randr_query_version_reply_t>{
+                  xcb_randr_query_version_reply(connection, cookie, e)};
+            });
         }
         xcb_void_cookie_t select_input(xcb_window_t window, uint16_t enable) {
             return xcb_randr_select_input(connection, window, enable);
@@ -868,8 +1067,19 @@ class Connection {
           connection, type, detail, time, root, rootPos.x, rootPos.y, deviceid);
     }
 
-    xcb_generic_error_t* request_check(xcb_void_cookie_t cookie) {
-        return xcb_request_check(connection, cookie);
+    xcb_generic_error_t* request_check(xcb_void_cookie_t cookie, SrcLoc loc = SrcLoc::current()) {
+        return stats.wait(loc, [&] { return xcb_request_check(connection, cookie); });
+    }
+
+    /** Count the requests sent since the last call and add them to the stats.
+     * This sends a NoOperation request, which is not counted.
+     * \return The total number of requests sent.
+     */
+    uint64_t requests_sent() {
+        const unsigned int sequence = xcb_no_operation(connection).sequence;
+        stats.requests += sequence - stats.last_sequence - 1;
+        stats.last_sequence = sequence;
+        return stats.requests;
     }
 
     uint32_t get_maximum_request_length() { return xcb_get_maximum_request_length(connection); }
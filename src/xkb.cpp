@@ -28,9 +28,15 @@
 #include "common/atoms.h"
 #include "common/util.h"
 #include "globalconf.h"
+#include "keyset.h"
 #include "objects/client.h"
 #include "xwindow.h"
 
+#include <algorithm>
+#include <glib.h>
+#include <optional>
+#include <string>
+#include <vector>
 #include <xkbcommon/xkbcommon-x11.h>
 #include <xkbcommon/xkbcommon.h>
 
@@ -63,14 +69,29 @@ int luaA_xkb_get_layout_group(lua_State* L) {
     return 1;
 }
 
+/** The symbols name of the current keymap, once it was asked for */
+static std::optional<std::string> symbols_name;
+
+/** The group that xkb::group_changed last reported, -1 if it is not known */
+static int reported_group = -1;
+/** The group from the last state notification */
+static int pending_group = -1;
+
 /**
  * Get layout short names.
  *
+ * The names are only asked from the X server once per keymap.
+ *
  * @staticfct xkb_get_group_names
  * @treturn string A string describing the current layout settings,
  *   e.g.: 'pc+us+de:2+inet(evdev)+group(alt_shift_toggle)+ctrl(nocaps)'
  */
 int luaA_xkb_get_group_names(lua_State* L) {
+    if (symbols_name) {
+        lua_pushlstring(L, symbols_name->data(), symbols_name->size());
+        return 1;
+    }
+
     auto name_c = getConnection().xkb().get_names_unchecked(XCB_XKB_ID_USE_CORE_KBD,
                                                             XCB_XKB_NAME_DETAIL_SYMBOLS);
     auto name_r = getConnection().xkb().get_names_reply(name_c);
@@ -93,16 +114,14 @@ int luaA_xkb_get_group_names(lua_State* L) {
                                         name_r->which,
                                         &name_list);
 
-    auto atom_name_c = getConnection().get_atom_name_unchecked(name_list.symbolsName);
-    auto atom_name_r = getConnection().get_atom_name_reply(atom_name_c);
-    if (!atom_name_r) {
+    auto name = atoms_name(getConnection().getConnection(), name_list.symbolsName);
+    if (!name) {
         Lua::warn(L, "Failed to get atom symbols name");
         return 0;
     }
 
-    const char* name = xcb_get_atom_name_name(atom_name_r.get());
-    size_t name_len = xcb_get_atom_name_name_length(atom_name_r.get());
-    lua_pushlstring(L, name, name_len);
+    symbols_name = *name;
+    lua_pushlstring(L, name->data(), name->size());
 
     return 1;
 }
@@ -141,6 +160,166 @@ static bool fill_rmlvo_from_root(struct xkb_rule_names* xkb_names) {
     return true;
 }
 
+/** What a keymap was compiled for: the names of its components, as the server
+ * reports them for the keyboard device, and the device.
+ */
+struct keymap_key {
+    std::string keycodes, types, compat, symbols;
+    int32_t device_id;
+
+    bool operator==(const keymap_key&) const = default;
+};
+
+/** How many compiled keymaps are kept for switching back to them */
+static constexpr size_t keymap_cache_size = 8;
+
+/** Compiled keymaps, most recently used first */
+static std::vector<std::pair<keymap_key, struct xkb_keymap*>> keymap_cache;
+
+/** What the current keymap was compiled for, if it is known */
+static std::optional<keymap_key> current_keymap_key;
+
+/** Get what the keymap of a device is compiled for now.
+ * The component names are the ones of the keymap the server uses, unlike
+ * _XKB_RULES_NAMES which is only a hint left by whoever set the keymap last.
+ * \param device_id The keyboard device.
+ * \return The key, unless the server did not tell the names.
+ */
+static std::optional<keymap_key> xkb_keymap_key(int32_t device_id) {
+    const uint32_t which = XCB_XKB_NAME_DETAIL_KEYCODES | XCB_XKB_NAME_DETAIL_TYPES |
+                           XCB_XKB_NAME_DETAIL_COMPAT | XCB_XKB_NAME_DETAIL_SYMBOLS;
+    auto name_c = getConnection().xkb().get_names_unchecked(device_id, which);
+    auto name_r = getConnection().xkb().get_names_reply(name_c);
+    if (!name_r) {
+        return std::nullopt;
+    }
+
+    xcb_xkb_get_names_value_list_t name_list;
+    void* buffer = xcb_xkb_get_names_value_list(name_r.get());
+    xcb_xkb_get_names_value_list_unpack(buffer,
+                                        name_r->nTypes,
+                                        name_r->indicators,
+                                        name_r->virtualMods,
+                                        name_r->groupNames,
+                                        name_r->nKeys,
+                                        name_r->nKeyAliases,
+                                        name_r->nRadioGroups,
+                                        name_r->which,
+                                        &name_list);
+
+    const xcb_atom_t atoms[] = {
+      name_list.keycodesName, name_list.typesName, name_list.compatName, name_list.symbolsName};
+    std::optional<std::string_view> names[std::size(atoms)];
+    atoms_names(getConnection().getConnection(), atoms, names);
+    if (!std::ranges::all_of(names, [](const auto& name) { return name.has_value(); })) {
+        return std::nullopt;
+    }
+    return keymap_key{std::string(*names[0]),
+                      std::string(*names[1]),
+                      std::string(*names[2]),
+                      std::string(*names[3]),
+                      device_id};
+}
+
+/** Take a keymap out of the cache.
+ * \param key What the keymap is compiled for.
+ * \return The keymap with the reference of the cache, or NULL.
+ */
+static struct xkb_keymap* xkb_keymap_cache_take(const keymap_key& key) {
+    auto it = std::ranges::find(keymap_cache, key, &decltype(keymap_cache)::value_type::first);
+    if (it == keymap_cache.end()) {
+        return NULL;
+    }
+    struct xkb_keymap* keymap = it->second;
+    keymap_cache.erase(it);
+    return keymap;
+}
+
+/** Keep a keymap in the cache, dropping the least recently used one if it is
+ * full.
+ * \param key What the keymap is compiled for.
+ * \param keymap The keymap, the cache takes a new reference.
+ */
+static void xkb_keymap_cache_put(const keymap_key& key, struct xkb_keymap* keymap) {
+    if (keymap_cache.size() >= keymap_cache_size) {
+        xkb_keymap_unref(keymap_cache.back().second);
+        keymap_cache.pop_back();
+    }
+    keymap_cache.insert(keymap_cache.begin(), {key, xkb_keymap_ref(keymap)});
+}
+
+static void xkb_keymap_cache_clear(void) {
+    for (auto& [key, keymap] : keymap_cache) {
+        xkb_keymap_unref(keymap);
+    }
+    keymap_cache.clear();
+}
+
+/** Get the keymap of a device from the X server.
+ * A keymap is only reused when the component names changed since the current
+ * keymap was compiled, like when setxkbmap switches between layouts. A map
+ * change with the same names comes from something like xmodmap changing the
+ * keymap itself, so it is compiled again and not kept.
+ * \param conn The connection.
+ * \param device_id The keyboard device.
+ * \return The keymap, the caller owns a reference.
+ */
+static struct xkb_keymap* xkb_keymap_from_device_cached(xcb_connection_t* conn,
+                                                        int32_t device_id) {
+    auto key = xkb_keymap_key(device_id);
+    struct xkb_keymap* keymap = NULL;
+    const bool names_changed = key && current_keymap_key && *key != *current_keymap_key;
+    if (key) {
+        keymap = xkb_keymap_cache_take(*key);
+        if (keymap && !names_changed) {
+            xkb_keymap_unref(keymap);
+            keymap = NULL;
+        }
+    }
+    current_keymap_key = key;
+    if (keymap) {
+        /* Move to the front */
+        xkb_keymap_cache_put(*key, keymap);
+        return keymap;
+    }
+
+    keymap = xkb_x11_keymap_new_from_device(
+      Manager::get().xkb_ctx, conn, device_id, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    if (!keymap) {
+        log_fatal("Failed while getting XKB keymap from device");
+    }
+    if (names_changed) {
+        xkb_keymap_cache_put(*key, keymap);
+    }
+    return keymap;
+}
+
+/** Compile the keymap of a device and create its state.
+ * This only uses its arguments, so that it can run on another thread.
+ * \param ctx The xkb context.
+ * \param conn The connection.
+ * \param device_id The keyboard device.
+ * \return The new state.
+ */
+static struct xkb_state*
+xkb_state_from_device(struct xkb_context* ctx, xcb_connection_t* conn, int32_t device_id) {
+    struct xkb_keymap* xkb_keymap =
+      xkb_x11_keymap_new_from_device(ctx, conn, device_id, XKB_KEYMAP_COMPILE_NO_FLAGS);
+
+    if (!xkb_keymap) {
+        log_fatal("Failed while getting XKB keymap from device");
+    }
+
+    struct xkb_state* state = xkb_x11_state_new_from_device(xkb_keymap, conn, device_id);
+    if (!state) {
+        log_fatal("Failed while getting XKB state from device");
+    }
+
+    /* xkb_keymap is no longer referenced directly; decreasing refcount */
+    xkb_keymap_unref(xkb_keymap);
+    return state;
+}
+
 /** Fill globalconf.xkb_state based on connection and context
  */
 static void xkb_fill_state(void) {
@@ -149,19 +328,11 @@ static void xkb_fill_state(void) {
     int32_t device_id = xkb_x11_get_core_keyboard_device_id(conn);
 
     if (device_id != -1) {
-        struct xkb_keymap* xkb_keymap = xkb_x11_keymap_new_from_device(
-          Manager::get().xkb_ctx, conn, device_id, XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-        if (!xkb_keymap) {
-            log_fatal("Failed while getting XKB keymap from device");
-        }
-
+        struct xkb_keymap* xkb_keymap = xkb_keymap_from_device_cached(conn, device_id);
         Manager::get().xkb_state = xkb_x11_state_new_from_device(xkb_keymap, conn, device_id);
         if (!Manager::get().xkb_state) {
             log_fatal("Failed while getting XKB state from device");
         }
-
-        /* xkb_keymap is no longer referenced directly; decreasing refcount */
         xkb_keymap_unref(xkb_keymap);
     } else {
         log_warn("Failed while getting XKB device id");
@@ -200,6 +371,46 @@ static void xkb_init_keymap(void) {
     xkb_fill_state();
 }
 
+/** The thread compiling the first keymap, see xkb_init_keymap_start() */
+static GThread* keymap_thread = NULL;
+
+/** The arguments of xkb_state_from_device() for keymap_thread */
+struct keymap_job {
+    struct xkb_context* ctx;
+    xcb_connection_t* conn;
+    int32_t device_id;
+};
+
+static gpointer xkb_keymap_thread(gpointer data) {
+    const keymap_job job = *static_cast<keymap_job*>(data);
+    delete static_cast<keymap_job*>(data);
+    return xkb_state_from_device(job.ctx, job.conn, job.device_id);
+}
+
+/** Like xkb_init_keymap(), but compile the keymap of the core keyboard on a
+ * worker thread. Compiling takes a while and only needs the X server, so the
+ * rest of the startup goes on meanwhile; xkb_init_wait() gets the result.
+ */
+static void xkb_init_keymap_start(void) {
+    Manager::get().xkb_ctx = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (!Manager::get().xkb_ctx) {
+        log_fatal("Failed while getting XKB context");
+    }
+
+    xcb_connection_t* conn = getConnection().getConnection();
+    int32_t device_id = xkb_x11_get_core_keyboard_device_id(conn);
+    if (device_id == -1) {
+        /* The fallback reads the root window, do that here */
+        xkb_fill_state();
+        return;
+    }
+
+    /* XCB connections are thread safe, the context is only used by the thread
+     * until it is joined */
+    keymap_thread = g_thread_new(
+      "xkb keymap", xkb_keymap_thread, new keymap_job{Manager::get().xkb_ctx, conn, device_id});
+}
+
 /** Frees xkb context, state and keymap from globalconf.
  * This should be used when these variables will not be used anymore
  */
@@ -215,20 +426,20 @@ static void xkb_free_keymap(void) {
 static void xkb_reload_keymap(void) {
     xkb_state_unref(Manager::get().xkb_state);
     xkb_fill_state();
+    symbols_name.reset();
 
     /* Free and then allocate the key symbols */
     Manager::get().input.keysyms = getConnection().key_symbols_alloc();
 
+    /* Keysym bindings may now map to other keycodes, resync every grab */
+    xwindow_grabs_reset_keys();
+
     /* Regrab key bindings on the root window */
-    xcb_screen_t* s = Manager::get().screen;
-    xwindow_grabkeys(s->root, Manager::get().keys);
+    KeySet::grab_root();
 
     /* Regrab key bindings on clients */
     for (auto* c : Manager::get().clients) {
-        xwindow_grabkeys(c->window, c->keys);
-        if (c->nofocus_window) {
-            xwindow_grabkeys(c->nofocus_window, c->keys);
-        }
+        KeySet::grab_client(c);
     }
 }
 
@@ -240,10 +451,19 @@ static gboolean xkb_refresh(gpointer unused) {
         xkb_reload_keymap();
     }
     if (Manager::get().xkb_map_changed) {
-        signal_object_emit(L, &Lua::global_signals, "xkb::map_changed", 0);
+        signal_object_emit(L, &Lua::global_signals, "xkb::map_changed"_sig, 0);
     }
-    if (Manager::get().xkb_group_changed) {
-        signal_object_emit(L, &Lua::global_signals, "xkb::group_changed", 0);
+    /* Several state notifications in a row are reported once, and not at
+     * all if the group ends up where it was */
+    if (Manager::get().xkb_group_changed && pending_group != reported_group) {
+        lua_pushinteger(L, pending_group);
+        if (reported_group < 0) {
+            lua_pushnil(L);
+        } else {
+            lua_pushinteger(L, reported_group);
+        }
+        reported_group = pending_group;
+        signal_object_emit(L, &Lua::global_signals, "xkb::group_changed"_sig, 2);
     }
 
     Manager::get().xkb_reload_keymap = false;
@@ -298,6 +518,7 @@ void event_handle_xkb_notify(xcb_generic_event_t* event) {
                               state_notify_event->lockedGroup);
 
         if (state_notify_event->changed & XCB_XKB_STATE_PART_GROUP_STATE) {
+            pending_group = state_notify_event->group;
             Manager::get().xkb_group_changed = true;
             xkb_schedule_refresh();
         }
@@ -359,13 +580,32 @@ void xkb_init(void) {
       XCB_XKB_ID_USE_CORE_KBD, map, 0, map, map_parts, map_parts, 0);
 
     /* load keymap to use when resolving keypresses */
-    xkb_init_keymap();
+    xkb_init_keymap_start();
+}
+
+/** Wait until the keymap that xkb_init() loads is ready.
+ */
+void xkb_init_wait(void) {
+    if (keymap_thread) {
+        Manager::get().xkb_state = static_cast<struct xkb_state*>(g_thread_join(keymap_thread));
+        keymap_thread = NULL;
+        reported_group = pending_group =
+          xkb_state_serialize_layout(Manager::get().xkb_state, XKB_STATE_LAYOUT_EFFECTIVE);
+        /* The first keymap may include changes made after setxkbmap, so it
+         * is not cached, but switching away from it can be */
+        current_keymap_key =
+          xkb_keymap_key(xkb_x11_get_core_keyboard_device_id(getConnection().getConnection()));
+    }
 }
 
 /** Frees resources allocated by xkb_init()
  */
 void xkb_free(void) {
+    xkb_init_wait();
     getConnection().xkb().select_events(XCB_XKB_ID_USE_CORE_KBD, 0, 0, 0, 0, 0, 0);
+    xkb_keymap_cache_clear();
+    current_keymap_key.reset();
+    symbols_name.reset();
     xkb_free_keymap();
 }
 
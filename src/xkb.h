@@ -26,6 +26,7 @@
 
 void event_handle_xkb_notify(xcb_generic_event_t* event);
 void xkb_init(void);
+void xkb_init_wait(void);
 void xkb_free(void);
 
 extern "C" int luaA_xkb_set_layout_group(lua_State* L);
@@ -42,13 +42,17 @@
  *
  */
 
+#include <algorithm>
+#include <array>
+#include <iterator>
+
 /* We don't use the uint32_t types here, to save some space. */
 struct codepair {
     uint16_t keysym;
     uint16_t ucs;
 };
 
-static const struct codepair keysymtab[] = {
+static constexpr struct codepair keysymtab[] = {
   {0x01a1,0x0104          }, /*                     Aogonek Ą LATIN CAPITAL LETTER A WITH OGONEK */
   {0x01a2, 0x02d8}, /*                       breve ˘ BREVE */
   {0x01a3, 0x0141}, /*                     Lstroke Ł LATIN CAPITAL LETTER L WITH STROKE */
@@ -843,6 +847,20 @@ static const struct codepair keysymtab[] = {
   {0x20ac, 0x20ac}, /*                    EuroSign € EURO SIGN */
 };
 
+static_assert(std::ranges::is_sorted(keysymtab, {}, &codepair::keysym));
+
+/* keysymtab[] sorted by Unicode value, built at compile time for a binary search
+ * in the other direction. Where several keysyms map to the same character, the
+ * smallest one comes first, which is the first one in keysymtab[]. */
+static constexpr auto keysymtab_by_ucs = [] {
+    std::array<codepair, std::size(keysymtab)> table{};
+    std::ranges::copy(keysymtab, table.begin());
+    std::ranges::sort(table, [](codepair a, codepair b) {
+        return a.ucs != b.ucs ? a.ucs < b.ucs : a.keysym < b.keysym;
+    });
+    return table;
+}();
+
 static xkb_keysym_t xkb_utf32_to_keysym_compat(uint32_t ucs) {
     /* first check for Latin-1 characters (1:1 mapping) */
     if ((ucs >= 0x0020 && ucs <= 0x007e) || (ucs >= 0x00a0 && ucs <= 0x00ff)) {
@@ -864,10 +882,9 @@ static xkb_keysym_t xkb_utf32_to_keysym_compat(uint32_t ucs) {
     }
 
     /* search main table */
-    for (size_t i = 0; i < sizeof(keysymtab) / sizeof(keysymtab[0]); i++) {
-        if (keysymtab[i].ucs == ucs) {
-            return keysymtab[i].keysym;
-        }
+    auto it = std::ranges::lower_bound(keysymtab_by_ucs, ucs, {}, &codepair::ucs);
+    if (it != keysymtab_by_ucs.end() && it->ucs == ucs) {
+        return it->keysym;
     }
 
     /* Use direct encoding if everything else fails */
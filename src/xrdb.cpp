@@ -21,9 +21,71 @@
 
 #include "xrdb.h"
 
+#include "common/xcursor.h"
 #include "globalconf.h"
+#include "luaa.h"
+#include "objects/drawin.h"
+#include "xwindow.h"
 
+#include <optional>
 #include <string.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+/** The resources looked up so far, by class and name. A missing resource is
+ * cached too. The cache is refreshed when RESOURCE_MANAGER changes.
+ */
+std::unordered_map<std::string, std::optional<std::string>> cache;
+
+std::string cache_key(std::string_view resource_class, std::string_view resource_name) {
+    std::string key;
+    key.reserve(resource_class.size() + resource_name.size() + 1);
+    key.append(resource_class);
+    key.push_back('\0');
+    key.append(resource_name);
+    return key;
+}
+
+std::optional<std::string> xrdb_lookup(const char* resource_class, const char* resource_name) {
+    char* result = NULL;
+    if (xcb_xrm_resource_get_string(
+          Manager::get().x.xrmdb, resource_name, resource_class, &result) < 0) {
+        return std::nullopt;
+    }
+    std::string value(result);
+    p_delete(&result);
+    return value;
+}
+
+/** Look the cached resources up again and emit xrdb_changed with the names of
+ * the ones whose value changed.
+ */
+void xrdb_refresh_cache(void) {
+    std::vector<std::string_view> changed;
+    for (auto& [key, value] : cache) {
+        const char* resource_class = key.c_str();
+        const char* resource_name = resource_class + strlen(resource_class) + 1;
+        auto fresh = xrdb_lookup(resource_class, resource_name);
+        if (fresh != value) {
+            value = std::move(fresh);
+            changed.push_back(resource_name);
+        }
+    }
+
+    lua_State* L = globalconf_get_lua_State();
+    lua_createtable(L, changed.size(), 0);
+    for (size_t i = 0; i < changed.size(); i++) {
+        lua_pushlstring(L, changed[i].data(), changed[i].size());
+        lua_rawseti(L, -2, i + 1);
+    }
+    signal_object_emit(L, &Lua::global_signals, "xrdb_changed"_sig, 1);
+}
+
+} // namespace
 
 /* \brief get value from X Resources DataBase
  * \param L The Lua VM state.
@@ -36,17 +98,52 @@
 int luaA_xrdb_get_value(lua_State* L) {
     const char* resource_class = luaL_checkstring(L, 1);
     const char* resource_name = luaL_checkstring(L, 2);
-    char* result = NULL;
 
-    if (xcb_xrm_resource_get_string(
-          Manager::get().x.xrmdb, resource_name, resource_class, &result) < 0) {
-        lua_pushnil(L);
+    auto key = cache_key(resource_class, resource_name);
+    auto it = cache.find(key);
+    if (it == cache.end()) {
+        it = cache.emplace(std::move(key), xrdb_lookup(resource_class, resource_name)).first;
+    }
+
+    if (it->second) {
+        lua_pushlstring(L, it->second->data(), it->second->size());
     } else {
-        lua_pushstring(L, result);
-        p_delete(&result);
+        lua_pushnil(L);
     }
 
     return 1;
 }
 
+/** Read the X resources and the cursor theme again after RESOURCE_MANAGER
+ * changed. The cached resources are looked up again, the cached cursors are
+ * dropped and the root window and drawins get theirs again from the new theme.
+ */
+void xrdb_reload(void) {
+    auto& x = Manager::get().x;
+    auto conn = getConnection().getConnection();
+
+    if (auto db = xcb_xrm_database_from_default(conn)) {
+        xcb_xrm_database_free(x.xrmdb);
+        x.xrmdb = db;
+    }
+
+    xcb_cursor_context_t* ctx;
+    if (xcb_cursor_context_new(conn, Manager::get().screen, &ctx) < 0) {
+        log_warn("Failed to reload the cursor theme");
+    } else {
+        xcursor_cache_clear(conn);
+        xcb_cursor_context_free(x.cursor_ctx);
+        x.cursor_ctx = ctx;
+
+        root_update_cursor();
+        for (auto drawin : Manager::get().drawins) {
+            if (uint16_t cursor_font = xcursor_font_fromstr(drawin->cursor.c_str())) {
+                xwindow_set_cursor(drawin->window, xcursor_new(ctx, cursor_font));
+            }
+        }
+    }
+
+    xrdb_refresh_cache();
+}
+
 // vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
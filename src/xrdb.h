@@ -23,3 +23,4 @@
 #include "common/luahdr.h"
 
 extern "C" int luaA_xrdb_get_value(lua_State* L);
+void xrdb_reload(void);
@@ -23,10 +23,24 @@
 
 #include "common/atoms.h"
 #include "globalconf.h"
+#include "memstats.h"
 #include "objects/button.h"
 
+#include <algorithm>
 #include <cairo-xcb.h>
+#include <climits>
 #include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <xcb/shape.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
@@ -87,6 +101,70 @@ void xwindow_configure(xcb_window_t win, area_t geometry, int border) {
     Manager::get().x.connection.send_event(false, win, XCB_EVENT_MASK_STRUCTURE_NOTIFY, (char*)&ce);
 }
 
+/** A (keycode or button, modifiers) pair grabbed on a window. */
+using grab_t = std::pair<uint8_t, uint16_t>;
+
+/** The grabs currently installed on a window, unset when unknown. */
+struct window_grabs {
+    std::optional<std::set<grab_t>> keys;
+    std::optional<std::set<grab_t>> buttons;
+};
+
+/** Per window grab sets, so that only the changed bindings generate requests. */
+static std::unordered_map<xcb_window_t, window_grabs> grabs;
+
+/** Whether two grabs share a combination.
+ * Keycode or button 0 is AnyKey or AnyButton, and AnyModifier covers all the
+ * modifiers, so a grab using them overlaps the specific ones it covers.
+ */
+static bool xwindow_grabs_overlap(const grab_t& a, const grab_t& b) {
+    const bool code = !a.first || !b.first || a.first == b.first;
+    const bool mods = a.second == XCB_MOD_MASK_ANY || b.second == XCB_MOD_MASK_ANY ||
+                      a.second == b.second;
+    return code && mods;
+}
+
+/** Bring the grabs of a window to the wanted set.
+ * If the current grabs are unknown, everything is ungrabbed first. Ungrabbing
+ * a combination releases it in every grab covering it, so the kept grabs
+ * which overlap an ungrabbed one are grabbed again.
+ * \param current The grabs currently installed, updated in place.
+ * \param wanted The grabs that should be installed.
+ * \param ungrab_all Ungrab every binding of the window.
+ * \param ungrab Ungrab one binding.
+ * \param grab Grab one binding.
+ */
+template <typename UngrabAll, typename Ungrab, typename Grab>
+static void xwindow_grabs_sync(std::optional<std::set<grab_t>>& current,
+                               std::set<grab_t>&& wanted,
+                               UngrabAll&& ungrab_all,
+                               Ungrab&& ungrab,
+                               Grab&& grab) {
+    if (!current) {
+        ungrab_all();
+        current.emplace();
+    }
+
+    std::vector<grab_t> removed;
+    for (const auto& g : *current) {
+        if (!wanted.contains(g)) {
+            ungrab(g);
+            removed.push_back(g);
+        }
+    }
+    for (const auto& g : wanted) {
+        const bool released =
+          current->contains(g) && std::ranges::any_of(removed, [&g](const grab_t& r) {
+              return xwindow_grabs_overlap(g, r);
+          });
+        if (released || !current->contains(g)) {
+            grab(g);
+        }
+    }
+
+    current = std::move(wanted);
+}
+
 /** Grab or ungrab buttons on a window.
  * \param win The window.
  * \param buttons The buttons to grab.
@@ -96,40 +174,90 @@ void xwindow_buttons_grab(xcb_window_t win, const std::vector<button_t*>& button
         return;
     }
 
-    /* Ungrab everything first */
-    Manager::get().x.connection.ungrab_button(XCB_BUTTON_INDEX_ANY, win, XCB_BUTTON_MASK_ANY);
-
+    std::set<grab_t> wanted;
     for (auto each : buttons) {
-        each->grab(win);
+        wanted.emplace(each->button(), each->modifiers());
     }
+
+    auto& conn = Manager::get().x.connection;
+    xwindow_grabs_sync(
+      grabs[win].buttons,
+      std::move(wanted),
+      [&] { conn.ungrab_button(XCB_BUTTON_INDEX_ANY, win, XCB_BUTTON_MASK_ANY); },
+      [&](const grab_t& g) { conn.ungrab_button(g.first, win, g.second); },
+      [&](const grab_t& g) {
+          conn.grab_button(false,
+                           win,
+                           BUTTONMASK,
+                           XCB_GRAB_MODE_SYNC,
+                           XCB_GRAB_MODE_ASYNC,
+                           XCB_NONE,
+                           XCB_NONE,
+                           g.first,
+                           g.second);
+      });
 }
 
-/** Grab key on a window.
- * \param win The window.
+/** Get the (keycode, modifiers) pairs a key binding grabs.
  * \param k The key.
+ * \param out Where to add the pairs.
  */
-static void xwindow_grabkey(xcb_window_t win, const keyb_t* k) {
+static void xwindow_key_grabs(const keyb_t* k, std::set<grab_t>& out) {
     if (k->keycode) {
-        Manager::get().x.connection.grab_key(
-          true, win, k->modifiers, k->keycode, XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+        out.emplace(k->keycode, k->modifiers);
     } else if (k->keysym) {
         auto keycodes = Manager::get().input.keysyms.get_keycode(k->keysym);
         if (!keycodes) {
             return;
         }
         for (xcb_keycode_t* kc = keycodes.get(); *kc; kc++) {
-            getConnection().grab_key(
-              true, win, k->modifiers, *kc, XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+            out.emplace(*kc, k->modifiers);
         }
     }
 }
 
+/** Grab keys on a window.
+ * Only the bindings which changed since the last call are grabbed or
+ * ungrabbed.
+ * \param win The window.
+ * \param keys The keys to grab.
+ */
 void xwindow_grabkeys(xcb_window_t win, const std::vector<keyb_t*>& keys) {
-    /* Ungrab everything first */
-    getConnection().ungrab_key(XCB_GRAB_ANY, win, XCB_BUTTON_MASK_ANY);
+    if (win == XCB_NONE) {
+        return;
+    }
 
+    std::set<grab_t> wanted;
     for (auto k : keys) {
-        xwindow_grabkey(win, k);
+        xwindow_key_grabs(k, wanted);
+    }
+
+    auto& conn = getConnection();
+    xwindow_grabs_sync(
+      grabs[win].keys,
+      std::move(wanted),
+      [&] { conn.ungrab_key(XCB_GRAB_ANY, win, XCB_BUTTON_MASK_ANY); },
+      [&](const grab_t& g) { conn.ungrab_key(g.first, win, g.second); },
+      [&](const grab_t& g) {
+          conn.grab_key(true, win, g.second, g.first, XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+      });
+}
+
+/** Forget the grabs tracked for a window.
+ * This must be called when the window goes away, since its id may be reused.
+ * The next grab on the window will start from scratch.
+ * \param win The window.
+ */
+void xwindow_grabs_forget(xcb_window_t win) { grabs.erase(win); }
+
+/** Forget the key grabs tracked for every window.
+ * The next xwindow_grabkeys() on each window ungrabs all keys and grabs all of
+ * its bindings again. Used when the keymap changed, since keysym bindings may
+ * now map to other keycodes. Button grabs do not depend on the keymap.
+ */
+void xwindow_grabs_reset_keys(void) {
+    for (auto& [win, g] : grabs) {
+        g.keys.reset();
     }
 }
 
@@ -220,6 +348,244 @@ void xwindow_set_border_color(xcb_window_t w, color_t* color) {
     }
 }
 
+/** A shape mask turned into YX-banded rectangles. Masks are shared by all
+ * windows that use the same mask, so that setting the same shape again (e.g.
+ * rounded corners after a resize) neither scans nor uploads it again.
+ */
+struct shape_mask_t {
+    std::vector<xcb_rectangle_t> rects;
+    /** False if the mask needs too many rectangles, it is then uploaded as a bitmap */
+    bool rects_valid = true;
+    xcb_pixmap_t pixmap = XCB_NONE;
+};
+
+struct shape_key_t {
+    size_t hash;
+    int width, height;
+    /** The part of the surface within the mask */
+    int w, h;
+    /** Whether each of its pixels is set, see shape_mask_bits() */
+    std::string bits;
+
+    bool operator==(const shape_key_t&) const = default;
+};
+
+/** Recently used masks, most recently used first */
+static std::list<std::pair<shape_key_t, std::shared_ptr<shape_mask_t>>> shape_masks;
+static constexpr size_t shape_masks_max = 32;
+/** Masks with more rectangles than this are uploaded as a bitmap */
+static constexpr size_t shape_rects_max = 4096;
+
+/** The shapes that we set on our own windows, so that reading them back does not
+ * need a round trip. A null mask means that the window is not shaped. */
+struct known_shape_t {
+    std::shared_ptr<const shape_mask_t> mask;
+    int offset;
+};
+static std::map<std::pair<xcb_window_t, xcb_shape_sk_t>, known_shape_t> known_shapes;
+
+/** Check whether a pixel ends up in a 1-bit mask painted from a surface.
+ * Like pixman, only the most significant bit of the alpha value counts.
+ */
+static bool shape_pixel_set(const unsigned char* row, cairo_format_t format, int x) {
+    switch (format) {
+    case CAIRO_FORMAT_A1: {
+        const uint32_t word = reinterpret_cast<const uint32_t*>(row)[x >> 5];
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return (word >> (x & 31)) & 1;
+#else
+        return (word >> (31 - (x & 31))) & 1;
+#endif
+    }
+    case CAIRO_FORMAT_A8: return row[x] & 0x80;
+    case CAIRO_FORMAT_ARGB32: return reinterpret_cast<const uint32_t*>(row)[x] >> 31;
+    default: return true;
+    }
+}
+
+/** Turn an image surface into the rectangles of a width x height mask.
+ * \param mask The mask to fill.
+ * \param width The width of the mask.
+ * \param height The height of the mask.
+ * \param surf The image surface, painted at 0x0.
+ */
+static void shape_mask_scan(shape_mask_t& mask, int width, int height, cairo_surface_t* surf) {
+    const auto format = cairo_image_surface_get_format(surf);
+    const unsigned char* data = cairo_image_surface_get_data(surf);
+    const int stride = cairo_image_surface_get_stride(surf);
+    const int w = std::min(width, cairo_image_surface_get_width(surf));
+    const int h = std::min(height, cairo_image_surface_get_height(surf));
+
+    /* The spans of the current row, merged into the previous band if equal */
+    std::vector<xcb_rectangle_t> spans;
+    size_t band = 0;
+    for (int y = 0; y < h; y++) {
+        const unsigned char* row = data + size_t(y) * stride;
+        spans.clear();
+        for (int x = 0; x < w;) {
+            if (!shape_pixel_set(row, format, x)) {
+                x++;
+                continue;
+            }
+            const int start = x;
+            while (x < w && shape_pixel_set(row, format, x)) {
+                x++;
+            }
+            spans.push_back({int16_t(start), int16_t(y), uint16_t(x - start), 1});
+        }
+
+        const size_t band_size = mask.rects.size() - band;
+        const bool same = band_size == spans.size() && band_size > 0 &&
+                          mask.rects[band].y + mask.rects[band].height == y &&
+                          std::equal(spans.begin(), spans.end(), mask.rects.begin() + band,
+                                     [](const auto& a, const auto& b) {
+                                         return a.x == b.x && a.width == b.width;
+                                     });
+        if (same) {
+            for (size_t i = band; i < mask.rects.size(); i++) {
+                mask.rects[i].height++;
+            }
+            continue;
+        }
+        if (spans.empty()) {
+            continue;
+        }
+        if (mask.rects.size() + spans.size() > shape_rects_max) {
+            mask.rects.clear();
+            mask.rects_valid = false;
+            return;
+        }
+        band = mask.rects.size();
+        mask.rects.insert(mask.rects.end(), spans.begin(), spans.end());
+    }
+}
+
+/** Pack the pixels of the mask a surface gives, one bit each, row after row.
+ * Unlike the surface data, this does not depend on the format or on the
+ * padding of the rows.
+ */
+static std::string shape_mask_bits(cairo_surface_t* surf, int w, int h) {
+    const auto format = cairo_image_surface_get_format(surf);
+    const unsigned char* data = cairo_image_surface_get_data(surf);
+    const int stride = cairo_image_surface_get_stride(surf);
+    std::string bits((size_t(w) * h + 7) / 8, '\0');
+    size_t i = 0;
+    for (int y = 0; y < h; y++) {
+        const unsigned char* row = data + size_t(y) * stride;
+        for (int x = 0; x < w; x++, i++) {
+            if (shape_pixel_set(row, format, x)) {
+                bits[i >> 3] |= char(1 << (i & 7));
+            }
+        }
+    }
+    return bits;
+}
+
+/** Get the mask for a surface from the cache, or create it.
+ * \return The mask, or nullptr if the surface cannot be read directly.
+ */
+static std::shared_ptr<shape_mask_t> shape_mask_get(int width, int height, cairo_surface_t* surf) {
+    if (cairo_surface_get_type(surf) != CAIRO_SURFACE_TYPE_IMAGE) {
+        return nullptr;
+    }
+    double dx, dy;
+    cairo_surface_get_device_offset(surf, &dx, &dy);
+    const auto format = cairo_image_surface_get_format(surf);
+    if (dx != 0 || dy != 0 ||
+        (format != CAIRO_FORMAT_A1 && format != CAIRO_FORMAT_A8 &&
+         format != CAIRO_FORMAT_ARGB32 && format != CAIRO_FORMAT_RGB24)) {
+        return nullptr;
+    }
+
+    cairo_surface_flush(surf);
+    const int w = std::max(0, std::min(width, cairo_image_surface_get_width(surf)));
+    const int h = std::max(0, std::min(height, cairo_image_surface_get_height(surf)));
+    std::string bits = shape_mask_bits(surf, w, h);
+    const size_t hash = std::hash<std::string_view>{}(bits) ^ (size_t(w) << 24) ^ size_t(h);
+    const shape_key_t key{hash, width, height, w, h, std::move(bits)};
+
+    auto it = std::ranges::find(shape_masks, key, [](const auto& e) { return e.first; });
+    if (it != shape_masks.end()) {
+        shape_masks.splice(shape_masks.begin(), shape_masks, it);
+        return it->second;
+    }
+
+    auto mask = std::make_shared<shape_mask_t>();
+    shape_mask_scan(*mask, width, height, surf);
+    shape_masks.emplace_front(key, mask);
+    if (shape_masks.size() > shape_masks_max) {
+        if (shape_masks.back().second->pixmap != XCB_NONE) {
+            const auto& key = shape_masks.back().first;
+            getConnection().free_pixmap(shape_masks.back().second->pixmap);
+            MemStats::pixmap(MemStats::Pixmap::Shape)
+              .remove(MemStats::pixmap_bytes(key.width, key.height, 1));
+        }
+        shape_masks.pop_back();
+    }
+    return mask;
+}
+
+/** Forget the shapes remembered for a window that is being destroyed.
+ * \param win The window.
+ */
+void xwindow_shapes_forget(xcb_window_t win) {
+    for (auto kind : {XCB_SHAPE_SK_BOUNDING, XCB_SHAPE_SK_CLIP, XCB_SHAPE_SK_INPUT}) {
+        known_shapes.erase({win, kind});
+    }
+}
+
+/** Draw rectangles into a new A1 surface.
+ * \param rects The rectangles.
+ * \param x The left edge of the surface.
+ * \param y The top edge of the surface.
+ * \param width The width of the surface.
+ * \param height The height of the surface.
+ * \return The surface.
+ */
+static cairo_surface_t* xwindow_shape_surface(std::span<const xcb_rectangle_t> rects,
+                                              int16_t x,
+                                              int16_t y,
+                                              uint16_t width,
+                                              uint16_t height) {
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_A1, width, height);
+    cairo_t* cr = cairo_create(surface);
+
+    cairo_surface_set_device_offset(surface, -x, -y);
+    cairo_set_fill_rule(cr, CAIRO_FILL_RULE_WINDING);
+
+    for (const auto& r : rects) {
+        cairo_rectangle(cr, r.x, r.y, r.width, r.height);
+    }
+    cairo_fill(cr);
+
+    cairo_destroy(cr);
+    return surface;
+}
+
+/** Build a surface from a shape that we set ourselves, see known_shapes.
+ * \return The surface, or NULL if the window is not shaped.
+ */
+static cairo_surface_t* xwindow_known_shape_surface(const known_shape_t& known) {
+    if (!known.mask) {
+        return NULL;
+    }
+
+    std::vector<xcb_rectangle_t> rects = known.mask->rects;
+    int x1 = INT_MAX, y1 = INT_MAX, x2 = INT_MIN, y2 = INT_MIN;
+    for (auto& r : rects) {
+        r.x += known.offset;
+        r.y += known.offset;
+        x1 = std::min<int>(x1, r.x);
+        y1 = std::min<int>(y1, r.y);
+        x2 = std::max<int>(x2, r.x + r.width);
+        y2 = std::max<int>(y2, r.y + r.height);
+    }
+    if (rects.empty()) {
+        x1 = y1 = x2 = y2 = 0;
+    }
+    return xwindow_shape_surface(rects, x1, y1, x2 - x1, y2 - y1);
+}
+
 /** Get one of a window's shapes as a cairo surface */
 cairo_surface_t* xwindow_get_shape(xcb_window_t win, enum xcb_shape_sk_t kind) {
     if (!Manager::get().x.caps.have_shape) {
@@ -229,6 +595,13 @@ cairo_surface_t* xwindow_get_shape(xcb_window_t win, enum xcb_shape_sk_t kind) {
         return NULL;
     }
 
+    /* Shapes that we set ourselves are already known */
+    if (kind != XCB_SHAPE_SK_INPUT) {
+        if (auto it = known_shapes.find({win, kind}); it != known_shapes.end()) {
+            return xwindow_known_shape_surface(it->second);
+        }
+    }
+
     int16_t x, y;
     uint16_t width, height;
     xcb_shape_get_rectangles_cookie_t rcookie = getConnection().shape().get_rectangles(win, kind);
@@ -282,21 +655,9 @@ cairo_surface_t* xwindow_get_shape(xcb_window_t win, enum xcb_shape_sk_t kind) {
         return cairo_image_surface_create(CAIRO_FORMAT_INVALID, -1, -1);
     }
 
-    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_A1, width, height);
-    cairo_t* cr = cairo_create(surface);
     int num_rects = xcb_shape_get_rectangles_rectangles_length(rects_reply.get());
     xcb_rectangle_t* rects = xcb_shape_get_rectangles_rectangles(rects_reply.get());
-
-    cairo_surface_set_device_offset(surface, -x, -y);
-    cairo_set_fill_rule(cr, CAIRO_FILL_RULE_WINDING);
-
-    for (int i = 0; i < num_rects; i++) {
-        cairo_rectangle(cr, rects[i].x, rects[i].y, rects[i].width, rects[i].height);
-    }
-    cairo_fill(cr);
-
-    cairo_destroy(cr);
-    return surface;
+    return xwindow_shape_surface({rects, size_t(num_rects)}, x, y, width, height);
 }
 
 /** Turn a cairo surface into a pixmap with depth 1 */
@@ -311,6 +672,7 @@ static xcb_pixmap_t xwindow_shape_pixmap(int width, int height, cairo_surface_t*
 
     getConnection().create_pixmap(
       1, pixmap, Manager::get().screen->root, {(uint16_t)(width), (uint16_t)height});
+    MemStats::pixmap(MemStats::Pixmap::Shape).add(MemStats::pixmap_bytes(width, height, 1));
     dest = cairo_xcb_surface_create_for_bitmap(
       getConnection().getConnection(), Manager::get().screen, pixmap, width, height);
 
@@ -341,6 +703,28 @@ void xwindow_set_shape(xcb_window_t win,
         return;
     }
 
+    std::shared_ptr<shape_mask_t> mask;
+    if (surf && width > 0 && height > 0) {
+        mask = shape_mask_get(width, height, surf);
+    }
+
+    if (mask && mask->rects_valid) {
+        /* Simple shapes (rectangles, rounded corners) need no bitmap at all */
+        getConnection().shape().rectangles(
+          XCB_SHAPE_SO_SET, kind, XCB_CLIP_ORDERING_YX_BANDED, win, offset, offset, mask->rects);
+        known_shapes[{win, kind}] = {mask, offset};
+        return;
+    }
+
+    if (mask) {
+        if (mask->pixmap == XCB_NONE) {
+            mask->pixmap = xwindow_shape_pixmap(width, height, surf);
+        }
+        getConnection().shape().mask(XCB_SHAPE_SO_SET, kind, win, offset, offset, mask->pixmap);
+        known_shapes.erase({win, kind});
+        return;
+    }
+
     xcb_pixmap_t pixmap = XCB_NONE;
     if (surf) {
         pixmap = xwindow_shape_pixmap(width, height, surf);
@@ -350,6 +734,11 @@ void xwindow_set_shape(xcb_window_t win,
 
     if (pixmap != XCB_NONE) {
         getConnection().free_pixmap(pixmap);
+        MemStats::pixmap(MemStats::Pixmap::Shape).remove(MemStats::pixmap_bytes(width, height, 1));
+        known_shapes.erase({win, kind});
+    } else {
+        /* The window is not shaped anymore */
+        known_shapes[{win, kind}] = {nullptr, offset};
     }
 }
 
@@ -14,6 +14,7 @@ pcall(require, 'luarocks.loader')
 local lgi  = require 'lgi'
 local GLib = lgi.require('GLib')
 local Gdk  = lgi.require('Gdk')
+local GdkPixbuf = lgi.require('GdkPixbuf')
 local Gtk  = lgi.require('Gtk', '3.0')
 local Gio  = lgi.require('Gio')
 Gtk.init()
@@ -45,6 +46,13 @@ local function open_window(class, title, options)
     elseif options.unminimize_after then
         window:iconify()
     end
+    if options.icon_size then
+        -- A square of one color, windows with the same size get the same icon
+        local size = tonumber(options.icon_size)
+        local icon = GdkPixbuf.Pixbuf.new(GdkPixbuf.Colorspace.RGB, true, 8, size, size)
+        icon:fill(0x3366ccff)
+        window:set_icon(icon)
+    end
     window:set_wmclass(class, class)
     window:show_all()
     if options.maximize_after then
@@ -217,6 +225,9 @@ local function new(_, class, title, sn_rules, callback, resize_increment, args)
         assert(type(args.gravity)=="number","Use `lgi.Gdk.Gravity.NORTH_WEST`")
         options = options .. "gravity=" .. args.gravity .. ","
     end
+    if args.icon_size then
+        options = options .. "icon_size=" .. args.icon_size .. ","
+    end
 
     local data = class .. "\n" .. title .. "\n" .. options .. "\n"
     local success, msg = pipe:write_all(data)
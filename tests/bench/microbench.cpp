@@ -0,0 +1,456 @@
+/*
+ * microbench.cpp - microbenchmarks of the window manager hot paths
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* This links everything but the main loop of the window manager and sets up
+ * just enough of it to manage a few hundred windows: an X connection, the Lua
+ * classes and the screens, but no rc.lua. It needs an X server that no other
+ * window manager runs on, e.g.
+ *
+ *     meson setup -Dbenchmarks=true build
+ *     xvfb-run -a meson test -C build --benchmark
+ *
+ * The results are printed as JSON, in a fixed order. Set BENCHMARK_EXACT=1
+ * for longer and more stable measurements, and pass benchmark names to only
+ * run some of them.
+ */
+
+#include "awesome.h"
+#include "banning.h"
+#include "common/atoms.h"
+#include "common/version.h"
+#include "draw.h"
+#include "event.h"
+#include "ewmh.h"
+#include "globalconf.h"
+#include "luaa.h"
+#include "objects/client.h"
+#include "objects/screen.h"
+#include "property.h"
+#include "stack.h"
+#include "systray.h"
+#include "xcbcpp/xcb.h"
+#include "xkb.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <xcb/xcb.h>
+
+/* Exit code that makes meson report the benchmark as skipped */
+static constexpr int EXIT_SKIP = 77;
+
+/* The number of clients and root key bindings the benchmarks work with */
+static constexpr int CLIENT_COUNT = 200;
+static constexpr int KEY_COUNT = 64;
+
+static Manager* gGlobals = nullptr;
+Manager& Manager::get() { return *gGlobals; }
+
+XCB::Connection& getConnection() { return Manager::get().x.connection; }
+
+void awesome_restart(void) {}
+void awesome_atexit(bool) {}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double median_ns;
+    double min_ns;
+};
+
+/** Time one iteration of a function, in nanoseconds */
+double run_rounds(const std::function<void()>& f, uint64_t iterations) {
+    const auto start = Clock::now();
+    for (uint64_t i = 0; i < iterations; i++) {
+        f();
+    }
+    const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+class Runner {
+    std::vector<std::string_view> filters;
+    std::chrono::nanoseconds round_time;
+    std::vector<Result> results;
+
+  public:
+    std::function<void()> between_rounds = [] {};
+
+    Runner(int argc, char** argv)
+      : filters(argv + 1, argv + argc)
+      , round_time(getenv("BENCHMARK_EXACT") ? std::chrono::milliseconds(200)
+                                             : std::chrono::milliseconds(20)) {}
+
+    bool wanted(std::string_view name) const {
+        return filters.empty() || std::ranges::any_of(filters, [name](auto f) {
+                   return name.find(f) != std::string_view::npos;
+               });
+    }
+
+    /** Measure a function in several rounds of the same number of iterations,
+     * sized so that a round takes about round_time */
+    void run(std::string_view name, const std::function<void()>& f) {
+        if (!wanted(name)) {
+            return;
+        }
+        constexpr int rounds = 7;
+
+        uint64_t iterations = 1;
+        double per_iteration = run_rounds(f, iterations);
+        while (per_iteration * iterations < round_time.count() / 10.0) {
+            iterations *= 10;
+            per_iteration = run_rounds(f, iterations);
+        }
+        iterations = uint64_t(round_time.count() / std::max(per_iteration, 1.0));
+        iterations = std::max<uint64_t>(iterations, 1);
+
+        std::vector<double> samples;
+        for (int i = 0; i < rounds; i++) {
+            between_rounds();
+            samples.push_back(run_rounds(f, iterations));
+        }
+        std::ranges::sort(samples);
+        results.push_back({std::string(name), iterations, samples[rounds / 2], samples.front()});
+    }
+
+    void print() const {
+        fmt::print("{{\n  \"benchmarks\": [\n");
+        for (size_t i = 0; i < results.size(); i++) {
+            const auto& r = results[i];
+            fmt::print("    {{\"name\": \"{}\", \"iterations\": {}, \"median_ns\": {:.1f}, "
+                       "\"min_ns\": {:.1f}}}{}\n",
+                       r.name,
+                       r.iterations,
+                       r.median_ns,
+                       r.min_ns,
+                       i + 1 < results.size() ? "," : "");
+        }
+        fmt::print("  ]\n}}\n");
+    }
+};
+
+/** Set up the X side like main() does, minus everything that only matters to
+ * a running window manager */
+bool setup_x() {
+    auto& manager = Manager::get();
+    manager.x.connection = XCB::Connection::connect(NULL, &manager.x.default_screen);
+    if (auto err = getConnection().connection_has_error()) {
+        fmt::print(stderr, "cannot open display (error {}), skipping\n", err);
+        return false;
+    }
+
+    manager.screen = getConnection().aux_get_screen(manager.x.default_screen);
+    manager.default_visual = draw_default_visual(manager.screen);
+    manager.visual = draw_argb_visual(manager.screen);
+    if (!manager.visual) {
+        manager.visual = manager.default_visual;
+    }
+    manager.default_depth = draw_visual_depth(manager.screen, manager.visual->visual_id);
+    manager.default_cmap = manager.screen->default_colormap;
+    if (manager.default_depth != manager.screen->root_depth) {
+        manager.default_cmap = getConnection().generate_id();
+        getConnection().create_colormap(XCB_COLORMAP_ALLOC_NONE,
+                                        manager.default_cmap,
+                                        manager.screen->root,
+                                        manager.visual->visual_id);
+    }
+
+#ifdef WITH_XCB_ERRORS
+    if (getConnection().errors_context_new(&manager.x.errors_ctx) < 0) {
+        return false;
+    }
+#endif
+    if (xcb_cursor_context_new(
+          getConnection().getConnection(), manager.screen, &manager.x.cursor_ctx) < 0) {
+        return false;
+    }
+    manager.x.xrmdb = xcb_xrm_database_from_string("");
+
+    {
+        const uint32_t select_input_val = XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT;
+        auto cookie = xcb_change_window_attributes_checked(getConnection().getConnection(),
+                                                           manager.screen->root,
+                                                           XCB_CW_EVENT_MASK,
+                                                           &select_input_val);
+        if (xcb_request_check(getConnection().getConnection(), cookie)) {
+            fmt::print(stderr, "another window manager is running, skipping\n");
+            return false;
+        }
+    }
+
+    const xcb_query_extension_reply_t* query =
+      xcb_get_extension_data(getConnection().getConnection(), &xcb_shape_id);
+    manager.x.caps.have_shape = query && query->present;
+
+    event_init();
+    manager.input.keysyms = getConnection().key_symbols_alloc();
+    atoms_init(getConnection().getConnection());
+    ewmh_init();
+    property_init();
+    systray_init();
+    xkb_init();
+    xkb_init_wait();
+
+    manager.focus.window_no_focus = getConnection().generate_id();
+    manager.gc = getConnection().generate_id();
+    getConnection().create_window(manager.default_depth,
+                                  manager.focus.window_no_focus,
+                                  manager.screen->root,
+                                  {-1, -1, 1, 1},
+                                  0,
+                                  XCB_COPY_FROM_PARENT,
+                                  manager.visual->visual_id,
+                                  XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL |
+                                    XCB_CW_OVERRIDE_REDIRECT | XCB_CW_COLORMAP,
+                                  std::to_array<uint32_t>({manager.screen->black_pixel,
+                                                           manager.screen->black_pixel,
+                                                           1u,
+                                                           manager.default_cmap}));
+    getConnection().change_attributes(
+      manager.screen->root, XCB_CW_EVENT_MASK, ROOT_WINDOW_EVENT_MASK);
+    return true;
+}
+
+/** Drop the events the benchmarks caused, nobody handles them */
+void drain_events() {
+    getConnection().aux_sync();
+    while (getConnection().poll_for_event()) {
+    }
+}
+
+/** Create windows and manage them like scan() does */
+void manage_clients(int count) {
+    auto& conn = getConnection();
+    const auto root = Manager::get().screen->root;
+
+    std::vector<xcb_window_t> windows;
+    for (int i = 0; i < count; i++) {
+        const auto w = conn.generate_id();
+        conn.create_window(XCB_COPY_FROM_PARENT,
+                           w,
+                           root,
+                           {int16_t(i % 40 * 10), int16_t(i / 40 * 10), 200, 150},
+                           0,
+                           XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                           XCB_COPY_FROM_PARENT,
+                           0);
+        windows.push_back(w);
+    }
+
+    for (auto w : windows) {
+        auto attr_c = conn.get_window_attributes_unchecked(w);
+        auto geom_c = conn.get_geometry_unchecked(w);
+        auto cookies = client_manage_prefetch(w);
+        auto attr_r = conn.get_window_attributes_reply(attr_c);
+        auto geom_r = conn.get_geometry_reply(geom_c);
+        client_manage(w, geom_r.get(), attr_r.get(), cookies, nullptr);
+    }
+    drain_events();
+}
+
+/** A _NET_WM_ICON value with the usual icon sizes */
+std::vector<uint32_t> net_wm_icon_value() {
+    std::vector<uint32_t> value;
+    for (uint32_t size : {16, 22, 32, 48, 64, 128}) {
+        value.push_back(size);
+        value.push_back(size);
+        for (uint32_t i = 0; i < size * size; i++) {
+            value.push_back(0x80000000 | (i * 2654435761u >> 8));
+        }
+    }
+    return value;
+}
+
+/** A GetProperty reply as it comes from the X server */
+std::vector<uint32_t> property_reply(const std::vector<uint32_t>& value) {
+    constexpr size_t header = sizeof(xcb_get_property_reply_t) / sizeof(uint32_t);
+    std::vector<uint32_t> buffer(header + value.size());
+    auto r = reinterpret_cast<xcb_get_property_reply_t*>(buffer.data());
+    r->response_type = XCB_GET_PROPERTY;
+    r->format = 32;
+    r->type = XCB_ATOM_CARDINAL;
+    r->length = value.size();
+    r->value_len = value.size();
+    std::ranges::copy(value, buffer.begin() + header);
+    return buffer;
+}
+
+void bench_draw(Runner& runner) {
+    std::vector<uint32_t> pixels(64 * 64);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = uint32_t(i * 2654435761u) | 0x40000000;
+    }
+    runner.run("draw_surface_from_data/64x64", [&] {
+        cairo_surface_destroy(draw_surface_from_data(64, 64, pixels.data()));
+    });
+}
+
+void bench_icons(Runner& runner) {
+    auto reply = property_reply(net_wm_icon_value());
+    auto r = reinterpret_cast<xcb_get_property_reply_t*>(reply.data());
+
+    runner.run("ewmh_window_icon_from_reply/new", [&] { ewmh_window_icon_from_reply(r); });
+
+    /* Another window already uses these icons, so they are shared */
+    auto held = ewmh_window_icon_from_reply(r);
+    runner.run("ewmh_window_icon_from_reply/shared", [&] { ewmh_window_icon_from_reply(r); });
+}
+
+void bench_lua(Runner& runner) {
+    lua_State* L = globalconf_get_lua_State();
+
+    luaL_dostring(L,
+                  "for _ = 1, 4 do\n"
+                  "    awesome.connect_signal('bench::signal', function() end)\n"
+                  "end\n");
+    runner.run("signal_object_emit/4_handlers", [&] {
+        lua_pushinteger(L, 1);
+        signal_object_emit(L, &Lua::global_signals, "bench::signal", 1);
+    });
+
+    luaA_object_push(L, Manager::get().clients.front());
+    runner.run("luaA_class_index/name", [&] {
+        lua_getfield(L, -1, "name");
+        lua_pop(L, 1);
+    });
+    runner.run("luaA_class_index/miss", [&] {
+        lua_getfield(L, -1, "bench_unset");
+        lua_pop(L, 1);
+    });
+    lua_pop(L, 1);
+}
+
+void bench_keys(Runner& runner) {
+    lua_State* L = globalconf_get_lua_State();
+
+    const auto script =
+      fmt::format("local keys = {{}}\n"
+                  "for i = 1, {} do\n"
+                  "    local k = key {{ key = '#' .. (i + 9), modifiers = {{}} }}\n"
+                  "    k:connect_signal('press', function() end)\n"
+                  "    keys[i] = k\n"
+                  "end\n"
+                  "root._keys(keys)\n",
+                  KEY_COUNT);
+    luaL_dostring(L, script.c_str());
+
+    xcb_key_press_event_t ev = {};
+    ev.response_type = XCB_KEY_PRESS;
+    ev.detail = 10 + KEY_COUNT / 2;
+    ev.root = ev.event = Manager::get().screen->root;
+    runner.run("event_key_match/root", [&] {
+        event_handle(reinterpret_cast<xcb_generic_event_t*>(&ev));
+    });
+}
+
+void bench_keysyms(Runner& runner) {
+    lua_State* L = globalconf_get_lua_State();
+
+    lua_getglobal(L, "awesome");
+    lua_getfield(L, -1, "_get_key_name");
+    /* A Latin-1 character, one at the end of the table and a keysym name */
+    for (const char* input : {"a", "\u20ac", "Return"}) {
+        runner.run(fmt::format("get_key_name/{}", input), [&] {
+            lua_pushvalue(L, -1);
+            lua_pushstring(L, input);
+            lua_call(L, 1, 2);
+            lua_pop(L, 2);
+        });
+    }
+    lua_pop(L, 2);
+}
+
+void bench_refresh(Runner& runner) {
+    auto& manager = Manager::get();
+
+    runner.run("stack_refresh/unchanged", [] {
+        stack_windows();
+        stack_refresh();
+    });
+    runner.run("stack_refresh/raise", [&] {
+        stack_client_push(manager.getStack().back());
+        stack_refresh();
+    });
+
+    runner.run("banning_refresh/all", [&] {
+        for (auto* c : manager.clients) {
+            c->sticky = !c->sticky;
+        }
+        manager.need_lazy_banning = true;
+        banning_refresh();
+    });
+    runner.run("banning_refresh/one", [&] {
+        auto* c = manager.clients.front();
+        c->sticky = !c->sticky;
+        banning_need_update(c);
+        banning_refresh();
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    setlocale(LC_ALL, "");
+
+    xdgHandle xdg;
+    if (!xdgInitHandle(&xdg)) {
+        fmt::print(stderr, "xdgInitHandle() failed, is $HOME unset?\n");
+        return EXIT_FAILURE;
+    }
+
+    gGlobals = new Manager;
+    Manager::get().api_level = awesome_default_api_level();
+    Manager::get().focus.need_update = true;
+
+    if (!setup_x()) {
+        return EXIT_SKIP;
+    }
+
+    Lua::init(&xdg, {});
+    ewmh_init_lua();
+    screen_scan();
+    screen_emit_scanned();
+    manage_clients(CLIENT_COUNT);
+
+    Runner runner(argc, argv);
+    runner.between_rounds = drain_events;
+
+    bench_draw(runner);
+    bench_icons(runner);
+    bench_lua(runner);
+    bench_keys(runner);
+    bench_keysyms(runner);
+    bench_refresh(runner);
+
+    runner.print();
+    xdgWipeHandle(&xdg);
+    return EXIT_SUCCESS;
+}
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
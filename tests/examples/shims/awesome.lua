@@ -74,6 +74,10 @@ end
 
 awesome.load_image = lgi.cairo.ImageSurface.create_from_png
 
+function awesome.load_image_async(path, callback)
+    callback(awesome.load_image(path))
+end
+
 function awesome.pixbuf_to_surface(_, path)
     return awesome.load_image(path)
 end
@@ -438,6 +438,13 @@ function client.get(s)
     return ret
 end
 
+function client.apply_geometries(batch)
+    for _, entry in ipairs(batch) do
+        entry[1]:geometry(entry[2])
+    end
+    return #batch
+end
+
 return client
 
 -- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
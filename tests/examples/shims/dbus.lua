@@ -18,7 +18,7 @@ local invocation = {
 
 local function parameters_miss(t, k)
     if k == "get_child_value" then
-        return function(idx) return t[idx-1] end
+        return function(_, idx) return { value = t.value[idx + 1] } end
     end
 end
 
@@ -189,6 +189,22 @@ function root._wallpaper(pattern)
     return target
 end
 
+function root._wallpaper_region(pattern, area)
+    if not root._wallpaper_surface then
+        root._wallpaper_surface = cairo.ImageSurface(cairo.Format.RGB32, root.size())
+        root._wallpaper_pattern = cairo.Pattern.create_for_surface(root._wallpaper_surface)
+    end
+
+    local cr = cairo.Context(root._wallpaper_surface)
+    cr:rectangle(area.x, area.y, area.width, area.height)
+    cr:clip()
+    cr:set_source(pattern)
+    cr.operator = cairo.Operator.SOURCE
+    cr:paint()
+
+    return true
+end
+
 
 function root.set_newindex_miss_handler(h)
     rawset(root, "_ni_handler", h)
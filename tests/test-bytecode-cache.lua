@@ -0,0 +1,44 @@
+--- Test that modules are loaded through the bytecode cache and that changed
+-- sources replace their cache entries.
+
+local runner = require("_runner")
+
+local dir = os.tmpname()
+os.remove(dir)
+assert(os.execute("mkdir -p " .. dir))
+package.path = dir .. "/?.lua;" .. package.path
+
+local function write_module(value)
+    local f = assert(io.open(dir .. "/bytecode_cache_test.lua", "w"))
+    f:write("return " .. value .. "\n")
+    f:close()
+end
+
+local function load_module()
+    package.loaded.bytecode_cache_test = nil
+    return require("bytecode_cache_test")
+end
+
+runner.run_steps({
+    function()
+        write_module("1")
+        assert(load_module() == 1)
+        -- Now from the cache
+        assert(load_module() == 1)
+
+        -- A different size invalidates the entry
+        write_module("1234")
+        assert(load_module() == 1234)
+
+        -- Missing modules still list where they were looked for
+        local ok, err = pcall(require, "bytecode_cache_missing")
+        assert(not ok)
+        assert(err:find("no file '" .. dir .. "/bytecode_cache_missing.lua'", 1, true), err)
+
+        os.remove(dir .. "/bytecode_cache_test.lua")
+        os.remove(dir)
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,43 @@
+--- Tests for client.apply_geometries()
+
+local runner = require("_runner")
+local test_client = require("_client")
+
+local c1, c2
+local seen = {}
+
+runner.run_steps({
+    function(count)
+        if count == 1 then
+            test_client()
+            test_client()
+        end
+        if #client.get() >= 2 then
+            c1, c2 = client.get()[1], client.get()[2]
+            c1.floating, c2.floating = true, true
+            return true
+        end
+    end,
+    function()
+        c1:connect_signal("property::geometry", function(c)
+            -- Both clients already got their geometry
+            seen[c] = c2:geometry().x == 200
+        end)
+
+        local n = client.apply_geometries {
+            { c1, { x = 100, y = 100, width = 300, height = 200 } },
+            { c2, { x = 200, y = 150 } },
+        }
+        assert(n == 2, n)
+        assert(seen[c1])
+        assert(c1:geometry().x == 100 and c1:geometry().y == 100)
+        assert(c2:geometry().x == 200 and c2:geometry().y == 150)
+
+        -- Nothing changes the second time
+        n = client.apply_geometries { { c2, { x = 200, y = 150 } } }
+        assert(n == 0, n)
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
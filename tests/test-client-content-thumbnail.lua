@@ -0,0 +1,57 @@
+-- Test the thumbnails of client content
+
+local runner = require("_runner")
+local gears = require("gears")
+local test_client = require("_client")
+
+local c
+
+runner.run_steps {
+    function()
+        test_client("thumbnail", "thumbnail")
+        return true
+    end,
+
+    function()
+        c = client.get()[1]
+        return c and c.valid
+    end,
+
+    function(count)
+        -- Let the client draw something first
+        if count < 3 then return end
+
+        if not awesome.composite_manager_running and not c:content_thumbnail(64, 64) then
+            -- Without Composite, there are no thumbnails
+            return true
+        end
+
+        local raw1 = assert(c:content_thumbnail(64, 64))
+        local raw2 = assert(c:content_thumbnail(64, 64))
+
+        -- An undamaged client is not read again
+        assert(raw1 == raw2)
+
+        local surf = gears.surface(raw1)
+        gears.surface(raw2)
+        local w, h = gears.surface.get_size(surf)
+        assert(w <= 64 and h <= 64, w .. "x" .. h)
+        assert(w == 64 or h == 64, w .. "x" .. h)
+
+        -- A persistent thumbnail redirects the client and is read again for
+        -- another size
+        local raw3 = assert(c:content_thumbnail(32, 32, true))
+        local w3, h3 = gears.surface.get_size(gears.surface(raw3))
+        assert(w3 <= 32 and h3 <= 32, w3 .. "x" .. h3)
+
+        -- The content is a copy too
+        local content = gears.surface(c.content)
+        local cw, ch = gears.surface.get_size(content)
+        assert(cw > 0 and ch > 0)
+
+        c:kill()
+        return true
+    end,
+}
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
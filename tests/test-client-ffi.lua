@@ -0,0 +1,60 @@
+--- Tests for awful.client.ffi
+
+local runner = require("_runner")
+local test_client = require("_client")
+local cffi = require("awful.client.ffi")
+
+local c
+
+local function check()
+    local x, y, width, height = cffi.geometry(c)
+    assert(x == c.x and y == c.y and width == c.width and height == c.height)
+    assert(cffi.x(c) == c.x and cffi.width(c) == c.width)
+    assert(cffi.minimized(c) == c.minimized)
+    assert(cffi.hidden(c) == c.hidden)
+    assert(cffi.screen(c) == c.screen)
+end
+
+runner.run_steps({
+    function(count)
+        if count == 1 then
+            test_client("ffi_view")
+        end
+        c = client.get()[1]
+        if c then
+            return true
+        end
+    end,
+    function()
+        assert(cffi.enabled)
+        check()
+
+        c:geometry { x = 12, y = 34, width = 100, height = 120 }
+        check()
+        c.minimized = true
+        check()
+        c.minimized = false
+        c.hidden = true
+        check()
+        c.hidden = false
+        check()
+
+        -- Values are up to date inside the signal handlers
+        c:connect_signal("property::geometry", check)
+        c.x = c.x + 5
+        c:disconnect_signal("property::geometry", check)
+
+        c:kill()
+        return true
+    end,
+    function()
+        if #client.get() > 0 then
+            return
+        end
+        -- Unmanaged clients go through the properties, which fail
+        assert(not pcall(cffi.x, c))
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,122 @@
+--- Tests for the client icon cache
+
+local runner = require("_runner")
+local test_client = require("_client")
+local cairo = require("lgi").cairo
+local gears_surface = require("gears.surface")
+
+local c
+local raw_icons
+
+local function clients_of(class)
+    local result = {}
+    for _, cl in ipairs(client.get()) do
+        if cl.class == class and #cl.icon_sizes > 0 then
+            table.insert(result, cl)
+        end
+    end
+    return result
+end
+
+runner.run_steps({
+    function(count)
+        if count == 1 then
+            test_client("icon_cache")
+        end
+        c = client.get()[1]
+        if c then
+            return true
+        end
+    end,
+    function()
+        local img = cairo.ImageSurface(cairo.Format.ARGB32, 24, 16)
+        c.icon = img._native
+
+        local sizes = c.icon_sizes
+        assert(#sizes == 1)
+        assert(sizes[1][1] == 24 and sizes[1][2] == 16)
+
+        -- Surfaces set from Lua survive even without any budget
+        awesome.set_icon_cache_limit(0)
+        local w, h = gears_surface.get_size(gears_surface(c:get_icon(1)))
+        assert(w == 24 and h == 16)
+        assert(c.icon)
+
+        awesome.set_icon_cache_limit(8 * 1024 * 1024)
+        return true
+    end,
+    function()
+        -- Scaled copies, from an icon set from a surface
+        c.icon = cairo.ImageSurface(cairo.Format.ARGB32, 96, 64)._native
+
+        local function size_of(...)
+            return gears_surface.get_size(gears_surface(c:get_icon(1, ...)))
+        end
+
+        local w, h = size_of(16, 16)
+        assert(w == 16 and h == 16)
+        w, h = size_of(30, 20)
+        assert(w == 30 and h == 20)
+        -- The aspect ratio is kept without a height
+        w, h = size_of(24)
+        assert(w == 24 and h == 16)
+        -- The icon itself at its own size
+        w, h = size_of(96, 64)
+        assert(w == 96 and h == 64)
+        -- More sizes than are kept
+        for size = 1, 10 do
+            w, h = size_of(size, size)
+            assert(w == size and h == size)
+        end
+
+        assert(not pcall(c.get_icon, c, 1, 0))
+        assert(not pcall(c.get_icon, c, 2, 16))
+
+        c:kill()
+        return true
+    end,
+    function()
+        -- Two windows with the same _NET_WM_ICON and one with another
+        raw_icons = awesome.memory_stats().icons.count
+        test_client("icon_shared", nil, nil, nil, nil, { icon_size = 32 })
+        test_client("icon_shared", nil, nil, nil, nil, { icon_size = 32 })
+        test_client("icon_other", nil, nil, nil, nil, { icon_size = 48 })
+        return true
+    end,
+    function()
+        local shared, other = clients_of("icon_shared"), clients_of("icon_other")
+        if #shared < 2 or #other < 1 then return end
+
+        -- The same pixels are only kept once, for both windows
+        local per_window = #shared[1].icon_sizes
+        assert(#shared[2].icon_sizes == per_window)
+        local count = awesome.memory_stats().icons.count
+        assert(count == raw_icons + per_window + #other[1].icon_sizes,
+            count .. " raw icons")
+        local raw1, raw2 = shared[1]:get_icon(1), shared[2]:get_icon(1)
+        assert(raw1 == raw2)
+        gears_surface(raw1)
+        gears_surface(raw2)
+
+        -- Over budget, all decoded icons but the last one used are dropped
+        gears_surface(other[1]:get_icon(1))
+        gears_surface(shared[1]:get_icon(1))
+        local decoded = awesome.memory_stats().icon_cache.bytes
+        assert(decoded >= (32 * 32 + 48 * 48) * 4, decoded .. " bytes decoded")
+        awesome.set_icon_cache_limit(0)
+        local left = awesome.memory_stats().icon_cache.bytes
+        assert(left == 32 * 32 * 4, left .. " bytes left")
+
+        -- And decoded again when needed
+        local w, h = gears_surface.get_size(gears_surface(other[1]:get_icon(1)))
+        assert(w == 48 and h == 48, w .. "x" .. h)
+
+        awesome.set_icon_cache_limit(8 * 1024 * 1024)
+        for _, cl in ipairs(client.get()) do
+            cl:kill()
+        end
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,36 @@
+--- Tests for awesome.set_lazy_icons()
+
+local runner = require("_runner")
+local test_client = require("_client")
+local cairo = require("lgi").cairo
+
+local c
+
+runner.run_steps({
+    function(count)
+        if count == 1 then
+            awesome.set_lazy_icons(true)
+            test_client("lazy_icons")
+        end
+        c = client.get()[1]
+        if c then
+            return true
+        end
+    end,
+    function()
+        -- Reading the icon fetches it
+        assert(type(c.icon_sizes) == "table")
+
+        -- Icons set from Lua are kept
+        c.icon = cairo.ImageSurface(cairo.Format.ARGB32, 12, 12)._native
+        local sizes = c.icon_sizes
+        assert(#sizes == 1 and sizes[1][1] == 12)
+        assert(c.icon)
+
+        awesome.set_lazy_icons(false)
+        c:kill()
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,43 @@
+--- Tests for client.query()
+
+local runner = require("_runner")
+local test_client = require("_client")
+
+runner.run_steps({
+    function(count)
+        if count == 1 then
+            test_client("query_a")
+            test_client("query_b")
+        end
+        if #client.get() >= 2 then
+            return true
+        end
+    end,
+    function()
+        local records = client.query { props = { "name", "minimized", "geometry", "tags" } }
+        assert(#records == #client.get(), #records)
+
+        for i, r in ipairs(records) do
+            local c = client.get()[i]
+            assert(r.client == c)
+            assert(r.name == c.name)
+            assert(r.minimized == c.minimized)
+            local geo = c:geometry()
+            assert(r.geometry.x == geo.x and r.geometry.width == geo.width)
+            assert(#r.tags == #c:tags())
+        end
+
+        -- Filtering and stacking order match client.get()
+        local s = client.get()[1].screen
+        local stacked = client.query { props = { "window" }, screen = s, stacked = true }
+        local expected = client.get(s, true)
+        assert(#stacked == #expected)
+        for i, r in ipairs(stacked) do
+            assert(r.client == expected[i])
+            assert(r.window == expected[i].window)
+        end
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
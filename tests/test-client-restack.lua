@@ -0,0 +1,54 @@
+--- Tests for client.restack()
+
+local runner = require("_runner")
+local test_client = require("_client")
+
+local function stacked()
+    local ret = {}
+    for _, c in ipairs(client.get(nil, true)) do
+        table.insert(ret, c.class)
+    end
+    return table.concat(ret, " ")
+end
+
+local function by_class(class)
+    for _, c in ipairs(client.get()) do
+        if c.class == class then return c end
+    end
+end
+
+runner.run_steps({
+    function()
+        for _, class in ipairs { "a", "b", "c", "d" } do
+            test_client(class, class)
+        end
+        return true
+    end,
+    function()
+        if #client.get() < 4 then return end
+        local a, b, c, d = by_class("a"), by_class("b"), by_class("c"), by_class("d")
+        d:raise()
+        c:raise()
+        b:raise()
+        a:raise()
+        assert(stacked() == "a b c d", stacked())
+
+        -- Raising puts the first client on top
+        local raised = {}
+        client.connect_signal("raised", function(cl) table.insert(raised, cl) end)
+        client.restack({ d, c }, true)
+        assert(stacked() == "d c a b", stacked())
+        assert(#raised == 2)
+
+        -- Otherwise the clients swap their places
+        client.restack({ b, d })
+        assert(stacked() == "b c a d", stacked())
+
+        -- Duplicates are ignored
+        client.restack({ a, c, a })
+        assert(stacked() == "b a c d", stacked())
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,42 @@
+--- Tests for tracking awesome.composite_manager_running
+
+local runner = require("_runner")
+
+local atom = "_NET_WM_CM_S0"
+local owner
+local changes = {}
+
+awesome.connect_signal("compositor::changed", function(running)
+    table.insert(changes, running)
+end)
+
+runner.run_steps({
+    function()
+        if awesome.composite_manager_running then
+            -- Another compositor owns the selection already
+            return true
+        end
+
+        -- Pretend to be a composite manager
+        owner = selection.acquire { selection = atom }
+        return true
+    end,
+    function()
+        if not owner then return true end
+        if #changes == 0 then return end
+        assert(changes[1] == true)
+        assert(awesome.composite_manager_running)
+
+        owner:release()
+        return true
+    end,
+    function()
+        if not owner then return true end
+        if #changes < 2 then return end
+        assert(changes[2] == false)
+        assert(not awesome.composite_manager_running)
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
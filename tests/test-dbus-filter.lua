@@ -0,0 +1,32 @@
+--- Tests for the member and path filters of dbus.connect_signal()
+
+local runner = require("_runner")
+
+local iface = "org.awesomewm.testfilter"
+local received = {}
+
+dbus.add_match("session", "type='signal',interface='" .. iface .. "'")
+assert(dbus.connect_signal(iface, function(data)
+    table.insert(received, data.member .. " " .. data.path)
+end, { member = { "Wanted", "Other" }, path = "/wanted" }))
+
+runner.run_steps({
+    function()
+        dbus.emit_signal("session", "/wanted", iface, "Unwanted", "string", "x")
+        dbus.emit_signal("session", "/ignored", iface, "Wanted", "string", "x")
+        dbus.emit_signal("session", "/wanted", iface, "Wanted", "string", "x")
+        dbus.emit_signal("session", "/wanted", iface, "Other", "string", "x")
+        return true
+    end,
+    function(count)
+        if #received < 2 and count < 20 then
+            return
+        end
+        assert(#received == 2, table.concat(received, ", "))
+        assert(received[1] == "Wanted /wanted", received[1])
+        assert(received[2] == "Other /wanted", received[2])
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
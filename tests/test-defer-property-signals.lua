@@ -0,0 +1,36 @@
+--- Tests for deferred property signals
+
+local runner = require("_runner")
+
+local d
+local count = 0
+
+runner.run_steps({
+    function()
+        drawin.set_defer_property_signals(true)
+        d = drawin({ x = 0, y = 0, width = 10, height = 10 })
+        d:connect_signal("property::x", function() count = count + 1 end)
+
+        d.x = 10
+        d.x = 20
+        d.x = 30
+
+        -- Nothing was delivered yet
+        assert(count == 0)
+        return true
+    end,
+    function()
+        if count == 0 then return end
+
+        -- The moves were merged into one signal
+        assert(count == 1, count)
+        assert(d.x == 30)
+
+        drawin.set_defer_property_signals(false)
+        d.x = 40
+        assert(count == 2, count)
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,36 @@
+--- Tests for the drawable pixmap pool
+
+local runner = require("_runner")
+
+local d
+local surfaces = 0
+
+runner.run_steps({
+    function()
+        d = drawin({ x = 0, y = 0, width = 100, height = 50, visible = true })
+        d.drawable:connect_signal("property::surface", function() surfaces = surfaces + 1 end)
+
+        -- Moves keep the surface
+        d.x = 10
+        d.y = 20
+        assert(surfaces == 0, surfaces)
+
+        -- Resizes get a new one, also when reusing a pooled pixmap
+        d.width = 110
+        d.width = 100
+        assert(surfaces == 2, surfaces)
+        assert(d.drawable.surface)
+
+        -- Disabling the pool frees everything and still works
+        drawable.set_pixmap_pool_limit(0)
+        d.height = 60
+        assert(surfaces == 3, surfaces)
+        assert(d.drawable.surface)
+        drawable.set_pixmap_pool_limit(16 * 1024 * 1024)
+
+        d.visible = false
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,43 @@
+--- Tests for shapes that are set as rectangles and read back without a round trip
+
+local runner = require("_runner")
+local cairo = require("lgi").cairo
+local gears_surface = require("gears.surface")
+
+local function make_shape(w, h)
+    local img = cairo.ImageSurface(cairo.Format.A1, w, h)
+    local cr = cairo.Context(img)
+    cr:rectangle(10, 5, 20, 10)
+    cr:rectangle(40, 5, 10, 30)
+    cr:fill()
+    return img
+end
+
+local function check(shape)
+    local surf = gears_surface(shape)
+    local w, h = gears_surface.get_size(surf)
+    -- The shape extents cover just the filled rectangles
+    assert(w == 40 and h == 30, w .. "x" .. h)
+end
+
+runner.run_steps({
+    function()
+        local d = drawin({ x = 0, y = 0, width = 60, height = 40, visible = true })
+        local img = make_shape(60, 40)
+
+        d.shape_bounding = img._native
+        check(d.shape_bounding)
+
+        -- The same mask again, now from the cache
+        d.shape_bounding = make_shape(60, 40)._native
+        check(d.shape_bounding)
+
+        d.shape_bounding = nil
+        assert(d.shape_bounding == nil)
+
+        d.visible = false
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
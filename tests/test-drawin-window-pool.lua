@@ -0,0 +1,43 @@
+--- Tests for the reuse of drawin windows
+
+local runner = require("_runner")
+
+local function collect()
+    collectgarbage("collect")
+    collectgarbage("collect")
+end
+
+local old_window
+
+runner.run_steps({
+    function()
+        local d = drawin { x = 10, y = 10, width = 50, height = 50, ontop = true,
+                           cursor = "fleur", opacity = 0.5 }
+        d.visible = true
+        d.visible = false
+        old_window = d.window
+        d = nil -- luacheck: no unused
+        collect()
+        return true
+    end,
+    function()
+        -- The window of the collected drawin is reused
+        local d = drawin { x = 20, y = 20, width = 30, height = 30 }
+        assert(d.window == old_window)
+        d.visible = true
+        assert(d:geometry().width == 30)
+        assert(d.cursor == "left_ptr")
+        d.visible = false
+        d = nil -- luacheck: no unused
+        collect()
+
+        -- Without a pool, new windows are created
+        drawin.set_window_pool_limit(0)
+        d = drawin {}
+        assert(d.window ~= old_window)
+        drawin.set_window_pool_limit(8)
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
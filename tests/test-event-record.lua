@@ -0,0 +1,38 @@
+--- Tests for awesome.event_record_start() and awesome.event_record_stop()
+
+local runner = require("_runner")
+
+local path = os.tmpname()
+
+runner.run_steps({
+    function()
+        assert(awesome.event_record_start(path))
+        -- Causes a MotionNotify on the root window
+        mouse.coords { x = 10, y = 10 }
+        mouse.coords { x = 20, y = 20 }
+        awesome.sync()
+        return true
+    end,
+    function(count)
+        -- Let a few main loop iterations be recorded
+        if count < 3 then
+            return
+        end
+        awesome.event_record_stop()
+
+        local f = assert(io.open(path, "rb"))
+        local recording = f:read("*a")
+        f:close()
+        os.remove(path)
+
+        assert(recording:sub(1, 8) == "AWEVLOG1", recording:sub(1, 8))
+        -- At least one event and the end of its batch
+        assert(#recording > 8 + 4, #recording)
+
+        -- A file that cannot be created is reported
+        assert(not awesome.event_record_start("/nonexistent/events.log"))
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
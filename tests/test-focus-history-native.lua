@@ -0,0 +1,77 @@
+--- Tests for the native focus history
+
+local runner = require("_runner")
+local awful = require("awful")
+local test_client = require("_client")
+local unpack = unpack or table.unpack -- luacheck: globals unpack (compatibility with Lua 5.1)
+
+local function history()
+    local ret = {}
+    for c in client.focus_history() do
+        table.insert(ret, c)
+    end
+    return ret
+end
+
+local c1, c2, c3
+
+runner.run_steps({
+    function()
+        test_client("a", "a")
+        test_client("b", "b")
+        test_client("c", "c")
+        return true
+    end,
+    function()
+        if #client.get() < 3 then return end
+        c1, c2, c3 = unpack(client.get())
+
+        client.focus = c1
+        client.focus = c2
+        client.focus = c3
+        local h = history()
+        assert(h[1] == c3 and h[2] == c2 and h[3] == c1)
+
+        -- The snapshot matches
+        local list = awful.client.focus.history.list
+        assert(list[1] == c3 and list[2] == c2 and list[3] == c1)
+
+        -- Previous client on this screen
+        assert(awful.client.focus.history.get(c3.screen, 1) == c2)
+
+        -- Only the clients of a tag
+        local t = awful.tag.add("other", { screen = c1.screen })
+        c2:tags { t }
+        local with_tag = {}
+        for c in client.focus_history(nil, t) do
+            table.insert(with_tag, c)
+        end
+        assert(#with_tag == 1 and with_tag[1] == c2, #with_tag)
+        -- Not visible anymore
+        for c in client.focus_history(c1.screen, nil, true) do
+            assert(c ~= c2)
+        end
+
+        -- Focus changes are not recorded while tracking is disabled
+        awful.client.focus.history.disable_tracking()
+        client.focus = c1
+        assert(history()[1] == c3)
+        awful.client.focus.history.enable_tracking()
+        client.focus = c1
+        client.focus = c3
+        client.focus = c1
+        assert(history()[1] == c1)
+
+        c3:kill()
+        return true
+    end,
+    function()
+        if #client.get() > 2 then return end
+        for c in client.focus_history() do
+            assert(c ~= c3 and c.valid)
+        end
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
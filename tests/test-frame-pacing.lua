@@ -0,0 +1,40 @@
+--- Test that frame pacing caps how often the deferred work is done.
+
+local runner = require("_runner")
+local gtimer = require("gears.timer")
+
+local wakeups = 0
+local ticker
+local started
+
+runner.run_steps({
+    function()
+        awesome.set_frame_pacing(true, 10)
+        awesome.loop_stats(true)
+        started = os.time()
+        -- Wake the main loop up much more often than the frame rate
+        ticker = gtimer.start_new(0.002, function()
+            wakeups = wakeups + 1
+            return true
+        end)
+        return true
+    end,
+    function()
+        if wakeups < 200 then
+            return
+        end
+        local elapsed = os.time() - started + 1
+        local stats = awesome.loop_stats()
+        assert(stats.flush.count <= 10 * elapsed + 2,
+            stats.flush.count .. " flushes for " .. wakeups .. " wakeups")
+        ticker:stop()
+        awesome.set_frame_pacing(false)
+        awesome.loop_stats(true)
+        return true
+    end,
+    function()
+        return awesome.loop_stats().flush.count > 0
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,38 @@
+--- Test that the Lua garbage collector runs while the main loop is idle.
+
+local runner = require("_runner")
+
+local garbage
+
+runner.run_steps({
+    function()
+        awesome.loop_stats(true)
+        garbage = {}
+        for i = 1, 10000 do
+            garbage[i] = { i }
+        end
+        garbage = nil
+        return true
+    end,
+    function()
+        return awesome.loop_stats().gc.count > 0
+    end,
+    function()
+        awesome.set_idle_gc_step(0)
+        awesome.loop_stats(true)
+        for i = 1, 10000 do
+            garbage = { i }
+        end
+        return true
+    end,
+    function(count)
+        assert(awesome.loop_stats().gc.count == 0)
+        if count < 5 then
+            return
+        end
+        awesome.set_idle_gc_step(16)
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,85 @@
+--- Measure the latency of key presses through the window manager.
+--
+-- Key presses are injected with XTest. The time until the key binding runs is
+-- measured here, the stages inside the window manager by awesome.input_stats().
+
+local runner = require("_runner")
+local test_client = require("_client")
+local akey = require("awful.key")
+local GLib = require("lgi").GLib
+
+local count = 20
+local sent, handled = 0, 0
+local sent_at
+local inject = {}
+
+local binding = akey({}, "F12", function()
+    handled = handled + 1
+    table.insert(inject, (GLib.get_monotonic_time() - sent_at) / 1e6)
+    -- Cause a request that has to be flushed
+    local c = client.get()[1]
+    c.x = c.x + 1
+end)
+
+local function percentile(values, p)
+    local sorted = {}
+    for i, v in ipairs(values) do
+        sorted[i] = v
+    end
+    table.sort(sorted)
+    return sorted[math.max(1, math.ceil(p * #sorted))]
+end
+
+runner.run_steps({
+    function(count_calls)
+        if count_calls == 1 then
+            test_client()
+        end
+        return #client.get() == 1 or nil
+    end,
+
+    function()
+        root._append_key(binding)
+        awesome.input_stats(true)
+        return true
+    end,
+
+    function()
+        if handled < sent then
+            return
+        end
+        if sent == count then
+            return true
+        end
+        sent = sent + 1
+        sent_at = GLib.get_monotonic_time()
+        root.fake_input("key_press", "F12")
+        root.fake_input("key_release", "F12")
+    end,
+
+    function()
+        local stats = awesome.input_stats()
+        for _, name in ipairs { "dispatch", "handler", "flush", "total" } do
+            local s = stats[name]
+            assert(s, name)
+            assert(s.count == count, name .. ": " .. s.count)
+            assert(s.p50 <= s.p99 and s.p99 <= s.max, name)
+        end
+        assert(stats.total.max >= stats.handler.max)
+
+        print(string.format("%10s: p50 %-10.6g p99 %-10.6g max %-10.6g sec", "inject",
+                            percentile(inject, 0.5), percentile(inject, 0.99),
+                            percentile(inject, 1)))
+        for _, name in ipairs { "dispatch", "handler", "flush", "total" } do
+            local s = stats[name]
+            print(string.format("%10s: p50 %-10.6g p99 %-10.6g max %-10.6g sec",
+                                name, s.p50, s.p99, s.max))
+        end
+
+        awesome.input_stats(true)
+        assert(awesome.input_stats().total.count == 0)
+        return true
+    end,
+}, { wait_per_step = 20 })
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
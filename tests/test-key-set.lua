@@ -0,0 +1,47 @@
+--- Tests for key binding sets
+
+local runner = require("_runner")
+
+local pressed, released = {}, {}
+
+local set = key.new_set({
+    { {}, "F11" },
+    { {}, "F12" },
+    { { "Shift" }, "F12" },
+    { {}, "NotAKeyAtAll" },
+}, function(index, press)
+    table.insert(press and pressed or released, index)
+end)
+
+runner.run_steps({
+    function()
+        assert(#set == 4)
+        root.set_key_set(set)
+        root.fake_input("key_press", "F12")
+        root.fake_input("key_release", "F12")
+        awesome.sync()
+        return true
+    end,
+    function()
+        if #released == 0 then return end
+        assert(#pressed == 1 and pressed[1] == 2, table.concat(pressed, " "))
+        assert(#released == 1 and released[1] == 2)
+
+        -- Without the set, nothing is called
+        root.set_key_set(nil)
+        pressed, released = {}, {}
+        root.fake_input("key_press", "F11")
+        root.fake_input("key_release", "F11")
+        awesome.sync()
+        return true
+    end,
+    function(count)
+        if count < 3 then return end
+        assert(#pressed == 0 and #released == 0)
+        set = nil -- luacheck: no unused
+        collectgarbage("collect")
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,80 @@
+-- Test the chords that the keygrabber matches natively
+
+local runner = require("_runner")
+local awful = require("awful")
+
+local results = {}
+local pressed = {}
+local stopped = false
+
+local function tap(key)
+    root.fake_input("key_press"  , key)
+    root.fake_input("key_release", key)
+end
+
+local grabber = awful.keygrabber {
+    chords = {
+        g = { g = "top", t = "next_tag" },
+        x = "single",
+    },
+    chord_callback = function(_, value, steps)
+        table.insert(results, { value = value, steps = table.concat(steps, " ") })
+    end,
+    keypressed_callback = function(_, _, key)
+        table.insert(pressed, key)
+    end,
+    stop_key = "Escape",
+    stop_callback = function() stopped = true end,
+}
+
+local steps = {
+    function()
+        grabber:start()
+        return true
+    end,
+
+    function(count)
+        if count == 1 then
+            tap("g")
+            tap("g")
+            tap("x")
+        end
+        if #results == 2 then
+            assert(results[1].value == "top", tostring(results[1].value))
+            assert(results[1].steps == "g g", results[1].steps)
+            assert(results[2].value == "single", tostring(results[2].value))
+            -- The keys of the chords never reached Lua
+            assert(#pressed == 0, table.concat(pressed, " "))
+            return true
+        end
+    end,
+
+    function(count)
+        if count == 1 then
+            -- Aborted chord, then a key that starts no chord
+            tap("g")
+            tap("z")
+            tap("q")
+        end
+        if #results == 3 and #pressed == 1 then
+            assert(results[3].value == nil)
+            assert(results[3].steps == "g z", results[3].steps)
+            assert(pressed[1] == "q", pressed[1])
+            return true
+        end
+    end,
+
+    function(count)
+        if count == 1 then
+            tap("Escape")
+        end
+        if stopped then
+            assert(not awful.keygrabber.get_is_running())
+            return true
+        end
+    end,
+}
+
+runner.run_steps(steps)
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,52 @@
+--- The native layouts give the same result as the Lua implementations
+
+local runner = require("_runner")
+local suit = require("awful.layout.suit")
+
+local layouts = {
+    suit.fair, suit.fair.horizontal, suit.spiral, suit.spiral.dwindle,
+    suit.max, suit.max.fullscreen,
+}
+
+local function arrange(l, n)
+    local clients = {}
+    for i = 1, n do clients[i] = {} end
+    local p = {
+        workarea   = { x = 13, y = 27, width = 1917, height = 1057 },
+        geometry   = { x = 0, y = 0, width = 1920, height = 1080 },
+        clients    = clients,
+        geometries = {},
+    }
+    l.arrange(p)
+    local ret = {}
+    for i, c in ipairs(clients) do ret[i] = p.geometries[c] end
+    return ret
+end
+
+runner.run_steps({
+    function()
+        local native = awesome._layout_arrange
+        assert(native)
+
+        for _, l in ipairs(layouts) do
+            for n = 0, 12 do
+                local got = arrange(l, n)
+                rawset(awesome, "_layout_arrange", nil)
+                local expected = arrange(l, n)
+                rawset(awesome, "_layout_arrange", native)
+
+                assert(#got == #expected)
+                for i, g in ipairs(expected) do
+                    for _, k in ipairs { "x", "y", "width", "height" } do
+                        assert(got[i][k] == g[k], l.name .. " " .. n .. " " .. i .. " " .. k)
+                    end
+                end
+            end
+        end
+
+        assert(not native("tile", {}))
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
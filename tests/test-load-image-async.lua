@@ -0,0 +1,50 @@
+--- Tests for awesome.load_image_async() and gears.surface.load_async()
+
+local runner = require("_runner")
+local cairo = require("lgi").cairo
+local gears_surface = require("gears.surface")
+
+local path = os.tmpname() .. ".png"
+local results = {}
+
+runner.run_steps({
+    function()
+        local img = cairo.ImageSurface(cairo.Format.ARGB32, 20, 10)
+        img:write_to_png(path)
+
+        local returned = false
+        gears_surface.load_async(path, function(s, err)
+            -- Never called synchronously
+            assert(returned)
+            table.insert(results, { s, err })
+        end)
+        -- A second load of the same file shares the work
+        gears_surface.load_async(path, function(s, err)
+            table.insert(results, { s, err })
+        end)
+        gears_surface.load_async("/does/not/exist.png", function(s, err)
+            table.insert(results, { s, err })
+        end)
+        returned = true
+        return true
+    end,
+    function()
+        if #results < 3 then return end
+
+        local loaded = 0
+        for _, r in ipairs(results) do
+            if r[1] then
+                local w, h = gears_surface.get_size(r[1])
+                assert(w == 20 and h == 10)
+                loaded = loaded + 1
+            else
+                assert(type(r[2]) == "string")
+            end
+        end
+        assert(loaded == 2, loaded)
+        os.remove(path)
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,19 @@
+--- Tests for awesome.set_log_options()
+
+local runner = require("_runner")
+
+runner.run_steps({
+    function()
+        awesome.set_log_options { json = true, rate_limit = 5 }
+        awesome.set_log_options { async = false }
+        awesome.set_log_options { level = "error" }
+        awesome.set_log_options { level = "warning", json = false, async = true, rate_limit = 20 }
+
+        assert(not pcall(awesome.set_log_options, { level = "verbose" }))
+        assert(not pcall(awesome.set_log_options, { rate_limit = -1 }))
+        assert(not pcall(awesome.set_log_options))
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,43 @@
+--- Tests for awesome.loop_stats()
+
+local runner = require("_runner")
+
+local phases = { "refresh", "drawin", "client", "banning", "stack", "ewmh",
+                 "destroy_later", "damage", "flush", "events", "poll", "iteration",
+                 "scan", "gc" }
+
+runner.run_steps({
+    function()
+        local stats = awesome.loop_stats()
+        for _, name in ipairs(phases) do
+            local s = stats[name]
+            assert(s, name)
+            assert(s.p50 <= s.p99 and s.p99 <= s.max, name)
+            assert(s.total >= 0, name)
+        end
+
+        -- The startup scan is recorded once
+        assert(stats.scan.count == 1, stats.scan.count)
+
+        -- A few iterations of the main loop already happened
+        return stats.refresh.count > 0 and stats.poll.count > 0
+    end,
+    function()
+        awesome.loop_stats(true)
+        local stats = awesome.loop_stats()
+        assert(stats.refresh.count == 0)
+        assert(stats.allocations.iterations == 0)
+        assert(stats.allocations.scratch > 0)
+        return true
+    end,
+    function()
+        -- Iterations with nothing to handle do not allocate
+        local a = awesome.loop_stats().allocations
+        if a.iterations < 10 then return end
+        assert(a.allocating < a.iterations, a.allocating)
+        assert(a.max >= a.last and a.total >= a.max)
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
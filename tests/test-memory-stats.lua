@@ -0,0 +1,36 @@
+--- Tests for awesome.memory_stats()
+
+local runner = require("_runner")
+
+local d
+local before
+
+runner.run_steps({
+    function()
+        local stats = awesome.memory_stats()
+        assert(stats.lua.bytes > 0)
+        for _, name in ipairs { "file", "icon", "copy", "shm" } do
+            assert(stats.images[name].count >= 0, name)
+        end
+        for _, name in ipairs { "drawable", "pool", "wallpaper", "shape" } do
+            assert(stats.pixmaps[name].bytes >= 0, name)
+        end
+        assert(stats.objects.client, "classes are listed")
+        assert(stats.objects.screen.count >= screen.count())
+        assert(stats.objects.screen.bytes > 0)
+
+        before = stats.pixmaps.drawable
+        d = drawin({ x = 0, y = 0, width = 100, height = 50, visible = true })
+        return true
+    end,
+    function()
+        local now = awesome.memory_stats().pixmaps.drawable
+        assert(now.count == before.count + 1, now.count)
+        assert(now.bytes >= before.bytes + 100 * 50 * 4, now.bytes)
+
+        d.visible = false
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
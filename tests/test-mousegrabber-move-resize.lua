@@ -0,0 +1,103 @@
+-- Test the native move and resize of the mousegrabber
+
+local runner = require("_runner")
+local test_client = require("_client")
+
+local events = {}
+
+local function callback(event, geo, snapped)
+    table.insert(events, { event = event, geo = geo, snapped = snapped })
+end
+
+local steps = {
+    function(count)
+        if count == 1 then
+            test_client("foobar", "foobar")
+        elseif #client.get() > 0 then
+            local c = client.get()[1]
+            c.floating = true
+            c:geometry { x = 200, y = 200, width = 300, height = 300 }
+            return true
+        end
+    end,
+
+    -- Grow the client from its bottom right corner
+    function()
+        local c = client.get()[1]
+        assert(c:geometry().width == 300)
+
+        root.fake_input("button_press", 1)
+        mouse.coords { x = 500, y = 500 }
+        mousegrabber.move_resize(c, {
+            mode             = "resize",
+            corner           = "bottom_right",
+            honor_size_hints = false,
+            callback         = callback,
+        })
+        assert(mousegrabber.isrunning())
+        assert(#events == 1 and events[1].event == "start")
+
+        mouse.coords { x = 600, y = 550 }
+        return true
+    end,
+
+    function()
+        local c = client.get()[1]
+        local geo = c:geometry()
+        if geo.width ~= 400 then return end
+
+        assert(geo.x == 200 and geo.y == 200, geo.x .. "," .. geo.y)
+        assert(geo.height == 350, geo.height)
+        -- Nothing but the start was reported while moving
+        assert(#events == 1)
+
+        root.fake_input("button_release", 1)
+        return true
+    end,
+
+    function()
+        if mousegrabber.isrunning() then return end
+
+        assert(#events == 2 and events[2].event == "end")
+        assert(events[2].geo.width == 400)
+        return true
+    end,
+
+    -- Move the client and let it snap to the left edge of the workarea
+    function()
+        local c = client.get()[1]
+        local wa = c.screen.workarea
+        events = {}
+
+        root.fake_input("button_press", 1)
+        mouse.coords { x = 300, y = 300 }
+        mousegrabber.move_resize(c, { snap = 8, callback = callback })
+
+        mouse.coords { x = 300 - (200 - wa.x) + 5, y = 350 }
+        return true
+    end,
+
+    function()
+        local c = client.get()[1]
+        local geo = c:geometry()
+        if geo.y ~= 250 then return end
+
+        assert(geo.x == c.screen.workarea.x, geo.x)
+        assert(geo.width == 400)
+        assert(events[#events].event == "snap" and events[#events].snapped)
+
+        root.fake_input("button_release", 1)
+        return true
+    end,
+
+    function()
+        if mousegrabber.isrunning() then return end
+
+        assert(events[#events].event == "end")
+        return true
+    end,
+}
+
+runner.run_steps(steps)
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
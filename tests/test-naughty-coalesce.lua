@@ -0,0 +1,125 @@
+--- Tests for the coalescing and rate limiting of D-Bus notifications
+
+local runner  = require("_runner")
+local naughty = require("naughty")
+local ndbus   = require("naughty.dbus")
+local Gio     = require("lgi").Gio
+local GLib    = require("lgi").GLib
+
+local dbus_connection = assert(Gio.bus_get_sync(Gio.BusType.SESSION))
+
+local function send_notify(app, summary, callback, body)
+    local parameters = GLib.Variant("(susssasa{sv}i)", {
+        app, 0, "", summary, body or "body", {}, {}, 25000
+    })
+    dbus_connection:call("org.freedesktop.Notifications",
+        "/org/freedesktop/Notifications", "org.freedesktop.Notifications",
+        "Notify", parameters, GLib.VariantType.new("(u)"),
+        Gio.DBusCallFlags.NO_AUTO_START, -1, nil, function(conn, result)
+            callback(conn:call_finish(result).value[1])
+        end)
+end
+
+local added = {}
+naughty.connect_signal("added", function(n) table.insert(added, n) end)
+
+local ids = {}
+local replies = 0
+local shown = {}
+
+runner.run_steps({
+    -- Updates of the same summary are coalesced into the first notification
+    function()
+        ndbus.config.coalesce_window = 0.2
+        ndbus.config.rate_limit = 0
+        for i = 1, 10 do
+            send_notify("chatty", "progress", function(id)
+                ids[i] = id
+                replies = replies + 1
+            end)
+        end
+        return true
+    end,
+    function()
+        if replies < 10 then
+            return
+        end
+        for i = 2, 10 do
+            assert(ids[i] == ids[1], "every call gets the id of the first notification")
+        end
+        assert(#added == 1, #added)
+        return true
+    end,
+    function()
+        local n = added[1]
+        if n.suppressed_count ~= 8 then
+            return
+        end
+        assert(#added == 1)
+        n:destroy()
+        return true
+    end,
+
+    -- Too many notifications of an application are merged into its last one
+    function()
+        ndbus.config.coalesce_window = 0
+        ndbus.config.rate_limit = 3
+        added, replies = {}, 0
+        for i = 1, 10 do
+            send_notify("flood", "message " .. i, function() replies = replies + 1 end)
+        end
+        return true
+    end,
+    function()
+        if replies < 10 then
+            return
+        end
+        assert(#added == 3, #added)
+        return true
+    end,
+    function()
+        local last = added[3]
+        if last.title ~= "message 10" then
+            return
+        end
+        assert(#added == 3)
+        assert(last.suppressed_count == 6, last.suppressed_count)
+        return true
+    end,
+
+    -- Updates held back by different sources are shown in the order they came
+    -- in, even when the window of the later one ends first
+    function()
+        ndbus.config.coalesce_window = 0.3
+        ndbus.config.rate_limit = 0
+        added, replies = {}, 0
+        send_notify("first", "a", function() replies = replies + 1 end, "a1")
+        send_notify("second", "b", function() replies = replies + 1 end, "b1")
+        return true
+    end,
+    function()
+        if replies < 2 then
+            return
+        end
+        assert(#added == 2, #added)
+        for _, n in ipairs(added) do
+            n:connect_signal("property::message", function()
+                table.insert(shown, n.message)
+            end)
+        end
+        send_notify("second", "b", function() replies = replies + 1 end, "b2")
+        send_notify("first", "a", function() replies = replies + 1 end, "a2")
+        return true
+    end,
+    function()
+        if #shown < 2 then
+            return
+        end
+        assert(shown[1] == "b2" and shown[2] == "a2", table.concat(shown, " "))
+        assert(#added == 2, #added)
+        ndbus.config.coalesce_window = 0
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,48 @@
+--- Tests for awesome.read_lines()
+
+local runner = require("_runner")
+local spawn = require("awful.spawn")
+
+local lines, batches, finished = {}, 0, false
+local split = {}
+local split_done = false
+
+runner.run_steps({
+    function()
+        local _, _, _, stdout = awesome.spawn({ "seq", "1", "5000" }, false, false, true)
+        awesome.read_lines(stdout, function(batch, err)
+            if not batch then
+                assert(err == nil, err)
+                assert(not finished)
+                finished = true
+                return
+            end
+            assert(#batch <= 100)
+            batches = batches + 1
+            for _, line in ipairs(batch) do
+                table.insert(lines, line)
+            end
+        end, 0, 100)
+
+        spawn.with_line_callback({ "printf", "abcdefgh\\nxy" }, {
+            stdout = function(line) table.insert(split, line) end,
+            output_done = function() split_done = true end,
+            max_line_length = 3,
+        })
+        return true
+    end,
+    function()
+        if not finished or not split_done then
+            return
+        end
+        assert(#lines == 5000, #lines)
+        assert(lines[1] == "1" and lines[5000] == "5000")
+        assert(batches >= 50, batches)
+
+        assert(#split == 4, #split)
+        assert(split[1] == "abc" and split[2] == "def" and split[3] == "gh" and split[4] == "xy")
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,76 @@
+--- Tests for awesome.reload(): the clients and the tags they are on survive
+-- running the configuration again.
+--
+-- The reload drops everything this file set up, the runner included, except
+-- GLib sources. The checks after the reload run from one of them, with a new
+-- copy of the runner.
+
+local runner = require("_runner")
+local test_client = require("_client")
+local GLib = require("lgi").GLib
+
+local window
+local reloaded = false
+
+local function by_window(w)
+    for _, c in ipairs(client.get()) do
+        if c.window == w then return c end
+    end
+end
+
+local function after_reload()
+    local new_runner = require("_runner")
+    assert(new_runner ~= runner)
+
+    new_runner.run_steps({
+        function()
+            assert(not awesome.startup)
+            local c = by_window(window)
+            assert(c, "the client did not survive the reload")
+
+            -- The new configuration created the tags again, the client is
+            -- on the ones at the same positions
+            local tags = screen[1].tags
+            assert(#tags == 9, #tags)
+            local names = {}
+            for _, t in ipairs(c:tags()) do
+                table.insert(names, t.name)
+            end
+            table.sort(names)
+            assert(table.concat(names, " ") == "2 3", table.concat(names, " "))
+            assert(tags[2]:clients()[1] == c)
+            return true
+        end,
+    })
+end
+
+runner.run_steps({
+    function()
+        test_client("reload_test", "reload_test")
+        return true
+    end,
+    function()
+        local c = client.get()[1]
+        if not c then return end
+        window = c.window
+        local tags = screen[1].tags
+        c:tags { tags[2], tags[3] }
+        return true
+    end,
+    function()
+        if reloaded then return end
+        reloaded = true
+
+        -- The reload runs from the main loop, after this step
+        GLib.timeout_add(GLib.PRIORITY_DEFAULT, 100, function()
+            if package.loaded["_runner"] == runner then
+                return true
+            end
+            after_reload()
+            return false
+        end)
+        awesome.reload()
+    end,
+}, { kill_clients = false })
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,100 @@
+--- Tests for root.content() with an area and awesome.save_image_async()
+
+local runner = require("_runner")
+local wibox = require("wibox")
+local awful = require("awful")
+local gears_surface = require("gears.surface")
+local lgi = require("lgi")
+local gdk = lgi.require("Gdk", "3.0")
+
+local path = os.tmpname() .. ".png"
+local saved = {}
+local shot_saved = nil
+
+wibox {
+    bg      = "#00ff00",
+    visible = true,
+    width   = 100,
+    height  = 100,
+    x       = 100,
+    y       = 100,
+}
+
+local function get_pixel(img, x, y)
+    local bytes = gdk.pixbuf_get_from_surface(img, x, y, 1, 1):get_pixels()
+    return "#" .. bytes:gsub('.', function(c) return ('%02x'):format(c:byte()) end)
+end
+
+runner.run_steps({
+    function()
+        -- Only the area is copied
+        local img = gears_surface(root.content { x = 150, y = 150, width = 100, height = 40 })
+        local w, h = gears_surface.get_size(img)
+        assert(w == 100 and h == 40, w .. "x" .. h)
+
+        if get_pixel(img, 10, 10) ~= "#00ff00" then return end
+        assert(get_pixel(img, 60, 10) ~= "#00ff00")
+
+        -- An area beyond the root window is clipped
+        local root_width, root_height = root.size()
+        local clipped = gears_surface(root.content {
+            x = root_width - 10, y = root_height - 10, width = 50, height = 50 })
+        w, h = gears_surface.get_size(clipped)
+        assert(w == 10 and h == 10, w .. "x" .. h)
+
+        local returned = false
+        awesome.save_image_async(img._native, path, function(p, err)
+            -- Never called synchronously
+            assert(returned)
+            table.insert(saved, { p, err })
+        end)
+        awesome.save_image_async(img._native, "/does/not/exist.png", function(p, err)
+            table.insert(saved, { p, err })
+        end)
+        returned = true
+        return true
+    end,
+    function()
+        if #saved < 2 then return end
+
+        local ok = 0
+        for _, r in ipairs(saved) do
+            if r[1] then
+                assert(r[1] == path)
+                ok = ok + 1
+            else
+                assert(type(r[2]) == "string")
+            end
+        end
+        assert(ok == 1, ok)
+
+        -- The file is complete once the callback is called
+        local img = gears_surface.load(path)
+        local w, h = gears_surface.get_size(img)
+        assert(w == 100 and h == 40)
+        assert(get_pixel(img, 10, 10) == "#00ff00")
+        os.remove(path)
+        return true
+    end,
+    function()
+        local ss = awful.screenshot {
+            geometry = { x = 100, y = 100, width = 20, height = 20 },
+            directory = "/tmp",
+        }
+        ss:connect_signal("file::saved", function(_, p) shot_saved = p end)
+        ss:save_async(path)
+        -- Not written yet
+        assert(not shot_saved)
+        return true
+    end,
+    function()
+        if not shot_saved then return end
+        assert(shot_saved == path)
+        local w, h = gears_surface.get_size(gears_surface.load(path))
+        assert(w == 20 and h == 20)
+        os.remove(path)
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,77 @@
+-- Test that rules matched natively give the same results as in Lua
+
+local runner = require("_runner")
+local gears = require("gears")
+local test_client = require("_client")
+
+local m = gears.matcher()
+
+local rules = {
+    { rule = { class = "rulematch" } },
+    { rule = { class = "^rulematch$" } },
+    { rule = { class = "^rule" } },
+    { rule = { class = "match$" } },
+    { rule = { class = "rule.atch" } },
+    { rule = { class = "nope" } },
+    { rule = { class = "rulematch", name = "nope" } },
+    { rule_any = { class = { "nope", "rulem" }, instance = { "x" } } },
+    { rule_any = { floating = true } },
+    { rule_any = { class = { "nope" } } },
+    { rule_every = { class = { "rulematch", "nope" }, instance = { "rulematch" } } },
+    { rule = { class = "rulematch" }, except = { instance = "rulematch" } },
+    { rule = { class = "rulematch" }, except_any = { name = { "nope" } } },
+    { rule = { urgent = false } },
+    { rule = { screen = 1 } },
+    { rule = {}, rule_greater = { width = 1 } },
+    { except = { class = "nope" } },
+    {},
+}
+
+local function lua_matches(c)
+    local ret = {}
+    for _, r in ipairs(rules) do
+        if m:matches_rule(c, r) then
+            table.insert(ret, r)
+        end
+    end
+    return ret
+end
+
+local function same(a, b)
+    if #a ~= #b then return false end
+    for i = 1, #a do
+        if a[i] ~= b[i] then return false end
+    end
+    return true
+end
+
+runner.run_steps {
+    function()
+        test_client("rulematch", "rulematch")
+        return true
+    end,
+
+    function()
+        local c = client.get()[1]
+        if not c then return end
+
+        assert(awesome._rules_compile)
+        local native = m:matching_rules(c, rules)
+        local expected = lua_matches(c)
+        assert(#expected > 0)
+        assert(same(native, expected), #native .. " ~= " .. #expected)
+
+        -- Adding a rule is seen
+        table.insert(rules, { rule = { instance = "rulematch" } })
+        assert(same(m:matching_rules(c, rules), lua_matches(c)))
+
+        -- A property matcher is left to Lua
+        m:add_property_matcher("class", function() return false end)
+        assert(same(m:matching_rules(c, rules), lua_matches(c)))
+
+        c:kill()
+        return true
+    end,
+}
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -195,6 +195,58 @@ runner.run_steps{
         return true
     end,
 
+    function()
+        -- Wait for the above check to be done
+        if not continue then
+            return
+        end
+
+        -- Query the image again, collected natively into one string
+        continue = false
+        local s = selection.getter{ selection = "CLIPBOARD", target = "image/bmp", accumulate = true }
+        local data = nil
+        s:connect_signal("data", function(_, d)
+            assert(data == nil)
+            data = d
+        end)
+        s:connect_signal("data_end", function(_, err)
+            assert(err == nil, err)
+            local stream = Gio.MemoryInputStream.new_from_data(data)
+            local pixbuf = assert(GdkPixbuf.Pixbuf.new_from_stream(stream))
+            assert(pixbuf.width == 1900)
+            assert(pixbuf.height == 1600)
+
+            assert(not continue)
+            continue = true
+        end)
+
+        return true
+    end,
+
+    function()
+        -- Wait for the above check to be done
+        if not continue then
+            return
+        end
+
+        -- An image larger than max_size fails without emitting any data
+        continue = false
+        local s = selection.getter{
+            selection = "CLIPBOARD",
+            target = "image/bmp",
+            accumulate = true,
+            max_size = 1024 * 1024,
+        }
+        s:connect_signal("data", function() error("Got unexpected data") end)
+        s:connect_signal("data_end", function(_, err)
+            assert(err == "selection is larger than max_size", tostring(err))
+            assert(not continue)
+            continue = true
+        end)
+
+        return true
+    end,
+
     function()
         -- Wait for the above check to be done
         if not continue then
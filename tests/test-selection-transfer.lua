@@ -174,6 +174,70 @@ runner.run_steps({
         return true
     end,
 
+    function()
+        -- Wait for the previous test to succeed
+        if not continue then return end
+        continue = false
+
+        -- Now test a huge transfer from a chunk callback
+        selection_object = assert(selection.acquire{ selection = "CLIPBOARD" },
+            "Failed to acquire the clipboard selection")
+        selection_object:connect_signal("request", function(_, target, transfer)
+            if target == "TARGETS" then
+                transfer:send{
+                    format = "atom",
+                    data = { "TARGETS", "UTF8_STRING" },
+                }
+            elseif target == "UTF8_STRING" then
+                local left = large_transfer_size
+                transfer:send{
+                    data = function(max_length)
+                        local length = math.min(left, max_length)
+                        left = left - length
+                        return large_transfer_piece:sub(1, length)
+                    end,
+                }
+            end
+        end)
+        awesome.sync()
+        spawn.with_line_callback({ lua_executable, "-e", check_large_transfer },
+            { stdout = function(line)
+                assert(line == "done", "Unexpected line: " .. line)
+                continue = true
+            end })
+        return true
+    end,
+
+    function()
+        -- Wait for the previous test to succeed
+        if not continue then return end
+        continue = false
+
+        -- Now test a huge transfer streamed from a pipe
+        selection_object = assert(selection.acquire{ selection = "CLIPBOARD" },
+            "Failed to acquire the clipboard selection")
+        selection_object:connect_signal("request", function(_, target, transfer)
+            if target == "TARGETS" then
+                transfer:send{
+                    format = "atom",
+                    data = { "TARGETS", "UTF8_STRING" },
+                }
+            elseif target == "UTF8_STRING" then
+                local cmd = string.format("yes | head -c %d", large_transfer_size)
+                local _, _, _, stdout = awesome.spawn({ "/bin/sh", "-c", cmd },
+                    false, false, true, false)
+                transfer:send_fd{ fd = stdout }
+            end
+        end)
+        awesome.sync()
+        spawn.with_line_callback({ lua_executable, "-e", check_large_transfer },
+            { stdout = function(line)
+                assert(line == "done", "Unexpected line: " .. line)
+                continue = true
+            end })
+        return true
+    end,
+
     function()
         -- Wait for the previous test to succeed
         if not continue then return end
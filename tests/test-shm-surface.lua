@@ -0,0 +1,33 @@
+--- Tests for awesome.create_shm_surface() and drawable:upload()
+
+local runner = require("_runner")
+local cairo = require("lgi").cairo
+local gears_surface = require("gears.surface")
+
+runner.run_steps({
+    function()
+        local d = drawin({ x = 0, y = 0, width = 64, height = 32, visible = true })
+
+        local img = gears_surface(awesome.create_shm_surface(64, 32))
+        local w, h = gears_surface.get_size(img)
+        assert(w == 64 and h == 32)
+
+        local cr = cairo.Context(img)
+        cr:set_source_rgb(1, 0, 0)
+        cr:paint()
+
+        -- Works both with shared memory and with the plain fallback
+        d.drawable:upload(img._native, 0, 0)
+        d.drawable:refresh()
+
+        -- Plain image surfaces are painted
+        local plain = cairo.ImageSurface(cairo.Format.ARGB32, 16, 16)
+        d.drawable:upload(plain._native, 8, 8)
+        d.drawable:refresh()
+
+        d.visible = false
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,70 @@
+--- Test the signal handler profiler.
+
+local runner = require("_runner")
+
+local function find(profile, class, signal)
+    for _, entry in ipairs(profile) do
+        if entry.class == class and entry.signal == signal then
+            return entry
+        end
+    end
+end
+
+local function inner()
+    local stop = os.clock() + 0.01
+    repeat until os.clock() >= stop
+end
+
+local function outer()
+    awesome.emit_signal("test::signal_profile_inner")
+end
+
+runner.run_steps({
+    function()
+        awesome.connect_signal("test::signal_profile_inner", inner)
+        awesome.connect_signal("test::signal_profile_outer", outer)
+
+        awesome.signal_profile("start")
+        for _ = 1, 3 do
+            awesome.emit_signal("test::signal_profile_outer")
+        end
+        awesome.signal_profile("stop")
+        -- Not counted any more
+        awesome.emit_signal("test::signal_profile_outer")
+
+        local profile = awesome.signal_profile("dump")
+        local i = assert(find(profile, "awesome", "test::signal_profile_inner"))
+        local o = assert(find(profile, "awesome", "test::signal_profile_outer"))
+        assert(i.calls == 3 and o.calls == 3)
+        assert(i.source:match("test%-signal%-profile%.lua:%d+$"), i.source)
+        assert(i.self >= 0.03 and i.self <= i.total)
+        assert(o.total >= i.total)
+        assert(o.self < i.self)
+
+        -- Sorted by self time
+        for n = 2, #profile do
+            assert(profile[n - 1].self >= profile[n].self)
+        end
+
+        awesome.disconnect_signal("test::signal_profile_inner", inner)
+        awesome.disconnect_signal("test::signal_profile_outer", outer)
+        return true
+    end,
+
+    function()
+        awesome.signal_profile("start")
+        client.connect_signal("test::signal_profile", inner)
+        client.emit_signal("test::signal_profile")
+        client.disconnect_signal("test::signal_profile", inner)
+        awesome.signal_profile("stop")
+
+        local profile = awesome.signal_profile("dump")
+        assert(find(profile, "client", "test::signal_profile").calls == 1)
+        assert(not find(profile, "awesome", "test::signal_profile_inner"))
+
+        assert(not pcall(awesome.signal_profile, "bogus"))
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
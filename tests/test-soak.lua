@@ -0,0 +1,343 @@
+-- A soak benchmark which repeats common operations for a while and checks
+-- that neither the memory use, the X resources nor the latency keep growing.
+--
+-- Every round spawns a test client, switches the tag, shows a notification,
+-- changes the wallpaper and kills the client again. The settings are read from
+-- the environment, the defaults keep this quick enough for the normal test
+-- runs:
+--
+--   SOAK_DURATION   seconds to run the rounds for (default 10)
+--   SOAK_INTERVAL   seconds between two samples of the resources (default 1)
+--   SOAK_OUTPUT     file to write the samples and results to as JSON
+--
+-- Each sample is taken after a full garbage collection, at the end of a round,
+-- and records the resident memory, the Lua heap, the image surfaces and
+-- pixmaps from awesome.memory_stats and the X resources from
+-- awesome.x_resources. The first quarter of the samples is a warm-up for the
+-- caches and is left out of the trends. An operation is timed until the main
+-- loop refreshed and the X server processed its requests.
+
+local runner = require("_runner")
+local awful = require("awful")
+local naughty = require("naughty")
+local gwallpaper = require("gears.wallpaper")
+local test_client = require("_client")
+local GLib = require("lgi").GLib
+
+local function env_number(name, default)
+    return math.max(0.1, tonumber(os.getenv(name)) or default)
+end
+
+local duration = env_number("SOAK_DURATION", 10)
+local interval = env_number("SOAK_INTERVAL", 1)
+local output = os.getenv("SOAK_OUTPUT")
+
+-- A series only trends upwards if it grows by more than this over the run
+local tolerance = {
+    rss = function(base) return math.max(4096, base * 0.1) end,
+    lua = function(base) return math.max(512, base * 0.1) end,
+    count = function() return 2 end,
+}
+-- The p95 latency of the last third may be this much slower than the first
+local latency_factor, latency_slack = 2, 0.01
+local min_trend_samples = 4
+
+local function now()
+    return GLib.get_monotonic_time() / 1e6
+end
+
+--- Call `done` once the following main loop iteration refreshed and the X
+-- server processed the requests it sent.
+local function settle(done)
+    GLib.idle_add(GLib.PRIORITY_LOW, function()
+        awesome.sync()
+        done()
+        return false
+    end)
+end
+
+local soak_client
+local managed, unmanaged
+
+client.connect_signal("manage", function(c)
+    if c.class == "soak" and managed then
+        soak_client = c
+        local done = managed
+        managed = nil
+        settle(done)
+    end
+end)
+
+client.connect_signal("unmanage", function(c)
+    if c == soak_client and unmanaged then
+        soak_client = nil
+        local done = unmanaged
+        unmanaged = nil
+        settle(done)
+    end
+end)
+
+local wallpapers = { "#202020", "#203040", "#402020" }
+local wallpaper_index = 0
+
+local operations = {
+    { name = "spawn", run = function(done)
+        managed = done
+        test_client("soak")
+    end },
+    { name = "tag_switch", run = function(done)
+        awful.tag.viewnext(screen[1])
+        settle(done)
+    end },
+    { name = "notification", run = function(done)
+        local n = naughty.notification {
+            title = "soak",
+            message = "round",
+            timeout = 0,
+        }
+        settle(function()
+            n:destroy()
+            settle(done)
+        end)
+    end },
+    { name = "wallpaper", run = function(done)
+        wallpaper_index = wallpaper_index % #wallpapers + 1
+        gwallpaper.set(wallpapers[wallpaper_index])
+        settle(done)
+    end },
+    { name = "kill", run = function(done)
+        unmanaged = done
+        soak_client:kill()
+    end },
+}
+
+-- The latencies of each operation, in the order they were taken
+local latencies = {}
+for _, op in ipairs(operations) do
+    latencies[op.name] = {}
+end
+
+local function read_rss()
+    local f = io.open("/proc/self/status")
+    if not f then
+        return nil
+    end
+    local rss
+    for line in f:lines() do
+        rss = rss or tonumber(line:match("^VmRSS:%s*(%d+)"))
+    end
+    f:close()
+    return rss
+end
+
+local function sum_counts(counters)
+    local count = 0
+    for _, counter in pairs(counters) do
+        count = count + counter.count
+    end
+    return count
+end
+
+-- Each sample maps a series name to its value, the memory is in kB
+local samples, series, known = {}, {}, {}
+
+local function take_sample(elapsed)
+    collectgarbage("collect")
+    collectgarbage("collect")
+
+    local stats = awesome.memory_stats()
+    local sample = {
+        time = elapsed,
+        rss = read_rss(),
+        lua = collectgarbage("count"),
+        images = sum_counts(stats.images),
+        pixmaps = sum_counts(stats.pixmaps),
+    }
+    for kind, count in pairs(awesome.x_resources() or {}) do
+        sample["x_" .. kind] = count
+    end
+
+    for name in pairs(sample) do
+        if name ~= "time" and not known[name] then
+            known[name] = true
+            table.insert(series, name)
+        end
+    end
+    table.sort(series)
+    table.insert(samples, sample)
+end
+
+local function tolerance_of(name, base)
+    if name == "rss" or name == "lua" then
+        return tolerance[name](base)
+    end
+    return tolerance.count()
+end
+
+--- The growth of a series over the samples after the warm-up, from the slope
+-- of its least squares fit.
+local function growth(name)
+    local first = math.floor(#samples / 4) + 1
+    local n, sx, sy, sxx, sxy = 0, 0, 0, 0, 0
+    for i = first, #samples do
+        local y = samples[i][name]
+        if y then
+            local x = samples[i].time
+            n = n + 1
+            sx, sy = sx + x, sy + y
+            sxx, sxy = sxx + x * x, sxy + x * y
+        end
+    end
+    if n < min_trend_samples or n * sxx - sx * sx == 0 then
+        return nil
+    end
+    local slope = (n * sxy - sx * sy) / (n * sxx - sx * sx)
+    return slope * (samples[#samples].time - samples[first].time), sy / n
+end
+
+local function percentile(values, p)
+    local sorted = {}
+    for i, v in ipairs(values) do
+        sorted[i] = v
+    end
+    table.sort(sorted)
+    return sorted[math.max(1, math.ceil(p * #sorted))]
+end
+
+local function summarize(name)
+    local all, first, last = {}, {}, {}
+    local samples_of = latencies[name]
+    local third = math.floor(#samples_of / 3)
+    for i, latency in ipairs(samples_of) do
+        table.insert(all, latency)
+        if i <= third then
+            table.insert(first, latency)
+        elseif i > #samples_of - third then
+            table.insert(last, latency)
+        end
+    end
+    return {
+        count = #all,
+        p50 = percentile(all, 0.5),
+        p95 = percentile(all, 0.95),
+        p99 = percentile(all, 0.99),
+        max = percentile(all, 1),
+        first_p95 = third > 0 and percentile(first, 0.95) or nil,
+        last_p95 = third > 0 and percentile(last, 0.95) or nil,
+    }
+end
+
+local rounds = 0
+
+local function report()
+    local failures, entries = {}, {}
+    print(string.format("soak: %d rounds, %d samples in %.1f sec",
+                        rounds, #samples, samples[#samples].time))
+
+    for _, name in ipairs(series) do
+        local grew, mean = growth(name)
+        if grew then
+            local limit = tolerance_of(name, mean)
+            print(string.format("%20s: mean %-12.6g growth %-12.6g limit %-12.6g",
+                                name, mean, grew, limit))
+            if grew > limit then
+                table.insert(failures, string.format("%s grew by %g", name, grew))
+            end
+        end
+    end
+
+    for _, op in ipairs(operations) do
+        local s = summarize(op.name)
+        print(string.format("%20s: p50 %-10.6g p95 %-10.6g p99 %-10.6g max %-10.6g sec",
+                            op.name, s.p50, s.p95, s.p99, s.max))
+        if s.last_p95 and s.count >= 3 * min_trend_samples
+                and s.last_p95 > s.first_p95 * latency_factor + latency_slack then
+            table.insert(failures, string.format("%s p95 latency went from %g to %g sec",
+                                                 op.name, s.first_p95, s.last_p95))
+        end
+        table.insert(entries, string.format(
+            '    {"name": "%s", "count": %d, "p50": %.9f, "p95": %.9f, "p99": %.9f, "max": %.9f}',
+            op.name, s.count, s.p50, s.p95, s.p99, s.max))
+    end
+
+    if output then
+        local rows = {}
+        for _, sample in ipairs(samples) do
+            local fields = { string.format('"time": %.3f', sample.time) }
+            for _, name in ipairs(series) do
+                if sample[name] then
+                    table.insert(fields, string.format('"%s": %.3f', name, sample[name]))
+                end
+            end
+            table.insert(rows, "    {" .. table.concat(fields, ", ") .. "}")
+        end
+        local f = assert(io.open(output, "w"))
+        f:write(string.format(
+            '{\n  "rounds": %d,\n  "operations": [\n%s\n  ],\n  "samples": [\n%s\n  ]\n}\n',
+            rounds, table.concat(entries, ",\n"), table.concat(rows, ",\n")))
+        f:close()
+    end
+
+    assert(#failures == 0, "soak: " .. table.concat(failures, ", "))
+end
+
+local finished = false
+
+local function run_rounds()
+    local start, last_sample = now(), -math.huge
+
+    local function run_operation(i)
+        local op = operations[i]
+        if not op then
+            rounds = rounds + 1
+            local elapsed = now() - start
+            if elapsed - last_sample >= interval or elapsed >= duration then
+                last_sample = elapsed
+                take_sample(elapsed)
+            end
+            if elapsed >= duration then
+                finished = true
+            else
+                -- Start the next round from the main loop, not from the
+                -- handlers of the last operation
+                GLib.idle_add(GLib.PRIORITY_DEFAULT, function()
+                    run_operation(1)
+                    return false
+                end)
+            end
+            return
+        end
+
+        local op_start = now()
+        op.run(function()
+            table.insert(latencies[op.name], now() - op_start)
+            run_operation(i + 1)
+        end)
+    end
+
+    run_operation(1)
+end
+
+runner.run_steps({
+    function()
+        local tags = awful.tag({ "soak1", "soak2", "soak3" }, screen[1], awful.layout.suit.tile)
+        tags[1]:view_only()
+        return true
+    end,
+
+    function()
+        run_rounds()
+        return true
+    end,
+
+    function()
+        return finished or nil
+    end,
+
+    function()
+        report()
+        return true
+    end,
+}, { wait_per_step = duration + 60 })
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
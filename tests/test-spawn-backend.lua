@@ -0,0 +1,49 @@
+--- Tests for awesome.set_spawn_backend()
+
+local runner = require("_runner")
+local spawn = require("awful.spawn")
+
+local results = {}
+
+local function run(backend)
+    awesome.set_spawn_backend(backend)
+    local pid, snid = awesome.spawn({ "sh", "-c", "test -z \"$DESKTOP_STARTUP_ID\"" }, false,
+            false, false, false, function(reason, code)
+                results[backend .. "_env"] = reason == "exit" and code == 0
+            end)
+    assert(type(pid) == "number", pid)
+    assert(snid == nil)
+
+    spawn.easy_async({ "sh", "-c", "echo yay; exit 3" },
+        function(stdout, _, reason, code)
+            results[backend] = stdout == "yay\n" and reason == "exit" and code == 3
+        end)
+
+    local err = awesome.spawn("this_does_not_exist_and_should_fail")
+    assert(string.find(err, "No such file or directory"), err)
+end
+
+runner.run_steps({
+    function()
+        assert(not pcall(awesome.set_spawn_backend, "fork"))
+        return true
+    end,
+    function(count)
+        if count == 1 then
+            -- Children without exit callback are reaped as well
+            awesome.spawn({ "true" }, false)
+            run("posix_spawn")
+            run("glib")
+        end
+        return results.posix_spawn ~= nil and results.glib ~= nil
+            and results.posix_spawn_env ~= nil and results.glib_env ~= nil
+    end,
+    function()
+        assert(results.posix_spawn and results.glib)
+        assert(results.posix_spawn_env and results.glib_env)
+        awesome.set_spawn_backend("posix_spawn")
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,53 @@
+--- Tests for awful.spawn.easy_async_worker()
+
+local runner = require("_runner")
+local spawn = require("awful.spawn")
+local unpack = unpack or table.unpack -- luacheck: globals unpack (compatibility with Lua 5.1)
+
+local cmd = "echo foo; printf bar; echo baz >&2; (exit 3)"
+local results = {}
+local first_pid, crashed, after_crash
+
+runner.run_steps({
+    function()
+        for i = 1, 3 do
+            local pid = spawn.easy_async_worker(cmd, function(...)
+                results[i] = { ... }
+            end)
+            assert(type(pid) == "number", pid)
+            assert(not first_pid or pid == first_pid)
+            first_pid = pid
+        end
+        return true
+    end,
+    function()
+        if not results[3] then
+            return
+        end
+        for i = 1, 3 do
+            local stdout, stderr, reason, code = unpack(results[i])
+            assert(stdout == "foo\nbar\n", stdout)
+            assert(stderr == "baz\n", stderr)
+            assert(reason == "exit" and code == 3, tostring(reason) .. " " .. tostring(code))
+        end
+
+        -- A command that kills its shell, the next call gets a new one
+        spawn.easy_async_worker("echo gone; exit 5", function(...) crashed = { ... } end)
+        spawn.easy_async_worker("echo gone; exit 5", function(...) after_crash = { ... } end)
+        return true
+    end,
+    function()
+        if not crashed or not after_crash then
+            return
+        end
+        assert(crashed[1] == "gone\n", crashed[1])
+        assert(crashed[3] == "exit" and crashed[4] == 5)
+        assert(after_crash[1] == "gone\n" and after_crash[4] == 5)
+
+        assert(spawn.stop_worker(cmd))
+        assert(not spawn.stop_worker(cmd))
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
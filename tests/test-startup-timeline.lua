@@ -0,0 +1,39 @@
+--- Test awesome.startup_timeline().
+
+local runner = require("_runner")
+
+runner.run_steps({
+    function()
+        local timeline = awesome.startup_timeline()
+        local phases, modules = {}, {}
+        local last_start = 0
+        for _, entry in ipairs(timeline) do
+            assert(entry.start >= last_start)
+            assert(entry.duration >= 0)
+            last_start = entry.start
+            if entry.kind == "phase" then
+                phases[entry.name] = entry
+            else
+                assert(entry.kind == "require")
+                assert(entry.depth >= 0)
+                modules[entry.name] = entry
+            end
+        end
+
+        for _, name in ipairs { "x_connect", "acquire_wm_sn", "dbus", "xkb", "screen_scan",
+                                "config", "client_scan", "first_paint" } do
+            assert(phases[name], name)
+        end
+        assert(phases.config.start >= phases.screen_scan.start)
+        assert(modules.awful, "awful was not recorded")
+        assert(modules.awful.start >= phases.config.start)
+
+        -- Modules loaded after startup are not recorded
+        package.loaded["gears.debug"] = nil
+        require("gears.debug")
+        assert(#awesome.startup_timeline() == #timeline)
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
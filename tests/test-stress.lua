@@ -0,0 +1,199 @@
+-- A stress benchmark that scales with the number of clients, tags and screens.
+--
+-- The sizes are read from the environment, the defaults keep this quick
+-- enough for the normal test runs:
+--
+--   STRESS_CLIENTS  number of test clients (default 4)
+--   STRESS_TAGS     tags per screen (default 3)
+--   STRESS_SCREENS  fake screens, side by side (default 1)
+--   STRESS_SAMPLES  samples per scenario (default 10)
+--   STRESS_OUTPUT   file to write the results to as JSON (default none)
+--
+-- Every sample is timed from the change until the main loop refreshed, flushed
+-- its requests and the X server processed them.
+
+local runner = require("_runner")
+local awful = require("awful")
+local test_client = require("_client")
+local create_wibox = require("_wibox_helper").create_wibox
+local GLib = require("lgi").GLib
+
+local function env_number(name, default)
+    return math.max(1, math.floor(tonumber(os.getenv(name)) or default))
+end
+
+local client_count = env_number("STRESS_CLIENTS", 4)
+local tag_count = env_number("STRESS_TAGS", 3)
+local screen_count = env_number("STRESS_SCREENS", 1)
+local sample_count = env_number("STRESS_SAMPLES", 10)
+local output = os.getenv("STRESS_OUTPUT")
+
+local function now()
+    return GLib.get_monotonic_time() / 1e6
+end
+
+local screens, tags = {}, {}
+local scenarios, results = {}, {}
+
+--- Time `op` `sample_count` times in a row, each sample ending when the X
+-- server processed what the following main loop iteration sent.
+local function scenario(name, op)
+    local samples = {}
+    table.insert(scenarios, name)
+    results[name] = samples
+
+    local started = false
+    return function()
+        if not started then
+            started = true
+            local function next_sample()
+                local start = now()
+                op()
+                -- Low priority idles run after the refresh of the next
+                -- iteration, which happens right before polling
+                GLib.idle_add(GLib.PRIORITY_LOW, function()
+                    awesome.sync()
+                    table.insert(samples, now() - start)
+                    if #samples < sample_count then
+                        next_sample()
+                    end
+                    return false
+                end)
+            end
+            next_sample()
+        end
+        return #samples >= sample_count or nil
+    end
+end
+
+local function percentile(sorted, p)
+    return sorted[math.max(1, math.ceil(p * #sorted))]
+end
+
+local function summarize(name)
+    local sorted = {}
+    for i, v in ipairs(results[name]) do
+        sorted[i] = v
+    end
+    table.sort(sorted)
+    return {
+        count = #sorted,
+        p50 = percentile(sorted, 0.5),
+        p95 = percentile(sorted, 0.95),
+        p99 = percentile(sorted, 0.99),
+        max = sorted[#sorted],
+    }
+end
+
+local function report()
+    local entries = {}
+    print(string.format("stress: %d clients, %d tags, %d screens",
+                        client_count, tag_count, screen_count))
+    for _, name in ipairs(scenarios) do
+        local s = summarize(name)
+        print(string.format("%20s: p50 %-10.6g p95 %-10.6g p99 %-10.6g max %-10.6g sec",
+                            name, s.p50, s.p95, s.p99, s.max))
+        table.insert(entries, string.format(
+            '    {"name": "%s", "count": %d, "p50": %.9f, "p95": %.9f, "p99": %.9f, "max": %.9f}',
+            name, s.count, s.p50, s.p95, s.p99, s.max))
+    end
+
+    if output then
+        local f = assert(io.open(output, "w"))
+        f:write(string.format(
+            '{\n  "clients": %d,\n  "tags": %d,\n  "screens": %d,\n  "scenarios": [\n%s\n  ]\n}\n',
+            client_count, tag_count, screen_count, table.concat(entries, ",\n")))
+        f:close()
+    end
+end
+
+-- Spawn the clients one after the other, each when the previous one was
+-- managed, and spread them over the screens and tags
+local spawned, managed = {}, 0
+local spawn_samples = {}
+table.insert(scenarios, "spawn_to_managed")
+results.spawn_to_managed = spawn_samples
+
+local function spawn_next()
+    local class = "stress_" .. (#spawn_samples + 1)
+    spawned[class] = now()
+    test_client(class)
+end
+
+client.connect_signal("manage", function(c)
+    local start = spawned[c.class]
+    if not start then
+        return
+    end
+    spawned[c.class] = nil
+    table.insert(spawn_samples, now() - start)
+
+    local s = screens[managed % #screens + 1]
+    c:move_to_screen(s)
+    c:tags { tags[s][math.floor(managed / #screens) % tag_count + 1] }
+    managed = managed + 1
+    if managed < client_count then
+        spawn_next()
+    end
+end)
+
+local _, textclock = create_wibox()
+
+runner.run_steps({
+    -- Split the screen into columns and give each column its tags
+    function()
+        local geo = screen[1].geometry
+        local width = math.floor(geo.width / screen_count)
+        screen[1]:fake_resize(geo.x, geo.y, width, geo.height)
+        screens[1] = screen[1]
+        for i = 2, screen_count do
+            screens[i] = screen.fake_add(geo.x + (i - 1) * width, geo.y, width, geo.height)
+        end
+
+        for _, s in ipairs(screens) do
+            local names = {}
+            for i = 1, tag_count do
+                names[i] = "stress" .. i
+            end
+            tags[s] = awful.tag(names, s, awful.layout.suit.tile)
+            tags[s][1]:view_only()
+        end
+        return true
+    end,
+
+    function()
+        spawn_next()
+        return true
+    end,
+
+    function()
+        return managed >= client_count or nil
+    end,
+
+    scenario("tag_switch", function()
+        for _, s in ipairs(screens) do
+            awful.tag.viewnext(s)
+        end
+    end),
+
+    scenario("focus_cycle", function()
+        awful.client.focus.byidx(1)
+    end),
+
+    scenario("relayout", function()
+        for _, s in ipairs(screens) do
+            awful.layout.arrange(s)
+        end
+    end),
+
+    scenario("wibox_redraw", function()
+        textclock:emit_signal("widget::redraw_needed")
+    end),
+
+    function()
+        report()
+        return true
+    end,
+}, { wait_per_step = 60 })
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
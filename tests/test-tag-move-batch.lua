@@ -0,0 +1,103 @@
+--- Tests for moving many clients to a tag at once
+
+local runner = require("_runner")
+local test_client = require("_client")
+
+local tagged, untagged, tags_changed = 0, 0, 0
+
+client.connect_signal("tagged", function() tagged = tagged + 1 end)
+client.connect_signal("untagged", function() untagged = untagged + 1 end)
+client.connect_signal("property::tags", function() tags_changed = tags_changed + 1 end)
+
+local t1, t2
+
+local function reset()
+    tagged, untagged, tags_changed = 0, 0, 0
+end
+
+runner.run_steps({
+    function()
+        t1, t2 = screen[1].tags[1], screen[1].tags[2]
+        for i = 1, 5 do
+            test_client("move" .. i, "move" .. i)
+        end
+        return true
+    end,
+    function()
+        if #client.get() < 5 then return end
+        for _, c in ipairs(client.get()) do
+            c:tags({ t1 })
+        end
+        client.get()[1]:tags({ t1, t2 })
+        reset()
+
+        client.move_to_tag(client.get(), t2)
+
+        -- Only the client already on t2 keeps it
+        assert(untagged == 5, untagged)
+        assert(tagged == 4, tagged)
+        assert(tags_changed == 5, tags_changed)
+        assert(#t1:clients() == 0)
+        assert(#t2:clients() == 5)
+        for _, c in ipairs(client.get()) do
+            local tags = c:tags()
+            assert(#tags == 1 and tags[1] == t2)
+        end
+
+        -- Nothing changes the second time
+        reset()
+        client.move_to_tag(client.get(), t2)
+        assert(tagged == 0 and untagged == 0 and tags_changed == 0)
+
+        -- Setting the same tags only emits property::tags
+        local c = client.get()[1]
+        c:tags({ t2, t2 })
+        assert(tagged == 0 and untagged == 0 and tags_changed == 1)
+
+        -- The tags are set before the signals are emitted
+        reset()
+        local function check(cl)
+            assert(#cl:tags() == 1 and cl:tags()[1] == t1)
+        end
+        client.connect_signal("untagged", check)
+        c:tags({ t1 })
+        client.disconnect_signal("untagged", check)
+        assert(tagged == 1 and untagged == 1)
+
+        -- tag:clear() moves the remaining clients to the fallback
+        t2:clear { fallback_tag = t1 }
+        assert(#t1:clients() == 5)
+        return true
+    end,
+    function()
+        -- t:clients() stays in tagging order when clients leave the middle
+        local clients = client.get()
+        t2:clients({})
+        for _, c in ipairs(clients) do
+            c:toggle_tag(t2)
+        end
+        clients[2]:toggle_tag(t2)
+        clients[4]:toggle_tag(t2)
+        clients[2]:toggle_tag(t2)
+
+        local expected = { clients[1], clients[3], clients[5], clients[2] }
+        local actual = t2:clients()
+        assert(#actual == #expected, #actual)
+        for i, c in ipairs(expected) do
+            assert(actual[i] == c, i)
+        end
+
+        -- Unmanaging a client removes it from all its tags
+        clients[3]:tags({ t1, t2 })
+        clients[3]:kill()
+        return true
+    end,
+    function()
+        if #client.get() > 4 then return end
+        assert(#t1:clients() == 4, #t1:clients())
+        assert(#t2:clients() == 3, #t2:clients())
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
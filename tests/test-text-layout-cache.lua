@@ -0,0 +1,74 @@
+--- Tests for the shared text layouts of textboxes
+
+local runner = require("_runner")
+local wibox = require("wibox")
+local beautiful = require("beautiful")
+local lgi = require("lgi")
+local Pango = lgi.Pango
+local PangoCairo = lgi.PangoCairo
+
+local function lgi_size(markup, font, dpi)
+    local ctx = PangoCairo.font_map_get_default():create_context()
+    ctx:set_resolution(dpi)
+    local layout = Pango.Layout.new(ctx)
+    layout:set_font_description(beautiful.get_font(font))
+    layout:set_markup(markup, -1)
+    local _, logical = layout:get_pixel_extents()
+    return logical.width, logical.height
+end
+
+local w
+
+runner.run_steps({
+    function()
+        local markup = "<b>some</b> text"
+        local box = wibox.widget.textbox(markup)
+
+        -- The same size as a layout of its own
+        local width, height = box:get_preferred_size_at_dpi(96)
+        local lgi_width, lgi_height = lgi_size(markup, beautiful.font, 96)
+        assert(width == lgi_width and height == lgi_height,
+            width .. "x" .. height .. " vs " .. lgi_width .. "x" .. lgi_height)
+
+        -- Settings are part of the key
+        box.font = "monospace 20"
+        local w2, h2 = box:get_preferred_size_at_dpi(96)
+        assert(h2 > height, h2)
+        local w3, h3 = box:get_preferred_size_at_dpi(192)
+        assert(w3 > w2 and h3 > h2, w3 .. "x" .. h3)
+
+        -- Wrapping
+        box.font = beautiful.font
+        assert(box:get_height_for_width_at_dpi(width / 2, 96) > height)
+
+        -- Handles outlive eviction
+        awesome.set_text_layout_cache_limit(0)
+        local layout = awesome.text_layout(box._private.layout_args, nil, nil, 96)
+        awesome.text_layout_size({ text = "other" }, nil, nil, 96)
+        assert(layout.draw)
+        awesome.set_text_layout_cache_limit(4 * 1024 * 1024)
+
+        w = wibox {
+            x       = 10,
+            y       = 10,
+            width   = 200,
+            height  = 40,
+            visible = true,
+            widget  = {
+                wibox.widget.textbox(markup),
+                wibox.widget.textbox(markup),
+                layout = wibox.layout.fixed.vertical,
+            },
+        }
+        return true
+    end,
+    function()
+        -- Drawing through the shared layout works
+        local boxes = w:find_widgets(5, 5)
+        assert(#boxes > 0)
+        w.visible = false
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
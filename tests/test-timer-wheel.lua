@@ -0,0 +1,106 @@
+--- Tests for awesome.timer_start() and gears.timer on top of it
+
+local runner = require("_runner")
+local gtimer = require("gears.timer")
+local GLib = require("lgi").GLib
+
+local fired = {}
+local ids = {}
+local slacked = {}
+local stalled = {}
+
+local function now()
+    return GLib.get_monotonic_time() / 1e6
+end
+
+runner.run_steps({
+    function()
+        -- Timers with the same slack run together
+        for i = 1, 10 do
+            local t = gtimer { timeout = 0.05, slack = 0.2 }
+            t:connect_signal("timeout", function()
+                slacked[i] = (slacked[i] or 0) + 1
+                t:stop()
+            end)
+            t:start()
+            assert(t.started and t.slack == 0.2)
+        end
+
+        ids.repeating = awesome.timer_start(0.01, function()
+            fired.repeating = (fired.repeating or 0) + 1
+        end)
+        ids.stopped = awesome.timer_start(0.01, function()
+            fired.stopped = true
+        end)
+        assert(awesome.timer_stop(ids.stopped))
+        assert(not awesome.timer_stop(ids.stopped))
+
+        local self_id
+        self_id = awesome.timer_start(0, function()
+            fired.self = (fired.self or 0) + 1
+            awesome.timer_stop(self_id)
+        end)
+
+        assert(not pcall(awesome.timer_start, -1, function() end))
+        return true
+    end,
+    function()
+        if (fired.repeating or 0) < 5 or #slacked < 10 then
+            return
+        end
+        assert(not fired.stopped)
+        assert(fired.self == 1)
+        for i = 1, 10 do
+            assert(slacked[i] == 1)
+        end
+        assert(awesome.timer_stop(ids.repeating))
+        return true
+    end,
+    function()
+        -- single_shot and again() still work
+        local count = 0
+        local t = gtimer { timeout = 0.01, single_shot = true, autostart = true,
+                           callback = function() count = count + 1 end }
+        t:again()
+        ids.single = t
+        ids.count = function() return count end
+        return true
+    end,
+    function()
+        if ids.count() == 0 then
+            return
+        end
+        assert(ids.count() == 1)
+        assert(not ids.single.started)
+        return true
+    end,
+    function()
+        -- A timer which falls several periods behind runs once to catch up,
+        -- not once per missed period
+        ids.stalled = awesome.timer_start(0.01, function()
+            table.insert(stalled, now())
+            if #stalled == 1 then
+                local stop = now() + 0.1
+                repeat until now() >= stop
+                stalled.resumed = now()
+            end
+        end)
+        return true
+    end,
+    function()
+        if #stalled < 5 then
+            return
+        end
+        assert(awesome.timer_stop(ids.stalled))
+        local burst = 0
+        for i = 2, #stalled do
+            if stalled[i] - stalled.resumed < 0.005 then
+                burst = burst + 1
+            end
+        end
+        assert(burst <= 1, burst)
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
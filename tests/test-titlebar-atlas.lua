@@ -0,0 +1,56 @@
+--- Tests for client.set_titlebar_atlas()
+
+local runner = require("_runner")
+local test_client = require("_client")
+
+local c
+local before
+
+local function drawable_pixmaps()
+    return awesome.memory_stats().pixmaps.drawable.count
+end
+
+runner.run_steps({
+    function()
+        test_client("atlas", "atlas")
+        return true
+    end,
+    function()
+        c = client.get()[1]
+        if not c then return end
+
+        for _, bar in ipairs { "top", "bottom", "left", "right" } do
+            c["titlebar_" .. bar](c, 10)
+        end
+        before = drawable_pixmaps()
+
+        client.set_titlebar_atlas(true)
+        -- The four titlebars share a single pixmap
+        assert(drawable_pixmaps() == before - 3, drawable_pixmaps())
+        for _, bar in ipairs { "top", "bottom", "left", "right" } do
+            assert(c["titlebar_" .. bar](c).surface, bar)
+        end
+        return true
+    end,
+    function()
+        -- Small resizes fit in the atlas
+        local geo = c:geometry()
+        c:geometry { width = geo.width + 5, height = geo.height + 5 }
+        assert(drawable_pixmaps() == before - 3, drawable_pixmaps())
+        assert(c:titlebar_bottom().surface)
+
+        -- Removing all titlebars frees it
+        for _, bar in ipairs { "top", "bottom", "left", "right" } do
+            c["titlebar_" .. bar](c, 0)
+        end
+        assert(drawable_pixmaps() == before - 4, drawable_pixmaps())
+
+        client.set_titlebar_atlas(false)
+        c:titlebar_top(10)
+        assert(c:titlebar_top().surface)
+        assert(drawable_pixmaps() == before - 3, drawable_pixmaps())
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
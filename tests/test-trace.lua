@@ -0,0 +1,40 @@
+--- Tests for awesome.trace_start() and awesome.trace_stop()
+
+local runner = require("_runner")
+
+local path = os.tmpname()
+
+runner.run_steps({
+    function()
+        assert(awesome.trace_start(path))
+        awesome.connect_signal("test::trace", function() end)
+        awesome.emit_signal("test::trace")
+        awesome.sync()
+        return true
+    end,
+    function(count)
+        -- Let a few main loop iterations be traced
+        if count < 3 then
+            return
+        end
+        awesome.trace_stop()
+
+        local f = assert(io.open(path))
+        local trace = f:read("*a")
+        f:close()
+        os.remove(path)
+
+        assert(trace:match('^{"displayTimeUnit":"ms","traceEvents":%['), trace:sub(1, 80))
+        assert(trace:match('%]}\n$'))
+        assert(trace:find('"name":"test::trace","cat":"signal"', 1, true))
+        assert(trace:find('"name":"iteration","cat":"loop"', 1, true))
+        assert(trace:find('"name":"refresh","cat":"loop"', 1, true))
+        assert(trace:find('"cat":"x_wait"', 1, true))
+
+        -- A file that cannot be created is reported
+        assert(not awesome.trace_start("/nonexistent/trace.json"))
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
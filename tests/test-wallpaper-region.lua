@@ -0,0 +1,36 @@
+--- Tests for root.wallpaper_region()
+
+local runner = require("_runner")
+local gears_color = require("gears.color")
+
+local changes = {}
+awesome.connect_signal("wallpaper_changed", function(area)
+    table.insert(changes, area or false)
+end)
+
+runner.run_steps({
+    function()
+        local s = screen.primary
+        assert(root.wallpaper(gears_color("#ff0000")))
+        assert(#changes == 1 and changes[1] == false)
+
+        -- Only the screen's part is repainted
+        local geo = s.geometry
+        assert(root.wallpaper_region(gears_color("#00ff00"), geo))
+        assert(#changes == 2)
+        local area = changes[2]
+        assert(area.x == geo.x and area.y == geo.y)
+        assert(area.width == geo.width and area.height == geo.height)
+
+        -- Areas outside of the root window are rejected
+        assert(not root.wallpaper_region(gears_color("#0000ff"),
+            { x = -100, y = -100, width = 50, height = 50 }))
+        assert(#changes == 2)
+
+        -- The wallpaper can still be read
+        assert(root.wallpaper())
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,50 @@
+-- Test that relayouts through the native hierarchy core are tracked
+
+local runner = require("_runner")
+local wibox = require("wibox")
+
+local text = wibox.widget.textbox("a")
+local counted = wibox.widget.textbox("b")
+wibox.hierarchy.count_widget(counted)
+
+local w = wibox {
+    visible = true,
+    x       = 10,
+    y       = 10,
+    width   = 200,
+    height  = 20,
+    widget  = {
+        text,
+        counted,
+        layout = wibox.layout.fixed.horizontal,
+    },
+}
+
+runner.run_steps({
+    function()
+        local h = w._drawable._widget_hierarchy
+        if not h then return end
+        assert(h:get_count(counted) == 1, h:get_count(counted))
+        assert(h:get_count(text) == 0)
+
+        local width, height = h:get_size()
+        assert(width == 200 and height == 20, width .. "x" .. height)
+
+        local found = w:find_widgets(1, 1)
+        assert(#found > 0)
+        return true
+    end,
+    function(count)
+        if count == 1 then
+            -- A longer text moves the second widget
+            text.text = "a much longer text"
+            return
+        end
+        local found = w:find_widgets(100, 5)
+        for _, f in ipairs(found) do
+            if f.widget == text then return true end
+        end
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
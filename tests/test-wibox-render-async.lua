@@ -0,0 +1,49 @@
+-- Test wiboxes whose widgets are rasterized on a render thread
+
+local runner = require("_runner")
+local wibox = require("wibox")
+local gears_surface = require("gears.surface")
+local lgi = require("lgi")
+local gdk = lgi.require("Gdk", "3.0")
+
+local function get_pixel(x, y)
+    local img = gears_surface(root.content { x = x, y = y, width = 1, height = 1 })
+    local bytes = gdk.pixbuf_get_from_surface(img, 0, 0, 1, 1):get_pixels()
+    return "#" .. bytes:gsub('.', function(c) return ('%02x'):format(c:byte()) end)
+end
+
+local w = wibox {
+    bg           = "#00ff00",
+    visible      = true,
+    x            = 50,
+    y            = 50,
+    width        = 100,
+    height       = 100,
+    render_async = true,
+}
+
+runner.run_steps({
+    function()
+        assert(w.render_async)
+        return get_pixel(100, 100) == "#00ff00"
+    end,
+    function(count)
+        if count == 1 then
+            -- Later frames replace earlier ones
+            w.bg = "#ff0000"
+            w.bg = "#0000ff"
+        end
+        return get_pixel(100, 100) == "#0000ff"
+    end,
+    function(count)
+        if count == 1 then
+            -- Switching back draws directly again
+            w.render_async = false
+            w.bg = "#ff0000"
+            assert(not w.render_async)
+        end
+        return get_pixel(100, 100) == "#ff0000"
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,53 @@
+--- Tests for awesome.x_stats()
+
+local runner = require("_runner")
+
+runner.run_steps({
+    function()
+        local stats = awesome.x_stats()
+        assert(stats.requests > 0, stats.requests)
+        assert(stats.flushes > 0, stats.flushes)
+        assert(stats.wait >= 0)
+
+        -- The startup needed some replies, all of them are attributed
+        local waits = 0
+        for name, site in pairs(stats.sites) do
+            assert(name:match(":%d+$"), name)
+            assert(site.max <= site.wait, name)
+            waits = waits + site.count
+        end
+        assert(waits == stats.waits, waits)
+        assert(waits > 0)
+
+        awesome.set_x_wait_warning(100)
+        return true
+    end,
+    function()
+        -- A blocking round trip is recorded
+        awesome.x_stats(true)
+        awesome.sync()
+        local stats = awesome.x_stats()
+        assert(stats.waits == 1, stats.waits)
+        assert(stats.requests > 0, stats.requests)
+
+        awesome.set_x_wait_warning(0)
+        return true
+    end,
+    function()
+        -- Mapping a drawin ignores the enter and leave events it causes
+        awesome.x_stats(true)
+        local before = awesome.x_stats()
+        assert(before.enter_leave_ignores == 0, before.enter_leave_ignores)
+
+        local d = drawin { x = 0, y = 0, width = 10, height = 10 }
+        d.visible = true
+
+        local after = awesome.x_stats()
+        assert(after.enter_leave_ignores >= 1, after.enter_leave_ignores)
+        assert(after.enter_leave_pending >= 1, after.enter_leave_pending)
+        d.visible = false
+        return true
+    end,
+})
+
+-- vim: filetype=lua:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
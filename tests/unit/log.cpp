@@ -0,0 +1,187 @@
+/*
+ * log.cpp - check the rate limiting and the formats of the log writer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* The log is written to stdout, which is pointed at a temporary file whose
+ * content is checked after each part. */
+
+#include "common/log.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                 \
+    do {                                                 \
+        if (!(cond)) {                                   \
+            std::fprintf(stderr, "line %d: ", __LINE__); \
+            std::fprintf(stderr, __VA_ARGS__);           \
+            std::fprintf(stderr, "\n");                  \
+            failures++;                                  \
+        }                                                \
+    } while (0)
+
+static char path[] = "/tmp/awesome-log-test-XXXXXX";
+
+/** Get what was written since the last call */
+static std::string take_output() {
+    Log::flush();
+    std::fflush(stdout);
+    std::string out;
+    const int fd = open(path, O_RDONLY);
+    char buf[4096];
+    for (ssize_t n; (n = read(fd, buf, sizeof(buf))) > 0;) {
+        out.append(buf, size_t(n));
+    }
+    close(fd);
+    if (ftruncate(STDOUT_FILENO, 0) != 0 || lseek(STDOUT_FILENO, 0, SEEK_SET) != 0) {
+        std::perror("truncating the output");
+        std::exit(1);
+    }
+    return out;
+}
+
+static std::vector<std::string> lines_of(const std::string& out) {
+    std::vector<std::string> lines;
+    std::istringstream in(out);
+    for (std::string line; std::getline(in, line);) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+/** Wait for the start of a second, the rate limit counts per second */
+static void wait_for_next_second() {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &start);
+    do {
+        usleep(1000);
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    } while (now.tv_sec == start.tv_sec);
+}
+
+/** All messages come from the same call site */
+static void spam(std::string_view message) {
+    Log::write('W', std::source_location::current(), message);
+}
+
+static void check_rate_limit(bool json) {
+    Log::set_json(json);
+    wait_for_next_second();
+    for (int i = 0; i < 10; i++) {
+        spam("spam");
+    }
+    auto lines = lines_of(take_output());
+    CHECK(lines.size() == 3, "%zu lines instead of 3 with a limit of 3", lines.size());
+
+    wait_for_next_second();
+    spam("spam");
+    lines = lines_of(take_output());
+    CHECK(lines.size() == 1, "%zu lines after the limit", lines.size());
+    const std::string suffix = json ? R"(,"suppressed":7})" : " (7 similar messages suppressed)";
+    CHECK(!lines.empty() && lines[0].ends_with(suffix),
+          "no suppressed count in '%s'",
+          lines.empty() ? "" : lines[0].c_str());
+}
+
+static void check_json() {
+    Log::set_json(true);
+    Log::write('W', std::source_location::current(), "a \"quoted\"\nline\t\x01\\");
+    const std::string out = take_output();
+    CHECK(out.starts_with(R"({"time":")") && out.ends_with("}\n") &&
+            lines_of(out).size() == 1,
+          "not one JSON object: %s",
+          out.c_str());
+    CHECK(out.find(R"("level":"warning")") != std::string::npos, "no level in %s", out.c_str());
+    CHECK(out.find(R"("message":"a \"quoted\"\nline\t\u0001\\")") != std::string::npos,
+          "badly escaped message in %s",
+          out.c_str());
+    CHECK(out.find("suppressed") == std::string::npos, "suppressed count in %s", out.c_str());
+}
+
+/** Lines of several threads all come out, each thread's in order */
+static void check_async() {
+    constexpr int threads = 4, per_thread = 200;
+    Log::set_json(false);
+    Log::set_rate_limit(0);
+    Log::set_async(true);
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < threads; t++) {
+        writers.emplace_back([t] {
+            for (int i = 0; i < per_thread; i++) {
+                Log::write('W',
+                           std::source_location::current(),
+                           "thread " + std::to_string(t) + " line " + std::to_string(i));
+                if (i % 5 == 0) {
+                    Log::flush();
+                }
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    std::vector<int> next(threads, 0);
+    int count = 0;
+    for (const auto& line : lines_of(take_output())) {
+        int t, i;
+        const auto at = line.find("thread ");
+        if (at == std::string::npos ||
+            std::sscanf(line.c_str() + at, "thread %d line %d", &t, &i) != 2 || t < 0 ||
+            t >= threads) {
+            CHECK(false, "unexpected line '%s'", line.c_str());
+            continue;
+        }
+        CHECK(i == next[t], "thread %d wrote line %d after %d", t, i, next[t] - 1);
+        next[t] = i + 1;
+        count++;
+    }
+    CHECK(count == threads * per_thread, "%d lines instead of %d", count, threads * per_thread);
+}
+
+int main() {
+    const int fd = mkstemp(path);
+    if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0) {
+        std::perror("redirecting the output");
+        return 1;
+    }
+    close(fd);
+
+    Log::set_async(false);
+    Log::set_rate_limit(3);
+    check_rate_limit(false);
+    check_rate_limit(true);
+    check_json();
+    check_async();
+
+    unlink(path);
+    std::fprintf(stderr, "log: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,150 @@
+/*
+ * luaalloc.cpp - check the pool allocator of the Lua state
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* The allocator is called directly, its statistics are read back through a
+ * plain Lua state. */
+
+#include "luaalloc.h"
+
+#include "profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                 \
+    do {                                                 \
+        if (!(cond)) {                                   \
+            std::fprintf(stderr, "line %d: ", __LINE__); \
+            std::fprintf(stderr, __VA_ARGS__);           \
+            std::fprintf(stderr, "\n");                  \
+            failures++;                                  \
+        }                                                \
+    } while (0)
+
+/* The phase names live with the rest of the profiler, which needs the whole
+ * window manager */
+std::string_view Profiler::name(Phase) { return "phase"; }
+
+static lua_State* L;
+
+static void* allocate(void* ptr, size_t osize, size_t nsize) {
+    return LuaAlloc::allocate(nullptr, ptr, osize, nsize);
+}
+
+/** A field of the statistics, pools[index] if index is not 0, else large */
+static lua_Integer stat(int index, const char* field) {
+    LuaAlloc::push_stats(L);
+    lua_getfield(L, -1, index ? "pools" : "large");
+    if (index) {
+        lua_rawgeti(L, -1, index);
+        lua_remove(L, -2);
+    }
+    lua_getfield(L, -1, field);
+    const lua_Integer value = lua_tointeger(L, -1);
+    lua_pop(L, 3);
+    return value;
+}
+
+/* The classes are 16, 32, 48, 64, 96, 128, 192, 256, 384 and 512 bytes */
+constexpr int class_48 = 3, class_128 = 6;
+
+static void check_reuse() {
+    CHECK(stat(class_48, "size") == 48, "class 3 has %ld bytes", long(stat(class_48, "size")));
+    const lua_Integer allocs = stat(class_48, "allocs");
+
+    /* A freed block is handed out again for any size of its class */
+    void* a = allocate(nullptr, 0, 40);
+    allocate(a, 40, 0);
+    void* b = allocate(nullptr, 0, 33);
+    CHECK(a == b, "a freed 48 byte block was not reused");
+    CHECK(stat(class_48, "count") == 1, "%ld live blocks", long(stat(class_48, "count")));
+    CHECK(stat(class_48, "allocs") == allocs + 2,
+          "%ld blocks handed out",
+          long(stat(class_48, "allocs") - allocs));
+
+    /* Growing within the class keeps the block */
+    std::memset(b, 0x5a, 33);
+    CHECK(allocate(b, 33, 48) == b, "growing within the class moved the block");
+
+    /* Growing past it moves the content to the next class */
+    void* c = allocate(b, 48, 100);
+    CHECK(c != b, "growing past the class kept the block");
+    CHECK(std::memcmp(c, std::string(48, '\x5a').data(), 33) == 0, "the content was not moved");
+    CHECK(stat(class_48, "count") == 0, "the old block is still live");
+    CHECK(stat(class_128, "count") == 1, "the new block is not live");
+
+    /* The old block is free again */
+    void* d = allocate(nullptr, 0, 48);
+    CHECK(d == b, "the block left behind was not reused");
+    allocate(d, 48, 0);
+    allocate(c, 100, 0);
+    CHECK(stat(class_128, "count") == 0, "the moved block is still live");
+}
+
+static void check_large() {
+    const lua_Integer allocs = stat(0, "allocs");
+    const lua_Integer pooled = stat(class_128, "allocs");
+
+    /* Blocks over 512 bytes come from malloc */
+    void* a = allocate(nullptr, 0, 1000);
+    CHECK(stat(0, "count") == 1, "%ld large blocks", long(stat(0, "count")));
+    CHECK(stat(0, "bytes") == 1000, "%ld large bytes", long(stat(0, "bytes")));
+    CHECK(stat(0, "allocs") == allocs + 1, "the large block was not counted");
+    std::memset(a, 0x3c, 1000);
+
+    /* Staying large is a realloc */
+    a = allocate(a, 1000, 4000);
+    CHECK(a, "the large block could not grow");
+    CHECK(stat(0, "count") == 1 && stat(0, "bytes") == 4000,
+          "%ld large blocks of %ld bytes after growing",
+          long(stat(0, "count")),
+          long(stat(0, "bytes")));
+
+    /* Shrinking into a class goes back to the pools and keeps the start */
+    void* b = allocate(a, 4000, 100);
+    CHECK(stat(0, "count") == 0 && stat(0, "bytes") == 0, "the large block is still live");
+    CHECK(stat(class_128, "allocs") == pooled + 1, "the small block is not from the pool");
+    CHECK(std::memcmp(b, std::string(100, '\x3c').data(), 100) == 0, "the content was lost");
+
+    /* And back */
+    void* c = allocate(b, 100, 513);
+    CHECK(stat(0, "count") == 1 && stat(0, "bytes") == 513, "513 bytes are not a large block");
+    CHECK(std::memcmp(c, std::string(100, '\x3c').data(), 100) == 0, "the content was lost");
+    allocate(c, 513, 0);
+    CHECK(stat(0, "count") == 0 && stat(0, "bytes") == 0, "the large block was not freed");
+
+    /* Lua frees NULL with a made up size */
+    allocate(nullptr, 1000, 0);
+    CHECK(stat(0, "count") == 0, "freeing NULL changed the count");
+}
+
+int main() {
+    L = luaL_newstate();
+    check_reuse();
+    check_large();
+    lua_close(L);
+
+    std::fprintf(stderr, "luaalloc: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80
@@ -0,0 +1,108 @@
+/*
+ * premultiply.cpp - check the premultiplication kernels against the scalar ones
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* The kernels picked for this CPU must give the same bits as the scalar
+ * versions, for every alpha and channel value, and for lengths and addresses
+ * which leave a tail to the scalar code. */
+
+#include "premultiply.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const char* what, size_t n, size_t offset) {
+    if (!ok && failures++ < 10) {
+        std::fprintf(stderr, "%s differs, %zu pixels at offset %zu\n", what, n, offset);
+    }
+}
+
+/** Compare both kernels on n pixels starting that many bytes into the buffers */
+static void compare(const std::vector<uint32_t>& argb_in, size_t n, size_t offset) {
+    /* Extra room for the offset, the rgba source is unaligned by bytes */
+    std::vector<uint8_t> storage(4 * n + 4 * 4 + 4), expected(4 * n + 4 * 4 + 4),
+      got(4 * n + 4 * 4 + 4);
+    uint8_t* src = storage.data() + offset;
+    if (n > 0) {
+        std::memcpy(src, argb_in.data(), 4 * n);
+    }
+
+    auto* want = reinterpret_cast<uint32_t*>(expected.data() + 4 * (offset % 4));
+    auto* have = reinterpret_cast<uint32_t*>(got.data() + 4 * (offset % 4));
+
+    if (offset % 4 == 0) {
+        Premultiply::argb_scalar(want, reinterpret_cast<const uint32_t*>(src), n);
+        Premultiply::argb(have, reinterpret_cast<const uint32_t*>(src), n);
+        check(std::memcmp(want, have, 4 * n) == 0, "argb", n, offset);
+    }
+
+    std::memset(want, 0, 4 * n);
+    std::memset(have, 0, 4 * n);
+    Premultiply::rgba_scalar(want, src, n);
+    Premultiply::rgba(have, src, n);
+    check(std::memcmp(want, have, 4 * n) == 0, "rgba", n, offset);
+}
+
+int main() {
+    /* Every alpha with every value of every channel, the channels differ so
+     * that mixing them up shows */
+    std::vector<uint32_t> all;
+    all.reserve(256 * 256);
+    for (unsigned a = 0; a < 256; a++) {
+        for (unsigned x = 0; x < 256; x++) {
+            all.push_back(a << 24 | x << 16 | (255 - x) << 8 | (x ^ 0x5a));
+        }
+    }
+
+    /* The scalar version rounds like x * a / 255 */
+    std::vector<uint32_t> scalar(all.size());
+    Premultiply::argb_scalar(scalar.data(), all.data(), all.size());
+    for (size_t i = 0; i < all.size(); i++) {
+        const unsigned a = all[i] >> 24;
+        for (unsigned shift = 0; shift < 24; shift += 8) {
+            const unsigned x = (all[i] >> shift) & 0xff;
+            const unsigned want = (x * a + 127) / 255;
+            const unsigned got = (scalar[i] >> shift) & 0xff;
+            if (got != want && failures++ < 10) {
+                std::fprintf(stderr, "scalar: %u * %u gave %u\n", x, a, got);
+            }
+        }
+    }
+
+    compare(all, all.size(), 0);
+
+    /* Short and odd lengths, from aligned and unaligned addresses */
+    for (size_t n = 0; n <= 35; n++) {
+        for (size_t offset = 0; offset < 16; offset++) {
+            std::vector<uint32_t> part(all.begin() + 1000 * n, all.begin() + 1000 * n + n);
+            compare(part, n, offset);
+        }
+    }
+
+    std::printf("%s kernels: %s\n",
+                std::string(Premultiply::implementation()).c_str(),
+                failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
+
+// vim: filetype=c:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:textwidth=80